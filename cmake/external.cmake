@@ -262,3 +262,43 @@ SET_TARGET_PROPERTIES(gmock_main PROPERTIES IMPORTED_LOCATION
     "${INSTALL_DIR}/lib/libgmock_main.a")
 
 SET(GMOCK_DIR "${INSTALL_DIR}")
+
+# Use Google Benchmark from the system if it is installed.
+FIND_PACKAGE(benchmark QUIET CONFIG)
+
+IF(benchmark_FOUND)
+    SET(BENCHMARK_LIBRARIES benchmark::benchmark)
+ELSE(benchmark_FOUND)
+    ExternalProject_Add(
+        googlebenchmark
+
+        GIT_REPOSITORY https://github.com/google/benchmark.git
+        GIT_TAG v1.5.0
+
+        PREFIX ${CMAKE_CURRENT_BINARY_DIR}/googlebenchmark
+
+        # Only fetched when the benchmarks are built.
+        EXCLUDE_FROM_ALL 1
+
+        CMAKE_ARGS -DCMAKE_INSTALL_PREFIX:PATH=<INSTALL_DIR> -DCMAKE_BUILD_TYPE=Release -DBENCHMARK_ENABLE_TESTING=OFF -DBENCHMARK_ENABLE_GTEST_TESTS=OFF "-DCMAKE_CXX_FLAGS=-std=c++11 ${SPECIAL_COMPILER_FLAGS}"
+
+        # Dump output to a log instead of the screen.
+        LOG_DOWNLOAD ON
+        LOG_CONFIGURE ON
+        LOG_BUILD ON
+        LOG_INSTALL ON
+
+        BUILD_BYPRODUCTS <INSTALL_DIR>/lib/libbenchmark.a
+    )
+
+    ExternalProject_Get_Property(googlebenchmark INSTALL_DIR)
+
+    SET(BENCHMARK_INCLUDE_DIRS "${INSTALL_DIR}/include")
+
+    ADD_LIBRARY(benchmark STATIC IMPORTED)
+    ADD_DEPENDENCIES(benchmark googlebenchmark)
+    SET_TARGET_PROPERTIES(benchmark PROPERTIES IMPORTED_LOCATION
+        "${INSTALL_DIR}/lib/libbenchmark.a")
+
+    SET(BENCHMARK_LIBRARIES benchmark)
+ENDIF(benchmark_FOUND)
@@ -65,29 +65,123 @@ FILE_HEADER = """/**
 #ifndef LIBCOMP_SRC_DECRYPT_LOOKUPTABLECP%CP%_H
 #define LIBCOMP_SRC_DECRYPT_LOOKUPTABLECP%CP%_H
 
-/// Table that contains data needed to convert between Unicode
-/// and Windows code page %CP%.
-static unsigned char LookupTableCP%CP%[] = {
+#include <stdint.h>
+
+/// Code page %CP% code point used for Unicode code points that have no
+/// mapping (including everything past U+FFFF).
+static const uint16_t LookupTableCP%CP%Default = 0x%DEFAULT%;
+
+/// Page of LookupTableCP%CP%Pages that maps every code page %CP% code point
+/// to the default Unicode character. A byte whose entry in
+/// LookupTableCP%CP%ToUnicode is this page is not a lead byte.
+static const uint8_t LookupTableCP%CP%UnmappedPage = %UNMAPPED%;
+
+/// Page of LookupTableCP%CP%Pages for each block of 256 Unicode code points
+/// (the high byte of the code point).
+static const uint8_t LookupTableCP%CP%FromUnicode[256] = {
+%FROM%
+};
+
+/// Page of LookupTableCP%CP%Pages for each block of 256 code page %CP% code
+/// points (the lead byte). The first page holds the single byte code points.
+static const uint8_t LookupTableCP%CP%ToUnicode[256] = {
+%TO%
+};
+
+/// Pages of 256 mappings used by both directions. Identical pages (like
+/// the ones that only hold the default character) are only stored once.
+static const uint16_t LookupTableCP%CP%Pages[][256] = {
 """
 
 # This should appear at the end of the file. All instances of %CP% will be
 # replaced with the code page number.
-FILE_FOOTER = """\n};
-
-#endif // LIBCOMP_SRC_DECRYPT_LOOKUPTABLECP%CP%_H\n"""
-
-
-# Generate a header file that contains an array of mappings between Unicode and
-# Windows code page codepoints. The array is simply a series of 16-bit values
-# in little endian byte order. For example, it can be cast to the uint16_t type
-# and the index would be the Unicode code point. The returned value would then
-# be the Windows code page codepoint. Depending on the code page, this value
-# may be 8 bits (like CP1252), 16 bits, or either depending on the value of the
-# code point (lookup how CP932 works - it is a lot like ShiftJIS). Note that
-# this is Unicode code points and not encodings so UTF-8, UTF-16, etc. need to
-# be parsed and converted first. To access the other mapping, Windows code page
-# to Unicode codepoints, offset the array by 128KiB or 2^16 16-bit elements and
-# cast the array to the uint16_t type again. The resulting header files will be
+FILE_FOOTER = """};
+
+#endif // LIBCOMP_SRC_DECRYPT_LOOKUPTABLECP%CP%_H
+"""
+
+
+# Format a list of integers as the lines of a C array initializer.
+# values  - Values to format.
+# perLine - Number of values on each line.
+# fmt     - Format of each value.
+def formatArray(values, perLine, fmt):
+	lines = []
+
+	for i in range(0, len(values), perLine):
+		lines.append("    " + ", ".join([fmt % v for v in
+			values[i:i + perLine]]) + ",")
+
+	# The last value does not get a comma.
+	return "\n".join(lines)[:-1]
+
+
+# Split both mappings into pages of 256 code points and write them to the
+# header file LookupTableCP{cpnum}.h in the current working directory. Most
+# of each mapping is the default character so storing the unique pages and
+# the page of each high byte makes the tables a fraction of the size of two
+# flat arrays of 2^16 values. A lookup is then:
+#   Pages[FromUnicode[uni >> 8]][uni & 0xFF]
+#   Pages[ToUnicode[cp >> 8]][cp & 0xFF]
+# cpnum              - Number of the Windows code page.
+# mappingFromUnicode - Code page code point for each of the 2^16 Unicode
+#                      code points.
+# mappingToUnicode   - Unicode code point for each of the 2^16 code page
+#                      code points.
+# defaultCP          - Code page code point used for unmapped Unicode.
+# defaultUni         - Unicode code point used for unmapped code points.
+def writeLookup(cpnum, mappingFromUnicode, mappingToUnicode, defaultCP,
+		defaultUni):
+	pages = []
+	pageIndex = {}
+
+	# Find (or add) the page of each high byte of a mapping.
+	def pageMap(mapping):
+		result = []
+
+		for high in range(256):
+			page = tuple(mapping[high * 256:(high + 1) * 256])
+
+			if page not in pageIndex:
+				pageIndex[page] = len(pages)
+				pages.append(page)
+
+			result.append(pageIndex[page])
+
+		return result
+
+	fromPages = pageMap(mappingFromUnicode)
+	toPages = pageMap(mappingToUnicode)
+
+	if len(pages) > 256:
+		raise Exception("Too many unique pages for CP%d." % cpnum)
+
+	# The page a byte that is not a lead byte gets. If there is no such page
+	# the index is past the end so no byte matches it.
+	unmapped = tuple([defaultUni for i in range(256)])
+	unmappedPage = pageIndex.get(unmapped, len(pages))
+
+	lookupFile = open("LookupTableCP%d.h" % cpnum, "w")
+	lookupFile.write(FILE_HEADER.replace("%CP%", str(cpnum)).replace(
+		"%DEFAULT%", "%04x" % defaultCP).replace(
+		"%UNMAPPED%", str(unmappedPage)).replace(
+		"%FROM%", formatArray(fromPages, 16, "%3d")).replace(
+		"%TO%", formatArray(toPages, 16, "%3d")))
+
+	for i in range(len(pages)):
+		lookupFile.write("    {\n" + formatArray(pages[i], 8, "0x%04x") +
+			("\n    },\n" if i + 1 < len(pages) else "\n    }\n"))
+
+	lookupFile.write(FILE_FOOTER.replace("%CP%", str(cpnum)))
+	lookupFile.close()
+
+
+# Generate a header file with the mappings between Unicode and Windows code
+# page code points (see writeLookup). Depending on the code page, a code page
+# value may be 8 bits (like CP1252), 16 bits, or either depending on the value
+# of the code point (lookup how CP932 works - it is a lot like ShiftJIS). Note
+# that this is Unicode code points and not encodings so UTF-8, UTF-16, etc.
+# need to be parsed and converted first. The resulting header files will be
 # written to the current working directory.
 # url   - URL of the Unicode mapping file to download and use when generating
 #         the array of mapping entries.
@@ -100,6 +194,10 @@ def generateLookup(url, cpnum):
 	mappingToUnicode = [0 for i in range(2 ** 16)]
 	mappingFromUnicode = [0 for i in range(2 ** 16)]
 
+	# Characters used for code points that have no mapping.
+	defaultCP = 0
+	defaultUni = 0
+
 	# Download the file from the specified URL and process each line looking
 	# for mapping values.
 	if USE_BESTFIT:
@@ -158,12 +256,12 @@ def generateLookup(url, cpnum):
 					continue
 
 				# Default characters during conversion.
-				cp = int(match.group(2), 16)
-				uni = int(match.group(3), 16)
+				defaultCP = int(match.group(2), 16)
+				defaultUni = int(match.group(3), 16)
 
 				# Fill the arrays with default characters.
-				mappingToUnicode = [uni for i in range(2 ** 16)]
-				mappingFromUnicode = [cp for i in range(2 ** 16)]
+				mappingToUnicode = [defaultUni for i in range(2 ** 16)]
+				mappingFromUnicode = [defaultCP for i in range(2 ** 16)]
 
 				# Move to the next parse state.
 				parseState = 2
@@ -309,52 +407,9 @@ def generateLookup(url, cpnum):
 				mappingToUnicode[cp] = uni
 				mappingFromUnicode[uni] = cp
 
-	# Open the output file named LookupTableCP{cpnum}.h where {cpnum} is the
-	# code page value passed to the method. After opening the file, write the
-	# header replacing all instances of %CP% with the same code page value that
-	# was passed into the method. Finally, write a tab to start the first line
-	# of the Unicode to Windows code page mapping portion of the array.
-	lookupFile = open("LookupTableCP%d.h" % cpnum, "w")
-	lookupFile.write(FILE_HEADER.replace("%CP%", str(cpnum)))
-	lookupFile.write('\t')
-
-	# Loop over the Unicode to Windows code page mapping array for each of the
-	# 2^16 codepoints we intend to convert. Write the two bytes of the matching
-	# Windows code page codepoint as two hex bytes in little endian format. If
-	# this is the 4th mapping value on a line (which means 8 bytes on the line)
-	# then create a new line and indent again; otherwise, add a space.
-	for uni in range(2 ** 16):
-		cp = mappingFromUnicode[uni]
-
-		lookupFile.write("0x%02x, 0x%02x," % (cp & 0xFF, cp >> 8))
-
-		if (uni % 4) == 3:
-			lookupFile.write("\n\t")
-		else:
-			lookupFile.write(" ")
-
-	# Loop over the Windows code page to Unicode mapping array for each of the
-	# 2^16 codepoints we intend to convert. This loop is exactly like the
-	# Unicode to Windows code page array above. The conversion code will simply
-	# offset 128KiB or 2^16 elements into the array to access this mapping
-	# instead of the one above.
-	for cp in range(2 ** 16):
-		uni = mappingToUnicode[cp]
-
-		lookupFile.write("0x%02x, 0x%02x," % (uni & 0xFF, uni >> 8))
-
-		if (cp % 4) == 3:
-			lookupFile.write("\n\t")
-		else:
-			lookupFile.write(" ")
-
-	# There won't be another line in the array and the last byte should not
-	# contain a comma after it so rewind the file by three bytes to remove the
-	# characters before writing the footer then write the footer replacing all
-	# instances of %CP% with the same code page value that was passed into the
-	# method.
-	lookupFile.seek(-3, 1)
-	lookupFile.write(FILE_FOOTER.replace("%CP%", "932"))
-
-generateLookup(URL_CP932, 932)
-generateLookup(URL_CP1252, 1252)
+	writeLookup(cpnum, mappingFromUnicode, mappingToUnicode, defaultCP,
+		defaultUni)
+
+if __name__ == "__main__":
+	generateLookup(URL_CP932, 932)
+	generateLookup(URL_CP1252, 1252)
@@ -0,0 +1,86 @@
+/**
+ * @file libcomp/bench/Compress.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark the compression routines.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <Compress.h>
+
+#include <vector>
+
+using namespace libcomp;
+
+/// Fill a buffer with data that compresses about as well as game commands.
+static std::vector<char> CommandLikeData(size_t size)
+{
+    std::vector<char> data(size);
+    uint32_t seed = 12345;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        seed = seed * 1103515245U + 12345U;
+        data[i] = 0 == (i % 4) ? (char)(seed >> 24) : (char)(i % 16);
+    }
+
+    return data;
+}
+
+static void CompressBuffer(benchmark::State& state)
+{
+    std::vector<char> in = CommandLikeData((size_t)state.range(0));
+    std::vector<char> out(in.size() * 2 + 64);
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(Compress::Compress(&in[0], &out[0],
+            (int32_t)in.size(), (int32_t)out.size()));
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * in.size()));
+}
+BENCHMARK(CompressBuffer)->Arg(256)->Arg(4096)->Arg(65536);
+
+static void DecompressBuffer(benchmark::State& state)
+{
+    std::vector<char> in = CommandLikeData((size_t)state.range(0));
+    std::vector<char> compressed(in.size() * 2 + 64);
+    std::vector<char> out(in.size());
+
+    int32_t compressedSize = Compress::Compress(&in[0], &compressed[0],
+        (int32_t)in.size(), (int32_t)compressed.size());
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(Compress::Decompress(&compressed[0],
+            &out[0], compressedSize, (int32_t)out.size()));
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * in.size()));
+}
+BENCHMARK(DecompressBuffer)->Arg(256)->Arg(4096)->Arg(65536);
+
+BENCHMARK_MAIN();
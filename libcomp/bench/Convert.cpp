@@ -0,0 +1,70 @@
+/**
+ * @file libcomp/bench/Convert.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark the encoding conversion routines.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <Convert.h>
+
+using namespace libcomp;
+
+/// Text with Japanese, accented and plain ASCII characters.
+static const char *gText = u8"COMP_hack ログインテスト café résumé "
+    u8"悪魔召喚プログラム Mitsuru Kirijo 0123456789";
+
+static void ToEncoding(benchmark::State& state)
+{
+    Convert::Encoding_t encoding = (Convert::Encoding_t)state.range(0);
+    String text(gText);
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(Convert::ToEncoding(encoding, text));
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * text.Size()));
+}
+BENCHMARK(ToEncoding)->Arg(Convert::ENCODING_CP932)->Arg(
+    Convert::ENCODING_CP1252);
+
+static void FromEncoding(benchmark::State& state)
+{
+    Convert::Encoding_t encoding = (Convert::Encoding_t)state.range(0);
+    std::vector<char> data = Convert::ToEncoding(encoding, String(gText),
+        false);
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(Convert::FromEncoding(encoding, data));
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * data.size()));
+}
+BENCHMARK(FromEncoding)->Arg(Convert::ENCODING_CP932)->Arg(
+    Convert::ENCODING_CP1252);
+
+BENCHMARK_MAIN();
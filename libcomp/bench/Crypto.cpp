@@ -0,0 +1,137 @@
+/**
+ * @file libcomp/bench/Crypto.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark packet encryption and the Diffie-Hellman exchange.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <Decrypt.h>
+#include <Packet.h>
+#include <TcpConnection.h>
+#include <TcpServer.h>
+
+#include <openssl/blowfish.h>
+
+using namespace libcomp;
+
+static void EncryptPacket(benchmark::State& state)
+{
+    BF_KEY key;
+    unsigned char keyData[16] = { 0 };
+    BF_set_key(&key, sizeof(keyData), keyData);
+
+    uint32_t size = (uint32_t)state.range(0);
+
+    while(state.KeepRunning())
+    {
+        state.PauseTiming();
+        Packet p;
+        p.WriteU32Big(0);
+        p.WriteU32Big(0);
+        p.WriteBlank(size);
+        state.ResumeTiming();
+
+        Decrypt::EncryptPacket(key, p);
+    }
+
+    state.SetBytesProcessed((int64_t)state.iterations() * size);
+}
+BENCHMARK(EncryptPacket)->Arg(64)->Arg(1024)->Arg(16384);
+
+static void DecryptPacket(benchmark::State& state)
+{
+    BF_KEY key;
+    unsigned char keyData[16] = { 0 };
+    BF_set_key(&key, sizeof(keyData), keyData);
+
+    uint32_t size = (uint32_t)state.range(0);
+
+    Packet encrypted;
+    encrypted.WriteU32Big(0);
+    encrypted.WriteU32Big(0);
+    encrypted.WriteBlank(size);
+    Decrypt::EncryptPacket(key, encrypted);
+
+    std::vector<char> data(encrypted.ConstData(), encrypted.ConstData() +
+        encrypted.Size());
+
+    while(state.KeepRunning())
+    {
+        state.PauseTiming();
+        Packet p(data);
+        state.ResumeTiming();
+
+        Decrypt::DecryptPacket(key, p);
+    }
+
+    state.SetBytesProcessed((int64_t)state.iterations() * size);
+}
+BENCHMARK(DecryptPacket)->Arg(64)->Arg(1024)->Arg(16384);
+
+/// Prime shared by the Diffie-Hellman benchmarks (slow to generate).
+static DH* GetDiffieHellman()
+{
+    static DH *pDiffieHellman = TcpServer::GenerateDiffieHellman();
+
+    return pDiffieHellman;
+}
+
+static void DiffieHellmanPublic(benchmark::State& state)
+{
+    DH *pDiffieHellman = TcpServer::CopyDiffieHellman(GetDiffieHellman());
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(TcpConnection::GenerateDiffieHellmanPublic(
+            pDiffieHellman));
+    }
+
+    DH_free(pDiffieHellman);
+}
+BENCHMARK(DiffieHellmanPublic);
+
+static void DiffieHellmanCompute(benchmark::State& state)
+{
+    DH *pServer = TcpServer::CopyDiffieHellman(GetDiffieHellman());
+    DH *pClient = TcpServer::CopyDiffieHellman(GetDiffieHellman());
+
+    String serverPublic = TcpConnection::GenerateDiffieHellmanPublic(
+        pServer);
+    (void)TcpConnection::GenerateDiffieHellmanPublic(pClient);
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(
+            TcpConnection::GenerateDiffieHellmanSharedData(pClient,
+            serverPublic));
+    }
+
+    DH_free(pServer);
+    DH_free(pClient);
+}
+BENCHMARK(DiffieHellmanCompute);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,121 @@
+/**
+ * @file libcomp/bench/MessageQueue.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark the MessageQueue class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <MessageQueue.h>
+
+#include <atomic>
+#include <list>
+
+using namespace libcomp;
+
+static void MessageQueueSingle(benchmark::State& state)
+{
+    MessageQueue<int> queue;
+    int item = 0;
+
+    while(state.KeepRunning())
+    {
+        queue.Enqueue(1);
+        queue.TryDequeue(item);
+    }
+
+    benchmark::DoNotOptimize(item);
+    state.SetItemsProcessed((int64_t)state.iterations());
+}
+BENCHMARK(MessageQueueSingle);
+
+static void MessageQueueBatch(benchmark::State& state)
+{
+    MessageQueue<int> queue;
+    std::list<int> in, out;
+
+    while(state.KeepRunning())
+    {
+        in.assign(64, 1);
+        queue.Enqueue(in);
+
+        out.clear();
+        queue.DequeueAll(out);
+    }
+
+    state.SetItemsProcessed((int64_t)state.iterations() * 64);
+}
+BENCHMARK(MessageQueueBatch);
+
+/**
+ * One thread is the consumer and drains the queue as fast as it can; every
+ * other thread enqueues.
+ */
+static void MessageQueueContention(benchmark::State& state)
+{
+    // Shared by every thread (and left over items are drained by the next
+    // run's consumer).
+    static MessageQueue<int> queue;
+
+    // The first thread to get here is the consumer for this run.
+    static std::atomic<bool> consumerTaken(false);
+
+    bool consumer = !consumerTaken.exchange(true);
+
+    MessageQueue<int> *pQueue = &queue;
+    int64_t dequeued = 0;
+    int item = 0;
+
+    while(state.KeepRunning())
+    {
+        if(consumer)
+        {
+            for(int i = 0; i < 16 && pQueue->TryDequeue(item); ++i)
+            {
+                dequeued++;
+            }
+        }
+        else
+        {
+            for(int i = 0; i < 16; ++i)
+            {
+                if(!pQueue->TryEnqueue(i))
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    // Only items that made it through the queue count.
+    if(consumer)
+    {
+        consumerTaken = false;
+        state.SetItemsProcessed(dequeued);
+    }
+}
+BENCHMARK(MessageQueueContention)->ThreadRange(2, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,80 @@
+/**
+ * @file libcomp/bench/MpscRingBuffer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark the MpscRingBuffer class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <MpscRingBuffer.h>
+
+#include <vector>
+
+using namespace libcomp;
+
+/// Capacity of the buffer (a multiple of the page size on any system).
+static const int32_t RING_CAPACITY = 1024 * 1024;
+
+static void MpscRingBufferWriteRead(benchmark::State& state)
+{
+    MpscRingBuffer buffer(RING_CAPACITY);
+    std::vector<char> chunk((size_t)state.range(0));
+    std::vector<char> out;
+
+    while(state.KeepRunning())
+    {
+        buffer.WriteRecord(&chunk[0], (int32_t)chunk.size());
+        buffer.ReadRecord(out);
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * chunk.size()));
+}
+BENCHMARK(MpscRingBufferWriteRead)->Arg(64)->Arg(1024);
+
+static void MpscRingBufferGather(benchmark::State& state)
+{
+    MpscRingBuffer buffer(RING_CAPACITY);
+    std::vector<char> chunk((size_t)state.range(0));
+    RingRecord_t records[32];
+
+    while(state.KeepRunning())
+    {
+        for(int i = 0; i < 32; ++i)
+        {
+            buffer.WriteRecord(&chunk[0], (int32_t)chunk.size());
+        }
+
+        // Read every record with one call like a gather write would.
+        int32_t size = 0;
+        benchmark::DoNotOptimize(buffer.BeginReadV(records, 32, size));
+        buffer.EndRead(size);
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * 32 *
+        chunk.size()));
+}
+BENCHMARK(MpscRingBufferGather)->Arg(64)->Arg(1024);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,193 @@
+/**
+ * @file libcomp/bench/Packet.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark the Packet and ReadOnlyPacket classes.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <Packet.h>
+#include <PacketLayout.h>
+#include <ReadOnlyPacket.h>
+
+using namespace libcomp;
+
+static void PacketWrite(benchmark::State& state)
+{
+    Packet p;
+
+    while(state.KeepRunning())
+    {
+        p.Clear();
+
+        for(int i = 0; i < 64; ++i)
+        {
+            p.WriteU8(1);
+            p.WriteU16Little(2);
+            p.WriteU32Big(3);
+            p.WriteU64Little(4);
+        }
+
+        benchmark::DoNotOptimize(p.Size());
+    }
+
+    state.SetBytesProcessed((int64_t)state.iterations() * 64 * 15);
+}
+BENCHMARK(PacketWrite);
+
+static void PacketRead(benchmark::State& state)
+{
+    Packet p;
+
+    for(int i = 0; i < 64; ++i)
+    {
+        p.WriteU8(1);
+        p.WriteU16Little(2);
+        p.WriteU32Big(3);
+        p.WriteU64Little(4);
+    }
+
+    uint64_t sum = 0;
+
+    while(state.KeepRunning())
+    {
+        p.Rewind();
+
+        for(int i = 0; i < 64; ++i)
+        {
+            sum += p.ReadU8();
+            sum += p.ReadU16Little();
+            sum += p.ReadU32Big();
+            sum += p.ReadU64Little();
+        }
+    }
+
+    benchmark::DoNotOptimize(sum);
+    state.SetBytesProcessed((int64_t)state.iterations() * 64 * 15);
+}
+BENCHMARK(PacketRead);
+
+static void PacketLayoutRead(benchmark::State& state)
+{
+    typedef PacketLayout<LittleField<uint8_t>, LittleField<uint16_t>,
+        BigField<uint32_t>, LittleField<uint64_t>> Layout_t;
+
+    Packet p;
+
+    for(int i = 0; i < 64; ++i)
+    {
+        Layout_t::Write(p, 1, 2, 3, 4);
+    }
+
+    uint64_t sum = 0;
+
+    while(state.KeepRunning())
+    {
+        p.Rewind();
+
+        for(int i = 0; i < 64; ++i)
+        {
+            uint8_t a;
+            uint16_t b;
+            uint32_t c;
+            uint64_t d;
+
+            Layout_t::Read(p, a, b, c, d);
+
+            sum += a + b + c + d;
+        }
+    }
+
+    benchmark::DoNotOptimize(sum);
+    state.SetBytesProcessed((int64_t)state.iterations() * 64 * 15);
+}
+BENCHMARK(PacketLayoutRead);
+
+static void PacketReadU32Array(benchmark::State& state)
+{
+    uint32_t values[QUEST_MASK_COUNT];
+
+    Packet p;
+
+    for(int i = 0; i < QUEST_MASK_COUNT; ++i)
+    {
+        p.WriteU32Big((uint32_t)i);
+    }
+
+    while(state.KeepRunning())
+    {
+        p.Rewind();
+
+        if(0 == state.range(0))
+        {
+            for(int i = 0; i < QUEST_MASK_COUNT; ++i)
+            {
+                values[i] = p.ReadU32Big();
+            }
+        }
+        else
+        {
+            p.ReadU32ArrayBig(values, QUEST_MASK_COUNT);
+        }
+
+        benchmark::DoNotOptimize(values[0]);
+    }
+
+    state.SetBytesProcessed((int64_t)state.iterations() *
+        QUEST_MASK_COUNT * 4);
+}
+BENCHMARK(PacketReadU32Array)->Arg(0)->Arg(1);
+
+static void ReadOnlyPacketCopy(benchmark::State& state)
+{
+    Packet p;
+    p.WriteBlank((uint32_t)state.range(0));
+
+    while(state.KeepRunning())
+    {
+        ReadOnlyPacket copy(p);
+
+        benchmark::DoNotOptimize(copy.ConstData());
+    }
+}
+BENCHMARK(ReadOnlyPacketCopy)->Arg(64)->Arg(4096);
+
+static void ReadOnlyPacketSlice(benchmark::State& state)
+{
+    Packet p;
+    p.WriteBlank(4096);
+
+    ReadOnlyPacket whole(p);
+
+    while(state.KeepRunning())
+    {
+        ReadOnlyPacket slice(whole, 1024, 512);
+
+        benchmark::DoNotOptimize(slice.ConstData());
+    }
+}
+BENCHMARK(ReadOnlyPacketSlice);
+
+BENCHMARK_MAIN();
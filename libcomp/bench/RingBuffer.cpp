@@ -0,0 +1,78 @@
+/**
+ * @file libcomp/bench/RingBuffer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark the RingBuffer class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <RingBuffer.h>
+
+#include <vector>
+
+using namespace libcomp;
+
+/// Capacity of the buffers (a multiple of the page size on any system).
+static const int32_t RING_CAPACITY = 1024 * 1024;
+
+static void RingBufferWriteRead(benchmark::State& state)
+{
+    RingBuffer buffer(RING_CAPACITY);
+    std::vector<char> chunk((size_t)state.range(0));
+    std::vector<char> out(chunk.size());
+
+    while(state.KeepRunning())
+    {
+        buffer.Write(&chunk[0], (int32_t)chunk.size());
+        buffer.Read(&out[0], (int32_t)out.size());
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * chunk.size()));
+}
+BENCHMARK(RingBufferWriteRead)->Arg(64)->Arg(1024)->Arg(16384);
+
+static void RingBufferZeroCopy(benchmark::State& state)
+{
+    RingBuffer buffer(RING_CAPACITY);
+    int32_t chunk = (int32_t)state.range(0);
+
+    while(state.KeepRunning())
+    {
+        int32_t size = chunk;
+        void *pWrite = buffer.BeginWrite(size);
+        benchmark::DoNotOptimize(pWrite);
+        buffer.EndWrite(size);
+
+        size = chunk;
+        const void *pRead = buffer.BeginRead(size);
+        benchmark::DoNotOptimize(pRead);
+        buffer.EndRead(size);
+    }
+
+    state.SetBytesProcessed((int64_t)state.iterations() * chunk);
+}
+BENCHMARK(RingBufferZeroCopy)->Arg(64)->Arg(1024)->Arg(16384);
+
+BENCHMARK_MAIN();
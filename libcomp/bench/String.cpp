@@ -0,0 +1,88 @@
+/**
+ * @file libcomp/bench/String.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Benchmark the String class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <benchmark/benchmark.h>
+#include <PopIgnore.h>
+
+#include <String.h>
+
+using namespace libcomp;
+
+static void StringArg(benchmark::State& state)
+{
+    String format("Client %1 connected from %2:%3 (%4)");
+    String host("127.0.0.1");
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(format.Arg((uint32_t)1234).Arg(host).Arg(
+            (uint16_t)10666).Arg("lobby"));
+    }
+}
+BENCHMARK(StringArg);
+
+static void StringReplace(benchmark::State& state)
+{
+    String page;
+
+    for(int i = 0; i < 64; ++i)
+    {
+        page += "<td>{COMP_HACK_ID}</td><td>{COMP_HACK_MSG}</td>\n";
+    }
+
+    String search("{COMP_HACK_ID}");
+    String replace("someone");
+
+    while(state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(page.Replace(search, replace));
+    }
+
+    state.SetBytesProcessed((int64_t)(state.iterations() * page.Size()));
+}
+BENCHMARK(StringReplace);
+
+static void StringAt(benchmark::State& state)
+{
+    String text(u8"悪魔召喚プログラム COMP_hack");
+    size_t length = text.Length();
+    String::CodePoint sum = 0;
+
+    while(state.KeepRunning())
+    {
+        for(size_t i = 0; i < length; ++i)
+        {
+            sum += text.At(i);
+        }
+    }
+
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed((int64_t)(state.iterations() * length));
+}
+BENCHMARK(StringAt);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,236 @@
+/**
+ * @file libcomp/src/AcceptLimiter.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Per-address limits on new connections.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AcceptLimiter.h"
+
+// Standard C++11 Includes
+#include <chrono>
+
+using namespace libcomp;
+
+AcceptLimiter::AcceptLimiter(double ratePerSecond, uint32_t burst,
+    uint32_t maxConnections, size_t capacity) : mState(new State)
+{
+    mState->ratePerSecond = 0 < ratePerSecond ? ratePerSecond : 0;
+    mState->burst = (double)(0 < burst ? burst : 1);
+    mState->maxConnections = maxConnections;
+
+    size_t shardSize = (capacity + ACCEPT_LIMITER_SHARD_COUNT - 1) /
+        ACCEPT_LIMITER_SHARD_COUNT;
+
+    if(ACCEPT_LIMITER_PROBES > shardSize)
+    {
+        shardSize = ACCEPT_LIMITER_PROBES;
+    }
+
+    for(auto& shard : mState->shards)
+    {
+        shard.entries.resize(shardSize);
+    }
+}
+
+AcceptLimiter::Result_t AcceptLimiter::Acquire(const Address_t& address,
+    std::shared_ptr<void>& lease)
+{
+    uint64_t now = (uint64_t)std::chrono::duration_cast<
+        std::chrono::milliseconds>(std::chrono::steady_clock::now().
+        time_since_epoch()).count();
+
+    return Acquire(address, lease, now);
+}
+
+AcceptLimiter::Result_t AcceptLimiter::Acquire(const Address_t& address,
+    std::shared_ptr<void>& lease, uint64_t now)
+{
+    lease.reset();
+
+    size_t hash = Hash(address);
+    Shard& shard = mState->shards[hash % ACCEPT_LIMITER_SHARD_COUNT];
+    size_t size = shard.entries.size();
+    size_t start = (hash / ACCEPT_LIMITER_SHARD_COUNT) % size;
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    Entry *pEntry = nullptr;
+    Entry *pFree = nullptr;
+
+    for(size_t i = 0; i < ACCEPT_LIMITER_PROBES; ++i)
+    {
+        Entry& entry = shard.entries[(start + i) % size];
+
+        if(entry.used && entry.address == address)
+        {
+            pEntry = &entry;
+            break;
+        }
+
+        if(nullptr == pFree && (!entry.used || IsIdle(*mState, entry, now)))
+        {
+            pFree = &entry;
+        }
+    }
+
+    if(nullptr == pEntry)
+    {
+        if(nullptr == pFree)
+        {
+            // Every slot is busy; let the connection in rather than refuse
+            // a host only because the table is full.
+            return RESULT_ACCEPTED;
+        }
+
+        pEntry = pFree;
+        pEntry->address = address;
+        pEntry->used = true;
+        pEntry->connections = 0;
+        pEntry->tokens = mState->burst;
+        pEntry->updated = now;
+    }
+
+    Refill(*mState, *pEntry, now);
+
+    if(0 != mState->maxConnections &&
+        pEntry->connections >= mState->maxConnections)
+    {
+        return RESULT_TOO_MANY_CONNECTIONS;
+    }
+
+    if(0 < mState->ratePerSecond)
+    {
+        if(1.0 > pEntry->tokens)
+        {
+            return RESULT_RATE_LIMITED;
+        }
+
+        pEntry->tokens -= 1.0;
+    }
+
+    pEntry->connections++;
+
+    std::shared_ptr<State> state = mState;
+
+    lease = std::shared_ptr<void>(nullptr, [state, address](void*)
+    {
+        Release(state, address);
+    });
+
+    return RESULT_ACCEPTED;
+}
+
+uint32_t AcceptLimiter::GetConnectionCount(const Address_t& address) const
+{
+    size_t hash = Hash(address);
+    Shard& shard = mState->shards[hash % ACCEPT_LIMITER_SHARD_COUNT];
+    size_t size = shard.entries.size();
+    size_t start = (hash / ACCEPT_LIMITER_SHARD_COUNT) % size;
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    for(size_t i = 0; i < ACCEPT_LIMITER_PROBES; ++i)
+    {
+        const Entry& entry = shard.entries[(start + i) % size];
+
+        if(entry.used && entry.address == address)
+        {
+            return entry.connections;
+        }
+    }
+
+    return 0;
+}
+
+size_t AcceptLimiter::Hash(const Address_t& address)
+{
+    // 64-bit FNV-1a.
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for(auto byte : address)
+    {
+        hash ^= byte;
+        hash *= 0x100000001B3ULL;
+    }
+
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+void AcceptLimiter::Refill(const State& state, Entry& entry, uint64_t now)
+{
+    if(now > entry.updated)
+    {
+        entry.tokens += (double)(now - entry.updated) *
+            state.ratePerSecond / 1000.0;
+
+        if(entry.tokens > state.burst)
+        {
+            entry.tokens = state.burst;
+        }
+    }
+
+    entry.updated = now;
+}
+
+bool AcceptLimiter::IsIdle(const State& state, const Entry& entry,
+    uint64_t now)
+{
+    if(0 != entry.connections)
+    {
+        return false;
+    }
+
+    // With no rate limit the bucket is always full.
+    if(0 >= state.ratePerSecond)
+    {
+        return true;
+    }
+
+    double elapsed = now > entry.updated ? (double)(now - entry.updated) : 0;
+
+    return (entry.tokens + elapsed * state.ratePerSecond / 1000.0) >=
+        state.burst;
+}
+
+void AcceptLimiter::Release(const std::shared_ptr<State>& state,
+    const Address_t& address)
+{
+    size_t hash = Hash(address);
+    Shard& shard = state->shards[hash % ACCEPT_LIMITER_SHARD_COUNT];
+    size_t size = shard.entries.size();
+    size_t start = (hash / ACCEPT_LIMITER_SHARD_COUNT) % size;
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    for(size_t i = 0; i < ACCEPT_LIMITER_PROBES; ++i)
+    {
+        Entry& entry = shard.entries[(start + i) % size];
+
+        // An entry with connections is never reused so it is still here.
+        if(entry.used && entry.address == address && 0 < entry.connections)
+        {
+            entry.connections--;
+            break;
+        }
+    }
+}
@@ -0,0 +1,169 @@
+/**
+ * @file libcomp/src/AcceptLimiter.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Per-address limits on new connections.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_ACCEPTLIMITER_H
+#define LIBCOMP_SRC_ACCEPTLIMITER_H
+
+// libcomp Includes
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Limits how fast each remote address may open connections (a token bucket
+ * refilled at a fixed rate) and how many it may have open at once. It is
+ * checked before a connection is built so an abusive host can't make the
+ * server run a handshake for every attempt. Addresses live in a fixed-size
+ * open addressing table split into independently locked shards. An address
+ * whose bucket is full and that has no open connection is in the same state
+ * as one that was never seen, so its slot is simply reused; if every slot
+ * an address may use is busy the attempt is allowed (but not counted).
+ */
+class AcceptLimiter
+{
+public:
+    /// Remote address (IPv6 or IPv4 mapped to IPv6).
+    typedef std::array<uint8_t, 16> Address_t;
+
+    /**
+     * Result of @ref Acquire.
+     */
+    typedef enum
+    {
+        /// The connection may be accepted.
+        RESULT_ACCEPTED = 0,
+        /// The address opened too many connections recently.
+        RESULT_RATE_LIMITED,
+        /// The address has too many connections open.
+        RESULT_TOO_MANY_CONNECTIONS,
+    } Result_t;
+
+    /**
+     * Create a limiter.
+     * @param ratePerSecond New connections each address may open per second
+     *   (0 for no rate limit).
+     * @param burst New connections an address may open at once.
+     * @param maxConnections Connections each address may have open at the
+     *   same time (0 for no limit).
+     * @param capacity Number of addresses that can be tracked.
+     */
+    AcceptLimiter(double ratePerSecond = ACCEPT_RATE_PER_ADDRESS,
+        uint32_t burst = ACCEPT_BURST_PER_ADDRESS,
+        uint32_t maxConnections = ACCEPT_MAX_PER_ADDRESS,
+        size_t capacity = ACCEPT_LIMITER_SIZE);
+
+    /**
+     * Check if a new connection from an address may be accepted. If it may,
+     * @em lease is set to an object that counts as one open connection of
+     * the address until the last reference to it is dropped; the connection
+     * should hold it until it closes.
+     * @param address Remote address of the connection.
+     * @param lease Set to the lease of the connection.
+     * @returns Result of the check.
+     */
+    Result_t Acquire(const Address_t& address, std::shared_ptr<void>& lease);
+
+    /**
+     * Same as @ref Acquire but at the given time.
+     * @param address Remote address of the connection.
+     * @param lease Set to the lease of the connection.
+     * @param now Current time in milliseconds (of any monotonic clock).
+     * @returns Result of the check.
+     */
+    Result_t Acquire(const Address_t& address, std::shared_ptr<void>& lease,
+        uint64_t now);
+
+    /**
+     * Get the number of connections of an address that hold a lease.
+     * @param address Remote address.
+     * @returns Number of open connections.
+     */
+    uint32_t GetConnectionCount(const Address_t& address) const;
+
+private:
+    /**
+     * @internal
+     * State of one address.
+     */
+    class Entry
+    {
+    public:
+        Entry() : used(false), connections(0), tokens(0), updated(0)
+        {
+        }
+
+        Address_t address;
+        bool used;
+        uint32_t connections;
+        double tokens;
+        uint64_t updated;
+    };
+
+    /**
+     * @internal
+     * Independently locked part of the table.
+     */
+    class Shard
+    {
+    public:
+        std::mutex lock;
+        std::vector<Entry> entries;
+    };
+
+    /**
+     * @internal
+     * Table shared by the limiter and every lease it has handed out.
+     */
+    class State
+    {
+    public:
+        double ratePerSecond;
+        double burst;
+        uint32_t maxConnections;
+        std::array<Shard, ACCEPT_LIMITER_SHARD_COUNT> shards;
+    };
+
+    static size_t Hash(const Address_t& address);
+    static void Refill(const State& state, Entry& entry, uint64_t now);
+    static bool IsIdle(const State& state, const Entry& entry, uint64_t now);
+    static void Release(const std::shared_ptr<State>& state,
+        const Address_t& address);
+
+    std::shared_ptr<State> mState;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_ACCEPTLIMITER_H
@@ -0,0 +1,412 @@
+/**
+ * @file libcomp/src/AllocationTracker.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Counts heap allocations per thread and per tagged code path.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AllocationTracker.h"
+
+// libcomp Includes
+#include "Metrics.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+using namespace libcomp;
+
+namespace
+{
+
+/// Index of each count in a counts row.
+enum
+{
+    FIELD_ALLOCATIONS = 0,
+    FIELD_BYTES,
+    FIELD_FREES,
+    FIELD_COUNT,
+};
+
+/// State of the counts of a thread.
+enum
+{
+    /// The thread has not allocated anything yet.
+    STATE_NEW = 0,
+
+    /// The counts of the thread are in the list of threads.
+    STATE_REGISTERED,
+
+    /// The thread is exiting; its counts were moved to the retired counts.
+    STATE_EXITED,
+};
+
+/**
+ * @internal
+ * Counts of one thread. Only the thread itself writes them so a relaxed
+ * load and store is enough; other threads only read them.
+ */
+class ThreadCounts
+{
+public:
+    std::atomic<uint64_t> counts[AllocationTracker::TAG_COUNT][FIELD_COUNT];
+
+    ThreadCounts *pPrev;
+    ThreadCounts *pNext;
+};
+
+/// Counts of the calling thread. This has no constructor so it is set to
+/// zero when the thread starts without anything being run.
+thread_local ThreadCounts tCounts;
+
+/// Tag of the innermost scope of the calling thread.
+thread_local uint8_t tTag = AllocationTracker::TAG_OTHER;
+
+/// State of the counts of the calling thread.
+thread_local uint8_t tState = STATE_NEW;
+
+/// Lock for the list of threads and the retired counts.
+std::mutex gLock;
+
+/// Counts of every thread that has allocated something and not exited.
+ThreadCounts *gThreads = nullptr;
+
+/// Counts of the threads that have exited.
+std::atomic<uint64_t> gRetired[AllocationTracker::TAG_COUNT][FIELD_COUNT];
+
+/**
+ * @internal
+ * Adds the counts of a thread to the list of threads and moves them to
+ * the retired counts when the thread exits.
+ */
+class Registration
+{
+public:
+    Registration()
+    {
+        std::lock_guard<std::mutex> guard(gLock);
+
+        tCounts.pPrev = nullptr;
+        tCounts.pNext = gThreads;
+
+        if(nullptr != gThreads)
+        {
+            gThreads->pPrev = &tCounts;
+        }
+
+        gThreads = &tCounts;
+    }
+
+    ~Registration()
+    {
+        std::lock_guard<std::mutex> guard(gLock);
+
+        for(size_t i = 0; i < AllocationTracker::TAG_COUNT; ++i)
+        {
+            for(size_t j = 0; j < FIELD_COUNT; ++j)
+            {
+                gRetired[i][j].fetch_add(tCounts.counts[i][j].load(
+                    std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
+
+        if(nullptr != tCounts.pPrev)
+        {
+            tCounts.pPrev->pNext = tCounts.pNext;
+        }
+        else
+        {
+            gThreads = tCounts.pNext;
+        }
+
+        if(nullptr != tCounts.pNext)
+        {
+            tCounts.pNext->pPrev = tCounts.pPrev;
+        }
+
+        // Anything freed by the rest of the thread exit goes straight to
+        // the retired counts.
+        tState = STATE_EXITED;
+    }
+};
+
+} // namespace
+
+#if defined(COMP_TRACK_ALLOCATIONS)
+/**
+ * @internal
+ * Count an allocation or free against the calling thread and its tag.
+ * @param field Count to add to.
+ * @param amount Amount to add.
+ */
+static void Count(size_t field, uint64_t amount)
+{
+    if(STATE_REGISTERED != tState)
+    {
+        if(STATE_EXITED == tState)
+        {
+            gRetired[tTag][field].fetch_add(amount,
+                std::memory_order_relaxed);
+
+            return;
+        }
+
+        // Set first so anything the registration allocates is counted
+        // without registering again.
+        tState = STATE_REGISTERED;
+
+        static thread_local Registration registration;
+        (void)registration;
+    }
+
+    std::atomic<uint64_t>& count = tCounts.counts[tTag][field];
+    count.store(count.load(std::memory_order_relaxed) + amount,
+        std::memory_order_relaxed);
+}
+
+/**
+ * @internal
+ * Allocate and count memory for operator new.
+ * @param size Number of bytes to allocate.
+ * @returns Allocated memory.
+ */
+static void* Allocate(std::size_t size)
+{
+    Count(FIELD_ALLOCATIONS, 1);
+    Count(FIELD_BYTES, size);
+
+    if(0 == size)
+    {
+        size = 1;
+    }
+
+    void *pMemory;
+
+    while(nullptr == (pMemory = malloc(size)))
+    {
+        std::new_handler handler = std::get_new_handler();
+
+        if(nullptr == handler)
+        {
+            throw std::bad_alloc();
+        }
+
+        handler();
+    }
+
+    return pMemory;
+}
+
+/**
+ * @internal
+ * Count and free memory for operator delete.
+ * @param pMemory Memory to free (may be null).
+ */
+static void Deallocate(void *pMemory)
+{
+    if(nullptr != pMemory)
+    {
+        Count(FIELD_FREES, 1);
+
+        free(pMemory);
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return Allocate(size);
+    }
+    catch(...)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return Allocate(size);
+    }
+    catch(...)
+    {
+        return nullptr;
+    }
+}
+
+// The sized versions of operator delete call these.
+void operator delete(void *pMemory) noexcept
+{
+    Deallocate(pMemory);
+}
+
+void operator delete[](void *pMemory) noexcept
+{
+    Deallocate(pMemory);
+}
+
+void operator delete(void *pMemory, const std::nothrow_t&) noexcept
+{
+    Deallocate(pMemory);
+}
+
+void operator delete[](void *pMemory, const std::nothrow_t&) noexcept
+{
+    Deallocate(pMemory);
+}
+#endif // COMP_TRACK_ALLOCATIONS
+
+AllocationTracker::Scope::Scope(Tag_t tag) : mPrevious((Tag_t)tTag)
+{
+    tTag = tag;
+}
+
+AllocationTracker::Scope::~Scope()
+{
+    tTag = mPrevious;
+}
+
+bool AllocationTracker::IsEnabled()
+{
+#if defined(COMP_TRACK_ALLOCATIONS)
+    return true;
+#else // !COMP_TRACK_ALLOCATIONS
+    return false;
+#endif // COMP_TRACK_ALLOCATIONS
+}
+
+const char* AllocationTracker::GetTagName(Tag_t tag)
+{
+    static const char *szNames[TAG_COUNT] = {
+        "other",
+        "recv",
+        "parse",
+        "send",
+    };
+
+    return tag < TAG_COUNT ? szNames[tag] : "unknown";
+}
+
+AllocationTracker::AllocationCounts_t AllocationTracker::GetThreadCounts(
+    Tag_t tag)
+{
+    AllocationCounts_t result;
+    result.allocations = tCounts.counts[tag][FIELD_ALLOCATIONS].load(
+        std::memory_order_relaxed);
+    result.bytes = tCounts.counts[tag][FIELD_BYTES].load(
+        std::memory_order_relaxed);
+    result.frees = tCounts.counts[tag][FIELD_FREES].load(
+        std::memory_order_relaxed);
+
+    return result;
+}
+
+AllocationTracker::AllocationCounts_t AllocationTracker::GetThreadTotal()
+{
+    AllocationCounts_t result = { 0, 0, 0 };
+
+    for(uint8_t i = 0; i < TAG_COUNT; ++i)
+    {
+        AllocationCounts_t counts = GetThreadCounts((Tag_t)i);
+
+        result.allocations += counts.allocations;
+        result.bytes += counts.bytes;
+        result.frees += counts.frees;
+    }
+
+    return result;
+}
+
+AllocationTracker::AllocationCounts_t AllocationTracker::GetCounts(Tag_t tag)
+{
+    std::lock_guard<std::mutex> guard(gLock);
+
+    uint64_t values[FIELD_COUNT];
+
+    for(size_t j = 0; j < FIELD_COUNT; ++j)
+    {
+        values[j] = gRetired[tag][j].load(std::memory_order_relaxed);
+
+        for(ThreadCounts *pThread = gThreads; nullptr != pThread;
+            pThread = pThread->pNext)
+        {
+            values[j] += pThread->counts[tag][j].load(
+                std::memory_order_relaxed);
+        }
+    }
+
+    AllocationCounts_t result;
+    result.allocations = values[FIELD_ALLOCATIONS];
+    result.bytes = values[FIELD_BYTES];
+    result.frees = values[FIELD_FREES];
+
+    return result;
+}
+
+void AllocationTracker::Publish()
+{
+    if(!IsEnabled())
+    {
+        return;
+    }
+
+    static std::mutex lock;
+    static AllocationCounts_t published[TAG_COUNT];
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    Metrics *pMetrics = Metrics::GetSingletonPtr();
+
+    // The counters only go up so each one gets what was added since the
+    // last call.
+    for(uint8_t i = 0; i < TAG_COUNT; ++i)
+    {
+        AllocationCounts_t counts = GetCounts((Tag_t)i);
+        String labels = String("tag=\"%1\"").Arg(GetTagName((Tag_t)i));
+
+        pMetrics->Counter("comp_allocations_total",
+            "Calls to operator new.", labels).Increment(
+            counts.allocations - published[i].allocations);
+        pMetrics->Counter("comp_allocated_bytes_total",
+            "Bytes asked for by calls to operator new.", labels).Increment(
+            counts.bytes - published[i].bytes);
+        pMetrics->Counter("comp_frees_total",
+            "Calls to operator delete.", labels).Increment(
+            counts.frees - published[i].frees);
+
+        published[i] = counts;
+    }
+}
@@ -0,0 +1,158 @@
+/**
+ * @file libcomp/src/AllocationTracker.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Counts heap allocations per thread and per tagged code path.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_ALLOCATIONTRACKER_H
+#define LIBCOMP_SRC_ALLOCATIONTRACKER_H
+
+// Standard C++11 Includes
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Heap allocation counters. When the build is configured with
+ * TRACK_ALLOCATIONS (which defines COMP_TRACK_ALLOCATIONS) the global
+ * operator new and operator delete are replaced with versions that count
+ * every call against the calling thread and the tag of the innermost
+ * @ref AllocationTracker::Scope. Without it nothing is counted and every
+ * count reads as zero, so the scopes may stay in the code.
+ */
+namespace AllocationTracker
+{
+
+/**
+ * Code path an allocation is counted against.
+ */
+typedef enum : uint8_t
+{
+    /// Anything outside of a scope.
+    TAG_OTHER = 0,
+
+    /// Reading data from a socket.
+    TAG_RECV,
+
+    /// Decrypting and splitting received frames into messages.
+    TAG_PARSE,
+
+    /// Queueing and writing data to a socket.
+    TAG_SEND,
+
+    /// Number of tags.
+    TAG_COUNT,
+} Tag_t;
+
+/**
+ * Counts for one tag (or the sum of every tag).
+ */
+typedef struct
+{
+    /// Number of calls to operator new.
+    uint64_t allocations;
+
+    /// Number of bytes asked for by those calls.
+    uint64_t bytes;
+
+    /// Number of calls to operator delete (with a non-null pointer).
+    uint64_t frees;
+} AllocationCounts_t;
+
+/**
+ * Count the allocations of the calling thread against a tag until the
+ * scope ends. Scopes nest; the previous tag is restored at the end.
+ */
+class Scope
+{
+public:
+    /**
+     * Start counting against a tag.
+     * @param tag Tag to count against.
+     */
+    explicit Scope(Tag_t tag);
+
+    /**
+     * Go back to the previous tag.
+     */
+    ~Scope();
+
+    Scope(const Scope& other) = delete;
+    Scope& operator=(const Scope& other) = delete;
+
+private:
+    /// Tag to restore at the end of the scope.
+    Tag_t mPrevious;
+};
+
+/**
+ * Check if the build counts allocations.
+ * @returns true if operator new and operator delete are replaced.
+ */
+bool IsEnabled();
+
+/**
+ * Get the name of a tag (as used in the metric labels).
+ * @param tag Tag to name.
+ * @returns Name of the tag.
+ */
+const char* GetTagName(Tag_t tag);
+
+/**
+ * Get the counts of the calling thread for one tag.
+ * @param tag Tag to get the counts of.
+ * @returns Counts since the thread started.
+ */
+AllocationCounts_t GetThreadCounts(Tag_t tag);
+
+/**
+ * Get the counts of the calling thread for every tag. Taking this before
+ * and after a code path shows what that path allocated.
+ * @returns Sum of the counts of every tag since the thread started.
+ */
+AllocationCounts_t GetThreadTotal();
+
+/**
+ * Get the counts of every thread (including threads that have exited) for
+ * one tag.
+ * @param tag Tag to get the counts of.
+ * @returns Counts since the process started.
+ */
+AllocationCounts_t GetCounts(Tag_t tag);
+
+/**
+ * Add the counts since the last call to the metrics registry
+ * (comp_allocations_total, comp_allocated_bytes_total and
+ * comp_frees_total, labeled by tag). Call this before the metrics are
+ * exported. Does nothing if the build does not count allocations.
+ */
+void Publish();
+
+} // namespace AllocationTracker
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_ALLOCATIONTRACKER_H
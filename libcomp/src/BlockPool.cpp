@@ -0,0 +1,139 @@
+/**
+ * @file libcomp/src/BlockPool.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Thread-safe pool of fixed-size memory blocks.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BlockPool.h"
+
+// Standard C++11 Includes
+#include <cstddef>
+#include <new>
+
+using namespace libcomp;
+
+BlockPool::BlockPool(size_t blockSize, size_t blocksPerSlab) :
+    mBlockSize(blockSize), mBlocksPerSlab(blocksPerSlab), mFreeList(nullptr)
+{
+    const size_t alignment = alignof(std::max_align_t);
+
+    // Each block must hold the free list header and keep the alignment.
+    if(sizeof(FreeBlock_t) > mBlockSize)
+    {
+        mBlockSize = sizeof(FreeBlock_t);
+    }
+
+    mBlockSize = ((mBlockSize + alignment - 1) / alignment) * alignment;
+
+    if(0 == mBlocksPerSlab)
+    {
+        mBlocksPerSlab = 1;
+    }
+
+    mStats.hits = 0;
+    mStats.misses = 0;
+    mStats.outstanding = 0;
+    mStats.highWater = 0;
+    mStats.free = 0;
+}
+
+BlockPool::~BlockPool()
+{
+    for(auto pSlab : mSlabs)
+    {
+        delete[] pSlab;
+    }
+}
+
+void* BlockPool::Allocate()
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(nullptr == mFreeList)
+    {
+        char *pSlab = new (std::nothrow) char[mBlockSize * mBlocksPerSlab];
+
+        if(nullptr == pSlab)
+        {
+            return nullptr;
+        }
+
+        mSlabs.push_back(pSlab);
+
+        // Thread the new blocks onto the free list.
+        for(size_t i = mBlocksPerSlab; i > 0; --i)
+        {
+            FreeBlock_t *pBlock = reinterpret_cast<FreeBlock_t*>(
+                pSlab + (i - 1) * mBlockSize);
+            pBlock->pNext = mFreeList;
+            mFreeList = pBlock;
+        }
+
+        mStats.free += mBlocksPerSlab;
+        mStats.misses++;
+    }
+    else
+    {
+        mStats.hits++;
+    }
+
+    FreeBlock_t *pBlock = mFreeList;
+    mFreeList = pBlock->pNext;
+
+    mStats.free--;
+    mStats.outstanding++;
+
+    if(mStats.outstanding > mStats.highWater)
+    {
+        mStats.highWater = mStats.outstanding;
+    }
+
+    return pBlock;
+}
+
+void BlockPool::Free(void *pBlock)
+{
+    if(nullptr != pBlock)
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        FreeBlock_t *pFree = reinterpret_cast<FreeBlock_t*>(pBlock);
+        pFree->pNext = mFreeList;
+        mFreeList = pFree;
+
+        mStats.free++;
+        mStats.outstanding--;
+    }
+}
+
+size_t BlockPool::GetBlockSize() const
+{
+    return mBlockSize;
+}
+
+ObjectPoolStats_t BlockPool::GetStats() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mStats;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file libcomp/src/BlockPool.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Thread-safe pool of fixed-size memory blocks.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_BLOCKPOOL_H
+#define LIBCOMP_SRC_BLOCKPOOL_H
+
+// libcomp Includes
+#include "ObjectPool.h"
+
+// Standard C++11 Includes
+#include <mutex>
+#include <vector>
+
+namespace libcomp
+{
+
+/**
+ * Slab allocator for blocks of one size. Memory is requested from the
+ * system one slab (many blocks) at a time and freed blocks are kept in an
+ * intrusive free list, so steady state allocation never calls malloc. The
+ * slabs are only released when the pool is destroyed. This is intended to
+ * back a class-specific operator new/delete (see Message::Packet).
+ */
+class BlockPool
+{
+public:
+    /**
+     * Create a new pool.
+     * @param blockSize Size in bytes of each block.
+     * @param blocksPerSlab Number of blocks to allocate at a time.
+     */
+    BlockPool(size_t blockSize, size_t blocksPerSlab);
+
+    /**
+     * Release every slab. Any block still in use becomes invalid.
+     */
+    ~BlockPool();
+
+    /**
+     * Get a free block (allocating a new slab if needed).
+     * @returns Pointer to the block or nullptr if the system is out of
+     * memory.
+     */
+    void* Allocate();
+
+    /**
+     * Return a block to the pool.
+     * @param pBlock Block returned by @ref Allocate.
+     */
+    void Free(void *pBlock);
+
+    /**
+     * Get the size of each block.
+     * @returns Size in bytes of each block.
+     */
+    size_t GetBlockSize() const;
+
+    /**
+     * Get the current pool counters. A miss is counted each time a new slab
+     * had to be allocated.
+     * @returns Pool counters.
+     */
+    ObjectPoolStats_t GetStats() const;
+
+private:
+    /**
+     * @internal
+     * Header written into each free block.
+     */
+    typedef struct FreeBlock
+    {
+        struct FreeBlock *pNext;
+    } FreeBlock_t;
+
+    size_t mBlockSize;
+    size_t mBlocksPerSlab;
+
+    mutable std::mutex mLock;
+    FreeBlock_t *mFreeList;
+    std::vector<char*> mSlabs;
+
+    ObjectPoolStats_t mStats;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_BLOCKPOOL_H
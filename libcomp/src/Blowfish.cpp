@@ -0,0 +1,382 @@
+/**
+ * @file libcomp/src/Blowfish.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Bulk Blowfish ECB routines.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Blowfish.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIBCOMP_BLOWFISH_AVX2
+#include <immintrin.h>
+#endif // defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+using namespace libcomp;
+
+/// Number of blocks the portable engine runs through the rounds together.
+#define BLOWFISH_LANES (4)
+
+/// Number of blocks the AVX2 engine runs through the rounds together.
+#define BLOWFISH_AVX2_LANES (8)
+
+/// Number of Blowfish rounds (the key has two more P entries).
+#define BLOWFISH_ROUNDS (16)
+
+static bool IsAvx2Supported()
+{
+#ifdef LIBCOMP_BLOWFISH_AVX2
+    return __builtin_cpu_supports("avx2");
+#else // LIBCOMP_BLOWFISH_AVX2
+    return false;
+#endif // LIBCOMP_BLOWFISH_AVX2
+}
+
+/**
+ * Blowfish round function.
+ */
+static inline uint32_t F(const BF_LONG *S, uint32_t x)
+{
+    return ((((uint32_t)S[x >> 24] + (uint32_t)S[0x100 + ((x >> 16) & 0xFF)])
+        ^ (uint32_t)S[0x200 + ((x >> 8) & 0xFF)]) +
+        (uint32_t)S[0x300 + (x & 0xFF)]);
+}
+
+static inline uint32_t Load32(const uint8_t *pData)
+{
+    uint32_t value;
+    memcpy(&value, pData, sizeof(value));
+
+    return value;
+}
+
+static inline void Store32(uint8_t *pData, uint32_t value)
+{
+    memcpy(pData, &value, sizeof(value));
+}
+
+/// XOR a P entry and the round function of the other half into each lane.
+/// The lanes are spelled out so the compiler keeps them all in registers.
+#define BLOWFISH_ROUND4(x, y, p) \
+    x##0 ^= (p) ^ F(S, y##0); \
+    x##1 ^= (p) ^ F(S, y##1); \
+    x##2 ^= (p) ^ F(S, y##2); \
+    x##3 ^= (p) ^ F(S, y##3)
+
+/**
+ * Run 4 blocks through the rounds. The P entries are passed in the order
+ * they are used so the same code encrypts and decrypts.
+ */
+static inline void CryptInterleaved(const BF_KEY& key, const uint8_t *pIn,
+    uint8_t *pOut, const int *order)
+{
+    static_assert(4 == BLOWFISH_LANES, "CryptInterleaved has 4 lanes");
+
+    const BF_LONG *P = key.P;
+    const BF_LONG *S = key.S;
+
+    uint32_t l0 = Load32(pIn), r0 = Load32(pIn + 4);
+    uint32_t l1 = Load32(pIn + 8), r1 = Load32(pIn + 12);
+    uint32_t l2 = Load32(pIn + 16), r2 = Load32(pIn + 20);
+    uint32_t l3 = Load32(pIn + 24), r3 = Load32(pIn + 28);
+
+    uint32_t p = (uint32_t)P[order[0]];
+
+    l0 ^= p;
+    l1 ^= p;
+    l2 ^= p;
+    l3 ^= p;
+
+    for(int round = 1; round <= BLOWFISH_ROUNDS; round += 2)
+    {
+        BLOWFISH_ROUND4(r, l, (uint32_t)P[order[round]]);
+        BLOWFISH_ROUND4(l, r, (uint32_t)P[order[round + 1]]);
+    }
+
+    p = (uint32_t)P[order[BLOWFISH_ROUNDS + 1]];
+
+    // The halves swap places like BF_encrypt/BF_decrypt.
+    Store32(pOut, r0 ^ p);
+    Store32(pOut + 4, l0);
+    Store32(pOut + 8, r1 ^ p);
+    Store32(pOut + 12, l1);
+    Store32(pOut + 16, r2 ^ p);
+    Store32(pOut + 20, l2);
+    Store32(pOut + 24, r3 ^ p);
+    Store32(pOut + 28, l3);
+}
+
+#undef BLOWFISH_ROUND4
+
+/// Order the P entries are used in to encrypt.
+static const int ENCRYPT_ORDER[BLOWFISH_ROUNDS + 2] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17
+};
+
+/// Order the P entries are used in to decrypt.
+static const int DECRYPT_ORDER[BLOWFISH_ROUNDS + 2] = {
+    17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+};
+
+#ifdef LIBCOMP_BLOWFISH_AVX2
+__attribute__((target("avx2")))
+static inline __m256i FAvx2(const int *S, __m256i x)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+
+    __m256i a = _mm256_i32gather_epi32(S, _mm256_srli_epi32(x, 24), 4);
+    __m256i b = _mm256_i32gather_epi32(S + 0x100, _mm256_and_si256(
+        _mm256_srli_epi32(x, 16), mask), 4);
+    __m256i c = _mm256_i32gather_epi32(S + 0x200, _mm256_and_si256(
+        _mm256_srli_epi32(x, 8), mask), 4);
+    __m256i d = _mm256_i32gather_epi32(S + 0x300, _mm256_and_si256(
+        x, mask), 4);
+
+    return _mm256_add_epi32(_mm256_xor_si256(_mm256_add_epi32(a, b), c), d);
+}
+
+/**
+ * Run 8 blocks through the rounds. The P entries are passed in the order
+ * they are used so the same code encrypts and decrypts.
+ */
+__attribute__((target("avx2")))
+static void CryptAvx2(const BF_KEY& key, const uint8_t *pIn, uint8_t *pOut,
+    bool encrypt)
+{
+    static_assert(sizeof(BF_LONG) == sizeof(int),
+        "AVX2 Blowfish needs 32-bit BF_LONG entries");
+
+    const int *S = reinterpret_cast<const int*>(key.S);
+
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+        pIn + 32));
+
+    // Split the halves of each block. The lanes end up in the order
+    // 0 1 4 5 2 3 6 7 which the unpack below puts back.
+    __m256i l = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a),
+        _mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256i r = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a),
+        _mm256_castsi256_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+
+    int first = encrypt ? 0 : BLOWFISH_ROUNDS + 1;
+    int step = encrypt ? 1 : -1;
+    int p = first;
+
+    l = _mm256_xor_si256(l, _mm256_set1_epi32((int)key.P[p]));
+
+    for(int round = 0; round < BLOWFISH_ROUNDS; round += 2)
+    {
+        p += step;
+        r = _mm256_xor_si256(r, _mm256_xor_si256(_mm256_set1_epi32(
+            (int)key.P[p]), FAvx2(S, l)));
+
+        p += step;
+        l = _mm256_xor_si256(l, _mm256_xor_si256(_mm256_set1_epi32(
+            (int)key.P[p]), FAvx2(S, r)));
+    }
+
+    p += step;
+    r = _mm256_xor_si256(r, _mm256_set1_epi32((int)key.P[p]));
+
+    // The halves swap places like BF_encrypt/BF_decrypt.
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut),
+        _mm256_unpacklo_epi32(r, l));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut + 32),
+        _mm256_unpackhi_epi32(r, l));
+}
+#endif // LIBCOMP_BLOWFISH_AVX2
+
+static void Crypt(Blowfish::Engine_t engine, const BF_KEY& key,
+    const void *pVoidIn, void *pVoidOut, size_t blockCount, bool encrypt)
+{
+    const uint8_t *pIn = reinterpret_cast<const uint8_t*>(pVoidIn);
+    uint8_t *pOut = reinterpret_cast<uint8_t*>(pVoidOut);
+
+#ifdef LIBCOMP_BLOWFISH_AVX2
+    if(Blowfish::ENGINE_AVX2 == engine)
+    {
+        while(BLOWFISH_AVX2_LANES <= blockCount)
+        {
+            CryptAvx2(key, pIn, pOut, encrypt);
+
+            pIn += BLOWFISH_AVX2_LANES * 8;
+            pOut += BLOWFISH_AVX2_LANES * 8;
+            blockCount -= BLOWFISH_AVX2_LANES;
+        }
+    }
+#endif // LIBCOMP_BLOWFISH_AVX2
+
+    if(Blowfish::ENGINE_SCALAR != engine)
+    {
+        while(BLOWFISH_LANES <= blockCount)
+        {
+            CryptInterleaved(key, pIn, pOut, encrypt ? ENCRYPT_ORDER :
+                DECRYPT_ORDER);
+
+            pIn += BLOWFISH_LANES * 8;
+            pOut += BLOWFISH_LANES * 8;
+            blockCount -= BLOWFISH_LANES;
+        }
+    }
+
+    // Finish whatever is left one block at a time.
+    while(0 < blockCount)
+    {
+        BF_LONG block[2];
+
+        memcpy(block, pIn, sizeof(block));
+
+        if(encrypt)
+        {
+            BF_encrypt(block, &key);
+        }
+        else
+        {
+            BF_decrypt(block, &key);
+        }
+
+        memcpy(pOut, block, sizeof(block));
+
+        pIn += 8;
+        pOut += 8;
+        blockCount--;
+    }
+}
+
+static double TimeEngine(Blowfish::Engine_t engine, const BF_KEY& key,
+    uint8_t *pData, size_t blockCount)
+{
+    double best = 0.0;
+
+    for(int i = 0; i < 8; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        Crypt(engine, key, pData, pData, blockCount, true);
+
+        double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        if(0 == i || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+static Blowfish::Engine_t DetectEngine()
+{
+    Blowfish::Engine_t engine = Blowfish::ENGINE_INTERLEAVED;
+
+    // Gathers are slow on some CPUs (and the interleaved code can beat them
+    // at -O3) so only use AVX2 if it is actually faster here. This takes
+    // well under a millisecond.
+    if(IsAvx2Supported())
+    {
+        BF_KEY key;
+        uint8_t data[256 * 8];
+
+        memset(data, 0, sizeof(data));
+        BF_set_key(&key, 16, data);
+
+        const size_t blockCount = sizeof(data) / 8;
+
+        if(TimeEngine(Blowfish::ENGINE_AVX2, key, data, blockCount) <
+            TimeEngine(Blowfish::ENGINE_INTERLEAVED, key, data, blockCount))
+        {
+            engine = Blowfish::ENGINE_AVX2;
+        }
+    }
+
+    return engine;
+}
+
+/// Engine in use. Until this is initialized it is ENGINE_SCALAR which is
+/// always safe to use.
+static Blowfish::Engine_t gEngine = DetectEngine();
+
+void Blowfish::EncryptBlocks(const BF_KEY& key, void *pData,
+    size_t blockCount)
+{
+    Crypt(gEngine, key, pData, pData, blockCount, true);
+}
+
+void Blowfish::EncryptBlocks(const BF_KEY& key, const void *pIn, void *pOut,
+    size_t blockCount)
+{
+    Crypt(gEngine, key, pIn, pOut, blockCount, true);
+}
+
+void Blowfish::DecryptBlocks(const BF_KEY& key, void *pData,
+    size_t blockCount)
+{
+    Crypt(gEngine, key, pData, pData, blockCount, false);
+}
+
+void Blowfish::DecryptBlocks(const BF_KEY& key, const void *pIn, void *pOut,
+    size_t blockCount)
+{
+    Crypt(gEngine, key, pIn, pOut, blockCount, false);
+}
+
+Blowfish::Engine_t Blowfish::GetEngine()
+{
+    return gEngine;
+}
+
+bool Blowfish::SetEngine(Engine_t engine)
+{
+    bool result = IsEngineSupported(engine);
+
+    if(result)
+    {
+        gEngine = engine;
+    }
+
+    return result;
+}
+
+bool Blowfish::IsEngineSupported(Engine_t engine)
+{
+    bool result = false;
+
+    switch(engine)
+    {
+        case ENGINE_SCALAR:
+        case ENGINE_INTERLEAVED:
+            result = true;
+            break;
+        case ENGINE_AVX2:
+            result = IsAvx2Supported();
+            break;
+    }
+
+    return result;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file libcomp/src/Blowfish.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Bulk Blowfish ECB routines.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_BLOWFISH_H
+#define LIBCOMP_SRC_BLOWFISH_H
+
+#include "PushIgnore.h"
+#include <openssl/blowfish.h>
+#include "PopIgnore.h"
+
+#include <stddef.h>
+
+namespace libcomp
+{
+
+/**
+ * Blowfish ECB routines that work on many blocks at once. Each block is
+ * independent so several blocks are run through the rounds together to hide
+ * the latency of the S-box lookups. The output is identical to calling
+ * BF_encrypt/BF_decrypt (or BF_ecb_encrypt) on each block in turn.
+ */
+namespace Blowfish
+{
+
+/**
+ * Implementations of the bulk routines.
+ */
+typedef enum
+{
+    /// One block at a time with BF_encrypt/BF_decrypt.
+    ENGINE_SCALAR = 0,
+    /// Several blocks interleaved in portable code.
+    ENGINE_INTERLEAVED,
+    /// Eight blocks at a time with AVX2 gathers (x86 only). This is only
+    /// picked if it is faster than @ref ENGINE_INTERLEAVED on this CPU.
+    ENGINE_AVX2,
+} Engine_t;
+
+/**
+ * Encrypt a number of 8 byte blocks in place.
+ * @param key Blowfish key to encrypt with.
+ * @param pData Data to be encrypted. This does not need to be aligned.
+ * @param blockCount Number of blocks to encrypt.
+ */
+void EncryptBlocks(const BF_KEY& key, void *pData, size_t blockCount);
+
+/**
+ * Encrypt a number of 8 byte blocks into another buffer.
+ * @param key Blowfish key to encrypt with.
+ * @param pIn Data to be encrypted.
+ * @param pOut Buffer for the encrypted data. This may be @em pIn but may
+ *   not overlap it otherwise.
+ * @param blockCount Number of blocks to encrypt.
+ */
+void EncryptBlocks(const BF_KEY& key, const void *pIn, void *pOut,
+    size_t blockCount);
+
+/**
+ * Decrypt a number of 8 byte blocks in place.
+ * @param key Blowfish key to decrypt with.
+ * @param pData Data to be decrypted. This does not need to be aligned.
+ * @param blockCount Number of blocks to decrypt.
+ */
+void DecryptBlocks(const BF_KEY& key, void *pData, size_t blockCount);
+
+/**
+ * Decrypt a number of 8 byte blocks into another buffer.
+ * @param key Blowfish key to decrypt with.
+ * @param pIn Data to be decrypted.
+ * @param pOut Buffer for the decrypted data. This may be @em pIn but may
+ *   not overlap it otherwise.
+ * @param blockCount Number of blocks to decrypt.
+ */
+void DecryptBlocks(const BF_KEY& key, const void *pIn, void *pOut,
+    size_t blockCount);
+
+/**
+ * Get the implementation picked for this CPU.
+ * @returns Engine used by @ref EncryptBlocks and @ref DecryptBlocks.
+ */
+Engine_t GetEngine();
+
+/**
+ * Override the implementation (mostly for tests and benchmarks). Must not
+ * be called while other threads are using the routines.
+ * @param engine Engine to use.
+ * @returns true if the engine is supported on this CPU; false otherwise
+ *   (the current engine is kept).
+ */
+bool SetEngine(Engine_t engine);
+
+/**
+ * Check if an implementation can run on this CPU.
+ * @param engine Engine to check.
+ * @returns true if the engine is supported; false otherwise.
+ */
+bool IsEngineSupported(Engine_t engine);
+
+} // namespace Blowfish
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_BLOWFISH_H
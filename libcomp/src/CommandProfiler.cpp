@@ -0,0 +1,250 @@
+/**
+ * @file libcomp/src/CommandProfiler.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Per-command-code latency and size profiler.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CommandProfiler.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+#include <vector>
+
+using namespace libcomp;
+
+/// Number of command codes (one entry for each 16-bit code).
+static const size_t COMMAND_CODE_COUNT = 65536;
+
+/**
+ * @internal
+ * Get the microseconds since a point in time.
+ * @param start Point in time to measure from.
+ * @returns Microseconds since @em start.
+ */
+static uint64_t MicrosecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @internal
+ * Get the average of a total.
+ * @param total Sum of every sample.
+ * @param count Number of samples.
+ * @returns Average sample (0 with no samples).
+ */
+static uint64_t Average(uint64_t total, uint64_t count)
+{
+    return 0 != count ? total / count : 0;
+}
+
+CommandProfiler::HandlerScope::HandlerScope(uint16_t commandCode) :
+    mCommandCode(commandCode),
+    mEnabled(CommandProfiler::GetSingletonPtr()->IsEnabled())
+{
+    if(mEnabled)
+    {
+        mStart = std::chrono::steady_clock::now();
+    }
+}
+
+CommandProfiler::HandlerScope::~HandlerScope()
+{
+    if(mEnabled)
+    {
+        CommandProfiler::GetSingletonPtr()->RecordHandled(mCommandCode,
+            MicrosecondsSince(mStart));
+    }
+}
+
+CommandProfiler::Entry::Entry() : count(0), bytes(0), queueMicroseconds(0),
+    handled(0), handlerMicroseconds(0), handlerMaxMicroseconds(0)
+{
+}
+
+CommandProfiler::CommandProfiler() : mEntries(nullptr), mEnabled(false)
+{
+}
+
+CommandProfiler* CommandProfiler::GetSingletonPtr()
+{
+    // Never destroyed so handlers may still finish during shutdown.
+    static CommandProfiler *pProfiler = new CommandProfiler;
+
+    return pProfiler;
+}
+
+void CommandProfiler::SetEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(enabled && nullptr == mEntries.load(std::memory_order_relaxed))
+    {
+        mEntries.store(new Entry[COMMAND_CODE_COUNT],
+            std::memory_order_release);
+    }
+
+    mEnabled.store(enabled, std::memory_order_release);
+}
+
+bool CommandProfiler::IsEnabled() const
+{
+    return mEnabled.load(std::memory_order_relaxed);
+}
+
+void CommandProfiler::RecordReceived(uint16_t commandCode, uint32_t size,
+    uint64_t queueMicroseconds)
+{
+    Entry *pEntries = mEntries.load(std::memory_order_acquire);
+
+    if(!IsEnabled() || nullptr == pEntries)
+    {
+        return;
+    }
+
+    Entry& entry = pEntries[commandCode];
+    entry.count.fetch_add(1, std::memory_order_relaxed);
+    entry.bytes.fetch_add(size, std::memory_order_relaxed);
+    entry.queueMicroseconds.fetch_add(queueMicroseconds,
+        std::memory_order_relaxed);
+}
+
+void CommandProfiler::RecordHandled(uint16_t commandCode,
+    uint64_t microseconds)
+{
+    Entry *pEntries = mEntries.load(std::memory_order_acquire);
+
+    if(!IsEnabled() || nullptr == pEntries)
+    {
+        return;
+    }
+
+    Entry& entry = pEntries[commandCode];
+    entry.handled.fetch_add(1, std::memory_order_relaxed);
+    entry.handlerMicroseconds.fetch_add(microseconds,
+        std::memory_order_relaxed);
+
+    uint64_t longest = entry.handlerMaxMicroseconds.load(
+        std::memory_order_relaxed);
+
+    while(microseconds > longest && !entry.handlerMaxMicroseconds.
+        compare_exchange_weak(longest, microseconds,
+        std::memory_order_relaxed))
+    {
+    }
+}
+
+CommandProfile_t CommandProfiler::GetProfile(uint16_t commandCode) const
+{
+    CommandProfile_t profile = CommandProfile_t();
+    Entry *pEntries = mEntries.load(std::memory_order_acquire);
+
+    if(nullptr != pEntries)
+    {
+        const Entry& entry = pEntries[commandCode];
+        profile.count = entry.count.load(std::memory_order_relaxed);
+        profile.bytes = entry.bytes.load(std::memory_order_relaxed);
+        profile.queueMicroseconds = entry.queueMicroseconds.load(
+            std::memory_order_relaxed);
+        profile.handled = entry.handled.load(std::memory_order_relaxed);
+        profile.handlerMicroseconds = entry.handlerMicroseconds.load(
+            std::memory_order_relaxed);
+        profile.handlerMaxMicroseconds = entry.handlerMaxMicroseconds.load(
+            std::memory_order_relaxed);
+    }
+
+    return profile;
+}
+
+void CommandProfiler::Reset()
+{
+    Entry *pEntries = mEntries.load(std::memory_order_acquire);
+
+    if(nullptr == pEntries)
+    {
+        return;
+    }
+
+    for(size_t i = 0; i < COMMAND_CODE_COUNT; ++i)
+    {
+        Entry& entry = pEntries[i];
+        entry.count.store(0, std::memory_order_relaxed);
+        entry.bytes.store(0, std::memory_order_relaxed);
+        entry.queueMicroseconds.store(0, std::memory_order_relaxed);
+        entry.handled.store(0, std::memory_order_relaxed);
+        entry.handlerMicroseconds.store(0, std::memory_order_relaxed);
+        entry.handlerMaxMicroseconds.store(0, std::memory_order_relaxed);
+    }
+}
+
+String CommandProfiler::Dump(size_t maxRows) const
+{
+    std::vector<std::pair<uint16_t, CommandProfile_t>> rows;
+
+    for(size_t i = 0; i < COMMAND_CODE_COUNT; ++i)
+    {
+        CommandProfile_t profile = GetProfile((uint16_t)i);
+
+        if(0 != profile.count || 0 != profile.handled)
+        {
+            rows.push_back(std::make_pair((uint16_t)i, profile));
+        }
+    }
+
+    std::sort(rows.begin(), rows.end(), [](
+        const std::pair<uint16_t, CommandProfile_t>& a,
+        const std::pair<uint16_t, CommandProfile_t>& b)
+    {
+        if(a.second.handlerMicroseconds != b.second.handlerMicroseconds)
+        {
+            return a.second.handlerMicroseconds >
+                b.second.handlerMicroseconds;
+        }
+
+        return a.second.queueMicroseconds > b.second.queueMicroseconds;
+    });
+
+    if(0 != maxRows && rows.size() > maxRows)
+    {
+        rows.resize(maxRows);
+    }
+
+    String text("  code      count        bytes avg_size   queue_us"
+        "    handled   handler_us   avg_us   max_us\n");
+
+    for(auto& row : rows)
+    {
+        const CommandProfile_t& profile = row.second;
+
+        text += String("0x%1 %2 %3 %4 %5 %6 %7 %8 %9\n").Arg(
+            row.first, 4, 16, '0').Arg(profile.count, 10).Arg(
+            profile.bytes, 12).Arg(Average(profile.bytes, profile.count),
+            8).Arg(Average(profile.queueMicroseconds, profile.count),
+            10).Arg(profile.handled, 10).Arg(profile.handlerMicroseconds,
+            12).Arg(Average(profile.handlerMicroseconds, profile.handled),
+            8).Arg(profile.handlerMaxMicroseconds, 8);
+    }
+
+    return text;
+}
@@ -0,0 +1,187 @@
+/**
+ * @file libcomp/src/CommandProfiler.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Per-command-code latency and size profiler.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_COMMANDPROFILER_H
+#define LIBCOMP_SRC_COMMANDPROFILER_H
+
+// libcomp Includes
+#include "String.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Totals kept for one command code.
+ */
+typedef struct
+{
+    /// Number of commands received.
+    uint64_t count;
+
+    /// Bytes of command data received.
+    uint64_t bytes;
+
+    /// Time from the frame being received to being queued (microseconds).
+    uint64_t queueMicroseconds;
+
+    /// Number of commands handled.
+    uint64_t handled;
+
+    /// Time spent in the command handlers (microseconds).
+    uint64_t handlerMicroseconds;
+
+    /// Longest time spent handling one command (microseconds).
+    uint64_t handlerMaxMicroseconds;
+} CommandProfile_t;
+
+/**
+ * Optional profiler that keeps totals for each command code in an array
+ * indexed by the 16-bit code. Nothing is recorded (and the array is not
+ * allocated) until the profiler is enabled so the parse path only pays
+ * for one relaxed load when profiling is off.
+ */
+class CommandProfiler
+{
+public:
+    /**
+     * Times a command handler and records it when it goes out of scope.
+     */
+    class HandlerScope
+    {
+    public:
+        /**
+         * Start timing a handler.
+         * @param commandCode Command code being handled.
+         */
+        explicit HandlerScope(uint16_t commandCode);
+
+        /**
+         * Record the time spent since the scope was created.
+         */
+        ~HandlerScope();
+
+    private:
+        uint16_t mCommandCode;
+        bool mEnabled;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    /**
+     * Get the profiler.
+     * @returns Pointer to the profiler.
+     */
+    static CommandProfiler* GetSingletonPtr();
+
+    /**
+     * Turn profiling on or off. Totals are kept when profiling is turned
+     * off and continue when it is turned back on.
+     * @param enabled If profiling should be done.
+     */
+    void SetEnabled(bool enabled);
+
+    /**
+     * Check if profiling is on.
+     * @returns true if commands are being profiled.
+     */
+    bool IsEnabled() const;
+
+    /**
+     * Record a received command.
+     * @param commandCode Command code.
+     * @param size Size of the command data.
+     * @param queueMicroseconds Time from receiving the frame to queuing it.
+     */
+    void RecordReceived(uint16_t commandCode, uint32_t size,
+        uint64_t queueMicroseconds);
+
+    /**
+     * Record a handled command.
+     * @param commandCode Command code.
+     * @param microseconds Time spent in the handler.
+     */
+    void RecordHandled(uint16_t commandCode, uint64_t microseconds);
+
+    /**
+     * Get the totals for a command code.
+     * @param commandCode Command code.
+     * @returns Totals for the command code.
+     */
+    CommandProfile_t GetProfile(uint16_t commandCode) const;
+
+    /**
+     * Zero every total.
+     */
+    void Reset();
+
+    /**
+     * Write a table of every command code seen so far. The commands that
+     * took the most handler time (then queue time) are listed first.
+     * @param maxRows Maximum number of rows to write (0 for every row).
+     * @returns Text of the table.
+     */
+    String Dump(size_t maxRows = 0) const;
+
+private:
+    CommandProfiler();
+
+    /**
+     * @internal
+     * Totals for one command code.
+     */
+    class Entry
+    {
+    public:
+        Entry();
+
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> queueMicroseconds;
+        std::atomic<uint64_t> handled;
+        std::atomic<uint64_t> handlerMicroseconds;
+        std::atomic<uint64_t> handlerMaxMicroseconds;
+    };
+
+    /// One entry per command code (allocated when first enabled and
+    /// never freed since the profiler lives until the process exits).
+    std::atomic<Entry*> mEntries;
+
+    /// Set once the entries exist and profiling is on.
+    std::atomic<bool> mEnabled;
+
+    /// Lock for allocating the entries.
+    std::mutex mLock;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_COMMANDPROFILER_H
@@ -31,65 +31,283 @@
 
 using namespace libcomp;
 
+/**
+ * @internal
+ * Number of bytes the output buffer of a stream grows by at a time.
+ */
+static const uInt STREAM_CHUNK_SIZE = 16384;
+
+/**
+ * @internal
+ * Allocate a zlib stream object with the default memory functions.
+ * @returns New zlib stream object.
+ */
+static std::unique_ptr<z_stream> NewStream()
+{
+    std::unique_ptr<z_stream> strm(new z_stream);
+
+    // Initialize the unset variables to null.
+    strm->zalloc = Z_NULL;
+    strm->zfree = Z_NULL;
+    strm->opaque = Z_NULL;
+    strm->avail_in = 0;
+    strm->next_in = Z_NULL;
+
+    return strm;
+}
+
 int32_t Compress::Compress(void *pIn, void *pOut, int32_t inSize,
     int32_t outSize, int32_t compLvl)
 {
-    // Sanity check the arguments. We may not have null buffers and all sizes
-    // must be positive numbers. The compression level must be between 0 and 9.
-    if(nullptr == pIn || nullptr == pOut || 1 > inSize || 1 > outSize ||
-        -1 > compLvl || 9 < compLvl)
+    // The compression level must be between 0 and 9 (or -1) to have a
+    // context.
+    Compressor *pCompressor = ThreadCompressor(compLvl);
+
+    if(nullptr == pCompressor)
     {
         return -1;
     }
 
+    return pCompressor->Compress(pIn, pOut, inSize, outSize);
+}
+
+int32_t Compress::Decompress(void *pIn, void *pOut,
+    int32_t inSize, int32_t outSize)
+{
+    return ThreadDecompressor()->Decompress(pIn, pOut, inSize, outSize);
+}
+
+Compress::Compressor* Compress::ThreadCompressor(int32_t compressionLevel)
+{
+    if(-1 > compressionLevel || 9 < compressionLevel)
+    {
+        return nullptr;
+    }
+
+    // One context per compression level (-1 to 9).
+    static thread_local std::unique_ptr<Compressor> contexts[11];
+
+    std::unique_ptr<Compressor>& context = contexts[compressionLevel + 1];
+
+    if(!context)
+    {
+        context.reset(new Compressor(compressionLevel));
+    }
+
+    return context.get();
+}
+
+Compress::Decompressor* Compress::ThreadDecompressor()
+{
+    static thread_local Decompressor context;
+
+    return &context;
+}
+
+Compress::Compressor::Compressor(int32_t compressionLevel) :
+    mLevel(compressionLevel), mStreaming(false)
+{
     // If the compression level is -1, use the default compression level.
-    if(-1 == compLvl)
+    if(-1 == mLevel)
     {
-        compLvl = Z_DEFAULT_COMPRESSION;
+        mLevel = Z_DEFAULT_COMPRESSION;
     }
+}
 
-    // Allocate the zlib stream object to store the state of the compression.
-    z_stream strm;
+Compress::Compressor::~Compressor()
+{
+    // Cleanup the zlib stream object (so it may free memory).
+    if(mStream)
+    {
+        (void)deflateEnd(mStream.get());
+    }
+}
 
-    // Initialize the unset variables to null.
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
+bool Compress::Compressor::Init()
+{
+    if(mStream)
+    {
+        return true;
+    }
+
+    // The compression level must be between 0 and 9.
+    if(Z_DEFAULT_COMPRESSION != mLevel && (0 > mLevel || 9 < mLevel))
+    {
+        return false;
+    }
+
+    std::unique_ptr<z_stream> strm = NewStream();
+
+    // Make sure the zlib stream initializes properly.
+    if(Z_OK != deflateInit(strm.get(), mLevel))
+    {
+        return false;
+    }
+
+    mStream = std::move(strm);
+
+    return true;
+}
+
+void Compress::Compressor::Reset()
+{
+    // Keep the zlib state around for the next payload.
+    if(mStream)
+    {
+        (void)deflateReset(mStream.get());
+    }
+
+    mStreaming = false;
+}
+
+int32_t Compress::Compressor::Compress(const void *pIn, void *pOut,
+    int32_t inSize, int32_t outSize)
+{
+    // Sanity check the arguments. We may not have null buffers and all sizes
+    // must be positive numbers.
+    if(nullptr == pIn || nullptr == pOut || 1 > inSize || 1 > outSize)
+    {
+        return -1;
+    }
 
     // Make sure the zlib stream initializes properly.
-    if(Z_OK != deflateInit(&strm, compLvl))
+    if(!Init())
     {
         return -2;
     }
 
+    if(mStreaming)
+    {
+        Reset();
+    }
+
+    z_stream *strm = mStream.get();
+
     // Tell zlib about the input buffer and how many bytes it contains.
-    strm.avail_in = (uInt)inSize;
-    strm.next_in = (Bytef*)pIn;
+    strm->avail_in = (uInt)inSize;
+    strm->next_in = (Bytef*)pIn;
 
     // Tell zlib about the output buffer and how many bytes it contains.
-    strm.avail_out = (uInt)outSize;
-    strm.next_out = (Bytef*)pOut;
+    strm->avail_out = (uInt)outSize;
+    strm->next_out = (Bytef*)pOut;
+
+    // Attempt to compress the data.
+    int ret = deflate(strm, Z_FINISH);
+
+    // Save how many bytes of the output buffer were written to.
+    int32_t written = (int32_t)strm->total_out;
+
+    // Get the stream ready for the next payload.
+    Reset();
 
-    // Attempt to compress the data and return if an error occured.
-    if(Z_STREAM_END != deflate(&strm, Z_FINISH))
+    // Return if an error occured.
+    if(Z_STREAM_END != ret)
     {
         return -3;
     }
 
-    // Save how many bytes of the output buffer were written to.
-    int32_t written = (int32_t)strm.total_out;
+    // Success! Return how many bytes were written to the output buffer.
+    return written;
+}
+
+int32_t Compress::Compressor::Write(const void *pIn, int32_t inSize,
+    std::vector<char>& out, bool finish)
+{
+    if(0 > inSize || (nullptr == pIn && 0 < inSize))
+    {
+        return -1;
+    }
 
+    if(!Init())
+    {
+        return -2;
+    }
+
+    z_stream *strm = mStream.get();
+    size_t start = out.size();
+    int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+
+    mStreaming = true;
+
+    strm->avail_in = (uInt)inSize;
+    strm->next_in = (Bytef*)pIn;
+
+    // Keep giving zlib more room until it stops filling the output.
+    do
+    {
+        size_t used = out.size();
+        out.resize(used + STREAM_CHUNK_SIZE);
+
+        strm->avail_out = STREAM_CHUNK_SIZE;
+        strm->next_out = (Bytef*)&out[used];
+
+        int ret = deflate(strm, flush);
+
+        out.resize(used + STREAM_CHUNK_SIZE - strm->avail_out);
+
+        if(Z_STREAM_ERROR == ret)
+        {
+            Reset();
+            out.resize(start);
+
+            return -3;
+        }
+    } while(0 == strm->avail_out);
+
+    // The whole payload has been written out.
+    if(finish)
+    {
+        Reset();
+    }
+
+    return (int32_t)(out.size() - start);
+}
+
+Compress::Decompressor::Decompressor() : mStreaming(false)
+{
+}
+
+Compress::Decompressor::~Decompressor()
+{
     // Cleanup the zlib stream object (so it may free memory).
-    if(Z_OK != deflateEnd(&strm))
+    if(mStream)
     {
-        return -4;
+        (void)inflateEnd(mStream.get());
     }
+}
 
-    // Success! Return how many bytes were written to the output buffer.
-    return written;
+bool Compress::Decompressor::Init()
+{
+    if(mStream)
+    {
+        return true;
+    }
+
+    std::unique_ptr<z_stream> strm = NewStream();
+
+    // Make sure the zlib stream initializes properly.
+    if(Z_OK != inflateInit(strm.get()))
+    {
+        return false;
+    }
+
+    mStream = std::move(strm);
+
+    return true;
 }
 
-int32_t Compress::Decompress(void *pIn, void *pOut,
+void Compress::Decompressor::Reset()
+{
+    // Keep the zlib state around for the next payload.
+    if(mStream)
+    {
+        (void)inflateReset(mStream.get());
+    }
+
+    mStreaming = false;
+}
+
+int32_t Compress::Decompressor::Decompress(const void *pIn, void *pOut,
     int32_t inSize, int32_t outSize)
 {
     // Sanity check the arguments. We may not have null buffers and all sizes
@@ -99,43 +317,120 @@ int32_t Compress::Decompress(void *pIn, void *pOut,
         return -1;
     }
 
-    // Allocate the zlib stream object to store the state of the decompression.
-    z_stream strm;
-
-    // Initialize the unset variables to null.
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-
-    // Tell zlib about the input buffer and how many bytes it contains.
-    strm.avail_in = (uInt)inSize;
-    strm.next_in = (Bytef*)pIn;
-
     // Make sure the zlib stream initializes properly.
-    if(Z_OK != inflateInit(&strm))
+    if(!Init())
     {
         return -2;
     }
 
-    // Tell zlib about the output buffer and how many bytes it contains.
-    strm.avail_out = (uInt)outSize;
-    strm.next_out = (Bytef*)pOut;
-
-    // Attempt to decompress the data and return if an error occured.
-    if(Z_STREAM_END != inflate(&strm, Z_FINISH))
+    if(mStreaming)
     {
-        return -3;
+        Reset();
     }
 
+    z_stream *strm = mStream.get();
+
+    // Tell zlib about the input buffer and how many bytes it contains.
+    strm->avail_in = (uInt)inSize;
+    strm->next_in = (Bytef*)pIn;
+
+    // Tell zlib about the output buffer and how many bytes it contains.
+    strm->avail_out = (uInt)outSize;
+    strm->next_out = (Bytef*)pOut;
+
+    // Attempt to decompress the data.
+    int ret = inflate(strm, Z_FINISH);
+
     // Save how many bytes of the output buffer were written to.
-    int32_t written = (int32_t)strm.total_out;
+    int32_t written = (int32_t)strm->total_out;
 
-    // Cleanup the zlib stream object (so it may free memory).
-    if(Z_OK != inflateEnd(&strm))
+    // Get the stream ready for the next payload.
+    Reset();
+
+    // Return if an error occured.
+    if(Z_STREAM_END != ret)
     {
-        return -4;
+        return -3;
     }
 
     // Success! Return how many bytes were written to the output buffer.
     return written;
 }
+
+int32_t Compress::Decompressor::Write(const void *pIn, int32_t inSize,
+    std::vector<char>& out, bool& finished, size_t maxSize)
+{
+    finished = false;
+
+    if(nullptr == pIn || 1 > inSize)
+    {
+        return -1;
+    }
+
+    if(!Init())
+    {
+        return -2;
+    }
+
+    z_stream *strm = mStream.get();
+    size_t start = out.size();
+
+    mStreaming = true;
+
+    strm->avail_in = (uInt)inSize;
+    strm->next_in = (Bytef*)pIn;
+
+    // Keep giving zlib more room until it needs more input.
+    while(true)
+    {
+        size_t used = out.size();
+
+        if(used >= maxSize)
+        {
+            // The payload is bigger than allowed.
+            Reset();
+            out.resize(start);
+
+            return -3;
+        }
+
+        size_t room = maxSize - used;
+
+        if(STREAM_CHUNK_SIZE < room)
+        {
+            room = STREAM_CHUNK_SIZE;
+        }
+
+        out.resize(used + room);
+
+        strm->avail_out = (uInt)room;
+        strm->next_out = (Bytef*)&out[used];
+
+        int ret = inflate(strm, Z_NO_FLUSH);
+
+        out.resize(used + room - strm->avail_out);
+
+        if(Z_STREAM_END == ret)
+        {
+            // Get the stream ready for the next payload.
+            finished = true;
+            Reset();
+
+            break;
+        }
+        else if(Z_OK != ret && Z_BUF_ERROR != ret)
+        {
+            Reset();
+            out.resize(start);
+
+            return -3;
+        }
+        else if(0 != strm->avail_out)
+        {
+            // All of the input has been used.
+            break;
+        }
+    }
+
+    return (int32_t)(out.size() - start);
+}
@@ -29,15 +29,182 @@
 
 #include <stdint.h>
 
+// Standard C++11 Includes
+#include <memory>
+#include <vector>
+
+// zlib stream state (see zlib.h).
+struct z_stream_s;
+
 namespace libcomp
 {
 
 /**
- * Routines to compress and decompress data using zlib.
+ * Routines to compress and decompress data using zlib. The one call
+ * functions reuse a zlib context kept for each thread (and compression
+ * level) so they do not pay for setting up the zlib state every time.
  */
 namespace Compress
 {
 
+/**
+ * Reusable zlib compression context. The zlib state is created on first use
+ * and reset (instead of freed) between payloads. A context must only be
+ * used by one thread at a time.
+ */
+class Compressor
+{
+public:
+    /**
+     * Create a new compression context.
+     * @param compressionLevel Compression level to use (0 to 9 or -1 for
+     *   Z_DEFAULT_COMPRESSION).
+     */
+    explicit Compressor(int32_t compressionLevel = -1);
+
+    /**
+     * Free the zlib state.
+     */
+    ~Compressor();
+
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    /**
+     * %Compress a whole payload at once. This discards any stream started
+     * with @ref Write.
+     * @param pIn Input buffer containing the data to be compressed.
+     * @param pOut Output buffer to store the compressed data.
+     * @param inSize Size of the input data to be compressed.
+     * @param outSize Size of output buffer.
+     * @returns Number of bytes written or an error as described by
+     *   @ref libcomp::Compress::Compress.
+     */
+    int32_t Compress(const void *pIn, void *pOut, int32_t inSize,
+        int32_t outSize);
+
+    /**
+     * Add a chunk of a payload to the stream and append the compressed data
+     * zlib produces to @em out. Once @em finish is set the stream is ended
+     * and the context may be used for the next payload.
+     * @param pIn Chunk of data to compress (may be null if @em inSize is 0).
+     * @param inSize Size of the chunk.
+     * @param out Buffer to append the compressed data to.
+     * @param finish Indicates this is the last chunk of the payload.
+     * @returns Number of bytes appended or a negative error code (-1 for
+     *   invalid arguments, -2 for an initialization error and -3 for a
+     *   compression error).
+     */
+    int32_t Write(const void *pIn, int32_t inSize, std::vector<char>& out,
+        bool finish);
+
+    /**
+     * Discard any partially compressed payload.
+     */
+    void Reset();
+
+private:
+    /**
+     * @internal
+     * Create the zlib state if needed.
+     * @returns true if the context is ready to use.
+     */
+    bool Init();
+
+    /// Compression level given to zlib.
+    int32_t mLevel;
+
+    /// zlib stream state (null until first used).
+    std::unique_ptr<z_stream_s> mStream;
+
+    /// Indicates a payload has been started with @ref Write.
+    bool mStreaming;
+};
+
+/**
+ * Reusable zlib decompression context. The zlib state is created on first
+ * use and reset (instead of freed) between payloads. A context must only be
+ * used by one thread at a time.
+ */
+class Decompressor
+{
+public:
+    /**
+     * Create a new decompression context.
+     */
+    Decompressor();
+
+    /**
+     * Free the zlib state.
+     */
+    ~Decompressor();
+
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    /**
+     * %Decompress a whole payload at once. This discards any stream started
+     * with @ref Write.
+     * @param pIn Input buffer containing the data to be decompressed.
+     * @param pOut Output buffer to store the decompressed data.
+     * @param inSize Size of the input data to be decompressed.
+     * @param outSize Size of output buffer.
+     * @returns Number of bytes written or an error as described by
+     *   @ref libcomp::Compress::Decompress.
+     */
+    int32_t Decompress(const void *pIn, void *pOut, int32_t inSize,
+        int32_t outSize);
+
+    /**
+     * Add a chunk of compressed data to the stream and append the data zlib
+     * produces to @em out. The context may be used for the next payload
+     * once the end of the compressed data has been reached.
+     * @param pIn Chunk of compressed data.
+     * @param inSize Size of the chunk.
+     * @param out Buffer to append the decompressed data to.
+     * @param finished Set to true when the end of the payload was reached.
+     * @param maxSize Maximum size @em out may grow to (so a bad payload can
+     *   not use up all memory).
+     * @returns Number of bytes appended or a negative error code (-1 for
+     *   invalid arguments, -2 for an initialization error and -3 for a
+     *   decompression error or if the data is bigger than @em maxSize).
+     */
+    int32_t Write(const void *pIn, int32_t inSize, std::vector<char>& out,
+        bool& finished, size_t maxSize = SIZE_MAX);
+
+    /**
+     * Discard any partially decompressed payload.
+     */
+    void Reset();
+
+private:
+    /**
+     * @internal
+     * Create the zlib state if needed.
+     * @returns true if the context is ready to use.
+     */
+    bool Init();
+
+    /// zlib stream state (null until first used).
+    std::unique_ptr<z_stream_s> mStream;
+
+    /// Indicates a payload has been started with @ref Write.
+    bool mStreaming;
+};
+
+/**
+ * Get the compression context of the calling thread for a compression level.
+ * @param compressionLevel Compression level (0 to 9 or -1 for the default).
+ * @returns Compression context or null if the level is not valid.
+ */
+Compressor* ThreadCompressor(int32_t compressionLevel = -1);
+
+/**
+ * Get the decompression context of the calling thread.
+ * @returns Decompression context.
+ */
+Decompressor* ThreadDecompressor();
+
 /**
  * @brief %Compress an input buffer into the output buffer.
  * %Compress @em inSize bytes of data from the input buffer @em in into the
@@ -0,0 +1,207 @@
+/**
+ * @file libcomp/src/ConnectionHandle.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Reference counted handle to a connection for received messages.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ConnectionHandle.h"
+
+// libcomp Includes
+#include "BlockPool.h"
+#include "ConnectionRegistry.h"
+#include "Constants.h"
+#include "TcpConnection.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <new>
+
+using namespace libcomp;
+
+/**
+ * @internal
+ * Block shared by the copies of a handle.
+ */
+class ConnectionHandle::Block
+{
+public:
+    /// Reference keeping the connection alive.
+    std::shared_ptr<TcpConnection> connection;
+
+    /// Registry ID of the connection.
+    uint64_t id;
+
+    /// Number of handles sharing the block.
+    std::atomic<uint32_t> references;
+};
+
+namespace
+{
+
+BlockPool* GetHandlePool()
+{
+    // This is never freed on purpose; handles may still be released by
+    // other threads while static objects are being destroyed.
+    static BlockPool *pPool = new BlockPool(sizeof(ConnectionHandle::Block),
+        MESSAGE_POOL_SLAB_SIZE);
+
+    return pPool;
+}
+
+} // namespace
+
+ConnectionHandle::ConnectionHandle() : mBlock(nullptr)
+{
+}
+
+ConnectionHandle::ConnectionHandle(
+    const std::shared_ptr<TcpConnection>& connection) : mBlock(nullptr)
+{
+    if(!connection)
+    {
+        return;
+    }
+
+    void *pMemory = GetHandlePool()->Allocate();
+
+    if(nullptr == pMemory)
+    {
+        throw std::bad_alloc();
+    }
+
+    mBlock = new (pMemory) Block;
+    mBlock->connection = connection;
+    mBlock->id = connection->GetConnectionID();
+    mBlock->references.store(1, std::memory_order_relaxed);
+}
+
+ConnectionHandle::ConnectionHandle(const ConnectionHandle& other) :
+    mBlock(other.mBlock)
+{
+    if(nullptr != mBlock)
+    {
+        mBlock->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+ConnectionHandle::ConnectionHandle(ConnectionHandle&& other) :
+    mBlock(other.mBlock)
+{
+    other.mBlock = nullptr;
+}
+
+ConnectionHandle::~ConnectionHandle()
+{
+    Release();
+}
+
+ConnectionHandle& ConnectionHandle::operator=(const ConnectionHandle& other)
+{
+    if(mBlock != other.mBlock)
+    {
+        ConnectionHandle copy(other);
+
+        std::swap(mBlock, copy.mBlock);
+    }
+
+    return *this;
+}
+
+ConnectionHandle& ConnectionHandle::operator=(ConnectionHandle&& other)
+{
+    if(this != &other)
+    {
+        Release();
+
+        mBlock = other.mBlock;
+        other.mBlock = nullptr;
+    }
+
+    return *this;
+}
+
+ConnectionHandle ConnectionHandle::Borrow() const
+{
+    ConnectionHandle handle;
+
+    if(nullptr != mBlock)
+    {
+        // No other thread holds the block yet so a plain increment is
+        // enough. The queue push that publishes the messages orders it.
+        mBlock->references.store(mBlock->references.load(
+            std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        handle.mBlock = mBlock;
+    }
+
+    return handle;
+}
+
+TcpConnection* ConnectionHandle::Get() const
+{
+    return nullptr != mBlock ? mBlock->connection.get() : nullptr;
+}
+
+std::shared_ptr<TcpConnection> ConnectionHandle::Lock() const
+{
+    return nullptr != mBlock ? mBlock->connection : nullptr;
+}
+
+uint64_t ConnectionHandle::GetID() const
+{
+    return nullptr != mBlock ? mBlock->id : INVALID_CONNECTION_ID;
+}
+
+uint32_t ConnectionHandle::GetReferenceCount() const
+{
+    return nullptr != mBlock ? mBlock->references.load(
+        std::memory_order_relaxed) : 0;
+}
+
+ConnectionHandle::operator bool() const
+{
+    return nullptr != mBlock;
+}
+
+ObjectPoolStats_t ConnectionHandle::GetPoolStats()
+{
+    return GetHandlePool()->GetStats();
+}
+
+void ConnectionHandle::Release()
+{
+    if(nullptr == mBlock)
+    {
+        return;
+    }
+
+    // The last release must see every write made through the other copies.
+    if(1 == mBlock->references.fetch_sub(1, std::memory_order_acq_rel))
+    {
+        mBlock->~Block();
+
+        GetHandlePool()->Free(mBlock);
+    }
+
+    mBlock = nullptr;
+}
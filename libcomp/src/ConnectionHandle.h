@@ -0,0 +1,161 @@
+/**
+ * @file libcomp/src/ConnectionHandle.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Reference counted handle to a connection for received messages.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_CONNECTIONHANDLE_H
+#define LIBCOMP_SRC_CONNECTIONHANDLE_H
+
+// libcomp Includes
+#include "ObjectPool.h"
+
+// Standard C++11 Includes
+#include <memory>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+class TcpConnection;
+
+/**
+ * Handle to the connection a message was received on. The connection is
+ * held by a single shared_ptr inside a block allocated from a slab pool and
+ * the block has its own (intrusive) reference count. Every message made
+ * from one frame shares the block so the connection is promoted from its
+ * weak pointer once per frame instead of the shared_ptr being copied for
+ * every command. The block also keeps the registry ID of the connection;
+ * the ID has a generation so it never finds a newer connection in the same
+ * registry slot.
+ */
+class ConnectionHandle
+{
+public:
+    /**
+     * Create an empty handle.
+     */
+    ConnectionHandle();
+
+    /**
+     * Create a handle in a new block.
+     * @param connection Connection to hold. If this is null the handle is
+     *   empty and no block is allocated.
+     */
+    explicit ConnectionHandle(
+        const std::shared_ptr<TcpConnection>& connection);
+
+    /**
+     * Share the block of another handle (atomic increment).
+     * @param other Handle to share.
+     */
+    ConnectionHandle(const ConnectionHandle& other);
+
+    /**
+     * Take the block of another handle. No reference count is changed.
+     * @param other Handle to take; it is left empty.
+     */
+    ConnectionHandle(ConnectionHandle&& other);
+
+    /**
+     * Release the reference. The last one frees the block (and its
+     * reference to the connection).
+     */
+    ~ConnectionHandle();
+
+    /**
+     * Share the block of another handle.
+     * @param other Handle to share.
+     * @returns Reference to this handle.
+     */
+    ConnectionHandle& operator=(const ConnectionHandle& other);
+
+    /**
+     * Take the block of another handle.
+     * @param other Handle to take; it is left empty.
+     * @returns Reference to this handle.
+     */
+    ConnectionHandle& operator=(ConnectionHandle&& other);
+
+    /**
+     * Share the block without an atomic read-modify-write. This is only
+     * valid while no other thread can see the block: on the thread that
+     * created the handle, before any message holding it has been queued.
+     * @returns New handle sharing the block.
+     */
+    ConnectionHandle Borrow() const;
+
+    /**
+     * Get the connection without touching any reference count.
+     * @returns Connection or nullptr if the handle is empty.
+     */
+    TcpConnection* Get() const;
+
+    /**
+     * Get a shared pointer to the connection (for code that keeps it).
+     * @returns Connection or nullptr if the handle is empty.
+     */
+    std::shared_ptr<TcpConnection> Lock() const;
+
+    /**
+     * Get the registry ID the connection had when the handle was made.
+     * @returns ID of the connection or INVALID_CONNECTION_ID.
+     */
+    uint64_t GetID() const;
+
+    /**
+     * Get the number of handles sharing the block.
+     * @returns Number of references or 0 if the handle is empty.
+     */
+    uint32_t GetReferenceCount() const;
+
+    /**
+     * Check if the handle holds a connection.
+     * @returns true if the handle is not empty.
+     */
+    explicit operator bool() const;
+
+    /**
+     * Get the counters for the pool the blocks are allocated from.
+     * @returns Handle pool counters.
+     */
+    static ObjectPoolStats_t GetPoolStats();
+
+    /// @internal Block shared by the copies of a handle.
+    class Block;
+
+private:
+    /**
+     * @internal
+     * Release the reference held by this handle.
+     */
+    void Release();
+
+    /// Block shared by every copy of the handle.
+    Block *mBlock;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_CONNECTIONHANDLE_H
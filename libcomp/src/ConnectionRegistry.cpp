@@ -0,0 +1,220 @@
+/**
+ * @file libcomp/src/ConnectionRegistry.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Registry of the live connections of a server.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ConnectionRegistry.h"
+
+using namespace libcomp;
+
+ConnectionRegistry::ConnectionRegistry(size_t maxConnections) :
+    mMaxConnections(maxConnections), mCount(0), mSnapshotDirty(false),
+    mSnapshot(new ConnectionList_t)
+{
+}
+
+uint64_t ConnectionRegistry::Add(const std::shared_ptr<
+    TcpConnection>& connection)
+{
+    uint64_t id = INVALID_CONNECTION_ID;
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(nullptr != connection && mCount < mMaxConnections)
+    {
+        uint32_t index;
+
+        if(!mFreeSlots.empty())
+        {
+            index = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        }
+        else
+        {
+            index = (uint32_t)mSlots.size();
+
+            Slot slot;
+            slot.generation = 0;
+
+            mSlots.push_back(slot);
+        }
+
+        Slot& slot = mSlots[index];
+        slot.connection = connection;
+
+        // Generation 0 is never used so no ID is ever INVALID_CONNECTION_ID.
+        if(0 == ++slot.generation)
+        {
+            slot.generation = 1;
+        }
+
+        id = MakeID(index, slot.generation);
+        mCount++;
+
+        mSnapshotDirty.store(true, std::memory_order_release);
+    }
+
+    return id;
+}
+
+bool ConnectionRegistry::Remove(uint64_t id)
+{
+    bool result = false;
+
+    // Release the connection outside of the lock in case this was the last
+    // reference to it.
+    std::shared_ptr<TcpConnection> connection;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        uint32_t index = (uint32_t)(id & 0xFFFFFFFF);
+        uint32_t generation = (uint32_t)(id >> 32);
+
+        if(index < mSlots.size() && nullptr != mSlots[index].connection &&
+            generation == mSlots[index].generation)
+        {
+            connection = std::move(mSlots[index].connection);
+            mSlots[index].connection.reset();
+
+            mFreeSlots.push_back(index);
+            mCount--;
+
+            mSnapshotDirty.store(true, std::memory_order_release);
+
+            result = true;
+        }
+    }
+
+    // The old snapshot would keep the connection alive until the next
+    // call to Snapshot().
+    if(result)
+    {
+        (void)Snapshot();
+    }
+
+    return result;
+}
+
+std::shared_ptr<TcpConnection> ConnectionRegistry::Get(uint64_t id) const
+{
+    std::shared_ptr<TcpConnection> connection;
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    uint32_t index = (uint32_t)(id & 0xFFFFFFFF);
+    uint32_t generation = (uint32_t)(id >> 32);
+
+    if(index < mSlots.size() && generation == mSlots[index].generation)
+    {
+        connection = mSlots[index].connection;
+    }
+
+    return connection;
+}
+
+size_t ConnectionRegistry::Count() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mCount;
+}
+
+size_t ConnectionRegistry::GetMaxConnections() const
+{
+    return mMaxConnections;
+}
+
+std::shared_ptr<const ConnectionRegistry::ConnectionList_t>
+    ConnectionRegistry::Snapshot()
+{
+    if(mSnapshotDirty.load(std::memory_order_acquire))
+    {
+        // Release the old snapshot outside of the lock in case it holds the
+        // last reference to a connection.
+        std::shared_ptr<const ConnectionList_t> oldSnapshot;
+
+        std::lock_guard<std::mutex> guard(mLock);
+
+        // Another thread may have rebuilt it while this one waited.
+        if(mSnapshotDirty.load(std::memory_order_relaxed))
+        {
+            std::shared_ptr<ConnectionList_t> snapshot(new ConnectionList_t);
+
+            for(auto& slot : mSlots)
+            {
+                if(nullptr != slot.connection)
+                {
+                    snapshot->push_back(slot.connection);
+                }
+            }
+
+            oldSnapshot = std::atomic_exchange(&mSnapshot, std::shared_ptr<
+                const ConnectionList_t>(snapshot));
+
+            mSnapshotDirty.store(false, std::memory_order_release);
+        }
+    }
+
+    return std::atomic_load(&mSnapshot);
+}
+
+void ConnectionRegistry::Clear()
+{
+    std::vector<Slot> slots;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        // Keep the generations so old IDs stay invalid.
+        for(uint32_t index = 0; index < mSlots.size(); ++index)
+        {
+            Slot& slot = mSlots[index];
+
+            if(nullptr != slot.connection)
+            {
+                Slot released;
+                released.connection = std::move(slot.connection);
+                released.generation = slot.generation;
+
+                slots.push_back(released);
+                slot.connection.reset();
+
+                mFreeSlots.push_back(index);
+            }
+        }
+
+        mCount = 0;
+
+        mSnapshotDirty.store(true, std::memory_order_release);
+    }
+
+    // The old snapshot may still hold the connections.
+    (void)Snapshot();
+}
+
+uint64_t ConnectionRegistry::MakeID(uint32_t index, uint32_t generation)
+{
+    return ((uint64_t)generation << 32) | index;
+}
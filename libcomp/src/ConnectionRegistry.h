@@ -0,0 +1,144 @@
+/**
+ * @file libcomp/src/ConnectionRegistry.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Registry of the live connections of a server.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_CONNECTIONREGISTRY_H
+#define LIBCOMP_SRC_CONNECTIONREGISTRY_H
+
+// libcomp Includes
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+class TcpConnection;
+
+/// ID that never refers to a connection.
+const uint64_t INVALID_CONNECTION_ID = 0;
+
+/**
+ * Registry of the live connections of a server. Each connection is stored
+ * in a slot and gets an ID made of the slot index and a generation that is
+ * bumped every time the slot is reused, so a stale ID never finds the wrong
+ * connection. Adding and removing are O(1). Broadcasts iterate a snapshot
+ * list that is rebuilt only after the registry changed; getting an up to
+ * date snapshot does not take the lock.
+ */
+class ConnectionRegistry
+{
+public:
+    /// List of connections as taken by TcpConnection::BroadcastPacket.
+    typedef std::list<std::shared_ptr<TcpConnection>> ConnectionList_t;
+
+    /**
+     * Create an empty registry.
+     * @param maxConnections Maximum number of live connections.
+     */
+    explicit ConnectionRegistry(size_t maxConnections =
+        MAX_CLIENT_CONNECTIONS);
+
+    /**
+     * Add a connection.
+     * @param connection Connection to add.
+     * @returns ID of the connection or @ref INVALID_CONNECTION_ID if the
+     *   registry is full.
+     */
+    uint64_t Add(const std::shared_ptr<TcpConnection>& connection);
+
+    /**
+     * Remove a connection.
+     * @param id ID returned by @ref Add.
+     * @returns true if the connection was removed; false if the ID is not
+     *   (or no longer) in the registry.
+     */
+    bool Remove(uint64_t id);
+
+    /**
+     * Find a connection.
+     * @param id ID returned by @ref Add.
+     * @returns The connection or nullptr if the ID is not in the registry.
+     */
+    std::shared_ptr<TcpConnection> Get(uint64_t id) const;
+
+    /**
+     * Get the number of live connections.
+     * @returns Number of connections in the registry.
+     */
+    size_t Count() const;
+
+    /**
+     * Get the maximum number of live connections.
+     * @returns Maximum number of connections.
+     */
+    size_t GetMaxConnections() const;
+
+    /**
+     * Get a list of every connection. The list is shared and must not be
+     * changed; it does not change when the registry does.
+     * @returns Snapshot of the connections.
+     */
+    std::shared_ptr<const ConnectionList_t> Snapshot();
+
+    /**
+     * Remove every connection.
+     */
+    void Clear();
+
+private:
+    /**
+     * @internal
+     * Slot holding one connection.
+     */
+    class Slot
+    {
+    public:
+        std::shared_ptr<TcpConnection> connection;
+        uint32_t generation;
+    };
+
+    static uint64_t MakeID(uint32_t index, uint32_t generation);
+
+    mutable std::mutex mLock;
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+    size_t mMaxConnections;
+    size_t mCount;
+
+    std::atomic<bool> mSnapshotDirty;
+    std::shared_ptr<const ConnectionList_t> mSnapshot;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_CONNECTIONREGISTRY_H
@@ -42,6 +42,9 @@ namespace libcomp
 /// Number of hex digits for a Diffie-Hellman key.
 #define DH_KEY_HEX_SIZE (DH_KEY_BIT_SIZE / 4)
 
+/// Number of bytes for a Diffie-Hellman key (zero padded on the left).
+#define DH_KEY_BYTE_SIZE (DH_KEY_BIT_SIZE / 8)
+
 /// Number of bytes in the Diffie-Hellman share data.
 #define DH_SHARED_DATA_SIZE (DH_KEY_BIT_SIZE / 8)
 
@@ -51,18 +54,202 @@ namespace libcomp
 /// Base "g" for a Diffie-Hellman key exchange (string format).
 #define DH_BASE_STRING "2"
 
+/// Number of pre-generated server Diffie-Hellman key pairs to keep ready.
+#define DH_KEY_CACHE_SIZE (64)
+
+/// Milliseconds to wait before trying again to generate a cached key pair.
+#define DH_KEY_RETRY_DELAY (1000)
+
 /// Size of the stack that is used to talk to a Squirrel VM.
 #define SQUIRREL_STACK_SIZE (1024)
 
 /// Maximum number of bytes in a packet.
 #define MAX_PACKET_SIZE (16384)
 
+/// Size of the smallest packet buffer size class.
+#define PACKET_SMALL_SIZE (256)
+
+/// Size of the medium packet buffer size class (the largest is
+/// @ref MAX_PACKET_SIZE).
+#define PACKET_MEDIUM_SIZE (2048)
+
+/// Maximum number of released packet buffers kept for reuse (per class).
+#define PACKET_POOL_MAX_FREE (MAX_CLIENT_CONNECTIONS)
+
+/// Number of NUMA nodes that get their own packet buffer pools. Threads on
+/// a higher node share the pools of the last one.
+#define PACKET_POOL_NUMA_NODES (8)
+
+/// Size of the per-connection ring buffer used for streaming receives. This
+/// must hold at least one full packet plus the sizes before it.
+#define RECEIVE_BUFFER_SIZE (MAX_PACKET_SIZE * 2)
+
+/// Maximum number of released receive buffers kept for reuse by the
+/// connections that receive on demand.
+#define RECEIVE_BUFFER_POOL_MAX_FREE (64)
+
+/// Number of submission queue entries of each io_uring (see IoUring).
+#define IO_URING_ENTRIES (256)
+
+/// Number of receive buffers each io_uring hands to the kernel. This must
+/// be a power of two.
+#define IO_URING_BUFFER_COUNT (256)
+
+/// Size of each io_uring receive buffer (a packet buffer size class).
+#define IO_URING_BUFFER_SIZE (PACKET_MEDIUM_SIZE)
+
+/// Number of queued outgoing bytes at which a connection stops being
+/// writable (and low priority packets are dropped).
+#define OUTGOING_HIGH_WATERMARK (MAX_PACKET_SIZE * 64)
+
+/// Number of queued outgoing bytes at which a connection that stopped being
+/// writable is writable again.
+#define OUTGOING_LOW_WATERMARK (MAX_PACKET_SIZE * 16)
+
+/// Number of connections the kernel may queue before they are accepted.
+#define SOCKET_LISTEN_BACKLOG (1024)
+
+/// Maximum number of Diffie-Hellman handshake steps waiting for a worker.
+#define MAX_PENDING_HANDSHAKES (MAX_CLIENT_CONNECTIONS)
+
+/// Maximum number of queued packets to combine into a single socket write.
+#define MAX_SEND_BATCH_PACKETS (64)
+
+/// Maximum number of bytes to combine into a single socket write.
+#define MAX_SEND_BATCH_SIZE (MAX_PACKET_SIZE * 4)
+
+/// Number of bytes of queued commands that causes a frame to be sent.
+#define COMMAND_FLUSH_SIZE (MAX_PACKET_SIZE / 4)
+
+/// Milliseconds a queued command may wait for more commands to share its
+/// frame (rounded up to a tick of the connection timer wheel).
+#define COMMAND_FLUSH_DELAY (1)
+
+/// Number of points each node gets on a consistent hash ring. More points
+/// spread the keys more evenly at the cost of a bigger ring.
+#define HASH_RING_VIRTUAL_NODES (160)
+
+/// Number of bytes of queued internal messages that causes a frame to be
+/// sent.
+#define INTERNAL_FLUSH_SIZE (MAX_PACKET_SIZE / 2)
+
+/// Microseconds a queued internal message may wait for more messages to
+/// share its frame.
+#define INTERNAL_FLUSH_DELAY (500)
+
+/// Magic that starts both halves of the internal connection handshake.
+#define INTERNAL_MAGIC "COMPINT1"
+
+/// Number of random bytes each side adds to the internal handshake.
+#define INTERNAL_NONCE_SIZE (16)
+
+/// Size of the HMAC-SHA256 that proves a side knows the pre-shared key.
+#define INTERNAL_PROOF_SIZE (32)
+
+/// Time between attempts to reconnect a lost internal connection (in
+/// seconds).
+#define INTERNAL_RECONNECT_DELAY (2)
+
+/// Flag set in the real size of a frame when its commands are compressed.
+#define FRAME_COMPRESSED_FLAG (0x80000000u)
+
+/// Frames with at least this many bytes of commands are compressed when
+/// compression is enabled on the connection.
+#define FRAME_COMPRESS_THRESHOLD (1024)
+
+/// zlib compression level used for compressed frames.
+#define FRAME_COMPRESS_LEVEL (1)
+
+/// Default number of messages a MessageQueue can hold.
+#define MESSAGE_QUEUE_SIZE (MAX_CLIENT_CONNECTIONS * 16)
+
+/// Number of log messages that may wait for the asynchronous log writer.
+#define LOG_QUEUE_SIZE (4096)
+
+/// Number of bytes of log records that may wait for the asynchronous log
+/// writer to render them.
+#define LOG_RING_SIZE (1024 * 1024)
+
+/// Largest binary log record (the header and the arguments). Longer string
+/// arguments are cut short.
+#define LOG_RECORD_SIZE (4096)
+
+/// Number of CPUs a thread affinity list may refer to (CPUs 0 to one less
+/// than this).
+#define MAX_CPU_COUNT (4096)
+
+/// Milliseconds the asynchronous log writer may leave written messages in
+/// the log file buffer.
+#define LOG_FLUSH_INTERVAL (250)
+
+/// Number of bytes the asynchronous log writer may leave in the log file
+/// buffer.
+#define LOG_FLUSH_SIZE (64 * 1024)
+
+/// Number of bytes of an encrypted file that are read and decrypted (or
+/// encrypted and written) at a time.
+#define FILE_CHUNK_SIZE (64 * 1024)
+
+/// Number of prepared statements each database keeps for reuse.
+#define PREPARED_STATEMENT_CACHE_SIZE (256)
+
+/// Milliseconds an SQLite connection waits for a lock held by another
+/// connection before giving up.
+#define SQLITE_BUSY_TIMEOUT (5000)
+
+/// Number of statements a DatabaseBatch collects before it is sent.
+#define DATABASE_BATCH_SIZE (64)
+
+/// Number of rows DatabaseQuery::ForEachRow fetches from the server at a
+/// time.
+#define DATABASE_PAGE_SIZE (1000)
+
+/// Time between the writes of a WriteBehindStore (in milliseconds).
+#define WRITE_BEHIND_INTERVAL (5000)
+
+/// Number of messages allocated at a time by the message pool.
+#define MESSAGE_POOL_SLAB_SIZE (1024)
+
+/// Number of events kept for each thread by the Tracer. Older events are
+/// overwritten once a thread has recorded this many.
+#define TRACE_BUFFER_EVENTS (65536)
+
+/// Alignment of each file in a DataArchive (in bytes). This is a multiple
+/// of the page size so every file starts on its own page.
+#define DATA_ARCHIVE_ALIGNMENT (4096)
+
 /// Maximum number of calls to trace when generating the backtrace.
 #define MAX_BACKTRACE_DEPTH (100)
 
+/// Number of protocol errors logged each second (the rest are only
+/// counted).
+#define PROTOCOL_ERROR_LOG_RATE (10)
+
+/// Maximum number of bytes of a packet dumped for a protocol error.
+#define PROTOCOL_ERROR_DUMP_SIZE (256)
+
 /// Maximum number of clients that can be connected at a given time.
 #define MAX_CLIENT_CONNECTIONS (4096)
 
+/// New connections each remote address may open per second (on average).
+#define ACCEPT_RATE_PER_ADDRESS (4)
+
+/// New connections a remote address may open at once before the rate
+/// limit applies.
+#define ACCEPT_BURST_PER_ADDRESS (16)
+
+/// Connections each remote address may have open at the same time.
+#define ACCEPT_MAX_PER_ADDRESS (32)
+
+/// Number of remote addresses the accept limiter can track.
+#define ACCEPT_LIMITER_SIZE (16384)
+
+/// Number of independently locked shards of the accept limiter.
+#define ACCEPT_LIMITER_SHARD_COUNT (16)
+
+/// Number of slots the accept limiter searches for an address.
+#define ACCEPT_LIMITER_PROBES (8)
+
 /// Maximum supported character level.
 #define MAX_LEVEL (99)
 
@@ -77,6 +264,33 @@ namespace libcomp
 /// network issues is not able to confirm socket closure on their end.
 #define TIMEOUT_SOCKET (17)
 
+/// Time a new connection has to finish the encryption handshake (in
+/// seconds).
+#define TIMEOUT_HANDSHAKE (TIMEOUT_CLIENT)
+
+/// Time without receiving anything before a connection is asked to send a
+/// keepalive (in seconds).
+#define TIMEOUT_KEEPALIVE (5)
+
+/// Time the kernel holds a new connection waiting for the client to send
+/// something before it is accepted (in seconds).
+#define TIMEOUT_DEFER_ACCEPT (TIMEOUT_CLIENT)
+
+/// Time a stopping server waits for its connections to send what they have
+/// queued and close before the rest are dropped (in seconds).
+#define TIMEOUT_DRAIN (10)
+
+/// How often a stopping server checks if every connection has closed (in
+/// milliseconds).
+#define DRAIN_POLL_INTERVAL (50)
+
+/// Length of one tick of the connection timer wheels (in milliseconds).
+#define TIMER_WHEEL_TICK (100)
+
+/// Width and height of the cells an InterestGrid splits each zone into (in
+/// zone units). Range queries look at the cells overlapping their range.
+#define INTEREST_CELL_SIZE (1000.0f)
+
 /// Chat message is only visible by the person who sent it.
 #define CHAT_VISIBILITY_SELF   (0)
 
@@ -188,6 +402,41 @@ namespace libcomp
 /// Client is attempting to log out.
 #define LOGIN_STATE_PENDING_LOGOUT (7)
 
+/// Messages a MessageScheduler worker runs from one connection before it
+/// moves on to the next connection.
+#define SCHEDULER_STRAND_BATCH (32)
+
+/// Number of locks the connections of a MessageScheduler are spread over.
+#define SCHEDULER_SHARD_COUNT (64)
+
+/// Bytes of capture records buffered before the writer thread is woken.
+#define PACKET_CAPTURE_FLUSH_SIZE (64 * 1024)
+
+/// Bytes of capture records that may wait for the writer thread before new
+/// records are dropped.
+#define PACKET_CAPTURE_MAX_BUFFER (16 * 1024 * 1024)
+
+/// Milliseconds a capture record may wait before it is written.
+#define PACKET_CAPTURE_FLUSH_INTERVAL (250)
+
+/// Number of shards (per-thread slots) of each metric counter.
+#define METRICS_SHARD_COUNT (16)
+
+/// Bytes of OS random data each thread buffers for session tokens.
+#define SESSION_TOKEN_POOL_SIZE (4096)
+
+/// Default number of threads serving the login web pages.
+#define LOGIN_WEB_THREADS (8)
+
+/// Default number of accepted connections that may wait for a web thread.
+#define LOGIN_WEB_QUEUE_DEPTH (64)
+
+/// Milliseconds an idle keep-alive web connection is kept open.
+#define LOGIN_WEB_KEEP_ALIVE_MS (15000)
+
+/// Largest login form (in bytes) the web frontend will read.
+#define LOGIN_WEB_MAX_POST (4096)
+
 /**
  * Equip types used to determine the type of and where to place an equip.
  * @sa BfCharacterData::equip
@@ -25,7 +25,7 @@
  */
 
 #include "Convert.h"
-#include "Endian.h"
+#include "Utf8.h"
 
 // Lookup tables for CP-1252 and CP-932.
 #include "LookupTableCP1252.h"
@@ -33,9 +33,58 @@
 
 #include <limits.h>
 #include <stdint.h>
+#include <string.h>
 
 using namespace libcomp;
 
+/**
+ * @internal
+ * Look up a code point in one direction of a paged lookup table.
+ * @param pPageIndex Page of @em pPages for each high byte.
+ * @param pPages Pages of 256 mappings.
+ * @param value Code point to look up (16 bits at most).
+ * @returns The mapped code point.
+ */
+static inline uint16_t LookupPaged(const uint8_t *pPageIndex,
+    const uint16_t (*pPages)[256], uint32_t value)
+{
+    return pPages[pPageIndex[(value >> 8) & 0xFF]][value & 0xFF];
+}
+
+/**
+ * @internal
+ * Find the CP-1252 code point of a Unicode code point.
+ * @param unicode Unicode code point to convert.
+ * @returns The CP-1252 code point or the default character if there is none.
+ */
+static inline uint16_t UnicodeToCP1252(String::CodePoint unicode)
+{
+    if(0xFFFF < unicode)
+    {
+        return LookupTableCP1252Default;
+    }
+
+    return LookupPaged(LookupTableCP1252FromUnicode, LookupTableCP1252Pages,
+        unicode);
+}
+
+/**
+ * @internal
+ * Find the CP-932 code point of a Unicode code point.
+ * @param unicode Unicode code point to convert.
+ * @returns The CP-932 code point or the default character if there is none.
+ */
+static inline uint16_t UnicodeToCP932(String::CodePoint unicode)
+{
+    if(0xFFFF < unicode)
+    {
+        return LookupTableCP932Default;
+    }
+
+    return LookupPaged(LookupTableCP932FromUnicode, LookupTableCP932Pages,
+        unicode);
+}
+
 /**
  * Convert a CP-1252 encoded string to a @ref String.
  * @param szString The string to convert.
@@ -55,20 +104,22 @@ static String FromCP932Encoding(const uint8_t *szString, int size);
 /**
  * Convert the @ref String to a CP-1252 encoded string.
  * @param str String to convert.
- * @param nullTerminator Indicates if a null terminator should be added.
- * @returns The converted string.
+ * @param pDestination Buffer to write the converted string into.
+ * @param size Size of the buffer. Conversion stops when it is full.
+ * @returns Number of bytes the converted string needs.
  */
-static std::vector<char> ToCP1252Encoding(const String& str,
-    bool nullTerminator = true);
+static size_t ToCP1252Encoding(const String& str, uint8_t *pDestination,
+    size_t size);
 
 /**
  * Convert the @ref String to a CP-932 encoded string.
  * @param str String to convert.
- * @param nullTerminator Indicates if a null terminator should be added.
- * @returns The converted string.
+ * @param pDestination Buffer to write the converted string into.
+ * @param size Size of the buffer. Conversion stops when it is full.
+ * @returns Number of bytes the converted string needs.
  */
-static std::vector<char> ToCP932Encoding(const String& str,
-    bool nullTerminator = true);
+static size_t ToCP932Encoding(const String& str, uint8_t *pDestination,
+    size_t size);
 
 static String FromCP1252Encoding(const uint8_t *szString, int size)
 {
@@ -83,21 +134,43 @@ static String FromCP1252Encoding(const uint8_t *szString, int size)
     }
     else if(0 > size)
     {
-        size = INT_MAX;
+        // Find the null terminator up front so the ASCII scan below never
+        // reads past it.
+        size_t length = strlen((const char*)szString);
+
+        size = (size_t)INT_MAX < length ? INT_MAX : (int)length;
     }
 
-    // Obtain pointers to the lookup table so it may be used as an array of
-    // unsigned 16-bit values.
-    const uint16_t *pMappingTo = (uint16_t*)LookupTableCP1252;
-    const uint16_t *pMappingFrom = pMappingTo + 65536;
+    // Every CP-1252 code point is a single byte so only the first page of
+    // the lookup table is needed.
+    const uint16_t *pMappingFrom = LookupTableCP1252Pages[
+        LookupTableCP1252ToUnicode[0]];
+
+    // String to store the converted string into. No code point takes more
+    // than 3 bytes of UTF-8 so this is the only allocation.
+    std::string final;
+    final.reserve((size_t)size * 3);
 
-    // String to store the converted string into.
-    String final;
+    char encoded[4];
 
     // Loop over the string until the null terminator has been or the
     // requested size has been reached.
-    while(0 < size-- && 0 != *szString)
+    while(0 < size && 0 != *szString)
     {
+        // ASCII maps to itself so copy whole runs of it at once.
+        size_t run = Utf8::AsciiRun(szString, (size_t)size);
+
+        if(0 < run)
+        {
+            final.append((const char*)szString, run);
+            szString += run;
+            size -= (int)run;
+
+            continue;
+        }
+
+        size--;
+
         // Retrieve the next byte of the string and determine the mapped code
         // point for the desired encoding. Advance the pointer to the next
         // value in the source string.
@@ -113,11 +186,11 @@ static String FromCP1252Encoding(const uint8_t *szString, int size)
         }
 
         // Append the mapped code point to the string.
-        final += String::FromCodePoint(unicode);
+        final.append(encoded, Utf8::Encode(unicode, encoded));
     }
 
     // Return the converted string.
-    return final;
+    return String(final);
 }
 
 static String FromCP932Encoding(const uint8_t *szString, int size)
@@ -133,30 +206,60 @@ static String FromCP932Encoding(const uint8_t *szString, int size)
     }
     else if(0 > size)
     {
-        size = INT_MAX;
+        // Find the null terminator up front so the ASCII scan below never
+        // reads past it.
+        size_t length = strlen((const char*)szString);
+
+        size = (size_t)INT_MAX < length ? INT_MAX : (int)length;
     }
 
-    // Obtain pointers to the lookup table so it may be used as an array of
-    // unsigned 16-bit values.
-    const uint16_t *pMappingTo = (uint16_t*)LookupTableCP932;
-    const uint16_t *pMappingFrom = pMappingTo + 65536;
+    // Page of the lookup table for the single byte code points (ASCII and
+    // the half-width katakana).
+    const uint16_t *pSingleByte = LookupTableCP932Pages[
+        LookupTableCP932ToUnicode[0]];
+
+    // String to store the converted string into. No code point takes more
+    // than 3 bytes of UTF-8 so this is the only allocation.
+    std::string final;
+    final.reserve((size_t)size * 3);
 
-    // String to store the converted string into.
-    String final;
+    char encoded[4];
 
     // Loop over the string until the null terminator has been or the
     // requested size has been reached.
-    while(0 < size-- && 0 != *szString)
+    while(0 < size && 0 != *szString)
     {
+        // ASCII maps to itself so copy whole runs of it at once.
+        size_t run = Utf8::AsciiRun(szString, (size_t)size);
+
+        if(0 < run)
+        {
+            final.append((const char*)szString, run);
+            szString += run;
+            size -= (int)run;
+
+            continue;
+        }
+
+        size--;
+
         // Retrieve the next byte of the string and determine the mapped code
         // point for the desired encoding. CP932 is a multi-byte format similar
-        // to Shift-JIS. As such, if the most significant bit is set, another
-        // byte needs to be read and added to the code point before conversion.
+        // to Shift-JIS. As such, if the byte is a lead byte, another byte
+        // needs to be read and added to the code point before conversion.
+        // Bytes with the most significant bit set that have no page of their
+        // own (like the half-width katakana) are single byte code points.
         // After each byte read from the string, the string pointer should be
         // advanced.
         uint16_t cp932 = *(szString++);
+        String::CodePoint unicode;
 
-        if(cp932 & 0x80)
+        if(0 == (cp932 & 0x80) || LookupTableCP932UnmappedPage ==
+            LookupTableCP932ToUnicode[cp932])
+        {
+            unicode = pSingleByte[cp932];
+        }
+        else
         {
             // Sanity check that we can read the 2nd byte of the code point.
             // If not, we should return an empty string to indicate an error.
@@ -171,109 +274,87 @@ static String FromCP932Encoding(const uint8_t *szString, int size)
             // 8 most significant bits and the second byte in the 8 least
             // significant bits.
             cp932 = (uint16_t)( (cp932 << 8) | *(szString++) );
+
+            unicode = LookupPaged(LookupTableCP932ToUnicode,
+                LookupTableCP932Pages, cp932);
         }
 
         // If there is no mapped codec, return an empty string to indicate an
         // error.
-        String::CodePoint unicode = pMappingFrom[cp932];
-
         if(0 == unicode)
         {
             return String();
         }
 
         // Append the mapped code point to the string.
-        final += String::FromCodePoint(unicode);
+        final.append(encoded, Utf8::Encode(unicode, encoded));
     }
 
     // Return the converted string.
-    return final;
+    return String(final);
 }
 
-static std::vector<char> ToCP1252Encoding(const String& str,
-    bool nullTerminator)
+static size_t ToCP1252Encoding(const String& str, uint8_t *pDestination,
+    size_t size)
 {
-    // Obtain a pointer to the lookup table so it may be used as an array of
-    // unsigned 16-bit values.
-    const uint16_t *pMappingTo = (uint16_t*)LookupTableCP1252;
-
-    // Used to add a null terminator to the end of the byte array.
-    char zero = 0;
-
-    // String to store the converted string into.
-    std::vector<char> final;
+    // Every code point is a single byte so there is nothing to measure.
+    size_t needed = str.Length();
 
-    // Loop over every character in the source string.
-    for(size_t i = 0; i < str.Length(); ++i)
+    if(size < needed)
     {
-        // Get the Unicode code point for the current character.
-        String::CodePoint unicode = str.At(i);
-
-        // Find the mapped code point for the desired encoding.
-        uint16_t cp1252 = pMappingTo[unicode];
-
-        // Add the converted character to the final string.
-        final.push_back((char)(cp1252 & 0xFF));
+        return needed;
     }
 
-    // Append a null terminator to the end of the final string.
-    if(nullTerminator)
+    // Loop over every character in the source string.
+    for(String::CodePoint unicode : str)
     {
-        final.push_back(zero);
+        // Find the mapped code point for the desired encoding and add the
+        // converted character to the final string.
+        *(pDestination++) = (uint8_t)(UnicodeToCP1252(unicode) & 0xFF);
     }
 
-    // Return the converted string.
-    return final;
+    // Return the size of the converted string.
+    return needed;
 }
 
-static std::vector<char> ToCP932Encoding(const String& str,
-    bool nullTerminator)
+static size_t ToCP932Encoding(const String& str, uint8_t *pDestination,
+    size_t size)
 {
-    // Obtain a pointer to the lookup table so it may be used as an array of
-    // unsigned 16-bit values.
-    const uint16_t *pMappingTo = (uint16_t*)LookupTableCP932;
-
-    // Used to add a null terminator to the end of the byte array.
-    char zero = 0;
-
-    // String to store the converted string into.
-    std::vector<char> final;
+    size_t needed = 0;
 
     // Loop over every character in the source string.
-    for(size_t i = 0; i < str.Length(); ++i)
+    for(String::CodePoint unicode : str)
     {
-        // Get the Unicode code point for the current character.
-        String::CodePoint unicode = str.At(i);
-
         // Find the mapped code point for the desired encoding.
-        uint16_t cp932 = pMappingTo[unicode];
+        uint16_t cp932 = UnicodeToCP932(unicode);
 
         // If the most significant bit is set, this CP932 code point is a
         // multi-byte codepoint.
         if(cp932 & 0x8000)
         {
-            // Double byte, ensure the value is in big endian host order.
-            cp932 = htobe16(cp932);
+            // Double byte, write the high byte first.
+            if(size >= (needed + 2))
+            {
+                pDestination[needed] = (uint8_t)((cp932 >> 8) & 0xFF);
+                pDestination[needed + 1] = (uint8_t)(cp932 & 0xFF);
+            }
 
-            // Write two bytes to the final string.
-            final.push_back((char)(cp932 & 0xFF));
-            final.push_back((char)((cp932 >> 8) & 0xFF));
+            needed += 2;
         }
         else
         {
             // Single byte, write one byte to the final string.
-            final.push_back((char)(cp932 & 0xFF));
-        }
-    }
+            if(size > needed)
+            {
+                pDestination[needed] = (uint8_t)(cp932 & 0xFF);
+            }
 
-    // Append a null terminator to the end of the final string.
-    if(nullTerminator)
-    {
-        final.push_back(zero);
+            needed++;
+        }
     }
 
-    // Return the converted string.
-    return final;
+    // Return the size of the converted string.
+    return needed;
 }
 
 String Convert::FromEncoding(Encoding_t encoding,
@@ -309,33 +390,87 @@ String Convert::FromEncoding(Encoding_t encoding, const std::vector<char>& str)
 std::vector<char> Convert::ToEncoding(Encoding_t encoding, const String& str,
     bool nullTerminator)
 {
+    // Size the result once and convert straight into it.
+    std::vector<char> final(SizeEncoded(encoding, str) +
+        (nullTerminator ? 1 : 0));
+
+    if(!final.empty())
+    {
+        EncodeInto(encoding, str, &final[0], final.size(), nullTerminator);
+    }
+
+    // Return the converted string.
+    return final;
+}
+
+size_t Convert::EncodeInto(Encoding_t encoding, const String& str,
+    char *pDestination, size_t size, bool nullTerminator)
+{
+    uint8_t *pBuffer = reinterpret_cast<uint8_t*>(pDestination);
+    size_t needed;
+
     // Determine the function to call based on the encoding requested.
     switch(encoding)
     {
         case ENCODING_CP932:
-            return ToCP932Encoding(str, nullTerminator);
+            needed = ToCP932Encoding(str, pBuffer, size);
+            break;
         case ENCODING_CP1252:
-            return ToCP1252Encoding(str, nullTerminator);
+            needed = ToCP1252Encoding(str, pBuffer, size);
+            break;
         default:
+        {
+            // Default to a UTF-8 encoded string.
+            needed = str.Size();
+
+            if(0 < needed && size >= needed)
+            {
+                memcpy(pBuffer, str.C(), needed);
+            }
+
             break;
+        }
     }
 
-    // Default to a UTF-8 encoded string.
-    return str.Data(nullTerminator);
+    // Append a null terminator to the end of the final string.
+    if(nullTerminator)
+    {
+        if(size > needed)
+        {
+            pBuffer[needed] = 0;
+        }
+
+        needed++;
+    }
+
+    return needed;
 }
 
 size_t Convert::SizeEncoded(Encoding_t encoding, const String& str,
     size_t align)
 {
-    // Convert the string to determine the size of the encoded result.
-    std::vector<char> out = ToEncoding(encoding, str, false);
+    size_t size;
+
+    // Only CP-932 has to look at the string to know how big it will be.
+    switch(encoding)
+    {
+        case ENCODING_CP932:
+            size = ToCP932Encoding(str, nullptr, 0);
+            break;
+        case ENCODING_CP1252:
+            size = str.Length();
+            break;
+        default:
+            size = str.Size();
+            break;
+    }
 
     // If the string should be aligned, calculate the aligned size.
     if(0 < align)
     {
-        return ((out.size() + align - 1) / align) * align;
+        return ((size + align - 1) / align) * align;
     }
 
     // Return the size of the encoded string without alignment.
-    return out.size();
+    return size;
 }
@@ -93,6 +93,25 @@ String FromEncoding(Encoding_t encoding, const std::vector<char>& str);
 std::vector<char> ToEncoding(Encoding_t encoding, const String& str,
     bool nullTerminator = true);
 
+/**
+ * Convert a String to the specified @em encoding into an existing buffer.
+ * Use @ref SizeEncoded to find out how big the buffer must be.
+ * @param encoding Encoding to use. Can be one of:
+ * - ENCODING_UTF8 (Unicode)
+ * - ENCODING_CP932 (Japanese)
+ * - ENCODING_CP1252 (US English)
+ * @param str String to convert.
+ * @param pDestination Buffer to write the converted string into.
+ * @param size Size of the buffer in bytes.
+ * @param nullTerminator Indicates if a null terminator should be added.
+ * @returns Number of bytes the converted string takes. If this is more than
+ *   @em size the buffer was too small and its contents are unspecified.
+ * @sa libfrost::Convert::ToEncoding
+ * @sa libfrost::Convert::SizeEncoded
+ */
+size_t EncodeInto(Encoding_t encoding, const String& str, char *pDestination,
+    size_t size, bool nullTerminator = true);
+
 /**
  * Determine the size of a String if it was converted to the specified
  * @em encoding. If @em align is specified, the size will be rounded up to a
@@ -107,7 +126,8 @@ std::vector<char> ToEncoding(Encoding_t encoding, const String& str,
  *   For example a string of length 13 would return a length of 16 if align
  *   was set to 4.
  * @returns The size of the string if it was converted to the desired encoding
- *   with the optional byte alignment.
+ *   with the optional byte alignment. This does not include a null
+ *   terminator and does not convert the string.
  */
 size_t SizeEncoded(Encoding_t encoding, const String& str, size_t align = 0);
 
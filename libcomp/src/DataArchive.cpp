@@ -0,0 +1,438 @@
+/**
+ * @file libcomp/src/DataArchive.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Indexed archive of game data files read through a memory map.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DataArchive.h"
+
+// libcomp Includes
+#include "Log.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else // !WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // WIN32
+
+using namespace libcomp;
+
+/// Magic at the start of every archive.
+static const char ARCHIVE_MAGIC[4] = { 'C', 'A', 'R', 'C' };
+
+/// Version of the archive format.
+static const uint32_t ARCHIVE_VERSION = 1;
+
+DataArchive::DataArchive() : mData(nullptr), mSize(0), mEntries(nullptr),
+    mCount(0), mNames(nullptr), mNamesSize(0)
+#if defined(_WIN32) || defined(_WIN64)
+    , mMapping(nullptr)
+#endif // WIN32
+{
+}
+
+DataArchive::~DataArchive()
+{
+    Close();
+}
+
+bool DataArchive::Open(const std::string& path)
+{
+    Close();
+
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if(INVALID_HANDLE_VALUE == file)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+
+    if(!GetFileSizeEx(file, &fileSize) || 0 == fileSize.QuadPart)
+    {
+        CloseHandle(file);
+
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY,
+        0, 0, nullptr);
+
+    // The mapping keeps the file open.
+    CloseHandle(file);
+
+    if(nullptr == mapping)
+    {
+        return false;
+    }
+
+    void *pData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if(nullptr == pData)
+    {
+        CloseHandle(mapping);
+
+        return false;
+    }
+
+    mMapping = mapping;
+    mData = reinterpret_cast<const char*>(pData);
+    mSize = (size_t)fileSize.QuadPart;
+#else // !WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if(0 > fd)
+    {
+        return false;
+    }
+
+    struct stat info;
+
+    if(0 != fstat(fd, &info) || 0 == info.st_size)
+    {
+        close(fd);
+
+        return false;
+    }
+
+    void *pData = mmap(nullptr, (size_t)info.st_size, PROT_READ,
+        MAP_SHARED, fd, 0);
+
+    // The mapping keeps the file open.
+    close(fd);
+
+    if(MAP_FAILED == pData)
+    {
+        return false;
+    }
+
+    mData = reinterpret_cast<const char*>(pData);
+    mSize = (size_t)info.st_size;
+#endif // WIN32
+
+    // Check the header and index once so lookups never leave the mapping.
+    const Header_t *pHeader = reinterpret_cast<const Header_t*>(mData);
+    bool valid = sizeof(Header_t) <= mSize &&
+        0 == memcmp(pHeader->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) &&
+        ARCHIVE_VERSION == pHeader->version &&
+        (uint64_t)pHeader->count * sizeof(Entry_t) + pHeader->namesSize <=
+            mSize - sizeof(Header_t);
+
+    if(valid)
+    {
+        mCount = pHeader->count;
+        mEntries = reinterpret_cast<const Entry_t*>(mData + sizeof(Header_t));
+        mNamesSize = pHeader->namesSize;
+        mNames = reinterpret_cast<const char*>(mEntries + mCount);
+
+        for(uint32_t i = 0; valid && i < mCount; ++i)
+        {
+            const Entry_t& entry = mEntries[i];
+
+            valid = entry.offset <= mSize && entry.size <= mSize -
+                entry.offset && entry.nameOffset <= mNamesSize &&
+                entry.nameSize <= mNamesSize - entry.nameOffset &&
+                (0 == i || mEntries[i - 1].hash <= entry.hash);
+        }
+    }
+
+    if(!valid)
+    {
+        LOG_ERROR(String("Invalid data archive: %1\n").Arg(path));
+
+        Close();
+
+        return false;
+    }
+
+    return true;
+}
+
+void DataArchive::Close()
+{
+    if(nullptr != mData)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        UnmapViewOfFile(mData);
+        CloseHandle(mMapping);
+        mMapping = nullptr;
+#else // !WIN32
+        munmap(const_cast<char*>(mData), mSize);
+#endif // WIN32
+    }
+
+    mData = nullptr;
+    mSize = 0;
+    mEntries = nullptr;
+    mCount = 0;
+    mNames = nullptr;
+    mNamesSize = 0;
+}
+
+bool DataArchive::IsOpen() const
+{
+    return nullptr != mData;
+}
+
+bool DataArchive::Get(const std::string& name, const char*& pData,
+    size_t& size) const
+{
+    const Entry_t *pEntry = Find(name);
+
+    if(nullptr == pEntry)
+    {
+        return false;
+    }
+
+    pData = mData + pEntry->offset;
+    size = (size_t)pEntry->size;
+
+    return true;
+}
+
+bool DataArchive::Contains(const std::string& name) const
+{
+    return nullptr != Find(name);
+}
+
+size_t DataArchive::Count() const
+{
+    return mCount;
+}
+
+std::vector<std::string> DataArchive::GetNames() const
+{
+    std::vector<std::string> names;
+    names.reserve(mCount);
+
+    for(uint32_t i = 0; i < mCount; ++i)
+    {
+        names.push_back(std::string(mNames + mEntries[i].nameOffset,
+            mEntries[i].nameSize));
+    }
+
+    return names;
+}
+
+bool DataArchive::Write(const std::string& path,
+    const std::vector<std::string>& names, const Loader_t& loader)
+{
+    std::vector<Entry_t> entries(names.size());
+    std::vector<std::string> normalized;
+    std::string nameTable;
+
+    normalized.reserve(names.size());
+
+    for(auto& name : names)
+    {
+        normalized.push_back(NormalizeName(name));
+    }
+
+    // Sort by hash (then name so the output is always the same).
+    std::vector<size_t> order(names.size());
+
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+        entries[i].hash = Hash(normalized[i]);
+    }
+
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        if(entries[a].hash != entries[b].hash)
+        {
+            return entries[a].hash < entries[b].hash;
+        }
+
+        return normalized[a] < normalized[b];
+    });
+
+    for(size_t i = 1; i < order.size(); ++i)
+    {
+        if(normalized[order[i - 1]] == normalized[order[i]])
+        {
+            LOG_ERROR(String("Duplicate file in data archive: %1\n").Arg(
+                names[order[i]]));
+
+            return false;
+        }
+    }
+
+    for(size_t i : order)
+    {
+        entries[i].nameOffset = (uint32_t)nameTable.size();
+        entries[i].nameSize = (uint32_t)normalized[i].size();
+
+        nameTable += normalized[i];
+    }
+
+    std::ofstream out(path.c_str(), std::ofstream::out |
+        std::ofstream::binary | std::ofstream::trunc);
+
+    if(!out.good())
+    {
+        return false;
+    }
+
+    Header_t header;
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+    header.count = (uint32_t)entries.size();
+    header.namesSize = (uint32_t)nameTable.size();
+
+    uint64_t offset = sizeof(Header_t) + entries.size() * sizeof(Entry_t) +
+        nameTable.size();
+
+    // The index is written last once every offset is known.
+    out.seekp((std::streamoff)offset);
+
+    std::vector<char> data;
+
+    for(size_t i : order)
+    {
+        data.clear();
+
+        if(!loader(names[i], data))
+        {
+            LOG_ERROR(String("Failed to read file for data archive: %1\n").Arg(
+                names[i]));
+
+            return false;
+        }
+
+        uint64_t padding = (DATA_ARCHIVE_ALIGNMENT - offset %
+            DATA_ARCHIVE_ALIGNMENT) % DATA_ARCHIVE_ALIGNMENT;
+
+        if(0 < padding)
+        {
+            std::vector<char> zeros((size_t)padding, 0);
+
+            out.write(&zeros[0], (std::streamsize)padding);
+            offset += padding;
+        }
+
+        entries[i].offset = offset;
+        entries[i].size = data.size();
+
+        if(!data.empty())
+        {
+            out.write(&data[0], (std::streamsize)data.size());
+            offset += data.size();
+        }
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for(size_t i : order)
+    {
+        out.write(reinterpret_cast<const char*>(&entries[i]),
+            sizeof(Entry_t));
+    }
+
+    out.write(nameTable.c_str(), (std::streamsize)nameTable.size());
+    out.close();
+
+    return !out.fail();
+}
+
+std::string DataArchive::NormalizeName(const std::string& name)
+{
+    std::string normalized;
+    normalized.reserve(name.size());
+
+    for(char c : name)
+    {
+        if('\\' == c)
+        {
+            c = '/';
+        }
+        else if('A' <= c && 'Z' >= c)
+        {
+            c = (char)(c - 'A' + 'a');
+        }
+
+        if('/' == c && normalized.empty())
+        {
+            continue;
+        }
+
+        normalized.push_back(c);
+    }
+
+    return normalized;
+}
+
+uint64_t DataArchive::Hash(const std::string& name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for(char c : name)
+    {
+        hash ^= (uint8_t)c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+const DataArchive::Entry_t* DataArchive::Find(const std::string& name) const
+{
+    if(0 == mCount)
+    {
+        return nullptr;
+    }
+
+    std::string normalized = NormalizeName(name);
+    uint64_t hash = Hash(normalized);
+
+    const Entry_t *pEnd = mEntries + mCount;
+    const Entry_t *pEntry = std::lower_bound(mEntries, pEnd, hash,
+        [](const Entry_t& entry, uint64_t value)
+        {
+            return entry.hash < value;
+        });
+
+    // Names that share a hash sit next to each other.
+    for(; pEntry != pEnd && pEntry->hash == hash; ++pEntry)
+    {
+        if(pEntry->nameSize == normalized.size() && 0 == memcmp(
+            mNames + pEntry->nameOffset, normalized.c_str(), pEntry->nameSize))
+        {
+            return pEntry;
+        }
+    }
+
+    return nullptr;
+}
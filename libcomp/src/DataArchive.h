@@ -0,0 +1,217 @@
+/**
+ * @file libcomp/src/DataArchive.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Indexed archive of game data files read through a memory map.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_DATAARCHIVE_H
+#define LIBCOMP_SRC_DATAARCHIVE_H
+
+// libcomp Includes
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Archive of (decrypted) game data files packed by comp_pack. The archive
+ * starts with a header and an index of every file sorted by the hash of
+ * its name. The data of each file starts on a page boundary. The reader maps
+ * the whole archive into memory, so opening it reads nothing up front. A
+ * lookup is a binary search of the index that returns a pointer straight
+ * into the mapping, with no copy or decryption. Every server on a host that
+ * maps the same archive shares its pages in the page cache.
+ *
+ * Layout (every number is little endian):
+ * @code
+ * Header_t   header;             // magic, version and file count
+ * Entry_t    index[count];       // sorted by name hash
+ * char       names[];            // every name, one after the other
+ * (padding to DATA_ARCHIVE_ALIGNMENT before each file)
+ * char       data[];
+ * @endcode
+ */
+class DataArchive
+{
+public:
+    /**
+     * Function that reads a file to pack.
+     * @param name Name of the file (as given to @ref Write).
+     * @param data Set to the contents of the file.
+     * @returns true if the file was read.
+     */
+    typedef std::function<bool(const std::string& name,
+        std::vector<char>& data)> Loader_t;
+
+    /**
+     * Create a reader with no archive open.
+     */
+    DataArchive();
+
+    /**
+     * Unmap the archive. Pointers returned by @ref Get become invalid.
+     */
+    ~DataArchive();
+
+    DataArchive(const DataArchive& other) = delete;
+    DataArchive& operator=(const DataArchive& other) = delete;
+
+    /**
+     * Map an archive into memory. Any archive already open is closed.
+     * @param path Path to the archive.
+     * @returns true if the archive was mapped and its index is valid.
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * Unmap the archive. Pointers returned by @ref Get become invalid.
+     */
+    void Close();
+
+    /**
+     * Check if an archive is open.
+     * @returns true if an archive is open.
+     */
+    bool IsOpen() const;
+
+    /**
+     * Find a file. The data is not copied; it stays valid until the archive
+     * is closed.
+     * @param name Name of the file (see @ref NormalizeName).
+     * @param pData Set to the start of the file data.
+     * @param size Set to the size of the file.
+     * @returns true if the file is in the archive.
+     */
+    bool Get(const std::string& name, const char*& pData,
+        size_t& size) const;
+
+    /**
+     * Check if a file is in the archive.
+     * @param name Name of the file.
+     * @returns true if the file is in the archive.
+     */
+    bool Contains(const std::string& name) const;
+
+    /**
+     * Get the number of files in the archive.
+     * @returns Number of files.
+     */
+    size_t Count() const;
+
+    /**
+     * Get the name of every file in the archive.
+     * @returns Names in index (hash) order.
+     */
+    std::vector<std::string> GetNames() const;
+
+    /**
+     * Write an archive. The files are read one at a time so the whole set
+     * is never held in memory.
+     * @param path Path of the archive to write.
+     * @param names Name of each file to pack.
+     * @param loader Function that reads each file.
+     * @returns true if the archive was written; false if a file could not
+     *   be read, two names are the same or the archive could not be
+     *   written.
+     */
+    static bool Write(const std::string& path,
+        const std::vector<std::string>& names, const Loader_t& loader);
+
+    /**
+     * Normalize the name of a file so "Data\\item.bin" and "data/item.bin"
+     * find the same file: backslashes become slashes, leading slashes are
+     * dropped and ASCII letters are lower case.
+     * @param name Name to normalize.
+     * @returns Normalized name.
+     */
+    static std::string NormalizeName(const std::string& name);
+
+    /**
+     * Hash a (normalized) file name (64-bit FNV-1a).
+     * @param name Name to hash.
+     * @returns Hash of the name.
+     */
+    static uint64_t Hash(const std::string& name);
+
+private:
+    /**
+     * @internal
+     * Start of the archive.
+     */
+    typedef struct
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t count;
+        uint32_t namesSize;
+    } Header_t;
+
+    /**
+     * @internal
+     * Index entry of one file.
+     */
+    typedef struct
+    {
+        uint64_t hash;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t nameOffset;
+        uint32_t nameSize;
+    } Entry_t;
+
+    const Entry_t* Find(const std::string& name) const;
+
+    /// Start of the mapping.
+    const char *mData;
+
+    /// Size of the mapping.
+    size_t mSize;
+
+    /// Index of the files (inside the mapping).
+    const Entry_t *mEntries;
+
+    /// Number of files.
+    uint32_t mCount;
+
+    /// Names of the files (inside the mapping).
+    const char *mNames;
+
+    /// Size of the names.
+    uint32_t mNamesSize;
+
+#if defined(_WIN32) || defined(_WIN64)
+    /// Handle of the file mapping.
+    void *mMapping;
+#endif // WIN32
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_DATAARCHIVE_H
@@ -35,5 +35,14 @@ bool Database::Execute(const String& query)
 
 String Database::GetLastError() const
 {
+    std::lock_guard<std::mutex> guard(mErrorLock);
+
     return mError;
 }
+
+void Database::SetLastError(const String& error)
+{
+    std::lock_guard<std::mutex> guard(mErrorLock);
+
+    mError = error;
+}
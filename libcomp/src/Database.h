@@ -28,9 +28,14 @@
 #define LIBCOMP_SRC_DATABASE_H
 
 // libcomp Includes
+#include "DatabaseBatch.h"
 #include "DatabaseQuery.h"
+#include "StatementCache.h"
 #include "String.h"
 
+// Standard C++11 Includes
+#include <mutex>
+
 namespace libcomp
 {
 
@@ -45,10 +50,37 @@ public:
     virtual DatabaseQuery Prepare(const String& query) = 0;
     virtual bool Execute(const String& query);
 
+    /**
+     * Create a batch to write many bound statements at once.
+     * @param logged If the batch must be applied atomically across
+     * partitions (Cassandra only; an SQLite batch is always one
+     * transaction). Unlogged batches are faster.
+     * @param flushSize Number of statements after which the batch is sent
+     * automatically (0 to only send it on @ref DatabaseBatch::Execute).
+     * @returns New batch.
+     */
+    virtual DatabaseBatch CreateBatch(bool logged = false,
+        size_t flushSize = DATABASE_BATCH_SIZE) = 0;
+
     String GetLastError() const;
 
+    /**
+     * Get the counters of the prepared statement cache.
+     * @returns Cache counters.
+     */
+    virtual StatementCacheStats_t GetStatementCacheStats() const = 0;
+
 protected:
+    /**
+     * Save the last error. Asynchronous queries finish on a driver thread so
+     * the error is guarded by a lock.
+     * @param error Error message to save.
+     */
+    void SetLastError(const String& error);
+
+private:
     String mError;
+    mutable std::mutex mErrorLock;
 };
 
 } // namespace libcomp
@@ -0,0 +1,112 @@
+/**
+ * @file libcomp/src/DatabaseBatch.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Group of database writes sent together.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DatabaseBatch.h"
+
+// libcomp Includes
+#include "Tracer.h"
+
+using namespace libcomp;
+
+DatabaseBatchImpl::~DatabaseBatchImpl()
+{
+}
+
+DatabaseBatch::DatabaseBatch(DatabaseBatchImpl *pImpl, size_t flushSize) :
+    mImpl(pImpl), mFlushSize(flushSize)
+{
+}
+
+DatabaseBatch::DatabaseBatch(DatabaseBatch&& other) : mImpl(other.mImpl),
+    mFlushSize(other.mFlushSize)
+{
+    other.mImpl = nullptr;
+}
+
+DatabaseBatch::~DatabaseBatch()
+{
+    delete mImpl;
+    mImpl = nullptr;
+}
+
+bool DatabaseBatch::Add(DatabaseQuery& query)
+{
+    bool result = false;
+
+    if(nullptr != mImpl && nullptr != query.mImpl)
+    {
+        result = mImpl->Add(query.mImpl);
+
+        if(result && 0 < mFlushSize && mImpl->Count() >= mFlushSize)
+        {
+            result = mImpl->Execute();
+        }
+    }
+
+    return result;
+}
+
+bool DatabaseBatch::Execute()
+{
+    TRACE_SCOPE("db.batch");
+
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->Execute();
+    }
+
+    return result;
+}
+
+size_t DatabaseBatch::Count() const
+{
+    size_t count = 0;
+
+    if(nullptr != mImpl)
+    {
+        count = mImpl->Count();
+    }
+
+    return count;
+}
+
+bool DatabaseBatch::IsValid() const
+{
+    return nullptr != mImpl;
+}
+
+DatabaseBatch& DatabaseBatch::operator=(DatabaseBatch&& other)
+{
+    delete mImpl;
+
+    mImpl = other.mImpl;
+    mFlushSize = other.mFlushSize;
+    other.mImpl = nullptr;
+
+    return *this;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file libcomp/src/DatabaseBatch.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Group of database writes sent together.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_DATABASEBATCH_H
+#define LIBCOMP_SRC_DATABASEBATCH_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "DatabaseQuery.h"
+
+namespace libcomp
+{
+
+class DatabaseBatchImpl
+{
+public:
+    virtual ~DatabaseBatchImpl();
+
+    /**
+     * Add the values currently bound to a query to the batch. The query is
+     * ready to be bound again afterwards.
+     * @param pQuery Query to add.
+     * @returns true if the query was added.
+     */
+    virtual bool Add(DatabaseQueryImpl *pQuery) = 0;
+
+    /**
+     * Send every statement added since the last call.
+     * @returns true if the statements were written.
+     */
+    virtual bool Execute() = 0;
+
+    /**
+     * Get the number of statements waiting to be sent.
+     * @returns Number of statements in the batch.
+     */
+    virtual size_t Count() const = 0;
+};
+
+/**
+ * Group of bound statements written to the database together: one (unlogged
+ * unless asked otherwise) batch for Cassandra or one transaction for SQLite.
+ * Once the batch holds @em flushSize statements it is sent automatically.
+ * If any statement fails to be added the whole batch is dropped when it is
+ * executed. Statements that have not been sent when the batch is destroyed
+ * are discarded.
+ */
+class DatabaseBatch
+{
+public:
+    DatabaseBatch(DatabaseBatchImpl *pImpl,
+        size_t flushSize = DATABASE_BATCH_SIZE);
+    DatabaseBatch(const DatabaseBatch& other) = delete;
+    DatabaseBatch(DatabaseBatch&& other);
+    ~DatabaseBatch();
+
+    /**
+     * Add the values currently bound to a query to the batch. This sends
+     * the batch if it is full.
+     * @param query Query to add. It is ready to be bound again afterwards.
+     * @returns true if the query was added (and the batch sent if it was
+     * full).
+     */
+    bool Add(DatabaseQuery& query);
+
+    /**
+     * Send every statement in the batch.
+     * @returns true if the statements were written.
+     */
+    bool Execute();
+
+    /**
+     * Get the number of statements waiting to be sent.
+     * @returns Number of statements in the batch.
+     */
+    size_t Count() const;
+
+    bool IsValid() const;
+
+    DatabaseBatch& operator=(DatabaseBatch&& other);
+
+protected:
+    DatabaseBatchImpl *mImpl;
+    size_t mFlushSize;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_DATABASEBATCH_H
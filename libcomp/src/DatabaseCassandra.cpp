@@ -29,13 +29,15 @@
  // libcomp Includes
 #include "DatabaseQueryCassandra.h"
 #include "Log.h"
+#include "ThreadAffinity.h"
 
 // SQLite3 Includes
 #include <sqlite3.h>
 
 using namespace libcomp;
 
-DatabaseCassandra::DatabaseCassandra() : mCluster(nullptr), mSession(nullptr)
+DatabaseCassandra::DatabaseCassandra() : mCluster(nullptr), mSession(nullptr),
+    mIoThreads(0), mCoreConnectionsPerHost(0)
 {
 }
 
@@ -58,12 +60,38 @@ bool DatabaseCassandra::Open(const String& address, const String& username,
 
         cass_cluster_set_contact_points(mCluster, address.C());
 
+        if(0 != mIoThreads)
+        {
+            cass_cluster_set_num_threads_io(mCluster, mIoThreads);
+        }
+
+        if(0 != mCoreConnectionsPerHost)
+        {
+            cass_cluster_set_core_connections_per_host(mCluster,
+                mCoreConnectionsPerHost);
+        }
+
         if(!username.IsEmpty())
         {
             cass_cluster_set_credentials(mCluster, username.C(), password.C());
         }
 
+        // The driver starts its threads (which run the query callbacks)
+        // while connecting and they inherit the affinity of this thread.
+        ThreadAffinity::CpuList_t databaseCpus = ThreadAffinity::GetCpus(
+            ThreadAffinity::ROLE_DATABASE);
+        ThreadAffinity::CpuList_t previousCpus;
+
+        bool restore = !databaseCpus.empty() &&
+            ThreadAffinity::GetCurrentThread(previousCpus) &&
+            ThreadAffinity::SetCurrentThread(databaseCpus);
+
         result = WaitForFuture(cass_session_connect(mSession, mCluster));
+
+        if(restore)
+        {
+            ThreadAffinity::SetCurrentThread(previousCpus);
+        }
     }
 
     return result;
@@ -73,6 +101,9 @@ bool DatabaseCassandra::Close()
 {
     bool result = true;
 
+    // Statements are prepared on the session so drop them with it.
+    mStatementCache.Clear();
+
     if(nullptr != mSession)
     {
         result = WaitForFuture(cass_session_close(mSession));
@@ -89,7 +120,7 @@ bool DatabaseCassandra::Close()
 
     if(result)
     {
-        mError.Clear();
+        SetLastError(String());
     }
 
     return result;
@@ -105,6 +136,64 @@ DatabaseQuery DatabaseCassandra::Prepare(const String& query)
     return DatabaseQuery(new DatabaseQueryCassandra(this), query);
 }
 
+void DatabaseCassandra::SetClusterOptions(uint32_t ioThreads,
+    uint32_t coreConnectionsPerHost)
+{
+    mIoThreads = ioThreads;
+    mCoreConnectionsPerHost = coreConnectionsPerHost;
+}
+
+DatabaseBatch DatabaseCassandra::CreateBatch(bool logged, size_t flushSize)
+{
+    return DatabaseBatch(new DatabaseBatchCassandra(this, logged), flushSize);
+}
+
+StatementCacheStats_t DatabaseCassandra::GetStatementCacheStats() const
+{
+    return mStatementCache.GetStats();
+}
+
+std::shared_ptr<const CassPrepared> DatabaseCassandra::GetPrepared(
+    const String& query)
+{
+    std::string key = query.ToUtf8();
+
+    std::shared_ptr<const CassPrepared> prepared = mStatementCache.Find(key);
+
+    if(!prepared && nullptr != mSession)
+    {
+        CassFuture *pFuture = cass_session_prepare(mSession, query.C());
+
+        cass_future_wait(pFuture);
+
+        if(CASS_OK != cass_future_error_code(pFuture))
+        {
+            // This saves the error and frees the future.
+            (void)WaitForFuture(pFuture);
+        }
+        else
+        {
+            const CassPrepared *pPrepared = cass_future_get_prepared(pFuture);
+
+            cass_future_free(pFuture);
+            pFuture = nullptr;
+
+            if(nullptr != pPrepared)
+            {
+                prepared = std::shared_ptr<const CassPrepared>(pPrepared,
+                    [](const CassPrepared *pFreed)
+                    {
+                        cass_prepared_free(pFreed);
+                    });
+
+                mStatementCache.Insert(key, prepared);
+            }
+        }
+    }
+
+    return prepared;
+}
+
 bool DatabaseCassandra::WaitForFuture(CassFuture *pFuture)
 {
     bool result = true;
@@ -123,7 +212,7 @@ bool DatabaseCassandra::WaitForFuture(CassFuture *pFuture)
         cass_future_error_message(pFuture, &szMessage, &messageLength);
   
         // Save.
-        mError = String(szMessage, messageLength);
+        SetLastError(String(szMessage, messageLength));
 
         result = false;
     }
@@ -33,12 +33,16 @@
 // Cassandra Includes
 #include <cassandra.h>
 
+// Standard C++11 Includes
+#include <memory>
+
 namespace libcomp
 {
 
 class DatabaseCassandra : public Database
 {
 public:
+    friend class DatabaseBatchCassandra;
     friend class DatabaseQueryCassandra;
 
     DatabaseCassandra();
@@ -50,15 +54,42 @@ public:
     virtual bool IsOpen() const;
 
     virtual DatabaseQuery Prepare(const String& query);
+    virtual DatabaseBatch CreateBatch(bool logged = false,
+        size_t flushSize = DATABASE_BATCH_SIZE);
+
+    virtual StatementCacheStats_t GetStatementCacheStats() const;
+
+    /**
+     * Set how the driver connects to the cluster. This must be called before
+     * @ref Open to have any effect. A value of 0 keeps the driver default.
+     * @param ioThreads Number of driver threads handling requests.
+     * @param coreConnectionsPerHost Number of connections made to each host
+     * per I/O thread.
+     */
+    void SetClusterOptions(uint32_t ioThreads,
+        uint32_t coreConnectionsPerHost);
 
 protected:
     bool WaitForFuture(CassFuture *pFuture);
 
     CassSession* GetSession() const;
 
+    /**
+     * Get the prepared statement for a query from the cache or prepare it
+     * (and add it to the cache) if it is not there.
+     * @param query Query to prepare.
+     * @returns Prepared statement or nullptr if the query failed to prepare.
+     */
+    std::shared_ptr<const CassPrepared> GetPrepared(const String& query);
+
 private:
     CassCluster *mCluster;
     CassSession *mSession;
+
+    uint32_t mIoThreads;
+    uint32_t mCoreConnectionsPerHost;
+
+    StatementCache<const CassPrepared> mStatementCache;
 };
 
 } // namespace libcomp
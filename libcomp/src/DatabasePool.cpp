@@ -0,0 +1,149 @@
+/**
+ * @file libcomp/src/DatabasePool.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Pool of database connections shared by worker threads.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DatabasePool.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <unordered_map>
+
+using namespace libcomp;
+
+/// Source of the unique ID of each pool.
+static std::atomic<uint64_t> gNextPoolID(0);
+
+DatabasePool::DatabasePool(const Factory_t& factory, size_t maxConnections) :
+    mState(std::make_shared<State>()), mID(++gNextPoolID)
+{
+    mState->factory = factory;
+    mState->maxConnections = 0 < maxConnections ? maxConnections : 1;
+    mState->openCount = 0;
+}
+
+std::shared_ptr<Database> DatabasePool::Acquire()
+{
+    std::shared_ptr<Database> db;
+    bool openNew = false;
+
+    {
+        std::unique_lock<std::mutex> uniqueLock(mState->lock);
+
+        mState->returned.wait(uniqueLock, [this]()
+        {
+            return !mState->idle.empty() ||
+                mState->openCount < mState->maxConnections;
+        });
+
+        if(!mState->idle.empty())
+        {
+            db = mState->idle.front();
+            mState->idle.pop_front();
+        }
+        else
+        {
+            // Reserve the slot so the connection is opened outside the lock.
+            mState->openCount++;
+            openNew = true;
+        }
+    }
+
+    if(openNew)
+    {
+        db = mState->factory();
+
+        if(!db || !db->IsOpen())
+        {
+            db.reset();
+
+            std::lock_guard<std::mutex> guard(mState->lock);
+            mState->openCount--;
+            mState->returned.notify_one();
+        }
+    }
+
+    std::shared_ptr<Database> handle;
+
+    // Hand out a handle that puts the connection back when it is released.
+    if(db)
+    {
+        std::shared_ptr<State> state = mState;
+
+        handle = std::shared_ptr<Database>(db.get(), [state, db](Database*)
+        {
+            Release(state, db);
+        });
+    }
+
+    return handle;
+}
+
+std::shared_ptr<Database> DatabasePool::GetThreadDatabase()
+{
+    // Released (back to the pool) when the thread exits.
+    static thread_local std::unordered_map<uint64_t,
+        std::shared_ptr<Database>> threadDatabases;
+
+    std::shared_ptr<Database>& db = threadDatabases[mID];
+
+    if(!db)
+    {
+        db = Acquire();
+    }
+
+    return db;
+}
+
+size_t DatabasePool::GetOpenCount() const
+{
+    std::lock_guard<std::mutex> guard(mState->lock);
+
+    return mState->openCount;
+}
+
+size_t DatabasePool::GetIdleCount() const
+{
+    std::lock_guard<std::mutex> guard(mState->lock);
+
+    return mState->idle.size();
+}
+
+void DatabasePool::Release(const std::shared_ptr<State>& state,
+    const std::shared_ptr<Database>& db)
+{
+    std::lock_guard<std::mutex> guard(state->lock);
+
+    if(db->IsOpen())
+    {
+        state->idle.push_back(db);
+    }
+    else
+    {
+        // The connection was closed so let a new one be opened instead.
+        state->openCount--;
+    }
+
+    state->returned.notify_one();
+}
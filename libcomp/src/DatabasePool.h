@@ -0,0 +1,126 @@
+/**
+ * @file libcomp/src/DatabasePool.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Pool of database connections shared by worker threads.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_DATABASEPOOL_H
+#define LIBCOMP_SRC_DATABASEPOOL_H
+
+// libcomp Includes
+#include "Database.h"
+
+// Standard C++11 Includes
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace libcomp
+{
+
+/**
+ * Pool of open database connections. A connection is only used by one
+ * thread at a time: workers either check a connection out with @ref Acquire
+ * (and give it back by dropping the returned pointer) or keep one for the
+ * life of the thread with @ref GetThreadDatabase. New connections are opened
+ * on demand by a factory until the pool limit is reached; after that
+ * @ref Acquire waits for a connection to be returned.
+ */
+class DatabasePool
+{
+public:
+    /**
+     * Function that creates and opens a new connection. It should return
+     * nullptr if the connection could not be opened.
+     */
+    typedef std::function<std::shared_ptr<Database>()> Factory_t;
+
+    /**
+     * Create a new pool.
+     * @param factory Function used to open new connections.
+     * @param maxConnections Maximum number of connections to open.
+     */
+    DatabasePool(const Factory_t& factory, size_t maxConnections);
+
+    /**
+     * Check a connection out of the pool. This will block if every
+     * connection is in use.
+     * @returns Connection that goes back to the pool once the last
+     * reference to it is dropped or nullptr if a new connection could not be
+     * opened.
+     */
+    std::shared_ptr<Database> Acquire();
+
+    /**
+     * Get the connection reserved for the calling thread, checking one out
+     * the first time this is called on the thread. The connection stays
+     * checked out until the thread exits.
+     * @returns Connection for this thread or nullptr if one could not be
+     * opened.
+     */
+    std::shared_ptr<Database> GetThreadDatabase();
+
+    /**
+     * Get the number of connections that have been opened.
+     * @returns Number of open connections.
+     */
+    size_t GetOpenCount() const;
+
+    /**
+     * Get the number of open connections not checked out.
+     * @returns Number of idle connections.
+     */
+    size_t GetIdleCount() const;
+
+private:
+    /**
+     * @internal
+     * State shared by the pool and every connection it has handed out.
+     */
+    class State
+    {
+    public:
+        Factory_t factory;
+        size_t maxConnections;
+        size_t openCount;
+
+        std::list<std::shared_ptr<Database>> idle;
+
+        std::mutex lock;
+        std::condition_variable returned;
+    };
+
+    static void Release(const std::shared_ptr<State>& state,
+        const std::shared_ptr<Database>& db);
+
+    std::shared_ptr<State> mState;
+
+    /// Unique ID used to find this pool's connection for each thread.
+    uint64_t mID;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_DATABASEPOOL_H
@@ -26,12 +26,26 @@
 
 #include "DatabaseQuery.h"
 
+// libcomp Includes
+#include "Metrics.h"
+#include "Tracer.h"
+
+// Standard C++11 Includes
+#include <chrono>
+
 using namespace libcomp;
 
 DatabaseQueryImpl::~DatabaseQueryImpl()
 {
 }
 
+bool DatabaseQueryImpl::ExecuteAsync(const DatabaseCallback_t& callback)
+{
+    callback(Execute());
+
+    return true;
+}
+
 bool DatabaseQueryImpl::Bind(size_t index, const std::unordered_map<
     std::string, std::vector<char>>& values)
 {
@@ -68,6 +82,91 @@ bool DatabaseQueryImpl::GetMap(const String& name, std::unordered_map<
     return false;
 }
 
+bool DatabaseQueryImpl::GetInt(size_t index, int32_t& value)
+{
+    (void)index;
+    (void)value;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::GetInt(const String& name, int32_t& value)
+{
+    (void)name;
+    (void)value;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::GetBigInt(size_t index, int64_t& value)
+{
+    (void)index;
+    (void)value;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::GetBigInt(const String& name, int64_t& value)
+{
+    (void)name;
+    (void)value;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::GetBlob(size_t index, const char*& pData, size_t& size)
+{
+    (void)index;
+    (void)pData;
+    (void)size;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::GetBlob(const String& name, const char*& pData,
+    size_t& size)
+{
+    (void)name;
+    (void)pData;
+    (void)size;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::GetText(size_t index, const char*& szText,
+    size_t& size)
+{
+    (void)index;
+    (void)szText;
+    (void)size;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::GetText(const String& name, const char*& szText,
+    size_t& size)
+{
+    (void)name;
+    (void)szText;
+    (void)size;
+
+    return false;
+}
+
+bool DatabaseQueryImpl::ForEachRow(const std::function<bool()>& visitor,
+    size_t pageSize)
+{
+    (void)pageSize;
+
+    bool result = Execute();
+
+    while(result && Next() && visitor())
+    {
+    }
+
+    return result;
+}
+
 DatabaseQuery::DatabaseQuery(DatabaseQueryImpl *pImpl, const String& query) :
     mImpl(pImpl)
 {
@@ -87,6 +186,8 @@ DatabaseQuery::~DatabaseQuery()
 
 bool DatabaseQuery::Prepare(const String& query)
 {
+    TRACE_SCOPE("db.prepare");
+
     bool result = false;
 
     if(nullptr != mImpl)
@@ -99,16 +200,62 @@ bool DatabaseQuery::Prepare(const String& query)
 
 bool DatabaseQuery::Execute()
 {
+    TRACE_SCOPE("db");
+
     bool result = false;
 
     if(nullptr != mImpl)
     {
+        static MetricHistogram& duration = Metrics::GetSingletonPtr()->
+            Histogram("comp_database_query_seconds",
+            "Time spent executing database queries.");
+        static MetricCounter& failures = Metrics::GetSingletonPtr()->Counter(
+            "comp_database_query_failures_total",
+            "Database queries that failed to execute.");
+
+        auto start = std::chrono::steady_clock::now();
+
         result = mImpl->Execute();
+
+        duration.ObserveSince(start);
+
+        if(!result)
+        {
+            failures.Increment();
+        }
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::ExecuteAsync(const DatabaseCallback_t& callback)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->ExecuteAsync(callback);
     }
 
     return result;
 }
 
+std::future<bool> DatabaseQuery::ExecuteAsync()
+{
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+
+    if(!ExecuteAsync([promise](bool result)
+    {
+        promise->set_value(result);
+    }))
+    {
+        promise->set_value(false);
+    }
+
+    return future;
+}
+
 bool DatabaseQuery::Next()
 {
     bool result = false;
@@ -209,6 +356,117 @@ bool DatabaseQuery::GetMap(const String& name, std::unordered_map<
     return result;
 }
 
+bool DatabaseQuery::GetInt(size_t index, int32_t& value)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetInt(index, value);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::GetInt(const String& name, int32_t& value)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetInt(name, value);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::GetBigInt(size_t index, int64_t& value)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetBigInt(index, value);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::GetBigInt(const String& name, int64_t& value)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetBigInt(name, value);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::GetBlob(size_t index, const char*& pData, size_t& size)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetBlob(index, pData, size);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::GetBlob(const String& name, const char*& pData,
+    size_t& size)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetBlob(name, pData, size);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::GetText(size_t index, const char*& szText, size_t& size)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetText(index, szText, size);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::GetText(const String& name, const char*& szText,
+    size_t& size)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->GetText(name, szText, size);
+    }
+
+    return result;
+}
+
+bool DatabaseQuery::ForEachRow(const std::function<bool()>& visitor,
+    size_t pageSize)
+{
+    bool result = false;
+
+    if(nullptr != mImpl)
+    {
+        result = mImpl->ForEachRow(visitor, pageSize);
+    }
+
+    return result;
+}
+
 bool DatabaseQuery::BatchNext()
 {
     bool result = false;
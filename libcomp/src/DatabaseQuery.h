@@ -28,14 +28,23 @@
 #define LIBCOMP_SRC_DATABASEQUERY_H
 
 // libcomp Includes
+#include "Constants.h"
 #include "String.h"
 
 // Standard C++11 Includes
+#include <functional>
+#include <future>
 #include <unordered_map>
 
 namespace libcomp
 {
 
+/**
+ * Function called when an asynchronous query has finished. The argument is
+ * the result that @ref DatabaseQuery::Execute would have returned.
+ */
+typedef std::function<void(bool)> DatabaseCallback_t;
+
 class DatabaseQueryImpl
 {
 public:
@@ -43,6 +52,16 @@ public:
 
     virtual bool Prepare(const String& query) = 0;
     virtual bool Execute() = 0;
+
+    /**
+     * Start executing the query without waiting for the result. The default
+     * implementation executes the query in place and calls the callback
+     * before returning.
+     * @param callback Function to call with the result.
+     * @returns true if the callback will be called.
+     */
+    virtual bool ExecuteAsync(const DatabaseCallback_t& callback);
+
     virtual bool Next() = 0;
 
     virtual bool Bind(size_t index, const String& value) = 0;
@@ -57,14 +76,39 @@ public:
     virtual bool GetMap(const String& name, std::unordered_map<
         std::string, std::vector<char>>& values);
 
+    virtual bool GetInt(size_t index, int32_t& value);
+    virtual bool GetInt(const String& name, int32_t& value);
+    virtual bool GetBigInt(size_t index, int64_t& value);
+    virtual bool GetBigInt(const String& name, int64_t& value);
+    virtual bool GetBlob(size_t index, const char*& pData, size_t& size);
+    virtual bool GetBlob(const String& name, const char*& pData, size_t& size);
+    virtual bool GetText(size_t index, const char*& szText, size_t& size);
+    virtual bool GetText(const String& name, const char*& szText,
+        size_t& size);
+
+    /**
+     * Execute the query and call @em visitor for each row of the result.
+     * The default implementation executes the query and walks the rows with
+     * @ref Next.
+     * @param visitor Function called on each row. Return false to stop.
+     * @param pageSize Number of rows to fetch from the server at a time.
+     * @returns true if the query succeeded.
+     */
+    virtual bool ForEachRow(const std::function<bool()>& visitor,
+        size_t pageSize);
+
     virtual bool BatchNext() = 0;
 
     virtual bool IsValid() const = 0;
 };
 
+class DatabaseBatch;
+
 class DatabaseQuery
 {
 public:
+    friend class DatabaseBatch;
+
     DatabaseQuery(DatabaseQueryImpl *pImpl, const String& query);
     DatabaseQuery(const DatabaseQuery& other) = delete;
     DatabaseQuery(DatabaseQuery&& other);
@@ -72,6 +116,42 @@ public:
 
     bool Prepare(const String& query);
     bool Execute();
+
+    /**
+     * Start executing the query without waiting for the result. The callback
+     * is called on a database driver thread once the query has finished. The
+     * query must stay alive (and must not be used) until then; the callback
+     * may call @ref Next and friends to read the result.
+     * @param callback Function to call with the result.
+     * @returns true if the query was started and the callback will be
+     * called; false if the query could not be started.
+     */
+    bool ExecuteAsync(const DatabaseCallback_t& callback);
+
+    /**
+     * Start executing the query and post the callback to @em service (for
+     * example an asio::io_service) once it has finished so the result is
+     * handled on the caller's own threads.
+     * @param service Object with a post() function to run the callback on.
+     * @param callback Function to call with the result.
+     * @returns true if the query was started and the callback will be
+     * posted; false if the query could not be started.
+     */
+    template<class Service>
+    bool ExecuteAsync(Service& service, const DatabaseCallback_t& callback)
+    {
+        return ExecuteAsync([&service, callback](bool result)
+        {
+            service.post(std::bind(callback, result));
+        });
+    }
+
+    /**
+     * Start executing the query without waiting for the result.
+     * @returns Future that holds the result once the query has finished.
+     */
+    std::future<bool> ExecuteAsync();
+
     bool Next();
 
     bool Bind(size_t index, const String& value);
@@ -86,6 +166,34 @@ public:
     bool GetMap(const String& name, std::unordered_map<
         std::string, std::vector<char>>& values);
 
+    /**
+     * Read a column of the current row (after @ref Next returned true)
+     * straight from the driver without copying it. Pointers returned by
+     * @ref GetBlob and @ref GetText stay valid until the next call to
+     * @ref Next or @ref Execute. Columns are numbered from 0.
+     * @returns true if the column exists, is not null and holds the
+     * requested type.
+     */
+    bool GetInt(size_t index, int32_t& value);
+    bool GetInt(const String& name, int32_t& value);
+    bool GetBigInt(size_t index, int64_t& value);
+    bool GetBigInt(const String& name, int64_t& value);
+    bool GetBlob(size_t index, const char*& pData, size_t& size);
+    bool GetBlob(const String& name, const char*& pData, size_t& size);
+    bool GetText(size_t index, const char*& szText, size_t& size);
+    bool GetText(const String& name, const char*& szText, size_t& size);
+
+    /**
+     * Execute the query and call @em visitor for each row of the result
+     * (the visitor reads columns with the getters above). Large results are
+     * fetched from the server one page at a time instead of all at once.
+     * @param visitor Function called on each row. Return false to stop.
+     * @param pageSize Number of rows to fetch from the server at a time.
+     * @returns true if the query succeeded.
+     */
+    bool ForEachRow(const std::function<bool()>& visitor,
+        size_t pageSize = DATABASE_PAGE_SIZE);
+
     bool BatchNext();
 
     bool IsValid() const;
@@ -29,14 +29,78 @@
 
 using namespace libcomp;
 
+static bool ReadInt(const CassValue *pValue, int32_t& value)
+{
+    cass_int32_t data;
+
+    bool result = nullptr != pValue && CASS_OK == cass_value_get_int32(
+        pValue, &data);
+
+    if(result)
+    {
+        value = (int32_t)data;
+    }
+
+    return result;
+}
+
+static bool ReadBigInt(const CassValue *pValue, int64_t& value)
+{
+    cass_int64_t data;
+
+    bool result = nullptr != pValue && CASS_OK == cass_value_get_int64(
+        pValue, &data);
+
+    if(result)
+    {
+        value = (int64_t)data;
+    }
+
+    return result;
+}
+
+static bool ReadBlob(const CassValue *pValue, const char*& pData,
+    size_t& size)
+{
+    const cass_byte_t *pBytes;
+
+    bool result = nullptr != pValue && CASS_OK == cass_value_get_bytes(
+        pValue, &pBytes, &size);
+
+    if(result)
+    {
+        pData = reinterpret_cast<const char*>(pBytes);
+    }
+
+    return result;
+}
+
+static bool ReadText(const CassValue *pValue, const char*& szText,
+    size_t& size)
+{
+    return nullptr != pValue && CASS_OK == cass_value_get_string(
+        pValue, &szText, &size);
+}
+
 DatabaseQueryCassandra::DatabaseQueryCassandra(DatabaseCassandra *pDatabase) :
-    mDatabase(pDatabase), mPrepared(nullptr), mStatement(nullptr),
-    mFuture(nullptr), mResult(nullptr), mRowIterator(nullptr), mBatch(nullptr)
+    mDatabase(pDatabase), mStatement(nullptr),
+    mFuture(nullptr), mResult(nullptr), mRowIterator(nullptr), mBatch(nullptr),
+    mAsyncPending(false)
 {
 }
 
 DatabaseQueryCassandra::~DatabaseQueryCassandra()
 {
+    // Wait for any asynchronous query to finish with this object.
+    {
+        std::unique_lock<std::mutex> uniqueLock(mAsyncLock);
+
+        mAsyncFinished.wait(uniqueLock, [this]()
+        {
+            return !mAsyncPending;
+        });
+    }
+
     if(nullptr != mBatch)
     {
         cass_batch_free(mBatch);
@@ -67,16 +131,11 @@ DatabaseQueryCassandra::~DatabaseQueryCassandra()
         mStatement = nullptr;
     }
 
-    if(nullptr != mPrepared)
-    {
-        cass_prepared_free(mPrepared);
-        mPrepared = nullptr;
-    }
 }
 
 bool DatabaseQueryCassandra::Prepare(const String& query)
 {
-    bool result = true;
+    bool result = false;
 
     // Remove any existing (prepared) statement.
     if(nullptr != mStatement)
@@ -85,47 +144,111 @@ bool DatabaseQueryCassandra::Prepare(const String& query)
         mStatement = nullptr;
     }
 
-    if(nullptr != mPrepared)
+    mPrepared.reset();
+
+    // Reuse the statement if this query has been prepared before.
+    if(nullptr != mDatabase)
     {
-        cass_prepared_free(mPrepared);
-        mPrepared = nullptr;
+        mPrepared = mDatabase->GetPrepared(query);
     }
 
-    CassFuture *pFuture = cass_session_prepare(mDatabase->GetSession(),
-        query.C());
+    if(mPrepared)
+    {
+        mStatement = cass_prepared_bind(mPrepared.get());
 
-    cass_future_wait(pFuture);
+        if(nullptr == mStatement)
+        {
+            mPrepared.reset();
+        }
+        else
+        {
+            result = true;
+        }
+    }
 
-    if(CASS_OK != cass_future_error_code(pFuture))
+    return result;
+}
+
+bool DatabaseQueryCassandra::Execute()
+{
+    CassFuture *pFuture = StartExecute();
+
+    if(nullptr != pFuture)
     {
-        result = mDatabase->WaitForFuture(pFuture);
+        cass_future_wait(pFuture);
     }
-    else
+
+    return FinishExecute(pFuture);
+}
+
+bool DatabaseQueryCassandra::ExecuteAsync(const DatabaseCallback_t& callback)
+{
+    bool result = false;
+    bool pending;
+
     {
-        mPrepared = cass_future_get_prepared(pFuture);
+        std::lock_guard<std::mutex> guard(mAsyncLock);
 
-        cass_future_free(pFuture);
-        pFuture = nullptr;
+        pending = mAsyncPending;
+    }
 
-        mStatement = cass_prepared_bind(mPrepared);
+    // Only one query per object may be in flight.
+    CassFuture *pFuture = pending ? nullptr : StartExecute();
 
-        if(nullptr == mStatement)
+    if(nullptr != pFuture)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mAsyncLock);
+
+            mCallback = callback;
+            mAsyncPending = true;
+        }
+
+        // If the future has already finished the driver calls the callback
+        // right away on this thread.
+        if(CASS_OK != cass_future_set_callback(pFuture,
+            &DatabaseQueryCassandra::FutureCallback, this))
         {
-            cass_prepared_free(mPrepared);
-            mPrepared = nullptr;
+            cass_future_wait(pFuture);
 
-            result = false;
+            FutureCallback(pFuture, this);
         }
+
+        result = true;
     }
 
     return result;
 }
 
-bool DatabaseQueryCassandra::Execute()
+void DatabaseQueryCassandra::FutureCallback(CassFuture *pFuture, void *pData)
 {
-    bool result = false;
-    bool isBatch = false;
+    DatabaseQueryCassandra *pQuery = reinterpret_cast<
+        DatabaseQueryCassandra*>(pData);
+
+    bool result = pQuery->FinishExecute(pFuture);
 
+    DatabaseCallback_t callback;
+
+    {
+        std::lock_guard<std::mutex> guard(pQuery->mAsyncLock);
+
+        callback = std::move(pQuery->mCallback);
+        pQuery->mCallback = nullptr;
+        pQuery->mAsyncPending = false;
+
+        pQuery->mAsyncFinished.notify_all();
+    }
+
+    // The query may be deleted by the callback (or by another thread once it
+    // is no longer pending) so it must not be touched from here on.
+    if(callback)
+    {
+        callback(result);
+    }
+}
+
+void DatabaseQueryCassandra::FreeResult()
+{
     if(nullptr != mFuture)
     {
         cass_iterator_free(mRowIterator);
@@ -137,6 +260,13 @@ bool DatabaseQueryCassandra::Execute()
         cass_future_free(mFuture);
         mFuture = nullptr;
     }
+}
+
+CassFuture* DatabaseQueryCassandra::StartExecute()
+{
+    CassFuture *pFuture = nullptr;
+
+    FreeResult();
 
     if(nullptr != mStatement && nullptr != mDatabase)
     {
@@ -144,12 +274,8 @@ bool DatabaseQueryCassandra::Execute()
 
         if(nullptr != pSession)
         {
-            CassFuture *pFuture;
-
             if(nullptr != mBatch)
             {
-                isBatch = true;
-
                 if(CASS_OK == cass_batch_add_statement(mBatch, mStatement))
                 {
                     cass_statement_free(mStatement);
@@ -157,70 +283,65 @@ bool DatabaseQueryCassandra::Execute()
 
                     pFuture = cass_session_execute_batch(pSession, mBatch);
                 }
-                else
-                {
-                    pFuture = nullptr;
-                }
             }
             else
             {
                 pFuture = cass_session_execute(pSession, mStatement);
             }
+        }
+    }
 
-            if(nullptr != pFuture)
-            {
-                cass_future_wait(pFuture);
-            }
-
-            if(nullptr == pFuture || CASS_OK != cass_future_error_code(
-                pFuture))
-            {
-                if(nullptr != pFuture)
-                {
-                    result = mDatabase->WaitForFuture(pFuture);
-                }
-                else
-                {
-                    result = false;
-                }
-            }
-            else
-            {
-                // Free the batch.
-                if(nullptr != mBatch)
-                {
-                    cass_batch_free(mBatch);
-                    mBatch = nullptr;
-                }
+    return pFuture;
+}
 
-                // Free the statement.
-                if(nullptr != mStatement)
-                {
-                    cass_statement_free(mStatement);
-                    mStatement = nullptr;
-                }
+bool DatabaseQueryCassandra::FinishExecute(CassFuture *pFuture)
+{
+    bool result = false;
 
-                // Prepare another statement.
-                if(nullptr != mPrepared)
-                {
-                    mStatement = cass_prepared_bind(mPrepared);
-                }
+    if(nullptr == pFuture)
+    {
+        // Nothing was sent.
+    }
+    else if(CASS_OK != cass_future_error_code(pFuture))
+    {
+        // This saves the error and frees the future.
+        result = mDatabase->WaitForFuture(pFuture);
+    }
+    else
+    {
+        // Free the batch.
+        if(nullptr != mBatch)
+        {
+            cass_batch_free(mBatch);
+            mBatch = nullptr;
+        }
 
-                // Save the result.
-                mResult = cass_future_get_result(pFuture);
+        // Free the statement.
+        if(nullptr != mStatement)
+        {
+            cass_statement_free(mStatement);
+            mStatement = nullptr;
+        }
 
-                // Save a row iterator.
-                if(nullptr != mResult)
-                {
-                    mRowIterator = cass_iterator_from_result(mResult);
-                }
+        // Prepare another statement.
+        if(mPrepared)
+        {
+            mStatement = cass_prepared_bind(mPrepared.get());
+        }
 
-                // Save the future.
-                mFuture = pFuture;
+        // Save the result.
+        mResult = cass_future_get_result(pFuture);
 
-                result = true;
-            }
+        // Save a row iterator.
+        if(nullptr != mResult)
+        {
+            mRowIterator = cass_iterator_from_result(mResult);
         }
+
+        // Save the future.
+        mFuture = pFuture;
+
+        result = true;
     }
 
     return result;
@@ -516,6 +637,122 @@ bool DatabaseQueryCassandra::GetMap(const String& name,
     return result;
 }
 
+bool DatabaseQueryCassandra::GetInt(size_t index, int32_t& value)
+{
+    return ReadInt(GetColumn(index), value);
+}
+
+bool DatabaseQueryCassandra::GetInt(const String& name, int32_t& value)
+{
+    return ReadInt(GetColumn(name), value);
+}
+
+bool DatabaseQueryCassandra::GetBigInt(size_t index, int64_t& value)
+{
+    return ReadBigInt(GetColumn(index), value);
+}
+
+bool DatabaseQueryCassandra::GetBigInt(const String& name, int64_t& value)
+{
+    return ReadBigInt(GetColumn(name), value);
+}
+
+bool DatabaseQueryCassandra::GetBlob(size_t index, const char*& pData,
+    size_t& size)
+{
+    return ReadBlob(GetColumn(index), pData, size);
+}
+
+bool DatabaseQueryCassandra::GetBlob(const String& name, const char*& pData,
+    size_t& size)
+{
+    return ReadBlob(GetColumn(name), pData, size);
+}
+
+bool DatabaseQueryCassandra::GetText(size_t index, const char*& szText,
+    size_t& size)
+{
+    return ReadText(GetColumn(index), szText, size);
+}
+
+bool DatabaseQueryCassandra::GetText(const String& name, const char*& szText,
+    size_t& size)
+{
+    return ReadText(GetColumn(name), szText, size);
+}
+
+bool DatabaseQueryCassandra::ForEachRow(const std::function<bool()>& visitor,
+    size_t pageSize)
+{
+    bool result = false;
+
+    CassSession *pSession = nullptr != mDatabase ?
+        mDatabase->GetSession() : nullptr;
+
+    if(nullptr != mBatch)
+    {
+        // A batch has no rows to page through.
+        result = DatabaseQueryImpl::ForEachRow(visitor, pageSize);
+    }
+    else if(nullptr != mStatement && nullptr != pSession)
+    {
+        FreeResult();
+
+        (void)cass_statement_set_paging_size(mStatement, (int)pageSize);
+
+        bool morePages = true;
+        result = true;
+
+        while(result && morePages)
+        {
+            CassFuture *pFuture = cass_session_execute(pSession, mStatement);
+
+            cass_future_wait(pFuture);
+
+            if(CASS_OK != cass_future_error_code(pFuture))
+            {
+                // This saves the error and frees the future.
+                result = mDatabase->WaitForFuture(pFuture);
+            }
+            else
+            {
+                mFuture = pFuture;
+                mResult = cass_future_get_result(pFuture);
+
+                if(nullptr != mResult)
+                {
+                    mRowIterator = cass_iterator_from_result(mResult);
+                }
+
+                bool keepGoing = true;
+
+                while(keepGoing && Next())
+                {
+                    keepGoing = visitor();
+                }
+
+                morePages = keepGoing && nullptr != mResult &&
+                    cass_result_has_more_pages(mResult);
+
+                // Ask for the page after this one.
+                if(morePages)
+                {
+                    (void)cass_statement_set_paging_state(mStatement,
+                        mResult);
+
+                    FreeResult();
+                }
+            }
+        }
+
+        // Bind a new statement like Execute does.
+        cass_statement_free(mStatement);
+        mStatement = mPrepared ? cass_prepared_bind(mPrepared.get()) : nullptr;
+    }
+
+    return result;
+}
+
 bool DatabaseQueryCassandra::BatchNext()
 {
     bool result = false;
@@ -534,9 +771,9 @@ bool DatabaseQueryCassandra::BatchNext()
                 cass_statement_free(mStatement);
                 mStatement = nullptr;
 
-                if(nullptr != mPrepared)
+                if(mPrepared)
                 {
-                    mStatement = cass_prepared_bind(mPrepared);
+                    mStatement = cass_prepared_bind(mPrepared.get());
                 }
 
                 result = true;
@@ -549,6 +786,133 @@ bool DatabaseQueryCassandra::BatchNext()
 
 bool DatabaseQueryCassandra::IsValid() const
 {
-    return nullptr != mDatabase && nullptr != mPrepared &&
-        nullptr != mStatement;
+    return nullptr != mDatabase && mPrepared && nullptr != mStatement;
+}
+
+const CassValue* DatabaseQueryCassandra::GetColumn(size_t index) const
+{
+    const CassValue *pValue = nullptr;
+    const CassRow *pRow;
+
+    if(nullptr != mRowIterator && nullptr != (pRow = cass_iterator_get_row(
+        mRowIterator)))
+    {
+        pValue = cass_row_get_column(pRow, index);
+    }
+
+    return (nullptr != pValue && !cass_value_is_null(pValue)) ?
+        pValue : nullptr;
+}
+
+const CassValue* DatabaseQueryCassandra::GetColumn(const String& name) const
+{
+    const CassValue *pValue = nullptr;
+    const CassRow *pRow;
+
+    if(nullptr != mRowIterator && nullptr != (pRow = cass_iterator_get_row(
+        mRowIterator)))
+    {
+        pValue = cass_row_get_column_by_name_n(pRow, name.C(), name.Size());
+    }
+
+    return (nullptr != pValue && !cass_value_is_null(pValue)) ?
+        pValue : nullptr;
+}
+
+bool DatabaseQueryCassandra::AddToBatch(CassBatch *pBatch)
+{
+    bool result = false;
+
+    if(nullptr != mStatement && nullptr != pBatch &&
+        CASS_OK == cass_batch_add_statement(pBatch, mStatement))
+    {
+        // The batch keeps its own reference to the statement.
+        cass_statement_free(mStatement);
+        mStatement = nullptr;
+
+        if(mPrepared)
+        {
+            mStatement = cass_prepared_bind(mPrepared.get());
+        }
+
+        result = true;
+    }
+
+    return result;
+}
+
+DatabaseBatchCassandra::DatabaseBatchCassandra(DatabaseCassandra *pDatabase,
+    bool logged) : mDatabase(pDatabase), mBatch(nullptr),
+    mType(logged ? CASS_BATCH_TYPE_LOGGED : CASS_BATCH_TYPE_UNLOGGED),
+    mCount(0), mFailed(false)
+{
+    Reset();
+}
+
+DatabaseBatchCassandra::~DatabaseBatchCassandra()
+{
+    if(nullptr != mBatch)
+    {
+        cass_batch_free(mBatch);
+        mBatch = nullptr;
+    }
+}
+
+bool DatabaseBatchCassandra::Add(DatabaseQueryImpl *pQuery)
+{
+    bool result = false;
+
+    DatabaseQueryCassandra *pCassandraQuery = dynamic_cast<
+        DatabaseQueryCassandra*>(pQuery);
+
+    if(nullptr != pCassandraQuery)
+    {
+        result = pCassandraQuery->AddToBatch(mBatch);
+    }
+
+    if(result)
+    {
+        mCount++;
+    }
+    else
+    {
+        mFailed = true;
+    }
+
+    return result;
+}
+
+bool DatabaseBatchCassandra::Execute()
+{
+    bool result = !mFailed;
+
+    CassSession *pSession = nullptr != mDatabase ?
+        mDatabase->GetSession() : nullptr;
+
+    if(result && 0 < mCount)
+    {
+        result = nullptr != pSession && mDatabase->WaitForFuture(
+            cass_session_execute_batch(pSession, mBatch));
+    }
+
+    Reset();
+
+    return result;
+}
+
+size_t DatabaseBatchCassandra::Count() const
+{
+    return mCount;
+}
+
+void DatabaseBatchCassandra::Reset()
+{
+    if(nullptr != mBatch)
+    {
+        cass_batch_free(mBatch);
+    }
+
+    mBatch = cass_batch_new(mType);
+    mCount = 0;
+    mFailed = false;
 }
@@ -28,11 +28,17 @@
 #define LIBCOMP_SRC_DATABASEQUERYCASSANDRA_H
 
 // libcomp Includes
+#include "DatabaseBatch.h"
 #include "DatabaseQuery.h"
 
 // Cassandra Includes
 #include <cassandra.h>
 
+// Standard C++11 Includes
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
 namespace libcomp
 {
 
@@ -46,6 +52,7 @@ public:
 
     virtual bool Prepare(const String& query);
     virtual bool Execute();
+    virtual bool ExecuteAsync(const DatabaseCallback_t& callback);
     virtual bool Next();
 
     virtual bool Bind(size_t index, const String& value);
@@ -60,13 +67,72 @@ public:
     virtual bool GetMap(const String& name, std::unordered_map<
         std::string, std::vector<char>>& values);
 
+    virtual bool GetInt(size_t index, int32_t& value);
+    virtual bool GetInt(const String& name, int32_t& value);
+    virtual bool GetBigInt(size_t index, int64_t& value);
+    virtual bool GetBigInt(const String& name, int64_t& value);
+    virtual bool GetBlob(size_t index, const char*& pData, size_t& size);
+    virtual bool GetBlob(const String& name, const char*& pData, size_t& size);
+    virtual bool GetText(size_t index, const char*& szText, size_t& size);
+    virtual bool GetText(const String& name, const char*& szText,
+        size_t& size);
+
+    virtual bool ForEachRow(const std::function<bool()>& visitor,
+        size_t pageSize);
+
     virtual bool BatchNext();
 
     virtual bool IsValid() const;
 
+    /**
+     * Move the bound statement into a batch and bind a new one.
+     * @param pBatch Batch to add the statement to.
+     * @returns true if the statement was added.
+     */
+    bool AddToBatch(CassBatch *pBatch);
+
 private:
+    /**
+     * Free the result of the last execution.
+     */
+    void FreeResult();
+
+    /**
+     * Get a column of the current row.
+     * @param index Index of the column.
+     * @returns Column value or nullptr if there is none (or it is null).
+     */
+    const CassValue* GetColumn(size_t index) const;
+
+    /**
+     * Get a column of the current row.
+     * @param name Name of the column.
+     * @returns Column value or nullptr if there is none (or it is null).
+     */
+    const CassValue* GetColumn(const String& name) const;
+
+    /**
+     * Free the last result and send the statement (or batch).
+     * @returns Future for the result or nullptr if nothing could be sent.
+     */
+    CassFuture* StartExecute();
+
+    /**
+     * Save the result of a finished future.
+     * @param pFuture Future returned by @ref StartExecute (may be nullptr).
+     * @returns true if the query succeeded.
+     */
+    bool FinishExecute(CassFuture *pFuture);
+
+    /**
+     * Called by the driver once an asynchronous query has finished.
+     * @param pFuture Future that finished.
+     * @param pData Query that started the future.
+     */
+    static void FutureCallback(CassFuture *pFuture, void *pData);
+
     DatabaseCassandra *mDatabase;
-    const CassPrepared *mPrepared;
+    std::shared_ptr<const CassPrepared> mPrepared;
     CassStatement *mStatement;
 
     CassFuture *mFuture;
@@ -74,6 +140,35 @@ private:
 
     CassIterator *mRowIterator;
     CassBatch *mBatch;
+
+    DatabaseCallback_t mCallback;
+    bool mAsyncPending;
+    std::mutex mAsyncLock;
+    std::condition_variable mAsyncFinished;
+};
+
+class DatabaseBatchCassandra : public DatabaseBatchImpl
+{
+public:
+    DatabaseBatchCassandra(DatabaseCassandra *pDatabase, bool logged);
+    virtual ~DatabaseBatchCassandra();
+
+    virtual bool Add(DatabaseQueryImpl *pQuery);
+    virtual bool Execute();
+    virtual size_t Count() const;
+
+private:
+    /**
+     * Drop every statement in the batch and start a new one.
+     */
+    void Reset();
+
+    DatabaseCassandra *mDatabase;
+    CassBatch *mBatch;
+    CassBatchType mType;
+
+    size_t mCount;
+    bool mFailed;
 };
 
 } // namespace libcomp
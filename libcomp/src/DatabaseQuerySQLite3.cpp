@@ -0,0 +1,408 @@
+/**
+ * @file libcomp/src/DatabaseQuerySQLite3.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief An SQLite3 database query.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DatabaseQuerySQLite3.h"
+
+// libcomp Includes
+#include "DatabaseSQLite3.h"
+
+// SQLite3 Includes
+#include <sqlite3.h>
+
+// Standard C++11 Includes
+#include <limits>
+
+using namespace libcomp;
+
+DatabaseQuerySQLite3::DatabaseQuerySQLite3(DatabaseSQLite3 *pDatabase) :
+    mDatabase(pDatabase), mNeedsReset(false), mPendingRow(false),
+    mHasRows(false)
+{
+}
+
+DatabaseQuerySQLite3::~DatabaseQuerySQLite3()
+{
+    ReleaseStatement();
+}
+
+bool DatabaseQuerySQLite3::Prepare(const String& query)
+{
+    // Give back any existing statement.
+    ReleaseStatement();
+
+    if(nullptr != mDatabase)
+    {
+        mStatement = mDatabase->TakeStatement(query);
+    }
+
+    if(mStatement)
+    {
+        mQuery = query;
+    }
+
+    return nullptr != mStatement;
+}
+
+bool DatabaseQuerySQLite3::Execute()
+{
+    bool result = false;
+
+    if(mStatement)
+    {
+        Reset(false);
+
+        int status = sqlite3_step(mStatement.get());
+
+        mNeedsReset = true;
+        mPendingRow = SQLITE_ROW == status;
+        mHasRows = mPendingRow;
+
+        if(SQLITE_ROW == status || SQLITE_DONE == status)
+        {
+            result = true;
+        }
+        else
+        {
+            mDatabase->SaveError();
+        }
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::Next()
+{
+    bool result = false;
+
+    if(mPendingRow)
+    {
+        // Execute already stepped onto the first row.
+        mPendingRow = false;
+
+        result = true;
+    }
+    else if(mHasRows)
+    {
+        mHasRows = SQLITE_ROW == sqlite3_step(mStatement.get());
+
+        result = mHasRows;
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::Bind(size_t index, const String& value)
+{
+    bool result = false;
+
+    if(mStatement)
+    {
+        Reset(true);
+
+        // SQLite numbers parameters from 1.
+        result = SQLITE_OK == sqlite3_bind_text(mStatement.get(),
+            (int)index + 1, value.C(), (int)value.Size(), SQLITE_TRANSIENT);
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::Bind(const String& name, const String& value)
+{
+    bool result = false;
+
+    if(mStatement)
+    {
+        Reset(true);
+
+        int index = sqlite3_bind_parameter_index(mStatement.get(), name.C());
+
+        // Allow the name without the ':' prefix.
+        if(0 == index)
+        {
+            index = sqlite3_bind_parameter_index(mStatement.get(),
+                (String(":") + name).C());
+        }
+
+        if(0 != index)
+        {
+            result = SQLITE_OK == sqlite3_bind_text(mStatement.get(), index,
+                value.C(), (int)value.Size(), SQLITE_TRANSIENT);
+        }
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::GetInt(size_t index, int32_t& value)
+{
+    int64_t bigValue;
+
+    bool result = GetBigInt(index, bigValue) &&
+        std::numeric_limits<int32_t>::min() <= bigValue &&
+        std::numeric_limits<int32_t>::max() >= bigValue;
+
+    if(result)
+    {
+        value = (int32_t)bigValue;
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::GetInt(const String& name, int32_t& value)
+{
+    size_t index;
+
+    return FindColumn(name, index) && GetInt(index, value);
+}
+
+bool DatabaseQuerySQLite3::GetBigInt(size_t index, int64_t& value)
+{
+    bool result = HasColumn(index, SQLITE_INTEGER);
+
+    if(result)
+    {
+        value = (int64_t)sqlite3_column_int64(mStatement.get(), (int)index);
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::GetBigInt(const String& name, int64_t& value)
+{
+    size_t index;
+
+    return FindColumn(name, index) && GetBigInt(index, value);
+}
+
+bool DatabaseQuerySQLite3::GetBlob(size_t index, const char*& pData,
+    size_t& size)
+{
+    bool result = HasColumn(index, SQLITE_BLOB);
+
+    if(result)
+    {
+        pData = reinterpret_cast<const char*>(sqlite3_column_blob(
+            mStatement.get(), (int)index));
+        size = (size_t)sqlite3_column_bytes(mStatement.get(), (int)index);
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::GetBlob(const String& name, const char*& pData,
+    size_t& size)
+{
+    size_t index;
+
+    return FindColumn(name, index) && GetBlob(index, pData, size);
+}
+
+bool DatabaseQuerySQLite3::GetText(size_t index, const char*& szText,
+    size_t& size)
+{
+    bool result = HasColumn(index, SQLITE_TEXT);
+
+    if(result)
+    {
+        szText = reinterpret_cast<const char*>(sqlite3_column_text(
+            mStatement.get(), (int)index));
+        size = (size_t)sqlite3_column_bytes(mStatement.get(), (int)index);
+    }
+
+    return result;
+}
+
+bool DatabaseQuerySQLite3::GetText(const String& name, const char*& szText,
+    size_t& size)
+{
+    size_t index;
+
+    return FindColumn(name, index) && GetText(index, szText, size);
+}
+
+bool DatabaseQuerySQLite3::BatchNext()
+{
+    // Batches are not supported by this backend.
+    return false;
+}
+
+bool DatabaseQuerySQLite3::IsValid() const
+{
+    return nullptr != mDatabase && nullptr != mStatement;
+}
+
+void DatabaseQuerySQLite3::ReleaseStatement()
+{
+    if(mStatement)
+    {
+        // The next query must not see this one's rows or values.
+        (void)sqlite3_reset(mStatement.get());
+        (void)sqlite3_clear_bindings(mStatement.get());
+
+        mDatabase->ReturnStatement(mQuery, mStatement);
+        mStatement.reset();
+    }
+
+    mQuery.Clear();
+    mNeedsReset = false;
+    mPendingRow = false;
+    mHasRows = false;
+}
+
+bool DatabaseQuerySQLite3::HasColumn(size_t index, int type) const
+{
+    return mStatement && mHasRows && !mPendingRow &&
+        (int)index < sqlite3_column_count(mStatement.get()) &&
+        type == sqlite3_column_type(mStatement.get(), (int)index);
+}
+
+bool DatabaseQuerySQLite3::FindColumn(const String& name,
+    size_t& index) const
+{
+    bool result = false;
+
+    if(mStatement)
+    {
+        int columnCount = sqlite3_column_count(mStatement.get());
+
+        for(int i = 0; !result && i < columnCount; ++i)
+        {
+            if(name == sqlite3_column_name(mStatement.get(), i))
+            {
+                index = (size_t)i;
+                result = true;
+            }
+        }
+    }
+
+    return result;
+}
+
+void DatabaseQuerySQLite3::Reset(bool clearBindings)
+{
+    if(mNeedsReset)
+    {
+        (void)sqlite3_reset(mStatement.get());
+
+        mNeedsReset = false;
+        mPendingRow = false;
+        mHasRows = false;
+
+        if(clearBindings)
+        {
+            (void)sqlite3_clear_bindings(mStatement.get());
+        }
+    }
+}
+
+DatabaseBatchSQLite3::DatabaseBatchSQLite3(DatabaseSQLite3 *pDatabase) :
+    mDatabase(pDatabase), mCount(0), mFailed(false)
+{
+}
+
+DatabaseBatchSQLite3::~DatabaseBatchSQLite3()
+{
+    // Discard anything that was not sent.
+    if(0 < mCount || mFailed)
+    {
+        (void)Run("ROLLBACK;");
+    }
+}
+
+bool DatabaseBatchSQLite3::Add(DatabaseQueryImpl *pQuery)
+{
+    bool result = nullptr != pQuery && nullptr != mDatabase &&
+        nullptr != mDatabase->mDatabase;
+
+    // Start the transaction with the first statement.
+    if(result && 0 == mCount && !mFailed)
+    {
+        result = Run("BEGIN;");
+    }
+
+    if(result)
+    {
+        result = pQuery->Execute();
+    }
+
+    if(result)
+    {
+        mCount++;
+    }
+    else
+    {
+        mFailed = true;
+    }
+
+    return result;
+}
+
+bool DatabaseBatchSQLite3::Execute()
+{
+    bool result = true;
+
+    if(mFailed)
+    {
+        (void)Run("ROLLBACK;");
+
+        result = false;
+    }
+    else if(0 < mCount)
+    {
+        result = Run("COMMIT;");
+
+        if(!result)
+        {
+            (void)Run("ROLLBACK;");
+        }
+    }
+
+    mCount = 0;
+    mFailed = false;
+
+    return result;
+}
+
+size_t DatabaseBatchSQLite3::Count() const
+{
+    return mCount;
+}
+
+bool DatabaseBatchSQLite3::Run(const char *szSql)
+{
+    bool result = nullptr != mDatabase && nullptr != mDatabase->mDatabase &&
+        SQLITE_OK == sqlite3_exec(mDatabase->mDatabase, szSql, nullptr,
+        nullptr, nullptr);
+
+    if(!result && nullptr != mDatabase)
+    {
+        mDatabase->SaveError();
+    }
+
+    return result;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file libcomp/src/DatabaseQuerySQLite3.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief An SQLite3 database query.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_DATABASEQUERYSQLITE3_H
+#define LIBCOMP_SRC_DATABASEQUERYSQLITE3_H
+
+// libcomp Includes
+#include "DatabaseBatch.h"
+#include "DatabaseQuery.h"
+
+// Standard C++11 Includes
+#include <memory>
+
+typedef struct sqlite3_stmt sqlite3_stmt;
+
+namespace libcomp
+{
+
+class DatabaseSQLite3;
+
+class DatabaseQuerySQLite3 : public DatabaseQueryImpl
+{
+public:
+    DatabaseQuerySQLite3(DatabaseSQLite3 *pDatabase);
+    virtual ~DatabaseQuerySQLite3();
+
+    virtual bool Prepare(const String& query);
+    virtual bool Execute();
+    virtual bool Next();
+
+    virtual bool Bind(size_t index, const String& value);
+    virtual bool Bind(const String& name, const String& value);
+
+    virtual bool GetInt(size_t index, int32_t& value);
+    virtual bool GetInt(const String& name, int32_t& value);
+    virtual bool GetBigInt(size_t index, int64_t& value);
+    virtual bool GetBigInt(const String& name, int64_t& value);
+    virtual bool GetBlob(size_t index, const char*& pData, size_t& size);
+    virtual bool GetBlob(const String& name, const char*& pData, size_t& size);
+    virtual bool GetText(size_t index, const char*& szText, size_t& size);
+    virtual bool GetText(const String& name, const char*& szText,
+        size_t& size);
+
+    virtual bool BatchNext();
+
+    virtual bool IsValid() const;
+
+private:
+    /**
+     * Give the statement back to the database so another query can use it.
+     */
+    void ReleaseStatement();
+
+    /**
+     * Reset the statement if it has been run so it can be bound again.
+     * @param clearBindings If the bound values should be removed too.
+     */
+    void Reset(bool clearBindings);
+
+    /**
+     * Find a column of the current row.
+     * @param index Index of the column.
+     * @param type SQLite type the column must hold.
+     * @returns true if the statement is on a row and the column holds
+     * @em type.
+     */
+    bool HasColumn(size_t index, int type) const;
+
+    /**
+     * Find the index of a column by name.
+     * @param name Name of the column.
+     * @param index Set to the index of the column.
+     * @returns true if the column exists.
+     */
+    bool FindColumn(const String& name, size_t& index) const;
+
+    DatabaseSQLite3 *mDatabase;
+    std::shared_ptr<sqlite3_stmt> mStatement;
+    String mQuery;
+
+    /// The statement has been stepped and must be reset before reuse.
+    bool mNeedsReset;
+
+    /// Execute stepped onto a row that Next has not returned yet.
+    bool mPendingRow;
+
+    /// The statement may have more rows.
+    bool mHasRows;
+};
+
+class DatabaseBatchSQLite3 : public DatabaseBatchImpl
+{
+public:
+    DatabaseBatchSQLite3(DatabaseSQLite3 *pDatabase);
+    virtual ~DatabaseBatchSQLite3();
+
+    /**
+     * Run the query inside the batch's transaction (starting it for the
+     * first query).
+     * @param pQuery Query to run.
+     * @returns true if the query succeeded.
+     */
+    virtual bool Add(DatabaseQueryImpl *pQuery);
+    virtual bool Execute();
+    virtual size_t Count() const;
+
+private:
+    /**
+     * Run a transaction control statement.
+     * @param szSql Statement to run.
+     * @returns true if the statement succeeded.
+     */
+    bool Run(const char *szSql);
+
+    DatabaseSQLite3 *mDatabase;
+
+    size_t mCount;
+    bool mFailed;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_DATABASEQUERYSQLITE3_H
@@ -27,6 +27,7 @@
 #include "DatabaseSQLite3.h"
 
 // libcomp Includes
+#include "DatabaseQuerySQLite3.h"
 #include "Log.h"
 
 // SQLite3 Includes
@@ -60,6 +61,20 @@ bool DatabaseSQLite3::Open(const String& address, const String& username,
 
         (void)Close();
     }
+    else
+    {
+        // Wait for other connections instead of failing right away.
+        (void)sqlite3_busy_timeout(mDatabase, SQLITE_BUSY_TIMEOUT);
+
+        // Let readers on other connections run while a write is in progress
+        // (in-memory databases just keep their own journal mode).
+        if(SQLITE_OK != sqlite3_exec(mDatabase, "PRAGMA journal_mode=WAL;",
+            nullptr, nullptr, nullptr))
+        {
+            LOG_WARNING(String("Failed to enable WAL mode: %1\n").Arg(
+                sqlite3_errmsg(mDatabase)));
+        }
+    }
 
     return result;
 }
@@ -68,6 +83,9 @@ bool DatabaseSQLite3::Close()
 {
     bool result = true;
 
+    // Every statement must be finalized before the database is closed.
+    mStatementCache.Clear();
+
     if(nullptr != mDatabase)
     {
         if(SQLITE_OK != sqlite3_close(mDatabase))
@@ -87,3 +105,65 @@ bool DatabaseSQLite3::IsOpen() const
 {
     return nullptr != mDatabase;
 }
+
+DatabaseQuery DatabaseSQLite3::Prepare(const String& query)
+{
+    return DatabaseQuery(new DatabaseQuerySQLite3(this), query);
+}
+
+DatabaseBatch DatabaseSQLite3::CreateBatch(bool logged, size_t flushSize)
+{
+    // A transaction is always atomic.
+    (void)logged;
+
+    return DatabaseBatch(new DatabaseBatchSQLite3(this), flushSize);
+}
+
+StatementCacheStats_t DatabaseSQLite3::GetStatementCacheStats() const
+{
+    return mStatementCache.GetStats();
+}
+
+std::shared_ptr<sqlite3_stmt> DatabaseSQLite3::TakeStatement(
+    const String& query)
+{
+    std::shared_ptr<sqlite3_stmt> statement = mStatementCache.Find(
+        query.ToUtf8(), true);
+
+    if(!statement && nullptr != mDatabase)
+    {
+        sqlite3_stmt *pStatement = nullptr;
+
+        if(SQLITE_OK == sqlite3_prepare_v2(mDatabase, query.C(),
+            (int)query.Size(), &pStatement, nullptr) && nullptr != pStatement)
+        {
+            statement = std::shared_ptr<sqlite3_stmt>(pStatement,
+                [](sqlite3_stmt *pFinalized)
+                {
+                    (void)sqlite3_finalize(pFinalized);
+                });
+        }
+        else
+        {
+            SaveError();
+
+            (void)sqlite3_finalize(pStatement);
+        }
+    }
+
+    return statement;
+}
+
+void DatabaseSQLite3::ReturnStatement(const String& query,
+    const std::shared_ptr<sqlite3_stmt>& statement)
+{
+    mStatementCache.Insert(query.ToUtf8(), statement);
+}
+
+void DatabaseSQLite3::SaveError()
+{
+    if(nullptr != mDatabase)
+    {
+        SetLastError(sqlite3_errmsg(mDatabase));
+    }
+}
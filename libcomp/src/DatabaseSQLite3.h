@@ -29,7 +29,11 @@
 
 #include "Database.h"
 
+// Standard C++11 Includes
+#include <memory>
+
 typedef struct sqlite3 sqlite3;
+typedef struct sqlite3_stmt sqlite3_stmt;
 
 namespace libcomp
 {
@@ -37,6 +41,9 @@ namespace libcomp
 class DatabaseSQLite3 : public Database
 {
 public:
+    friend class DatabaseBatchSQLite3;
+    friend class DatabaseQuerySQLite3;
+
     DatabaseSQLite3();
     virtual ~DatabaseSQLite3();
 
@@ -45,8 +52,39 @@ public:
     virtual bool Close();
     virtual bool IsOpen() const;
 
+    virtual DatabaseQuery Prepare(const String& query);
+    virtual DatabaseBatch CreateBatch(bool logged = false,
+        size_t flushSize = DATABASE_BATCH_SIZE);
+
+    virtual StatementCacheStats_t GetStatementCacheStats() const;
+
+protected:
+    /**
+     * Take the statement for a query out of the cache or prepare it if it is
+     * not there. A statement can only be used by one query at a time so it
+     * stays out of the cache until it is returned.
+     * @param query Query to prepare.
+     * @returns Prepared statement or nullptr if the query failed to prepare.
+     */
+    std::shared_ptr<sqlite3_stmt> TakeStatement(const String& query);
+
+    /**
+     * Put a statement back in the cache once a query is done with it.
+     * @param query Query the statement was prepared from.
+     * @param statement Statement that has been reset.
+     */
+    void ReturnStatement(const String& query,
+        const std::shared_ptr<sqlite3_stmt>& statement);
+
+    /**
+     * Save the last error reported by SQLite.
+     */
+    void SaveError();
+
 private:
     sqlite3 *mDatabase;
+
+    StatementCache<sqlite3_stmt> mStatementCache;
 };
 
 } // namespace libcomp
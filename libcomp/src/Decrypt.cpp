@@ -25,9 +25,11 @@
  */
 
 #include "Decrypt.h"
+#include "Blowfish.h"
 #include "Config.h"
 #include "Exception.h"
 #include "Packet.h"
+#include "Tracer.h"
 
 #include <openssl/crypto.h>
 #include <openssl/md5.h>
@@ -44,6 +46,7 @@
 #include <wincrypt.h>
 #endif // _WIN32
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <sstream>
@@ -80,34 +83,70 @@ typedef struct __attribute__((packed))
     uint32_t originalSize;
 } EncryptedFileHeader_t;
 
-std::vector<char> Decrypt::DecryptFile(const std::string& path)
+/**
+ * @internal
+ * Open an encrypted file and check its header.
+ * @param path Path to the encrypted file.
+ * @param file Stream to open. On success it is at the encrypted data.
+ * @param originalSize Set to the size of the file after decryption.
+ * @param encryptedSize Set to the number of bytes of encrypted data.
+ * @returns true if the file is a valid encrypted file.
+ */
+static bool OpenEncryptedFile(const std::string& path, std::ifstream& file,
+    uint32_t& originalSize, size_t& encryptedSize)
 {
-    std::vector<char> data = Decrypt::LoadFile(path);
+    file.open(path.c_str(), std::ifstream::in | std::ifstream::binary |
+        std::ifstream::ate);
+
+    std::streampos fileSize = file.tellg();
+    file.seekg(0);
+
+    EncryptedFileHeader_t header;
 
     // Check the file is large enough.
-    if(sizeof(EncryptedFileHeader_t) < data.size())
+    if(!file.good() || (std::streampos)sizeof(header) >= fileSize)
     {
-        EncryptedFileHeader_t *pHeader = reinterpret_cast<
-            EncryptedFileHeader_t*>(&data[0]);
+        return false;
+    }
 
-        // Check the header.
-        if(data.size() >= (sizeof(EncryptedFileHeader_t) +
-            pHeader->originalSize) && 0 == memcmp(&pHeader->magic[0],
-            Config::ENCRYPTED_FILE_MAGIC, sizeof(pHeader->magic)))
-        {
-            uint32_t originalSize = pHeader->originalSize;
-            pHeader = nullptr;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    encryptedSize = (size_t)fileSize - sizeof(header);
+    originalSize = header.originalSize;
+
+    // Check the header.
+    return file.good() && encryptedSize >= originalSize &&
+        0 == (encryptedSize % BLOWFISH_BLOCK_SIZE) &&
+        0 == memcmp(&header.magic[0], Config::ENCRYPTED_FILE_MAGIC,
+        sizeof(header.magic));
+}
+
+std::vector<char> Decrypt::DecryptFile(const std::string& path)
+{
+    std::vector<char> data;
+    std::ifstream file;
 
-            // Remove the header.
-            data.erase(data.begin(), data.begin() +
-                sizeof(EncryptedFileHeader_t));
+    uint32_t originalSize = 0;
+    size_t encryptedSize = 0;
 
-            // Decrypt the file.
-            Decrypt::DecryptCbc(data, originalSize);
+    if(OpenEncryptedFile(path, file, originalSize, encryptedSize))
+    {
+        uint64_t initializationVector = *reinterpret_cast<const uint64_t*>(
+            Config::ENCRYPTED_FILE_IV);
+
+        // Read the encrypted data straight into the result and decrypt it
+        // there.
+        data.resize(encryptedSize);
+        file.read(&data[0], (std::streamsize)encryptedSize);
+
+        if(file.good())
+        {
+            DecryptCbc(gFileEncryptionKey, initializationVector, &data[0],
+                encryptedSize);
+            data.resize(originalSize);
         }
         else
         {
-            pHeader = nullptr;
             data.clear();
         }
     }
@@ -115,23 +154,134 @@ std::vector<char> Decrypt::DecryptFile(const std::string& path)
     return data;
 }
 
+bool Decrypt::DecryptFile(const std::string& path, const std::function<bool(
+    const char *pData, size_t size)>& sink, size_t chunkSize)
+{
+    std::ifstream file;
+
+    uint32_t originalSize = 0;
+    size_t encryptedSize = 0;
+
+    // Keep whole blocks in each chunk so the CBC state carries over.
+    chunkSize -= chunkSize % BLOWFISH_BLOCK_SIZE;
+
+    if(0 == chunkSize || !OpenEncryptedFile(path, file, originalSize,
+        encryptedSize))
+    {
+        return false;
+    }
+
+    uint64_t initializationVector = *reinterpret_cast<const uint64_t*>(
+        Config::ENCRYPTED_FILE_IV);
+
+    std::vector<char> chunk(std::min(chunkSize, encryptedSize));
+
+    size_t remaining = originalSize;
+
+    while(0 < encryptedSize)
+    {
+        size_t size = std::min(chunk.size(), encryptedSize);
+
+        file.read(&chunk[0], (std::streamsize)size);
+
+        if(!file.good())
+        {
+            return false;
+        }
+
+        DecryptCbc(gFileEncryptionKey, initializationVector, &chunk[0],
+            size);
+
+        encryptedSize -= size;
+
+        // Leave out the padding at the end.
+        size_t used = std::min(size, remaining);
+        remaining -= used;
+
+        if(0 < used && !sink(&chunk[0], used))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool Decrypt::EncryptFile(const std::string& path,
     const std::vector<char>& data)
 {
-    std::vector<char> dataCopy = data;
+    size_t offset = 0;
+
+    return EncryptFile(path, [&data, &offset](char *pData, size_t size)
+    {
+        size = std::min(size, data.size() - offset);
+
+        if(0 < size)
+        {
+            memcpy(pData, &data[offset], size);
+            offset += size;
+        }
+
+        return size;
+    }, static_cast<uint32_t>(data.size()));
+}
+
+bool Decrypt::EncryptFile(const std::string& path,
+    const std::function<size_t(char *pData, size_t size)>& source,
+    uint32_t originalSize, size_t chunkSize)
+{
+    // Keep whole blocks in each chunk so the CBC state carries over.
+    chunkSize -= chunkSize % BLOWFISH_BLOCK_SIZE;
+
+    if(0 == chunkSize)
+    {
+        return false;
+    }
 
     EncryptedFileHeader_t header;
-    header.originalSize = static_cast<uint32_t>(data.size());
+    header.originalSize = originalSize;
 
     memcpy(&header.magic[0], Config::ENCRYPTED_FILE_MAGIC,
         sizeof(header.magic));
 
-    Decrypt::EncryptCbc(dataCopy);
-
     std::ofstream out;
     out.open(path, std::ofstream::out | std::ofstream::binary);
     out.write(reinterpret_cast<const char*>(&header), sizeof(header));
-    out.write(&dataCopy[0], dataCopy.size());
+
+    uint64_t initializationVector = *reinterpret_cast<const uint64_t*>(
+        Config::ENCRYPTED_FILE_IV);
+
+    std::vector<char> chunk(std::min<size_t>(chunkSize, ((originalSize +
+        BLOWFISH_BLOCK_SIZE - 1) / BLOWFISH_BLOCK_SIZE) *
+        BLOWFISH_BLOCK_SIZE));
+
+    size_t remaining = originalSize;
+
+    while(out.good() && 0 < remaining)
+    {
+        size_t size = std::min(chunk.size(), remaining);
+
+        if(size != source(&chunk[0], size))
+        {
+            return false;
+        }
+
+        remaining -= size;
+
+        // Pad the last block with zeros.
+        size_t padded = ((size + BLOWFISH_BLOCK_SIZE - 1) /
+            BLOWFISH_BLOCK_SIZE) * BLOWFISH_BLOCK_SIZE;
+
+        if(padded > size)
+        {
+            memset(&chunk[size], 0, padded - size);
+        }
+
+        EncryptCbc(gFileEncryptionKey, initializationVector, &chunk[0],
+            padded);
+
+        out.write(&chunk[0], (std::streamsize)padded);
+    }
 
     return out.good();
 }
@@ -266,6 +416,78 @@ String Decrypt::GenerateRandom(int sz)
     return ss.str();
 }
 
+/**
+ * @internal
+ * Fill a buffer with random bytes from the OS.
+ * @param pBuffer Buffer to fill.
+ * @param size Number of bytes to read.
+ * @returns true if the buffer was filled; false otherwise.
+ */
+static bool ReadSystemRandom(uint8_t *pBuffer, size_t size)
+{
+#ifdef WIN32
+    HCRYPTPROV hCryptProv;
+
+    if(TRUE != CryptAcquireContext(&hCryptProv, NULL, NULL, PROV_RSA_FULL,
+        CRYPT_VERIFYCONTEXT))
+    {
+        return false;
+    }
+
+    bool result = TRUE == CryptGenRandom(hCryptProv, (DWORD)size, pBuffer);
+
+    CryptReleaseContext(hCryptProv, 0);
+
+    return result;
+#else // WIN32
+    std::ifstream file("/dev/urandom", std::ifstream::in |
+        std::ifstream::binary);
+    file.read(reinterpret_cast<char*>(pBuffer), (std::streamsize)size);
+
+    return file.good() && (std::streamsize)size == file.gcount();
+#endif // WIN32
+}
+
+String Decrypt::GenerateSessionToken(size_t digits)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    // Random bytes not handed out yet are at the end of the pool.
+    static thread_local uint8_t pool[SESSION_TOKEN_POOL_SIZE];
+    static thread_local size_t poolUsed = SESSION_TOKEN_POOL_SIZE;
+
+    if(0 != (digits % 2))
+    {
+        return String();
+    }
+
+    std::string token(digits, '0');
+    size_t bytes = digits / 2;
+
+    for(size_t i = 0; i < bytes; ++i)
+    {
+        if(SESSION_TOKEN_POOL_SIZE == poolUsed)
+        {
+            if(!ReadSystemRandom(pool, sizeof(pool)))
+            {
+                return String();
+            }
+
+            poolUsed = 0;
+        }
+
+        uint8_t byte = pool[poolUsed];
+
+        // Never hand out the same random byte twice.
+        pool[poolUsed++] = 0;
+
+        token[i * 2] = HEX_DIGITS[byte >> 4];
+        token[i * 2 + 1] = HEX_DIGITS[byte & 0x0F];
+    }
+
+    return token;
+}
+
 uint32_t Decrypt::GenerateSessionKey()
 {
     uint32_t sessionKey = 0;
@@ -428,15 +650,9 @@ void Decrypt::Encrypt(const BF_KEY& key, void *pVoidData, uint32_t dataSize)
     // Make room for the padded block.
     if(0 == (dataSize % BLOWFISH_BLOCK_SIZE))
     {
-        char *pData = reinterpret_cast<char*>(pVoidData);
-
         // Encrypt each full block.
-        while(BLOWFISH_BLOCK_SIZE <= dataSize)
-        {
-            BF_encrypt(reinterpret_cast<BF_LONG*>(pData), &key);
-            pData += BLOWFISH_BLOCK_SIZE;
-            dataSize -= BLOWFISH_BLOCK_SIZE;
-        }
+        Blowfish::EncryptBlocks(key, pVoidData,
+            dataSize / BLOWFISH_BLOCK_SIZE);
     }
 }
 
@@ -455,14 +671,10 @@ void Decrypt::Encrypt(const BF_KEY& key, std::vector<char>& data)
         data.resize(size, 0);
     }
 
-    char *pData = &data[0];
-
     // Encrypt each full block.
-    while(BLOWFISH_BLOCK_SIZE <= size)
+    if(0 < size)
     {
-        BF_encrypt(reinterpret_cast<BF_LONG*>(pData), &key);
-        pData += BLOWFISH_BLOCK_SIZE;
-        size -= BLOWFISH_BLOCK_SIZE;
+        Blowfish::EncryptBlocks(key, &data[0], size / BLOWFISH_BLOCK_SIZE);
     }
 }
 
@@ -476,15 +688,9 @@ void Decrypt::Decrypt(const BF_KEY& key, void *pVoidData, uint32_t dataSize)
     // Make room for the padded block.
     if(0 == (dataSize % BLOWFISH_BLOCK_SIZE))
     {
-        char *pData = reinterpret_cast<char*>(pVoidData);
-
         // Decrypt each full block.
-        while(BLOWFISH_BLOCK_SIZE <= dataSize)
-        {
-            BF_decrypt(reinterpret_cast<BF_LONG*>(pData), &key);
-            pData += BLOWFISH_BLOCK_SIZE;
-            dataSize -= BLOWFISH_BLOCK_SIZE;
-        }
+        Blowfish::DecryptBlocks(key, pVoidData,
+            dataSize / BLOWFISH_BLOCK_SIZE);
     }
 }
 
@@ -492,18 +698,12 @@ void Decrypt::Decrypt(const BF_KEY& key, std::vector<char>& data,
     std::vector<char>::size_type realSize)
 {
     std::vector<char>::size_type size = data.size();
-    char *pData = &data[0];
 
     if((0 == realSize || realSize <= size) &&
-        0 == (size % BLOWFISH_BLOCK_SIZE))
+        0 == (size % BLOWFISH_BLOCK_SIZE) && 0 < size)
     {
         // Decrypt each full block.
-        while(BLOWFISH_BLOCK_SIZE <= size)
-        {
-            BF_decrypt(reinterpret_cast<BF_LONG*>(pData), &key);
-            pData += BLOWFISH_BLOCK_SIZE;
-            size -= BLOWFISH_BLOCK_SIZE;
-        }
+        Blowfish::DecryptBlocks(key, &data[0], size / BLOWFISH_BLOCK_SIZE);
     }
 
     // Resize the data if requested.
@@ -523,7 +723,6 @@ void Decrypt::EncryptCbc(const BF_KEY& key, uint64_t& initializationVector,
     std::vector<char>& data)
 {
     std::vector<char>::size_type size = data.size();
-    uint64_t previousBlock = initializationVector;
 
     // Make room for the padded block.
     if(0 != (size % BLOWFISH_BLOCK_SIZE))
@@ -536,21 +735,33 @@ void Decrypt::EncryptCbc(const BF_KEY& key, uint64_t& initializationVector,
         data.resize(size, 0);
     }
 
-    char *pData = &data[0];
+    if(0 < size)
+    {
+        EncryptCbc(key, initializationVector, &data[0], size);
+    }
+}
+
+void Decrypt::EncryptCbc(const BF_KEY& key, uint64_t& initializationVector,
+    void *pVoidData, size_t dataSize)
+{
+    char *pData = reinterpret_cast<char*>(pVoidData);
+    uint64_t previousBlock = initializationVector;
 
     // Encrypt each full block.
-    while(BLOWFISH_BLOCK_SIZE <= size)
+    while(BLOWFISH_BLOCK_SIZE <= dataSize)
     {
-        uint64_t unencryptedBlock = *reinterpret_cast<uint64_t*>(pData);
-        uint64_t encryptedBlock = unencryptedBlock ^ previousBlock;
+        uint64_t encryptedBlock;
+        memcpy(&encryptedBlock, pData, sizeof(encryptedBlock));
+
+        encryptedBlock ^= previousBlock;
 
         BF_encrypt(reinterpret_cast<BF_LONG*>(&encryptedBlock), &key);
 
-        // Save the data back into the vector.
-        *reinterpret_cast<uint64_t*>(pData) = encryptedBlock;
+        // Save the data back into the buffer.
+        memcpy(pData, &encryptedBlock, sizeof(encryptedBlock));
 
         pData += BLOWFISH_BLOCK_SIZE;
-        size -= BLOWFISH_BLOCK_SIZE;
+        dataSize -= BLOWFISH_BLOCK_SIZE;
 
         // Save this for the next round.
         previousBlock = encryptedBlock;
@@ -572,31 +783,11 @@ void Decrypt::DecryptCbc(const BF_KEY& key, uint64_t& initializationVector,
     std::vector<char>& data, std::vector<char>::size_type realSize)
 {
     std::vector<char>::size_type size = data.size();
-    uint64_t previousBlock = initializationVector;
-    char *pData = &data[0];
 
-    if((0 == realSize || realSize <= size) &&
+    if(0 < size && (0 == realSize || realSize <= size) &&
         0 == (size % BLOWFISH_BLOCK_SIZE))
     {
-        // Decrypt each full block.
-        while(BLOWFISH_BLOCK_SIZE <= size)
-        {
-            uint64_t encryptedBlock = *reinterpret_cast<uint64_t*>(pData);
-            uint64_t unencryptedBlock = encryptedBlock;
-
-            BF_decrypt(reinterpret_cast<BF_LONG*>(&unencryptedBlock), &key);
-
-            unencryptedBlock ^= previousBlock;
-
-            // Save the data back into the vector.
-            *reinterpret_cast<uint64_t*>(pData) = unencryptedBlock;
-
-            pData += BLOWFISH_BLOCK_SIZE;
-            size -= BLOWFISH_BLOCK_SIZE;
-
-            // Save this for the next round.
-            previousBlock = encryptedBlock;
-        }
+        DecryptCbc(key, initializationVector, &data[0], size);
     }
 
     // Resize the data if requested.
@@ -604,6 +795,35 @@ void Decrypt::DecryptCbc(const BF_KEY& key, uint64_t& initializationVector,
     {
         data.resize(realSize);
     }
+}
+
+void Decrypt::DecryptCbc(const BF_KEY& key, uint64_t& initializationVector,
+    void *pVoidData, size_t dataSize)
+{
+    char *pData = reinterpret_cast<char*>(pVoidData);
+    uint64_t previousBlock = initializationVector;
+
+    // Decrypt each full block.
+    while(BLOWFISH_BLOCK_SIZE <= dataSize)
+    {
+        uint64_t encryptedBlock;
+        memcpy(&encryptedBlock, pData, sizeof(encryptedBlock));
+
+        uint64_t unencryptedBlock = encryptedBlock;
+
+        BF_decrypt(reinterpret_cast<BF_LONG*>(&unencryptedBlock), &key);
+
+        unencryptedBlock ^= previousBlock;
+
+        // Save the data back into the buffer.
+        memcpy(pData, &unencryptedBlock, sizeof(unencryptedBlock));
+
+        pData += BLOWFISH_BLOCK_SIZE;
+        dataSize -= BLOWFISH_BLOCK_SIZE;
+
+        // Save this for the next round.
+        previousBlock = encryptedBlock;
+    }
 
     // Save the vector used so one may call this function again.
     initializationVector = previousBlock;
@@ -620,6 +840,8 @@ void Decrypt::DecryptCbc(std::vector<char>& data,
 
 void Decrypt::EncryptPacket(const BF_KEY& key, Packet& packet)
 {
+    TRACE_SCOPE("encrypt");
+
     uint32_t realSize = packet.Size() - 2 * sizeof(uint32_t);
 
     // Write the real size.
@@ -653,6 +875,8 @@ void Decrypt::EncryptPacket(const BF_KEY& key, Packet& packet)
 
 void Decrypt::DecryptPacket(const BF_KEY& key, Packet& packet)
 {
+    TRACE_SCOPE("decrypt");
+
     // The packet must have at least one block and the sizes.
     if((2 * sizeof(uint32_t) + BLOWFISH_BLOCK_SIZE) <= packet.Size())
     {
@@ -662,6 +886,12 @@ void Decrypt::DecryptPacket(const BF_KEY& key, Packet& packet)
         // Get the padded size of the packet.
         uint32_t paddedSize = packet.ReadU32Big();
 
+        // Never decrypt past the end of the packet.
+        if((2 * sizeof(uint32_t) + paddedSize) > packet.Size())
+        {
+            return;
+        }
+
         // Determine the start of the data to decrypt.
         char *pData = packet.Data();
         pData += 2 * sizeof(uint32_t);
@@ -28,6 +28,7 @@
 #define LIBCOMP_SRC_DECRYPT_H
 
 /// libcomp Includes
+#include "Constants.h"
 #include "String.h"
 
 #include "PushIgnore.h"
@@ -36,6 +37,7 @@
 
 #include <stdint.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -64,6 +66,21 @@ namespace Decrypt
  */
 std::vector<char> DecryptFile(const std::string& path);
 
+/**
+ * @brief Decrypt a file in chunks. Only one chunk of the file is held in
+ * memory at a time so this is the way to handle big files.
+ * @param path Path to the file to be decrypted.
+ * @param sink Called with each chunk of decrypted data in order. Return
+ *   false to stop decrypting.
+ * @param chunkSize Number of bytes to read and decrypt at a time.
+ * @retval true The whole file was decrypted and passed to the sink.
+ * @retval false The file could not be decrypted or the sink stopped.
+ * @sa Decrypt::EncryptFile
+ */
+bool DecryptFile(const std::string& path, const std::function<bool(
+    const char *pData, size_t size)>& sink,
+    size_t chunkSize = FILE_CHUNK_SIZE);
+
 /**
  * Encrypt a file from a buffer.
  * @param Path to the file to be written to.
@@ -77,6 +94,22 @@ std::vector<char> DecryptFile(const std::string& path);
  */
 bool EncryptFile(const std::string& path, const std::vector<char>& data);
 
+/**
+ * Encrypt a file in chunks. Only one chunk is held in memory at a time.
+ * @param path Path to the file to be written to.
+ * @param source Called to fill the buffer with up to @em size bytes of the
+ *   next data to encrypt. Returns the number of bytes it wrote; anything
+ *   less than @em size means the data ended.
+ * @param originalSize Number of bytes the source will provide.
+ * @param chunkSize Number of bytes to encrypt and write at a time.
+ * @retval true File was encrypted.
+ * @retval false File was not encrypted.
+ * @sa Decrypt::DecryptFile
+ */
+bool EncryptFile(const std::string& path, const std::function<size_t(
+    char *pData, size_t size)>& source, uint32_t originalSize,
+    size_t chunkSize = FILE_CHUNK_SIZE);
+
 /**
  * Load a file into a buffer
  * @param path Path to the file to be loaded.
@@ -97,6 +130,16 @@ std::vector<char> LoadFile(const std::string& path, int requestedSize = -1);
  */
 String GenerateRandom(int sz = -1);
 
+/**
+ * Generates a random lower-case hex token to identify a web login session.
+ * Each thread keeps a buffer of random bytes read from the OS in one large
+ * block so most calls do not touch the OS at all.
+ *
+ * @param digits Number of hex digits to generate (must be even).
+ * @returns The random token or an empty string if an error occured.
+ */
+String GenerateSessionToken(size_t digits);
+
 /**
  * Generates a random value. This value is used to identify a login session
  * when passing an authenticated user from the lobby server to the
@@ -179,6 +222,18 @@ void Decrypt(std::vector<char>& data,
 void EncryptCbc(const BF_KEY& key, uint64_t& initializationVector,
     std::vector<char>& data);
 
+/**
+ * Encrypt a data buffer in place with Blowfish and Cipher Block Chaining
+ * (CBC). Calls may be chained over consecutive chunks of the same data.
+ * @param key Blowfish key to encrypt with.
+ * @param initializationVector Initial value to feed into the CBC algorithm.
+ *   On return this holds the value to continue with for the next chunk.
+ * @param pData Data to be encrypted.
+ * @param dataSize Size of the data (a multiple of BLOWFISH_BLOCK_SIZE).
+ */
+void EncryptCbc(const BF_KEY& key, uint64_t& initializationVector,
+    void *pData, size_t dataSize);
+
 /**
  * Encrypt a data buffer with the default Blowfish key and Cipher Block
  * Chaining (CBC) initialization vector (IV).
@@ -199,6 +254,18 @@ void EncryptCbc(std::vector<char>& data);
 void DecryptCbc(const BF_KEY& key, uint64_t& initializationVector,
     std::vector<char>& data, std::vector<char>::size_type realSize = 0);
 
+/**
+ * Decrypt a data buffer in place with Blowfish and Cipher Block Chaining
+ * (CBC). Calls may be chained over consecutive chunks of the same data.
+ * @param key Blowfish key to decrypt with.
+ * @param initializationVector Initial value to feed into the CBC algorithm.
+ *   On return this holds the value to continue with for the next chunk.
+ * @param pData Data to be decrypted.
+ * @param dataSize Size of the data (a multiple of BLOWFISH_BLOCK_SIZE).
+ */
+void DecryptCbc(const BF_KEY& key, uint64_t& initializationVector,
+    void *pData, size_t dataSize);
+
 /**
  * Decrypt a data buffer with the default Blowfish key and Cipher Block
  * Chaining (CBC) initialization vector (IV).
@@ -0,0 +1,161 @@
+/**
+ * @file libcomp/src/DiffieHellmanCache.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Cache of pre-generated Diffie-Hellman key pairs.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DiffieHellmanCache.h"
+
+// libcomp Includes
+#include "Constants.h"
+#include "Log.h"
+#include "TcpServer.h"
+
+// Standard C++11 Includes
+#include <chrono>
+
+using namespace libcomp;
+
+DiffieHellmanCache::DiffieHellmanCache(const DH *pDiffieHellman,
+    size_t size) : mDiffieHellman(TcpServer::CopyDiffieHellman(
+    pDiffieHellman)), mSize(size), mRunning(true), mMisses(0)
+{
+    mThread = std::thread([this]()
+    {
+        Refill();
+    });
+}
+
+DiffieHellmanCache::~DiffieHellmanCache()
+{
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        mRunning = false;
+    }
+
+    mCondition.notify_all();
+    mThread.join();
+
+    for(auto pKey : mKeys)
+    {
+        DH_free(pKey);
+    }
+
+    if(nullptr != mDiffieHellman)
+    {
+        DH_free(mDiffieHellman);
+    }
+}
+
+DH* DiffieHellmanCache::Take()
+{
+    DH *pKey = nullptr;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        if(!mKeys.empty())
+        {
+            pKey = mKeys.front();
+            mKeys.pop_front();
+        }
+        else
+        {
+            mMisses++;
+        }
+    }
+
+    // Wake the refill thread.
+    mCondition.notify_one();
+
+    if(nullptr == pKey)
+    {
+        pKey = TcpServer::CopyDiffieHellman(mDiffieHellman);
+    }
+
+    return pKey;
+}
+
+size_t DiffieHellmanCache::Available() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mKeys.size();
+}
+
+uint64_t DiffieHellmanCache::GetMisses() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mMisses;
+}
+
+void DiffieHellmanCache::Refill()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while(mRunning && nullptr != mDiffieHellman)
+    {
+        mCondition.wait(lock, [this]()
+        {
+            return !mRunning || mKeys.size() < mSize;
+        });
+
+        if(!mRunning)
+        {
+            break;
+        }
+
+        lock.unlock();
+
+        // Generate the key pair outside of the lock.
+        DH *pKey = TcpServer::CopyDiffieHellman(mDiffieHellman);
+
+        if(nullptr != pKey && 1 != DH_generate_key(pKey))
+        {
+            DH_free(pKey);
+            pKey = nullptr;
+        }
+
+        lock.lock();
+
+        if(nullptr == pKey)
+        {
+            LOG_ERROR("Failed to generate a Diffie-Hellman key pair; "
+                "trying again.\n");
+
+            // Keep the thread alive so the cache is refilled once key
+            // generation works again.
+            mCondition.wait_for(lock, std::chrono::milliseconds(
+                DH_KEY_RETRY_DELAY), [this]()
+            {
+                return !mRunning;
+            });
+
+            continue;
+        }
+
+        mKeys.push_back(pKey);
+    }
+}
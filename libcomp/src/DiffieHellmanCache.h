@@ -0,0 +1,101 @@
+/**
+ * @file libcomp/src/DiffieHellmanCache.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Cache of pre-generated Diffie-Hellman key pairs.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_DIFFIEHELLMANCACHE_H
+#define LIBCOMP_SRC_DIFFIEHELLMANCACHE_H
+
+// Standard C++11 Includes
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include <stdint.h>
+
+// OpenSSL Includes
+#include <openssl/dh.h>
+
+namespace libcomp
+{
+
+/**
+ * Keeps a number of server key pairs (DH_generate_key) for one prime ready
+ * so a new connection does not have to generate one. A background thread
+ * refills the cache as keys are taken. Each key pair is handed out once.
+ */
+class DiffieHellmanCache
+{
+public:
+    /**
+     * Create the cache and start the refill thread.
+     * @param pDiffieHellman Prime and base to generate keys for (copied).
+     * @param size Number of key pairs to keep ready.
+     */
+    DiffieHellmanCache(const DH *pDiffieHellman, size_t size);
+
+    /**
+     * Stop the refill thread and free the unused key pairs.
+     */
+    ~DiffieHellmanCache();
+
+    /**
+     * Take a key pair from the cache. If the cache is empty a copy of the
+     * prime and base without a key pair is returned instead (the key will
+     * then be generated during the handshake).
+     * @returns Diffie-Hellman object the caller must free or nullptr on
+     * error.
+     */
+    DH* Take();
+
+    /**
+     * Get the number of key pairs ready to be taken.
+     * @returns Number of key pairs in the cache.
+     */
+    size_t Available() const;
+
+    /**
+     * Get the number of times @ref Take found the cache empty.
+     * @returns Number of cache misses.
+     */
+    uint64_t GetMisses() const;
+
+private:
+    void Refill();
+
+    DH *mDiffieHellman;
+    size_t mSize;
+    bool mRunning;
+    uint64_t mMisses;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCondition;
+    std::list<DH*> mKeys;
+    std::thread mThread;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_DIFFIEHELLMANCACHE_H
@@ -0,0 +1,315 @@
+/**
+ * @file libcomp/src/GroupRegistry.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Registry of the connections in each party, clan and team.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GroupRegistry.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+
+using namespace libcomp;
+
+namespace
+{
+
+/**
+ * @internal
+ * Job that sends a packet to the members of a group that run on one
+ * io_service. It holds the member array and a shallow copy of the packet
+ * so posting it does not allocate anything per recipient.
+ */
+class GroupSend
+{
+public:
+    GroupSend(const GroupRegistry::Members_t& members, size_t owner,
+        const ReadOnlyPacket& packet, const TcpConnection *pExclude,
+        TcpConnection::SendPriority_t priority) : mMembers(members),
+        mOwner(owner), mPacket(packet), mExclude(pExclude),
+        mPriority(priority)
+    {
+    }
+
+    void operator()()
+    {
+        const GroupOwner_t& owner = mMembers->owners[mOwner];
+
+        for(size_t i = owner.first; i < owner.first + owner.count; ++i)
+        {
+            const std::shared_ptr<TcpConnection>& member =
+                mMembers->connections[i];
+
+            if(mExclude != member.get())
+            {
+                // Shallow copy; SendPacket() takes this one.
+                ReadOnlyPacket copy(mPacket);
+
+                (void)member->SendPacket(copy, mPriority);
+            }
+        }
+    }
+
+private:
+    GroupRegistry::Members_t mMembers;
+    size_t mOwner;
+    ReadOnlyPacket mPacket;
+    const TcpConnection *mExclude;
+    TcpConnection::SendPriority_t mPriority;
+};
+
+} // namespace
+
+GroupRegistry::GroupRegistry() : mVersion(0)
+{
+}
+
+bool GroupRegistry::Join(uint8_t kind, uint32_t groupID,
+    const std::shared_ptr<TcpConnection>& connection)
+{
+    if(nullptr == connection)
+    {
+        return false;
+    }
+
+    uint64_t key = MakeKey(kind, groupID);
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    std::vector<std::shared_ptr<TcpConnection>> connections;
+
+    auto it = mGroups.find(key);
+
+    if(mGroups.end() != it)
+    {
+        connections = it->second->connections;
+
+        if(connections.end() != std::find(connections.begin(),
+            connections.end(), connection))
+        {
+            return false;
+        }
+    }
+
+    connections.push_back(connection);
+
+    mGroups[key] = MakeMembers(connections);
+    mMemberships[connection.get()].push_back(key);
+
+    return true;
+}
+
+bool GroupRegistry::Leave(uint8_t kind, uint32_t groupID,
+    const TcpConnection *pConnection)
+{
+    uint64_t key = MakeKey(kind, groupID);
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(!Remove(key, pConnection))
+    {
+        return false;
+    }
+
+    auto it = mMemberships.find(pConnection);
+
+    if(mMemberships.end() != it)
+    {
+        std::vector<uint64_t>& keys = it->second;
+
+        keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+
+        if(keys.empty())
+        {
+            mMemberships.erase(it);
+        }
+    }
+
+    return true;
+}
+
+size_t GroupRegistry::LeaveAll(const TcpConnection *pConnection)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mMemberships.find(pConnection);
+
+    if(mMemberships.end() == it)
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+
+    for(uint64_t key : it->second)
+    {
+        if(Remove(key, pConnection))
+        {
+            count++;
+        }
+    }
+
+    mMemberships.erase(it);
+
+    return count;
+}
+
+GroupRegistry::Members_t GroupRegistry::GetMembers(uint8_t kind,
+    uint32_t groupID) const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mGroups.find(MakeKey(kind, groupID));
+
+    return mGroups.end() != it ? it->second : nullptr;
+}
+
+size_t GroupRegistry::Broadcast(uint8_t kind, uint32_t groupID,
+    ReadOnlyPacket& packet, const TcpConnection *pExclude,
+    TcpConnection::SendPriority_t priority) const
+{
+    // Only the lookup is done under the lock.
+    return Broadcast(GetMembers(kind, groupID), packet, pExclude, priority);
+}
+
+size_t GroupRegistry::Broadcast(const Members_t& members,
+    ReadOnlyPacket& packet, const TcpConnection *pExclude,
+    TcpConnection::SendPriority_t priority)
+{
+    if(nullptr == members)
+    {
+        return 0;
+    }
+
+    size_t count = members->connections.size();
+
+    for(auto& member : members->connections)
+    {
+        if(pExclude == member.get())
+        {
+            count--;
+        }
+    }
+
+    for(size_t i = 0; i < members->owners.size(); ++i)
+    {
+        members->owners[i].pService->post(GroupSend(members, i, packet,
+            pExclude, priority));
+    }
+
+    return count;
+}
+
+size_t GroupRegistry::Count() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mGroups.size();
+}
+
+uint64_t GroupRegistry::MakeKey(uint8_t kind, uint32_t groupID)
+{
+    return ((uint64_t)kind << 32) | groupID;
+}
+
+GroupRegistry::Members_t GroupRegistry::MakeMembers(const std::vector<
+    std::shared_ptr<TcpConnection>>& connections)
+{
+    std::shared_ptr<GroupMembers_t> members(new GroupMembers_t);
+    members->version = ++mVersion;
+    members->connections.reserve(connections.size());
+
+    // There are only as many owners as there are io threads so a linear
+    // search is fine.
+    std::vector<asio::io_service*> services;
+
+    for(auto& connection : connections)
+    {
+        asio::io_service *pService = &connection->GetIoService();
+
+        if(services.end() == std::find(services.begin(), services.end(),
+            pService))
+        {
+            services.push_back(pService);
+        }
+    }
+
+    for(auto pService : services)
+    {
+        GroupOwner_t owner;
+        owner.pService = pService;
+        owner.first = members->connections.size();
+
+        for(auto& connection : connections)
+        {
+            if(pService == &connection->GetIoService())
+            {
+                members->connections.push_back(connection);
+            }
+        }
+
+        owner.count = members->connections.size() - owner.first;
+
+        members->owners.push_back(owner);
+    }
+
+    return members;
+}
+
+bool GroupRegistry::Remove(uint64_t key, const TcpConnection *pConnection)
+{
+    auto it = mGroups.find(key);
+
+    if(mGroups.end() == it)
+    {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<TcpConnection>> connections;
+    connections.reserve(it->second->connections.size());
+
+    for(auto& connection : it->second->connections)
+    {
+        if(pConnection != connection.get())
+        {
+            connections.push_back(connection);
+        }
+    }
+
+    if(connections.size() == it->second->connections.size())
+    {
+        return false;
+    }
+
+    // A group with no members is forgotten.
+    if(connections.empty())
+    {
+        mGroups.erase(it);
+    }
+    else
+    {
+        it->second = MakeMembers(connections);
+    }
+
+    return true;
+}
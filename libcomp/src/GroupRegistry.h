@@ -0,0 +1,185 @@
+/**
+ * @file libcomp/src/GroupRegistry.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Registry of the connections in each party, clan and team.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_GROUPREGISTRY_H
+#define LIBCOMP_SRC_GROUPREGISTRY_H
+
+// libcomp Includes
+#include "TcpConnection.h"
+
+// Standard C++11 Includes
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Members of one group that share an io_service.
+ */
+typedef struct
+{
+    /// io_service the members run on.
+    asio::io_service *pService;
+
+    /// Index of the first of these members in the member array.
+    size_t first;
+
+    /// Number of these members.
+    size_t count;
+} GroupOwner_t;
+
+/**
+ * Members of a group at one point in time. This never changes once made;
+ * a change to the group makes a new one with a higher version.
+ */
+typedef struct
+{
+    /// Version of the group. Every change gets a higher version.
+    uint64_t version;
+
+    /// Member connections, grouped by the io_service they run on.
+    std::vector<std::shared_ptr<TcpConnection>> connections;
+
+    /// Where the members of each io_service are in @ref connections.
+    std::vector<GroupOwner_t> owners;
+} GroupMembers_t;
+
+/**
+ * Registry of the connections in each group (party, clan or team). Every
+ * group has a flat array of its members that is replaced (copy on write)
+ * when someone joins or leaves, so reading the members only copies one
+ * shared pointer and a broadcast never builds a recipient list. The array
+ * is already split by the io_service of each member so a broadcast posts
+ * one job per io_service without allocating anything per recipient.
+ * Every method may be called from any thread.
+ */
+class GroupRegistry
+{
+public:
+    /// Shared members of a group.
+    typedef std::shared_ptr<const GroupMembers_t> Members_t;
+
+    /**
+     * Create an empty registry.
+     */
+    GroupRegistry();
+
+    /**
+     * Add a connection to a group.
+     * @param kind Kind of group (like @ref CHAT_VISIBILITY_PARTY).
+     * @param groupID ID of the group.
+     * @param connection Connection to add.
+     * @returns true if the connection was added; false if it is already
+     *   in the group.
+     */
+    bool Join(uint8_t kind, uint32_t groupID,
+        const std::shared_ptr<TcpConnection>& connection);
+
+    /**
+     * Remove a connection from a group.
+     * @param kind Kind of group.
+     * @param groupID ID of the group.
+     * @param pConnection Connection to remove.
+     * @returns true if the connection was in the group.
+     */
+    bool Leave(uint8_t kind, uint32_t groupID,
+        const TcpConnection *pConnection);
+
+    /**
+     * Remove a connection from every group (when it closes).
+     * @param pConnection Connection to remove.
+     * @returns Number of groups the connection was removed from.
+     */
+    size_t LeaveAll(const TcpConnection *pConnection);
+
+    /**
+     * Get the members of a group.
+     * @param kind Kind of group.
+     * @param groupID ID of the group.
+     * @returns Members of the group or nullptr if it has none.
+     */
+    Members_t GetMembers(uint8_t kind, uint32_t groupID) const;
+
+    /**
+     * Send a packet to every member of a group.
+     * @param kind Kind of group.
+     * @param groupID ID of the group.
+     * @param packet Packet to send. The packet keeps its data.
+     * @param pExclude Member to leave out (usually the sender).
+     * @param priority What may happen to the packet for a member that is
+     *   not writable.
+     * @returns Number of members the packet is sent to.
+     */
+    size_t Broadcast(uint8_t kind, uint32_t groupID, ReadOnlyPacket& packet,
+        const TcpConnection *pExclude = nullptr,
+        TcpConnection::SendPriority_t priority =
+        TcpConnection::PRIORITY_NORMAL) const;
+
+    /**
+     * Send a packet to the members of a group. Every member shares the one
+     * packet buffer and is sent the packet by the thread that owns it
+     * (like TcpConnection::BroadcastPacket).
+     * @param members Members to send the packet to.
+     * @param packet Packet to send. The packet keeps its data.
+     * @param pExclude Member to leave out (usually the sender).
+     * @param priority What may happen to the packet for a member that is
+     *   not writable.
+     * @returns Number of members the packet is sent to.
+     */
+    static size_t Broadcast(const Members_t& members, ReadOnlyPacket& packet,
+        const TcpConnection *pExclude = nullptr,
+        TcpConnection::SendPriority_t priority =
+        TcpConnection::PRIORITY_NORMAL);
+
+    /**
+     * Get the number of groups with at least one member.
+     * @returns Number of groups.
+     */
+    size_t Count() const;
+
+private:
+    static uint64_t MakeKey(uint8_t kind, uint32_t groupID);
+
+    Members_t MakeMembers(const std::vector<std::shared_ptr<
+        TcpConnection>>& connections);
+
+    bool Remove(uint64_t key, const TcpConnection *pConnection);
+
+    mutable std::mutex mLock;
+    std::unordered_map<uint64_t, Members_t> mGroups;
+    std::unordered_map<const TcpConnection*,
+        std::vector<uint64_t>> mMemberships;
+    uint64_t mVersion;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_GROUPREGISTRY_H
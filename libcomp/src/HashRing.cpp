@@ -0,0 +1,193 @@
+/**
+ * @file libcomp/src/HashRing.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Consistent hash ring that assigns keys to nodes.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HashRing.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+
+using namespace libcomp;
+
+HashRing::HashRing(size_t virtualNodes) :
+    mVirtualNodes(0 < virtualNodes ? virtualNodes : 1)
+{
+}
+
+void HashRing::AddNode(const String& node)
+{
+    if(HasNode(node))
+    {
+        return;
+    }
+
+    size_t index = mNodes.size();
+    mNodes.push_back(node);
+
+    for(size_t i = 0; i < mVirtualNodes; ++i)
+    {
+        String point = String("%1#%2").Arg(node).Arg(i);
+
+        mPoints.push_back(Point_t(Hash(point.C(), point.Size()), index));
+    }
+
+    // Break ties by name so every process builds the same ring no matter
+    // what order the nodes were added in.
+    std::sort(mPoints.begin(), mPoints.end(), [this](const Point_t& a,
+        const Point_t& b)
+    {
+        if(a.first != b.first)
+        {
+            return a.first < b.first;
+        }
+
+        return mNodes[a.second].ToUtf8() < mNodes[b.second].ToUtf8();
+    });
+}
+
+bool HashRing::RemoveNode(const String& node)
+{
+    auto it = std::find(mNodes.begin(), mNodes.end(), node);
+
+    if(mNodes.end() == it)
+    {
+        return false;
+    }
+
+    size_t index = (size_t)(it - mNodes.begin());
+    mNodes.erase(it);
+
+    // The other points keep their order; only the indices after the
+    // removed node shift down.
+    mPoints.erase(std::remove_if(mPoints.begin(), mPoints.end(),
+        [index](const Point_t& point)
+        {
+            return point.second == index;
+        }), mPoints.end());
+
+    for(auto& point : mPoints)
+    {
+        if(point.second > index)
+        {
+            point.second--;
+        }
+    }
+
+    return true;
+}
+
+bool HashRing::HasNode(const String& node) const
+{
+    return mNodes.end() != std::find(mNodes.begin(), mNodes.end(), node);
+}
+
+size_t HashRing::GetNodeCount() const
+{
+    return mNodes.size();
+}
+
+size_t HashRing::FindPoint(const String& key) const
+{
+    uint64_t hash = Hash(key.C(), key.Size());
+
+    auto it = std::lower_bound(mPoints.begin(), mPoints.end(), hash,
+        [](const Point_t& point, uint64_t value)
+        {
+            return point.first < value;
+        });
+
+    // Past the last point the ring wraps around to the first.
+    return mPoints.end() == it ? 0 : (size_t)(it - mPoints.begin());
+}
+
+String HashRing::GetNode(const String& key) const
+{
+    if(mPoints.empty())
+    {
+        return String();
+    }
+
+    return mNodes[mPoints[FindPoint(key)].second];
+}
+
+std::vector<String> HashRing::GetNodes(const String& key, size_t count) const
+{
+    std::vector<String> nodes;
+
+    if(mPoints.empty())
+    {
+        return nodes;
+    }
+
+    if(count > mNodes.size())
+    {
+        count = mNodes.size();
+    }
+
+    std::vector<bool> seen(mNodes.size(), false);
+    size_t point = FindPoint(key);
+
+    for(size_t i = 0; i < mPoints.size() && nodes.size() < count; ++i)
+    {
+        size_t index = mPoints[(point + i) % mPoints.size()].second;
+
+        if(!seen[index])
+        {
+            seen[index] = true;
+            nodes.push_back(mNodes[index]);
+        }
+    }
+
+    return nodes;
+}
+
+bool HashRing::IsOwner(const String& key, const String& node) const
+{
+    return !mPoints.empty() && node == GetNode(key);
+}
+
+uint64_t HashRing::Hash(const void *pData, size_t size)
+{
+    const uint8_t *pBytes = reinterpret_cast<const uint8_t*>(pData);
+
+    // 64-bit FNV-1a.
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= pBytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    // FNV leaves similar keys (like the virtual points of a node) close
+    // together so finish with a mix that spreads them over the ring.
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
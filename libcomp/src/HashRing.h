@@ -0,0 +1,136 @@
+/**
+ * @file libcomp/src/HashRing.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Consistent hash ring that assigns keys to nodes.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_HASHRING_H
+#define LIBCOMP_SRC_HASHRING_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "String.h"
+
+// Standard C++11 Includes
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Consistent hash ring that decides which node owns a key (an account, a
+ * session ID and so on). Every node is hashed onto the ring at a number of
+ * virtual points and a key belongs to the first point at or after its own
+ * hash. Adding a node only takes keys from the points it lands next to and
+ * removing one only moves its own keys to the following points, so about
+ * 1/N of the keys move instead of nearly all of them like with a modulo.
+ * Every process that builds a ring from the same node names agrees on the
+ * owner of each key. The ring is not thread-safe; lock around it if it is
+ * changed while other threads look keys up.
+ */
+class HashRing
+{
+public:
+    /**
+     * Create an empty ring.
+     * @param virtualNodes Number of points each node gets on the ring.
+     */
+    explicit HashRing(size_t virtualNodes = HASH_RING_VIRTUAL_NODES);
+
+    /**
+     * Add a node. Adding a node that is already on the ring does nothing.
+     * @param node Name of the node (for example "world1:10667").
+     */
+    void AddNode(const String& node);
+
+    /**
+     * Remove a node.
+     * @param node Name of the node.
+     * @returns true if the node was on the ring.
+     */
+    bool RemoveNode(const String& node);
+
+    /**
+     * Check if a node is on the ring.
+     * @param node Name of the node.
+     * @returns true if the node was added.
+     */
+    bool HasNode(const String& node) const;
+
+    /**
+     * Get the number of nodes on the ring.
+     * @returns Number of nodes.
+     */
+    size_t GetNodeCount() const;
+
+    /**
+     * Get the node that owns a key.
+     * @param key Key to look up.
+     * @returns Name of the owner or an empty string if the ring is empty.
+     */
+    String GetNode(const String& key) const;
+
+    /**
+     * Get the owner of a key followed by the nodes that take over the key if
+     * the ones before them are gone (in ring order, each node once). Use
+     * this to skip a node that is down without moving any other key.
+     * @param key Key to look up.
+     * @param count Maximum number of nodes to return.
+     * @returns Up to @em count different nodes.
+     */
+    std::vector<String> GetNodes(const String& key, size_t count) const;
+
+    /**
+     * Check if a node owns a key.
+     * @param key Key to look up.
+     * @param node Name of the node.
+     * @returns true if @em node is the owner of @em key.
+     */
+    bool IsOwner(const String& key, const String& node) const;
+
+    /**
+     * Hash a key (or a virtual point) onto the ring. The hash is the same in
+     * every process and on every platform.
+     * @param pData Data to hash.
+     * @param size Number of bytes to hash.
+     * @returns Position on the ring.
+     */
+    static uint64_t Hash(const void *pData, size_t size);
+
+private:
+    /// Point on the ring and the index of the node it belongs to.
+    typedef std::pair<uint64_t, size_t> Point_t;
+
+    size_t FindPoint(const String& key) const;
+
+    size_t mVirtualNodes;
+    std::vector<String> mNodes;
+    std::vector<Point_t> mPoints;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_HASHRING_H
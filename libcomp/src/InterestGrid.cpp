@@ -0,0 +1,321 @@
+/**
+ * @file libcomp/src/InterestGrid.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Index of which connections are near a position in a zone.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InterestGrid.h"
+
+// Standard C++11 Includes
+#include <cmath>
+#include <limits>
+
+using namespace libcomp;
+
+InterestGrid::InterestGrid(float cellSize) : mCellSize(0.0f < cellSize ?
+    cellSize : INTEREST_CELL_SIZE)
+{
+}
+
+bool InterestGrid::Update(const std::shared_ptr<TcpConnection>& connection,
+    uint32_t zoneID, float x, float y)
+{
+    if(nullptr == connection || std::isnan(x) || std::isnan(y))
+    {
+        return false;
+    }
+
+    uint64_t cell = GetCell(x, y);
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mEntries.find(connection.get());
+
+    if(mEntries.end() == it)
+    {
+        Entry& entry = mEntries[connection.get()];
+        entry.connection = connection;
+        entry.zoneID = zoneID;
+        entry.cell = cell;
+        entry.x = x;
+        entry.y = y;
+
+        Link(&entry);
+
+        return true;
+    }
+
+    Entry& entry = it->second;
+
+    // Most moves stay in the same cell.
+    if(entry.zoneID != zoneID || entry.cell != cell)
+    {
+        Unlink(&entry);
+
+        entry.zoneID = zoneID;
+        entry.cell = cell;
+
+        Link(&entry);
+    }
+
+    entry.x = x;
+    entry.y = y;
+
+    return true;
+}
+
+bool InterestGrid::Remove(const TcpConnection *pConnection)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mEntries.find(pConnection);
+
+    if(mEntries.end() == it)
+    {
+        return false;
+    }
+
+    Unlink(&it->second);
+
+    mEntries.erase(it);
+
+    return true;
+}
+
+size_t InterestGrid::GetInRange(uint32_t zoneID, float x, float y,
+    float range, ConnectionList_t& recipients,
+    const TcpConnection *pExclude) const
+{
+    if(!(0.0f <= range) || std::isnan(x) || std::isnan(y))
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto zone = mZones.find(zoneID);
+
+    if(mZones.end() == zone)
+    {
+        return 0;
+    }
+
+    const Zone_t& cells = zone->second;
+
+    size_t count = 0;
+    float rangeSquared = range * range;
+
+    auto addCell = [&](const std::vector<Entry*>& entries)
+    {
+        for(auto pEntry : entries)
+        {
+            float dx = pEntry->x - x;
+            float dy = pEntry->y - y;
+
+            if(rangeSquared >= dx * dx + dy * dy &&
+                pExclude != pEntry->connection.get())
+            {
+                recipients.push_back(pEntry->connection);
+                count++;
+            }
+        }
+    };
+
+    int64_t left = GetCellIndex(x - range);
+    int64_t right = GetCellIndex(x + range);
+    int64_t top = GetCellIndex(y - range);
+    int64_t bottom = GetCellIndex(y + range);
+
+    // A range wider than the occupied part of the zone is cheaper to check
+    // one occupied cell at a time.
+    uint64_t width = (uint64_t)(right - left + 1);
+    uint64_t height = (uint64_t)(bottom - top + 1);
+
+    if(width > cells.size() || height > cells.size() ||
+        width * height > cells.size())
+    {
+        for(auto& cell : cells)
+        {
+            addCell(cell.second);
+        }
+
+        return count;
+    }
+
+    for(int64_t cellX = left; cellX <= right; ++cellX)
+    {
+        for(int64_t cellY = top; cellY <= bottom; ++cellY)
+        {
+            auto cell = cells.find(((uint64_t)(uint32_t)cellX << 32) |
+                (uint64_t)(uint32_t)cellY);
+
+            if(cells.end() != cell)
+            {
+                addCell(cell->second);
+            }
+        }
+    }
+
+    return count;
+}
+
+size_t InterestGrid::GetInZone(uint32_t zoneID, ConnectionList_t& recipients,
+    const TcpConnection *pExclude) const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto zone = mZones.find(zoneID);
+
+    if(mZones.end() == zone)
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+
+    for(auto& cell : zone->second)
+    {
+        for(auto pEntry : cell.second)
+        {
+            if(pExclude != pEntry->connection.get())
+            {
+                recipients.push_back(pEntry->connection);
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+size_t InterestGrid::BroadcastInRange(uint32_t zoneID, float x, float y,
+    float range, ReadOnlyPacket& packet, const TcpConnection *pExclude,
+    TcpConnection::SendPriority_t priority) const
+{
+    ConnectionList_t recipients;
+
+    size_t count = GetInRange(zoneID, x, y, range, recipients, pExclude);
+
+    // Sent after the lock is released; the connections are still held by
+    // the list.
+    if(0 < count)
+    {
+        TcpConnection::BroadcastPacket(recipients, packet, priority);
+    }
+
+    return count;
+}
+
+bool InterestGrid::GetPosition(const TcpConnection *pConnection,
+    uint32_t& zoneID, float& x, float& y) const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mEntries.find(pConnection);
+
+    if(mEntries.end() == it)
+    {
+        return false;
+    }
+
+    zoneID = it->second.zoneID;
+    x = it->second.x;
+    y = it->second.y;
+
+    return true;
+}
+
+size_t InterestGrid::Count() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mEntries.size();
+}
+
+size_t InterestGrid::Count(uint32_t zoneID) const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mZoneCounts.find(zoneID);
+
+    return mZoneCounts.end() != it ? it->second : 0;
+}
+
+uint64_t InterestGrid::GetCell(float x, float y) const
+{
+    return ((uint64_t)(uint32_t)GetCellIndex(x) << 32) |
+        (uint64_t)(uint32_t)GetCellIndex(y);
+}
+
+int32_t InterestGrid::GetCellIndex(float position) const
+{
+    float index = std::floor(position / mCellSize);
+
+    // Positions past the edge of the index range share the edge cell.
+    if((float)std::numeric_limits<int32_t>::max() <= index)
+    {
+        return std::numeric_limits<int32_t>::max();
+    }
+    else if((float)std::numeric_limits<int32_t>::min() >= index)
+    {
+        return std::numeric_limits<int32_t>::min();
+    }
+
+    return (int32_t)index;
+}
+
+void InterestGrid::Link(Entry *pEntry)
+{
+    std::vector<Entry*>& cell = mZones[pEntry->zoneID][pEntry->cell];
+
+    pEntry->index = cell.size();
+    cell.push_back(pEntry);
+
+    mZoneCounts[pEntry->zoneID]++;
+}
+
+void InterestGrid::Unlink(Entry *pEntry)
+{
+    auto zone = mZones.find(pEntry->zoneID);
+    auto cell = zone->second.find(pEntry->cell);
+
+    std::vector<Entry*>& entries = cell->second;
+
+    // Swap the last entry into the hole so removal is O(1).
+    Entry *pLast = entries.back();
+    entries[pEntry->index] = pLast;
+    pLast->index = pEntry->index;
+    entries.pop_back();
+
+    if(entries.empty())
+    {
+        zone->second.erase(cell);
+    }
+
+    // The last connection to leave takes the zone with it.
+    if(0 == --mZoneCounts[pEntry->zoneID])
+    {
+        mZoneCounts.erase(pEntry->zoneID);
+        mZones.erase(zone);
+    }
+}
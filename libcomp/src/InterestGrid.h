@@ -0,0 +1,189 @@
+/**
+ * @file libcomp/src/InterestGrid.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Index of which connections are near a position in a zone.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_INTERESTGRID_H
+#define LIBCOMP_SRC_INTERESTGRID_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "TcpConnection.h"
+
+// Standard C++11 Includes
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Index of where each connection is so range limited messages (range chat,
+ * movement and the like) only look at the connections near the sender.
+ * Every zone is split into square cells of the same size and each cell
+ * lists the connections in it. A connection changes cell as it moves so a
+ * query only visits the cells that overlap its range; the time taken
+ * depends on how many connections are nearby, not how many are in the
+ * zone. The recipients are returned in the list taken by
+ * TcpConnection::BroadcastPacket so they share one packet buffer.
+ *
+ * A connection is held until it is removed so it must be removed when it
+ * leaves the zone or closes. Every method may be called from any thread.
+ */
+class InterestGrid
+{
+public:
+    /// List of connections as taken by TcpConnection::BroadcastPacket.
+    typedef std::list<std::shared_ptr<TcpConnection>> ConnectionList_t;
+
+    /**
+     * Create an empty grid.
+     * @param cellSize Width and height of each cell (in zone units). This
+     *   should be about the range of the most common query.
+     */
+    explicit InterestGrid(float cellSize = INTEREST_CELL_SIZE);
+
+    /**
+     * Add a connection or move it (to another zone if needed).
+     * @param connection Connection to place.
+     * @param zoneID Zone the connection is in.
+     * @param x X position in the zone.
+     * @param y Y position in the zone.
+     * @returns true if the connection was placed.
+     */
+    bool Update(const std::shared_ptr<TcpConnection>& connection,
+        uint32_t zoneID, float x, float y);
+
+    /**
+     * Remove a connection.
+     * @param pConnection Connection to remove.
+     * @returns true if the connection was in the grid.
+     */
+    bool Remove(const TcpConnection *pConnection);
+
+    /**
+     * Get the connections within a range of a position.
+     * @param zoneID Zone to look in.
+     * @param x X position in the zone.
+     * @param y Y position in the zone.
+     * @param range Maximum distance from the position.
+     * @param recipients Connections in range are added to this list.
+     * @param pExclude Connection to leave out (usually the sender).
+     * @returns Number of connections added.
+     */
+    size_t GetInRange(uint32_t zoneID, float x, float y, float range,
+        ConnectionList_t& recipients,
+        const TcpConnection *pExclude = nullptr) const;
+
+    /**
+     * Get every connection in a zone.
+     * @param zoneID Zone to look in.
+     * @param recipients Connections in the zone are added to this list.
+     * @param pExclude Connection to leave out (usually the sender).
+     * @returns Number of connections added.
+     */
+    size_t GetInZone(uint32_t zoneID, ConnectionList_t& recipients,
+        const TcpConnection *pExclude = nullptr) const;
+
+    /**
+     * Send a packet to every connection within a range of a position.
+     * @param zoneID Zone to send in.
+     * @param x X position in the zone.
+     * @param y Y position in the zone.
+     * @param range Maximum distance from the position.
+     * @param packet Packet to send. The packet keeps its data.
+     * @param pExclude Connection to leave out (usually the sender).
+     * @param priority What may happen to the packet for a recipient that
+     *   is not writable.
+     * @returns Number of connections the packet was sent to.
+     */
+    size_t BroadcastInRange(uint32_t zoneID, float x, float y, float range,
+        ReadOnlyPacket& packet, const TcpConnection *pExclude = nullptr,
+        TcpConnection::SendPriority_t priority =
+        TcpConnection::PRIORITY_NORMAL) const;
+
+    /**
+     * Get the zone and position of a connection.
+     * @param pConnection Connection to find.
+     * @param zoneID Set to the zone of the connection.
+     * @param x Set to the X position of the connection.
+     * @param y Set to the Y position of the connection.
+     * @returns true if the connection is in the grid.
+     */
+    bool GetPosition(const TcpConnection *pConnection, uint32_t& zoneID,
+        float& x, float& y) const;
+
+    /**
+     * Get the number of connections in the grid.
+     * @returns Number of connections.
+     */
+    size_t Count() const;
+
+    /**
+     * Get the number of connections in a zone.
+     * @param zoneID Zone to count.
+     * @returns Number of connections in the zone.
+     */
+    size_t Count(uint32_t zoneID) const;
+
+private:
+    /**
+     * @internal
+     * Position of one connection.
+     */
+    class Entry
+    {
+    public:
+        std::shared_ptr<TcpConnection> connection;
+        uint32_t zoneID;
+        uint64_t cell;
+        size_t index;
+        float x;
+        float y;
+    };
+
+    /// Entries in each cell of a zone.
+    typedef std::unordered_map<uint64_t, std::vector<Entry*>> Zone_t;
+
+    uint64_t GetCell(float x, float y) const;
+    int32_t GetCellIndex(float position) const;
+    void Link(Entry *pEntry);
+    void Unlink(Entry *pEntry);
+
+    float mCellSize;
+
+    mutable std::mutex mLock;
+    std::unordered_map<const TcpConnection*, Entry> mEntries;
+    std::unordered_map<uint32_t, Zone_t> mZones;
+    std::unordered_map<uint32_t, size_t> mZoneCounts;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_INTERESTGRID_H
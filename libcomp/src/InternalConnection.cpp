@@ -0,0 +1,577 @@
+/**
+ * @file libcomp/src/InternalConnection.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Connection between server nodes.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InternalConnection.h"
+
+// libcomp Includes
+#include "Constants.h"
+#include "Endian.h"
+#include "Log.h"
+#include "MessagePacketFrame.h"
+#include "Metrics.h"
+#include "PacketLayout.h"
+
+// Standard C++11 Includes
+#include <cstring>
+
+// OpenSSL Includes
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+using namespace libcomp;
+
+/// Size of the magic at the start of the handshake.
+static const uint32_t MAGIC_SIZE = (uint32_t)(sizeof(INTERNAL_MAGIC) - 1);
+
+/// Header of a message (code and data size).
+typedef PacketLayout<LittleField<uint16_t>,
+    LittleField<uint16_t>> MessageHeader_t;
+
+/**
+ * @internal
+ * Generate the random nonce of one side of the handshake.
+ * @returns Nonce or an empty vector if there is no randomness.
+ */
+static std::vector<char> GenerateNonce()
+{
+    std::vector<char> nonce(INTERNAL_NONCE_SIZE);
+
+    if(1 != RAND_bytes(reinterpret_cast<unsigned char*>(&nonce[0]),
+        (int)nonce.size()))
+    {
+        nonce.clear();
+    }
+
+    return nonce;
+}
+
+/**
+ * @internal
+ * Read the magic at the start of a handshake packet.
+ * @param packet Packet to read from.
+ * @returns true if the magic matched.
+ */
+static bool ReadMagic(libcomp::Packet& packet)
+{
+    char magic[MAGIC_SIZE];
+
+    packet.ReadArray(magic, MAGIC_SIZE);
+
+    return 0 == memcmp(magic, INTERNAL_MAGIC, MAGIC_SIZE);
+}
+
+InternalConnection::InternalConnection(asio::io_service& io_service) :
+    libcomp::TcpConnection(io_service), mReady(false), mMessageBytes(0)
+{
+}
+
+InternalConnection::InternalConnection(asio::ip::tcp::socket& socket) :
+    libcomp::TcpConnection(socket, nullptr), mReady(false), mMessageBytes(0)
+{
+}
+
+InternalConnection::~InternalConnection()
+{
+}
+
+void InternalConnection::SetPreSharedKey(const String& key)
+{
+    mPreSharedKey = key;
+}
+
+void InternalConnection::SetMessageQueue(const std::shared_ptr<
+    MessageQueue<libcomp::Message::Message*>>& messageQueue)
+{
+    mMessageQueue = messageQueue;
+}
+
+bool InternalConnection::IsReady() const
+{
+    return mReady;
+}
+
+void InternalConnection::ConnectionSuccess()
+{
+    LOG_DEBUG(libcomp::String("Internal connection: %1\n").Arg(
+        GetRemoteAddress()));
+
+    if(ROLE_CLIENT == GetRole())
+    {
+        mClientNonce = GenerateNonce();
+
+        if(mClientNonce.empty())
+        {
+            SocketError("Failed to generate the handshake nonce.");
+
+            return;
+        }
+
+        libcomp::Packet hello;
+        hello.WriteArray(INTERNAL_MAGIC, MAGIC_SIZE);
+        hello.WriteArray(mClientNonce);
+
+        SendPacket(hello);
+
+        if(!AsyncRead(MAGIC_SIZE + INTERNAL_NONCE_SIZE + INTERNAL_PROOF_SIZE,
+            [this](bool success, libcomp::Packet& packet)
+            {
+                ReadServerHello(success, packet);
+            }))
+        {
+            SocketError("Failed to request more data.");
+        }
+    }
+    else
+    {
+        // Don't let a peer hold the connection without proving the key.
+        StartHandshakeTimeout();
+
+        if(!AsyncRead(MAGIC_SIZE + INTERNAL_NONCE_SIZE,
+            [this](bool success, libcomp::Packet& packet)
+            {
+                ReadHello(success, packet);
+            }))
+        {
+            SocketError("Failed to request more data.");
+        }
+    }
+}
+
+void InternalConnection::ReadHello(bool success, libcomp::Packet& packet)
+{
+    if(!success)
+    {
+        return;
+    }
+
+    bool magic = ReadMagic(packet);
+    mClientNonce = packet.ReadArray(INTERNAL_NONCE_SIZE);
+    mServerNonce = GenerateNonce();
+
+    // Get ready for the next packet.
+    packet.Clear();
+
+    if(!magic)
+    {
+        SocketError("Not an internal connection.");
+
+        return;
+    }
+
+    if(mServerNonce.empty())
+    {
+        SocketError("Failed to generate the handshake nonce.");
+
+        return;
+    }
+
+    libcomp::Packet reply;
+    reply.WriteArray(INTERNAL_MAGIC, MAGIC_SIZE);
+    reply.WriteArray(mServerNonce);
+    reply.WriteArray(MakeProof('S'));
+
+    SendPacket(reply);
+
+    if(!AsyncRead(INTERNAL_PROOF_SIZE,
+        [this](bool readSuccess, libcomp::Packet& proof)
+        {
+            ReadClientProof(readSuccess, proof);
+        }))
+    {
+        SocketError("Failed to request more data.");
+    }
+}
+
+void InternalConnection::ReadServerHello(bool success,
+    libcomp::Packet& packet)
+{
+    if(!success)
+    {
+        return;
+    }
+
+    bool magic = ReadMagic(packet);
+    mServerNonce = packet.ReadArray(INTERNAL_NONCE_SIZE);
+    bool proven = magic && CheckProof('S', packet);
+
+    // Get ready for the next packet.
+    packet.Clear();
+
+    if(!magic)
+    {
+        SocketError("Not an internal connection.");
+    }
+    else if(!proven)
+    {
+        SocketError("Server does not know the pre-shared key.");
+    }
+    else
+    {
+        libcomp::Packet reply;
+        reply.WriteArray(MakeProof('C'));
+
+        SendPacket(reply);
+
+        // The server closes the connection if it does not like the proof.
+        Ready();
+    }
+}
+
+void InternalConnection::ReadClientProof(bool success,
+    libcomp::Packet& packet)
+{
+    if(!success)
+    {
+        return;
+    }
+
+    bool proven = CheckProof('C', packet);
+
+    // Get ready for the next packet.
+    packet.Clear();
+
+    if(!proven)
+    {
+        SocketError("Client does not know the pre-shared key.");
+    }
+    else
+    {
+        StopHandshakeTimeout();
+
+        Ready();
+    }
+}
+
+void InternalConnection::Ready()
+{
+    mReady = true;
+
+    LOG_DEBUG(libcomp::String("Internal connection ready: %1\n").Arg(
+        GetRemoteAddress()));
+
+    // Send what was queued during the handshake.
+    FlushMessages();
+
+    ConnectionReady();
+
+    ReadFrame();
+}
+
+void InternalConnection::ConnectionReady()
+{
+}
+
+std::vector<char> InternalConnection::MakeProof(char side) const
+{
+    std::vector<char> data;
+    data.push_back(side);
+    data.insert(data.end(), mClientNonce.begin(), mClientNonce.end());
+    data.insert(data.end(), mServerNonce.begin(), mServerNonce.end());
+
+    std::vector<char> proof(INTERNAL_PROOF_SIZE);
+    unsigned int proofSize = (unsigned int)proof.size();
+
+    if(nullptr == HMAC(EVP_sha256(), mPreSharedKey.C(),
+        (int)mPreSharedKey.Size(), reinterpret_cast<const unsigned char*>(
+        &data[0]), data.size(), reinterpret_cast<unsigned char*>(&proof[0]),
+        &proofSize) || INTERNAL_PROOF_SIZE != proofSize)
+    {
+        proof.clear();
+    }
+
+    return proof;
+}
+
+bool InternalConnection::CheckProof(char side, libcomp::Packet& packet) const
+{
+    std::vector<char> expected = MakeProof(side);
+    std::vector<char> proof = packet.ReadArray(INTERNAL_PROOF_SIZE);
+
+    // Compare in constant time so the proof can't be guessed byte by byte.
+    return !expected.empty() && expected.size() == proof.size() &&
+        0 == CRYPTO_memcmp(&expected[0], &proof[0], proof.size());
+}
+
+void InternalConnection::ReadFrame()
+{
+    if(!AsyncRead(sizeof(uint32_t),
+        [this](bool success, libcomp::Packet& packet)
+        {
+            ReadFrameData(success, packet);
+        }))
+    {
+        SocketError("Failed to request more data.");
+    }
+}
+
+void InternalConnection::ReadFrameData(bool success, libcomp::Packet& packet)
+{
+    if(!success)
+    {
+        return;
+    }
+
+    uint32_t frameSize = packet.PeekU32Little();
+
+    // Compared this way round so a huge size can't wrap around.
+    if(0 == frameSize || MAX_PACKET_SIZE - sizeof(uint32_t) < frameSize)
+    {
+        ProtocolViolation(ProtocolError::CODE_BAD_INTERNAL_FRAME, &packet);
+
+        // Get ready for the next packet.
+        packet.Clear();
+
+        return;
+    }
+
+    if(!AsyncRead(frameSize,
+        [this](bool readSuccess, libcomp::Packet& frame)
+        {
+            if(readSuccess && ParseFrame(frame))
+            {
+                ReadFrame();
+            }
+        }))
+    {
+        SocketError("Failed to request more data.");
+    }
+}
+
+bool InternalConnection::ParseFrame(libcomp::Packet& packet)
+{
+    static MetricCounter& frames = Metrics::GetSingletonPtr()->Counter(
+        "comp_internal_frames_total", "Internal frames received.");
+    static MetricCounter& messages = Metrics::GetSingletonPtr()->Counter(
+        "comp_internal_messages_total", "Internal messages queued for the "
+        "server.");
+
+    frames.Increment();
+
+    // Move the packet into a read only copy so the next read can't
+    // overwrite the messages that are still waiting in the queue.
+    ReadOnlyPacket copy(std::move(packet));
+    copy.Seek(sizeof(uint32_t));
+
+    std::shared_ptr<libcomp::TcpConnection> self = mSelf.lock();
+    std::unique_ptr<libcomp::Message::PacketFrame> frame;
+
+    if(nullptr != mMessageQueue && nullptr != self)
+    {
+        frame.reset(new libcomp::Message::PacketFrame(
+            libcomp::ConnectionHandle(self), copy));
+    }
+
+    bool ping = false;
+
+    while(0 < copy.Left())
+    {
+        uint16_t messageCode, dataSize;
+
+        if(!MessageHeader_t::Read(copy, messageCode, dataSize))
+        {
+            ProtocolViolation(ProtocolError::CODE_BAD_INTERNAL_FRAME, &copy,
+                copy.Tell());
+
+            return false;
+        }
+
+        if(dataSize > copy.Left())
+        {
+            ProtocolViolation(ProtocolError::CODE_BAD_INTERNAL_FRAME, &copy,
+                copy.Tell() - MessageHeader_t::SIZE);
+
+            return false;
+        }
+
+        if(MESSAGE_PING == messageCode)
+        {
+            ping = true;
+        }
+        else if(MESSAGE_PONG != messageCode && frame)
+        {
+            frame->AddCommand(messageCode, copy.Tell(), dataSize);
+        }
+
+        copy.Skip(dataSize);
+    }
+
+    if(ping)
+    {
+        (void)SendMessage(MESSAGE_PONG, nullptr, 0);
+    }
+
+    if(frame && 0 < frame->GetCommandCount())
+    {
+        messages.Increment(frame->GetCommandCount());
+        mMessageQueue->Enqueue(frame.release());
+    }
+
+    return true;
+}
+
+bool InternalConnection::QueueMessage(uint16_t messageCode,
+    const void *pData, uint16_t dataSize)
+{
+    uint32_t messageSize = MessageHeader_t::SIZE + dataSize;
+
+    if((0 != dataSize && nullptr == pData) || MAX_PACKET_SIZE <
+        messageSize + sizeof(uint32_t))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(mMessageMutex);
+
+    // Seal what is there if this message would not fit in the frame.
+    if(MAX_PACKET_SIZE < mMessageBytes + messageSize + sizeof(uint32_t))
+    {
+        FlushMessagesLocked();
+
+        // Nothing can be sent before the handshake is done.
+        if(0 != mMessageBytes)
+        {
+            return false;
+        }
+    }
+
+    if(0 == mMessageBytes && mReady)
+    {
+        StartFlushTimer();
+    }
+
+    // Leave room for the frame size; it is written when sealed.
+    uint8_t *pFrame = reinterpret_cast<uint8_t*>(mMessageFrame.Direct(
+        (uint32_t)sizeof(uint32_t) + mMessageBytes + messageSize));
+    uint8_t *pMessage = pFrame + sizeof(uint32_t) + mMessageBytes;
+
+    MessageHeader_t::Store(reinterpret_cast<char*>(pMessage), messageCode,
+        dataSize);
+
+    if(0 < dataSize)
+    {
+        memcpy(pMessage + MessageHeader_t::SIZE, pData, dataSize);
+    }
+
+    mMessageBytes += messageSize;
+
+    if(mMessageBytes >= INTERNAL_FLUSH_SIZE && IsWritable())
+    {
+        FlushMessagesLocked();
+    }
+
+    return true;
+}
+
+bool InternalConnection::SendMessage(uint16_t messageCode, const void *pData,
+    uint16_t dataSize)
+{
+    if(!QueueMessage(messageCode, pData, dataSize))
+    {
+        return false;
+    }
+
+    FlushMessages();
+
+    return true;
+}
+
+void InternalConnection::FlushMessages()
+{
+    std::lock_guard<std::mutex> guard(mMessageMutex);
+
+    FlushMessagesLocked();
+}
+
+void InternalConnection::FlushMessagesLocked()
+{
+    if(0 == mMessageBytes || !mReady)
+    {
+        return;
+    }
+
+    if(mFlushTimer)
+    {
+        mFlushTimer->cancel();
+    }
+
+    uint8_t *pFrame = reinterpret_cast<uint8_t*>(mMessageFrame.Direct(
+        (uint32_t)sizeof(uint32_t) + mMessageBytes));
+
+    uint32_t frameSize = htole32(mMessageBytes);
+    memcpy(pFrame, &frameSize, sizeof(frameSize));
+
+    mMessageBytes = 0;
+
+    ReadOnlyPacket frame(std::move(mMessageFrame));
+
+    SendPacket(frame);
+}
+
+void InternalConnection::StartFlushTimer()
+{
+    std::shared_ptr<libcomp::TcpConnection> self = mSelf.lock();
+
+    if(nullptr != self)
+    {
+        if(!mFlushTimer)
+        {
+            mFlushTimer.reset(new asio::steady_timer(GetIoService()));
+        }
+
+        mFlushTimer->expires_from_now(std::chrono::microseconds(
+            INTERNAL_FLUSH_DELAY));
+        mFlushTimer->async_wait([this, self](asio::error_code errorCode)
+        {
+            // A flush before the deadline cancels the timer.
+            if(!errorCode)
+            {
+                FlushMessages();
+            }
+        });
+    }
+}
+
+void InternalConnection::ConnectionClosing(const libcomp::String& reason)
+{
+    (void)reason;
+
+    FlushMessages();
+}
+
+void InternalConnection::OutgoingDrained()
+{
+    FlushMessages();
+}
+
+void InternalConnection::KeepAlive()
+{
+    if(mReady)
+    {
+        (void)SendMessage(MESSAGE_PING, nullptr, 0);
+    }
+}
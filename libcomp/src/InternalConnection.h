@@ -0,0 +1,190 @@
+/**
+ * @file libcomp/src/InternalConnection.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Connection between server nodes.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_INTERNALCONNECTION_H
+#define LIBCOMP_SRC_INTERNALCONNECTION_H
+
+// libcomp Includes
+#include "MessageQueue.h"
+#include "TcpConnection.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace libcomp
+{
+
+namespace Message
+{
+
+class Message;
+
+} // namespace Message
+
+/**
+ * Connection between two server nodes (for example a lobby and a world).
+ * There is no key exchange: both sides prove they know a pre-shared key
+ * with an HMAC over each other's random nonce and the messages are then
+ * sent in plaintext. Messages are batched into frames like the commands of
+ * a @ref LobbyConnection:
+ * @code
+ * u32 frameSize (little endian, not counting itself)
+ * repeat until frameSize bytes are used:
+ *     u16 messageCode
+ *     u16 dataSize
+ *     dataSize bytes of data
+ * @endcode
+ * Every frame received is sent to the message queue as one
+ * Message::PacketFrame.
+ */
+class InternalConnection : public libcomp::TcpConnection
+{
+public:
+    /**
+     * Codes of the messages exchanged by lobby and world nodes.
+     */
+    typedef enum
+    {
+        /// Lobby to world: an authenticated session will log in here.
+        MESSAGE_SESSION_ROUTE = 0x0001,
+        /// Any node to the others: the state of a session changed.
+        MESSAGE_SESSION_STATE = 0x0002,
+        /// Asks the other node to answer so an idle link is not closed
+        /// (handled by the connection).
+        MESSAGE_PING = 0xFFFE,
+        /// Answer to @ref MESSAGE_PING (handled by the connection).
+        MESSAGE_PONG = 0xFFFF,
+    } MessageCode_t;
+
+    /**
+     * Create a connection that will connect to another node.
+     * @param io_service Service to run the connection on.
+     */
+    InternalConnection(asio::io_service& io_service);
+
+    /**
+     * Create a connection for a socket accepted from another node.
+     * @param socket Accepted socket.
+     */
+    InternalConnection(asio::ip::tcp::socket& socket);
+
+    virtual ~InternalConnection();
+
+    /**
+     * Set the key both sides must know. An empty key still runs the
+     * handshake but proves nothing. This must be called before the
+     * connection starts.
+     * @param key Pre-shared key.
+     */
+    void SetPreSharedKey(const String& key);
+
+    void SetMessageQueue(const std::shared_ptr<MessageQueue<
+        libcomp::Message::Message*>>& messageQueue);
+
+    /**
+     * Check if the handshake is done and messages are being sent.
+     * @returns true if the other node proved it knows the key.
+     */
+    bool IsReady() const;
+
+    /**
+     * Add a message to the frame being built. The message is copied so the
+     * data may be reused right away. Messages queued before the handshake
+     * is done are sent once it is.
+     * @param messageCode Code of the message.
+     * @param pData Message data.
+     * @param dataSize Number of bytes of message data.
+     * @returns true if the message was queued; false if it does not fit in
+     *   a frame (or the frame is full and can't be sent yet).
+     */
+    bool QueueMessage(uint16_t messageCode, const void *pData,
+        uint16_t dataSize);
+
+    /**
+     * Queue a message and send the frame right away.
+     * @param messageCode Code of the message.
+     * @param pData Message data.
+     * @param dataSize Number of bytes of message data.
+     * @returns true if the message was queued.
+     */
+    bool SendMessage(uint16_t messageCode, const void *pData,
+        uint16_t dataSize);
+
+    /**
+     * Send the queued messages now.
+     */
+    void FlushMessages();
+
+    virtual void ConnectionSuccess();
+
+protected:
+    /**
+     * Called (on the io thread) once the handshake is done.
+     */
+    virtual void ConnectionReady();
+
+    virtual void ConnectionClosing(const libcomp::String& reason);
+
+    virtual void OutgoingDrained();
+
+    virtual void KeepAlive();
+
+private:
+    void ReadHello(bool success, libcomp::Packet& packet);
+    void ReadServerHello(bool success, libcomp::Packet& packet);
+    void ReadClientProof(bool success, libcomp::Packet& packet);
+    void Ready();
+
+    void ReadFrame();
+    void ReadFrameData(bool success, libcomp::Packet& packet);
+    bool ParseFrame(libcomp::Packet& packet);
+
+    void FlushMessagesLocked();
+    void StartFlushTimer();
+
+    std::vector<char> MakeProof(char side) const;
+    bool CheckProof(char side, libcomp::Packet& packet) const;
+
+    String mPreSharedKey;
+    std::vector<char> mClientNonce;
+    std::vector<char> mServerNonce;
+
+    std::atomic<bool> mReady;
+
+    std::mutex mMessageMutex;
+    Packet mMessageFrame;
+    uint32_t mMessageBytes;
+    std::unique_ptr<asio::steady_timer> mFlushTimer;
+
+    std::shared_ptr<MessageQueue<libcomp::Message::Message*>> mMessageQueue;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_INTERNALCONNECTION_H
@@ -0,0 +1,62 @@
+/**
+ * @file libcomp/src/InternalServer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Server that accepts connections from other server nodes.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InternalServer.h"
+
+// libcomp Includes
+#include "InternalConnection.h"
+
+using namespace libcomp;
+
+InternalServer::InternalServer(String listenAddress, int port,
+    const String& preSharedKey, const std::shared_ptr<MessageQueue<
+    Message::Message*>>& messageQueue, size_t workerCount) :
+    TcpServer(listenAddress, port, workerCount), mPreSharedKey(preSharedKey),
+    mMessageQueue(messageQueue)
+{
+}
+
+InternalServer::~InternalServer()
+{
+}
+
+std::shared_ptr<TcpConnection> InternalServer::CreateConnection(
+    asio::ip::tcp::socket& socket)
+{
+    auto connection = std::shared_ptr<InternalConnection>(
+        new InternalConnection(socket));
+
+    connection->SetPreSharedKey(mPreSharedKey);
+    connection->SetMessageQueue(mMessageQueue);
+
+    // TcpServer starts the connection once it has been registered.
+    return connection;
+}
+
+bool InternalServer::UsesDiffieHellman() const
+{
+    return false;
+}
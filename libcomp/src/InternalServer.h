@@ -0,0 +1,84 @@
+/**
+ * @file libcomp/src/InternalServer.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Server that accepts connections from other server nodes.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_INTERNALSERVER_H
+#define LIBCOMP_SRC_INTERNALSERVER_H
+
+// libcomp Includes
+#include "MessageQueue.h"
+#include "TcpServer.h"
+
+// Standard C++11 Includes
+#include <memory>
+
+namespace libcomp
+{
+
+namespace Message
+{
+
+class Message;
+
+} // namespace Message
+
+/**
+ * Server that accepts @ref InternalConnection links from other nodes (for
+ * example a world node accepting its lobbies). There is no key exchange so
+ * no prime is needed; every message the nodes send arrives on the message
+ * queue as a Message::PacketFrame.
+ */
+class InternalServer : public TcpServer
+{
+public:
+    /**
+     * Create a new internal server.
+     * @param listenAddress Address to listen on ("any" for all interfaces).
+     * @param port Port to listen on.
+     * @param preSharedKey Key the other nodes must know.
+     * @param messageQueue Queue the received messages are sent to.
+     * @param workerCount Number of worker threads. There are only a few
+     *   links between nodes so one is usually enough.
+     */
+    InternalServer(String listenAddress, int port, const String& preSharedKey,
+        const std::shared_ptr<MessageQueue<Message::Message*>>& messageQueue,
+        size_t workerCount = 1);
+    virtual ~InternalServer();
+
+protected:
+    virtual std::shared_ptr<TcpConnection> CreateConnection(
+        asio::ip::tcp::socket& socket);
+
+    virtual bool UsesDiffieHellman() const;
+
+private:
+    String mPreSharedKey;
+
+    std::shared_ptr<MessageQueue<Message::Message*>> mMessageQueue;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_INTERNALSERVER_H
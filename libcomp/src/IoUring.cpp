@@ -0,0 +1,1056 @@
+/**
+ * @file libcomp/src/IoUring.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Completion based socket I/O with io_uring on Linux.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "IoUring.h"
+
+// libcomp Includes
+#include "ReadOnlyPacket.h"
+
+#if defined(__linux__)
+// Standard C++11 Includes
+#include <cstring>
+#include <unordered_map>
+
+// Linux Includes
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif // __linux__
+
+using namespace libcomp;
+
+#if defined(__linux__)
+/// User data of the cancel requests (their completions are ignored).
+static const uint64_t CANCEL_ID = 0;
+
+/// Buffer group the receive buffers are registered as.
+static const uint16_t BUFFER_GROUP = 0;
+
+/**
+ * @internal
+ * Open io_uring and everything waiting on it.
+ */
+class IoUring::Ring : public std::enable_shared_from_this<IoUring::Ring>
+{
+public:
+    /**
+     * @internal
+     * Kind of operation.
+     */
+    typedef enum : uint8_t
+    {
+        OP_ACCEPT = 0,
+        OP_RECEIVE,
+        OP_SEND,
+    } Type_t;
+
+    /**
+     * @internal
+     * Operation waiting for completions.
+     */
+    class Operation
+    {
+    public:
+        Type_t type;
+        int handle;
+        bool cancelled;
+        Handler_t handler;
+        ReceiveHandler_t receiveHandler;
+
+        // Sends keep their own copy of the buffer list so a short write can
+        // continue where it stopped.
+        std::vector<struct iovec> buffers;
+        size_t nextBuffer;
+        size_t sent;
+        struct msghdr message;
+    };
+
+    explicit Ring(asio::io_service& service) : mHandle(-1),
+        pRingMemory(nullptr), mRingMemorySize(0), pEntries(nullptr),
+        mEntriesSize(0), pSubmitHead(nullptr), pSubmitTail(nullptr),
+        pSubmitArray(nullptr), mSubmitMask(0), mSubmitCount(0),
+        mSubmitTail(0), pCompleteHead(nullptr), pCompleteTail(nullptr),
+        pCompletions(nullptr), mCompleteMask(0), pBufferRing(nullptr),
+        mBufferRingSize(0), mBufferMask(0), mBufferTail(0), mBufferSize(0),
+        mNextID(CANCEL_ID + 1), mFlushPosted(false), mClosed(true),
+        mService(service), mDescriptor(service)
+    {
+    }
+
+    ~Ring()
+    {
+        Close();
+    }
+
+    bool Open(uint32_t entries, uint16_t bufferCount)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        // Multishot operations can post many completions for each entry.
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+        params.cq_entries = entries * 4;
+
+        mHandle = (int)syscall(__NR_io_uring_setup, entries, &params);
+
+        if(0 > mHandle)
+        {
+            return false;
+        }
+
+        mClosed = false;
+
+        if(0 == (params.features & IORING_FEAT_SINGLE_MMAP) ||
+            0 == (params.features & IORING_FEAT_NODROP) ||
+            0 == bufferCount || 0 != (bufferCount & (bufferCount - 1)))
+        {
+            Close();
+
+            return false;
+        }
+
+        size_t submitSize = params.sq_off.array +
+            params.sq_entries * sizeof(uint32_t);
+        size_t completeSize = params.cq_off.cqes +
+            params.cq_entries * sizeof(struct io_uring_cqe);
+
+        mRingMemorySize = submitSize > completeSize ? submitSize :
+            completeSize;
+        pRingMemory = mmap(nullptr, mRingMemorySize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, mHandle, IORING_OFF_SQ_RING);
+
+        if(MAP_FAILED == pRingMemory)
+        {
+            pRingMemory = nullptr;
+            Close();
+
+            return false;
+        }
+
+        mEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void *pMemory = mmap(nullptr, mEntriesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, mHandle, IORING_OFF_SQES);
+
+        if(MAP_FAILED == pMemory)
+        {
+            Close();
+
+            return false;
+        }
+
+        pEntries = static_cast<struct io_uring_sqe*>(pMemory);
+
+        uint8_t *pBase = static_cast<uint8_t*>(pRingMemory);
+        pSubmitHead = reinterpret_cast<uint32_t*>(pBase + params.sq_off.head);
+        pSubmitTail = reinterpret_cast<uint32_t*>(pBase + params.sq_off.tail);
+        pSubmitArray = reinterpret_cast<uint32_t*>(
+            pBase + params.sq_off.array);
+        mSubmitMask = *reinterpret_cast<uint32_t*>(
+            pBase + params.sq_off.ring_mask);
+        mSubmitCount = params.sq_entries;
+        mSubmitTail = *pSubmitTail;
+
+        pCompleteHead = reinterpret_cast<uint32_t*>(
+            pBase + params.cq_off.head);
+        pCompleteTail = reinterpret_cast<uint32_t*>(
+            pBase + params.cq_off.tail);
+        pCompletions = reinterpret_cast<struct io_uring_cqe*>(
+            pBase + params.cq_off.cqes);
+        mCompleteMask = *reinterpret_cast<uint32_t*>(
+            pBase + params.cq_off.ring_mask);
+
+        // Entry i always sits in slot i.
+        for(uint32_t i = 0; i < mSubmitCount; ++i)
+        {
+            pSubmitArray[i] = i;
+        }
+
+        if(!RegisterBuffers(bufferCount))
+        {
+            Close();
+
+            return false;
+        }
+
+        // The io_service owns a duplicate so closing it never closes the
+        // ring out from under the mappings.
+        asio::error_code errorCode;
+        mDescriptor.assign(dup(mHandle), errorCode);
+
+        if(errorCode)
+        {
+            Close();
+
+            return false;
+        }
+
+        Wait();
+
+        return true;
+    }
+
+    void Close()
+    {
+        if(mClosed)
+        {
+            return;
+        }
+
+        mClosed = true;
+
+        asio::error_code ignored;
+        mDescriptor.close(ignored);
+
+        // The handlers may hold the last reference to whatever owns this
+        // ring so they are only destroyed once nothing here is used.
+        std::unordered_map<uint64_t, Operation> operations;
+        operations.swap(mOperations);
+
+        if(nullptr != pBufferRing)
+        {
+            struct io_uring_buf_reg registration;
+            memset(&registration, 0, sizeof(registration));
+            registration.bgid = BUFFER_GROUP;
+
+            (void)syscall(__NR_io_uring_register, mHandle,
+                IORING_UNREGISTER_PBUF_RING, &registration, 1);
+
+            munmap(pBufferRing, mBufferRingSize);
+            pBufferRing = nullptr;
+        }
+
+        if(nullptr != pEntries)
+        {
+            munmap(pEntries, mEntriesSize);
+            pEntries = nullptr;
+        }
+
+        if(nullptr != pRingMemory)
+        {
+            munmap(pRingMemory, mRingMemorySize);
+            pRingMemory = nullptr;
+        }
+
+        if(0 <= mHandle)
+        {
+            close(mHandle);
+            mHandle = -1;
+        }
+
+        mBuffers.clear();
+    }
+
+    bool IsOpen() const
+    {
+        return !mClosed;
+    }
+
+    uint64_t Accept(int handle, const Handler_t& handler)
+    {
+        uint64_t id = mNextID++;
+
+        Operation& operation = mOperations[id];
+        operation.type = OP_ACCEPT;
+        operation.handle = handle;
+        operation.cancelled = false;
+        operation.handler = handler;
+
+        if(!PrepareAccept(handle, id))
+        {
+            mOperations.erase(id);
+
+            return 0;
+        }
+
+        return id;
+    }
+
+    uint64_t Receive(int handle, const ReceiveHandler_t& handler)
+    {
+        uint64_t id = mNextID++;
+
+        Operation& operation = mOperations[id];
+        operation.type = OP_RECEIVE;
+        operation.handle = handle;
+        operation.cancelled = false;
+        operation.receiveHandler = handler;
+
+        if(!PrepareReceive(handle, id))
+        {
+            mOperations.erase(id);
+
+            return 0;
+        }
+
+        return id;
+    }
+
+    bool Send(int handle, const std::vector<asio::const_buffer>& buffers,
+        const Handler_t& handler)
+    {
+        uint64_t id = mNextID++;
+
+        Operation& operation = mOperations[id];
+        operation.type = OP_SEND;
+        operation.handle = handle;
+        operation.cancelled = false;
+        operation.handler = handler;
+        operation.nextBuffer = 0;
+        operation.sent = 0;
+
+        for(auto& buffer : buffers)
+        {
+            struct iovec vector;
+            vector.iov_base = const_cast<void*>(asio::buffer_cast<
+                const void*>(buffer));
+            vector.iov_len = asio::buffer_size(buffer);
+
+            operation.buffers.push_back(vector);
+        }
+
+        if(!PrepareSend(operation, id))
+        {
+            mOperations.erase(id);
+
+            return false;
+        }
+
+        return true;
+    }
+
+    void Cancel(uint64_t id)
+    {
+        auto it = mOperations.find(id);
+
+        // A send can't be stopped; its handler keeps the data alive.
+        if(mOperations.end() == it || it->second.cancelled ||
+            OP_SEND == it->second.type)
+        {
+            return;
+        }
+
+        it->second.cancelled = true;
+        it->second.handler = nullptr;
+        it->second.receiveHandler = nullptr;
+
+        // The operation is removed once the kernel says it has stopped.
+        struct io_uring_sqe *pEntry = GetEntry();
+
+        if(nullptr != pEntry)
+        {
+            pEntry->opcode = IORING_OP_ASYNC_CANCEL;
+            pEntry->fd = -1;
+            pEntry->addr = id;
+            pEntry->user_data = CANCEL_ID;
+        }
+    }
+
+private:
+    bool RegisterBuffers(uint16_t bufferCount)
+    {
+        mBufferRingSize = bufferCount * sizeof(struct io_uring_buf);
+
+        void *pMemory = mmap(nullptr, mBufferRingSize, PROT_READ |
+            PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+        if(MAP_FAILED == pMemory)
+        {
+            return false;
+        }
+
+        pBufferRing = static_cast<struct io_uring_buf_ring*>(pMemory);
+
+        struct io_uring_buf_reg registration;
+        memset(&registration, 0, sizeof(registration));
+        registration.ring_addr = (uint64_t)(uintptr_t)pMemory;
+        registration.ring_entries = bufferCount;
+        registration.bgid = BUFFER_GROUP;
+
+        if(0 != syscall(__NR_io_uring_register, mHandle,
+            IORING_REGISTER_PBUF_RING, &registration, 1))
+        {
+            munmap(pBufferRing, mBufferRingSize);
+            pBufferRing = nullptr;
+
+            return false;
+        }
+
+        mBufferMask = (uint16_t)(bufferCount - 1);
+        mBufferTail = 0;
+
+        // The buffers come from the packet buffer pool.
+        for(uint16_t i = 0; i < bufferCount; ++i)
+        {
+            mBuffers.push_back(ReadOnlyPacket::AllocateBuffer(
+                IO_URING_BUFFER_SIZE, mBufferSize));
+        }
+
+        for(uint16_t i = 0; i < bufferCount; ++i)
+        {
+            RecycleBuffer(i);
+        }
+
+        return true;
+    }
+
+    void RecycleBuffer(uint16_t id)
+    {
+        // The bufs member is not at the start of the ring in C++ (the flex
+        // array is wrapped in a struct after an empty one) so the entries
+        // are found from the start of the ring instead.
+        struct io_uring_buf *pBuffer = reinterpret_cast<
+            struct io_uring_buf*>(pBufferRing) + (mBufferTail & mBufferMask);
+        pBuffer->addr = (uint64_t)(uintptr_t)mBuffers[id].get();
+        pBuffer->len = mBufferSize;
+        pBuffer->bid = id;
+
+        __atomic_store_n(&pBufferRing->tail, ++mBufferTail,
+            __ATOMIC_RELEASE);
+    }
+
+    struct io_uring_sqe* GetEntry()
+    {
+        if(mClosed)
+        {
+            return nullptr;
+        }
+
+        uint32_t head = __atomic_load_n(pSubmitHead, __ATOMIC_ACQUIRE);
+
+        if(mSubmitCount <= (mSubmitTail - head))
+        {
+            Submit();
+            head = __atomic_load_n(pSubmitHead, __ATOMIC_ACQUIRE);
+
+            if(mSubmitCount <= (mSubmitTail - head))
+            {
+                return nullptr;
+            }
+        }
+
+        struct io_uring_sqe *pEntry = &pEntries[mSubmitTail & mSubmitMask];
+        memset(pEntry, 0, sizeof(*pEntry));
+
+        mSubmitTail++;
+
+        ScheduleFlush();
+
+        return pEntry;
+    }
+
+    bool PrepareAccept(int handle, uint64_t id)
+    {
+        struct io_uring_sqe *pEntry = GetEntry();
+
+        if(nullptr == pEntry)
+        {
+            return false;
+        }
+
+        pEntry->opcode = IORING_OP_ACCEPT;
+        pEntry->fd = handle;
+        pEntry->ioprio = IORING_ACCEPT_MULTISHOT;
+        pEntry->accept_flags = SOCK_CLOEXEC;
+        pEntry->user_data = id;
+
+        return true;
+    }
+
+    bool PrepareReceive(int handle, uint64_t id)
+    {
+        struct io_uring_sqe *pEntry = GetEntry();
+
+        if(nullptr == pEntry)
+        {
+            return false;
+        }
+
+        pEntry->opcode = IORING_OP_RECV;
+        pEntry->fd = handle;
+        pEntry->ioprio = IORING_RECV_MULTISHOT;
+        pEntry->flags = IOSQE_BUFFER_SELECT;
+        pEntry->buf_group = BUFFER_GROUP;
+        pEntry->user_data = id;
+
+        return true;
+    }
+
+    bool PrepareSend(Operation& operation, uint64_t id)
+    {
+        struct io_uring_sqe *pEntry = GetEntry();
+
+        if(nullptr == pEntry)
+        {
+            return false;
+        }
+
+        memset(&operation.message, 0, sizeof(operation.message));
+        operation.message.msg_iov = &operation.buffers[operation.nextBuffer];
+        operation.message.msg_iovlen = operation.buffers.size() -
+            operation.nextBuffer;
+
+        pEntry->opcode = IORING_OP_SENDMSG;
+        pEntry->fd = operation.handle;
+        pEntry->addr = (uint64_t)(uintptr_t)&operation.message;
+        pEntry->len = 1;
+        pEntry->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        pEntry->user_data = id;
+
+        return true;
+    }
+
+    void Submit()
+    {
+        if(mClosed)
+        {
+            return;
+        }
+
+        __atomic_store_n(pSubmitTail, mSubmitTail, __ATOMIC_RELEASE);
+
+        uint32_t pending = mSubmitTail - __atomic_load_n(pSubmitHead,
+            __ATOMIC_ACQUIRE);
+
+        // Anything the kernel could not take now goes with the next call.
+        while(0 < pending && 0 > syscall(__NR_io_uring_enter, mHandle,
+            pending, 0, 0, nullptr, 0) && EINTR == errno)
+        {
+        }
+    }
+
+    void ScheduleFlush()
+    {
+        if(mFlushPosted)
+        {
+            return;
+        }
+
+        mFlushPosted = true;
+
+        // Everything prepared until the io_service gets to this is
+        // submitted with one system call.
+        std::weak_ptr<Ring> weakSelf(shared_from_this());
+
+        mService.post([weakSelf]()
+        {
+            std::shared_ptr<Ring> self = weakSelf.lock();
+
+            if(nullptr != self)
+            {
+                self->mFlushPosted = false;
+                self->Submit();
+            }
+        });
+    }
+
+    bool HasCompletions() const
+    {
+        return *pCompleteHead != __atomic_load_n(pCompleteTail,
+            __ATOMIC_ACQUIRE);
+    }
+
+    void Wait()
+    {
+        std::weak_ptr<Ring> weakSelf(shared_from_this());
+
+        mDescriptor.async_read_some(asio::null_buffers(),
+            [weakSelf](const asio::error_code& errorCode, std::size_t)
+            {
+                std::shared_ptr<Ring> self = weakSelf.lock();
+
+                if(!errorCode && nullptr != self && !self->mClosed)
+                {
+                    self->ProcessCompletions();
+
+                    if(!self->mClosed)
+                    {
+                        self->Wait();
+                    }
+                }
+            });
+
+        // The reactor only wakes up for new completions so anything posted
+        // before the wait was started is handled now.
+        if(HasCompletions())
+        {
+            mService.post([weakSelf]()
+            {
+                std::shared_ptr<Ring> self = weakSelf.lock();
+
+                if(nullptr != self && !self->mClosed)
+                {
+                    self->ProcessCompletions();
+                }
+            });
+        }
+    }
+
+    void ProcessCompletions()
+    {
+        uint32_t head = *pCompleteHead;
+        uint32_t tail = __atomic_load_n(pCompleteTail, __ATOMIC_ACQUIRE);
+
+        while(head != tail && !mClosed)
+        {
+            struct io_uring_cqe completion = pCompletions[
+                head & mCompleteMask];
+
+            // Give the slot back before a handler can start more work.
+            __atomic_store_n(pCompleteHead, ++head, __ATOMIC_RELEASE);
+
+            Complete(completion.user_data, completion.res,
+                completion.flags);
+
+            if(head == tail && !mClosed)
+            {
+                tail = __atomic_load_n(pCompleteTail, __ATOMIC_ACQUIRE);
+            }
+        }
+    }
+
+    void Complete(uint64_t id, int32_t result, uint32_t flags)
+    {
+        bool more = 0 != (flags & IORING_CQE_F_MORE);
+        bool hasBuffer = 0 != (flags & IORING_CQE_F_BUFFER);
+        uint16_t buffer = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+        auto it = mOperations.find(id);
+
+        if(mOperations.end() == it)
+        {
+            if(hasBuffer)
+            {
+                RecycleBuffer(buffer);
+            }
+
+            return;
+        }
+
+        // References stay valid while handlers add operations but the
+        // lookup has to be repeated after a handler ran.
+        Operation& operation = it->second;
+
+        if(operation.cancelled)
+        {
+            if(hasBuffer)
+            {
+                RecycleBuffer(buffer);
+            }
+
+            // Nobody wants the socket any more.
+            if(OP_ACCEPT == operation.type && 0 <= result)
+            {
+                close(result);
+            }
+
+            if(!more)
+            {
+                mOperations.erase(id);
+            }
+
+            return;
+        }
+
+        switch(operation.type)
+        {
+            case OP_ACCEPT:
+                CompleteAccept(id, operation, result, more);
+                break;
+            case OP_RECEIVE:
+                CompleteReceive(id, operation, result, more, hasBuffer,
+                    buffer);
+                break;
+            case OP_SEND:
+                CompleteSend(id, operation, result);
+                break;
+        }
+    }
+
+    void CompleteAccept(uint64_t id, Operation& operation, int32_t result,
+        bool more)
+    {
+        if(0 > result)
+        {
+            // Only an error that stopped the accept is reported.
+            if(more)
+            {
+                return;
+            }
+
+            Handler_t handler = std::move(operation.handler);
+            mOperations.erase(id);
+
+            handler(result);
+
+            return;
+        }
+
+        Handler_t handler = operation.handler;
+        int handle = operation.handle;
+
+        handler(result);
+
+        // The kernel may stop a multishot accept at any time.
+        if(!more && !mClosed && IsActive(id) && !PrepareAccept(handle, id))
+        {
+            Fail(id, -ENOMEM);
+        }
+    }
+
+    void CompleteReceive(uint64_t id, Operation& operation, int32_t result,
+        bool more, bool hasBuffer, uint16_t buffer)
+    {
+        if(0 < result && hasBuffer)
+        {
+            ReceiveHandler_t handler = operation.receiveHandler;
+            int handle = operation.handle;
+
+            handler(result, mBuffers[buffer].get());
+
+            if(mClosed)
+            {
+                return;
+            }
+
+            RecycleBuffer(buffer);
+
+            if(!more && IsActive(id) && !PrepareReceive(handle, id))
+            {
+                Fail(id, -ENOMEM);
+            }
+        }
+        else if(-ENOBUFS == result)
+        {
+            // Every buffer was in use; they are all back by now.
+            if(!more && !PrepareReceive(operation.handle, id))
+            {
+                Fail(id, -ENOMEM);
+            }
+        }
+        else
+        {
+            if(hasBuffer)
+            {
+                RecycleBuffer(buffer);
+            }
+
+            if(!more)
+            {
+                Fail(id, 0 < result ? -EIO : result);
+            }
+        }
+    }
+
+    void CompleteSend(uint64_t id, Operation& operation, int32_t result)
+    {
+        if(0 < result)
+        {
+            size_t length = (size_t)result;
+            operation.sent += length;
+
+            // Skip what was written in case the send stopped early.
+            while(operation.nextBuffer < operation.buffers.size() &&
+                operation.buffers[operation.nextBuffer].iov_len <= length)
+            {
+                length -= operation.buffers[operation.nextBuffer].iov_len;
+                operation.nextBuffer++;
+            }
+
+            if(operation.nextBuffer < operation.buffers.size())
+            {
+                struct iovec& vector = operation.buffers[
+                    operation.nextBuffer];
+                vector.iov_base = static_cast<uint8_t*>(vector.iov_base) +
+                    length;
+                vector.iov_len -= length;
+
+                if(PrepareSend(operation, id))
+                {
+                    return;
+                }
+
+                result = -ENOMEM;
+            }
+        }
+        else if(0 == result)
+        {
+            result = -EPIPE;
+        }
+
+        Handler_t handler = std::move(operation.handler);
+        int32_t sent = (int32_t)operation.sent;
+        mOperations.erase(id);
+
+        handler(0 > result ? result : sent);
+    }
+
+    bool IsActive(uint64_t id) const
+    {
+        auto it = mOperations.find(id);
+
+        return mOperations.end() != it && !it->second.cancelled;
+    }
+
+    void Fail(uint64_t id, int32_t result)
+    {
+        auto it = mOperations.find(id);
+
+        if(mOperations.end() == it)
+        {
+            return;
+        }
+
+        Handler_t handler = std::move(it->second.handler);
+        ReceiveHandler_t receiveHandler = std::move(
+            it->second.receiveHandler);
+        mOperations.erase(it);
+
+        if(receiveHandler)
+        {
+            receiveHandler(result, nullptr);
+        }
+        else if(handler)
+        {
+            handler(result);
+        }
+    }
+
+    int mHandle;
+
+    void *pRingMemory;
+    size_t mRingMemorySize;
+    struct io_uring_sqe *pEntries;
+    size_t mEntriesSize;
+
+    uint32_t *pSubmitHead;
+    uint32_t *pSubmitTail;
+    uint32_t *pSubmitArray;
+    uint32_t mSubmitMask;
+    uint32_t mSubmitCount;
+    uint32_t mSubmitTail;
+
+    uint32_t *pCompleteHead;
+    uint32_t *pCompleteTail;
+    struct io_uring_cqe *pCompletions;
+    uint32_t mCompleteMask;
+
+    struct io_uring_buf_ring *pBufferRing;
+    size_t mBufferRingSize;
+    uint16_t mBufferMask;
+    uint16_t mBufferTail;
+    uint32_t mBufferSize;
+    std::vector<std::shared_ptr<uint8_t>> mBuffers;
+
+    std::unordered_map<uint64_t, Operation> mOperations;
+    uint64_t mNextID;
+    bool mFlushPosted;
+    bool mClosed;
+
+    asio::io_service& mService;
+    asio::posix::stream_descriptor mDescriptor;
+};
+#else // !__linux__
+/**
+ * @internal
+ * There is no io_uring on this platform.
+ */
+class IoUring::Ring
+{
+public:
+    explicit Ring(asio::io_service& service)
+    {
+        (void)service;
+    }
+
+    bool Open(uint32_t entries, uint16_t bufferCount)
+    {
+        (void)entries;
+        (void)bufferCount;
+
+        return false;
+    }
+
+    void Close()
+    {
+    }
+
+    bool IsOpen() const
+    {
+        return false;
+    }
+
+    uint64_t Accept(int handle, const Handler_t& handler)
+    {
+        (void)handle;
+        (void)handler;
+
+        return 0;
+    }
+
+    uint64_t Receive(int handle, const ReceiveHandler_t& handler)
+    {
+        (void)handle;
+        (void)handler;
+
+        return 0;
+    }
+
+    bool Send(int handle, const std::vector<asio::const_buffer>& buffers,
+        const Handler_t& handler)
+    {
+        (void)handle;
+        (void)buffers;
+        (void)handler;
+
+        return false;
+    }
+
+    void Cancel(uint64_t id)
+    {
+        (void)id;
+    }
+};
+#endif // __linux__
+
+IoUring::IoUring(asio::io_service& service) : mService(service)
+{
+}
+
+IoUring::~IoUring()
+{
+    Close();
+}
+
+bool IoUring::IsSupported()
+{
+#if defined(__linux__)
+    static const bool supported = []()
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        int handle = (int)syscall(__NR_io_uring_setup, 2, &params);
+
+        if(0 > handle)
+        {
+            return false;
+        }
+
+        std::vector<uint8_t> storage(sizeof(struct io_uring_probe) +
+            256 * sizeof(struct io_uring_probe_op), 0);
+        struct io_uring_probe *pProbe = reinterpret_cast<
+            struct io_uring_probe*>(storage.data());
+
+        bool result = 0 == syscall(__NR_io_uring_register, handle,
+            IORING_REGISTER_PROBE, pProbe, 256);
+
+        // Multishot receive and zero copy send came with the same kernel
+        // (6.0); only the second one shows up in the probe.
+        const uint8_t required[] = {
+            IORING_OP_ACCEPT,
+            IORING_OP_ASYNC_CANCEL,
+            IORING_OP_RECV,
+            IORING_OP_SENDMSG,
+            IORING_OP_SEND_ZC,
+        };
+
+        for(auto op : required)
+        {
+            result = result && op <= pProbe->last_op &&
+                0 != (pProbe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        }
+
+        close(handle);
+
+        return result;
+    }();
+
+    return supported;
+#else // !__linux__
+    return false;
+#endif // __linux__
+}
+
+bool IoUring::Open(uint32_t entries, uint16_t bufferCount)
+{
+    Close();
+
+    std::shared_ptr<Ring> ring(new Ring(mService));
+
+    if(!ring->Open(entries, bufferCount))
+    {
+        return false;
+    }
+
+    mRing = ring;
+
+    return true;
+}
+
+void IoUring::Close()
+{
+    // Dropping the last handler may drop the last reference to this.
+    std::shared_ptr<Ring> ring;
+    ring.swap(mRing);
+
+    if(nullptr != ring)
+    {
+        ring->Close();
+    }
+}
+
+bool IoUring::IsOpen() const
+{
+    return nullptr != mRing && mRing->IsOpen();
+}
+
+uint64_t IoUring::Accept(int handle, const Handler_t& handler)
+{
+    return nullptr != mRing ? mRing->Accept(handle, handler) : 0;
+}
+
+uint64_t IoUring::Receive(int handle, const ReceiveHandler_t& handler)
+{
+    return nullptr != mRing ? mRing->Receive(handle, handler) : 0;
+}
+
+bool IoUring::Send(int handle, const std::vector<asio::const_buffer>& buffers,
+    const Handler_t& handler)
+{
+    return nullptr != mRing && mRing->Send(handle, buffers, handler);
+}
+
+void IoUring::Cancel(uint64_t id)
+{
+    if(nullptr != mRing)
+    {
+        mRing->Cancel(id);
+    }
+}
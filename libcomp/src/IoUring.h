@@ -0,0 +1,160 @@
+/**
+ * @file libcomp/src/IoUring.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Completion based socket I/O with io_uring on Linux.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_IOURING_H
+#define LIBCOMP_SRC_IOURING_H
+
+// libcomp Includes
+#include "Constants.h"
+
+// Boost ASIO Includes
+#include "PushIgnore.h"
+#include <asio.hpp>
+#include "PopIgnore.h"
+
+// Standard C++11 Includes
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Socket operations run through an io_uring instead of the epoll reactor
+ * of asio. An accept or receive is started once and keeps delivering
+ * (multishot) into buffers the kernel picks from a registered ring of
+ * packet buffers. Operations started while a handler runs are submitted
+ * together with a single system call once the io_service gets to it. The
+ * ring itself is watched by the io_service so the handlers run on the
+ * thread that runs it. Every method must be called from that thread.
+ */
+class IoUring
+{
+public:
+    /// Called with the result of an operation (a negative errno on error).
+    typedef std::function<void(int32_t result)> Handler_t;
+
+    /// Called with the size and data of a receive (the data is only valid
+    /// until the handler returns) or with 0 or a negative errno once the
+    /// receive has stopped.
+    typedef std::function<void(int32_t result,
+        const uint8_t *pData)> ReceiveHandler_t;
+
+    /**
+     * Create a ring that is not open yet.
+     * @param service io_service that runs the handlers.
+     */
+    explicit IoUring(asio::io_service& service);
+
+    /**
+     * Close the ring (see @ref Close).
+     */
+    ~IoUring();
+
+    /**
+     * Check if the kernel has everything this needs: io_uring with the
+     * receive, accept, sendmsg and cancel operations plus multishot receive
+     * and registered buffer rings (Linux 6.0).
+     * @returns true if an io_uring may be opened.
+     */
+    static bool IsSupported();
+
+    /**
+     * Open the ring and register the receive buffers.
+     * @param entries Number of submission queue entries.
+     * @param bufferCount Number of receive buffers (a power of two).
+     * @returns true if the ring is ready.
+     */
+    bool Open(uint32_t entries = IO_URING_ENTRIES,
+        uint16_t bufferCount = IO_URING_BUFFER_COUNT);
+
+    /**
+     * Close the ring. Handlers of operations that have not finished are
+     * dropped without being called.
+     */
+    void Close();
+
+    /**
+     * Check if the ring is open.
+     * @returns true if the ring is open.
+     */
+    bool IsOpen() const;
+
+    /**
+     * Accept connections on a listening socket until cancelled or an
+     * error stops it.
+     * @param handle Native handle of the listening socket.
+     * @param handler Called with the handle of each accepted socket (the
+     *   handler owns it) or with a negative errno once accepting stopped.
+     * @returns ID of the operation (0 if it could not be started).
+     */
+    uint64_t Accept(int handle, const Handler_t& handler);
+
+    /**
+     * Receive from a socket until cancelled, the peer closes it or an
+     * error stops it.
+     * @param handle Native handle of the socket.
+     * @param handler Called for each chunk of data that is received.
+     * @returns ID of the operation (0 if it could not be started).
+     */
+    uint64_t Receive(int handle, const ReceiveHandler_t& handler);
+
+    /**
+     * Write every buffer to a socket (short writes are continued). The
+     * buffers must stay valid until the handler is called.
+     * @param handle Native handle of the socket.
+     * @param buffers Data to send in order.
+     * @param handler Called with the number of bytes sent (all of them) or
+     *   a negative errno.
+     * @returns true if the send was started.
+     */
+    bool Send(int handle, const std::vector<asio::const_buffer>& buffers,
+        const Handler_t& handler);
+
+    /**
+     * Stop an accept or receive. Its handler is released right away and
+     * is not called again.
+     * @param id ID of the operation.
+     */
+    void Cancel(uint64_t id);
+
+private:
+    class Ring;
+
+    /// io_service that runs the handlers.
+    asio::io_service& mService;
+
+    /// State of the open ring (shared with the handlers posted to the
+    /// io_service).
+    std::shared_ptr<Ring> mRing;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_IOURING_H
@@ -27,23 +27,174 @@
 #include "LobbyConnection.h"
 
 // libcomp Includes
+#include "AllocationTracker.h"
+#include "Blowfish.h"
+#include "CommandProfiler.h"
+#include "Compress.h"
 #include "Constants.h"
 #include "Decrypt.h"
+#include "Endian.h"
 #include "Exception.h"
 #include "Log.h"
 #include "MessagePacket.h"
+#include "MessagePacketFrame.h"
+#include "Metrics.h"
+#include "PacketCapture.h"
+#include "PacketLayout.h"
 #include "TcpServer.h"
+#include "Tracer.h"
+#include "WorkerPool.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
 
 using namespace libcomp;
 
+/// Sizes in front of an encrypted packet (padded size and real size).
+typedef PacketLayout<BigField<uint32_t>,
+    BigField<uint32_t>> EncryptedHeader_t;
+
+/// Header of a command (big endian size, size and code).
+typedef PacketLayout<BigField<uint16_t>, LittleField<uint16_t>,
+    LittleField<uint16_t>> CommandHeader_t;
+
+/**
+ * @internal
+ * Counters of LobbyConnection::BroadcastEncrypted. They are sharded so the
+ * io threads encrypting a broadcast do not fight over them.
+ */
+class BroadcastMetrics
+{
+public:
+    BroadcastMetrics() : frames(Metrics::GetSingletonPtr()->Counter(
+        "comp_lobby_broadcast_frames_total", "Frames encrypted for "
+        "broadcasts.")), bytes(Metrics::GetSingletonPtr()->Counter(
+        "comp_lobby_broadcast_bytes_total", "Bytes encrypted for "
+        "broadcasts.")), time(Metrics::GetSingletonPtr()->Counter(
+        "comp_lobby_broadcast_encrypt_nanoseconds_total", "Time spent "
+        "encrypting broadcasts."))
+    {
+    }
+
+    MetricCounter& frames;
+    MetricCounter& bytes;
+    MetricCounter& time;
+};
+
+/**
+ * @internal
+ * Get the broadcast metrics.
+ * @returns Metrics shared by every connection.
+ */
+static BroadcastMetrics& GetBroadcastMetrics()
+{
+    static BroadcastMetrics metrics;
+
+    return metrics;
+}
+
+/// Frames sent compressed by any LobbyConnection.
+static std::atomic<uint64_t> gCompressedFrames(0);
+
+/// Command bytes of the frames that were compressed.
+static std::atomic<uint64_t> gCompressedBytesIn(0);
+
+/// Bytes the compressed frames took instead.
+static std::atomic<uint64_t> gCompressedBytesOut(0);
+
+/// Frames that were big enough to compress but did not get smaller.
+static std::atomic<uint64_t> gIncompressibleFrames(0);
+
+/// Compressed frames received and inflated by any LobbyConnection.
+static std::atomic<uint64_t> gInflatedFrames(0);
+
+/**
+ * @internal
+ * Client side of the key exchange written as one linear flow. This is a
+ * stackless asio::coroutine: each yield starts an asynchronous step with a
+ * copy of the coroutine as its completion handler and that copy resumes the
+ * flow after the yield. Only the @ref State is shared between the copies so
+ * anything that must survive a yield lives there.
+ */
+class LobbyConnection::ClientHandshake : public asio::coroutine
+{
+public:
+    explicit ClientHandshake(LobbyConnection *pConnection) :
+        mConnection(pConnection), mState(std::make_shared<State>())
+    {
+    }
+
+    /**
+     * Resume after @ref TcpConnection::AsyncRead.
+     * @param success false if the read failed (the socket is closed).
+     * @param packet Packet holding the bytes that were read.
+     */
+    void operator()(bool success, libcomp::Packet& packet)
+    {
+        Step(success, &packet);
+    }
+
+    /**
+     * Start the handshake or resume after @ref RunHandshakeStep.
+     */
+    void operator()()
+    {
+        Step(true, nullptr);
+    }
+
+private:
+    /**
+     * @internal
+     * Keys carried across the steps of the handshake.
+     */
+    class State
+    {
+    public:
+        DiffieHellmanKey_t prime;
+        DiffieHellmanKey_t serverPublic;
+        DiffieHellmanKey_t clientPublic;
+        std::vector<char> sharedData;
+    };
+
+    std::function<void()> GenerateKeys() const
+    {
+        LobbyConnection *pConnection = mConnection;
+        std::shared_ptr<State> state = mState;
+
+        return [pConnection, state]()
+        {
+            // Both keys are generated before the shared data is used.
+            if(GenerateDiffieHellmanPublic(pConnection->mDiffieHellman,
+                state->clientPublic))
+            {
+                state->sharedData = GenerateDiffieHellmanSharedData(
+                    pConnection->mDiffieHellman, state->serverPublic);
+            }
+        };
+    }
+
+    void Step(bool success, libcomp::Packet *pPacket);
+
+    LobbyConnection *mConnection;
+    std::shared_ptr<State> mState;
+};
+
 LobbyConnection::LobbyConnection(asio::io_service& io_service) :
-    libcomp::TcpConnection(io_service), mPacketParser(nullptr)
+    libcomp::TcpConnection(io_service), mPacketParser(nullptr),
+    mFrameDispatch(false), mCompression(false),
+    mCompressThreshold(FRAME_COMPRESS_THRESHOLD), mCommandBytes(0),
+    mCommandFlushSize(COMMAND_FLUSH_SIZE),
+    mCommandFlushDelay(COMMAND_FLUSH_DELAY)
 {
 }
 
 LobbyConnection::LobbyConnection(asio::ip::tcp::socket& socket,
     DH *pDiffieHellman) : libcomp::TcpConnection(socket, pDiffieHellman),
-    mPacketParser(nullptr)
+    mPacketParser(nullptr), mFrameDispatch(false), mCompression(false),
+    mCompressThreshold(FRAME_COMPRESS_THRESHOLD), mCommandBytes(0),
+    mCommandFlushSize(COMMAND_FLUSH_SIZE),
+    mCommandFlushDelay(COMMAND_FLUSH_DELAY)
 {
 }
 
@@ -62,6 +213,9 @@ void LobbyConnection::SocketError(const libcomp::String& errorMessage)
     TcpConnection::SocketError(errorMessage);
 
     mPacketParser = nullptr;
+
+    // Errors are reported on the thread that owns the wheel.
+    mFlushTimer.Cancel();
 }
 
 void LobbyConnection::ConnectionSuccess()
@@ -71,27 +225,20 @@ void LobbyConnection::ConnectionSuccess()
 
     if(ROLE_CLIENT == GetRole())
     {
-        mPacketParser = &LobbyConnection::ParseClientEncryptionStart;
-
-        libcomp::Packet packet;
+        // The handshake reads for itself until the connection is encrypted.
+        mPacketParser = nullptr;
 
-        packet.WriteU32Big(1);
-        packet.WriteU32Big(8);
-
-        // Send a packet after connecting.
-        SendPacket(packet);
-
-        // Now read the first reply.
-        if(!RequestPacket(strlen(DH_BASE_STRING) + 2 * DH_KEY_HEX_SIZE +
-            4 * sizeof(uint32_t)))
-        {
-            SocketError("Failed to request more data.");
-        }
+        ClientHandshake handshake(this);
+        handshake();
     }
     else
     {
         mPacketParser = &LobbyConnection::ParseServerEncryptionStart;
 
+        // Don't let a client hold a connection (and its key pair) without
+        // finishing the handshake.
+        StartHandshakeTimeout();
+
         // Read the first packet.
         if(!RequestPacket(2 * sizeof(uint32_t)))
         {
@@ -100,154 +247,691 @@ void LobbyConnection::ConnectionSuccess()
     }
 }
 
-void LobbyConnection::ConnectionEncrypted()
+bool LobbyConnection::SendEncrypted(uint16_t commandCode, const void *pData,
+    uint16_t dataSize)
 {
-    /// @todo Implement (send an event to the queue).
-    LOG_DEBUG("Connection encrypted!\n");
+    OutgoingCommand_t command;
+    command.commandCode = commandCode;
+    command.pData = pData;
+    command.dataSize = dataSize;
 
-    // Start reading until we have the packet sizes.
-    if(!RequestPacket(2 * sizeof(uint32_t)))
-    {
-        SocketError("Failed to request more data.");
-    }
+    return SendEncrypted(&command, 1);
 }
 
-void LobbyConnection::ParseClientEncryptionStart(libcomp::Packet& packet)
+bool LobbyConnection::SendEncrypted(const OutgoingCommand_t *pCommands,
+    size_t commandCount)
 {
-    // Check if we have all the data.
-    if((strlen(DH_BASE_STRING) + 2 * DH_KEY_HEX_SIZE +
-        4 * sizeof(uint32_t)) > packet.Size())
+    AllocationTracker::Scope tag(AllocationTracker::TAG_SEND);
+
+    bool result = false;
+
+    uint32_t realSize = 0;
+
+    for(size_t i = 0; i < commandCount; ++i)
     {
-        // Keep reading the first reply.
-        if(!RequestPacket(strlen(DH_BASE_STRING) + 2 * DH_KEY_HEX_SIZE +
-            4 * sizeof(uint32_t) - packet.Size()))
+        realSize += (uint32_t)(3 * sizeof(uint16_t)) + pCommands[i].dataSize;
+    }
+
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+
+    if(STATUS_ENCRYPTED == GetStatus() && nullptr != pCommands &&
+        0 < commandCount && MAX_PACKET_SIZE >= FrameSize(realSize))
+    {
+        // Anything queued before this must go out first.
+        FlushCommandsLocked();
+
+        // The packet only owns the pooled buffer; nothing is written through
+        // it so the frame is not walked again afterwards.
+        Packet packet;
+
+        uint8_t *pPayload = reinterpret_cast<uint8_t*>(packet.Direct(
+            FrameSize(realSize))) + 2 * sizeof(uint32_t);
+
+        uint32_t written = 0;
+        uint32_t encrypted = 0;
+
+        // A frame that will be compressed must stay plaintext until then.
+        bool compress = mCompression && realSize >= mCompressThreshold;
+
+        for(size_t i = 0; i < commandCount; ++i)
         {
-            SocketError("Failed to request more data.");
+            written += WriteCommand(pPayload + written, pCommands[i]);
+
+            // Encrypt the blocks that are complete while they are still in
+            // the cache.
+            uint32_t blocks = (written - encrypted) /
+                (uint32_t)BLOWFISH_BLOCK_SIZE;
+
+            if(0 < blocks && !compress)
+            {
+                Blowfish::EncryptBlocks(mEncryptionKey, pPayload + encrypted,
+                    blocks);
+                encrypted += blocks * (uint32_t)BLOWFISH_BLOCK_SIZE;
+            }
         }
+
+        SendFrame(packet, realSize, encrypted);
+
+        result = true;
     }
-    else 
-    {
-        // Parsing status.
-        bool status = true;
 
-        // Sanity check the packet contents.
-        if(0 != packet.ReadU32Big())
+    return result;
+}
+
+void LobbyConnection::SetCommandFlush(uint32_t flushSize, uint32_t flushDelay)
+{
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+
+    mCommandFlushSize = flushSize;
+    mCommandFlushDelay = flushDelay;
+}
+
+bool LobbyConnection::QueueCommand(uint16_t commandCode, const void *pData,
+    uint16_t dataSize)
+{
+    AllocationTracker::Scope tag(AllocationTracker::TAG_SEND);
+
+    bool result = false;
+
+    OutgoingCommand_t command;
+    command.commandCode = commandCode;
+    command.pData = pData;
+    command.dataSize = dataSize;
+
+    uint32_t commandSize = (uint32_t)(3 * sizeof(uint16_t)) + dataSize;
+
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+
+    if(STATUS_ENCRYPTED == GetStatus() && (0 == dataSize ||
+        nullptr != pData) && MAX_PACKET_SIZE >= FrameSize(commandSize))
+    {
+        // Seal what is there if this command would not fit in the frame.
+        if(MAX_PACKET_SIZE < FrameSize(mCommandBytes + commandSize))
         {
-            SocketError("Failed to parse encryption data.");
-            status = false;
+            FlushCommandsLocked();
         }
 
-        // Check the size of the base.
-        if(status && strlen(DH_BASE_STRING) != packet.PeekU32Big())
+        if(0 == mCommandBytes)
         {
-            SocketError("Failed to parse encryption base.");
-            status = false;
+            // Most frames are small so only reserve what is likely needed.
+            uint32_t reserve = FrameSize(mCommandFlushSize) + commandSize;
+
+            mCommandFrame.Reserve(MAX_PACKET_SIZE < reserve ?
+                MAX_PACKET_SIZE : reserve);
+
+            StartFlushTimer();
         }
 
-        libcomp::String base;
+        // Leave room for the sizes; the padding is added when sealed.
+        uint8_t *pPayload = reinterpret_cast<uint8_t*>(mCommandFrame.Direct(
+            (uint32_t)(2 * sizeof(uint32_t)) + mCommandBytes +
+            commandSize)) + 2 * sizeof(uint32_t);
+
+        mCommandBytes += WriteCommand(pPayload + mCommandBytes, command);
 
-        if(status)
+        // A slow reader keeps coalescing until the frame is full.
+        if(mCommandBytes >= mCommandFlushSize && IsWritable())
         {
-            base = packet.ReadString32Big(libcomp::Convert::ENCODING_UTF8);
+            FlushCommandsLocked();
         }
 
-        // Check the base matches what is expected.
-        if(status && DH_BASE_STRING != base)
+        result = true;
+    }
+
+    return result;
+}
+
+void LobbyConnection::FlushCommands()
+{
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+
+    // OutgoingDrained() sends what is held back.
+    if(IsWritable())
+    {
+        FlushCommandsLocked();
+    }
+}
+
+void LobbyConnection::OutgoingDrained()
+{
+    FlushCommands();
+}
+
+void LobbyConnection::ConnectionClosing(const libcomp::String& reason)
+{
+    (void)reason;
+
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+
+    // Send the commands that are held back too (the socket is closed once
+    // the queue is empty so no later drain would send them).
+    FlushCommandsLocked();
+}
+
+void LobbyConnection::FlushCommandsLocked()
+{
+    if(0 < mCommandBytes)
+    {
+        uint32_t realSize = mCommandBytes;
+        mCommandBytes = 0;
+
+        SendFrame(mCommandFrame, realSize, 0);
+    }
+}
+
+void LobbyConnection::StartFlushTimer()
+{
+    std::shared_ptr<libcomp::TcpConnection> self = mSelf.lock();
+
+    if(0 == mCommandFlushDelay || nullptr == self)
+    {
+        return;
+    }
+
+    // The timer is not cancelled by a flush (only the io thread may touch
+    // it) so a frame started before it fires is sent early instead.
+    if(!ScheduleTimer(mFlushTimer, mCommandFlushDelay, [this]()
+    {
+        FlushCommands();
+    }))
+    {
+        GetIoService().post([self]()
         {
-            SocketError("Failed to parse encryption base (not "
-                DH_BASE_STRING ").");
-            status = false;
-        }
+            self->FlushCommands();
+        });
+    }
+}
+
+uint32_t LobbyConnection::FrameSize(uint32_t realSize)
+{
+    // The sizes are not part of the padded data.
+    return (uint32_t)(2 * sizeof(uint32_t) + ((realSize +
+        BLOWFISH_BLOCK_SIZE - 1) / BLOWFISH_BLOCK_SIZE) * BLOWFISH_BLOCK_SIZE);
+}
 
-        // Check the size of the prime.
-        if(status && DH_KEY_HEX_SIZE != packet.PeekU32Big())
+uint32_t LobbyConnection::WriteCommand(uint8_t *pDestination,
+    const OutgoingCommand_t& command)
+{
+    // The command size includes the little endian size and code.
+    uint16_t commandSize = (uint16_t)(command.dataSize +
+        2 * sizeof(uint16_t));
+    uint16_t header[3] = {
+        htobe16(commandSize),
+        htole16(commandSize),
+        htole16(command.commandCode),
+    };
+
+    memcpy(pDestination, header, sizeof(header));
+
+    if(0 < command.dataSize)
+    {
+        memcpy(pDestination + sizeof(header), command.pData,
+            command.dataSize);
+    }
+
+    return (uint32_t)sizeof(header) + command.dataSize;
+}
+
+void LobbyConnection::SendFrame(Packet& packet, uint32_t realSize,
+    uint32_t encrypted)
+{
+    const uint32_t sizesSize = 2 * sizeof(uint32_t);
+
+    uint32_t sizeFlags = 0;
+
+    if(0 == encrypted && mCompression && realSize >= mCompressThreshold)
+    {
+        uint32_t compressedSize = realSize;
+
+        CompressFrame(packet, compressedSize);
+
+        if(compressedSize != realSize)
         {
-            SocketError("Failed to parse encryption prime.");
-            status = false;
+            realSize = compressedSize;
+            sizeFlags = FRAME_COMPRESSED_FLAG;
         }
+    }
+
+    uint32_t frameSize = FrameSize(realSize);
+    uint32_t paddedSize = frameSize - sizesSize;
+
+    uint8_t *pFrame = reinterpret_cast<uint8_t*>(packet.Direct(frameSize));
+    uint8_t *pPayload = pFrame + sizesSize;
+
+    uint32_t value = htobe32(paddedSize);
+    memcpy(pFrame, &value, sizeof(value));
+
+    value = htobe32(realSize | sizeFlags);
+    memcpy(pFrame + sizeof(uint32_t), &value, sizeof(value));
+
+    // Pad and encrypt whatever has not been encrypted yet.
+    if(paddedSize > realSize)
+    {
+        memset(pPayload + realSize, 0, paddedSize - realSize);
+    }
+
+    if(paddedSize > encrypted)
+    {
+        Blowfish::EncryptBlocks(mEncryptionKey, pPayload + encrypted,
+            (paddedSize - encrypted) / BLOWFISH_BLOCK_SIZE);
+    }
+
+    ReadOnlyPacket frame(std::move(packet));
+
+    SendPacket(frame);
+}
+
+void LobbyConnection::CompressFrame(Packet& packet, uint32_t& realSize)
+{
+    const uint32_t sizesSize = 2 * sizeof(uint32_t);
+
+    // Only keep the compressed commands if they (and their size) come out
+    // smaller than the plaintext.
+    uint32_t limit = realSize - (uint32_t)sizeof(uint32_t);
+
+    Packet compressed;
+
+    uint8_t *pCompressed = reinterpret_cast<uint8_t*>(compressed.Direct(
+        FrameSize(realSize)));
+    const uint8_t *pPayload = reinterpret_cast<const uint8_t*>(
+        packet.ConstData()) + sizesSize;
+
+    Compress::Compressor *pCompressor = Compress::ThreadCompressor(
+        FRAME_COMPRESS_LEVEL);
+
+    int32_t written = -1;
+
+    if(nullptr != pCompressor)
+    {
+        written = pCompressor->Compress(pPayload, pCompressed + sizesSize +
+            sizeof(uint32_t), (int32_t)realSize, (int32_t)limit);
+    }
+
+    if(0 < written && (uint32_t)written < limit)
+    {
+        // The compressed commands start with their inflated size.
+        uint32_t value = htobe32(realSize);
+        memcpy(pCompressed + sizesSize, &value, sizeof(value));
+
+        gCompressedFrames++;
+        gCompressedBytesIn += realSize;
+
+        realSize = (uint32_t)sizeof(uint32_t) + (uint32_t)written;
+
+        gCompressedBytesOut += realSize;
 
-        libcomp::String prime;
+        packet = std::move(compressed);
+    }
+    else
+    {
+        gIncompressibleFrames++;
+    }
+}
+
+bool LobbyConnection::InflateFrame(Packet& packet, uint32_t& realSize)
+{
+    const uint32_t sizesSize = 2 * sizeof(uint32_t);
+
+    if(!mCompression || (uint32_t)sizeof(uint32_t) >= realSize)
+    {
+        return false;
+    }
 
-        if(status)
+    const uint8_t *pPayload = reinterpret_cast<const uint8_t*>(
+        packet.ConstData()) + sizesSize;
+
+    uint32_t inflatedSize;
+    memcpy(&inflatedSize, pPayload, sizeof(inflatedSize));
+    inflatedSize = be32toh(inflatedSize);
+
+    if(0 == inflatedSize || (MAX_PACKET_SIZE - sizesSize) < inflatedSize)
+    {
+        return false;
+    }
+
+    // Inflate into a pooled buffer laid out like a plaintext frame with no
+    // padding.
+    Packet inflated;
+
+    uint8_t *pInflated = reinterpret_cast<uint8_t*>(inflated.Direct(
+        sizesSize + inflatedSize));
+
+    uint32_t value = htobe32(inflatedSize);
+    memcpy(pInflated, &value, sizeof(value));
+    memcpy(pInflated + sizeof(uint32_t), &value, sizeof(value));
+
+    int32_t written = Compress::ThreadDecompressor()->Decompress(
+        pPayload + sizeof(uint32_t), pInflated + sizesSize,
+        (int32_t)(realSize - sizeof(uint32_t)), (int32_t)inflatedSize);
+
+    if((int32_t)inflatedSize != written)
+    {
+        return false;
+    }
+
+    gInflatedFrames++;
+
+    packet = std::move(inflated);
+    realSize = inflatedSize;
+
+    return true;
+}
+
+bool LobbyConnection::BroadcastEncrypted(const std::list<std::shared_ptr<
+    TcpConnection>>& connections, const OutgoingCommand_t *pCommands,
+    size_t commandCount, SendPriority_t priority)
+{
+    bool result = false;
+
+    uint32_t realSize = 0;
+
+    for(size_t i = 0; i < commandCount; ++i)
+    {
+        realSize += (uint32_t)(3 * sizeof(uint16_t)) + pCommands[i].dataSize;
+    }
+
+    uint32_t frameSize = FrameSize(realSize);
+
+    if(nullptr != pCommands && 0 < commandCount &&
+        MAX_PACKET_SIZE >= frameSize)
+    {
+        const uint32_t sizesSize = 2 * sizeof(uint32_t);
+
+        // Build the plaintext frame once for every recipient.
+        Packet packet;
+
+        uint8_t *pFrame = reinterpret_cast<uint8_t*>(packet.Direct(
+            frameSize));
+        uint8_t *pPayload = pFrame + sizesSize;
+
+        uint32_t value = htobe32(frameSize - sizesSize);
+        memcpy(pFrame, &value, sizeof(value));
+
+        value = htobe32(realSize);
+        memcpy(pFrame + sizeof(uint32_t), &value, sizeof(value));
+
+        uint32_t written = 0;
+
+        for(size_t i = 0; i < commandCount; ++i)
         {
-            prime = packet.ReadString32Big(libcomp::Convert::ENCODING_UTF8);
+            written += WriteCommand(pPayload + written, pCommands[i]);
         }
 
-        // Check the size of the server public.
-        if(status && DH_KEY_HEX_SIZE != packet.PeekU32Big())
+        if(frameSize - sizesSize > written)
         {
-            SocketError("Failed to parse encryption server public.");
-            status = false;
+            memset(pPayload + written, 0, frameSize - sizesSize - written);
         }
 
-        libcomp::String serverPublic;
+        std::shared_ptr<ReadOnlyPacket> plaintext(new ReadOnlyPacket(
+            std::move(packet)));
 
-        if(status)
+        PostToOwners(connections, [plaintext, priority](const std::vector<
+            std::shared_ptr<TcpConnection>>& recipients)
         {
-            serverPublic = packet.ReadString32Big(
-                libcomp::Convert::ENCODING_UTF8);
+            for(auto& recipient : recipients)
+            {
+                std::shared_ptr<LobbyConnection> connection =
+                    std::dynamic_pointer_cast<LobbyConnection>(recipient);
+
+                if(connection)
+                {
+                    (void)connection->SendPlaintextFrame(*plaintext,
+                        priority);
+                }
+            }
+        });
+
+        result = true;
+    }
+
+    return result;
+}
+
+LobbyConnection::BroadcastStats_t LobbyConnection::GetBroadcastStats()
+{
+    BroadcastStats_t stats;
+    stats.framesEncrypted = GetBroadcastMetrics().frames.Value();
+    stats.bytesEncrypted = GetBroadcastMetrics().bytes.Value();
+    stats.encryptTime = GetBroadcastMetrics().time.Value();
+
+    return stats;
+}
+
+LobbyConnection::CompressionStats_t LobbyConnection::GetCompressionStats()
+{
+    CompressionStats_t stats;
+    stats.framesCompressed = gCompressedFrames;
+    stats.bytesIn = gCompressedBytesIn;
+    stats.bytesOut = gCompressedBytesOut;
+    stats.framesIncompressible = gIncompressibleFrames;
+    stats.framesInflated = gInflatedFrames;
+
+    return stats;
+}
+
+bool LobbyConnection::SendPlaintextFrame(const ReadOnlyPacket& plaintext,
+    SendPriority_t priority)
+{
+    bool result = false;
+
+    const uint32_t sizesSize = 2 * sizeof(uint32_t);
+
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+
+    // Don't encrypt a frame that would only be dropped.
+    if(STATUS_ENCRYPTED == GetStatus() && sizesSize <= plaintext.Size() &&
+        (PRIORITY_LOW != priority || IsWritable()))
+    {
+        // Anything queued before this must go out first.
+        FlushCommandsLocked();
+
+        uint32_t paddedSize = plaintext.Size() - sizesSize;
+
+        Packet packet;
+
+        uint8_t *pFrame = reinterpret_cast<uint8_t*>(packet.Direct(
+            plaintext.Size()));
+        const uint8_t *pPlaintext = reinterpret_cast<const uint8_t*>(
+            plaintext.ConstData());
+
+        // The sizes are not encrypted.
+        memcpy(pFrame, pPlaintext, sizesSize);
+
+        auto start = std::chrono::steady_clock::now();
+
+        Blowfish::EncryptBlocks(mEncryptionKey, pPlaintext + sizesSize,
+            pFrame + sizesSize, paddedSize / BLOWFISH_BLOCK_SIZE);
+
+        BroadcastMetrics& metrics = GetBroadcastMetrics();
+        metrics.time.Increment((uint64_t)std::chrono::duration_cast<
+            std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+            start).count());
+        metrics.bytes.Increment(paddedSize);
+        metrics.frames.Increment();
+
+        ReadOnlyPacket frame(std::move(packet));
+
+        result = SendPacket(frame, priority);
+    }
+
+    return result;
+}
+
+void LobbyConnection::ConnectionEncrypted()
+{
+    StopHandshakeTimeout();
+
+    /// @todo Implement (send an event to the queue).
+    LOG_DEBUG("Connection encrypted!\n");
+
+    if(IsStreamingReceive())
+    {
+        // Read everything the socket has and parse whole frames from it.
+        if(!RequestStream())
+        {
+            SocketError("Failed to request more data.");
         }
+    }
+    else
+    {
+        // Start reading until we have the packet sizes.
+        if(!RequestPacket(2 * sizeof(uint32_t)))
+        {
+            SocketError("Failed to request more data.");
+        }
+    }
+}
 
-        // Make sure we read the entire packet.
-        if(status && 0 == packet.Left())
+#include <asio/yield.hpp>
+
+void LobbyConnection::ClientHandshake::Step(bool success,
+    libcomp::Packet *pPacket)
+{
+    LobbyConnection *pConnection = mConnection;
+
+    if(!success)
+    {
+        // The read already closed the socket.
+        return;
+    }
+
+    try
+    {
+        reenter(this)
         {
-            mStatus = STATUS_WAITING_ENCRYPTION;
+            {
+                libcomp::Packet packet;
+
+                packet.WriteU32Big(1);
+                packet.WriteU32Big(8);
+
+                // Send a packet after connecting.
+                pConnection->SendPacket(packet);
+            }
+
+            // Wait for the whole first reply.
+            yield if(!pConnection->AsyncRead(strlen(DH_BASE_STRING) +
+                2 * DH_KEY_HEX_SIZE + 4 * sizeof(uint32_t), *this))
+            {
+                pConnection->SocketError("Failed to request more data.");
+            }
+
+            success = pConnection->ReadServerKeys(*pPacket, mState->prime,
+                mState->serverPublic);
+
+            // Get ready for the next packet.
+            pPacket->Clear();
+
+            if(!success)
+            {
+                return;
+            }
+
+            pConnection->mStatus = STATUS_WAITING_ENCRYPTION;
+
+            // Load the prime and base.
+            pConnection->mDiffieHellman =
+                libcomp::TcpServer::LoadDiffieHellman(mState->prime.data(),
+                mState->prime.size());
+
+            yield pConnection->RunHandshakeStep(GenerateKeys(), *this);
+
+            if(DH_SHARED_DATA_SIZE != mState->sharedData.size())
+            {
+                pConnection->SocketError("Failed to generate encryption "
+                    "client public and shared data.");
+
+                return;
+            }
+
+            libcomp::Packet reply;
+
+            // Form the reply.
+            WriteDiffieHellmanKey(reply, mState->clientPublic);
+
+            // Send the reply.
+            pConnection->SendPacket(reply);
+
+            // Set the encryption key.
+            pConnection->SetEncryptionKey(mState->sharedData);
+
+            // We are now encrypted.
+            pConnection->mStatus = STATUS_ENCRYPTED;
+
+            // Use this packet parser now.
+            pConnection->mPacketParser = &LobbyConnection::ParsePacket;
+
+            // Callback.
+            pConnection->ConnectionEncrypted();
+        }
+    }
+    catch(libcomp::Exception& e)
+    {
+        e.Log();
+
+        // This connection is now bad; kill it.
+        pConnection->SocketError();
+    }
+}
 
-            // Load the prime and base.
-            mDiffieHellman = libcomp::TcpServer::LoadDiffieHellman(prime);
+#include <asio/unyield.hpp>
 
-            // Generate the client public.
-            libcomp::String clientPublic = GenerateDiffieHellmanPublic(
-                mDiffieHellman);
+bool LobbyConnection::ReadServerKeys(libcomp::Packet& packet,
+    DiffieHellmanKey_t& prime, DiffieHellmanKey_t& serverPublic)
+{
+    // Sanity check the packet contents.
+    if(0 != packet.ReadU32Big())
+    {
+        SocketError("Failed to parse encryption data.");
 
-            // Generate the shared data.
-            std::vector<char> sharedData = GenerateDiffieHellmanSharedData(
-                mDiffieHellman, serverPublic);
+        return false;
+    }
 
-            if(DH_KEY_HEX_SIZE != clientPublic.Length() ||
-                DH_SHARED_DATA_SIZE != sharedData.size())
-            {
-                // Get ready for the next packet.
-                packet.Clear();
+    // Check the size of the base.
+    if(strlen(DH_BASE_STRING) != packet.PeekU32Big())
+    {
+        SocketError("Failed to parse encryption base.");
 
-                SocketError("Failed to generate encryption client public and "
-                    "shared data.");
-            }
-            else
-            {
-                libcomp::Packet reply;
+        return false;
+    }
 
-                // Form the reply.
-                reply.WriteString32Big(libcomp::Convert::ENCODING_UTF8,
-                    clientPublic);
+    libcomp::String base = packet.ReadString32Big(
+        libcomp::Convert::ENCODING_UTF8);
 
-                // Send the reply.
-                SendPacket(reply);
+    // Check the base matches what is expected.
+    if(DH_BASE_STRING != base)
+    {
+        SocketError("Failed to parse encryption base (not "
+            DH_BASE_STRING ").");
 
-                // Set the encryption key.
-                SetEncryptionKey(sharedData);
+        return false;
+    }
 
-                // We are now encrypted.
-                mStatus = STATUS_ENCRYPTED;
+    // Check the size of the prime and decode it.
+    if(!ReadDiffieHellmanKey(packet, prime))
+    {
+        SocketError("Failed to parse encryption prime.");
 
-                // Use this packet parser now.
-                mPacketParser = &LobbyConnection::ParsePacket;
+        return false;
+    }
 
-                // Get ready for the next packet.
-                packet.Clear();
+    // Check the size of the server public and decode it.
+    if(!ReadDiffieHellmanKey(packet, serverPublic))
+    {
+        SocketError("Failed to parse encryption server public.");
 
-                // Callback.
-                ConnectionEncrypted();
-            }
-        }
-        else
-        {
-            // Get ready for the next packet.
-            packet.Clear();
+        return false;
+    }
 
-            SocketError("Read too much data for packet.");
-        }
+    // Make sure we read the entire packet.
+    if(0 != packet.Left())
+    {
+        SocketError("Read too much data for packet.");
+
+        return false;
     }
+
+    return true;
 }
 
 void LobbyConnection::ParseServerEncryptionStart(libcomp::Packet& packet)
@@ -270,28 +954,47 @@ void LobbyConnection::ParseServerEncryptionStart(libcomp::Packet& packet)
         {
             mStatus = STATUS_WAITING_ENCRYPTION;
 
-            libcomp::Packet reply;
-
-            reply.WriteBlank(4);
-            reply.WriteString32Big(libcomp::Convert::ENCODING_UTF8,
-                DH_BASE_STRING);
-            reply.WriteString32Big(libcomp::Convert::ENCODING_UTF8,
-                GetDiffieHellmanPrime(mDiffieHellman));
-            reply.WriteString32Big(libcomp::Convert::ENCODING_UTF8,
-                GenerateDiffieHellmanPublic(mDiffieHellman));
-
-            SendPacket(reply);
-
             mPacketParser = &LobbyConnection::ParseServerEncryptionFinish;
 
             // Get ready for the next packet.
             packet.Clear();
 
-            // Wait for the client public.
-            if(!RequestPacket(DH_KEY_HEX_SIZE + sizeof(uint32_t)))
+            std::shared_ptr<DiffieHellmanKey_t> serverPublic(
+                new DiffieHellmanKey_t);
+            std::shared_ptr<bool> generated(new bool(false));
+
+            RunHandshakeStep([this, serverPublic, generated]()
             {
-                SocketError("Failed to request more data.");
-            }
+                *generated = GenerateDiffieHellmanPublic(mDiffieHellman,
+                    *serverPublic);
+            }, [this, serverPublic, generated]()
+            {
+                DiffieHellmanKey_t prime;
+
+                if(!*generated || !GetDiffieHellmanPrime(mDiffieHellman,
+                    prime))
+                {
+                    SocketError("Failed to generate server public.");
+
+                    return;
+                }
+
+                libcomp::Packet reply;
+
+                reply.WriteBlank(4);
+                reply.WriteString32Big(libcomp::Convert::ENCODING_UTF8,
+                    DH_BASE_STRING);
+                WriteDiffieHellmanKey(reply, prime);
+                WriteDiffieHellmanKey(reply, *serverPublic);
+
+                SendPacket(reply);
+
+                // Wait for the client public.
+                if(!RequestPacket(DH_KEY_HEX_SIZE + sizeof(uint32_t)))
+                {
+                    SocketError("Failed to request more data.");
+                }
+            });
         }
         else
         {
@@ -319,51 +1022,49 @@ void LobbyConnection::ParseServerEncryptionFinish(libcomp::Packet& packet)
         // Parsing status.
         bool status = true;
 
-        // Check the size of the client public.
-        if(status && DH_KEY_HEX_SIZE != packet.PeekU32Big())
+        DiffieHellmanKey_t clientPublic;
+
+        // Check the size of the client public and decode it.
+        if(!ReadDiffieHellmanKey(packet, clientPublic))
         {
             SocketError("Failed to parse encryption client public.");
             status = false;
         }
 
-        libcomp::String clientPublic;
-
-        if(status)
-        {
-            clientPublic = packet.ReadString32Big(
-                libcomp::Convert::ENCODING_UTF8);
-        }
-
         // Make sure we read the entire packet.
         if(status && 0 == packet.Left())
         {
-            std::vector<char> sharedData = GenerateDiffieHellmanSharedData(
-                mDiffieHellman, clientPublic);
+            // Get ready for the next packet.
+            packet.Clear();
 
-            if(DH_SHARED_DATA_SIZE != sharedData.size())
-            {
-                // Get ready for the next packet.
-                packet.Clear();
+            std::shared_ptr<std::vector<char>> sharedData(
+                new std::vector<char>);
 
-                SocketError("Failed to generate shared data.");
-            }
-            else
+            RunHandshakeStep([this, sharedData, clientPublic]()
             {
-                // Set the encryption key.
-                SetEncryptionKey(sharedData);
-
-                // We are now encrypted.
-                mStatus = STATUS_ENCRYPTED;
+                *sharedData = GenerateDiffieHellmanSharedData(
+                    mDiffieHellman, clientPublic);
+            }, [this, sharedData]()
+            {
+                if(DH_SHARED_DATA_SIZE != sharedData->size())
+                {
+                    SocketError("Failed to generate shared data.");
+                }
+                else
+                {
+                    // Set the encryption key.
+                    SetEncryptionKey(*sharedData);
 
-                // Use this packet parser now.
-                mPacketParser = &LobbyConnection::ParsePacket;
+                    // We are now encrypted.
+                    mStatus = STATUS_ENCRYPTED;
 
-                // Get ready for the next packet.
-                packet.Clear();
+                    // Use this packet parser now.
+                    mPacketParser = &LobbyConnection::ParsePacket;
 
-                // Callback.
-                ConnectionEncrypted();
-            }
+                    // Callback.
+                    ConnectionEncrypted();
+                }
+            });
         }
         else
         {
@@ -381,26 +1082,24 @@ void LobbyConnection::ParsePacket(libcomp::Packet& packet)
 
     if(STATUS_ENCRYPTED == GetStatus())
     {
-        // Check if we have all the data.
-        if((2 * sizeof(uint32_t)) > packet.Size())
+        uint32_t paddedSize, realSize;
+
+        // Check if we have all the data (and read the sizes if we do).
+        if(!EncryptedHeader_t::Read(packet, paddedSize, realSize))
         {
             // Keep reading until we have the packet sizes.
-            if(!RequestPacket(2 * sizeof(uint32_t) - packet.Size()))
+            if(!RequestPacket(EncryptedHeader_t::SIZE - packet.Size()))
             {
                 SocketError("Failed to request more data.");
             }
         }
         else
         {
-            // Read the sizes.
-            uint32_t paddedSize = packet.ReadU32Big();
-            uint32_t realSize = packet.ReadU32Big();
-
             // Check for enough packet data (the sizes are not included).
-            if((paddedSize + 2 * sizeof(uint32_t)) > packet.Size())
+            if((paddedSize + EncryptedHeader_t::SIZE) > packet.Size())
             {
                 // Keep reading until we have the packet.
-                if(!RequestPacket(paddedSize + 2 * sizeof(uint32_t) -
+                if(!RequestPacket(paddedSize + EncryptedHeader_t::SIZE -
                     packet.Size()))
                 {
                     SocketError("Failed to request more data.");
@@ -413,6 +1112,14 @@ void LobbyConnection::ParsePacket(libcomp::Packet& packet)
 
                 // Get ready for the next packet.
                 packet.Clear();
+
+                // Start reading the sizes of the next packet (unless the
+                // packet was bad and the connection is closed).
+                if(STATUS_ENCRYPTED == GetStatus() &&
+                    !RequestPacket(EncryptedHeader_t::SIZE))
+                {
+                    SocketError("Failed to request more data.");
+                }
             }
         }
     }
@@ -428,47 +1135,120 @@ void LobbyConnection::ParsePacket(libcomp::Packet& packet)
 void LobbyConnection::ParsePacket(libcomp::Packet& packet,
     uint32_t paddedSize, uint32_t realSize)
 {
+    AllocationTracker::Scope tag(AllocationTracker::TAG_PARSE);
+    TRACE_SCOPE("parse");
+
+    CommandProfiler *pProfiler = CommandProfiler::GetSingletonPtr();
+    bool profiling = pProfiler->IsEnabled();
+    std::chrono::steady_clock::time_point received;
+
+    if(profiling)
+    {
+        received = std::chrono::steady_clock::now();
+    }
+
     // Decrypt the packet
     Decrypt::DecryptPacket(mEncryptionKey, packet);
 
-    // Move the packet into a read only copy.
-    ReadOnlyPacket copy(packet);
+    if(0 != (realSize & FRAME_COMPRESSED_FLAG))
+    {
+        realSize &= ~FRAME_COMPRESSED_FLAG;
+
+        if(realSize > paddedSize || !InflateFrame(packet, realSize))
+        {
+            ProtocolViolation(ProtocolError::CODE_BAD_COMPRESSED_FRAME);
+
+            return;
+        }
+
+        // The inflated frame has no padding.
+        paddedSize = realSize;
+    }
+
+    // Move the packet into a read only copy. This takes the buffer away from
+    // the receive packet so the next read can't overwrite the commands that
+    // are still waiting in the message queue.
+    ReadOnlyPacket copy(std::move(packet));
 
     // Make sure we are at the right spot (right after the sizes).
     copy.Seek(2 * sizeof(uint32_t));
 
+    // This will stop the command parsing.
+    bool errorFound = false;
+
+    if(realSize > paddedSize || copy.Left() < paddedSize)
+    {
+        ProtocolViolation(ProtocolError::CODE_BAD_SIZES, &copy, 0);
+
+        return;
+    }
+
     // Calculate how much data is padding.
     uint32_t padding = paddedSize - realSize;
 
-    // This will stop the command parsing.
-    bool errorFound = false;
+    if(nullptr == mMessageQueue)
+    {
+        SocketError("No message queue for packet.");
+
+        errorFound = true;
+    }
+
+    // Promote to a shared pointer.
+    std::shared_ptr<libcomp::TcpConnection> self = mSelf.lock();
+
+    if(!errorFound && this != self.get())
+    {
+        SocketError("Failed to obtain a shared pointer.");
+
+        errorFound = true;
+    }
+
+    // Either every command goes into one frame message or each command gets
+    // a message. Both are sent to the queue at once after the frame.
+    std::unique_ptr<libcomp::Message::PacketFrame> frame;
+    std::list<libcomp::Message::Message*> messages;
+
+    // Every message of the frame shares this one connection reference.
+    libcomp::ConnectionHandle handle;
+
+    if(!errorFound)
+    {
+        handle = libcomp::ConnectionHandle(self);
+    }
+
+    if(!errorFound && mFrameDispatch)
+    {
+        frame.reset(new libcomp::Message::PacketFrame(std::move(handle),
+            copy));
+    }
 
     // Keep reading each command (sometimes called a packet) inside the
     // decrypted packet from the network socket.
     while(!errorFound && copy.Left() > padding)
     {
+        // The big endian size is ignored (we think it is the same).
+        uint16_t bigSize, commandSize, commandCode;
+
         // Make sure there is enough data
-        if(copy.Left() < 3 * sizeof(uint16_t))
+        if(!CommandHeader_t::Read(copy, bigSize, commandSize, commandCode))
         {
-            SocketError("Corrupt packet (not enough data for command header).");
+            ProtocolViolation(ProtocolError::CODE_SHORT_COMMAND_HEADER, &copy,
+                copy.Tell());
 
             errorFound = true;
         }
         else
         {
-            // Skip over the big endian size (we think).
-            copy.Skip(2);
-
-            // Remember where this command started so we may advance over it
-            // after it has been parsed.
-            uint32_t commandStart = copy.Tell();
-            uint16_t commandSize = copy.ReadU16Little();
-            uint16_t commandCode = copy.ReadU16Little();
+            // Remember where this command started (after the big endian
+            // size) so we may advance over it after it has been parsed.
+            uint32_t commandStart = copy.Tell() -
+                (uint32_t)(2 * sizeof(uint16_t));
 
             // With no data, the command size is 4 bytes (code + a size).
             if(commandSize < 2 * sizeof(uint16_t))
             {
-                SocketError("Corrupt packet (not enough data for command).");
+                ProtocolViolation(ProtocolError::CODE_SHORT_COMMAND, &copy,
+                    commandStart);
 
                 errorFound = true;
             }
@@ -477,39 +1257,33 @@ void LobbyConnection::ParsePacket(libcomp::Packet& packet,
             if(!errorFound && copy.Left() < (uint32_t)(commandSize -
                 2 * sizeof(uint16_t)))
             {
-                copy.HexDump();
-                SocketError("Corrupt packet (not enough data for "
-                    "command data).");
-
-                errorFound = true;
-            }
-
-            if(!errorFound && nullptr == mMessageQueue)
-            {
-                SocketError("No message queue for packet.");
-
-                errorFound = true;
-            }
-
-            // Promote to a shared pointer.
-            std::shared_ptr<libcomp::TcpConnection> self = mSelf.lock();
-
-            if(!errorFound && this != self.get())
-            {
-                SocketError("Failed to obtain a shared pointer.");
+                ProtocolViolation(ProtocolError::CODE_SHORT_COMMAND_DATA,
+                    &copy, commandStart);
 
                 errorFound = true;
             }
 
             if(!errorFound)
             {
-                // This is a shallow copy of the command data.
-                ReadOnlyPacket command(copy, commandStart +
-                    2 * sizeof(uint16_t), commandSize - 2 * sizeof(uint16_t));
+                uint32_t dataStart = commandStart +
+                    (uint32_t)(2 * sizeof(uint16_t));
+                uint32_t dataSize = (uint32_t)(commandSize -
+                    2 * sizeof(uint16_t));
+
+                if(frame)
+                {
+                    frame->AddCommand(commandCode, dataStart, dataSize);
+                }
+                else
+                {
+                    // This is a shallow copy of the command data.
+                    ReadOnlyPacket command(copy, dataStart, dataSize);
 
-                // Notify the task about the new packet.
-                mMessageQueue->Enqueue(new libcomp::Message::Packet(self,
-                    commandCode, copy));
+                    // Nothing has been queued yet so the handle may be
+                    // shared without an atomic increment.
+                    messages.push_back(new libcomp::Message::Packet(
+                        handle.Borrow(), commandCode, command));
+                }
             }
 
             // Move to the next command.
@@ -528,7 +1302,107 @@ void LobbyConnection::ParsePacket(libcomp::Packet& packet,
 
     if(!errorFound && copy.Left() != 0)
     {
-        SocketError("Corrupt packet has extra data.");
+        ProtocolViolation(ProtocolError::CODE_EXTRA_DATA, &copy, copy.Tell());
+
+        errorFound = true;
+    }
+
+    static MetricCounter& frames = Metrics::GetSingletonPtr()->Counter(
+        "comp_lobby_frames_total", "Frames decrypted and parsed.");
+    static MetricCounter& commands = Metrics::GetSingletonPtr()->Counter(
+        "comp_lobby_commands_total", "Commands queued for the server.");
+    static MetricCounter& corrupt = Metrics::GetSingletonPtr()->Counter(
+        "comp_lobby_corrupt_frames_total", "Frames dropped as corrupt.");
+    static MetricGauge& queueDepth = Metrics::GetSingletonPtr()->Gauge(
+        "comp_message_queue_depth", "Messages waiting for the server.");
+
+    frames.Increment();
+
+    if(!errorFound && profiling)
+    {
+        uint64_t queueTime = (uint64_t)std::chrono::duration_cast<
+            std::chrono::microseconds>(std::chrono::steady_clock::now() -
+            received).count();
+
+        if(frame)
+        {
+            for(auto& command : frame->GetCommands())
+            {
+                pProfiler->RecordReceived(command.commandCode,
+                    command.length, queueTime);
+            }
+        }
+        else
+        {
+            for(auto pMessage : messages)
+            {
+                libcomp::Message::Packet *pPacket = static_cast<
+                    libcomp::Message::Packet*>(pMessage);
+
+                pProfiler->RecordReceived(pPacket->GetCommandCode(),
+                    pPacket->GetPacket().Size(), queueTime);
+            }
+        }
+    }
+
+    PacketCapture *pCapture = PacketCapture::GetSingletonPtr();
+
+    if(!errorFound && pCapture->IsCapturing())
+    {
+        uint64_t id = GetConnectionID();
+
+        if(frame)
+        {
+            const char *pFrameData = frame->GetFrame().ConstData();
+
+            for(auto& command : frame->GetCommands())
+            {
+                pCapture->Record(PacketCapture::TYPE_COMMAND, id,
+                    command.commandCode, pFrameData + command.offset,
+                    command.length);
+            }
+        }
+        else
+        {
+            for(auto pMessage : messages)
+            {
+                libcomp::Message::Packet *pPacket = static_cast<
+                    libcomp::Message::Packet*>(pMessage);
+                ReadOnlyPacket& command = pPacket->GetPacket();
+
+                pCapture->Record(PacketCapture::TYPE_COMMAND, id,
+                    pPacket->GetCommandCode(), command.ConstData(),
+                    command.Size());
+            }
+        }
+    }
+
+    TRACE_SCOPE("queue");
+
+    // Notify the task about the new commands.
+    if(errorFound)
+    {
+        corrupt.Increment();
+
+        for(auto pMessage : messages)
+        {
+            delete pMessage;
+        }
+    }
+    else if(frame)
+    {
+        if(0 < frame->GetCommandCount())
+        {
+            commands.Increment(frame->GetCommandCount());
+            mMessageQueue->Enqueue(frame.release());
+            queueDepth.Set((int64_t)mMessageQueue->Size());
+        }
+    }
+    else if(!messages.empty())
+    {
+        commands.Increment(messages.size());
+        mMessageQueue->Enqueue(messages);
+        queueDepth.Set((int64_t)mMessageQueue->Size());
     }
 }
 
@@ -543,10 +1417,85 @@ void LobbyConnection::PacketReceived(libcomp::Packet& packet)
         }
         catch(libcomp::Exception& e)
         {
-            e.Log();
+            // This connection is now bad; kill it. The full log (with the
+            // backtrace and packet) is only written for sampled reports.
+            if(ProtocolViolation(ProtocolError::CODE_EXCEPTION))
+            {
+                e.Log();
+            }
+        }
+    }
+}
+
+void LobbyConnection::StreamReceived(libcomp::RingBuffer& buffer)
+{
+    try
+    {
+        bool parsing = true;
+
+        // Parse every complete frame in the buffer.
+        while(parsing && STATUS_ENCRYPTED == GetStatus())
+        {
+            int32_t available = buffer.Available();
+
+            const uint8_t *pData = reinterpret_cast<const uint8_t*>(
+                buffer.BeginRead(available));
+
+            uint32_t paddedSize = 0;
+            uint32_t realSize = 0;
+
+            if(nullptr == pData || (int32_t)(2 * sizeof(uint32_t)) >
+                available)
+            {
+                // Wait for the sizes.
+                parsing = false;
+            }
+            else
+            {
+                memcpy(&paddedSize, pData, sizeof(paddedSize));
+                memcpy(&realSize, pData + sizeof(paddedSize),
+                    sizeof(realSize));
+
+                paddedSize = be32toh(paddedSize);
+                realSize = be32toh(realSize);
+
+                if((realSize & ~FRAME_COMPRESSED_FLAG) > paddedSize ||
+                    (MAX_PACKET_SIZE - 2 * sizeof(uint32_t)) < paddedSize)
+                {
+                    ProtocolViolation(ProtocolError::CODE_BAD_SIZES);
+
+                    parsing = false;
+                }
+                else if((int32_t)(paddedSize + 2 * sizeof(uint32_t)) >
+                    available)
+                {
+                    // Wait for the rest of the frame.
+                    parsing = false;
+                }
+            }
+
+            if(parsing)
+            {
+                int32_t frameSize = (int32_t)(paddedSize +
+                    2 * sizeof(uint32_t));
 
-            // This connection is now bad; kill it.
-            SocketError();
+                // The frame is never split thanks to the mirrored buffer so
+                // this is the only copy (into a pooled packet buffer).
+                libcomp::Packet packet(pData, (uint32_t)frameSize);
+
+                (void)buffer.EndRead(frameSize);
+
+                ParsePacket(packet, paddedSize, realSize);
+            }
+        }
+    }
+    catch(libcomp::Exception& e)
+    {
+        // This connection is now bad; kill it. The full log (with the
+        // backtrace and packet) is only written for sampled reports.
+        if(ProtocolViolation(ProtocolError::CODE_EXCEPTION))
+        {
+            e.Log();
         }
     }
 }
@@ -556,3 +1505,65 @@ void LobbyConnection::SetMessageQueue(const std::shared_ptr<
 {
     mMessageQueue = messageQueue;
 }
+
+void LobbyConnection::SetFrameDispatch(bool enabled)
+{
+    mFrameDispatch = enabled;
+}
+
+void LobbyConnection::SetCompression(bool enabled, uint32_t threshold)
+{
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+
+    mCompression = enabled;
+    mCompressThreshold = threshold;
+}
+
+void LobbyConnection::SetCryptoPool(
+    const std::shared_ptr<WorkerPool>& cryptoPool)
+{
+    mCryptoPool = cryptoPool;
+}
+
+void LobbyConnection::RunHandshakeStep(const std::function<void()>& work,
+    const std::function<void()>& finish)
+{
+    if(nullptr == mCryptoPool)
+    {
+        work();
+        finish();
+
+        return;
+    }
+
+    // Keep the connection alive until the step has finished.
+    std::shared_ptr<libcomp::TcpConnection> self = mSelf.lock();
+
+    if(this != self.get())
+    {
+        SocketError("Failed to obtain a shared pointer.");
+
+        return;
+    }
+
+    asio::io_service& service = GetIoService();
+
+    bool queued = mCryptoPool->Submit([self, work, finish, &service]()
+    {
+        work();
+
+        // Resume the state machine on the thread that owns the connection.
+        service.post([self, finish]()
+        {
+            if(STATUS_NOT_CONNECTED != self->GetStatus())
+            {
+                finish();
+            }
+        });
+    });
+
+    if(!queued)
+    {
+        SocketError("Handshake queue is full.");
+    }
+}
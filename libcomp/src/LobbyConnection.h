@@ -31,9 +31,14 @@
 #include "MessageQueue.h"
 #include "TcpConnection.h"
 
+// Standard C++11 Includes
+#include <functional>
+
 namespace libcomp
 {
 
+class WorkerPool;
+
 namespace Message
 {
 
@@ -44,6 +49,60 @@ class Message;
 class LobbyConnection : public libcomp::TcpConnection
 {
 public:
+    /**
+     * Plaintext command to send with @ref SendEncrypted.
+     */
+    typedef struct
+    {
+        /// Code of the command.
+        uint16_t commandCode;
+
+        /// Command data (without the command header).
+        const void *pData;
+
+        /// Number of bytes of command data.
+        uint16_t dataSize;
+    } OutgoingCommand_t;
+
+    /**
+     * Counters for @ref BroadcastEncrypted. Dividing @em bytesEncrypted by
+     * @em encryptTime gives the encryption rate of a single core since the
+     * time is summed over every thread that did the work.
+     */
+    typedef struct
+    {
+        /// Number of frames encrypted for broadcast recipients.
+        uint64_t framesEncrypted;
+
+        /// Number of bytes encrypted for broadcast recipients.
+        uint64_t bytesEncrypted;
+
+        /// Nanoseconds spent encrypting (summed over all threads).
+        uint64_t encryptTime;
+    } BroadcastStats_t;
+
+    /**
+     * Counters for compressed frames (see @ref SetCompression). The bytes
+     * saved are @em bytesIn minus @em bytesOut.
+     */
+    typedef struct
+    {
+        /// Number of frames sent compressed.
+        uint64_t framesCompressed;
+
+        /// Number of command bytes in the frames that were compressed.
+        uint64_t bytesIn;
+
+        /// Number of bytes the compressed frames took instead.
+        uint64_t bytesOut;
+
+        /// Number of frames that were big enough but did not get smaller.
+        uint64_t framesIncompressible;
+
+        /// Number of compressed frames received and inflated.
+        uint64_t framesInflated;
+    } CompressionStats_t;
+
     LobbyConnection(asio::io_service& io_service);
     LobbyConnection(asio::ip::tcp::socket& socket, DH *pDiffieHellman);
     virtual ~LobbyConnection();
@@ -53,10 +112,128 @@ public:
     void SetMessageQueue(const std::shared_ptr<MessageQueue<
         libcomp::Message::Message*>>& messageQueue);
 
+    /**
+     * Choose how received commands are sent to the message queue. By
+     * default each command is sent as a Message::Packet. With frame dispatch
+     * all the commands of a frame are sent as one Message::PacketFrame that
+     * shares the frame buffer.
+     * @param enabled true to send one message per frame.
+     */
+    void SetFrameDispatch(bool enabled);
+
+    /**
+     * Run the Diffie-Hellman steps of the handshake on a worker pool
+     * instead of the network thread. Without a pool they run inline.
+     * @param cryptoPool Pool to run the key exchange on.
+     */
+    void SetCryptoPool(const std::shared_ptr<WorkerPool>& cryptoPool);
+
+    /**
+     * Enable compressed frames. Frames with at least @em threshold bytes of
+     * commands are compressed before they are encrypted (if that makes them
+     * smaller) and compressed frames from the other side are accepted. Both
+     * sides of the connection must enable this.
+     * @param enabled true to send and accept compressed frames.
+     * @param threshold Smallest frame (in bytes of commands) to compress.
+     */
+    void SetCompression(bool enabled,
+        uint32_t threshold = FRAME_COMPRESS_THRESHOLD);
+
+    /**
+     * Send a single command. See the other overload for details.
+     * @param commandCode Code of the command.
+     * @param pData Command data (without the command header).
+     * @param dataSize Number of bytes of command data.
+     * @returns true if the command was queued to be sent.
+     */
+    bool SendEncrypted(uint16_t commandCode, const void *pData,
+        uint16_t dataSize);
+
+    /**
+     * Send commands as one encrypted frame. The sizes, command headers and
+     * padding are written straight into a pooled buffer and each block is
+     * encrypted as soon as it is complete, so the frame is only written once
+     * (no Decrypt::EncryptPacket pass over a Packet).
+     * @param pCommands Commands to put in the frame.
+     * @param commandCount Number of commands.
+     * @returns true if the frame was queued to be sent; false if the
+     *   connection is not encrypted or the frame would be too big.
+     */
+    bool SendEncrypted(const OutgoingCommand_t *pCommands,
+        size_t commandCount);
+
+    /**
+     * Set when commands added with @ref QueueCommand are sealed into a frame
+     * and sent (besides an explicit @ref FlushCommands).
+     * @param flushSize Send once this many bytes of commands are waiting.
+     * @param flushDelay Send this many milliseconds after the first command
+     *   of a frame was queued (on the next tick of the timer wheel of the
+     *   connection). Without a timer wheel the commands are sent once the
+     *   io thread is done with the handlers that are ready. Zero disables
+     *   the timer.
+     */
+    void SetCommandFlush(uint32_t flushSize, uint32_t flushDelay);
+
+    /**
+     * Add a command to the frame being built. The command is copied so the
+     * data may be reused right away. Commands are sent in the order they
+     * were queued, and before anything sent with @ref SendEncrypted later.
+     * @param commandCode Code of the command.
+     * @param pData Command data (without the command header).
+     * @param dataSize Number of bytes of command data.
+     * @returns true if the command was queued; false if the connection is
+     *   not encrypted or the command is too big for a frame.
+     */
+    bool QueueCommand(uint16_t commandCode, const void *pData,
+        uint16_t dataSize);
+
+    /**
+     * Seal the queued commands into a frame and send it now. Call this at
+     * the end of a tick to send everything the tick produced together.
+     * While the connection is not writable the commands are held back (and
+     * keep coalescing) until the send queue drains.
+     */
+    virtual void FlushCommands();
+
+    /**
+     * Send the same commands to many connections. The plaintext frame
+     * (sizes, command headers and padding) is built once and shared. Each
+     * recipient only runs the Blowfish pass with its own key, straight from
+     * the shared frame into its own pooled send buffer. The recipients are
+     * grouped by their io_service and each group is encrypted on the thread
+     * that owns it, which spreads the work over the worker threads.
+     * @param connections Connections to send to. Any that are not an
+     *   encrypted LobbyConnection are skipped.
+     * @param pCommands Commands to put in the frame.
+     * @param commandCount Number of commands.
+     * @param priority With low priority a recipient that is not writable is
+     *   skipped before any encryption is done for it.
+     * @returns true if the frame was built and posted to the recipients.
+     */
+    static bool BroadcastEncrypted(const std::list<std::shared_ptr<
+        TcpConnection>>& connections, const OutgoingCommand_t *pCommands,
+        size_t commandCount, SendPriority_t priority = PRIORITY_NORMAL);
+
+    /**
+     * Get the counters for @ref BroadcastEncrypted.
+     * @returns Broadcast encryption counters.
+     */
+    static BroadcastStats_t GetBroadcastStats();
+
+    /**
+     * Get the counters for compressed frames (over all connections).
+     * @returns Frame compression counters.
+     */
+    static CompressionStats_t GetCompressionStats();
+
 protected:
     typedef void (LobbyConnection::*PacketParser_t)(libcomp::Packet& packet);
 
-    void ParseClientEncryptionStart(libcomp::Packet& packet);
+    class ClientHandshake;
+
+    bool ReadServerKeys(libcomp::Packet& packet, DiffieHellmanKey_t& prime,
+        DiffieHellmanKey_t& serverPublic);
+
     void ParseServerEncryptionStart(libcomp::Packet& packet);
     void ParseServerEncryptionFinish(libcomp::Packet& packet);
     void ParsePacket(libcomp::Packet& packet);
@@ -70,8 +247,50 @@ protected:
 
     virtual void PacketReceived(libcomp::Packet& packet);
 
+    virtual void StreamReceived(libcomp::RingBuffer& buffer);
+
+    virtual void OutgoingDrained();
+
+    virtual void ConnectionClosing(const libcomp::String& reason);
+
+    /**
+     * Run @em work on the crypto pool (if there is one) and then @em finish
+     * on the thread of this connection. Nothing else may be requested from
+     * the socket until @em finish runs.
+     * @param work Expensive key exchange step.
+     * @param finish Continuation of the handshake.
+     */
+    void RunHandshakeStep(const std::function<void()>& work,
+        const std::function<void()>& finish);
+
     PacketParser_t mPacketParser;
 
+    void FlushCommandsLocked();
+    void StartFlushTimer();
+    void SendFrame(Packet& packet, uint32_t realSize, uint32_t encrypted);
+    void CompressFrame(Packet& packet, uint32_t& realSize);
+    bool InflateFrame(Packet& packet, uint32_t& realSize);
+    bool SendPlaintextFrame(const ReadOnlyPacket& plaintext,
+        SendPriority_t priority);
+
+    static uint32_t FrameSize(uint32_t realSize);
+    static uint32_t WriteCommand(uint8_t *pDestination,
+        const OutgoingCommand_t& command);
+
+    bool mFrameDispatch;
+
+    std::shared_ptr<WorkerPool> mCryptoPool;
+
+    bool mCompression;
+    uint32_t mCompressThreshold;
+
+    std::mutex mCommandMutex;
+    Packet mCommandFrame;
+    uint32_t mCommandBytes;
+    uint32_t mCommandFlushSize;
+    uint32_t mCommandFlushDelay;
+    libcomp::TimerWheel::Timer mFlushTimer;
+
     std::shared_ptr<MessageQueue<libcomp::Message::Message*>> mMessageQueue;
 };
 
@@ -26,6 +26,11 @@
 
 #include "Log.h"
 
+#include "MessageQueue.h"
+#include "MpscRingBuffer.h"
+#include "ThreadAffinity.h"
+
+#include <chrono>
 #include <iostream>
 #include <cassert>
 
@@ -37,6 +42,30 @@ using namespace libcomp;
  */
 static Log *gLogInst = nullptr;
 
+/**
+ * @internal
+ * Format strings registered with Log::RegisterFormat (indexed by ID).
+ */
+static std::vector<String> gLogFormats(1, "%1");
+
+/**
+ * @internal
+ * Lock for @ref gLogFormats.
+ */
+static std::mutex gLogFormatLock;
+
+/**
+ * @internal
+ * Prepend these to messages.
+ */
+static const char *gLogMessages[Log::LOG_LEVEL_COUNT] = {
+    "DEBUG: %1",
+    "%1",
+    "WARNING: %1",
+    "ERROR: %1",
+    "CRITICAL: %1",
+};
+
 /*
  * Black       0;30     Dark Gray     1;30
  * Blue        0;34     Light Blue    1;34
@@ -98,7 +127,55 @@ static void LogToStandardOutput(Log::Level_t level,
     std::cout.flush();
 }
 
-Log::Log() : mLogFile(nullptr)
+/**
+ * @internal
+ * Formatted message waiting for the writer thread. A null record tells the
+ * writer to stop and a record with the level LOG_LEVEL_COUNT tells it to
+ * drain the ring buffer of encoded messages.
+ */
+class Log::Record
+{
+public:
+    /// Logging level of the message.
+    Level_t level;
+
+    /// The message (without the level prefix).
+    String msg;
+
+    /// When the message was logged (microseconds since the epoch).
+    uint64_t timestamp;
+
+    /// Hash of the ID of the thread that logged the message.
+    uint64_t thread;
+};
+
+/**
+ * @internal
+ * Counts a thread as using the writer queue (or ring buffer) so
+ * Log::StopAsync waits for it before the final drain.
+ */
+class AsyncProducer
+{
+public:
+    explicit AsyncProducer(std::atomic<uint32_t>& producers) :
+        mProducers(producers)
+    {
+        mProducers.fetch_add(1);
+    }
+
+    ~AsyncProducer()
+    {
+        mProducers.fetch_sub(1);
+    }
+
+private:
+    std::atomic<uint32_t>& mProducers;
+};
+
+Log::Log() : mLogFile(nullptr), mBinaryLogFile(nullptr),
+    mAsyncProducers(0), mRingPending(false),
+    mFlushInterval(LOG_FLUSH_INTERVAL),
+    mFlushSize(LOG_FLUSH_SIZE), mDroppedMessages(0)
 {
     // Default all log levels to enabled.
     for(int i = 0; i < LOG_LEVEL_COUNT; ++i)
@@ -109,16 +186,22 @@ Log::Log() : mLogFile(nullptr)
 
 Log::~Log()
 {
+    // Write what is still queued.
+    StopAsync();
+
     // Lock the muxtex.
     std::lock_guard<std::mutex> lock(mLock);
 
     // Clear the last line before the server exits.
     std::cout << "\e[0K\e[0m";
 
-    // Close the log file.
+    // Close the log files.
     delete mLogFile;
     mLogFile = nullptr;
 
+    delete mBinaryLogFile;
+    mBinaryLogFile = nullptr;
+
     // Remove the singleton pointer.
     gLogInst = nullptr;
 }
@@ -139,15 +222,6 @@ Log* Log::GetSingletonPtr()
 
 void Log::LogMessage(Log::Level_t level, const String& msg)
 {
-    // Prepend these to messages.
-    static const String gLogMessages[Log::LOG_LEVEL_COUNT] = {
-        "DEBUG: %1",
-        "%1",
-        "WARNING: %1",
-        "ERROR: %1",
-        "CRITICAL: %1",
-    };
-
     // Log a critical error message. If the configuration option is true, log
     // the message to the log file. Regardless, pass the message to all the
     // log hooks for processing. Critical messages have the text "CRITICAL: "
@@ -155,18 +229,207 @@ void Log::LogMessage(Log::Level_t level, const String& msg)
     if(0 > level || LOG_LEVEL_COUNT <= level || !mLogEnables[level])
         return;
 
-    String final = String(gLogMessages[level]).Arg(msg);
+    {
+        AsyncProducer producer(mAsyncProducers);
+
+        std::shared_ptr<MessageQueue<Record*>> queue = std::atomic_load(
+            &mQueue);
+
+        if(nullptr != queue)
+        {
+            // The level prefix is added by the writer thread.
+            Record *pRecord = new Record;
+            pRecord->level = level;
+            pRecord->msg = msg;
+            pRecord->timestamp = LogRecord::Now();
+            pRecord->thread = LogRecord::CurrentThread();
+
+            if(!queue->TryEnqueue(pRecord))
+            {
+                // Only wait for the writer if the message matters.
+                if(LOG_LEVEL_WARNING <= level)
+                {
+                    queue->Enqueue(pRecord);
+                }
+                else
+                {
+                    delete pRecord;
+                    mDroppedMessages++;
+                }
+            }
+
+            return;
+        }
+    }
+
+    // Lock the muxtex.
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if(0 < WriteMessage(level, msg, LogRecord::Now(),
+        LogRecord::CurrentThread()))
+    {
+        Flush();
+    }
+}
+
+void Log::LogEncoded(const LogRecord& record)
+{
+    Level_t level = (Level_t)record.GetLevel();
+
+    if(LOG_LEVEL_COUNT <= level || !mLogEnables[level])
+        return;
+
+    {
+        AsyncProducer producer(mAsyncProducers);
+
+        std::shared_ptr<MessageQueue<Record*>> queue = std::atomic_load(
+            &mQueue);
+
+        if(nullptr != queue)
+        {
+            std::shared_ptr<MpscRingBuffer> ring = std::atomic_load(&mRing);
+
+            if(!ring->WriteRecord(record.Data(), (int32_t)record.Size()))
+            {
+                // The ring is full. Only wait for the writer if the message
+                // matters (by rendering it here and queuing the text).
+                if(LOG_LEVEL_WARNING <= level)
+                {
+                    LogRecordHeader_t header;
+                    std::vector<String> args;
+
+                    if(LogRecord::Decode(record.Data(), record.Size(), header,
+                        args))
+                    {
+                        LogMessage(level, LogRecord::Render(GetFormat(
+                            header.formatId), args));
+                    }
+                }
+                else
+                {
+                    mDroppedMessages++;
+                }
+
+                return;
+            }
+
+            // Only one wake up is queued until the writer drains the ring.
+            if(!mRingPending.exchange(true))
+            {
+                Record *pRecord = new Record;
+                pRecord->level = LOG_LEVEL_COUNT;
+
+                queue->Enqueue(pRecord);
+            }
+
+            return;
+        }
+    }
 
     // Lock the muxtex.
     std::lock_guard<std::mutex> lock(mLock);
 
+    if(0 < WriteEncoded(record.Data(), record.Size()))
+    {
+        Flush();
+    }
+}
+
+uint32_t Log::RegisterFormat(const char *szFormat)
+{
+    std::lock_guard<std::mutex> lock(gLogFormatLock);
+
+    gLogFormats.push_back(szFormat);
+
+    return (uint32_t)(gLogFormats.size() - 1);
+}
+
+String Log::GetFormat(uint32_t formatId)
+{
+    std::lock_guard<std::mutex> lock(gLogFormatLock);
+
+    if(gLogFormats.size() <= formatId)
+    {
+        return String();
+    }
+
+    return gLogFormats[formatId];
+}
+
+size_t Log::WriteMessage(Level_t level, const String& msg,
+    uint64_t timestamp, uint64_t thread)
+{
+    size_t written = 0;
+
+    if(nullptr != mBinaryLogFile)
+    {
+        // Messages longer than a record are cut short in the binary log.
+        LogRecord record(LogRecord::PLAIN_FORMAT, (uint8_t)level, timestamp,
+            thread);
+        record.Add(msg);
+
+        written += LogRecord::WriteRecord(*mBinaryLogFile, record.Data(),
+            record.Size());
+    }
+
+    return written + WriteText(level, msg);
+}
+
+size_t Log::WriteEncoded(const void *pData, uint32_t size)
+{
+    LogRecordHeader_t header;
+    std::vector<String> args;
+
+    if(!LogRecord::Decode(pData, size, header, args) ||
+        LOG_LEVEL_COUNT <= header.level)
+    {
+        return 0;
+    }
+
+    size_t written = 0;
+
+    if(nullptr != mBinaryLogFile)
+    {
+        // The format is written once before the first record that uses it.
+        if(mWrittenFormats.size() <= header.formatId)
+        {
+            mWrittenFormats.resize(header.formatId + 1, false);
+        }
+
+        if(!mWrittenFormats[header.formatId])
+        {
+            LogRecord::WriteFormat(*mBinaryLogFile, header.formatId,
+                GetFormat(header.formatId));
+
+            mWrittenFormats[header.formatId] = true;
+        }
+
+        written += LogRecord::WriteRecord(*mBinaryLogFile, pData, size);
+    }
+
+    // Only render the text if something will use it.
+    if(nullptr != mLogFile || !mHooks.empty() || !mLambdaHooks.empty())
+    {
+        written += WriteText((Level_t)header.level, LogRecord::Render(
+            GetFormat(header.formatId), args));
+    }
+
+    return written;
+}
+
+size_t Log::WriteText(Level_t level, const String& msg)
+{
+    size_t written = 0;
+
+    String final = String(gLogMessages[level]).Arg(msg);
+
     if(nullptr != mLogFile)
     {
         std::vector<char> data = final.Data();
 
-        mLogFile->write(&data[0],
-            (std::streamsize)(data.size() * sizeof(char)));
-        mLogFile->flush();
+        written = data.size() * sizeof(char);
+
+        mLogFile->write(&data[0], (std::streamsize)written);
     }
 
     // Call all hooks.
@@ -180,6 +443,217 @@ void Log::LogMessage(Log::Level_t level, const String& msg)
     {
         func(level, final);
     }
+
+    return written;
+}
+
+void Log::Flush()
+{
+    if(nullptr != mLogFile)
+    {
+        mLogFile->flush();
+    }
+
+    if(nullptr != mBinaryLogFile)
+    {
+        mBinaryLogFile->flush();
+    }
+}
+
+size_t Log::DrainRing(MpscRingBuffer& ring)
+{
+    RingRecord_t records[64];
+    size_t written = 0;
+    int32_t count;
+
+    do
+    {
+        int32_t size = 0;
+
+        count = ring.BeginReadV(records, 64, size);
+
+        for(int32_t i = 0; i < count; ++i)
+        {
+            written += WriteEncoded(records[i].pData,
+                (uint32_t)records[i].size);
+        }
+
+        ring.EndRead(size);
+    } while(0 < count);
+
+    return written;
+}
+
+void Log::StartAsync(size_t queueSize)
+{
+    if(nullptr == std::atomic_load(&mQueue))
+    {
+        std::shared_ptr<MessageQueue<Record*>> queue =
+            std::make_shared<MessageQueue<Record*>>(queueSize);
+
+        std::shared_ptr<MpscRingBuffer> ring = std::atomic_load(&mRing);
+
+        // The ring is kept for the next time (it is drained when stopping).
+        if(nullptr == ring)
+        {
+            ring = std::make_shared<MpscRingBuffer>(LOG_RING_SIZE);
+
+            std::atomic_store(&mRing, ring);
+        }
+
+        mWriter = std::thread([this, queue, ring]()
+        {
+            ThreadAffinity::Apply(ThreadAffinity::ROLE_LOG);
+
+            RunWriter(queue, ring);
+        });
+
+        std::atomic_store(&mQueue, queue);
+    }
+}
+
+void Log::StopAsync()
+{
+    std::shared_ptr<MessageQueue<Record*>> queue = std::atomic_load(&mQueue);
+
+    if(nullptr != queue)
+    {
+        // New messages are written right away from now on.
+        std::atomic_store(&mQueue, std::shared_ptr<MessageQueue<Record*>>());
+
+        // Wait for the threads that still use the queue (the writer keeps
+        // running so a full queue does not block them) or their messages
+        // would come after the final drain and be lost.
+        while(0 != mAsyncProducers.load())
+        {
+            std::this_thread::yield();
+        }
+
+        queue->Enqueue(nullptr);
+        mWriter.join();
+
+        // Write anything that was queued after the writer stopped.
+        Record *pRecord;
+
+        std::lock_guard<std::mutex> lock(mLock);
+
+        while(queue->TryDequeue(pRecord))
+        {
+            if(nullptr != pRecord)
+            {
+                if(LOG_LEVEL_COUNT != pRecord->level)
+                {
+                    (void)WriteMessage(pRecord->level, pRecord->msg,
+                        pRecord->timestamp, pRecord->thread);
+                }
+
+                delete pRecord;
+            }
+        }
+
+        (void)DrainRing(*std::atomic_load(&mRing));
+        mRingPending = false;
+
+        Flush();
+    }
+}
+
+bool Log::IsAsync() const
+{
+    return nullptr != std::atomic_load(&mQueue);
+}
+
+void Log::SetFlushPolicy(uint32_t flushInterval, size_t flushSize)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mFlushInterval = flushInterval;
+    mFlushSize = flushSize;
+}
+
+uint64_t Log::GetDroppedMessages() const
+{
+    return mDroppedMessages;
+}
+
+void Log::RunWriter(std::shared_ptr<MessageQueue<Record*>> queue,
+    std::shared_ptr<MpscRingBuffer> ring)
+{
+    std::list<Record*> records;
+    std::chrono::steady_clock::time_point lastFlush =
+        std::chrono::steady_clock::now();
+    std::chrono::milliseconds flushInterval(LOG_FLUSH_INTERVAL);
+    size_t unflushed = 0;
+    bool running = true;
+
+    while(running)
+    {
+        if(0 < unflushed)
+        {
+            // Don't block on the queue while there is something to flush.
+            Record *pRecord;
+
+            while(queue->TryDequeue(pRecord))
+            {
+                records.push_back(pRecord);
+            }
+
+            if(records.empty())
+            {
+                std::this_thread::sleep_until(lastFlush + flushInterval);
+            }
+        }
+        else
+        {
+            queue->DequeueAll(records);
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+
+        for(auto pRecord : records)
+        {
+            if(nullptr == pRecord)
+            {
+                running = false;
+            }
+            else if(LOG_LEVEL_COUNT == pRecord->level)
+            {
+                // Clear the flag first so a message added to the ring while
+                // it is drained queues another wake up.
+                mRingPending = false;
+
+                unflushed += DrainRing(*ring);
+
+                delete pRecord;
+            }
+            else
+            {
+                unflushed += WriteMessage(pRecord->level, pRecord->msg,
+                    pRecord->timestamp, pRecord->thread);
+
+                delete pRecord;
+            }
+        }
+
+        records.clear();
+
+        std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        flushInterval = std::chrono::milliseconds(mFlushInterval);
+
+        if(0 < unflushed && (!running || unflushed >= mFlushSize ||
+            now >= (lastFlush + flushInterval)))
+        {
+            Flush();
+
+            unflushed = 0;
+            lastFlush = now;
+        }
+        else if(0 == unflushed)
+        {
+            lastFlush = now;
+        }
+    }
 }
 
 String Log::GetLogPath() const
@@ -221,6 +695,44 @@ void Log::SetLogPath(const String& path)
     }
 }
 
+String Log::GetBinaryLogPath() const
+{
+    return mBinaryLogPath;
+}
+
+void Log::SetBinaryLogPath(const String& path)
+{
+    // Lock the muxtex.
+    std::lock_guard<std::mutex> lock(mLock);
+
+    // Close the old binary log file if it's open.
+    delete mBinaryLogFile;
+    mBinaryLogFile = nullptr;
+
+    mBinaryLogPath = path;
+    mWrittenFormats.clear();
+
+    // If the path isn't empty, create a new binary log file. The file will
+    // be truncated first.
+    if(!mBinaryLogPath.IsEmpty())
+    {
+        mBinaryLogFile = new std::ofstream();
+        mBinaryLogFile->open(mBinaryLogPath.C(), std::ofstream::out |
+            std::ofstream::trunc | std::ofstream::binary);
+
+        LogRecord::WriteFileHeader(*mBinaryLogFile);
+        mBinaryLogFile->flush();
+
+        // If this failed, close it.
+        if(!mBinaryLogFile->good())
+        {
+            delete mBinaryLogFile;
+            mBinaryLogFile = nullptr;
+            mBinaryLogPath.Clear();
+        }
+    }
+}
+
 void Log::AddLogHook(Log::Hook_t func, void *data)
 {
     // Lock the muxtex.
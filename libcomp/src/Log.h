@@ -27,17 +27,25 @@
 #ifndef LIBCOMP_SRC_LOG_H
 #define LIBCOMP_SRC_LOG_H
 
+#include "Constants.h"
+#include "LogRecord.h"
 #include "String.h"
 
+#include <atomic>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <fstream>
 #include <functional>
+#include <thread>
 #include <unordered_map>
 
 namespace libcomp
 {
 
+template<class T> class MessageQueue;
+class MpscRingBuffer;
+
 /**
  * Logging interface capable of logging messages to the terminal or a file.
  * The Log class is implemented as a singleton. The constructor should not be
@@ -64,6 +72,12 @@ namespace libcomp
  * log level, the message, and the user data provided by the @ref AddLogHook
  * method. For more information on the function prototype, see the docs for
  * @ref Log::Hook_t and @ref AddLogHook.
+ *
+ * Messages on hot paths may use @ref LOG_INFO_FORMAT (and the other
+ * _FORMAT macros) instead. These record the ID of a static format string
+ * and the raw argument values (see @ref LogRecord) and the text is only
+ * rendered by the writer thread. @ref SetBinaryLogPath also keeps every
+ * message in that form on disk to be rendered later by comp_logdecode.
  */
 class Log
 {
@@ -110,6 +124,48 @@ public:
      */
     void LogMessage(Level_t level, const String& msg);
 
+    /**
+     * Log a message from a format string and its arguments. When the log is
+     * asynchronous the arguments are copied into a ring buffer and the text
+     * is rendered by the writer thread. Use @ref LOG_FORMAT instead of
+     * calling this directly.
+     * @param level Logging level of the message.
+     * @param formatId ID returned by @ref RegisterFormat.
+     * @param args Arguments of the format string (integers, floating point
+     *   numbers and strings).
+     */
+    template<typename... T>
+    void LogFormat(Level_t level, uint32_t formatId, const T&... args)
+    {
+        LogRecord record(formatId, (uint8_t)level);
+
+        int expand[] = { 0, (record.Add(args), 0)... };
+        (void)expand;
+
+        LogEncoded(record);
+    }
+
+    /**
+     * Log a message that has already been encoded.
+     * @param record The encoded message.
+     */
+    void LogEncoded(const LogRecord& record);
+
+    /**
+     * Register a format string for @ref LogFormat. This is done once for
+     * each use of @ref LOG_FORMAT.
+     * @param szFormat The format string (using %1, %2, etc.).
+     * @returns ID of the format string.
+     */
+    static uint32_t RegisterFormat(const char *szFormat);
+
+    /**
+     * Get a registered format string.
+     * @param formatId ID returned by @ref RegisterFormat.
+     * @returns The format string or an empty string if the ID is unknown.
+     */
+    static String GetFormat(uint32_t formatId);
+
     /**
      * Get the path to the log file.
      * @returns Path to the log file.
@@ -122,6 +178,20 @@ public:
      */
     void SetLogPath(const String& path);
 
+    /**
+     * Get the path to the binary log file.
+     * @returns Path to the binary log file.
+     */
+    String GetBinaryLogPath() const;
+
+    /**
+     * Set the path to the binary log file. Every message is also written to
+     * it as a @ref LogRecord (with the time and the thread that logged it).
+     * This will open the file and truncate it.
+     * @param path Path to the binary log file (empty to stop using one).
+     */
+    void SetBinaryLogPath(const String& path);
+
     /**
      * Add a log hook to the logging subsystem. The log hook @em func will be
      * called for each new log message that is enabled through
@@ -166,6 +236,45 @@ public:
      */
     void SetLogLevelEnabled(Level_t level, bool enabled);
 
+    /**
+     * Start writing messages on a dedicated thread. @ref LogMessage then
+     * only hands the message to a lock-free queue (and @ref LogFormat only
+     * copies its arguments into a ring buffer without rendering them); the
+     * writer thread writes the messages to the log file in batches, flushes
+     * by the policy set with @ref SetFlushPolicy and calls the hooks. If
+     * the queue is full debug and info messages are dropped (see
+     * @ref GetDroppedMessages) while more severe messages wait for room.
+     * @param queueSize Number of messages that may wait for the writer.
+     */
+    void StartAsync(size_t queueSize = LOG_QUEUE_SIZE);
+
+    /**
+     * Write everything that is queued, stop the writer thread and go back
+     * to writing messages on the thread that logs them. Call this once the
+     * other threads have stopped logging (for example before exiting).
+     */
+    void StopAsync();
+
+    /**
+     * Check if messages are written by the writer thread.
+     * @returns true if @ref StartAsync was called.
+     */
+    bool IsAsync() const;
+
+    /**
+     * Set when the writer thread flushes the log file.
+     * @param flushInterval Milliseconds a written message may stay in the
+     *   file buffer.
+     * @param flushSize Number of bytes that may stay in the file buffer.
+     */
+    void SetFlushPolicy(uint32_t flushInterval, size_t flushSize);
+
+    /**
+     * Get the number of messages dropped because the queue was full.
+     * @returns Number of dropped messages.
+     */
+    uint64_t GetDroppedMessages() const;
+
 protected:
     /**
      * @internal
@@ -177,6 +286,70 @@ protected:
      */
     Log();
 
+    /**
+     * @internal
+     * Message waiting for the writer thread.
+     */
+    class Record;
+
+    /**
+     * @internal
+     * Write a message to the log files (without flushing them) and call the
+     * hooks. The lock must be held.
+     * @param level Logging level of the message.
+     * @param msg The message (without the level prefix).
+     * @param timestamp When the message was logged (microseconds since the
+     *   epoch).
+     * @param thread Hash of the ID of the thread that logged the message.
+     * @returns Number of bytes written to the log files.
+     */
+    size_t WriteMessage(Level_t level, const String& msg, uint64_t timestamp,
+        uint64_t thread);
+
+    /**
+     * @internal
+     * Write an encoded message to the log files (without flushing them) and
+     * call the hooks. The text is only rendered if something needs it. The
+     * lock must be held.
+     * @param pData The encoded message.
+     * @param size Size of the encoded message.
+     * @returns Number of bytes written to the log files.
+     */
+    size_t WriteEncoded(const void *pData, uint32_t size);
+
+    /**
+     * @internal
+     * Write a rendered message to the text log file and call the hooks. The
+     * lock must be held.
+     * @param level Logging level of the message.
+     * @param msg The message (without the level prefix).
+     * @returns Number of bytes written to the log file.
+     */
+    size_t WriteText(Level_t level, const String& msg);
+
+    /**
+     * @internal
+     * Flush the log files. The lock must be held.
+     */
+    void Flush();
+
+    /**
+     * @internal
+     * Write every encoded message in the ring buffer. The lock must be held.
+     * @param ring Ring buffer to take the messages from.
+     * @returns Number of bytes written to the log files.
+     */
+    size_t DrainRing(MpscRingBuffer& ring);
+
+    /**
+     * @internal
+     * Body of the writer thread.
+     * @param queue Queue to take the messages from.
+     * @param ring Ring buffer to take the encoded messages from.
+     */
+    void RunWriter(std::shared_ptr<MessageQueue<Record*>> queue,
+        std::shared_ptr<MpscRingBuffer> ring);
+
     /**
      * @internal
      * Path to the log file.
@@ -195,6 +368,24 @@ protected:
      */
     std::ofstream *mLogFile;
 
+    /**
+     * @internal
+     * Path to the binary log file.
+     */
+    String mBinaryLogPath;
+
+    /**
+     * @internal
+     * Binary log file that encoded messages will be written to.
+     */
+    std::ofstream *mBinaryLogFile;
+
+    /**
+     * @internal
+     * Which format strings have been written to the binary log file.
+     */
+    std::vector<bool> mWrittenFormats;
+
     /**
      * @internal
      * Mapping of log hooks and their associated user data.
@@ -213,18 +404,117 @@ protected:
      * Mutex to make the log thread safe.
      */
     std::mutex mLock;
+
+    /**
+     * @internal
+     * Queue of the writer thread (null when not asynchronous).
+     */
+    std::shared_ptr<MessageQueue<Record*>> mQueue;
+
+    /**
+     * @internal
+     * Number of threads that may be using the queue or ring buffer.
+     */
+    std::atomic<uint32_t> mAsyncProducers;
+
+    /**
+     * @internal
+     * Ring buffer of encoded messages for the writer thread (null when not
+     * asynchronous).
+     */
+    std::shared_ptr<MpscRingBuffer> mRing;
+
+    /**
+     * @internal
+     * If the writer thread has been told to drain the ring buffer.
+     */
+    std::atomic<bool> mRingPending;
+
+    /**
+     * @internal
+     * Thread that writes the queued messages.
+     */
+    std::thread mWriter;
+
+    /**
+     * @internal
+     * Milliseconds a message may stay in the file buffer.
+     */
+    uint32_t mFlushInterval;
+
+    /**
+     * @internal
+     * Number of bytes that may stay in the file buffer.
+     */
+    size_t mFlushSize;
+
+    /**
+     * @internal
+     * Number of messages dropped because the queue was full.
+     */
+    std::atomic<uint64_t> mDroppedMessages;
 };
 
 } // namespace libcomp
 
+/**
+ * Lowest log level that is compiled in. Messages below it are removed at
+ * compile time (their arguments are never evaluated). Debug builds keep
+ * everything and release builds drop debug messages. Define this to a
+ * @ref Log::Level_t value to override it.
+ */
+#ifndef LOG_MIN_LEVEL
+#ifdef COMP_HACK_DEBUG
+#define LOG_MIN_LEVEL (0)
+#else // COMP_HACK_DEBUG
+#define LOG_MIN_LEVEL (1)
+#endif // COMP_HACK_DEBUG
+#endif // LOG_MIN_LEVEL
+
+/**
+ * %Log a message if the level is compiled in and enabled. The message is
+ * only evaluated (and formatted) if it will be logged.
+ * @param level Logging level of the message.
+ * @param msg The message to log.
+ * @sa Log::LogMessage
+ * @relates Log
+ */
+#define LOG_MESSAGE(level, msg) do { \
+    if((int)(level) >= LOG_MIN_LEVEL && libcomp::Log::GetSingletonPtr( \
+        )->GetLogLevelEnabled(level)) \
+    { \
+        libcomp::Log::GetSingletonPtr()->LogMessage(level, msg); \
+    } \
+} while(0)
+
+/**
+ * %Log a message from a format string if the level is compiled in and
+ * enabled. The format string is registered the first time this line runs
+ * and the arguments are only rendered into it by the writer thread. There
+ * must be at least one argument.
+ * @param level Logging level of the message.
+ * @param format Format string (a string literal using %1, %2, etc.).
+ * @sa Log::LogFormat
+ * @relates Log
+ */
+#define LOG_FORMAT(level, format, ...) do { \
+    if((int)(level) >= LOG_MIN_LEVEL && libcomp::Log::GetSingletonPtr( \
+        )->GetLogLevelEnabled(level)) \
+    { \
+        static const uint32_t logFormatId = \
+            libcomp::Log::RegisterFormat(format); \
+        libcomp::Log::GetSingletonPtr()->LogFormat(level, logFormatId, \
+            __VA_ARGS__); \
+    } \
+} while(0)
+
 /**
  * %Log a critical error message.
  * @param msg The message to log.
  * @sa Log::LogMessage
  * @relates Log
  */
-#define LOG_CRITICAL(msg) libcomp::Log::GetSingletonPtr()->LogMessage( \
-    libcomp::Log::LOG_LEVEL_CRITICAL, msg)
+#define LOG_CRITICAL(msg) LOG_MESSAGE(libcomp::Log::LOG_LEVEL_CRITICAL, msg)
 
 /**
  * %Log an error message.
@@ -232,8 +522,7 @@ protected:
  * @sa Log::LogMessage
  * @relates Log
  */
-#define LOG_ERROR(msg)    libcomp::Log::GetSingletonPtr()->LogMessage( \
-    libcomp::Log::LOG_LEVEL_ERROR, msg)
+#define LOG_ERROR(msg)    LOG_MESSAGE(libcomp::Log::LOG_LEVEL_ERROR, msg)
 
 /**
  * %Log a warning message.
@@ -241,8 +530,7 @@ protected:
  * @sa Log::LogMessage
  * @relates Log
  */
-#define LOG_WARNING(msg)  libcomp::Log::GetSingletonPtr()->LogMessage( \
-    libcomp::Log::LOG_LEVEL_WARNING, msg)
+#define LOG_WARNING(msg)  LOG_MESSAGE(libcomp::Log::LOG_LEVEL_WARNING, msg)
 
 /**
  * %Log a informational message.
@@ -250,8 +538,7 @@ protected:
  * @sa Log::LogMessage
  * @relates Log
  */
-#define LOG_INFO(msg)     libcomp::Log::GetSingletonPtr()->LogMessage( \
-    libcomp::Log::LOG_LEVEL_INFO, msg)
+#define LOG_INFO(msg)     LOG_MESSAGE(libcomp::Log::LOG_LEVEL_INFO, msg)
 
 /**
  * %Log a debug message.
@@ -259,7 +546,51 @@ protected:
  * @sa Log::LogMessage
  * @relates Log
  */
-#define LOG_DEBUG(msg)    libcomp::Log::GetSingletonPtr()->LogMessage( \
-    libcomp::Log::LOG_LEVEL_DEBUG, msg)
+#define LOG_DEBUG(msg)    LOG_MESSAGE(libcomp::Log::LOG_LEVEL_DEBUG, msg)
+
+/**
+ * %Log a critical error message from a format string.
+ * @param format Format string.
+ * @sa LOG_FORMAT
+ * @relates Log
+ */
+#define LOG_CRITICAL_FORMAT(format, ...) LOG_FORMAT( \
+    libcomp::Log::LOG_LEVEL_CRITICAL, format, __VA_ARGS__)
+
+/**
+ * %Log an error message from a format string.
+ * @param format Format string.
+ * @sa LOG_FORMAT
+ * @relates Log
+ */
+#define LOG_ERROR_FORMAT(format, ...) LOG_FORMAT( \
+    libcomp::Log::LOG_LEVEL_ERROR, format, __VA_ARGS__)
+
+/**
+ * %Log a warning message from a format string.
+ * @param format Format string.
+ * @sa LOG_FORMAT
+ * @relates Log
+ */
+#define LOG_WARNING_FORMAT(format, ...) LOG_FORMAT( \
+    libcomp::Log::LOG_LEVEL_WARNING, format, __VA_ARGS__)
+
+/**
+ * %Log an informational message from a format string.
+ * @param format Format string.
+ * @sa LOG_FORMAT
+ * @relates Log
+ */
+#define LOG_INFO_FORMAT(format, ...) LOG_FORMAT( \
+    libcomp::Log::LOG_LEVEL_INFO, format, __VA_ARGS__)
+
+/**
+ * %Log a debug message from a format string.
+ * @param format Format string.
+ * @sa LOG_FORMAT
+ * @relates Log
+ */
+#define LOG_DEBUG_FORMAT(format, ...) LOG_FORMAT( \
+    libcomp::Log::LOG_LEVEL_DEBUG, format, __VA_ARGS__)
 
 #endif // LIBCOMP_SRC_LOG_H
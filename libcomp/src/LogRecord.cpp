@@ -0,0 +1,412 @@
+/**
+ * @file libcomp/src/LogRecord.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Binary log record that is rendered to text later.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LogRecord.h"
+
+// Standard C++11 Includes
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+using namespace libcomp;
+
+/// Start of a binary log file.
+static const char LOG_FILE_MAGIC[4] = { 'C', 'L', 'O', 'G' };
+
+/// Version of the binary log file format.
+static const uint32_t LOG_FILE_VERSION = 1;
+
+/**
+ * Type of an entry in a binary log file.
+ */
+typedef enum : uint8_t
+{
+    LOG_ENTRY_FORMAT = 1,
+    LOG_ENTRY_RECORD,
+} LogEntry_t;
+
+/**
+ * Type of a record argument.
+ */
+typedef enum : uint8_t
+{
+    LOG_ARG_INT = 1,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+} LogArgument_t;
+
+static_assert(LOG_RECORD_SIZE > sizeof(LogRecordHeader_t) + 16,
+    "LOG_RECORD_SIZE does not leave room for any arguments.");
+
+const uint32_t LogRecord::PLAIN_FORMAT;
+
+LogRecord::LogRecord(uint32_t formatId, uint8_t level) :
+    LogRecord(formatId, level, Now(), CurrentThread())
+{
+}
+
+LogRecord::LogRecord(uint32_t formatId, uint8_t level, uint64_t timestamp,
+    uint64_t thread) : mSize((uint32_t)sizeof(LogRecordHeader_t))
+{
+    LogRecordHeader_t header;
+    header.formatId = formatId;
+    header.level = level;
+    header.argCount = 0;
+    header.reserved = 0;
+    header.timestamp = timestamp;
+    header.thread = thread;
+
+    memcpy(mData, &header, sizeof(header));
+}
+
+uint64_t LogRecord::Now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t LogRecord::CurrentThread()
+{
+    // The hash is worked out once per thread.
+    static thread_local uint64_t thread = (uint64_t)std::hash<
+        std::thread::id>()(std::this_thread::get_id());
+
+    return thread;
+}
+
+void LogRecord::Add(int64_t value)
+{
+    (void)AddArgument(LOG_ARG_INT, &value, sizeof(value));
+}
+
+void LogRecord::Add(uint64_t value)
+{
+    (void)AddArgument(LOG_ARG_UINT, &value, sizeof(value));
+}
+
+void LogRecord::Add(double value)
+{
+    (void)AddArgument(LOG_ARG_DOUBLE, &value, sizeof(value));
+}
+
+void LogRecord::Add(const String& value)
+{
+    AddString(value.C(), value.Size());
+}
+
+void LogRecord::Add(const char *szValue)
+{
+    AddString(szValue, nullptr == szValue ? 0 : strlen(szValue));
+}
+
+void LogRecord::Add(const std::string& value)
+{
+    AddString(value.c_str(), value.size());
+}
+
+uint8_t LogRecord::GetLevel() const
+{
+    return mData[offsetof(LogRecordHeader_t, level)];
+}
+
+const void* LogRecord::Data() const
+{
+    return mData;
+}
+
+uint32_t LogRecord::Size() const
+{
+    return mSize;
+}
+
+bool LogRecord::AddArgument(uint8_t type, const void *pValue, uint32_t size)
+{
+    uint8_t *pArgCount = &mData[offsetof(LogRecordHeader_t, argCount)];
+
+    // Arguments that don't fit (or are past the 255th) are left out.
+    if((LOG_RECORD_SIZE - mSize) < (1 + size) || 0xFF == *pArgCount)
+    {
+        return false;
+    }
+
+    mData[mSize] = type;
+    memcpy(&mData[mSize + 1], pValue, size);
+
+    mSize += 1 + size;
+    (*pArgCount)++;
+
+    return true;
+}
+
+void LogRecord::AddString(const char *szValue, size_t size)
+{
+    uint32_t room = LOG_RECORD_SIZE - mSize;
+
+    // The type and the length always have to fit.
+    if((1 + sizeof(uint32_t)) > room)
+    {
+        return;
+    }
+
+    room -= 1 + (uint32_t)sizeof(uint32_t);
+
+    uint32_t length = (uint32_t)size < room ? (uint32_t)size : room;
+
+    // Don't cut a UTF-8 character in half.
+    while(length < size && 0 < length &&
+        0x80 == ((uint8_t)szValue[length] & 0xC0))
+    {
+        length--;
+    }
+
+    uint8_t *pArgCount = &mData[offsetof(LogRecordHeader_t, argCount)];
+
+    if(0xFF == *pArgCount)
+    {
+        return;
+    }
+
+    mData[mSize] = LOG_ARG_STRING;
+    memcpy(&mData[mSize + 1], &length, sizeof(length));
+
+    if(0 < length)
+    {
+        memcpy(&mData[mSize + 1 + sizeof(length)], szValue, length);
+    }
+
+    mSize += 1 + (uint32_t)sizeof(length) + length;
+    (*pArgCount)++;
+}
+
+bool LogRecord::Decode(const void *pData, size_t size,
+    LogRecordHeader_t& header, std::vector<String>& args)
+{
+    const uint8_t *pBytes = reinterpret_cast<const uint8_t*>(pData);
+
+    if(sizeof(header) > size)
+    {
+        return false;
+    }
+
+    memcpy(&header, pBytes, sizeof(header));
+
+    size_t offset = sizeof(header);
+
+    args.clear();
+
+    for(uint8_t i = 0; i < header.argCount; ++i)
+    {
+        if(offset >= size)
+        {
+            return false;
+        }
+
+        uint8_t type = pBytes[offset++];
+
+        switch(type)
+        {
+            case LOG_ARG_INT:
+            case LOG_ARG_UINT:
+            case LOG_ARG_DOUBLE:
+            {
+                if(sizeof(uint64_t) > (size - offset))
+                {
+                    return false;
+                }
+
+                if(LOG_ARG_INT == type)
+                {
+                    int64_t value;
+                    memcpy(&value, &pBytes[offset], sizeof(value));
+                    args.push_back(std::to_string(value));
+                }
+                else if(LOG_ARG_UINT == type)
+                {
+                    uint64_t value;
+                    memcpy(&value, &pBytes[offset], sizeof(value));
+                    args.push_back(std::to_string(value));
+                }
+                else
+                {
+                    double value;
+                    char szValue[32];
+
+                    memcpy(&value, &pBytes[offset], sizeof(value));
+                    snprintf(szValue, sizeof(szValue), "%g", value);
+                    args.push_back(szValue);
+                }
+
+                offset += sizeof(uint64_t);
+                break;
+            }
+            case LOG_ARG_STRING:
+            {
+                uint32_t length;
+
+                if(sizeof(length) > (size - offset))
+                {
+                    return false;
+                }
+
+                memcpy(&length, &pBytes[offset], sizeof(length));
+                offset += sizeof(length);
+
+                if(length > (size - offset))
+                {
+                    return false;
+                }
+
+                args.push_back(std::string(reinterpret_cast<const char*>(
+                    &pBytes[offset]), length));
+
+                offset += length;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+String LogRecord::Render(const String& format,
+    const std::vector<String>& args)
+{
+    return format.Arg(args);
+}
+
+void LogRecord::WriteFileHeader(std::ostream& out)
+{
+    out.write(LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC));
+    out.write(reinterpret_cast<const char*>(&LOG_FILE_VERSION),
+        sizeof(LOG_FILE_VERSION));
+}
+
+void LogRecord::WriteFormat(std::ostream& out, uint32_t formatId,
+    const String& format)
+{
+    uint8_t type = LOG_ENTRY_FORMAT;
+    uint32_t size = (uint32_t)format.Size();
+
+    out.write(reinterpret_cast<const char*>(&type), sizeof(type));
+    out.write(reinterpret_cast<const char*>(&formatId), sizeof(formatId));
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(format.C(), (std::streamsize)size);
+}
+
+size_t LogRecord::WriteRecord(std::ostream& out, const void *pData,
+    uint32_t size)
+{
+    uint8_t type = LOG_ENTRY_RECORD;
+
+    out.write(reinterpret_cast<const char*>(&type), sizeof(type));
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(pData), (std::streamsize)size);
+
+    return sizeof(type) + sizeof(size) + size;
+}
+
+bool LogRecord::ReadFile(std::istream& in, const std::function<void(
+    const LogRecordHeader_t& header, const String& msg)>& func)
+{
+    char magic[sizeof(LOG_FILE_MAGIC)];
+    uint32_t version;
+
+    if(!in.read(magic, sizeof(magic)) || 0 != memcmp(magic,
+        LOG_FILE_MAGIC, sizeof(magic)) || !in.read(reinterpret_cast<char*>(
+        &version), sizeof(version)) || LOG_FILE_VERSION != version)
+    {
+        return false;
+    }
+
+    std::unordered_map<uint32_t, String> formats;
+    std::vector<char> data;
+    std::vector<String> args;
+
+    formats[PLAIN_FORMAT] = "%1";
+
+    uint8_t type;
+
+    while(in.read(reinterpret_cast<char*>(&type), sizeof(type)))
+    {
+        uint32_t formatId = 0;
+        uint32_t size;
+
+        if(LOG_ENTRY_FORMAT == type && !in.read(reinterpret_cast<char*>(
+            &formatId), sizeof(formatId)))
+        {
+            return false;
+        }
+
+        if(!in.read(reinterpret_cast<char*>(&size), sizeof(size)) ||
+            (LOG_ENTRY_RECORD == type && LOG_RECORD_SIZE < size))
+        {
+            return false;
+        }
+
+        data.resize(size);
+
+        if(0 < size && !in.read(&data[0], size))
+        {
+            return false;
+        }
+
+        if(LOG_ENTRY_FORMAT == type)
+        {
+            formats[formatId] = std::string(data.begin(), data.end());
+        }
+        else if(LOG_ENTRY_RECORD == type)
+        {
+            LogRecordHeader_t header;
+
+            if(!Decode(data.empty() ? nullptr : &data[0], size, header, args))
+            {
+                return false;
+            }
+
+            auto format = formats.find(header.formatId);
+
+            // A record is never written before its format.
+            if(formats.end() == format)
+            {
+                return false;
+            }
+
+            func(header, Render(format->second, args));
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return in.eof();
+}
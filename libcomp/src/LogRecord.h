@@ -0,0 +1,281 @@
+/**
+ * @file libcomp/src/LogRecord.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Binary log record that is rendered to text later.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_LOGRECORD_H
+#define LIBCOMP_SRC_LOGRECORD_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "String.h"
+
+// Standard C++11 Includes
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Fixed part of a binary log record.
+ */
+typedef struct
+{
+    /// ID of the format string (see Log::RegisterFormat).
+    uint32_t formatId;
+
+    /// Logging level of the message.
+    uint8_t level;
+
+    /// Number of arguments that follow the header.
+    uint8_t argCount;
+
+    /// Unused (keeps the header aligned).
+    uint16_t reserved;
+
+    /// When the message was logged (microseconds since the epoch).
+    uint64_t timestamp;
+
+    /// Hash of the ID of the thread that logged the message.
+    uint64_t thread;
+} LogRecordHeader_t;
+
+/**
+ * Log message stored as the ID of its format string and the raw values of
+ * its arguments. Building one is a few copies so the caller never formats
+ * any text. The writer thread (or the offline decoder) looks the format up
+ * and renders the text with @ref Render.
+ *
+ * A binary log file starts with @ref WriteFileHeader and is followed by
+ * entries. A format entry is written before the first record that uses it
+ * so the file may be decoded on its own with @ref ReadFile.
+ */
+class LogRecord
+{
+public:
+    /// Format ID of messages that were formatted by the caller. The format
+    /// is "%1" and the only argument is the message.
+    static const uint32_t PLAIN_FORMAT = 0;
+
+    /**
+     * Start a record for the calling thread at the current time.
+     * @param formatId ID of the format string.
+     * @param level Logging level of the message.
+     */
+    LogRecord(uint32_t formatId, uint8_t level);
+
+    /**
+     * Start a record with a given time and thread.
+     * @param formatId ID of the format string.
+     * @param level Logging level of the message.
+     * @param timestamp When the message was logged (see @ref Now).
+     * @param thread Thread that logged the message (see
+     *   @ref CurrentThread).
+     */
+    LogRecord(uint32_t formatId, uint8_t level, uint64_t timestamp,
+        uint64_t thread);
+
+    /**
+     * Get the current time for a record.
+     * @returns Microseconds since the epoch.
+     */
+    static uint64_t Now();
+
+    /**
+     * Get the thread for a record.
+     * @returns Hash of the ID of the calling thread.
+     */
+    static uint64_t CurrentThread();
+
+    /**
+     * Add a signed argument.
+     * @param value Value of the argument.
+     */
+    void Add(int64_t value);
+
+    /**
+     * Add an unsigned argument.
+     * @param value Value of the argument.
+     */
+    void Add(uint64_t value);
+
+    /**
+     * Add a floating point argument.
+     * @param value Value of the argument.
+     */
+    void Add(double value);
+
+    /**
+     * Add a string argument. It is cut short if the record is full.
+     * @param value Value of the argument.
+     */
+    void Add(const String& value);
+
+    /**
+     * Add a string argument. It is cut short if the record is full.
+     * @param szValue Value of the argument.
+     */
+    void Add(const char *szValue);
+
+    /**
+     * Add a string argument. It is cut short if the record is full.
+     * @param value Value of the argument.
+     */
+    void Add(const std::string& value);
+
+    /**
+     * Add an integer argument of any other size.
+     * @param value Value of the argument.
+     */
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type Add(T value)
+    {
+        if(std::is_signed<T>::value)
+        {
+            Add((int64_t)value);
+        }
+        else
+        {
+            Add((uint64_t)value);
+        }
+    }
+
+    /**
+     * Add a floating point argument of any other size.
+     * @param value Value of the argument.
+     */
+    template<typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type Add(
+        T value)
+    {
+        Add((double)value);
+    }
+
+    /**
+     * Get the logging level of the record.
+     * @returns Logging level of the record.
+     */
+    uint8_t GetLevel() const;
+
+    /**
+     * Get the encoded record.
+     * @returns Pointer to the encoded record.
+     */
+    const void* Data() const;
+
+    /**
+     * Get the size of the encoded record.
+     * @returns Size of the encoded record (in bytes).
+     */
+    uint32_t Size() const;
+
+    /**
+     * Decode a record.
+     * @param pData Encoded record.
+     * @param size Size of the encoded record.
+     * @param header Set to the fixed part of the record.
+     * @param args Set to the text of each argument.
+     * @returns true if the record is valid.
+     */
+    static bool Decode(const void *pData, size_t size,
+        LogRecordHeader_t& header, std::vector<String>& args);
+
+    /**
+     * Render the text of a record.
+     * @param format Format string of the record.
+     * @param args Text of each argument.
+     * @returns The rendered message.
+     */
+    static String Render(const String& format,
+        const std::vector<String>& args);
+
+    /**
+     * Write the start of a binary log file.
+     * @param out Stream to write to.
+     */
+    static void WriteFileHeader(std::ostream& out);
+
+    /**
+     * Write a format string to a binary log file.
+     * @param out Stream to write to.
+     * @param formatId ID of the format string.
+     * @param format The format string.
+     */
+    static void WriteFormat(std::ostream& out, uint32_t formatId,
+        const String& format);
+
+    /**
+     * Write a record to a binary log file.
+     * @param out Stream to write to.
+     * @param pData Encoded record.
+     * @param size Size of the encoded record.
+     * @returns Number of bytes written.
+     */
+    static size_t WriteRecord(std::ostream& out, const void *pData,
+        uint32_t size);
+
+    /**
+     * Read a binary log file and render each record.
+     * @param in Stream to read from.
+     * @param func Function called with the fixed part and the text of each
+     *   record (without the level prefix).
+     * @returns true if the whole file was read; false if it is not a binary
+     *   log or it is cut short.
+     */
+    static bool ReadFile(std::istream& in, const std::function<void(
+        const LogRecordHeader_t& header, const String& msg)>& func);
+
+private:
+    /**
+     * Add an argument.
+     * @param type Type of the argument.
+     * @param pValue Value of the argument.
+     * @param size Size of the value.
+     * @returns true if the argument fit in the record.
+     */
+    bool AddArgument(uint8_t type, const void *pValue, uint32_t size);
+
+    /**
+     * Add a string argument.
+     * @param szValue Value of the argument.
+     * @param size Size of the value (in bytes).
+     */
+    void AddString(const char *szValue, size_t size);
+
+    /// Size of the encoded record.
+    uint32_t mSize;
+
+    /// Encoded record (the header followed by the arguments).
+    uint8_t mData[LOG_RECORD_SIZE];
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_LOGRECORD_H
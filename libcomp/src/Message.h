@@ -27,6 +27,9 @@
 #ifndef LIBCOMP_SRC_MESSAGE_H
 #define LIBCOMP_SRC_MESSAGE_H
 
+// Standard C++11 Includes
+#include <memory>
+
 namespace libcomp
 {
 
@@ -35,8 +38,14 @@ namespace Message
 
 class Message
 {
+public:
+    virtual ~Message() { }
 };
 
+/// Owning handle for a dequeued message. Subclasses like Message::Packet
+/// return their memory to a pool when the handle is destroyed.
+typedef std::unique_ptr<Message> Handle;
+
 } // namespace Message
 
 } // namespace libcomp
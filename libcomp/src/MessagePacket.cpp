@@ -26,14 +26,42 @@
 
 #include "MessagePacket.h"
 
+// libcomp Includes
+#include "BlockPool.h"
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <new>
+
 using namespace libcomp;
 
+namespace
+{
+
+BlockPool* GetMessagePool()
+{
+    // This is never freed on purpose; messages may still be released by
+    // other threads while static objects are being destroyed.
+    static BlockPool *pPool = new BlockPool(sizeof(Message::Packet),
+        MESSAGE_POOL_SLAB_SIZE);
+
+    return pPool;
+}
+
+} // namespace
+
 Message::Packet::Packet(const std::shared_ptr<TcpConnection>& connection,
     uint16_t commandCode, ReadOnlyPacket& packet) : mPacket(std::move(packet)),
     mCommandCode(commandCode), mConnection(connection)
 {
 }
 
+Message::Packet::Packet(ConnectionHandle&& connection, uint16_t commandCode,
+    ReadOnlyPacket& packet) : mPacket(std::move(packet)),
+    mCommandCode(commandCode), mConnection(std::move(connection))
+{
+}
+
 ReadOnlyPacket& Message::Packet::GetPacket()
 {
     return mPacket;
@@ -45,6 +73,49 @@ uint16_t Message::Packet::GetCommandCode() const
 }
 
 std::shared_ptr<TcpConnection> Message::Packet::GetConnection() const
+{
+    return mConnection.Lock();
+}
+
+const ConnectionHandle& Message::Packet::GetConnectionHandle() const
 {
     return mConnection;
 }
+
+void* Message::Packet::operator new(size_t size)
+{
+    void *pMemory = nullptr;
+
+    if(sizeof(Packet) == size)
+    {
+        pMemory = GetMessagePool()->Allocate();
+    }
+    else
+    {
+        pMemory = ::operator new(size, std::nothrow);
+    }
+
+    if(nullptr == pMemory)
+    {
+        throw std::bad_alloc();
+    }
+
+    return pMemory;
+}
+
+void Message::Packet::operator delete(void *pMemory, size_t size)
+{
+    if(sizeof(Packet) == size)
+    {
+        GetMessagePool()->Free(pMemory);
+    }
+    else
+    {
+        ::operator delete(pMemory);
+    }
+}
+
+ObjectPoolStats_t Message::Packet::GetPoolStats()
+{
+    return GetMessagePool()->GetStats();
+}
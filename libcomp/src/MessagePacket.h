@@ -28,7 +28,9 @@
 #define LIBCOMP_SRC_MESSAGEPACKET_H
 
 // libcomp Includes
+#include "ConnectionHandle.h"
 #include "Message.h"
+#include "ObjectPool.h"
 #include "ReadOnlyPacket.h"
 
 // Standard C++11 Includes
@@ -48,18 +50,58 @@ public:
     Packet(const std::shared_ptr<TcpConnection>& connection,
         uint16_t commandCode, ReadOnlyPacket& packet);
 
+    /**
+     * Create a packet message that shares a connection handle. Every
+     * command of a frame uses the same handle so the connection reference
+     * is only taken once per frame.
+     * @param connection Handle to the connection the command came from.
+     * @param commandCode Command code.
+     * @param packet Command data (moved into the message).
+     */
+    Packet(ConnectionHandle&& connection, uint16_t commandCode,
+        ReadOnlyPacket& packet);
+
     ReadOnlyPacket& GetPacket();
 
     uint16_t GetCommandCode() const;
 
     std::shared_ptr<TcpConnection> GetConnection() const;
 
+    /**
+     * Get the handle to the connection the command came from. Use this
+     * instead of @ref GetConnection when the connection is not kept.
+     * @returns Connection handle.
+     */
+    const ConnectionHandle& GetConnectionHandle() const;
+
+    /**
+     * Allocate the message from a slab pool instead of the heap. One of
+     * these is created for every command received so this keeps the relay
+     * to the worker thread free of malloc.
+     * @param size Size of the object (a subclass falls back to the heap).
+     * @returns Memory for the message.
+     */
+    static void* operator new(size_t size);
+
+    /**
+     * Return the message memory to the pool it came from.
+     * @param pMemory Memory from @ref operator new.
+     * @param size Size of the object.
+     */
+    static void operator delete(void *pMemory, size_t size);
+
+    /**
+     * Get the counters for the pool the messages are allocated from.
+     * @returns Message pool counters.
+     */
+    static ObjectPoolStats_t GetPoolStats();
+
 private:
     ReadOnlyPacket mPacket;
 
     uint16_t mCommandCode;
 
-    std::shared_ptr<TcpConnection> mConnection;
+    ConnectionHandle mConnection;
 };
 
 } // namespace Message
@@ -0,0 +1,156 @@
+/**
+ * @file libcomp/src/MessagePacketFrame.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Message holding every command of a received frame.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MessagePacketFrame.h"
+
+// libcomp Includes
+#include "BlockPool.h"
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <new>
+
+using namespace libcomp;
+
+namespace
+{
+
+BlockPool* GetFramePool()
+{
+    // This is never freed on purpose; messages may still be released by
+    // other threads while static objects are being destroyed.
+    static BlockPool *pPool = new BlockPool(sizeof(Message::PacketFrame),
+        MESSAGE_POOL_SLAB_SIZE);
+
+    return pPool;
+}
+
+} // namespace
+
+Message::PacketFrame::PacketFrame(
+    const std::shared_ptr<TcpConnection>& connection,
+    ReadOnlyPacket& frame) : mFrame(frame), mConnection(connection)
+{
+    // Most frames carry only a few commands.
+    mCommands.reserve(4);
+}
+
+Message::PacketFrame::PacketFrame(ConnectionHandle&& connection,
+    ReadOnlyPacket& frame) : mFrame(frame),
+    mConnection(std::move(connection))
+{
+    mCommands.reserve(4);
+}
+
+void Message::PacketFrame::AddCommand(uint16_t commandCode, uint32_t offset,
+    uint32_t length)
+{
+    Command_t command;
+    command.commandCode = commandCode;
+    command.offset = offset;
+    command.length = length;
+
+    mCommands.push_back(command);
+}
+
+size_t Message::PacketFrame::GetCommandCount() const
+{
+    return mCommands.size();
+}
+
+uint16_t Message::PacketFrame::GetCommandCode(size_t index) const
+{
+    return mCommands.at(index).commandCode;
+}
+
+void Message::PacketFrame::GetCommand(size_t index,
+    ReadOnlyPacket& command) const
+{
+    const Command_t& location = mCommands.at(index);
+
+    ReadOnlyPacket view(mFrame, location.offset, location.length);
+
+    command = view;
+}
+
+const std::vector<Message::PacketFrame::Command_t>&
+    Message::PacketFrame::GetCommands() const
+{
+    return mCommands;
+}
+
+ReadOnlyPacket& Message::PacketFrame::GetFrame()
+{
+    return mFrame;
+}
+
+std::shared_ptr<TcpConnection> Message::PacketFrame::GetConnection() const
+{
+    return mConnection.Lock();
+}
+
+const ConnectionHandle& Message::PacketFrame::GetConnectionHandle() const
+{
+    return mConnection;
+}
+
+void* Message::PacketFrame::operator new(size_t size)
+{
+    void *pMemory = nullptr;
+
+    if(sizeof(PacketFrame) == size)
+    {
+        pMemory = GetFramePool()->Allocate();
+    }
+    else
+    {
+        pMemory = ::operator new(size, std::nothrow);
+    }
+
+    if(nullptr == pMemory)
+    {
+        throw std::bad_alloc();
+    }
+
+    return pMemory;
+}
+
+void Message::PacketFrame::operator delete(void *pMemory, size_t size)
+{
+    if(sizeof(PacketFrame) == size)
+    {
+        GetFramePool()->Free(pMemory);
+    }
+    else
+    {
+        ::operator delete(pMemory);
+    }
+}
+
+ObjectPoolStats_t Message::PacketFrame::GetPoolStats()
+{
+    return GetFramePool()->GetStats();
+}
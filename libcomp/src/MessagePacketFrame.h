@@ -0,0 +1,164 @@
+/**
+ * @file libcomp/src/MessagePacketFrame.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Message holding every command of a received frame.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_MESSAGEPACKETFRAME_H
+#define LIBCOMP_SRC_MESSAGEPACKETFRAME_H
+
+// libcomp Includes
+#include "ConnectionHandle.h"
+#include "Message.h"
+#include "ObjectPool.h"
+#include "ReadOnlyPacket.h"
+
+// Standard C++11 Includes
+#include <memory>
+#include <vector>
+
+namespace libcomp
+{
+
+class TcpConnection;
+
+namespace Message
+{
+
+/**
+ * All the commands of one decrypted frame. The frame data is kept in a
+ * single shared buffer and each command is described by its code and where
+ * its data sits in that buffer. @ref GetCommand returns a shallow view into
+ * the buffer so no command data is copied and there is one message (and
+ * one queue operation) per frame instead of per command.
+ */
+class PacketFrame : public Message
+{
+public:
+    /**
+     * Location of one command inside the frame.
+     */
+    typedef struct
+    {
+        /// Command code.
+        uint16_t commandCode;
+
+        /// Offset of the command data from the start of the frame.
+        uint32_t offset;
+
+        /// Size of the command data.
+        uint32_t length;
+    } Command_t;
+
+    /**
+     * Create a frame message.
+     * @param connection Connection the frame was received on.
+     * @param frame Packet holding the whole frame (the buffer is shared).
+     */
+    PacketFrame(const std::shared_ptr<TcpConnection>& connection,
+        ReadOnlyPacket& frame);
+
+    /**
+     * Create a frame message that shares a connection handle.
+     * @param connection Handle to the connection the frame was received on.
+     * @param frame Packet holding the whole frame (the buffer is shared).
+     */
+    PacketFrame(ConnectionHandle&& connection, ReadOnlyPacket& frame);
+
+    /**
+     * Add a command to the frame.
+     * @param commandCode Command code.
+     * @param offset Offset of the command data from the start of the frame.
+     * @param length Size of the command data.
+     */
+    void AddCommand(uint16_t commandCode, uint32_t offset, uint32_t length);
+
+    /**
+     * Get the number of commands in the frame.
+     * @returns Number of commands.
+     */
+    size_t GetCommandCount() const;
+
+    /**
+     * Get the command code of a command.
+     * @param index Index of the command.
+     * @returns Command code.
+     */
+    uint16_t GetCommandCode(size_t index) const;
+
+    /**
+     * Get a view of the data of a command. The view shares the frame buffer.
+     * @param index Index of the command.
+     * @param command Set to a read only packet with just the command data.
+     */
+    void GetCommand(size_t index, ReadOnlyPacket& command) const;
+
+    /**
+     * Get the location of every command in the frame.
+     * @returns List of command locations.
+     */
+    const std::vector<Command_t>& GetCommands() const;
+
+    /**
+     * Get the packet holding the whole frame.
+     * @returns Frame packet.
+     */
+    ReadOnlyPacket& GetFrame();
+
+    /**
+     * Get the connection the frame was received on.
+     * @returns Connection the frame was received on.
+     */
+    std::shared_ptr<TcpConnection> GetConnection() const;
+
+    /**
+     * Get the handle to the connection the frame was received on.
+     * @returns Connection handle.
+     */
+    const ConnectionHandle& GetConnectionHandle() const;
+
+    /// @copydoc Packet::operator new
+    static void* operator new(size_t size);
+
+    /// @copydoc Packet::operator delete
+    static void operator delete(void *pMemory, size_t size);
+
+    /**
+     * Get the counters for the pool the messages are allocated from.
+     * @returns Message pool counters.
+     */
+    static ObjectPoolStats_t GetPoolStats();
+
+private:
+    ReadOnlyPacket mFrame;
+
+    std::vector<Command_t> mCommands;
+
+    ConnectionHandle mConnection;
+};
+
+} // namespace Message
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_MESSAGEPACKETFRAME_H
@@ -27,85 +27,329 @@
 #ifndef LIBCOMP_SRC_MESSAGEQUEUE_H
 #define LIBCOMP_SRC_MESSAGEQUEUE_H
 
+// libcomp Includes
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <condition_variable>
 #include <list>
+#include <memory>
 #include <mutex>
-#include <condition_variable>
+#include <thread>
+#include <vector>
 
 namespace libcomp
 {
 
+/**
+ * Bounded multi-producer, single-consumer queue. Any number of threads may
+ * enqueue items without taking a lock. Only one thread may dequeue items.
+ * Each slot carries a sequence number that tells a producer when the slot is
+ * free and the consumer when it holds an item (see Dmitry Vyukov's bounded
+ * queue). The mutex and condition variable are only used to put the consumer
+ * to sleep when the queue is empty; producers only touch them when the
+ * consumer is actually sleeping.
+ */
 template<class T>
 class MessageQueue
 {
 public:
-    void Enqueue(T item)
+    /**
+     * Create a new queue.
+     * @param capacity Number of items the queue can hold. This is rounded up
+     * to a power of two.
+     */
+    explicit MessageQueue(size_t capacity = MESSAGE_QUEUE_SIZE) :
+        mCapacity(RoundCapacity(capacity)), mMask(mCapacity - 1),
+        mCells(new Cell[mCapacity]), mEnqueuePosition(0),
+        mDequeuePosition(0), mConsumerWaiting(false)
     {
-        mQueueLock.lock();
-        bool wasEmpty = mQueue.empty();
-        mQueue.push_back(item);
-        mQueueLock.unlock();
+        for(size_t i = 0; i < mCapacity; ++i)
+        {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
 
-        if(wasEmpty)
+    /**
+     * Add an item to the queue. If the queue is full this will yield until
+     * the consumer has made room.
+     * @param item Item to add.
+     */
+    void Enqueue(T item)
+    {
+        while(!TryEnqueue(item))
         {
-            std::unique_lock<std::mutex> uniqueLock(mEmptyConditionLock);
-            mEmptyCondition.notify_one();
+            std::this_thread::yield();
         }
     }
 
+    /**
+     * Add every item in the list to the queue (in order) and clear the list.
+     * Items are reserved in as few blocks of slots as possible so a batch is
+     * published with one atomic operation per block instead of per item.
+     * @param items Items to add.
+     */
     void Enqueue(std::list<T>& items)
     {
-        mQueueLock.lock();
-        bool wasEmpty = mQueue.empty();
-        mQueue.splice(mQueue.end(), items);
-        mQueueLock.unlock();
+        auto it = items.begin();
 
-        if(wasEmpty)
+        while(items.end() != it)
         {
-            std::unique_lock<std::mutex> uniqueLock(mEmptyConditionLock);
-            mEmptyCondition.notify_one();
+            size_t remaining = (size_t)std::distance(it, items.end());
+            size_t count = remaining < mCapacity ? remaining : mCapacity;
+            size_t position;
+
+            while(!ReserveSlots(count, position))
+            {
+                std::this_thread::yield();
+            }
+
+            for(size_t i = 0; i < count; ++i, ++it)
+            {
+                Publish(position + i, std::move(*it));
+            }
+        }
+
+        items.clear();
+
+        WakeConsumer();
+    }
+
+    /**
+     * Attempt to add an item to the queue without waiting.
+     * @param item Item to add.
+     * @returns true if the item was added; false if the queue is full.
+     */
+    bool TryEnqueue(T& item)
+    {
+        size_t position;
+
+        if(!ReserveSlots(1, position))
+        {
+            return false;
         }
+
+        Publish(position, std::move(item));
+        WakeConsumer();
+
+        return true;
     }
 
+    /**
+     * Remove the next item from the queue. This will block until there is
+     * an item. Must only be called from the consumer thread.
+     * @returns Next item in the queue.
+     */
     T Dequeue()
     {
-        mQueueLock.lock();
+        T item;
 
-        if(!mQueue.empty())
+        while(!TryDequeue(item))
         {
-            mQueueLock.unlock();
-            std::unique_lock<std::mutex> uniqueLock(mEmptyConditionLock);
-            mEmptyCondition.wait();
-            mQueueLock.lock();
+            WaitForItem();
         }
 
-        T item = mQueue.pop_front();
-        mQueueLock.unlock();
         return item;
     }
 
+    /**
+     * Remove the next item from the queue if there is one. Must only be
+     * called from the consumer thread.
+     * @param item Set to the item that was removed.
+     * @returns true if an item was removed; false if the queue is empty.
+     */
+    bool TryDequeue(T& item)
+    {
+        size_t position = mDequeuePosition.load(std::memory_order_relaxed);
+        Cell& cell = mCells[position & mMask];
+
+        if(cell.sequence.load(std::memory_order_acquire) != (position + 1))
+        {
+            return false;
+        }
+
+        item = std::move(cell.data);
+
+        // Mark the slot free for the producer one lap ahead.
+        cell.sequence.store(position + mCapacity, std::memory_order_release);
+        mDequeuePosition.store(position + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /**
+     * Move every item in the queue to the end of @em destinationQueue. This
+     * will block until there is at least one item. Must only be called from
+     * the consumer thread.
+     * @param destinationQueue List to append the items to.
+     */
     void DequeueAll(std::list<T>& destinationQueue)
     {
-        std::list<T> tempQueue;
+        T item;
+
+        while(!TryDequeue(item))
+        {
+            WaitForItem();
+        }
 
-        mQueueLock.lock();
+        do
+        {
+            destinationQueue.push_back(std::move(item));
+        } while(TryDequeue(item));
+    }
 
-        if(!mQueue.empty())
+    /**
+     * Move the items that are in the queue right now to the end of a
+     * vector without blocking. Must only be called from the consumer
+     * thread.
+     * @param destination Vector to append the items to.
+     * @returns Number of items moved.
+     */
+    size_t TryDequeueAll(std::vector<T>& destination)
+    {
+        size_t count = 0;
+        T item;
+
+        while(TryDequeue(item))
         {
-            mQueueLock.unlock();
-            std::unique_lock<std::mutex> uniqueLock(mEmptyConditionLock);
-            mEmptyCondition.wait();
-            mQueueLock.lock();
+            destination.push_back(std::move(item));
+            count++;
         }
 
-        mQueue.swap(tempQueue);
-        mQueueLock.unlock();
+        return count;
+    }
 
-        destinationQueue.splice(destinationQueue.end(), tempQueue);
+    /**
+     * Get the number of items waiting in the queue. This may be called from
+     * any thread but the value is only a snapshot.
+     * @returns Approximate number of items in the queue.
+     */
+    size_t Size() const
+    {
+        size_t dequeued = mDequeuePosition.load(std::memory_order_relaxed);
+        size_t enqueued = mEnqueuePosition.load(std::memory_order_relaxed);
+
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    /**
+     * Get the number of items the queue can hold.
+     * @returns Capacity of the queue.
+     */
+    size_t Capacity() const
+    {
+        return mCapacity;
     }
 
 private:
-    std::list<T> mQueue;
-    std::mutex mQueueLock;
+    /**
+     * @internal
+     * Slot in the queue.
+     */
+    class Cell
+    {
+    public:
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static size_t RoundCapacity(size_t capacity)
+    {
+        size_t rounded = 2;
+
+        while(rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+
+        return rounded;
+    }
+
+    bool ReserveSlots(size_t count, size_t& position)
+    {
+        position = mEnqueuePosition.load(std::memory_order_relaxed);
+
+        while(true)
+        {
+            // The consumer frees slots in order so if the last slot of the
+            // block is free then every slot before it is free too.
+            size_t last = position + count - 1;
+            size_t sequence = mCells[last & mMask].sequence.load(
+                std::memory_order_acquire);
+
+            if(sequence == last)
+            {
+                if(mEnqueuePosition.compare_exchange_weak(position,
+                    position + count, std::memory_order_relaxed))
+                {
+                    return true;
+                }
+            }
+            else if(sequence < last)
+            {
+                // The slot still holds an item from the last lap.
+                return false;
+            }
+            else
+            {
+                // Another producer got there first.
+                position = mEnqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Publish(size_t position, T&& item)
+    {
+        Cell& cell = mCells[position & mMask];
+        cell.data = std::move(item);
+        cell.sequence.store(position + 1, std::memory_order_release);
+    }
+
+    void WakeConsumer()
+    {
+        // Pairs with the fence in WaitForItem() so either the consumer sees
+        // the new item or this sees that the consumer is waiting.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(mConsumerWaiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> guard(mEmptyConditionLock);
+            mEmptyCondition.notify_one();
+        }
+    }
+
+    void WaitForItem()
+    {
+        std::unique_lock<std::mutex> uniqueLock(mEmptyConditionLock);
+
+        mConsumerWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        mEmptyCondition.wait(uniqueLock, [this]()
+        {
+            size_t position = mDequeuePosition.load(
+                std::memory_order_relaxed);
+
+            return mCells[position & mMask].sequence.load(
+                std::memory_order_acquire) == (position + 1);
+        });
+
+        mConsumerWaiting.store(false, std::memory_order_relaxed);
+    }
+
+    const size_t mCapacity;
+    const size_t mMask;
+    std::unique_ptr<Cell[]> mCells;
+
+    // Keep the producer and consumer positions on separate cache lines.
+    char mPositionPadding[64 - sizeof(std::unique_ptr<Cell[]>)];
+    std::atomic<size_t> mEnqueuePosition;
+    char mEnqueuePadding[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> mDequeuePosition;
+    char mDequeuePadding[64 - sizeof(std::atomic<size_t>)];
+
+    std::atomic<bool> mConsumerWaiting;
     std::mutex mEmptyConditionLock;
     std::condition_variable mEmptyCondition;
 };
@@ -0,0 +1,475 @@
+/**
+ * @file libcomp/src/MessageScheduler.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Work-stealing scheduler for queued messages.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MessageScheduler.h"
+
+// libcomp Includes
+#include "CommandProfiler.h"
+#include "Exception.h"
+#include "Log.h"
+#include "MessagePacket.h"
+#include "MessagePacketFrame.h"
+#include "Metrics.h"
+#include "ThreadAffinity.h"
+#include "Tracer.h"
+
+using namespace libcomp;
+
+/// Keys for messages with no ordering (a connection pointer never has the
+/// top bit set).
+static const uint64_t UNORDERED_KEY_BIT = 1ULL << 63;
+
+/**
+ * @internal
+ * Mix the bits of a strand key. Connection pointers are aligned so the low
+ * bits alone would put every connection on the same worker.
+ * @param key Strand key.
+ * @returns Mixed key.
+ */
+static uint64_t MixKey(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+
+    return key;
+}
+
+/**
+ * @internal
+ * Metrics shared by every scheduler.
+ */
+class MessageSchedulerMetrics
+{
+public:
+    MessageSchedulerMetrics() : queued(Metrics::GetSingletonPtr()->Gauge(
+        "comp_scheduler_queued_messages", "Messages waiting for a "
+        "scheduler worker.")), handled(Metrics::GetSingletonPtr()->Counter(
+        "comp_scheduler_messages_total", "Messages run by the scheduler.")),
+        steals(Metrics::GetSingletonPtr()->Counter(
+        "comp_scheduler_steals_total", "Connections a scheduler worker "
+        "took from another worker."))
+    {
+    }
+
+    MetricGauge& queued;
+    MetricCounter& handled;
+    MetricCounter& steals;
+};
+
+/**
+ * @internal
+ * Get the scheduler metrics.
+ * @returns Metrics shared by every scheduler.
+ */
+static MessageSchedulerMetrics& GetMetrics()
+{
+    static MessageSchedulerMetrics metrics;
+
+    return metrics;
+}
+
+MessageScheduler::Strand::Strand(uint64_t strandKey) : key(strandKey),
+    scheduled(false)
+{
+}
+
+MessageScheduler::MessageScheduler(const Handler_t& handler,
+    size_t threadCount) : mHandler(handler), mNextUnorderedKey(0),
+    mPendingStrands(0), mSleepingWorkers(0), mAccepting(true),
+    mStopping(false), mSubmitted(0), mCompleted(0), mRejected(0), mSteals(0)
+{
+    if(0 == threadCount)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    if(0 == threadCount)
+    {
+        threadCount = 1;
+    }
+
+    // Create every worker before any thread may try to steal from them.
+    for(size_t i = 0; i < threadCount; ++i)
+    {
+        mWorkers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+
+    for(size_t i = 0; i < threadCount; ++i)
+    {
+        mWorkers[i]->thread = std::thread([this, i]()
+        {
+            ThreadAffinity::Apply(ThreadAffinity::ROLE_WORKER, i);
+
+            Run(i);
+        });
+    }
+}
+
+MessageScheduler::~MessageScheduler()
+{
+    Stop();
+}
+
+void MessageScheduler::Stop()
+{
+    if(mConsumeThread.joinable())
+    {
+        // The consumer submits everything queued before the null message.
+        mConsumed->Enqueue(nullptr);
+        mConsumeThread.join();
+    }
+
+    mAccepting = false;
+
+    {
+        std::lock_guard<std::mutex> guard(mIdleLock);
+        mStopping = true;
+    }
+
+    mIdleCondition.notify_all();
+
+    for(auto& worker : mWorkers)
+    {
+        if(worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+
+    // Anything left was submitted while stopping.
+    for(auto& shard : mShards)
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        for(auto& pair : shard.strands)
+        {
+            for(auto pMessage : pair.second->messages)
+            {
+                delete pMessage;
+                mRejected++;
+            }
+        }
+
+        shard.strands.clear();
+    }
+}
+
+bool MessageScheduler::Submit(Message::Message *pMessage)
+{
+    return Submit(GetAffinityKey(pMessage), pMessage);
+}
+
+bool MessageScheduler::Submit(uint64_t key, Message::Message *pMessage)
+{
+    if(!mAccepting)
+    {
+        delete pMessage;
+        mRejected++;
+
+        return false;
+    }
+
+    if(0 == key)
+    {
+        key = UNORDERED_KEY_BIT | mNextUnorderedKey++;
+    }
+
+    Strand *pStrand = nullptr;
+
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        std::unique_ptr<Strand>& strand = shard.strands[key];
+
+        if(!strand)
+        {
+            strand.reset(new Strand(key));
+        }
+
+        strand->messages.push_back(pMessage);
+
+        // Only an idle strand has to be given to a worker.
+        if(!strand->scheduled)
+        {
+            strand->scheduled = true;
+            pStrand = strand.get();
+        }
+    }
+
+    mSubmitted++;
+    GetMetrics().queued.Add(1);
+
+    if(nullptr != pStrand)
+    {
+        // Keep a connection on the same worker while it has no backlog.
+        PushStrand((size_t)(MixKey(key) % mWorkers.size()), pStrand);
+    }
+
+    return true;
+}
+
+bool MessageScheduler::Consume(const std::shared_ptr<MessageQueue<
+    Message::Message*>>& queue)
+{
+    if(!queue || mConsumeThread.joinable() || !mAccepting)
+    {
+        return false;
+    }
+
+    mConsumed = queue;
+    mConsumeThread = std::thread([this]()
+    {
+        std::list<Message::Message*> messages;
+        bool running = true;
+
+        while(running)
+        {
+            mConsumed->DequeueAll(messages);
+
+            for(auto pMessage : messages)
+            {
+                if(nullptr == pMessage)
+                {
+                    running = false;
+                }
+                else
+                {
+                    (void)Submit(pMessage);
+                }
+            }
+
+            messages.clear();
+        }
+    });
+
+    return true;
+}
+
+size_t MessageScheduler::GetThreadCount() const
+{
+    return mWorkers.size();
+}
+
+MessageSchedulerStats_t MessageScheduler::GetStats() const
+{
+    MessageSchedulerStats_t stats;
+    stats.submitted = mSubmitted;
+    stats.completed = mCompleted;
+    stats.rejected = mRejected;
+    stats.queued = stats.submitted - stats.completed;
+    stats.steals = mSteals;
+
+    return stats;
+}
+
+uint64_t MessageScheduler::GetAffinityKey(const Message::Message *pMessage)
+{
+    // The handle is read without touching the connection reference count.
+    const TcpConnection *pConnection = nullptr;
+
+    auto pPacket = dynamic_cast<const Message::Packet*>(pMessage);
+
+    if(nullptr != pPacket)
+    {
+        pConnection = pPacket->GetConnectionHandle().Get();
+    }
+    else
+    {
+        auto pFrame = dynamic_cast<const Message::PacketFrame*>(pMessage);
+
+        if(nullptr != pFrame)
+        {
+            pConnection = pFrame->GetConnectionHandle().Get();
+        }
+    }
+
+    return (uint64_t)(uintptr_t)pConnection;
+}
+
+void MessageScheduler::Run(size_t index)
+{
+    while(true)
+    {
+        Strand *pStrand = TakeStrand(index);
+
+        if(nullptr != pStrand)
+        {
+            RunStrand(index, pStrand);
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> uniqueLock(mIdleLock);
+
+        mSleepingWorkers++;
+
+        // Pairs with the check in PushStrand() so either this sees the new
+        // strand or the pusher sees this worker sleeping.
+        mIdleCondition.wait(uniqueLock, [this]()
+        {
+            return 0 < mPendingStrands || mStopping;
+        });
+
+        mSleepingWorkers--;
+
+        if(mStopping && 0 == mPendingStrands)
+        {
+            break;
+        }
+    }
+}
+
+MessageScheduler::Strand* MessageScheduler::TakeStrand(size_t index)
+{
+    Strand *pStrand = nullptr;
+
+    // Take the oldest strand of this worker first.
+    {
+        Worker& worker = *mWorkers[index];
+        std::lock_guard<std::mutex> guard(worker.lock);
+
+        if(!worker.strands.empty())
+        {
+            pStrand = worker.strands.front();
+            worker.strands.pop_front();
+        }
+    }
+
+    // Steal the newest strand of another worker (the one the owner would
+    // get to last).
+    for(size_t i = 1; nullptr == pStrand && i < mWorkers.size(); ++i)
+    {
+        Worker& victim = *mWorkers[(index + i) % mWorkers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        if(!victim.strands.empty())
+        {
+            pStrand = victim.strands.back();
+            victim.strands.pop_back();
+
+            mSteals++;
+            GetMetrics().steals.Increment();
+        }
+    }
+
+    if(nullptr != pStrand)
+    {
+        mPendingStrands--;
+    }
+
+    return pStrand;
+}
+
+void MessageScheduler::RunStrand(size_t index, Strand *pStrand)
+{
+    Shard& shard = GetShard(pStrand->key);
+
+    for(size_t i = 0; i < SCHEDULER_STRAND_BATCH; ++i)
+    {
+        Message::Handle message;
+
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+
+            if(pStrand->messages.empty())
+            {
+                // Nothing else can reach the strand once it is idle and
+                // out of the map.
+                pStrand->scheduled = false;
+                shard.strands.erase(pStrand->key);
+
+                return;
+            }
+
+            message.reset(pStrand->messages.front());
+            pStrand->messages.pop_front();
+        }
+
+        try
+        {
+            auto pPacket = dynamic_cast<Message::Packet*>(message.get());
+
+            if(nullptr != pPacket)
+            {
+                CommandProfiler::HandlerScope profile(
+                    pPacket->GetCommandCode());
+                TRACE_SCOPE("handler");
+
+                mHandler(*message);
+            }
+            else
+            {
+                TRACE_SCOPE("handler");
+
+                mHandler(*message);
+            }
+        }
+        catch(libcomp::Exception& e)
+        {
+            e.Log();
+        }
+        catch(...)
+        {
+            LOG_ERROR("Unhandled exception in a message handler.\n");
+        }
+
+        message.reset();
+
+        mCompleted++;
+        GetMetrics().queued.Add(-1);
+        GetMetrics().handled.Increment();
+    }
+
+    // Let the other strands of this worker run before the rest of this one.
+    PushStrand(index, pStrand);
+}
+
+void MessageScheduler::PushStrand(size_t index, Strand *pStrand)
+{
+    // Count the strand first so the count never drops below the number of
+    // strands on the deques.
+    mPendingStrands++;
+
+    {
+        Worker& worker = *mWorkers[index];
+        std::lock_guard<std::mutex> guard(worker.lock);
+
+        worker.strands.push_back(pStrand);
+    }
+
+    if(0 < mSleepingWorkers)
+    {
+        std::lock_guard<std::mutex> guard(mIdleLock);
+        mIdleCondition.notify_one();
+    }
+}
+
+MessageScheduler::Shard& MessageScheduler::GetShard(uint64_t key)
+{
+    return mShards[MixKey(key) % SCHEDULER_SHARD_COUNT];
+}
@@ -0,0 +1,247 @@
+/**
+ * @file libcomp/src/MessageScheduler.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Work-stealing scheduler for queued messages.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_MESSAGESCHEDULER_H
+#define LIBCOMP_SRC_MESSAGESCHEDULER_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "Message.h"
+#include "MessageQueue.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Counters for the messages run by a @ref MessageScheduler.
+ */
+typedef struct
+{
+    /// Number of messages accepted.
+    uint64_t submitted;
+
+    /// Number of messages the handler finished with.
+    uint64_t completed;
+
+    /// Number of messages rejected because the scheduler was stopped.
+    uint64_t rejected;
+
+    /// Number of messages waiting to be handled.
+    uint64_t queued;
+
+    /// Number of times a worker took a connection from another worker.
+    uint64_t steals;
+} MessageSchedulerStats_t;
+
+/**
+ * Runs queued messages on a pool of worker threads. Messages from the same
+ * connection (see @ref GetAffinityKey) are put on one strand and run one
+ * at a time in the order they were submitted, so the commands of a client
+ * stay ordered while different clients are handled in parallel. A strand
+ * with work is owned by one worker at a time; each worker keeps its own
+ * deque of strands and an idle worker steals strands from the back of
+ * another worker's deque. A worker runs at most @ref SCHEDULER_STRAND_BATCH
+ * messages from a strand before it moves to the next one so one busy client
+ * can not starve the others.
+ */
+class MessageScheduler
+{
+public:
+    /// Function that handles a message. The scheduler deletes the message
+    /// once the handler returns.
+    typedef std::function<void(Message::Message&)> Handler_t;
+
+    /**
+     * Create and start the worker threads.
+     * @param handler Function to run for each message.
+     * @param threadCount Number of threads (zero will use one per hardware
+     *   thread).
+     */
+    explicit MessageScheduler(const Handler_t& handler,
+        size_t threadCount = 0);
+
+    /**
+     * Stop the scheduler (see @ref Stop).
+     */
+    ~MessageScheduler();
+
+    /**
+     * Stop taking messages from the consumed queue, run every message that
+     * was accepted and stop the worker threads. Call this once nothing else
+     * submits messages.
+     */
+    void Stop();
+
+    /**
+     * Schedule a message on the strand of its connection.
+     * @param pMessage Message to handle (the scheduler takes ownership).
+     * @returns true if the message was scheduled; false (and the message is
+     *   deleted) if the scheduler was stopped.
+     */
+    bool Submit(Message::Message *pMessage);
+
+    /**
+     * Schedule a message on a strand.
+     * @param key Strand to run the message on (0 runs the message without
+     *   any ordering).
+     * @param pMessage Message to handle (the scheduler takes ownership).
+     * @returns true if the message was scheduled; false (and the message is
+     *   deleted) if the scheduler was stopped.
+     */
+    bool Submit(uint64_t key, Message::Message *pMessage);
+
+    /**
+     * Start a thread that moves every message from a queue into the
+     * scheduler. This replaces the single consumer thread of the queue so
+     * nothing else should dequeue from it. @ref Stop ends the thread by
+     * queuing a null message. Only one queue may be consumed.
+     * @param queue Queue to take messages from.
+     * @returns true if the thread was started.
+     */
+    bool Consume(const std::shared_ptr<MessageQueue<
+        Message::Message*>>& queue);
+
+    /**
+     * Get the number of worker threads.
+     * @returns Number of worker threads.
+     */
+    size_t GetThreadCount() const;
+
+    /**
+     * Get the current counters.
+     * @returns Scheduler counters.
+     */
+    MessageSchedulerStats_t GetStats() const;
+
+    /**
+     * Get the strand a message should run on. Messages for a connection
+     * (@ref Message::Packet and @ref Message::PacketFrame) use the
+     * connection; other messages have no ordering.
+     * @param pMessage Message to check.
+     * @returns Strand key for the message (0 for no ordering).
+     */
+    static uint64_t GetAffinityKey(const Message::Message *pMessage);
+
+private:
+    /**
+     * @internal
+     * Messages of one connection that have to run in order.
+     */
+    class Strand
+    {
+    public:
+        explicit Strand(uint64_t strandKey);
+
+        /// Key the strand is stored under.
+        uint64_t key;
+
+        /// Messages waiting to run (guarded by the shard lock).
+        std::deque<Message::Message*> messages;
+
+        /// Set while the strand is on a worker deque or running (guarded
+        /// by the shard lock).
+        bool scheduled;
+    };
+
+    /**
+     * @internal
+     * Strands that share a lock.
+     */
+    class Shard
+    {
+    public:
+        std::mutex lock;
+        std::unordered_map<uint64_t, std::unique_ptr<Strand>> strands;
+    };
+
+    /**
+     * @internal
+     * Worker thread and the strands it owns.
+     */
+    class Worker
+    {
+    public:
+        std::mutex lock;
+        std::deque<Strand*> strands;
+        std::thread thread;
+    };
+
+    void Run(size_t index);
+
+    Strand* TakeStrand(size_t index);
+
+    void RunStrand(size_t index, Strand *pStrand);
+
+    void PushStrand(size_t index, Strand *pStrand);
+
+    Shard& GetShard(uint64_t key);
+
+    Handler_t mHandler;
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    Shard mShards[SCHEDULER_SHARD_COUNT];
+
+    /// Key for the next message with no ordering.
+    std::atomic<uint64_t> mNextUnorderedKey;
+
+    /// Number of strands waiting on a worker deque.
+    std::atomic<size_t> mPendingStrands;
+
+    /// Number of workers waiting for a strand.
+    std::atomic<size_t> mSleepingWorkers;
+
+    std::atomic<bool> mAccepting;
+    std::atomic<bool> mStopping;
+
+    std::mutex mIdleLock;
+    std::condition_variable mIdleCondition;
+
+    /// Queue moved into the scheduler by the consumer thread.
+    std::shared_ptr<MessageQueue<Message::Message*>> mConsumed;
+    std::thread mConsumeThread;
+
+    std::atomic<uint64_t> mSubmitted;
+    std::atomic<uint64_t> mCompleted;
+    std::atomic<uint64_t> mRejected;
+    std::atomic<uint64_t> mSteals;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_MESSAGESCHEDULER_H
@@ -0,0 +1,324 @@
+/**
+ * @file libcomp/src/Metrics.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Runtime counters, gauges and histograms.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Metrics.h"
+
+using namespace libcomp;
+
+/// Source of the shard each thread uses.
+static std::atomic<size_t> gNextShard(0);
+
+/**
+ * @internal
+ * Get the shard the calling thread updates.
+ * @returns Index of the shard.
+ */
+static size_t ThreadShard()
+{
+    static thread_local size_t shard = gNextShard++ % METRICS_SHARD_COUNT;
+
+    return shard;
+}
+
+/**
+ * @internal
+ * Format microseconds as seconds for the text format.
+ * @param microseconds Value to format.
+ * @returns Value in seconds.
+ */
+static String Seconds(uint64_t microseconds)
+{
+    return String("%1.%2").Arg(microseconds / 1000000).Arg(
+        microseconds % 1000000, 6, 10, '0');
+}
+
+/**
+ * @internal
+ * Write a metric name with its labels (and one extra label).
+ * @param name Name of the metric.
+ * @param labels Label set of the metric.
+ * @param extra Extra label to add (may be empty).
+ * @returns Name and labels for the text format.
+ */
+static String Series(const String& name, const std::string& labels,
+    const String& extra = String())
+{
+    if(labels.empty() && extra.IsEmpty())
+    {
+        return name;
+    }
+
+    String joined = labels;
+
+    if(!labels.empty() && !extra.IsEmpty())
+    {
+        joined += ",";
+    }
+
+    return String("%1{%2}").Arg(name).Arg(joined + extra);
+}
+
+MetricCounter::MetricCounter()
+{
+    for(auto& shard : mShards)
+    {
+        shard.value = 0;
+    }
+}
+
+void MetricCounter::Increment(uint64_t count)
+{
+    mShards[ThreadShard()].value.fetch_add(count, std::memory_order_relaxed);
+}
+
+uint64_t MetricCounter::Value() const
+{
+    uint64_t value = 0;
+
+    for(auto& shard : mShards)
+    {
+        value += shard.value.load(std::memory_order_relaxed);
+    }
+
+    return value;
+}
+
+MetricGauge::MetricGauge() : mValue(0)
+{
+}
+
+void MetricGauge::Set(int64_t value)
+{
+    mValue.store(value, std::memory_order_relaxed);
+}
+
+void MetricGauge::Add(int64_t delta)
+{
+    mValue.fetch_add(delta, std::memory_order_relaxed);
+}
+
+int64_t MetricGauge::Value() const
+{
+    return mValue.load(std::memory_order_relaxed);
+}
+
+MetricHistogram::MetricHistogram(const std::vector<uint64_t>& bounds) :
+    mBounds(bounds)
+{
+    for(auto& shard : mShards)
+    {
+        shard.buckets.reset(new std::atomic<uint64_t>[mBounds.size() + 1]);
+
+        for(size_t i = 0; i <= mBounds.size(); ++i)
+        {
+            shard.buckets[i] = 0;
+        }
+
+        shard.sum = 0;
+        shard.count = 0;
+    }
+}
+
+void MetricHistogram::Observe(uint64_t microseconds)
+{
+    size_t bucket = 0;
+
+    while(bucket < mBounds.size() && microseconds > mBounds[bucket])
+    {
+        bucket++;
+    }
+
+    Shard& shard = mShards[ThreadShard()];
+    shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(microseconds, std::memory_order_relaxed);
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MetricHistogram::ObserveSince(std::chrono::steady_clock::time_point start)
+{
+    Observe((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+const std::vector<uint64_t>& MetricHistogram::GetBounds() const
+{
+    return mBounds;
+}
+
+MetricHistogram::Snapshot_t MetricHistogram::GetSnapshot() const
+{
+    Snapshot_t snapshot;
+    snapshot.buckets.assign(mBounds.size() + 1, 0);
+    snapshot.sum = 0;
+    snapshot.count = 0;
+
+    for(auto& shard : mShards)
+    {
+        for(size_t i = 0; i <= mBounds.size(); ++i)
+        {
+            snapshot.buckets[i] += shard.buckets[i].load(
+                std::memory_order_relaxed);
+        }
+
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        snapshot.count += shard.count.load(std::memory_order_relaxed);
+    }
+
+    return snapshot;
+}
+
+Metrics::Metrics()
+{
+}
+
+Metrics* Metrics::GetSingletonPtr()
+{
+    // Never destroyed so metrics may still be updated during shutdown.
+    static Metrics *pMetrics = new Metrics;
+
+    return pMetrics;
+}
+
+MetricCounter& Metrics::Counter(const String& name, const String& help,
+    const String& labels)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    std::unique_ptr<MetricCounter>& metric = GetFamily(name, help,
+        "counter").counters[labels.ToUtf8()];
+
+    if(!metric)
+    {
+        metric.reset(new MetricCounter);
+    }
+
+    return *metric;
+}
+
+MetricGauge& Metrics::Gauge(const String& name, const String& help,
+    const String& labels)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    std::unique_ptr<MetricGauge>& metric = GetFamily(name, help,
+        "gauge").gauges[labels.ToUtf8()];
+
+    if(!metric)
+    {
+        metric.reset(new MetricGauge);
+    }
+
+    return *metric;
+}
+
+MetricHistogram& Metrics::Histogram(const String& name, const String& help,
+    const String& labels, const std::vector<uint64_t>& bounds)
+{
+    static const std::vector<uint64_t> DEFAULT_BOUNDS = {
+        10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+        100000, 250000, 500000, 1000000, 2500000, 5000000,
+    };
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    std::unique_ptr<MetricHistogram>& metric = GetFamily(name, help,
+        "histogram").histograms[labels.ToUtf8()];
+
+    if(!metric)
+    {
+        metric.reset(new MetricHistogram(bounds.empty() ?
+            DEFAULT_BOUNDS : bounds));
+    }
+
+    return *metric;
+}
+
+String Metrics::Export() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    String text;
+
+    for(auto& familyPair : mFamilies)
+    {
+        String name = familyPair.first;
+        const Family& family = familyPair.second;
+
+        text += String("# HELP %1 %2\n# TYPE %1 %3\n").Arg(name).Arg(
+            family.help).Arg(family.szType);
+
+        for(auto& metric : family.counters)
+        {
+            text += String("%1 %2\n").Arg(Series(name, metric.first)).Arg(
+                metric.second->Value());
+        }
+
+        for(auto& metric : family.gauges)
+        {
+            text += String("%1 %2\n").Arg(Series(name, metric.first)).Arg(
+                metric.second->Value());
+        }
+
+        for(auto& metric : family.histograms)
+        {
+            const std::vector<uint64_t>& bounds = metric.second->GetBounds();
+            MetricHistogram::Snapshot_t snapshot =
+                metric.second->GetSnapshot();
+            uint64_t cumulative = 0;
+
+            for(size_t i = 0; i < bounds.size(); ++i)
+            {
+                cumulative += snapshot.buckets[i];
+
+                text += String("%1 %2\n").Arg(Series(name + "_bucket",
+                    metric.first, String("le=\"%1\"").Arg(Seconds(
+                    bounds[i])))).Arg(cumulative);
+            }
+
+            text += String("%1 %2\n%3 %4\n%5 %6\n").Arg(Series(
+                name + "_bucket", metric.first, "le=\"+Inf\"")).Arg(
+                snapshot.count).Arg(Series(name + "_sum", metric.first)).Arg(
+                Seconds(snapshot.sum)).Arg(Series(name + "_count",
+                metric.first)).Arg(snapshot.count);
+        }
+    }
+
+    return text;
+}
+
+Metrics::Family& Metrics::GetFamily(const String& name, const String& help,
+    const char *szType)
+{
+    Family& family = mFamilies[name.ToUtf8()];
+
+    if(nullptr == family.szType)
+    {
+        family.help = help;
+        family.szType = szType;
+    }
+
+    return family;
+}
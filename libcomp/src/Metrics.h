@@ -0,0 +1,280 @@
+/**
+ * @file libcomp/src/Metrics.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Runtime counters, gauges and histograms.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_METRICS_H
+#define LIBCOMP_SRC_METRICS_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "String.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Counter that only goes up. Each thread adds to one of several shards (on
+ * their own cache lines) so busy threads do not fight over one atomic; the
+ * shards are summed when the counter is read.
+ */
+class MetricCounter
+{
+public:
+    MetricCounter();
+
+    /**
+     * Add to the counter.
+     * @param count Amount to add.
+     */
+    void Increment(uint64_t count = 1);
+
+    /**
+     * Get the current value of the counter.
+     * @returns Sum of every shard.
+     */
+    uint64_t Value() const;
+
+private:
+    /**
+     * @internal
+     * Part of the counter updated by a subset of the threads.
+     */
+    class Shard
+    {
+    public:
+        std::atomic<uint64_t> value;
+
+        // Keep each shard on its own cache line.
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    Shard mShards[METRICS_SHARD_COUNT];
+};
+
+/**
+ * Value that may go up and down (like the number of open connections).
+ */
+class MetricGauge
+{
+public:
+    MetricGauge();
+
+    /**
+     * Set the gauge.
+     * @param value New value.
+     */
+    void Set(int64_t value);
+
+    /**
+     * Add to (or subtract from) the gauge.
+     * @param delta Amount to add.
+     */
+    void Add(int64_t delta);
+
+    /**
+     * Get the current value of the gauge.
+     * @returns Value of the gauge.
+     */
+    int64_t Value() const;
+
+private:
+    std::atomic<int64_t> mValue;
+};
+
+/**
+ * Distribution of durations in microseconds. Observations are counted in
+ * buckets (per shard like @ref MetricCounter) and exported in seconds.
+ */
+class MetricHistogram
+{
+public:
+    /**
+     * Merged view of a histogram.
+     */
+    typedef struct
+    {
+        /// Observations in each bucket (not cumulative). The last bucket
+        /// holds everything over the highest bound.
+        std::vector<uint64_t> buckets;
+
+        /// Sum of every observation (in microseconds).
+        uint64_t sum;
+
+        /// Number of observations.
+        uint64_t count;
+    } Snapshot_t;
+
+    /**
+     * Create a new histogram.
+     * @param bounds Upper bound (in microseconds) of each bucket in
+     *   ascending order.
+     */
+    explicit MetricHistogram(const std::vector<uint64_t>& bounds);
+
+    /**
+     * Record a duration.
+     * @param microseconds Duration to record.
+     */
+    void Observe(uint64_t microseconds);
+
+    /**
+     * Record the time since @em start.
+     * @param start When the measured work started.
+     */
+    void ObserveSince(std::chrono::steady_clock::time_point start);
+
+    /**
+     * Get the bucket bounds.
+     * @returns Upper bound of each bucket in microseconds.
+     */
+    const std::vector<uint64_t>& GetBounds() const;
+
+    /**
+     * Merge the shards.
+     * @returns Current state of the histogram.
+     */
+    Snapshot_t GetSnapshot() const;
+
+private:
+    /**
+     * @internal
+     * Part of the histogram updated by a subset of the threads.
+     */
+    class Shard
+    {
+    public:
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> count;
+
+        // Keep each shard on its own cache line.
+        char padding[64 - sizeof(std::unique_ptr<std::atomic<uint64_t>[]>) -
+            2 * sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::vector<uint64_t> mBounds;
+    Shard mShards[METRICS_SHARD_COUNT];
+};
+
+/**
+ * Registry of every metric in the process. Metrics are created the first
+ * time they are asked for and live until the process exits so callers
+ * should keep the returned reference (usually in a static) instead of
+ * looking the metric up each time. A metric is identified by its name and
+ * label set; the label set is written as it appears in the Prometheus text
+ * format (for example @c code="0x0003").
+ */
+class Metrics
+{
+public:
+    /**
+     * Get the registry.
+     * @returns Pointer to the registry.
+     */
+    static Metrics* GetSingletonPtr();
+
+    /**
+     * Get (or create) a counter.
+     * @param name Name of the metric.
+     * @param help Description of the metric.
+     * @param labels Label set (may be empty).
+     * @returns Counter with the name and labels.
+     */
+    MetricCounter& Counter(const String& name, const String& help,
+        const String& labels = String());
+
+    /**
+     * Get (or create) a gauge.
+     * @param name Name of the metric.
+     * @param help Description of the metric.
+     * @param labels Label set (may be empty).
+     * @returns Gauge with the name and labels.
+     */
+    MetricGauge& Gauge(const String& name, const String& help,
+        const String& labels = String());
+
+    /**
+     * Get (or create) a histogram.
+     * @param name Name of the metric.
+     * @param help Description of the metric.
+     * @param labels Label set (may be empty).
+     * @param bounds Bucket bounds in microseconds (only used if the
+     *   histogram is created). Empty for the default latency buckets.
+     * @returns Histogram with the name and labels.
+     */
+    MetricHistogram& Histogram(const String& name, const String& help,
+        const String& labels = String(),
+        const std::vector<uint64_t>& bounds = std::vector<uint64_t>());
+
+    /**
+     * Write every metric in the Prometheus text exposition format.
+     * @returns Text of every metric.
+     */
+    String Export() const;
+
+private:
+    Metrics();
+
+    /**
+     * @internal
+     * Every metric with one name (they all have the same type).
+     */
+    class Family
+    {
+    public:
+        Family() : szType(nullptr)
+        {
+        }
+
+        String help;
+        const char *szType;
+
+        std::map<std::string, std::unique_ptr<MetricCounter>> counters;
+        std::map<std::string, std::unique_ptr<MetricGauge>> gauges;
+        std::map<std::string, std::unique_ptr<MetricHistogram>> histograms;
+    };
+
+    Family& GetFamily(const String& name, const String& help,
+        const char *szType);
+
+    std::map<std::string, Family> mFamilies;
+
+    mutable std::mutex mLock;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_METRICS_H
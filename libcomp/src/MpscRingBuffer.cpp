@@ -0,0 +1,202 @@
+/**
+ * @file libcomp/src/MpscRingBuffer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Multiple producer, single consumer ring buffer of records.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MpscRingBuffer.h"
+
+#include <cstring>
+
+using namespace libcomp;
+
+/// Bit of the length prefix set once the record may be read.
+static const uint32_t RECORD_COMMITTED = 0x80000000u;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+    "The length prefix must be a plain 32-bit value.");
+
+/**
+ * @internal
+ * Get the length prefix of a record as an atomic value.
+ * @param pPrefix Start of the record.
+ * @returns The length prefix.
+ */
+static inline std::atomic<uint32_t>* Prefix(const void *pPrefix)
+{
+    return reinterpret_cast<std::atomic<uint32_t>*>(
+        const_cast<void*>(pPrefix));
+}
+
+MpscRingBuffer::MpscRingBuffer(int32_t capacity) : mRing(capacity),
+    mBuffer(mRing.mBuffer), mCapacity((uint32_t)mRing.mCapacity),
+    mCapacityMask((uint32_t)mRing.mCapacityMask), mReserveIndex(0),
+    mReadIndex(0)
+{
+    // The mapping starts out zeroed so no record looks committed.
+}
+
+int32_t MpscRingBuffer::Capacity() const
+{
+    return (int32_t)mCapacity;
+}
+
+int32_t MpscRingBuffer::Used() const
+{
+    return (int32_t)(mReserveIndex.load(std::memory_order_acquire) -
+        mReadIndex.load(std::memory_order_acquire));
+}
+
+void* MpscRingBuffer::BeginRecord(int32_t size)
+{
+    if(0 > size || (uint32_t)size > mCapacity)
+    {
+        return nullptr;
+    }
+
+    uint32_t total = RecordSize(size);
+    uint32_t reserve = mReserveIndex.load(std::memory_order_relaxed);
+
+    // Claim the space with one atomic update. A plain fetch_add can't be
+    // undone if the buffer turns out to be full so the claim is only made
+    // if the record fits. The acquire on the read index makes the consumer
+    // clearing the space visible before it is reused.
+    do
+    {
+        uint32_t read = mReadIndex.load(std::memory_order_acquire);
+
+        if(total > mCapacity - (reserve - read))
+        {
+            return nullptr;
+        }
+    } while(!mReserveIndex.compare_exchange_weak(reserve, reserve + total,
+        std::memory_order_relaxed));
+
+    int8_t *pRecord = &mBuffer[reserve & mCapacityMask];
+
+    // The size is kept in the prefix but the record can't be read until
+    // the committed bit is set too.
+    Prefix(pRecord)->store((uint32_t)size, std::memory_order_relaxed);
+
+    return pRecord + sizeof(uint32_t);
+}
+
+void MpscRingBuffer::EndRecord(void *pRecord)
+{
+    std::atomic<uint32_t> *pPrefix = Prefix(
+        reinterpret_cast<int8_t*>(pRecord) - sizeof(uint32_t));
+
+    // The release publishes the record data written before it.
+    pPrefix->store(pPrefix->load(std::memory_order_relaxed) |
+        RECORD_COMMITTED, std::memory_order_release);
+}
+
+bool MpscRingBuffer::WriteRecord(const void *pSource, int32_t size)
+{
+    void *pRecord = BeginRecord(size);
+
+    if(nullptr == pRecord)
+    {
+        return false;
+    }
+
+    if(0 < size)
+    {
+        memcpy(pRecord, pSource, (size_t)size);
+    }
+
+    EndRecord(pRecord);
+
+    return true;
+}
+
+int32_t MpscRingBuffer::BeginReadV(RingRecord_t *pRecords, int32_t count,
+    int32_t& size) const
+{
+    uint32_t read = mReadIndex.load(std::memory_order_relaxed);
+    uint32_t used = 0;
+
+    int32_t records = 0;
+
+    // Space that has not been reserved yet was cleared so its prefix is
+    // never committed and the scan stops there.
+    while(records < count && used < mCapacity)
+    {
+        const int8_t *pRecord = &mBuffer[(read + used) & mCapacityMask];
+        uint32_t prefix = Prefix(pRecord)->load(std::memory_order_acquire);
+
+        if(0 == (prefix & RECORD_COMMITTED))
+        {
+            break;
+        }
+
+        int32_t recordSize = (int32_t)(prefix & ~RECORD_COMMITTED);
+
+        pRecords[records].pData = pRecord + sizeof(uint32_t);
+        pRecords[records].size = recordSize;
+        records++;
+
+        used += RecordSize(recordSize);
+    }
+
+    size = (int32_t)used;
+
+    return records;
+}
+
+void MpscRingBuffer::EndRead(int32_t size)
+{
+    uint32_t read = mReadIndex.load(std::memory_order_relaxed);
+
+    // Clear the space so stale prefixes are never mistaken for new records
+    // and then hand it back to the producers.
+    memset(&mBuffer[read & mCapacityMask], 0, (size_t)size);
+
+    mReadIndex.store(read + (uint32_t)size, std::memory_order_release);
+}
+
+bool MpscRingBuffer::ReadRecord(std::vector<char>& record)
+{
+    RingRecord_t next;
+    int32_t size = 0;
+
+    if(1 != BeginReadV(&next, 1, size))
+    {
+        return false;
+    }
+
+    const char *pData = reinterpret_cast<const char*>(next.pData);
+    record.assign(pData, pData + next.size);
+
+    EndRead(size);
+
+    return true;
+}
+
+uint32_t MpscRingBuffer::RecordSize(int32_t size)
+{
+    uint32_t total = (uint32_t)sizeof(uint32_t) + (uint32_t)size;
+
+    return (total + (uint32_t)sizeof(uint32_t) - 1) &
+        ~((uint32_t)sizeof(uint32_t) - 1);
+}
@@ -0,0 +1,171 @@
+/**
+ * @file libcomp/src/MpscRingBuffer.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Multiple producer, single consumer ring buffer of records.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_MPSCRINGBUFFER_H
+#define LIBCOMP_SRC_MPSCRINGBUFFER_H
+
+// libcomp Includes
+#include "RingBuffer.h"
+
+namespace libcomp
+{
+
+/**
+* @brief Multiple producer, single consumer, lock free ring buffer of
+*   length-prefixed records.
+*
+* Each producer reserves the space for a whole record with one atomic
+* update of the reserve index and then fills it in without touching any
+* shared state. The record is published by setting the committed bit of its
+* length prefix, so producers that finish out of order never expose a record
+* that is still being written. The consumer reads committed records in
+* order and stops at the first one that is not committed yet.
+*
+* The memory is mapped twice like @ref RingBuffer so every record is
+* contiguous and may be used in place (for example with a gather write).
+*
+* This ring buffer is thread safe if the following requirements are met:
+* - Any number of threads may call @ref BeginRecord, @ref EndRecord and
+*   @ref WriteRecord.
+* - Only one thread calls @ref BeginReadV, @ref EndRead and
+*   @ref ReadRecord.
+* - Every @ref BeginRecord that returns a buffer is followed by
+*   @ref EndRecord from the same thread. Until it is, the consumer can't
+*   read past that record.
+* - No thread uses the ring buffer before the constructor has returned or
+*   after the destructor is called.
+*/
+class MpscRingBuffer
+{
+public:
+    /**
+    * @brief Create a ring buffer with a minimum capacity.
+    * @param capacity The minimum capacity of the ring buffer.
+    * @note Throws RingBuffer::Exception if the memory can't be mapped.
+    */
+    MpscRingBuffer(int32_t capacity);
+
+    /**
+    * @brief Capacity of the ring buffer (in bytes).
+    * @returns Capacity of the ring buffer (in bytes).
+    */
+    int32_t Capacity() const;
+
+    /**
+    * @brief Number of bytes reserved by producers that the consumer has not
+    *   finished reading (including records that are not committed yet).
+    * @returns Number of bytes in use.
+    */
+    int32_t Used() const;
+
+    /**
+    * @brief Reserve space for a record.
+    * @param size Size of the record data.
+    * @returns Pointer to write the record data into or nullptr if there is
+    *   not enough room for it.
+    */
+    void* BeginRecord(int32_t size);
+
+    /**
+    * @brief Commit a record so the consumer may read it.
+    * @param pRecord Pointer returned by @ref BeginRecord.
+    */
+    void EndRecord(void *pRecord);
+
+    /**
+    * @brief Copy a record into the ring buffer.
+    * @param pSource Pointer to the record data.
+    * @param size Size of the record data.
+    * @returns true if the record was written; false if there is not enough
+    *   room for it.
+    */
+    bool WriteRecord(const void *pSource, int32_t size);
+
+    /**
+    * @brief Start a read of the committed records.
+    * @param pRecords Array to store the records in.
+    * @param count Maximum number of records to return.
+    * @param size Updated with the number of bytes the returned records use.
+    *   This should be passed to @ref EndRead once the records are no longer
+    *   used.
+    * @returns Number of records stored in @em pRecords.
+    */
+    int32_t BeginReadV(RingRecord_t *pRecords, int32_t count,
+        int32_t& size) const;
+
+    /**
+    * @brief Finish a read and give the space back to the producers.
+    * @param size Size returned by @ref BeginReadV.
+    */
+    void EndRead(int32_t size);
+
+    /**
+    * @brief Read the next committed record.
+    * @param record Buffer that is replaced with the record data.
+    * @returns true if a record was read; false if there are none.
+    */
+    bool ReadRecord(std::vector<char>& record);
+
+private:
+    /**
+    * @brief Get the space a record takes in the ring buffer.
+    * @param size Size of the record data.
+    * @returns Size of the length prefix, the data and the padding that
+    *   keeps the next length prefix aligned.
+    */
+    static uint32_t RecordSize(int32_t size);
+
+    /// Memory mapping the records are stored in. Its indices are not used.
+    RingBuffer mRing;
+
+    /// Pointer to the base of the memory mapped data.
+    int8_t *mBuffer;
+
+    /// Capacity of the buffer.
+    uint32_t mCapacity;
+
+    /// Mask used to wrap the indices around.
+    uint32_t mCapacityMask;
+
+    // Keep each index on its own cache line so the producers and consumer
+    // do not contend.
+    char mIndexPadding[64 - sizeof(uint32_t)];
+
+    /// Total number of bytes reserved by producers. This only grows (and
+    /// wraps around) so it is never confused with a full buffer.
+    std::atomic<uint32_t> mReserveIndex;
+
+    char mReservePadding[64 - sizeof(std::atomic<uint32_t>)];
+
+    /// Total number of bytes the consumer has finished with.
+    std::atomic<uint32_t> mReadIndex;
+
+    char mReadPadding[64 - sizeof(std::atomic<uint32_t>)];
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_MPSCRINGBUFFER_H
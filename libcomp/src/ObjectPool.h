@@ -0,0 +1,231 @@
+/**
+ * @file libcomp/src/ObjectPool.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Thread-safe pool of reusable objects.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_OBJECTPOOL_H
+#define LIBCOMP_SRC_OBJECTPOOL_H
+
+// Standard C++11 Includes
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Counters describing how well an @ref ObjectPool is sized.
+ */
+typedef struct
+{
+    /// Number of allocations that were served from the free list.
+    uint64_t hits;
+
+    /// Number of allocations that had to create a new object.
+    uint64_t misses;
+
+    /// Number of objects currently handed out.
+    uint64_t outstanding;
+
+    /// Highest number of objects handed out at the same time.
+    uint64_t highWater;
+
+    /// Number of objects waiting in the free list.
+    uint64_t free;
+} ObjectPoolStats_t;
+
+/**
+ * Pool of objects that are handed out as a std::shared_ptr and returned to
+ * the pool (instead of being deleted) when the last reference is dropped.
+ * Returned objects are not destroyed or reset so the user of the pool must
+ * not depend on the state of a newly allocated object. The pool may be
+ * destroyed while objects are still handed out; the pooled objects are then
+ * deleted once the last of them is released.
+ */
+template<class T>
+class ObjectPool
+{
+    // Objects are created with plain new which does not honor extended
+    // alignment before C++17 (pad members instead of using alignas).
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+        "Pooled objects must not be over-aligned.");
+
+public:
+    /**
+     * Create a new pool.
+     * @param maxFree Maximum number of released objects to keep around for
+     * reuse. Objects released when the free list is full are deleted.
+     */
+    explicit ObjectPool(size_t maxFree) : mState(new State)
+    {
+        mState->maxFree = maxFree;
+    }
+
+    /**
+     * Get an object from the pool (or create a new one).
+     * @returns Object that will be returned to the pool when released.
+     */
+    std::shared_ptr<T> Allocate()
+    {
+        T *pObject = nullptr;
+
+        {
+            std::lock_guard<std::mutex> guard(mState->lock);
+
+            if(!mState->freeList.empty())
+            {
+                pObject = mState->freeList.back();
+                mState->freeList.pop_back();
+            }
+        }
+
+        if(nullptr != pObject)
+        {
+            mState->hits++;
+        }
+        else
+        {
+            pObject = new T;
+            mState->misses++;
+        }
+
+        uint64_t outstanding = ++mState->outstanding;
+        uint64_t highWater = mState->highWater;
+
+        while(outstanding > highWater && !mState->highWater.
+            compare_exchange_weak(highWater, outstanding))
+        {
+        }
+
+        std::shared_ptr<State> state = mState;
+
+        return std::shared_ptr<T>(pObject, [state](T *pReleased)
+        {
+            Release(state, pReleased);
+        });
+    }
+
+    /**
+     * Create objects ahead of time so the first allocations do not miss.
+     * @param count Number of objects the free list should hold.
+     */
+    void Reserve(size_t count)
+    {
+        std::lock_guard<std::mutex> guard(mState->lock);
+
+        if(count > mState->maxFree)
+        {
+            mState->maxFree = count;
+        }
+
+        while(mState->freeList.size() < count)
+        {
+            mState->freeList.push_back(new T);
+        }
+    }
+
+    /**
+     * Get the current pool counters.
+     * @returns Pool counters.
+     */
+    ObjectPoolStats_t GetStats() const
+    {
+        ObjectPoolStats_t stats;
+        stats.hits = mState->hits;
+        stats.misses = mState->misses;
+        stats.outstanding = mState->outstanding;
+        stats.highWater = mState->highWater;
+
+        {
+            std::lock_guard<std::mutex> guard(mState->lock);
+            stats.free = mState->freeList.size();
+        }
+
+        return stats;
+    }
+
+private:
+    /**
+     * @internal
+     * State shared by the pool and every object it has handed out.
+     */
+    class State
+    {
+    public:
+        State() : maxFree(0), hits(0), misses(0), outstanding(0),
+            highWater(0)
+        {
+        }
+
+        ~State()
+        {
+            for(auto pObject : freeList)
+            {
+                delete pObject;
+            }
+        }
+
+        std::mutex lock;
+        std::vector<T*> freeList;
+        size_t maxFree;
+
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> outstanding;
+        std::atomic<uint64_t> highWater;
+    };
+
+    static void Release(const std::shared_ptr<State>& state, T *pObject)
+    {
+        bool keep = false;
+
+        state->outstanding--;
+
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+
+            if(state->freeList.size() < state->maxFree)
+            {
+                state->freeList.push_back(pObject);
+                keep = true;
+            }
+        }
+
+        if(!keep)
+        {
+            delete pObject;
+        }
+    }
+
+    std::shared_ptr<State> mState;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_OBJECTPOOL_H
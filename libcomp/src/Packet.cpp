@@ -54,6 +54,7 @@
 #define dump_print(...) sprintf(bufferp, __VA_ARGS__)
 #endif // _WIN32
 
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
 
@@ -66,9 +67,9 @@ Packet::Packet() : ReadOnlyPacket()
 }
 
 Packet::Packet(const Packet& other) : ReadOnlyPacket(other.mPosition,
-    other.mSize, nullptr, nullptr)
+    other.mSize, nullptr, 0, nullptr)
 {
-    Allocate();
+    Reserve(other.mSize);
 
     // Make sure the data pointer is valid first.
     if(nullptr != mData)
@@ -78,12 +79,13 @@ Packet::Packet(const Packet& other) : ReadOnlyPacket(other.mPosition,
 }
 
 Packet::Packet(Packet&& other) : ReadOnlyPacket(other.mPosition, other.mSize,
-    other.mData, other.mDataRef)
+    other.mData, other.mCapacity, other.mDataRef)
 {
     other.mPosition = 0;
     other.mSize = 0;
     other.mDataRef.reset();
     other.mData = nullptr;
+    other.mCapacity = 0;
 
     // Ensure the packet is clear and the variables are set.
     other.Clear();
@@ -162,11 +164,40 @@ void Packet::GrowPacket(uint32_t sz)
     }
     else
     {
-        // The new packet size is valid, set it.
+        // The new packet size is valid, make room for it and set it.
+        Reserve(newSize);
         mSize = newSize;
     }
 }
 
+void Packet::Reserve(uint32_t capacity)
+{
+    if(MAX_PACKET_SIZE < capacity)
+    {
+        PACKET_EXCEPTION(String("Attempted to reserve %1 bytes for the "
+            "packet; however, this size exceeds the MAX_PACKET_SIZE").Arg(
+            capacity), this);
+    }
+
+    // Move to a bigger size class if the current buffer is too small.
+    if(nullptr == mData || mCapacity < capacity)
+    {
+        uint32_t bufferSize = 0;
+
+        std::shared_ptr<uint8_t> buffer = AllocateBuffer(capacity,
+            bufferSize);
+
+        if(nullptr != mData && 0 < mSize)
+        {
+            memcpy(buffer.get(), mData, mSize);
+        }
+
+        mDataRef = buffer;
+        mData = buffer.get();
+        mCapacity = bufferSize;
+    }
+}
+
 void Packet::WriteBlank(uint32_t count)
 {
     // If we are writing 0 blank bytes, do nothing.
@@ -214,77 +245,159 @@ void Packet::WriteArray(const void *pData, uint32_t sz)
     Skip(sz);
 }
 
+void Packet::WriteU16ArrayBig(const uint16_t *pValues, uint32_t count)
+{
+    WriteScalarArray(pValues, count, (uint32_t)sizeof(uint16_t), true);
+}
+
+void Packet::WriteU16ArrayLittle(const uint16_t *pValues, uint32_t count)
+{
+    WriteScalarArray(pValues, count, (uint32_t)sizeof(uint16_t), false);
+}
+
+void Packet::WriteU32ArrayBig(const uint32_t *pValues, uint32_t count)
+{
+    WriteScalarArray(pValues, count, (uint32_t)sizeof(uint32_t), true);
+}
+
+void Packet::WriteU32ArrayLittle(const uint32_t *pValues, uint32_t count)
+{
+    WriteScalarArray(pValues, count, (uint32_t)sizeof(uint32_t), false);
+}
+
+void Packet::WriteU64ArrayBig(const uint64_t *pValues, uint32_t count)
+{
+    WriteScalarArray(pValues, count, (uint32_t)sizeof(uint64_t), true);
+}
+
+void Packet::WriteU64ArrayLittle(const uint64_t *pValues, uint32_t count)
+{
+    WriteScalarArray(pValues, count, (uint32_t)sizeof(uint64_t), false);
+}
+
+void Packet::WriteScalarArray(const void *pValues, uint32_t count,
+    uint32_t elementSize, bool bigEndian)
+{
+    // If we are writing an empty array, do nothing.
+    if(0 == count)
+    {
+        return;
+    }
+
+    // Check the size in 64-bit so a huge count can't wrap.
+    uint64_t sz = (uint64_t)count * elementSize;
+
+    if(MAX_PACKET_SIZE < ((uint64_t)mPosition + sz))
+    {
+        PACKET_EXCEPTION(String("Attempted to write an array of %1 values; "
+            "however, this would exceed the MAX_PACKET_SIZE").Arg(count),
+            this);
+    }
+
+    // Grow the packet once for the whole array and convert the values
+    // straight into the packet data.
+    GrowPacket((uint32_t)sz);
+    CopyScalarArray(mData + mPosition, pValues, count, elementSize,
+        bigEndian);
+    Skip((uint32_t)sz);
+}
+
 void Packet::WriteString(Convert::Encoding_t encoding, const String& str,
     bool nullTerminate)
 {
     // Convert the string to the requested encoding and write it.
-    WriteArray(Convert::ToEncoding(encoding, str, nullTerminate));
+    WriteEncoded(encoding, str, nullTerminate, (uint32_t)Convert::SizeEncoded(
+        encoding, str) + (nullTerminate ? 1u : 0u));
 }
 
 void Packet::WriteString32(Convert::Encoding_t encoding, const String& str,
     bool nullTerminate)
 {
-    // Convert the string to the requested encoding.
-    std::vector<char> strd = Convert::ToEncoding(encoding, str, nullTerminate);
+    // Determine the size of the string in the requested encoding.
+    uint32_t sz = (uint32_t)Convert::SizeEncoded(encoding, str) +
+        (nullTerminate ? 1u : 0u);
 
     // Write the size of the string data and the string.
-    WriteU32((uint32_t)strd.size());
-    WriteArray(strd);
+    WriteU32((uint32_t)sz);
+    WriteEncoded(encoding, str, nullTerminate, sz);
 }
 
 void Packet::WriteString32Big(Convert::Encoding_t encoding, const String& str,
     bool nullTerminate)
 {
-    // Convert the string to the requested encoding.
-    std::vector<char> strd = Convert::ToEncoding(encoding, str, nullTerminate);
+    // Determine the size of the string in the requested encoding.
+    uint32_t sz = (uint32_t)Convert::SizeEncoded(encoding, str) +
+        (nullTerminate ? 1u : 0u);
 
     // Write the size of the string data and the string.
-    WriteU32Big((uint32_t)strd.size());
-    WriteArray(strd);
+    WriteU32Big((uint32_t)sz);
+    WriteEncoded(encoding, str, nullTerminate, sz);
 }
 
 void Packet::WriteString32Little(Convert::Encoding_t encoding,
     const String& str, bool nullTerminate)
 {
-    // Convert the string to the requested encoding.
-    std::vector<char> strd = Convert::ToEncoding(encoding, str, nullTerminate);
+    // Determine the size of the string in the requested encoding.
+    uint32_t sz = (uint32_t)Convert::SizeEncoded(encoding, str) +
+        (nullTerminate ? 1u : 0u);
 
     // Write the size of the string data and the string.
-    WriteU32Little((uint32_t)strd.size());
-    WriteArray(strd);
+    WriteU32Little((uint32_t)sz);
+    WriteEncoded(encoding, str, nullTerminate, sz);
 }
 
 void Packet::WriteString16(Convert::Encoding_t encoding, const String& str,
     bool nullTerminate)
 {
-    // Convert the string to the requested encoding.
-    std::vector<char> strd = Convert::ToEncoding(encoding, str, nullTerminate);
+    // Determine the size of the string in the requested encoding.
+    uint32_t sz = (uint32_t)Convert::SizeEncoded(encoding, str) +
+        (nullTerminate ? 1u : 0u);
 
     // Write the size of the string data and the string.
-    WriteU16((uint16_t)strd.size());
-    WriteArray(strd);
+    WriteU16((uint16_t)sz);
+    WriteEncoded(encoding, str, nullTerminate, sz);
 }
 
 void Packet::WriteString16Big(Convert::Encoding_t encoding, const String& str,
     bool nullTerminate)
 {
-    // Convert the string to the requested encoding.
-    std::vector<char> strd = Convert::ToEncoding(encoding, str, nullTerminate);
+    // Determine the size of the string in the requested encoding.
+    uint32_t sz = (uint32_t)Convert::SizeEncoded(encoding, str) +
+        (nullTerminate ? 1u : 0u);
 
     // Write the size of the string data and the string.
-    WriteU16Big((uint16_t)strd.size());
-    WriteArray(strd);
+    WriteU16Big((uint16_t)sz);
+    WriteEncoded(encoding, str, nullTerminate, sz);
 }
 
 void Packet::WriteString16Little(Convert::Encoding_t encoding,
     const String& str, bool nullTerminate)
 {
-    // Convert the string to the requested encoding.
-    std::vector<char> strd = Convert::ToEncoding(encoding, str, nullTerminate);
+    // Determine the size of the string in the requested encoding.
+    uint32_t sz = (uint32_t)Convert::SizeEncoded(encoding, str) +
+        (nullTerminate ? 1u : 0u);
 
     // Write the size of the string data and the string.
-    WriteU16Little((uint16_t)strd.size());
-    WriteArray(strd);
+    WriteU16Little((uint16_t)sz);
+    WriteEncoded(encoding, str, nullTerminate, sz);
+}
+
+void Packet::WriteEncoded(Convert::Encoding_t encoding, const String& str,
+    bool nullTerminate, uint32_t sz)
+{
+    // If we are writing an empty string, do nothing.
+    if(0 == sz)
+    {
+        return;
+    }
+
+    // Grow the packet by the size of the converted string, convert it into
+    // the packet data at the current position, and advance the current
+    // position past it.
+    GrowPacket(sz);
+    Convert::EncodeInto(encoding, str, (char*)(mData + mPosition), sz,
+        nullTerminate);
+    Skip(sz);
 }
 
 void Packet::WriteU8(uint8_t value)
@@ -453,7 +566,7 @@ void Packet::Clear()
     uint32_t deadbeef = 0xEFBEADDE;
 
     // Fill the buffer with "dead beef" so you can see what is and isn't data.
-    for(uint32_t i = 0; i < MAX_PACKET_SIZE; i += 4)
+    for(uint32_t i = 0; i < mCapacity; i += 4)
     {
         memcpy(mData + i, &deadbeef, 4);
     }
@@ -492,6 +605,9 @@ char* Packet::Direct(uint32_t sz)
             "size of the packet").Arg(sz), this);
     }
 
+    // Make sure the buffer can hold the new size of the packet.
+    Reserve(sz);
+
     // Set the new size of the packet.
     mSize = sz;
 
@@ -541,6 +657,9 @@ int32_t Packet::Decompress(int32_t sz)
             "packet").Arg(sz), this);
     }
 
+    // The decompressed data could be as large as the biggest packet.
+    Reserve(MAX_PACKET_SIZE);
+
     // Allocate the compressed copy.
     uint8_t *pData = new uint8_t[sz];
 
@@ -557,7 +676,7 @@ int32_t Packet::Decompress(int32_t sz)
 
     // Decompress the data
     int32_t written = Compress::Decompress(pData, mData + mPosition,
-        sz, (int32_t)(MAX_PACKET_SIZE - mSize));
+        sz, (int32_t)(mCapacity - mSize));
 
     // Update the size.
     mSize += (uint32_t)written;
@@ -585,6 +704,10 @@ int32_t Packet::Compress(int32_t sz)
             "packet").Arg(sz), this);
     }
 
+    // Leave room for data that does not compress (with some overhead).
+    Reserve(std::min<uint32_t>(MAX_PACKET_SIZE, mPosition + (uint32_t)sz +
+        ((uint32_t)sz >> 8) + 64));
+
     // Allocate the compressed copy.
     uint8_t *pData = new uint8_t[sz];
 
@@ -601,7 +724,7 @@ int32_t Packet::Compress(int32_t sz)
 
     // Compress the data
     int32_t written = Compress::Compress(pData, mData + mPosition,
-        sz, (int32_t)(MAX_PACKET_SIZE - mSize));
+        sz, (int32_t)(mCapacity - mSize));
 
     // Update the size.
     mSize += (uint32_t)written;
@@ -618,11 +741,13 @@ Packet& Packet::operator=(Packet&& other)
     mSize = other.mSize;
     mDataRef = other.mDataRef;
     mData = other.mData;
+    mCapacity = other.mCapacity;
 
     other.mPosition = 0;
     other.mSize = 0;
     other.mDataRef.reset();
     other.mData = nullptr;
+    other.mCapacity = 0;
 
     // Ensure the packet is clear and the variables are set.
     other.Clear();
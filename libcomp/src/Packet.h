@@ -122,6 +122,62 @@ public:
      */
     void WriteArray(const void *pData, uint32_t sz);
 
+    /**
+     * Write @em count 16-bit unsigned integers from @em pValues into the
+     * packet in big endian byte order. The packet is grown once for the
+     * whole array and the byte order is converted in bulk (with SIMD if the
+     * CPU supports it).
+     * @param pValues Values to write.
+     * @param count Number of values to write.
+     * @sa ReadOnlyPacket::ReadU16ArrayBig
+     */
+    void WriteU16ArrayBig(const uint16_t *pValues, uint32_t count);
+
+    /**
+     * Write @em count 16-bit unsigned integers from @em pValues into the
+     * packet in little endian byte order. See @ref WriteU16ArrayBig.
+     * @param pValues Values to write.
+     * @param count Number of values to write.
+     * @sa ReadOnlyPacket::ReadU16ArrayLittle
+     */
+    void WriteU16ArrayLittle(const uint16_t *pValues, uint32_t count);
+
+    /**
+     * Write @em count 32-bit unsigned integers from @em pValues into the
+     * packet in big endian byte order. See @ref WriteU16ArrayBig.
+     * @param pValues Values to write.
+     * @param count Number of values to write.
+     * @sa ReadOnlyPacket::ReadU32ArrayBig
+     */
+    void WriteU32ArrayBig(const uint32_t *pValues, uint32_t count);
+
+    /**
+     * Write @em count 32-bit unsigned integers from @em pValues into the
+     * packet in little endian byte order. See @ref WriteU16ArrayBig.
+     * @param pValues Values to write.
+     * @param count Number of values to write.
+     * @sa ReadOnlyPacket::ReadU32ArrayLittle
+     */
+    void WriteU32ArrayLittle(const uint32_t *pValues, uint32_t count);
+
+    /**
+     * Write @em count 64-bit unsigned integers from @em pValues into the
+     * packet in big endian byte order. See @ref WriteU16ArrayBig.
+     * @param pValues Values to write.
+     * @param count Number of values to write.
+     * @sa ReadOnlyPacket::ReadU64ArrayBig
+     */
+    void WriteU64ArrayBig(const uint64_t *pValues, uint32_t count);
+
+    /**
+     * Write @em count 64-bit unsigned integers from @em pValues into the
+     * packet in little endian byte order. See @ref WriteU16ArrayBig.
+     * @param pValues Values to write.
+     * @param count Number of values to write.
+     * @sa ReadOnlyPacket::ReadU64ArrayLittle
+     */
+    void WriteU64ArrayLittle(const uint64_t *pValues, uint32_t count);
+
     /**
      * Write the string @em str into the packet encoded with @em encoding.
      * There is no size written before the string so using this function
@@ -503,6 +559,15 @@ public:
      */
     char* Direct(uint32_t sz);
 
+    /**
+     * Make sure the buffer can hold at least @em capacity bytes. If the
+     * current buffer is too small the data is moved into a buffer from a
+     * bigger size class. Call this before writing past @ref Size() through
+     * @ref Data().
+     * @param capacity Number of bytes the buffer must be able to hold.
+     */
+    void Reserve(uint32_t capacity);
+
     /**
      * %Decompress from the cursor position @em sz bytes. After the
      * decompression the current position will remain the same.
@@ -532,6 +597,27 @@ private:
      * @param count Number of bytes to add to the packet.
      */
     void GrowPacket(uint32_t count);
+
+    /**
+     * Write an array of integers (see @ref WriteU16ArrayBig).
+     * @param pValues Values to write.
+     * @param count Number of values to write.
+     * @param elementSize Size in bytes of each value.
+     * @param bigEndian Indicates if the values should be big endian.
+     */
+    void WriteScalarArray(const void *pValues, uint32_t count,
+        uint32_t elementSize, bool bigEndian);
+
+    /**
+     * Convert a string straight into the packet at the current position and
+     * advance past it.
+     * @param encoding Encoding to convert the string to.
+     * @param str String to write.
+     * @param nullTerminate Indicates if a null terminator should be added.
+     * @param sz Size of the converted string including the terminator.
+     */
+    void WriteEncoded(Convert::Encoding_t encoding, const String& str,
+        bool nullTerminate, uint32_t sz);
 };
 
 } // namespace libcomp
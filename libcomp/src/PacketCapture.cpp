@@ -0,0 +1,241 @@
+/**
+ * @file libcomp/src/PacketCapture.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Writer for decrypted command captures.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PacketCapture.h"
+
+// libcomp Includes
+#include "Log.h"
+
+using namespace libcomp;
+
+const char PacketCapture::MAGIC[8] = { 'C', 'O', 'M', 'P', 'C', 'A', 'P',
+    '1' };
+
+/**
+ * @internal
+ * Append an integer to a buffer in little endian.
+ * @param buffer Buffer to append to.
+ * @param value Integer to append.
+ * @param size Number of low bytes of @em value to append.
+ */
+static void AppendLittle(std::vector<char>& buffer, uint64_t value,
+    size_t size)
+{
+    for(size_t i = 0; i < size; ++i)
+    {
+        buffer.push_back((char)((value >> (8 * i)) & 0xFF));
+    }
+}
+
+PacketCapture::PacketCapture() : mFile(nullptr), mCapturing(false),
+    mStopping(false), mDroppedRecords(0)
+{
+}
+
+PacketCapture* PacketCapture::GetSingletonPtr()
+{
+    // Never destroyed so connections may still close during shutdown.
+    static PacketCapture *pCapture = new PacketCapture;
+
+    return pCapture;
+}
+
+bool PacketCapture::Start(const String& path)
+{
+    std::lock_guard<std::mutex> control(mControlLock);
+
+    StopWriter();
+
+    FILE *pFile = fopen(path.C(), "wb");
+
+    if(nullptr == pFile)
+    {
+        LOG_ERROR(String("Failed to open capture file: %1\n").Arg(path));
+
+        return false;
+    }
+
+    uint64_t wallClock = (uint64_t)std::chrono::duration_cast<
+        std::chrono::microseconds>(std::chrono::system_clock::now().
+        time_since_epoch()).count();
+
+    std::vector<char> header(MAGIC, MAGIC + sizeof(MAGIC));
+    AppendLittle(header, wallClock, sizeof(wallClock));
+
+    if(1 != fwrite(&header[0], header.size(), 1, pFile))
+    {
+        LOG_ERROR(String("Failed to write capture file: %1\n").Arg(path));
+        fclose(pFile);
+
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mFile = pFile;
+        mStart = std::chrono::steady_clock::now();
+        mBuffer.clear();
+        mBuffer.reserve(PACKET_CAPTURE_FLUSH_SIZE * 2);
+        mStopping = false;
+        mCapturing = true;
+    }
+
+    mWriteThread = std::thread([this]()
+    {
+        WriteThread();
+    });
+
+    LOG_INFO(String("Capturing traffic to %1\n").Arg(path));
+
+    return true;
+}
+
+void PacketCapture::Stop()
+{
+    std::lock_guard<std::mutex> control(mControlLock);
+
+    StopWriter();
+}
+
+void PacketCapture::StopWriter()
+{
+    if(nullptr == mFile)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mCapturing = false;
+        mStopping = true;
+    }
+
+    mCondition.notify_one();
+    mWriteThread.join();
+
+    fclose(mFile);
+    mFile = nullptr;
+}
+
+bool PacketCapture::IsCapturing() const
+{
+    return mCapturing.load(std::memory_order_relaxed);
+}
+
+void PacketCapture::Record(Type_t type, uint64_t connectionID,
+    uint16_t commandCode, const char *pData, uint32_t size)
+{
+    if(!IsCapturing())
+    {
+        return;
+    }
+
+    bool wake = false;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        // The capture may have been stopped while waiting for the lock.
+        if(!mCapturing)
+        {
+            return;
+        }
+
+        if((mBuffer.size() + RECORD_HEADER_SIZE + size) >
+            PACKET_CAPTURE_MAX_BUFFER)
+        {
+            mDroppedRecords++;
+
+            return;
+        }
+
+        uint64_t timestamp = (uint64_t)std::chrono::duration_cast<
+            std::chrono::microseconds>(std::chrono::steady_clock::now() -
+            mStart).count();
+
+        mBuffer.push_back((char)type);
+        AppendLittle(mBuffer, timestamp, sizeof(timestamp));
+        AppendLittle(mBuffer, connectionID, sizeof(connectionID));
+        AppendLittle(mBuffer, commandCode, sizeof(commandCode));
+        AppendLittle(mBuffer, size, sizeof(size));
+
+        if(0 < size)
+        {
+            mBuffer.insert(mBuffer.end(), pData, pData + size);
+        }
+
+        wake = PACKET_CAPTURE_FLUSH_SIZE <= mBuffer.size();
+    }
+
+    if(wake)
+    {
+        mCondition.notify_one();
+    }
+}
+
+uint64_t PacketCapture::GetDroppedRecords() const
+{
+    return mDroppedRecords;
+}
+
+void PacketCapture::WriteThread()
+{
+    std::vector<char> records;
+    records.reserve(PACKET_CAPTURE_FLUSH_SIZE * 2);
+
+    bool stopping = false;
+
+    while(!stopping)
+    {
+        {
+            std::unique_lock<std::mutex> uniqueLock(mLock);
+
+            mCondition.wait_for(uniqueLock, std::chrono::milliseconds(
+                PACKET_CAPTURE_FLUSH_INTERVAL), [this]()
+            {
+                return mStopping || PACKET_CAPTURE_FLUSH_SIZE <=
+                    mBuffer.size();
+            });
+
+            // Swap buffers so the io threads can keep adding records
+            // while these are written.
+            records.swap(mBuffer);
+            stopping = mStopping;
+        }
+
+        if(!records.empty())
+        {
+            if(1 != fwrite(&records[0], records.size(), 1, mFile))
+            {
+                LOG_ERROR("Failed to write to the capture file.\n");
+            }
+
+            records.clear();
+        }
+
+        fflush(mFile);
+    }
+}
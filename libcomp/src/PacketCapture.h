@@ -0,0 +1,198 @@
+/**
+ * @file libcomp/src/PacketCapture.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Writer for decrypted command captures.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_PACKETCAPTURE_H
+#define LIBCOMP_SRC_PACKETCAPTURE_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "String.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * One entry in a capture file.
+ */
+typedef struct
+{
+    /// What happened (see the PacketCapture::Type_t values).
+    uint8_t type;
+
+    /// Microseconds since the capture was started.
+    uint64_t timestamp;
+
+    /// ID of the connection in the @ref ConnectionRegistry.
+    uint64_t connectionID;
+
+    /// Command code (only for commands).
+    uint16_t commandCode;
+
+    /// Command data for a command or the remote address for an open.
+    std::vector<char> data;
+} PacketCaptureRecord_t;
+
+/**
+ * Writes the decrypted commands received by every connection (along with
+ * when each connection was opened and closed) to a compact binary file so
+ * the traffic can be replayed later. Records are appended to a buffer under
+ * a short lock and written by a dedicated thread so the io threads never
+ * touch the file. If the writer falls too far behind new records are
+ * dropped (see @ref GetDroppedRecords) instead of stalling the server.
+ *
+ * The file starts with @ref MAGIC and the wall clock time the capture
+ * started (microseconds since the epoch). Each record is a type byte,
+ * the timestamp, the connection ID, the command code and the data size
+ * followed by the data. Every integer is little endian.
+ */
+class PacketCapture
+{
+public:
+    /**
+     * Kind of capture record.
+     */
+    typedef enum
+    {
+        /// Connection was accepted (data is the remote address).
+        TYPE_OPEN = 0,
+        /// Decrypted command was received.
+        TYPE_COMMAND,
+        /// Connection was closed.
+        TYPE_CLOSE,
+    } Type_t;
+
+    /// First bytes of every capture file.
+    static const char MAGIC[8];
+
+    /// Bytes in the file header.
+    static const size_t HEADER_SIZE = 16;
+
+    /// Bytes in a record header (before the data).
+    static const size_t RECORD_HEADER_SIZE = 23;
+
+    /**
+     * Get the capture writer.
+     * @returns Pointer to the capture writer.
+     */
+    static PacketCapture* GetSingletonPtr();
+
+    /**
+     * Start capturing to a file. A capture that is already running is
+     * stopped first.
+     * @param path Path of the file to create.
+     * @returns true if the file was created.
+     */
+    bool Start(const String& path);
+
+    /**
+     * Write every buffered record, close the file and stop the writer.
+     */
+    void Stop();
+
+    /**
+     * Check if traffic is being captured.
+     * @returns true if traffic is being captured.
+     */
+    bool IsCapturing() const;
+
+    /**
+     * Add a record to the capture. This does nothing if no capture is
+     * running.
+     * @param type Kind of record.
+     * @param connectionID ID of the connection.
+     * @param commandCode Command code (0 if not a command).
+     * @param pData Record data (may be null if @em size is 0).
+     * @param size Bytes of record data.
+     */
+    void Record(Type_t type, uint64_t connectionID, uint16_t commandCode,
+        const char *pData, uint32_t size);
+
+    /**
+     * Get the number of records dropped because the writer fell behind.
+     * @returns Number of dropped records.
+     */
+    uint64_t GetDroppedRecords() const;
+
+private:
+    PacketCapture();
+
+    /**
+     * @internal
+     * Stop the writer thread and close the file (if a capture is running).
+     * The control lock must be held.
+     */
+    void StopWriter();
+
+    /**
+     * @internal
+     * Write buffered records until the capture is stopped.
+     */
+    void WriteThread();
+
+    /// File the capture is written to.
+    FILE *mFile;
+
+    /// When the capture started.
+    std::chrono::steady_clock::time_point mStart;
+
+    /// Records waiting for the writer thread.
+    std::vector<char> mBuffer;
+
+    /// Set while a capture is running.
+    std::atomic<bool> mCapturing;
+
+    /// Set to make the writer thread exit.
+    bool mStopping;
+
+    /// Number of records dropped because the buffer was full.
+    std::atomic<uint64_t> mDroppedRecords;
+
+    /// Lock for the buffer.
+    std::mutex mLock;
+
+    /// Signaled when the buffer should be written.
+    std::condition_variable mCondition;
+
+    /// Lock for starting and stopping the capture.
+    std::mutex mControlLock;
+
+    std::thread mWriteThread;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_PACKETCAPTURE_H
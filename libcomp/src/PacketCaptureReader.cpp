@@ -0,0 +1,123 @@
+/**
+ * @file libcomp/src/PacketCaptureReader.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Reader for decrypted command captures.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PacketCaptureReader.h"
+
+// Standard C++11 Includes
+#include <cstring>
+
+using namespace libcomp;
+
+/**
+ * @internal
+ * Read a little endian integer from a buffer.
+ * @param pData Buffer to read from.
+ * @param size Number of bytes in the integer.
+ * @returns Integer that was read.
+ */
+static uint64_t ReadLittle(const unsigned char *pData, size_t size)
+{
+    uint64_t value = 0;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        value |= (uint64_t)pData[i] << (8 * i);
+    }
+
+    return value;
+}
+
+PacketCaptureReader::PacketCaptureReader() : mFile(nullptr), mStartTime(0)
+{
+}
+
+PacketCaptureReader::~PacketCaptureReader()
+{
+    Close();
+}
+
+bool PacketCaptureReader::Open(const String& path)
+{
+    Close();
+
+    mFile = fopen(path.C(), "rb");
+
+    if(nullptr == mFile)
+    {
+        return false;
+    }
+
+    unsigned char header[PacketCapture::HEADER_SIZE];
+
+    if(1 != fread(header, sizeof(header), 1, mFile) || 0 != memcmp(header,
+        PacketCapture::MAGIC, sizeof(PacketCapture::MAGIC)))
+    {
+        Close();
+
+        return false;
+    }
+
+    mStartTime = ReadLittle(header + sizeof(PacketCapture::MAGIC),
+        sizeof(mStartTime));
+
+    return true;
+}
+
+void PacketCaptureReader::Close()
+{
+    if(nullptr != mFile)
+    {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+uint64_t PacketCaptureReader::GetStartTime() const
+{
+    return mStartTime;
+}
+
+bool PacketCaptureReader::Next(PacketCaptureRecord_t& record)
+{
+    unsigned char header[PacketCapture::RECORD_HEADER_SIZE];
+
+    if(nullptr == mFile || 1 != fread(header, sizeof(header), 1, mFile))
+    {
+        return false;
+    }
+
+    record.type = header[0];
+    record.timestamp = ReadLittle(header + 1, sizeof(record.timestamp));
+    record.connectionID = ReadLittle(header + 9, sizeof(record.connectionID));
+    record.commandCode = (uint16_t)ReadLittle(header + 17,
+        sizeof(record.commandCode));
+
+    uint32_t size = (uint32_t)ReadLittle(header + 19, sizeof(uint32_t));
+
+    record.data.resize(size);
+
+    return 0 == size || 1 == fread(&record.data[0], size, 1, mFile);
+}
@@ -0,0 +1,78 @@
+/**
+ * @file libcomp/src/PacketCaptureReader.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Reader for decrypted command captures.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_PACKETCAPTUREREADER_H
+#define LIBCOMP_SRC_PACKETCAPTUREREADER_H
+
+// libcomp Includes
+#include "PacketCapture.h"
+
+namespace libcomp
+{
+
+/**
+ * Reads the records of a file written by @ref PacketCapture in order.
+ */
+class PacketCaptureReader
+{
+public:
+    PacketCaptureReader();
+    ~PacketCaptureReader();
+
+    /**
+     * Open a capture file and read the header.
+     * @param path Path of the capture file.
+     * @returns true if the file is a capture file.
+     */
+    bool Open(const String& path);
+
+    /**
+     * Close the capture file.
+     */
+    void Close();
+
+    /**
+     * Get when the capture started.
+     * @returns Microseconds since the epoch when the capture started.
+     */
+    uint64_t GetStartTime() const;
+
+    /**
+     * Read the next record.
+     * @param record Set to the next record.
+     * @returns false at the end of the file or if the record is truncated.
+     */
+    bool Next(PacketCaptureRecord_t& record);
+
+private:
+    FILE *mFile;
+
+    uint64_t mStartTime;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_PACKETCAPTUREREADER_H
@@ -0,0 +1,377 @@
+/**
+ * @file libcomp/src/PacketLayout.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Fixed-size packet layouts decoded with one bounds check.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_PACKETLAYOUT_H
+#define LIBCOMP_SRC_PACKETLAYOUT_H
+
+// libcomp Includes
+#include "Endian.h"
+#include "Packet.h"
+
+// Standard C++11 Includes
+#include <cstring>
+#include <type_traits>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * @internal
+ * Byte order conversion for an integer of @em BYTES bytes.
+ */
+template<size_t BYTES>
+class PacketFieldBits;
+
+template<>
+class PacketFieldBits<1>
+{
+public:
+    typedef uint8_t Type;
+
+    static Type FromBig(Type bits)
+    {
+        return bits;
+    }
+
+    static Type FromLittle(Type bits)
+    {
+        return bits;
+    }
+
+    static Type ToBig(Type bits)
+    {
+        return bits;
+    }
+
+    static Type ToLittle(Type bits)
+    {
+        return bits;
+    }
+};
+
+template<>
+class PacketFieldBits<2>
+{
+public:
+    typedef uint16_t Type;
+
+    static Type FromBig(Type bits)
+    {
+        return be16toh(bits);
+    }
+
+    static Type FromLittle(Type bits)
+    {
+        return le16toh(bits);
+    }
+
+    static Type ToBig(Type bits)
+    {
+        return htobe16(bits);
+    }
+
+    static Type ToLittle(Type bits)
+    {
+        return htole16(bits);
+    }
+};
+
+template<>
+class PacketFieldBits<4>
+{
+public:
+    typedef uint32_t Type;
+
+    static Type FromBig(Type bits)
+    {
+        return be32toh(bits);
+    }
+
+    static Type FromLittle(Type bits)
+    {
+        return le32toh(bits);
+    }
+
+    static Type ToBig(Type bits)
+    {
+        return htobe32(bits);
+    }
+
+    static Type ToLittle(Type bits)
+    {
+        return htole32(bits);
+    }
+};
+
+template<>
+class PacketFieldBits<8>
+{
+public:
+    typedef uint64_t Type;
+
+    static Type FromBig(Type bits)
+    {
+        return be64toh(bits);
+    }
+
+    static Type FromLittle(Type bits)
+    {
+        return le64toh(bits);
+    }
+
+    static Type ToBig(Type bits)
+    {
+        return htobe64(bits);
+    }
+
+    static Type ToLittle(Type bits)
+    {
+        return htole64(bits);
+    }
+};
+
+/**
+ * Scalar field of a @ref PacketLayout. The field is @em T (any integer or
+ * float type) stored in big endian if @em BIG is true and little endian
+ * otherwise. Use @ref BigField and @ref LittleField instead of naming this
+ * directly.
+ */
+template<typename T, bool BIG>
+class PacketField
+{
+public:
+    static_assert(std::is_arithmetic<T>::value,
+        "Packet fields must be integers or floats.");
+
+    /// Type the field is decoded into.
+    typedef T Type;
+
+    /// Number of bytes the field takes in the packet.
+    static const uint32_t SIZE = (uint32_t)sizeof(T);
+
+    /**
+     * Decode the field without any bounds checking.
+     * @param pData Start of the field.
+     * @returns Value of the field.
+     */
+    static T Load(const char *pData)
+    {
+        typename Bits_t::Type bits;
+        std::memcpy(&bits, pData, sizeof(bits));
+
+        bits = BIG ? Bits_t::FromBig(bits) : Bits_t::FromLittle(bits);
+
+        T value;
+        std::memcpy(&value, &bits, sizeof(value));
+
+        return value;
+    }
+
+    /**
+     * Encode the field without any bounds checking.
+     * @param pData Start of the field.
+     * @param value Value of the field.
+     */
+    static void Store(char *pData, T value)
+    {
+        typename Bits_t::Type bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        bits = BIG ? Bits_t::ToBig(bits) : Bits_t::ToLittle(bits);
+
+        std::memcpy(pData, &bits, sizeof(bits));
+    }
+
+private:
+    typedef PacketFieldBits<sizeof(T)> Bits_t;
+};
+
+template<typename T, bool BIG>
+const uint32_t PacketField<T, BIG>::SIZE;
+
+/// Big endian field of a @ref PacketLayout.
+template<typename T>
+using BigField = PacketField<T, true>;
+
+/// Little endian field of a @ref PacketLayout.
+template<typename T>
+using LittleField = PacketField<T, false>;
+
+/**
+ * @internal
+ * Recursion over the fields of a @ref PacketLayout.
+ */
+template<typename... Fields>
+class PacketLayoutFields;
+
+template<>
+class PacketLayoutFields<>
+{
+public:
+    static const uint32_t SIZE = 0;
+
+    static void Load(const char *)
+    {
+    }
+
+    static void Store(char *)
+    {
+    }
+};
+
+template<typename Field, typename... Rest>
+class PacketLayoutFields<Field, Rest...>
+{
+public:
+    static const uint32_t SIZE = Field::SIZE +
+        PacketLayoutFields<Rest...>::SIZE;
+
+    static void Load(const char *pData, typename Field::Type& value,
+        typename Rest::Type&... rest)
+    {
+        value = Field::Load(pData);
+
+        PacketLayoutFields<Rest...>::Load(pData + Field::SIZE, rest...);
+    }
+
+    static void Store(char *pData, typename Field::Type value,
+        typename Rest::Type... rest)
+    {
+        Field::Store(pData, value);
+
+        PacketLayoutFields<Rest...>::Store(pData + Field::SIZE, rest...);
+    }
+};
+
+/**
+ * Fixed-size part of a command described as a list of fields, for example
+ * @code
+ * typedef PacketLayout<LittleField<uint16_t>,
+ *     LittleField<uint16_t>> CommandHeader_t;
+ *
+ * uint16_t commandSize, commandCode;
+ *
+ * if(!CommandHeader_t::Read(packet, commandSize, commandCode))
+ * {
+ *     // Not enough data.
+ * }
+ * @endcode
+ * The size of the layout is known at compile time so reading it checks the
+ * packet once and then decodes every field with straight-line loads instead
+ * of going through a bounds checked accessor (that may throw) per field.
+ */
+template<typename... Fields>
+class PacketLayout
+{
+public:
+    /// Number of bytes the layout takes in the packet.
+    static const uint32_t SIZE = PacketLayoutFields<Fields...>::SIZE;
+
+    static_assert(0 < SIZE, "Packet layouts must have at least one field.");
+
+    /**
+     * Decode the layout from a buffer without any bounds checking.
+     * @param pData Start of the layout; must hold @ref SIZE bytes.
+     * @param values Set to the value of each field.
+     */
+    static void Load(const char *pData, typename Fields::Type&... values)
+    {
+        PacketLayoutFields<Fields...>::Load(pData, values...);
+    }
+
+    /**
+     * Encode the layout into a buffer without any bounds checking.
+     * @param pData Start of the layout; must hold @ref SIZE bytes.
+     * @param values Value of each field.
+     */
+    static void Store(char *pData, typename Fields::Type... values)
+    {
+        PacketLayoutFields<Fields...>::Store(pData, values...);
+    }
+
+    /**
+     * Decode the layout at the current position of a packet without moving
+     * the position.
+     * @param packet Packet to decode from.
+     * @param values Set to the value of each field.
+     * @returns false (and leaves the values alone) if the packet does not
+     * have @ref SIZE bytes left.
+     */
+    static bool Peek(const ReadOnlyPacket& packet,
+        typename Fields::Type&... values)
+    {
+        if(SIZE > packet.Left())
+        {
+            return false;
+        }
+
+        Load(packet.ConstData() + packet.Tell(), values...);
+
+        return true;
+    }
+
+    /**
+     * Decode the layout at the current position of a packet and move past
+     * it.
+     * @param packet Packet to decode from.
+     * @param values Set to the value of each field.
+     * @returns false (and leaves the packet and values alone) if the packet
+     * does not have @ref SIZE bytes left.
+     */
+    static bool Read(ReadOnlyPacket& packet, typename Fields::Type&... values)
+    {
+        if(!Peek(packet, values...))
+        {
+            return false;
+        }
+
+        packet.Skip(SIZE);
+
+        return true;
+    }
+
+    /**
+     * Encode the layout at the current position of a packet.
+     * @param packet Packet to encode into.
+     * @param values Value of each field.
+     */
+    static void Write(Packet& packet, typename Fields::Type... values)
+    {
+        char data[SIZE];
+        Store(data, values...);
+
+        packet.WriteArray(data, SIZE);
+    }
+};
+
+template<typename... Fields>
+const uint32_t PacketLayout<Fields...>::SIZE;
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_PACKETLAYOUT_H
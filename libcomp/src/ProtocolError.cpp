@@ -0,0 +1,183 @@
+/**
+ * @file libcomp/src/ProtocolError.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Rate-limited reporting of protocol violations.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProtocolError.h"
+
+// libcomp Includes
+#include "Constants.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "ReadOnlyPacket.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+
+using namespace libcomp;
+
+/**
+ * @internal
+ * Metric label and description of each code.
+ */
+static const char* const CODE_INFO[ProtocolError::CODE_COUNT][2] = {
+    { "bad_sizes", "bad frame sizes" },
+    { "bad_compressed_frame", "bad compressed frame" },
+    { "short_command_header", "not enough data for command header" },
+    { "short_command", "command is smaller than its header" },
+    { "short_command_data", "not enough data for command data" },
+    { "extra_data", "extra data after the commands" },
+    { "bad_internal_frame", "corrupt internal frame" },
+    { "exception", "exception while parsing" },
+};
+
+/// Number of reports of each code.
+static std::atomic<uint64_t> gCounts[ProtocolError::CODE_COUNT];
+
+/// Second (of the steady clock) the log budget belongs to.
+static std::atomic<int64_t> gLogWindow(-1);
+
+/// Number of reports that used the log budget of this second.
+static std::atomic<uint32_t> gLogged(0);
+
+/// Reports not logged since the last one that was.
+static std::atomic<uint64_t> gPendingSuppressed(0);
+
+/// Reports not logged since the server started.
+static std::atomic<uint64_t> gSuppressed(0);
+
+/**
+ * @internal
+ * Get the metric counting reports of a code.
+ * @param code Kind of violation.
+ * @returns Counter for the code.
+ */
+static MetricCounter& GetCounter(ProtocolError::Code_t code)
+{
+    static MetricCounter* counters[ProtocolError::CODE_COUNT] = { nullptr };
+    static bool initialized = [&]()
+    {
+        for(int i = 0; i < ProtocolError::CODE_COUNT; ++i)
+        {
+            counters[i] = &Metrics::GetSingletonPtr()->Counter(
+                "comp_protocol_errors_total",
+                "Malformed data received from clients.",
+                String("code=\"%1\"").Arg(CODE_INFO[i][0]));
+        }
+
+        return true;
+    }();
+
+    (void)initialized;
+
+    return *counters[code];
+}
+
+bool ProtocolError::Report(Code_t code, const String& remoteAddress,
+    const ReadOnlyPacket *pPacket, uint32_t offset)
+{
+    if(CODE_COUNT <= code)
+    {
+        code = CODE_EXCEPTION;
+    }
+
+    gCounts[code]++;
+    GetCounter(code).Increment();
+
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t window = gLogWindow.load(std::memory_order_relaxed);
+
+    // The first report of a new second resets the budget. Two threads may
+    // race here; the worst case is a few extra lines that second.
+    if(window != now && gLogWindow.compare_exchange_strong(window, now))
+    {
+        gLogged.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t slot = gLogged++;
+
+    if(PROTOCOL_ERROR_LOG_RATE <= slot)
+    {
+        gPendingSuppressed++;
+        gSuppressed++;
+
+        return false;
+    }
+
+    String message = String("Protocol error from %1: %2 (offset %3)").Arg(
+        remoteAddress).Arg(CODE_INFO[code][1]).Arg(offset);
+
+    uint64_t suppressed = gPendingSuppressed.exchange(0);
+
+    if(0 != suppressed)
+    {
+        message += String("; %1 more were not logged").Arg(suppressed);
+    }
+
+    // Only the first report of each second does the expensive part.
+    bool detailed = 0 == slot;
+
+    if(detailed && nullptr != pPacket && 0 < pPacket->Size())
+    {
+        uint32_t size = pPacket->Size();
+        uint32_t start = offset < size ? offset : size - 1;
+
+        // Dump from a little before the offset.
+        start = start > (PROTOCOL_ERROR_DUMP_SIZE / 4) ?
+            start - (PROTOCOL_ERROR_DUMP_SIZE / 4) : 0;
+
+        uint32_t length = size - start;
+
+        if(PROTOCOL_ERROR_DUMP_SIZE < length)
+        {
+            length = PROTOCOL_ERROR_DUMP_SIZE;
+        }
+
+        ReadOnlyPacket part(*pPacket, start, length);
+
+        message += String("\nPacket bytes %1 to %2 of %3:\n%4").Arg(
+            start).Arg(start + length).Arg(size).Arg(part.Dump());
+    }
+
+    LOG_WARNING(message + "\n");
+
+    return detailed;
+}
+
+const char* ProtocolError::GetDescription(Code_t code)
+{
+    return CODE_COUNT > code ? CODE_INFO[code][1] : "unknown";
+}
+
+uint64_t ProtocolError::GetCount(Code_t code)
+{
+    return CODE_COUNT > code ? gCounts[code].load() : 0;
+}
+
+uint64_t ProtocolError::GetSuppressedCount()
+{
+    return gSuppressed;
+}
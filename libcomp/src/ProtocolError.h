@@ -0,0 +1,116 @@
+/**
+ * @file libcomp/src/ProtocolError.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Rate-limited reporting of protocol violations.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_PROTOCOLERROR_H
+#define LIBCOMP_SRC_PROTOCOLERROR_H
+
+// libcomp Includes
+#include "String.h"
+
+// Standard C++11 Includes
+#include <stdint.h>
+
+namespace libcomp
+{
+
+class ReadOnlyPacket;
+
+/**
+ * Cheap error channel for malformed data received from a remote end. A
+ * report never throws and costs a couple of atomic operations: it bumps a
+ * counter for the code (also exported as the comp_protocol_errors_total
+ * metric) and only logs a one line message if fewer than
+ * @ref PROTOCOL_ERROR_LOG_RATE reports were logged this second. Only the
+ * first report of each second dumps (part of) the packet. This keeps a
+ * client that floods the server with bad packets from turning each one into
+ * backtrace and hex dump formatting on the io thread.
+ */
+class ProtocolError
+{
+public:
+    /**
+     * Kind of protocol violation.
+     */
+    typedef enum : uint8_t
+    {
+        /// The sizes at the start of a frame don't make sense.
+        CODE_BAD_SIZES = 0,
+        /// A compressed frame failed to inflate.
+        CODE_BAD_COMPRESSED_FRAME,
+        /// There is not enough data left for a command header.
+        CODE_SHORT_COMMAND_HEADER,
+        /// A command is smaller than its own header.
+        CODE_SHORT_COMMAND,
+        /// There is not enough data left for the data of a command.
+        CODE_SHORT_COMMAND_DATA,
+        /// There is data left after the commands and padding.
+        CODE_EXTRA_DATA,
+        /// An internal frame or message is corrupt.
+        CODE_BAD_INTERNAL_FRAME,
+        /// Parsing the packet threw an exception.
+        CODE_EXCEPTION,
+        /// Number of codes (not a code).
+        CODE_COUNT,
+    } Code_t;
+
+    /**
+     * Record a protocol violation.
+     * @param code Kind of violation.
+     * @param remoteAddress Address of the remote end that sent the data.
+     * @param pPacket Packet the violation was found in (may be null).
+     * @param offset Offset into the packet the violation was found at.
+     * @returns true if this report was picked for the detailed diagnostics
+     * (the caller may then log anything else that is expensive, such as an
+     * exception backtrace).
+     */
+    static bool Report(Code_t code, const String& remoteAddress,
+        const ReadOnlyPacket *pPacket = nullptr, uint32_t offset = 0);
+
+    /**
+     * Get a description of a code.
+     * @param code Kind of violation.
+     * @returns Description of the code.
+     */
+    static const char* GetDescription(Code_t code);
+
+    /**
+     * Get the number of violations reported with a code.
+     * @param code Kind of violation.
+     * @returns Number of reports.
+     */
+    static uint64_t GetCount(Code_t code);
+
+    /**
+     * Get the number of reports that were not logged because of the rate
+     * limit.
+     * @returns Number of reports that were only counted.
+     */
+    static uint64_t GetSuppressedCount();
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_PROTOCOLERROR_H
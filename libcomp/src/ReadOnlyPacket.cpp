@@ -29,6 +29,7 @@
 #include "Endian.h"
 #include "Log.h"
 #include "PacketException.h"
+#include "ThreadAffinity.h"
 
 #include <array>
 
@@ -56,30 +57,200 @@
 #include <cstring>
 #include <cstdio>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIBCOMP_PACKET_SSSE3
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define LIBCOMP_PACKET_NEON
+#include <arm_neon.h>
+#endif
+
 using namespace libcomp;
 
-ReadOnlyPacket::ReadOnlyPacket() : mPosition(0), mSize(0), mData(nullptr)
+namespace
+{
+
+/// Storage for a buffer in the small size class.
+typedef std::array<uint8_t, PACKET_SMALL_SIZE> SmallPacketArray;
+
+/// Storage for a buffer in the medium size class.
+typedef std::array<uint8_t, PACKET_MEDIUM_SIZE> MediumPacketArray;
+
+/// Storage for a buffer in the large size class.
+typedef std::array<uint8_t, MAX_PACKET_SIZE> LargePacketArray;
+
+/**
+ * @internal
+ * Get the buffer pool of a size class for a NUMA node. Each node has its
+ * own pools so a released buffer is only reused by threads on the node that
+ * allocated (and first touched) it.
+ * @param node NUMA node of the pool.
+ * @returns Pool for the size class.
+ */
+template<class T>
+ObjectPool<T>& GetBufferPool(uint32_t node)
+{
+    static std::vector<std::unique_ptr<ObjectPool<T>>> pools = []()
+    {
+        std::vector<std::unique_ptr<ObjectPool<T>>> nodePools;
+
+        for(uint32_t i = 0; i < PACKET_POOL_NUMA_NODES; ++i)
+        {
+            nodePools.emplace_back(new ObjectPool<T>(PACKET_POOL_MAX_FREE));
+        }
+
+        return nodePools;
+    }();
+
+    return *pools[node < PACKET_POOL_NUMA_NODES ? node :
+        PACKET_POOL_NUMA_NODES - 1];
+}
+
+/**
+ * @internal
+ * Add up the counters of a size class over every NUMA node.
+ * @returns Pool counters.
+ */
+template<class T>
+ObjectPoolStats_t SumBufferPoolStats()
+{
+    ObjectPoolStats_t stats = GetBufferPool<T>(0).GetStats();
+
+    for(uint32_t node = 1; node < PACKET_POOL_NUMA_NODES; ++node)
+    {
+        ObjectPoolStats_t nodeStats = GetBufferPool<T>(node).GetStats();
+        stats.hits += nodeStats.hits;
+        stats.misses += nodeStats.misses;
+        stats.outstanding += nodeStats.outstanding;
+        stats.highWater += nodeStats.highWater;
+        stats.free += nodeStats.free;
+    }
+
+    return stats;
+}
+
+template<class T>
+std::shared_ptr<uint8_t> AllocateFromPool()
+{
+    std::shared_ptr<T> buffer = GetBufferPool<T>(
+        ThreadAffinity::GetCurrentNode()).Allocate();
+
+    // Share ownership of the array but point at the data.
+    return std::shared_ptr<uint8_t>(buffer, buffer->data());
+}
+
+#ifdef LIBCOMP_PACKET_SSSE3
+/**
+ * @internal
+ * Swap the bytes of each element 16 bytes at a time with pshufb.
+ * @returns Number of bytes that were swapped.
+ */
+__attribute__((target("ssse3")))
+uint32_t SwapCopySsse3(uint8_t *pDestination, const uint8_t *pSource,
+    uint32_t bytes, uint32_t elementSize)
+{
+    __m128i shuffle;
+
+    if(2 == elementSize)
+    {
+        shuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+            9, 8, 11, 10, 13, 12, 15, 14);
+    }
+    else if(4 == elementSize)
+    {
+        shuffle = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+            11, 10, 9, 8, 15, 14, 13, 12);
+    }
+    else
+    {
+        shuffle = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+            15, 14, 13, 12, 11, 10, 9, 8);
+    }
+
+    uint32_t done = 0;
+
+    for(; (done + 16) <= bytes; done += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+            pSource + done));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + done),
+            _mm_shuffle_epi8(v, shuffle));
+    }
+
+    return done;
+}
+#endif // LIBCOMP_PACKET_SSSE3
+
+#ifdef LIBCOMP_PACKET_NEON
+/**
+ * @internal
+ * Swap the bytes of each element 16 bytes at a time with vrev.
+ * @returns Number of bytes that were swapped.
+ */
+uint32_t SwapCopyNeon(uint8_t *pDestination, const uint8_t *pSource,
+    uint32_t bytes, uint32_t elementSize)
+{
+    uint32_t done = 0;
+
+    for(; (done + 16) <= bytes; done += 16)
+    {
+        uint8x16_t v = vld1q_u8(pSource + done);
+
+        if(2 == elementSize)
+        {
+            v = vrev16q_u8(v);
+        }
+        else if(4 == elementSize)
+        {
+            v = vrev32q_u8(v);
+        }
+        else
+        {
+            v = vrev64q_u8(v);
+        }
+
+        vst1q_u8(pDestination + done, v);
+    }
+
+    return done;
+}
+#endif // LIBCOMP_PACKET_NEON
+
+} // namespace
+
+ReadOnlyPacket::ReadOnlyPacket() : mPosition(0), mSize(0), mData(nullptr),
+    mCapacity(0)
 {
     // The max packet size should be evenly divisible by 4 bytes.
     static_assert(0 == (MAX_PACKET_SIZE % 4),
         "MAX_PACKET_SIZE not a multiple of 4");
+
+    // Each size class is used to fill the debug pattern as well.
+    static_assert(0 == (PACKET_SMALL_SIZE % 4) &&
+        0 == (PACKET_MEDIUM_SIZE % 4), "Packet size class not a multiple "
+        "of 4");
+    static_assert(PACKET_SMALL_SIZE < PACKET_MEDIUM_SIZE &&
+        PACKET_MEDIUM_SIZE < MAX_PACKET_SIZE, "Packet size classes must "
+        "increase up to MAX_PACKET_SIZE");
 }
 
 ReadOnlyPacket::ReadOnlyPacket(uint32_t position, uint32_t size,
-    uint8_t *pData, std::shared_ptr<PacketArray> dataRef) :
-    mPosition(position), mSize(size), mData(pData), mDataRef(dataRef)
+    uint8_t *pData, uint32_t capacity, std::shared_ptr<uint8_t> dataRef) :
+    mPosition(position), mSize(size), mData(pData), mCapacity(capacity),
+    mDataRef(dataRef)
 {
 }
 
 ReadOnlyPacket::ReadOnlyPacket(const ReadOnlyPacket& other) :
     mPosition(other.mPosition), mSize(other.mSize), mData(other.mData),
-    mDataRef(other.mDataRef)
+    mCapacity(other.mCapacity), mDataRef(other.mDataRef)
 {
 }
 
 ReadOnlyPacket::ReadOnlyPacket(const ReadOnlyPacket& other,
     uint32_t start, uint32_t size) : mPosition(0), mSize(size),
-    mData(&other.mData[start]), mDataRef(other.mDataRef)
+    mData(&other.mData[start]), mCapacity(size), mDataRef(other.mDataRef)
 {
     if((start + size) > other.mSize)
     {
@@ -90,12 +261,13 @@ ReadOnlyPacket::ReadOnlyPacket(const ReadOnlyPacket& other,
 
 ReadOnlyPacket::ReadOnlyPacket(Packet&& other) :
     mPosition(other.mPosition), mSize(other.mSize), mData(other.mData),
-    mDataRef(other.mDataRef)
+    mCapacity(other.mCapacity), mDataRef(other.mDataRef)
 {
     other.mPosition = 0;
     other.mSize = 0;
     other.mDataRef.reset();
     other.mData = nullptr;
+    other.mCapacity = 0;
 
     // Ensure the ReadOnlypacket is clear and the variables are set.
     other.Clear();
@@ -110,8 +282,66 @@ void ReadOnlyPacket::Allocate()
     // Ensure the packet data buffer is allocated.
     if(nullptr == mData)
     {
-        mDataRef = std::shared_ptr<PacketArray>(new PacketArray);
-        mData = mDataRef.get()->data();
+        mDataRef = AllocateBuffer(PACKET_SMALL_SIZE, mCapacity);
+        mData = mDataRef.get();
+    }
+}
+
+uint32_t ReadOnlyPacket::Capacity() const
+{
+    return mCapacity;
+}
+
+std::shared_ptr<uint8_t> ReadOnlyPacket::AllocateBuffer(uint32_t capacity,
+    uint32_t& bufferSize)
+{
+    if(PACKET_SMALL_SIZE >= capacity)
+    {
+        bufferSize = PACKET_SMALL_SIZE;
+
+        return AllocateFromPool<SmallPacketArray>();
+    }
+    else if(PACKET_MEDIUM_SIZE >= capacity)
+    {
+        bufferSize = PACKET_MEDIUM_SIZE;
+
+        return AllocateFromPool<MediumPacketArray>();
+    }
+
+    bufferSize = MAX_PACKET_SIZE;
+
+    return AllocateFromPool<LargePacketArray>();
+}
+
+ObjectPoolStats_t ReadOnlyPacket::GetBufferPoolStats(uint32_t capacity)
+{
+    if(PACKET_SMALL_SIZE >= capacity)
+    {
+        return SumBufferPoolStats<SmallPacketArray>();
+    }
+    else if(PACKET_MEDIUM_SIZE >= capacity)
+    {
+        return SumBufferPoolStats<MediumPacketArray>();
+    }
+
+    return SumBufferPoolStats<LargePacketArray>();
+}
+
+void ReadOnlyPacket::ReserveBuffers(size_t count, uint32_t capacity)
+{
+    uint32_t node = ThreadAffinity::GetCurrentNode();
+
+    if(PACKET_SMALL_SIZE >= capacity)
+    {
+        GetBufferPool<SmallPacketArray>(node).Reserve(count);
+    }
+    else if(PACKET_MEDIUM_SIZE >= capacity)
+    {
+        GetBufferPool<MediumPacketArray>(node).Reserve(count);
+    }
+    else
+    {
+        GetBufferPool<LargePacketArray>(node).Reserve(count);
     }
 }
 
@@ -224,6 +454,103 @@ void ReadOnlyPacket::ReadArray(void *buffer, uint32_t sz)
     Skip(sz);
 }
 
+void ReadOnlyPacket::ReadU16ArrayBig(uint16_t *pValues, uint32_t count)
+{
+    ReadScalarArray(pValues, count, (uint32_t)sizeof(uint16_t), true);
+}
+
+void ReadOnlyPacket::ReadU16ArrayLittle(uint16_t *pValues, uint32_t count)
+{
+    ReadScalarArray(pValues, count, (uint32_t)sizeof(uint16_t), false);
+}
+
+void ReadOnlyPacket::ReadU32ArrayBig(uint32_t *pValues, uint32_t count)
+{
+    ReadScalarArray(pValues, count, (uint32_t)sizeof(uint32_t), true);
+}
+
+void ReadOnlyPacket::ReadU32ArrayLittle(uint32_t *pValues, uint32_t count)
+{
+    ReadScalarArray(pValues, count, (uint32_t)sizeof(uint32_t), false);
+}
+
+void ReadOnlyPacket::ReadU64ArrayBig(uint64_t *pValues, uint32_t count)
+{
+    ReadScalarArray(pValues, count, (uint32_t)sizeof(uint64_t), true);
+}
+
+void ReadOnlyPacket::ReadU64ArrayLittle(uint64_t *pValues, uint32_t count)
+{
+    ReadScalarArray(pValues, count, (uint32_t)sizeof(uint64_t), false);
+}
+
+void ReadOnlyPacket::ReadScalarArray(void *pValues, uint32_t count,
+    uint32_t elementSize, bool bigEndian)
+{
+    // Check the whole array once (in 64-bit so a huge count can't wrap).
+    uint64_t sz = (uint64_t)count * elementSize;
+
+    if(((uint64_t)mPosition + sz) > mSize)
+    {
+        PACKET_EXCEPTION(String("Attempted to read an array of %1 values; "
+            "however, doing so would read more data then is remaining "
+            "in the ReadOnlypacket").Arg(count), this);
+    }
+
+    CopyScalarArray(pValues, mData + mPosition, count, elementSize,
+        bigEndian);
+
+    mPosition += (uint32_t)sz;
+}
+
+void ReadOnlyPacket::CopyScalarArray(void *pDestination, const void *pSource,
+    uint32_t count, uint32_t elementSize, bool bigEndian)
+{
+    uint32_t bytes = count * elementSize;
+
+#ifdef LIBCOMP_LITTLEENDIAN
+    bool swap = bigEndian;
+#else // LIBCOMP_BIGENDIAN
+    bool swap = !bigEndian;
+#endif // LIBCOMP_LITTLEENDIAN
+
+    if(0 == bytes)
+    {
+        return;
+    }
+
+    if(!swap || 1 == elementSize)
+    {
+        memcpy(pDestination, pSource, bytes);
+
+        return;
+    }
+
+    uint8_t *pOut = reinterpret_cast<uint8_t*>(pDestination);
+    const uint8_t *pIn = reinterpret_cast<const uint8_t*>(pSource);
+    uint32_t done = 0;
+
+#if defined(LIBCOMP_PACKET_SSSE3)
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+
+    if(ssse3)
+    {
+        done = SwapCopySsse3(pOut, pIn, bytes, elementSize);
+    }
+#elif defined(LIBCOMP_PACKET_NEON)
+    done = SwapCopyNeon(pOut, pIn, bytes, elementSize);
+#endif
+
+    // Swap whatever is left one element at a time.
+    for(; done < bytes; done += elementSize)
+    {
+        for(uint32_t i = 0; i < elementSize; ++i)
+        {
+            pOut[done + i] = pIn[done + elementSize - 1 - i];
+        }
+    }
+}
+
 String ReadOnlyPacket::ReadString(Convert::Encoding_t encoding)
 {
     uint32_t sz = 0;
@@ -795,6 +1122,7 @@ ReadOnlyPacket& ReadOnlyPacket::operator=(ReadOnlyPacket& other)
     mSize = other.mSize;
     mDataRef = other.mDataRef;
     mData = other.mData;
+    mCapacity = other.mCapacity;
 
     return *this;
 }
@@ -29,6 +29,7 @@
 
 #include "Constants.h"
 #include "Convert.h"
+#include "ObjectPool.h"
 #include "String.h"
 
 #include <memory>
@@ -84,9 +85,6 @@ class PacketException;
  */
 class ReadOnlyPacket
 {
-private:
-    typedef std::array<uint8_t, MAX_PACKET_SIZE> PacketArray;
-
 public:
     /// This class needs to directly access data in the Packet class.
     friend class PacketException;
@@ -139,6 +137,63 @@ public:
      */
     void ReadArray(void *buffer, uint32_t sz);
 
+    /**
+     * Read @em count big endian 16-bit unsigned integers from the packet
+     * into @em pValues. The packet is bounds checked once for the whole
+     * array and the byte order is converted in bulk (with SIMD if the CPU
+     * supports it). After reading, the current position in the packet will
+     * advance past the array.
+     * @param pValues Array to store the values in.
+     * @param count Number of values to read.
+     * @sa Packet::WriteU16ArrayBig
+     */
+    void ReadU16ArrayBig(uint16_t *pValues, uint32_t count);
+
+    /**
+     * Read @em count little endian 16-bit unsigned integers from the packet
+     * into @em pValues. See @ref ReadU16ArrayBig.
+     * @param pValues Array to store the values in.
+     * @param count Number of values to read.
+     * @sa Packet::WriteU16ArrayLittle
+     */
+    void ReadU16ArrayLittle(uint16_t *pValues, uint32_t count);
+
+    /**
+     * Read @em count big endian 32-bit unsigned integers from the packet
+     * into @em pValues. See @ref ReadU16ArrayBig.
+     * @param pValues Array to store the values in.
+     * @param count Number of values to read.
+     * @sa Packet::WriteU32ArrayBig
+     */
+    void ReadU32ArrayBig(uint32_t *pValues, uint32_t count);
+
+    /**
+     * Read @em count little endian 32-bit unsigned integers from the packet
+     * into @em pValues. See @ref ReadU16ArrayBig.
+     * @param pValues Array to store the values in.
+     * @param count Number of values to read.
+     * @sa Packet::WriteU32ArrayLittle
+     */
+    void ReadU32ArrayLittle(uint32_t *pValues, uint32_t count);
+
+    /**
+     * Read @em count big endian 64-bit unsigned integers from the packet
+     * into @em pValues. See @ref ReadU16ArrayBig.
+     * @param pValues Array to store the values in.
+     * @param count Number of values to read.
+     * @sa Packet::WriteU64ArrayBig
+     */
+    void ReadU64ArrayBig(uint64_t *pValues, uint32_t count);
+
+    /**
+     * Read @em count little endian 64-bit unsigned integers from the packet
+     * into @em pValues. See @ref ReadU16ArrayBig.
+     * @param pValues Array to store the values in.
+     * @param count Number of values to read.
+     * @sa Packet::WriteU64ArrayLittle
+     */
+    void ReadU64ArrayLittle(uint64_t *pValues, uint32_t count);
+
     /**
      * Read the string @em str encoded with @em encoding from the packet. The
      * string should contain a null terminator.
@@ -625,10 +680,46 @@ public:
     const char* ConstData() const;
 
     /**
-     * @brief Ensure the packet data buffer is allocated.
+     * @brief Ensure the packet data buffer is allocated. The buffer is taken
+     * from the pool of the smallest size class (@ref PACKET_SMALL_SIZE) and
+     * returned to it once the last packet referencing it is destroyed. A
+     * Packet moves to a bigger size class as it grows.
      */
     void Allocate();
 
+    /**
+     * @brief Get the number of bytes the packet can hold before the buffer
+     * has to be replaced with one from a bigger size class.
+     * @returns Capacity of the packet buffer.
+     */
+    uint32_t Capacity() const;
+
+    /**
+     * @brief Get the counters for the pool of packet buffers.
+     * @param capacity Capacity used to pick the size class.
+     * @returns Packet buffer pool counters.
+     */
+    static ObjectPoolStats_t GetBufferPoolStats(
+        uint32_t capacity = MAX_PACKET_SIZE);
+
+    /**
+     * @brief Allocate packet buffers ahead of time.
+     * @param count Number of free buffers the pool should hold.
+     * @param capacity Capacity used to pick the size class.
+     */
+    static void ReserveBuffers(size_t count,
+        uint32_t capacity = MAX_PACKET_SIZE);
+
+    /**
+     * @brief Get a buffer from the pool of the smallest size class that can
+     * hold @em capacity bytes.
+     * @param capacity Minimum number of bytes the buffer must hold.
+     * @param bufferSize Set to the actual size of the buffer.
+     * @returns Reference to the buffer.
+     */
+    static std::shared_ptr<uint8_t> AllocateBuffer(uint32_t capacity,
+        uint32_t& bufferSize);
+
     /**
      * @brief Copy the packet data from another ReadOnlyPacket object.
      * @param other ReadOnlyPacket object to move the data from.
@@ -644,7 +735,29 @@ public:
 protected:
     /// Protected constructor for use by subclasses.
     explicit ReadOnlyPacket(uint32_t position, uint32_t size,
-        uint8_t *pData, std::shared_ptr<PacketArray> dataRef);
+        uint8_t *pData, uint32_t capacity, std::shared_ptr<uint8_t> dataRef);
+
+    /**
+     * @brief Copy an array of integers converting each one between host
+     * byte order and the packet byte order. The arrays must not overlap.
+     * @param pDestination Array to copy to.
+     * @param pSource Array to copy from.
+     * @param count Number of integers to copy.
+     * @param elementSize Size in bytes of each integer (1, 2, 4 or 8).
+     * @param bigEndian Indicates if the packet side is big endian.
+     */
+    static void CopyScalarArray(void *pDestination, const void *pSource,
+        uint32_t count, uint32_t elementSize, bool bigEndian);
+
+    /**
+     * @brief Read an array of integers (see @ref ReadU16ArrayBig).
+     * @param pValues Array to store the values in.
+     * @param count Number of values to read.
+     * @param elementSize Size in bytes of each value.
+     * @param bigEndian Indicates if the values are big endian.
+     */
+    void ReadScalarArray(void *pValues, uint32_t count, uint32_t elementSize,
+        bool bigEndian);
 
     /// Current position in the packet.
     uint32_t mPosition;
@@ -655,9 +768,12 @@ protected:
     /// Pointer to the packet data.
     uint8_t *mData;
 
+    /// Number of bytes available starting at @ref mData.
+    uint32_t mCapacity;
+
     /// Reference to the underlying buffer (which could be shared between
     /// read only packets).
-    std::shared_ptr<PacketArray> mDataRef;
+    std::shared_ptr<uint8_t> mDataRef;
 };
 
 } // namespace libcomp
@@ -0,0 +1,373 @@
+/**
+ * @file libcomp/src/ReadThroughCache.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Sharded read-through cache in front of the database.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_READTHROUGHCACHE_H
+#define LIBCOMP_SRC_READTHROUGHCACHE_H
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Counters describing how well a @ref ReadThroughCache works.
+ */
+typedef struct
+{
+    /// Number of lookups answered from the cache.
+    uint64_t hits;
+
+    /// Number of lookups that had to ask the loader.
+    uint64_t misses;
+
+    /// Number of entries dropped because they were too old.
+    uint64_t expired;
+
+    /// Number of entries dropped to stay within the size bound.
+    uint64_t evictions;
+} ReadThroughCacheStats_t;
+
+/**
+ * Cache of records (such as accounts or sessions) loaded from the database,
+ * keyed by their ID. A lookup that misses (or finds an entry older than the
+ * time to live) calls the loader and keeps the result. Writes go through the
+ * writer first and then update the cache so it never holds a value the
+ * database does not. The keys are spread over several shards, each with its
+ * own lock and size bound, so threads looking up different records do not
+ * wait on each other. The loader and writer are called without any lock
+ * held; two threads that miss on the same key at once may both load it.
+ */
+template<class T>
+class ReadThroughCache
+{
+public:
+    /**
+     * Function that reads a record from the database.
+     * @param key ID of the record.
+     * @param value Set to the record that was read.
+     * @returns true if the record exists.
+     */
+    typedef std::function<bool(const std::string& key, T& value)> Loader_t;
+
+    /**
+     * Function that writes a record to the database.
+     * @param key ID of the record.
+     * @param value Record to write.
+     * @returns true if the record was written.
+     */
+    typedef std::function<bool(const std::string& key,
+        const T& value)> Writer_t;
+
+    /**
+     * Function that decides if this process owns a record.
+     * @param key ID of the record.
+     * @returns true if the record should be cached here.
+     */
+    typedef std::function<bool(const std::string& key)> OwnerFilter_t;
+
+    /**
+     * Create a new cache.
+     * @param loader Function that reads a record from the database.
+     * @param writer Function that writes a record to the database.
+     * @param capacity Maximum number of records to keep.
+     * @param timeToLive How long a record is trusted before it is loaded
+     * again.
+     * @param shardCount Number of independently locked shards.
+     */
+    ReadThroughCache(const Loader_t& loader, const Writer_t& writer,
+        size_t capacity, std::chrono::milliseconds timeToLive,
+        size_t shardCount = 16) : mLoader(loader), mWriter(writer),
+        mTimeToLive(timeToLive), mShardCount(0 < shardCount ? shardCount : 1),
+        mShards(new Shard[mShardCount]), mHits(0), mMisses(0), mExpired(0),
+        mEvictions(0)
+    {
+        // Round up so the whole cache holds at least the capacity.
+        mShardCapacity = (capacity + mShardCount - 1) / mShardCount;
+
+        if(0 == mShardCapacity)
+        {
+            mShardCapacity = 1;
+        }
+    }
+
+    /**
+     * Only cache the records this process owns (for example the keys a
+     * @ref HashRing maps to this lobby). Records owned by another process
+     * are still loaded and written but never kept, so a copy that could go
+     * stale while the owner changes it is never read back. By default every
+     * record is cached. This must be set before the cache is used.
+     * @param filter Function that decides if this process owns a record.
+     */
+    void SetOwnerFilter(const OwnerFilter_t& filter)
+    {
+        mOwnerFilter = filter;
+    }
+
+    /**
+     * Look up a record, loading it from the database if it is not cached.
+     * @param key ID of the record.
+     * @param value Set to the record.
+     * @returns true if the record exists.
+     */
+    bool Get(const std::string& key, T& value)
+    {
+        Shard& shard = GetShard(key);
+        uint64_t generation;
+
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+
+            auto it = shard.index.find(key);
+
+            if(shard.index.end() != it)
+            {
+                if(Clock_t::now() < it->second->expires)
+                {
+                    // Move the entry to the front (most recently used).
+                    shard.entries.splice(shard.entries.begin(),
+                        shard.entries, it->second);
+
+                    value = it->second->value;
+                    mHits++;
+
+                    return true;
+                }
+
+                shard.entries.erase(it->second);
+                shard.index.erase(it);
+                mExpired++;
+            }
+
+            generation = shard.generation;
+        }
+
+        mMisses++;
+
+        bool result = mLoader && mLoader(key, value);
+
+        // Don't cache what was read if a write raced with the load since
+        // the value may already be stale.
+        if(result)
+        {
+            Store(shard, key, value, &generation);
+        }
+
+        return result;
+    }
+
+    /**
+     * Write a record to the database and then to the cache.
+     * @param key ID of the record.
+     * @param value Record to write.
+     * @returns true if the record was written. If the write fails the
+     * cached copy is dropped since the database state is unknown.
+     */
+    bool Put(const std::string& key, const T& value)
+    {
+        Shard& shard = GetShard(key);
+
+        bool result = !mWriter || mWriter(key, value);
+
+        if(result)
+        {
+            Store(shard, key, value, nullptr);
+        }
+        else
+        {
+            Invalidate(key);
+        }
+
+        return result;
+    }
+
+    /**
+     * Drop a record from the cache so the next lookup reads the database.
+     * Use this when the record is changed or deleted without @ref Put.
+     * @param key ID of the record.
+     */
+    void Invalidate(const std::string& key)
+    {
+        Shard& shard = GetShard(key);
+
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        auto it = shard.index.find(key);
+
+        if(shard.index.end() != it)
+        {
+            shard.entries.erase(it->second);
+            shard.index.erase(it);
+        }
+
+        shard.generation++;
+    }
+
+    /**
+     * Drop every record from the cache.
+     */
+    void Clear()
+    {
+        for(size_t i = 0; i < mShardCount; ++i)
+        {
+            std::lock_guard<std::mutex> guard(mShards[i].lock);
+
+            mShards[i].index.clear();
+            mShards[i].entries.clear();
+            mShards[i].generation++;
+        }
+    }
+
+    /**
+     * Get the current cache counters.
+     * @returns Cache counters.
+     */
+    ReadThroughCacheStats_t GetStats() const
+    {
+        ReadThroughCacheStats_t stats;
+        stats.hits = mHits;
+        stats.misses = mMisses;
+        stats.expired = mExpired;
+        stats.evictions = mEvictions;
+
+        return stats;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock_t;
+
+    /**
+     * @internal
+     * Cached record.
+     */
+    class Entry
+    {
+    public:
+        std::string key;
+        T value;
+        Clock_t::time_point expires;
+    };
+
+    /**
+     * @internal
+     * Independently locked part of the cache.
+     */
+    class Shard
+    {
+    public:
+        Shard() : generation(0)
+        {
+        }
+
+        std::mutex lock;
+
+        /// Changed by every write so a slow load can tell it is stale.
+        uint64_t generation;
+
+        std::list<Entry> entries;
+        std::unordered_map<std::string,
+            typename std::list<Entry>::iterator> index;
+    };
+
+    Shard& GetShard(const std::string& key)
+    {
+        return mShards[std::hash<std::string>()(key) % mShardCount];
+    }
+
+    void Store(Shard& shard, const std::string& key, const T& value,
+        const uint64_t *pGeneration)
+    {
+        bool owned = !mOwnerFilter || mOwnerFilter(key);
+
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        if(nullptr != pGeneration && *pGeneration != shard.generation)
+        {
+            return;
+        }
+
+        if(nullptr == pGeneration)
+        {
+            shard.generation++;
+        }
+
+        auto it = shard.index.find(key);
+
+        if(shard.index.end() != it)
+        {
+            shard.entries.erase(it->second);
+            shard.index.erase(it);
+        }
+
+        if(!owned)
+        {
+            return;
+        }
+
+        while(shard.entries.size() >= mShardCapacity)
+        {
+            shard.index.erase(shard.entries.back().key);
+            shard.entries.pop_back();
+            mEvictions++;
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.value = value;
+        entry.expires = Clock_t::now() + mTimeToLive;
+
+        shard.entries.push_front(std::move(entry));
+        shard.index[key] = shard.entries.begin();
+    }
+
+    Loader_t mLoader;
+    Writer_t mWriter;
+    OwnerFilter_t mOwnerFilter;
+
+    std::chrono::milliseconds mTimeToLive;
+
+    size_t mShardCount;
+    size_t mShardCapacity;
+    std::unique_ptr<Shard[]> mShards;
+
+    std::atomic<uint64_t> mHits;
+    std::atomic<uint64_t> mMisses;
+    std::atomic<uint64_t> mExpired;
+    std::atomic<uint64_t> mEvictions;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_READTHROUGHCACHE_H
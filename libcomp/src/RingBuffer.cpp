@@ -215,12 +215,14 @@ RingBuffer::~RingBuffer()
 
 int32_t RingBuffer::Free() const
 {
-    return (mReadIndex - mWriteIndex - 1) & mCapacityMask;
+    return (mReadIndex.load(std::memory_order_acquire) -
+        mWriteIndex.load(std::memory_order_acquire) - 1) & mCapacityMask;
 }
 
 int32_t RingBuffer::Available() const
 {
-    return (mCapacity - (mReadIndex - mWriteIndex)) & mCapacityMask;
+    return (mCapacity - (mReadIndex.load(std::memory_order_acquire) -
+        mWriteIndex.load(std::memory_order_acquire))) & mCapacityMask;
 }
 
 int32_t RingBuffer::Capacity() const
@@ -233,8 +235,11 @@ const void* RingBuffer::BeginRead(int32_t& size) const
     // This size should only ever increase if the consumer is adding data.
     // In this case, the extra data will not be read until the next read
     // operation and the size returned by EndRead may not be 100% synchronized.
-    int32_t available = (mCapacity - (mReadIndex -
-        mWriteIndex)) & mCapacityMask;
+    // Loading the write index with acquire makes the data the producer wrote
+    // before it updated the index visible to this thread.
+    int32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+    int32_t available = (mCapacity - (readIndex - mWriteIndex.load(
+        std::memory_order_acquire))) & mCapacityMask;
 
     // Ensure the request read size does not exceed the available bytes.
     size = std::min(size, available);
@@ -242,7 +247,7 @@ const void* RingBuffer::BeginRead(int32_t& size) const
     // Return the buffer pointer if the consumer may read at least 1 byte.
     if(0 < size && nullptr != mBuffer)
     {
-        return &mBuffer[mReadIndex];
+        return &mBuffer[readIndex];
     }
     else
     {
@@ -255,16 +260,19 @@ int32_t RingBuffer::EndRead(int32_t& size)
     // This size should only ever increase if the consumer is adding data.
     // In this case, the extra data will not be read until the next read
     // operation and the size returned by EndRead may not be 100% synchronized.
-    int32_t available = (mCapacity - (mReadIndex -
-        mWriteIndex)) & mCapacityMask;
+    int32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+    int32_t available = (mCapacity - (readIndex - mWriteIndex.load(
+        std::memory_order_acquire))) & mCapacityMask;
 
     // Ensure the request read size does not exceed the available bytes.
     size = std::min(size, available);
 
     // Update the read index. This is safe because it will only increase
     // the number of free bytes and there is only 1 consumer that will modify
-    // this index (the callee).
-    mReadIndex = (mReadIndex + size) & mCapacityMask;
+    // this index (the callee). The release lets the producer reuse the bytes
+    // only after they have been read.
+    mReadIndex.store((readIndex + size) & mCapacityMask,
+        std::memory_order_release);
 
     // Return the observed number of available bytes to read.
     // The true number of available bytes should never be less than this.
@@ -294,7 +302,9 @@ void* RingBuffer::BeginWrite(int32_t& size) const
     // This size should only ever increase if the producer is removing data.
     // In this case, the extra free bytes will not be used until the next write
     // operation and the size returned by EndWrite may not be 100% synchronized.
-    int32_t free = (mReadIndex - mWriteIndex - 1) & mCapacityMask;
+    int32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+    int32_t free = (mReadIndex.load(std::memory_order_acquire) -
+        writeIndex - 1) & mCapacityMask;
 
     // Ensure the request write size does not exceed the free bytes.
     size = std::min(size, free);
@@ -302,7 +312,7 @@ void* RingBuffer::BeginWrite(int32_t& size) const
     // Return the buffer pointer if the producer may write at least 1 byte.
     if(0 < size && nullptr != mBuffer)
     {
-        return &mBuffer[mWriteIndex];
+        return &mBuffer[writeIndex];
     }
     else
     {
@@ -315,15 +325,19 @@ int32_t RingBuffer::EndWrite(int32_t& size)
     // This size should only ever increase if the producer is removing data.
     // In this case, the extra free bytes will not be used until the next write
     // operation and the size returned by EndWrite may not be 100% synchronized.
-    int32_t free = (mReadIndex - mWriteIndex - 1) & mCapacityMask;
+    int32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+    int32_t free = (mReadIndex.load(std::memory_order_acquire) -
+        writeIndex - 1) & mCapacityMask;
 
     // Ensure the request write size does not exceed the free bytes.
     size = std::min(size, free);
 
     // Update the write index. This is safe because it will only increase
     // the number of available bytes and there is only 1 producer that will
-    // modify this index (the callee).
-    mWriteIndex = (mWriteIndex + size) & mCapacityMask;
+    // modify this index (the callee). The release publishes the bytes
+    // written before it to the consumer.
+    mWriteIndex.store((writeIndex + size) & mCapacityMask,
+        std::memory_order_release);
 
     // Return the observed number of free bytes to write.
     // The true number of free bytes should never be less than this.
@@ -348,6 +362,89 @@ int32_t RingBuffer::Write(const void *pSource, int32_t size)
     return size;
 }
 
+bool RingBuffer::WriteRecord(const void *pSource, int32_t size)
+{
+    if(0 > size)
+    {
+        return false;
+    }
+
+    // The length prefix and the data are written together so the consumer
+    // never sees part of a record.
+    int32_t total = (int32_t)sizeof(int32_t) + size;
+    int32_t writeSize = total;
+
+    int8_t *pDestination = reinterpret_cast<int8_t*>(BeginWrite(writeSize));
+
+    if(writeSize < total)
+    {
+        return false;
+    }
+
+    memcpy(pDestination, &size, sizeof(size));
+
+    if(0 < size)
+    {
+        memcpy(pDestination + sizeof(size), pSource, (size_t)size);
+    }
+
+    (void)EndWrite(writeSize);
+
+    return true;
+}
+
+bool RingBuffer::ReadRecord(std::vector<char>& record)
+{
+    RingRecord_t next;
+    int32_t size = 0;
+
+    if(1 != BeginReadV(&next, 1, size))
+    {
+        return false;
+    }
+
+    const char *pData = reinterpret_cast<const char*>(next.pData);
+    record.assign(pData, pData + next.size);
+
+    (void)EndRead(size);
+
+    return true;
+}
+
+int32_t RingBuffer::BeginReadV(RingRecord_t *pRecords, int32_t count,
+    int32_t& size) const
+{
+    // Get everything that has been written so far.
+    int32_t available = mCapacity;
+    const int8_t *pData = reinterpret_cast<const int8_t*>(
+        BeginRead(available));
+
+    int32_t records = 0;
+    size = 0;
+
+    // The buffer is mapped twice so every record is contiguous even if it
+    // wraps around the end.
+    while(records < count && (int32_t)sizeof(int32_t) <= available - size)
+    {
+        int32_t recordSize;
+        memcpy(&recordSize, pData + size, sizeof(recordSize));
+
+        if(0 > recordSize || recordSize > available - size -
+            (int32_t)sizeof(int32_t))
+        {
+            break;
+        }
+
+        pRecords[records].pData = pData + size + sizeof(int32_t);
+        pRecords[records].size = recordSize;
+        records++;
+
+        size += (int32_t)sizeof(int32_t) + recordSize;
+    }
+
+    return records;
+}
+
 int32_t RingBuffer::GetPageSize()
 {
 #if defined(_WIN32) || defined(_WIN64)
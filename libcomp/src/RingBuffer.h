@@ -32,11 +32,25 @@
 #endif // WIN32
 
 #include <stdint.h>
+#include <atomic>
 #include <string>
+#include <vector>
 
 namespace libcomp
 {
 
+/**
+* @brief One record (length-prefixed message) returned by a vectored read.
+*/
+typedef struct
+{
+    /// Start of the record data (after the length prefix).
+    const void *pData;
+
+    /// Size of the record data (in bytes).
+    int32_t size;
+} RingRecord_t;
+
 /**
 * @brief Single producer, single consumer, lock free, no wait ring buffer.
 *
@@ -68,6 +82,11 @@ namespace libcomp
 *   returned and all threads should stop using the ring buffer before the
 *   destructor is called. The ring buffer may be constructed and destructed
 *   by any thread as long as this condition is met.
+*
+* Records written with @ref WriteRecord are prefixed with their length so
+* the consumer may read whole messages with @ref ReadRecord or gather
+* several of them at once with @ref BeginReadV. Records and raw writes
+* should not be mixed in the same ring buffer.
 */
 class RingBuffer
 {
@@ -185,7 +204,40 @@ public:
     */
     int32_t Write(const void *pSource, int32_t size);
 
+    /**
+    * @brief Write a length-prefixed record into the ring buffer. The record
+    *   is only written if all of it fits.
+    * @param pSource Pointer to the record data.
+    * @param size Size of the record data.
+    * @returns true if the record was written; false if there is not enough
+    *   room for it.
+    */
+    bool WriteRecord(const void *pSource, int32_t size);
+
+    /**
+    * @brief Read the next record from the ring buffer.
+    * @param record Buffer that is replaced with the record data.
+    * @returns true if a record was read; false if there are none.
+    */
+    bool ReadRecord(std::vector<char>& record);
+
+    /**
+    * @brief Start a read of several records at once. The records point into
+    *   the ring buffer so they may be passed to a single gather write (like
+    *   writev or an asio buffer sequence) without being copied.
+    * @param pRecords Array to store the records in.
+    * @param count Maximum number of records to return.
+    * @param size Updated with the number of bytes the returned records use
+    *   (including the length prefixes). This should be passed to
+    *   @ref EndRead once the records are no longer used.
+    * @returns Number of records stored in @em pRecords.
+    */
+    int32_t BeginReadV(RingRecord_t *pRecords, int32_t count,
+        int32_t& size) const;
+
 private:
+    friend class MpscRingBuffer;
+
     /**
     * @brief Determine if a number is a positive power of two.
     * @returns true if a number is a positive power of two; otherwise, false.
@@ -213,11 +265,20 @@ private:
     /// Mask used to wrap the read and write index around.
     int32_t mCapacityMask;
 
+    // Keep each index on its own cache line so the producer and consumer
+    // do not contend. Padding is used instead of alignas so the buffer can
+    // still be allocated with plain new.
+    char mIndexPadding[64 - sizeof(int32_t)];
+
     /// Index into the buffer for the next read operation.
-    int32_t mReadIndex;
+    std::atomic<int32_t> mReadIndex;
+
+    char mReadPadding[64 - sizeof(std::atomic<int32_t>)];
 
     /// Index into the buffer for the next write operation.
-    int32_t mWriteIndex;
+    std::atomic<int32_t> mWriteIndex;
+
+    char mWritePadding[64 - sizeof(std::atomic<int32_t>)];
 
 #if defined(_WIN32) || defined(_WIN64)
     /// Windows handle to the memory mapped file.
@@ -28,9 +28,11 @@
 
 #include "Constants.h"
 #include "Log.h"
+#include "Tracer.h"
 
 #include <cstdio>
 #include <cstdarg>
+#include <cstring>
 
 #include <sqstdaux.h>
 
@@ -51,9 +53,66 @@ typedef void (*SQCOMPILERERROR)(HSQUIRRELVM /*v*/,const SQChar * /*desc*/,const
 #endif
 
 const SQInteger ONE_PARAM = 1;
+const SQInteger TWO_PARAMS = 2;
 const SQBool    NO_RETURN_VALUE = SQFalse;
 const SQBool    RAISE_ERROR = SQTrue;
 
+/**
+ * @internal
+ * Position in the bytecode being loaded by sq_readclosure.
+ */
+typedef struct
+{
+    const char *pData;
+    size_t size;
+    size_t offset;
+} BytecodeReader_t;
+
+static SQInteger ReadBytecode(SQUserPointer pUserData, SQUserPointer pDest,
+    SQInteger size)
+{
+    BytecodeReader_t *pReader = reinterpret_cast<BytecodeReader_t*>(
+        pUserData);
+
+    size_t remaining = pReader->size - pReader->offset;
+    size_t count = (size_t)size < remaining ? (size_t)size : remaining;
+
+    memcpy(pDest, pReader->pData + pReader->offset, count);
+    pReader->offset += count;
+
+    // Squirrel treats a short read as an error.
+    return (SQInteger)count;
+}
+
+static SQInteger WriteBytecode(SQUserPointer pUserData, SQUserPointer pSrc,
+    SQInteger size)
+{
+    std::vector<char> *pBytecode = reinterpret_cast<std::vector<char>*>(
+        pUserData);
+
+    const char *pBytes = reinterpret_cast<const char*>(pSrc);
+    pBytecode->insert(pBytecode->end(), pBytes, pBytes + size);
+
+    return size;
+}
+
+/**
+ * @internal
+ * 64-bit FNV-1a hash of a script.
+ */
+static uint64_t HashScript(const char *pData, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= (uint8_t)pData[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
 static void SquirrelPrintFunction(HSQUIRRELVM vm, const SQChar *szFormat, ...)
 {
     (void)vm;
@@ -132,36 +191,486 @@ ScriptEngine::ScriptEngine()
 
 ScriptEngine::~ScriptEngine()
 {
+    ClearCache();
+
     sq_close(mVM);
 }
 
 bool ScriptEngine::Eval(const String& source, const String& sourceName)
+{
+    TRACE_SCOPE("script");
+
+    bool result = false;
+
+    SQInteger top = sq_gettop(mVM);
+
+    if(PushScript(source.C(), source.Size(), sourceName, false))
+    {
+        result = CallScript();
+    }
+
+    sq_settop(mVM, top);
+
+    return result;
+}
+
+bool ScriptEngine::Compile(const String& source, const String& sourceName,
+    std::vector<char>& bytecode)
+{
+    bool result = false;
+
+    SQInteger top = sq_gettop(mVM);
+
+    bytecode.clear();
+
+    if(PushScript(source.C(), source.Size(), sourceName, false))
+    {
+        result = SQ_SUCCEEDED(sq_writeclosure(mVM, &WriteBytecode,
+            &bytecode));
+    }
+
+    sq_settop(mVM, top);
+
+    return result;
+}
+
+bool ScriptEngine::EvalBytecode(const std::vector<char>& bytecode,
+    const String& sourceName)
 {
     bool result = false;
 
     SQInteger top = sq_gettop(mVM);
 
-    if(SQ_SUCCEEDED(sq_compilebuffer(mVM, source.C(),
-        (SQInteger)source.Size(), sourceName.C(), 1)))
+    if(!bytecode.empty() && PushScript(&bytecode[0], bytecode.size(),
+        sourceName, true))
     {
-        sq_pushroottable(mVM);
+        result = CallScript();
+    }
+
+    sq_settop(mVM, top);
+
+    return result;
+}
+
+bool ScriptEngine::Call(const String& functionName)
+{
+    return CallFunction(functionName, nullptr);
+}
+
+bool ScriptEngine::Call(const String& functionName, ReadOnlyPacket& packet)
+{
+    return CallFunction(functionName, &packet);
+}
+
+bool ScriptEngine::CallFunction(const String& functionName,
+    ReadOnlyPacket *pPacket)
+{
+    TRACE_SCOPE("script");
+
+    bool result = false;
+
+    SQInteger top = sq_gettop(mVM);
 
-        if(SQ_SUCCEEDED(sq_call(mVM, ONE_PARAM,
-            NO_RETURN_VALUE, RAISE_ERROR)))
+    sq_pushroottable(mVM);
+    sq_pushstring(mVM, functionName.C(), (SQInteger)functionName.Size());
+
+    if(SQ_SUCCEEDED(sq_get(mVM, -2)))
+    {
+        if(nullptr == pPacket)
+        {
+            result = CallScript();
+        }
+        else
         {
-            result = true;
+            // Push the packet by pointer so the script works on it in place.
+            sq_pushroottable(mVM);
+            PushVar(mVM, pPacket);
+
+            result = SQ_SUCCEEDED(sq_call(mVM, TWO_PARAMS, NO_RETURN_VALUE,
+                RAISE_ERROR));
         }
     }
+    else
+    {
+        LOG_ERROR(String("Squirrel function not found: %1\n").Arg(
+            functionName));
+    }
 
     sq_settop(mVM, top);
 
     return result;
 }
 
+void ScriptEngine::ClearCache()
+{
+    for(auto& it : mScriptCache)
+    {
+        sq_release(mVM, &it.second.closure);
+    }
+
+    mScriptCache.clear();
+}
+
+bool ScriptEngine::PushScript(const char *pData, size_t size,
+    const String& sourceName, bool isBytecode)
+{
+    uint64_t hash = HashScript(pData, size);
+
+    // Only named scripts are cached. Unnamed ones are often generated so
+    // caching them by content would grow the cache without bound.
+    bool cache = !sourceName.IsEmpty();
+
+    // Source and bytecode never share a cache entry.
+    std::string key = isBytecode ? "bc:" : "src:";
+    key += sourceName.ToUtf8();
+
+    auto it = cache ? mScriptCache.find(key) : mScriptCache.end();
+
+    if(mScriptCache.end() != it)
+    {
+        if(it->second.hash == hash)
+        {
+            sq_pushobject(mVM, it->second.closure);
+
+            return true;
+        }
+
+        // The script changed so compile it again.
+        sq_release(mVM, &it->second.closure);
+        mScriptCache.erase(it);
+    }
+
+    bool loaded;
+
+    if(isBytecode)
+    {
+        BytecodeReader_t reader;
+        reader.pData = pData;
+        reader.size = size;
+        reader.offset = 0;
+
+        loaded = SQ_SUCCEEDED(sq_readclosure(mVM, &ReadBytecode, &reader));
+    }
+    else
+    {
+        loaded = SQ_SUCCEEDED(sq_compilebuffer(mVM, pData, (SQInteger)size,
+            sourceName.C(), 1));
+    }
+
+    if(loaded && cache)
+    {
+        CachedScript script;
+        script.hash = hash;
+
+        sq_resetobject(&script.closure);
+        sq_getstackobj(mVM, -1, &script.closure);
+        sq_addref(mVM, &script.closure);
+
+        mScriptCache[key] = script;
+    }
+
+    return loaded;
+}
+
+bool ScriptEngine::CallScript()
+{
+    sq_pushroottable(mVM);
+
+    return SQ_SUCCEEDED(sq_call(mVM, ONE_PARAM, NO_RETURN_VALUE,
+        RAISE_ERROR));
+}
+
+/**
+ * @internal
+ * Get the number of bytes a struct format describes. The format is a list
+ * of fields, each an optional repeat count followed by a type:
+ * @li b / B - signed / unsigned 8-bit integer
+ * @li h / H - signed / unsigned 16-bit integer
+ * @li i / I - signed / unsigned 32-bit integer
+ * @li q / Q - signed / unsigned 64-bit integer
+ * @li f - 32-bit float
+ * @li x - padding byte (skipped on read, zero on write)
+ * @li < / > - read the fields that follow as little / big endian
+ *
+ * Fields are little endian unless a '>' comes first. For example "<HI4x>H"
+ * is a little endian u16 and u32, 4 padding bytes and a big endian u16.
+ * @param szFormat Format to check.
+ * @param size Set to the size of the struct in bytes.
+ * @param fieldCount Set to the number of values (excluding padding).
+ * @returns true if the format is valid; false otherwise.
+ */
+static bool GetStructSize(const SQChar *szFormat, uint32_t& size,
+    uint32_t& fieldCount)
+{
+    size = 0;
+    fieldCount = 0;
+
+    for(const SQChar *c = szFormat; 0 != *c; ++c)
+    {
+        uint32_t count = 0;
+
+        while('0' <= *c && '9' >= *c)
+        {
+            count = count * 10 + (uint32_t)(*c - '0');
+            ++c;
+        }
+
+        if(0 == count)
+        {
+            count = 1;
+        }
+
+        uint32_t fieldSize;
+
+        switch(*c)
+        {
+            case 'b': case 'B': case 'x':
+                fieldSize = 1;
+                break;
+            case 'h': case 'H':
+                fieldSize = 2;
+                break;
+            case 'i': case 'I': case 'f':
+                fieldSize = 4;
+                break;
+            case 'q': case 'Q':
+                fieldSize = 8;
+                break;
+            case '<': case '>':
+                continue;
+            default:
+                return false;
+        }
+
+        size += fieldSize * count;
+
+        if('x' != *c)
+        {
+            fieldCount += count;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @internal
+ * Script form: packet.ReadStruct(format). Read every field described by
+ * the format in one call and return them as an array. Either the whole
+ * struct is read or (if the packet is too short) none of it is.
+ */
+static SQInteger ReadStruct(HSQUIRRELVM vm)
+{
+    ReadOnlyPacket *pPacket = Var<ReadOnlyPacket*>(vm, 1).value;
+    const SQChar *szFormat = nullptr;
+    uint32_t size, fieldCount;
+
+    if(nullptr == pPacket || SQ_FAILED(sq_getstring(vm, 2, &szFormat)) ||
+        !GetStructSize(szFormat, size, fieldCount))
+    {
+        return sq_throwerror(vm, "invalid struct format");
+    }
+
+    if(size > pPacket->Left())
+    {
+        return sq_throwerror(vm, "not enough data in the packet");
+    }
+
+    bool big = false;
+
+    sq_newarray(vm, 0);
+
+    for(const SQChar *c = szFormat; 0 != *c; ++c)
+    {
+        uint32_t count = 0;
+
+        while('0' <= *c && '9' >= *c)
+        {
+            count = count * 10 + (uint32_t)(*c - '0');
+            ++c;
+        }
+
+        for(uint32_t i = 0; i < (0 == count ? 1 : count); ++i)
+        {
+            switch(*c)
+            {
+                case '<':
+                    big = false;
+                    continue;
+                case '>':
+                    big = true;
+                    continue;
+                case 'x':
+                    pPacket->Skip(1);
+                    continue;
+                case 'b':
+                    sq_pushinteger(vm, pPacket->ReadS8());
+                    break;
+                case 'B':
+                    sq_pushinteger(vm, pPacket->ReadU8());
+                    break;
+                case 'h':
+                    sq_pushinteger(vm, big ? pPacket->ReadS16Big() :
+                        pPacket->ReadS16Little());
+                    break;
+                case 'H':
+                    sq_pushinteger(vm, big ? pPacket->ReadU16Big() :
+                        pPacket->ReadU16Little());
+                    break;
+                case 'i':
+                    sq_pushinteger(vm, (SQInteger)(big ?
+                        pPacket->ReadS32Big() : pPacket->ReadS32Little()));
+                    break;
+                case 'I':
+                    sq_pushinteger(vm, (SQInteger)(big ?
+                        pPacket->ReadU32Big() : pPacket->ReadU32Little()));
+                    break;
+                case 'q':
+                    sq_pushinteger(vm, (SQInteger)(big ?
+                        pPacket->ReadS64Big() : pPacket->ReadS64Little()));
+                    break;
+                case 'Q':
+                    sq_pushinteger(vm, (SQInteger)(big ?
+                        pPacket->ReadU64Big() : pPacket->ReadU64Little()));
+                    break;
+                case 'f':
+                    sq_pushfloat(vm, (SQFloat)pPacket->ReadFloat());
+                    break;
+            }
+
+            sq_arrayappend(vm, -2);
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @internal
+ * Script form: packet.WriteStruct(format, values). Write every field
+ * described by the format from an array of values in one call.
+ */
+static SQInteger WriteStruct(HSQUIRRELVM vm)
+{
+    Packet *pPacket = Var<Packet*>(vm, 1).value;
+    const SQChar *szFormat = nullptr;
+    uint32_t size, fieldCount;
+
+    if(nullptr == pPacket || SQ_FAILED(sq_getstring(vm, 2, &szFormat)) ||
+        !GetStructSize(szFormat, size, fieldCount))
+    {
+        return sq_throwerror(vm, "invalid struct format");
+    }
+
+    if(OT_ARRAY != sq_gettype(vm, 3) ||
+        (SQInteger)fieldCount != sq_getsize(vm, 3))
+    {
+        return sq_throwerror(vm, "values do not match the struct format");
+    }
+
+    if(size > (MAX_PACKET_SIZE - pPacket->Tell()))
+    {
+        return sq_throwerror(vm, "struct does not fit in the packet");
+    }
+
+    pPacket->Reserve(pPacket->Tell() + size);
+
+    bool big = false;
+    SQInteger index = 0;
+
+    for(const SQChar *c = szFormat; 0 != *c; ++c)
+    {
+        uint32_t count = 0;
+
+        while('0' <= *c && '9' >= *c)
+        {
+            count = count * 10 + (uint32_t)(*c - '0');
+            ++c;
+        }
+
+        for(uint32_t i = 0; i < (0 == count ? 1 : count); ++i)
+        {
+            if('<' == *c || '>' == *c)
+            {
+                big = '>' == *c;
+                continue;
+            }
+            else if('x' == *c)
+            {
+                pPacket->WriteU8(0);
+                continue;
+            }
+
+            SQInteger value = 0;
+            SQFloat floatValue = 0;
+
+            sq_pushinteger(vm, index++);
+            sq_get(vm, 3);
+
+            if('f' == *c)
+            {
+                sq_getfloat(vm, -1, &floatValue);
+            }
+            else
+            {
+                sq_getinteger(vm, -1, &value);
+            }
+
+            sq_pop(vm, 1);
+
+            switch(*c)
+            {
+                case 'b': case 'B':
+                    pPacket->WriteU8((uint8_t)value);
+                    break;
+                case 'h': case 'H':
+                    if(big)
+                    {
+                        pPacket->WriteU16Big((uint16_t)value);
+                    }
+                    else
+                    {
+                        pPacket->WriteU16Little((uint16_t)value);
+                    }
+                    break;
+                case 'i': case 'I':
+                    if(big)
+                    {
+                        pPacket->WriteU32Big((uint32_t)value);
+                    }
+                    else
+                    {
+                        pPacket->WriteU32Little((uint32_t)value);
+                    }
+                    break;
+                case 'q': case 'Q':
+                    if(big)
+                    {
+                        pPacket->WriteU64Big((uint64_t)value);
+                    }
+                    else
+                    {
+                        pPacket->WriteU64Little((uint64_t)value);
+                    }
+                    break;
+                case 'f':
+                    pPacket->WriteFloat((float)floatValue);
+                    break;
+            }
+        }
+    }
+
+    return 0;
+}
+
 void ScriptEngine::BindReadOnlyPacket()
 {
     Class<ReadOnlyPacket> readOnlyPacketBinding(mVM, "ReadOnlyPacket");
     readOnlyPacketBinding.Func("Size", &Packet::Size);
+    readOnlyPacketBinding.Func("Left", &Packet::Left);
+    readOnlyPacketBinding.Func("Tell", &Packet::Tell);
+    readOnlyPacketBinding.Func("Seek", &Packet::Seek);
+    readOnlyPacketBinding.SquirrelFunc("ReadStruct", &ReadStruct);
 
     RootTable(mVM).Bind("ReadOnlyPacket", readOnlyPacketBinding);
 }
@@ -171,6 +680,7 @@ void ScriptEngine::BindPacket()
     // Base class must be bound first.
     DerivedClass<Packet, ReadOnlyPacket> packetBinding(mVM, "Packet");
     packetBinding.Func("WriteBlank", &Packet::WriteBlank);
+    packetBinding.SquirrelFunc("WriteStruct", &WriteStruct);
 
     RootTable(mVM).Bind("Packet", packetBinding);
 }
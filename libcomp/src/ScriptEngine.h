@@ -33,22 +33,124 @@
 // Squirrel Includes
 #include <squirrel.h>
 
+// Standard C++11 Includes
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace libcomp
 {
 
+class ReadOnlyPacket;
+
 class ScriptEngine
 {
 public:
     ScriptEngine();
     ~ScriptEngine();
 
+    /**
+     * Run a script. The compiled script is cached by name and reused until
+     * the source changes. A script without a name is compiled every time.
+     * @param source Squirrel source code.
+     * @param sourceName Name (or path) of the script.
+     * @returns true if the script compiled and ran without error.
+     */
     bool Eval(const String& source, const String& sourceName = String());
 
+    /**
+     * Compile a script to Squirrel bytecode so it can be run later with
+     * @ref EvalBytecode without invoking the compiler (for example by
+     * precompiling scripts at build time or once at startup).
+     * @param source Squirrel source code.
+     * @param sourceName Name (or path) of the script.
+     * @param bytecode Set to the compiled script.
+     * @returns true if the script compiled.
+     */
+    bool Compile(const String& source, const String& sourceName,
+        std::vector<char>& bytecode);
+
+    /**
+     * Run a script that was compiled with @ref Compile. The loaded script
+     * is cached the same way as @ref Eval. The bytecode must come from a
+     * trusted source built with the same version of Squirrel.
+     * @param bytecode Compiled script.
+     * @param sourceName Name (or path) of the script.
+     * @returns true if the script loaded and ran without error.
+     */
+    bool EvalBytecode(const std::vector<char>& bytecode,
+        const String& sourceName = String());
+
+    /**
+     * Call a function in the root table with no arguments.
+     * @param functionName Name of the function.
+     * @returns true if the function exists and ran without error.
+     */
+    bool Call(const String& functionName);
+
+    /**
+     * Call a function in the root table with a packet as the only
+     * argument. The script sees the packet itself (not a copy) so it must
+     * not keep a reference to it after the call returns.
+     * @param functionName Name of the function.
+     * @param packet Packet to pass to the function.
+     * @returns true if the function exists and ran without error.
+     */
+    bool Call(const String& functionName, ReadOnlyPacket& packet);
+
+    /**
+     * Drop every cached script.
+     */
+    void ClearCache();
+
     void BindReadOnlyPacket();
     void BindPacket();
 
 private:
+    /**
+     * @internal
+     * Compiled script kept for reuse.
+     */
+    class CachedScript
+    {
+    public:
+        /// Hash of the source (or bytecode) the closure was built from.
+        uint64_t hash;
+
+        /// Closure that runs the script.
+        HSQOBJECT closure;
+    };
+
+    /**
+     * Push the closure for a script onto the stack, compiling (or loading)
+     * it only if it is not cached. Scripts without a name are not cached.
+     * @param pData Source code or bytecode.
+     * @param size Size of the source code or bytecode.
+     * @param sourceName Name (or path) of the script.
+     * @param isBytecode If @em pData is bytecode.
+     * @returns true if the closure was pushed.
+     */
+    bool PushScript(const char *pData, size_t size, const String& sourceName,
+        bool isBytecode);
+
+    /**
+     * Look up a function in the root table and call it.
+     * @param functionName Name of the function.
+     * @param pPacket Packet to pass as the only argument or nullptr to
+     * call the function with no arguments.
+     * @returns true if the function exists and ran without error.
+     */
+    bool CallFunction(const String& functionName, ReadOnlyPacket *pPacket);
+
+    /**
+     * Call the closure on the top of the stack with the root table.
+     * @returns true if the script ran without error.
+     */
+    bool CallScript();
+
     HSQUIRRELVM mVM;
+
+    std::unordered_map<std::string, CachedScript> mScriptCache;
 };
 
 } // namespace libcomp
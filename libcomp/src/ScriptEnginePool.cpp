@@ -0,0 +1,134 @@
+/**
+ * @file libcomp/src/ScriptEnginePool.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Pool of script engines with one engine per worker thread.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ScriptEnginePool.h"
+
+// libcomp Includes
+#include "Log.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <unordered_map>
+
+using namespace libcomp;
+
+/// Source of the unique ID of each pool.
+static std::atomic<uint64_t> gNextPoolID(0);
+
+ScriptEnginePool::ScriptEnginePool() : mEngineCount(0),
+    mID(++gNextPoolID), mLifetime(std::make_shared<bool>(true))
+{
+}
+
+bool ScriptEnginePool::AddModule(const String& source,
+    const String& sourceName)
+{
+    std::shared_ptr<Module> module = std::make_shared<Module>();
+    module->name = sourceName;
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(!mCompiler.Compile(source, sourceName, module->bytecode))
+    {
+        return false;
+    }
+
+    mModules.push_back(module);
+
+    return true;
+}
+
+ScriptEngine& ScriptEnginePool::GetThreadEngine()
+{
+    // Destroyed when the thread exits.
+    static thread_local std::unordered_map<uint64_t,
+        std::unique_ptr<ThreadEngine>> threadEngines;
+
+    auto it = threadEngines.find(mID);
+    bool created = false;
+
+    if(threadEngines.end() == it)
+    {
+        // Pool IDs are never reused so the engines of destroyed pools would
+        // otherwise stay until the thread exits.
+        for(auto dead = threadEngines.begin(); dead != threadEngines.end();)
+        {
+            if(dead->second->pool.expired())
+            {
+                dead = threadEngines.erase(dead);
+            }
+            else
+            {
+                ++dead;
+            }
+        }
+
+        std::unique_ptr<ThreadEngine> engine(new ThreadEngine);
+        engine->pool = mLifetime;
+
+        it = threadEngines.insert(std::make_pair(mID,
+            std::move(engine))).first;
+        created = true;
+    }
+
+    ThreadEngine *threadEngine = it->second.get();
+    std::vector<std::shared_ptr<Module>> modules;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        if(created)
+        {
+            mEngineCount++;
+        }
+
+        if(threadEngine->loadedCount < mModules.size())
+        {
+            modules.assign(mModules.begin() + (std::ptrdiff_t)
+                threadEngine->loadedCount, mModules.end());
+            threadEngine->loadedCount = mModules.size();
+        }
+    }
+
+    // Load outside the lock so other threads are not held up.
+    for(auto module : modules)
+    {
+        if(!threadEngine->engine.EvalBytecode(module->bytecode, module->name))
+        {
+            LOG_ERROR(String("Failed to load script module: %1\n").Arg(
+                module->name));
+        }
+    }
+
+    return threadEngine->engine;
+}
+
+size_t ScriptEnginePool::GetEngineCount() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mEngineCount;
+}
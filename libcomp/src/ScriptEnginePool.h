@@ -0,0 +1,171 @@
+/**
+ * @file libcomp/src/ScriptEnginePool.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Pool of script engines with one engine per worker thread.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_SCRIPTENGINEPOOL_H
+#define LIBCOMP_SRC_SCRIPTENGINEPOOL_H
+
+// libcomp Includes
+#include "ScriptEngine.h"
+
+// Standard C++11 Includes
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace libcomp
+{
+
+/**
+ * Pool of script engines with one engine for each thread that uses it. A
+ * Squirrel VM may only be used by one thread so rather than lock a shared
+ * engine each worker thread gets its own (with the packet bindings already
+ * loaded) the first time it runs a script. Modules added to the pool are
+ * compiled once and the bytecode is loaded into every engine before it next
+ * runs a script. The pool must outlive the jobs posted with @ref Run. The
+ * engines of a destroyed pool are freed the next time their thread creates
+ * an engine for another pool (or when it exits).
+ */
+class ScriptEnginePool
+{
+public:
+    /**
+     * Script job to run on a worker thread.
+     */
+    typedef std::function<void(ScriptEngine&)> Job_t;
+
+    /**
+     * Create a new pool.
+     */
+    ScriptEnginePool();
+
+    /**
+     * Compile a module and load it into every engine in the pool. Engines
+     * load the module the next time they are used by their thread.
+     * @param source Squirrel source of the module.
+     * @param sourceName Name of the module (used in error messages).
+     * @returns true if the module compiled; false otherwise.
+     */
+    bool AddModule(const String& source, const String& sourceName);
+
+    /**
+     * Get the engine for the calling thread, creating it the first time this
+     * is called on the thread. Any modules added since the last call are
+     * loaded first.
+     * @returns Engine for this thread.
+     */
+    ScriptEngine& GetThreadEngine();
+
+    /**
+     * Run a script job on the thread (or threads) that run @em service. This
+     * is normally the worker service that owns a connection so the job runs
+     * on the same thread as the connection's handlers.
+     * @param service Service to post the job to.
+     * @param job Job to run with the engine of that thread.
+     */
+    template<class Service>
+    void Run(Service& service, const Job_t& job)
+    {
+        service.post([this, job]()
+        {
+            job(GetThreadEngine());
+        });
+    }
+
+    /**
+     * Call a function in the root table on the thread that runs
+     * @em service.
+     * @param service Service to post the call to.
+     * @param functionName Name of the function to call.
+     */
+    template<class Service>
+    void Call(Service& service, const String& functionName)
+    {
+        Run(service, [functionName](ScriptEngine& engine)
+        {
+            (void)engine.Call(functionName);
+        });
+    }
+
+    /**
+     * Get the number of engines that have been created.
+     * @returns Number of engines.
+     */
+    size_t GetEngineCount() const;
+
+private:
+    /**
+     * @internal
+     * Compiled module shared by every engine.
+     */
+    class Module
+    {
+    public:
+        String name;
+        std::vector<char> bytecode;
+    };
+
+    /**
+     * @internal
+     * Engine owned by one thread and the number of modules it has loaded.
+     */
+    class ThreadEngine
+    {
+    public:
+        ThreadEngine() : loadedCount(0)
+        {
+        }
+
+        ScriptEngine engine;
+        size_t loadedCount;
+
+        /// Expires when the pool that owns the engine is destroyed.
+        std::weak_ptr<void> pool;
+    };
+
+    /// Engine only used to compile modules.
+    ScriptEngine mCompiler;
+
+    /// Modules in the order they were added.
+    std::vector<std::shared_ptr<Module>> mModules;
+
+    /// Number of engines created.
+    size_t mEngineCount;
+
+    /// Unique ID used to find this pool's engine for each thread.
+    uint64_t mID;
+
+    /// Only referenced weakly by the engines so a thread can tell the pool
+    /// was destroyed and drop its engine.
+    std::shared_ptr<void> mLifetime;
+
+    /// Lock for the compiler, module list and engine count.
+    mutable std::mutex mLock;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_SCRIPTENGINEPOOL_H
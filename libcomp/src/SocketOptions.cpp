@@ -0,0 +1,191 @@
+/**
+ * @file libcomp/src/SocketOptions.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Socket options applied to accepted and connected sockets.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SocketOptions.h"
+
+// libcomp Includes
+#include "Constants.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif // !WIN32
+
+using namespace libcomp;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+template<class T>
+static bool SetOption(T& socket, int level, int name, int value)
+{
+    return 0 == setsockopt(socket.native_handle(), level, name, &value,
+        (socklen_t)sizeof(value));
+}
+#endif // !WIN32
+
+SocketOptions_t SocketOptions::GetDefaults()
+{
+    SocketOptions_t options;
+    options.noDelay = true;
+    options.receiveBufferSize = 0;
+    options.sendBufferSize = 0;
+    options.keepAlive = true;
+    options.keepAliveIdle = TIMEOUT_KEEPALIVE;
+    options.keepAliveInterval = TIMEOUT_KEEPALIVE;
+    options.keepAliveCount = (TIMEOUT_SOCKET - TIMEOUT_KEEPALIVE) /
+        TIMEOUT_KEEPALIVE;
+    options.reusePort = true;
+    options.deferAccept = 0;
+    options.listenBacklog = SOCKET_LISTEN_BACKLOG;
+    options.ioUring = false;
+
+    return options;
+}
+
+bool SocketOptions::Apply(asio::ip::tcp::socket& socket,
+    const SocketOptions_t& options)
+{
+    asio::error_code errorCode;
+    bool result = true;
+
+    socket.set_option(asio::ip::tcp::no_delay(options.noDelay), errorCode);
+    result = result && !errorCode;
+
+    if(0 < options.receiveBufferSize)
+    {
+        socket.set_option(asio::socket_base::receive_buffer_size(
+            options.receiveBufferSize), errorCode);
+        result = result && !errorCode;
+    }
+
+    if(0 < options.sendBufferSize)
+    {
+        socket.set_option(asio::socket_base::send_buffer_size(
+            options.sendBufferSize), errorCode);
+        result = result && !errorCode;
+    }
+
+    socket.set_option(asio::socket_base::keep_alive(options.keepAlive),
+        errorCode);
+    result = result && !errorCode;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if(options.keepAlive)
+    {
+#ifdef TCP_KEEPIDLE
+        if(0 < options.keepAliveIdle)
+        {
+            result = SetOption(socket, IPPROTO_TCP, TCP_KEEPIDLE,
+                options.keepAliveIdle) && result;
+        }
+#endif // TCP_KEEPIDLE
+
+#ifdef TCP_KEEPINTVL
+        if(0 < options.keepAliveInterval)
+        {
+            result = SetOption(socket, IPPROTO_TCP, TCP_KEEPINTVL,
+                options.keepAliveInterval) && result;
+        }
+#endif // TCP_KEEPINTVL
+
+#ifdef TCP_KEEPCNT
+        if(0 < options.keepAliveCount)
+        {
+            result = SetOption(socket, IPPROTO_TCP, TCP_KEEPCNT,
+                options.keepAliveCount) && result;
+        }
+#endif // TCP_KEEPCNT
+    }
+#endif // !WIN32
+
+    return result;
+}
+
+bool SocketOptions::Listen(asio::ip::tcp::acceptor& acceptor,
+    const asio::ip::tcp::endpoint& endpoint, const SocketOptions_t& options,
+    bool reusePort, asio::error_code& errorCode)
+{
+    acceptor.open(endpoint.protocol(), errorCode);
+
+    if(!errorCode)
+    {
+        acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true),
+            errorCode);
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(SO_REUSEPORT)
+    if(!errorCode && reusePort && !SetOption(acceptor, SOL_SOCKET,
+        SO_REUSEPORT, 1))
+    {
+        errorCode = asio::error_code(errno, asio::error::get_system_category());
+    }
+#else // WIN32 || !SO_REUSEPORT
+    (void)reusePort;
+#endif // !WIN32 && SO_REUSEPORT
+
+    // Accepted sockets inherit the buffer sizes of the listen socket. Setting
+    // them here also lets the window scale be picked for the sizes.
+    if(!errorCode && 0 < options.receiveBufferSize)
+    {
+        acceptor.set_option(asio::socket_base::receive_buffer_size(
+            options.receiveBufferSize), errorCode);
+    }
+
+    if(!errorCode && 0 < options.sendBufferSize)
+    {
+        acceptor.set_option(asio::socket_base::send_buffer_size(
+            options.sendBufferSize), errorCode);
+    }
+
+    if(!errorCode)
+    {
+        acceptor.bind(endpoint, errorCode);
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(TCP_DEFER_ACCEPT)
+    // This is only a hint so don't fail if the kernel ignores it.
+    if(!errorCode && 0 < options.deferAccept)
+    {
+        (void)SetOption(acceptor, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+            options.deferAccept);
+    }
+#endif // !WIN32 && TCP_DEFER_ACCEPT
+
+    if(!errorCode)
+    {
+        acceptor.listen(0 < options.listenBacklog ? options.listenBacklog :
+            asio::socket_base::max_connections, errorCode);
+    }
+
+    if(errorCode && acceptor.is_open())
+    {
+        asio::error_code ignored;
+        acceptor.close(ignored);
+    }
+
+    return !errorCode;
+}
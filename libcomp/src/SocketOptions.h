@@ -0,0 +1,120 @@
+/**
+ * @file libcomp/src/SocketOptions.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Socket options applied to accepted and connected sockets.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_SOCKETOPTIONS_H
+#define LIBCOMP_SRC_SOCKETOPTIONS_H
+
+// Boost ASIO Includes
+#include "PushIgnore.h"
+#include <asio.hpp>
+#include "PopIgnore.h"
+
+namespace libcomp
+{
+
+/**
+ * Options applied to the sockets of a server or connection. Sizes and times
+ * of zero leave the kernel default in place. Options the platform does not
+ * support are ignored.
+ */
+typedef struct
+{
+    /// Disable Nagle's algorithm so small replies are sent right away.
+    bool noDelay;
+
+    /// Size of the kernel receive buffer (in bytes).
+    int receiveBufferSize;
+
+    /// Size of the kernel send buffer (in bytes).
+    int sendBufferSize;
+
+    /// Enable TCP keepalive probes.
+    bool keepAlive;
+
+    /// Idle time before the first keepalive probe (in seconds).
+    int keepAliveIdle;
+
+    /// Time between keepalive probes (in seconds).
+    int keepAliveInterval;
+
+    /// Number of unanswered probes before the connection is dropped.
+    int keepAliveCount;
+
+    /// Listen with one acceptor per worker thread (SO_REUSEPORT) so the
+    /// kernel spreads new connections across the workers.
+    bool reusePort;
+
+    /// Only accept a connection once the client has sent something or this
+    /// many seconds have passed (TCP_DEFER_ACCEPT). Only use this for a
+    /// protocol where the client speaks first.
+    int deferAccept;
+
+    /// Number of connections the kernel may queue before they are accepted.
+    int listenBacklog;
+
+    /// Run the sockets of each worker through an io_uring (see IoUring)
+    /// instead of the asio reactor. This is ignored if the kernel does not
+    /// support it.
+    bool ioUring;
+} SocketOptions_t;
+
+namespace SocketOptions
+{
+
+/**
+ * Get the default options: no Nagle, keepalive probes that give up at about
+ * @ref TIMEOUT_SOCKET, one acceptor per worker, a backlog of
+ * @ref SOCKET_LISTEN_BACKLOG and no io_uring.
+ * @returns Default options.
+ */
+SocketOptions_t GetDefaults();
+
+/**
+ * Apply the per connection options to an open socket.
+ * @param socket Accepted or connected socket.
+ * @param options Options to apply.
+ * @returns true if every supported option was set; false otherwise.
+ */
+bool Apply(asio::ip::tcp::socket& socket, const SocketOptions_t& options);
+
+/**
+ * Open, bind and listen on an acceptor with the listen options.
+ * @param acceptor Acceptor to open.
+ * @param endpoint Address and port to listen on.
+ * @param options Options to apply.
+ * @param reusePort Set SO_REUSEPORT so other acceptors can share the port.
+ * @param errorCode Set to the error if the acceptor could not listen.
+ * @returns true if the acceptor is listening; false otherwise.
+ */
+bool Listen(asio::ip::tcp::acceptor& acceptor,
+    const asio::ip::tcp::endpoint& endpoint, const SocketOptions_t& options,
+    bool reusePort, asio::error_code& errorCode);
+
+} // namespace SocketOptions
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_SOCKETOPTIONS_H
@@ -0,0 +1,142 @@
+/**
+ * @file libcomp/src/StartupProfile.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Runs and times the startup steps of a server.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StartupProfile.h"
+
+// libcomp Includes
+#include "Log.h"
+
+// Standard C++11 Includes
+#include <thread>
+
+using namespace libcomp;
+
+/**
+ * @internal
+ * Get the milliseconds since a point in time.
+ * @param start Point in time to measure from.
+ * @returns Milliseconds since @em start.
+ */
+static uint64_t MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+StartupProfile::StartupProfile(const String& name) : mName(name),
+    mStart(std::chrono::steady_clock::now()), mReady(false)
+{
+}
+
+void StartupProfile::AddStep(const String& name, const Step_t& step)
+{
+    mPending.push_back(std::make_pair(name, step));
+}
+
+bool StartupProfile::Run()
+{
+    std::vector<std::pair<String, Step_t>> pending;
+    pending.swap(mPending);
+
+    std::vector<StartupStep_t> results(pending.size());
+    std::vector<std::thread> threads;
+
+    for(size_t i = 0; i < pending.size(); ++i)
+    {
+        StartupStep_t& result = results[i];
+        const std::pair<String, Step_t>& step = pending[i];
+
+        threads.emplace_back([&result, &step]()
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            result.name = step.first;
+
+            try
+            {
+                result.success = step.second();
+            }
+            catch(...)
+            {
+                result.success = false;
+            }
+
+            result.duration = MillisecondsSince(start);
+        });
+    }
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    bool success = true;
+
+    // Logged in the order the steps were added so the output is stable.
+    for(auto& result : results)
+    {
+        if(result.success)
+        {
+            LOG_INFO(String("Startup step '%1' took %2 ms.\n").Arg(
+                result.name).Arg(result.duration));
+        }
+        else
+        {
+            LOG_CRITICAL(String("Startup step '%1' failed after %2 ms.\n").Arg(
+                result.name).Arg(result.duration));
+
+            success = false;
+        }
+
+        mSteps.push_back(result);
+    }
+
+    return success;
+}
+
+void StartupProfile::Ready()
+{
+    if(!mReady.exchange(true))
+    {
+        LOG_INFO(String("%1 is ready after %2 ms.\n").Arg(mName).Arg(
+            GetElapsed()));
+    }
+}
+
+bool StartupProfile::IsReady() const
+{
+    return mReady;
+}
+
+std::vector<StartupStep_t> StartupProfile::GetSteps() const
+{
+    return mSteps;
+}
+
+uint64_t StartupProfile::GetElapsed() const
+{
+    return MillisecondsSince(mStart);
+}
@@ -0,0 +1,134 @@
+/**
+ * @file libcomp/src/StartupProfile.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Runs and times the startup steps of a server.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_STARTUPPROFILE_H
+#define LIBCOMP_SRC_STARTUPPROFILE_H
+
+// libcomp Includes
+#include "String.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Time taken by one startup step.
+ */
+typedef struct
+{
+    /// Name of the step (for the log).
+    String name;
+
+    /// Time the step took (in milliseconds).
+    uint64_t duration;
+
+    /// If the step worked.
+    bool success;
+} StartupStep_t;
+
+/**
+ * Startup steps of a server. Steps that do not depend on each other are
+ * added and then run at the same time (each on its own thread) so the
+ * server starts as fast as its slowest step. The time of every step is
+ * logged and the server is only reported as ready once @ref Ready is
+ * called after everything it needs is done.
+ */
+class StartupProfile
+{
+public:
+    /// Work done by a step. It returns false if the server can't start.
+    typedef std::function<bool()> Step_t;
+
+    /**
+     * Create a profile and start the clock.
+     * @param name Name of the server (for the log).
+     */
+    explicit StartupProfile(const String& name);
+
+    /**
+     * Add a step for the next @ref Run.
+     * @param name Name of the step (for the log).
+     * @param step Work to do. It must not depend on any other step of the
+     *   same run.
+     */
+    void AddStep(const String& name, const Step_t& step);
+
+    /**
+     * Run the added steps at the same time and wait for all of them.
+     * @returns true if every step worked.
+     */
+    bool Run();
+
+    /**
+     * Log that the server is ready and how long startup took.
+     */
+    void Ready();
+
+    /**
+     * Check if @ref Ready was called. This may be called from any thread.
+     * @returns true if the server is ready.
+     */
+    bool IsReady() const;
+
+    /**
+     * Get the steps that have finished.
+     * @returns Time taken by each finished step in the order they were added.
+     */
+    std::vector<StartupStep_t> GetSteps() const;
+
+    /**
+     * Get the time since the profile was created.
+     * @returns Time since the profile was created (in milliseconds).
+     */
+    uint64_t GetElapsed() const;
+
+private:
+    /// Name of the server.
+    String mName;
+
+    /// When the profile was created.
+    std::chrono::steady_clock::time_point mStart;
+
+    /// Steps waiting for the next run.
+    std::vector<std::pair<String, Step_t>> mPending;
+
+    /// Steps that have finished.
+    std::vector<StartupStep_t> mSteps;
+
+    /// If the server is ready.
+    std::atomic<bool> mReady;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_STARTUPPROFILE_H
@@ -0,0 +1,200 @@
+/**
+ * @file libcomp/src/StatementCache.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief LRU cache of prepared database statements.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_STATEMENTCACHE_H
+#define LIBCOMP_SRC_STATEMENTCACHE_H
+
+// libcomp Includes
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Counters describing how well a database's prepared statement cache works.
+ * The hit rate is hits / (hits + misses).
+ */
+typedef struct
+{
+    /// Number of queries that reused a cached statement.
+    uint64_t hits;
+
+    /// Number of queries that had to prepare their statement.
+    uint64_t misses;
+
+    /// Number of statements dropped to make room for newer ones.
+    uint64_t evictions;
+
+    /// Number of statements currently in the cache.
+    uint64_t size;
+} StatementCacheStats_t;
+
+/**
+ * Thread-safe cache of prepared statements keyed by their query text. When
+ * the cache is full the least recently used statement is dropped. Statements
+ * are held by a std::shared_ptr whose deleter frees the driver object so a
+ * statement that is dropped while in use stays valid until it is released.
+ */
+template<class T>
+class StatementCache
+{
+public:
+    /**
+     * Create a new cache.
+     * @param capacity Maximum number of statements to keep.
+     */
+    explicit StatementCache(size_t capacity = PREPARED_STATEMENT_CACHE_SIZE) :
+        mCapacity(capacity), mHits(0), mMisses(0), mEvictions(0)
+    {
+    }
+
+    /**
+     * Find the statement for a query. This counts as a hit or a miss.
+     * @param query Query text the statement was prepared from.
+     * @param remove If the statement should be taken out of the cache (for
+     * statements that can only be used by one query at a time).
+     * @returns Cached statement or nullptr if there is none.
+     */
+    std::shared_ptr<T> Find(const std::string& query, bool remove = false)
+    {
+        std::shared_ptr<T> statement;
+
+        std::lock_guard<std::mutex> guard(mLock);
+
+        auto it = mIndex.find(query);
+
+        if(mIndex.end() == it)
+        {
+            mMisses++;
+        }
+        else
+        {
+            mHits++;
+
+            statement = it->second->second;
+
+            if(remove)
+            {
+                mEntries.erase(it->second);
+                mIndex.erase(it);
+            }
+            else
+            {
+                // Move the entry to the front (most recently used).
+                mEntries.splice(mEntries.begin(), mEntries, it->second);
+            }
+        }
+
+        return statement;
+    }
+
+    /**
+     * Add a statement to the cache. If the query is already cached the
+     * existing statement is kept.
+     * @param query Query text the statement was prepared from.
+     * @param statement Statement to add.
+     */
+    void Insert(const std::string& query, const std::shared_ptr<T>& statement)
+    {
+        if(0 == mCapacity || !statement)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(mLock);
+
+        if(mIndex.end() != mIndex.find(query))
+        {
+            return;
+        }
+
+        while(mEntries.size() >= mCapacity)
+        {
+            mIndex.erase(mEntries.back().first);
+            mEntries.pop_back();
+            mEvictions++;
+        }
+
+        mEntries.push_front(std::make_pair(query, statement));
+        mIndex[query] = mEntries.begin();
+    }
+
+    /**
+     * Remove every statement from the cache.
+     */
+    void Clear()
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        mIndex.clear();
+        mEntries.clear();
+    }
+
+    /**
+     * Get the current cache counters.
+     * @returns Cache counters.
+     */
+    StatementCacheStats_t GetStats() const
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        StatementCacheStats_t stats;
+        stats.hits = mHits;
+        stats.misses = mMisses;
+        stats.evictions = mEvictions;
+        stats.size = mEntries.size();
+
+        return stats;
+    }
+
+private:
+    typedef std::list<std::pair<std::string, std::shared_ptr<T>>> List_t;
+
+    size_t mCapacity;
+
+    List_t mEntries;
+    std::unordered_map<std::string, typename List_t::iterator> mIndex;
+
+    uint64_t mHits;
+    uint64_t mMisses;
+    uint64_t mEvictions;
+
+    mutable std::mutex mLock;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_STATEMENTCACHE_H
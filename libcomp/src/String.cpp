@@ -26,7 +26,8 @@
 
 #include "String.h"
 
-#include <regex_ext>
+#include "Utf8.h"
+
 #include <algorithm>
 #include <functional>
 #include <iostream>
@@ -35,12 +36,92 @@
 #include <iomanip>
 #include <cctype>
 #include <locale>
-#include <regex>
 
 using namespace libcomp;
 
 bool String::mBadArgumentReporting = true;
 
+/**
+ * @internal
+ * Strings with at least this many characters (that are not pure ASCII) get
+ * an index of code point offsets.
+ */
+static const size_t INDEX_MIN_LENGTH = 64;
+
+/**
+ * @internal
+ * Number of characters between entries of the code point index.
+ */
+static const size_t INDEX_STRIDE = 16;
+
+/**
+ * @internal
+ * Get the number of bytes of a UTF-8 sequence from its first byte.
+ * @param lead First byte of the sequence.
+ * @returns Number of bytes in the sequence.
+ */
+static size_t SequenceSize(char lead)
+{
+    size_t size = 1;
+
+    if(0 == (lead & 0x80))
+    {
+        size = 1;
+    }
+    else if(0xC0 == (lead & 0xE0))
+    {
+        size = 2;
+    }
+    else if(0xE0 == (lead & 0xF0))
+    {
+        size = 3;
+    }
+    else if(0xF0 == (lead & 0xF8))
+    {
+        size = 4;
+    }
+
+    return size;
+}
+
+/**
+ * @internal
+ * Skip a number of code points.
+ * @param pPosition First byte of a code point.
+ * @param pEnd End of the data.
+ * @param count Number of code points to skip.
+ * @returns Pointer to the code point (or the end).
+ */
+static const char* SkipCodePoints(const char *pPosition, const char *pEnd,
+    size_t count)
+{
+    while(0 < count && pPosition < pEnd)
+    {
+        pPosition++;
+
+        // Skip the continuation bytes.
+        while(pPosition < pEnd && 0x80 == (*pPosition & 0xC0))
+        {
+            pPosition++;
+        }
+
+        count--;
+    }
+
+    return pPosition;
+}
+
+/**
+ * @internal
+ * Strings with at most this many bytes are stored in the string object
+ * itself. This fits in the small buffer of common std::string
+ * implementations so copying one does not allocate.
+ */
+static const size_t INLINE_MAX_SIZE = 15;
+
+static_assert(INLINE_MAX_SIZE < INDEX_MIN_LENGTH,
+    "Strings with an index must use shared data");
+
 /**
  * @internal
  * Shared string data oject.
@@ -48,82 +129,133 @@ bool String::mBadArgumentReporting = true;
 class String::StringData
 {
 public:
-    /**
-     * Construct an empty data object.
-     */
-    StringData();
-
-    /**
-     * Perform a deep copy of the string data.
-     * @param other Data object to copy the data from.
-     */
-    StringData(const StringData& other);
-
     /**
      * Construct a data object with the given data.
-     * @param str String data to use.
-     * @param length Number of UTF-8 characters in the data.
+     * @param str String data to take.
      */
-    StringData(const std::string& str, size_t length);
-
-    /// Number of UTF-8 characters in the data.
-    size_t mLength;
+    explicit StringData(std::string&& str);
 
     /// UTF-8 encoded string data.
     std::string mString;
+
+    /// Byte offset of every @ref INDEX_STRIDE th character (built when first
+    /// needed). Any change to the data must reset this.
+    std::shared_ptr<const std::vector<size_t>> mIndex;
 };
 
-String::StringData::StringData() : mLength(0)
+String::StringData::StringData(std::string&& str) : mString(std::move(str))
 {
 }
 
-String::StringData::StringData(const StringData& other) :
-    mLength(other.mLength), mString(other.mString)
+String::String() : mLength(0)
 {
 }
 
-String::StringData::StringData(const std::string& str, size_t length) :
-    mLength(length), mString(str)
+String::String(const String& other) : mLength(other.mLength),
+    mInline(other.mInline), d(other.d)
 {
 }
 
-String::String() : d(new String::StringData)
+String::String(String&& other) noexcept : mLength(other.mLength),
+    mInline(std::move(other.mInline)), d(std::move(other.d))
 {
+    other.mLength = 0;
+    other.mInline.clear();
 }
 
-String::String(const String& other) : d(other.d)
+String::String(const std::string& str) : mLength(0)
 {
+    Assign(std::string(str), CalculateLength(str));
 }
 
-String::String(const std::string& str) : d(new String::StringData)
+String::String(std::string&& str) : mLength(0)
 {
-    d->mString = str;
-    d->mLength = CalculateLength(d->mString);
+    size_t length = CalculateLength(str);
+
+    Assign(std::move(str), length);
 }
 
-String::String(const char *szString) : d(new String::StringData)
+String::String(const char *szString) : mLength(0)
 {
-    d->mString = std::string(szString);
-    d->mLength = CalculateLength(d->mString);
+    std::string str(szString);
+    size_t length = CalculateLength(str);
+
+    Assign(std::move(str), length);
 }
 
-String::String(const char *szString, size_t bytes) : d(new String::StringData)
+String::String(const char *szString, size_t bytes) : mLength(0)
 {
-    d->mString = std::string(szString, bytes);
-    d->mLength = CalculateLength(d->mString);
+    std::string str(szString, bytes);
+    size_t length = CalculateLength(str);
+
+    Assign(std::move(str), length);
 }
 
 String::String(const char *szString, size_t offset, size_t bytes) :
-    d(new String::StringData)
+    mLength(0)
 {
-    d->mString = std::string(szString, offset, bytes);
-    d->mLength = CalculateLength(d->mString);
+    std::string str(szString, offset, bytes);
+    size_t length = CalculateLength(str);
+
+    Assign(std::move(str), length);
 }
 
-String::String(size_t bytes, char character) : d(new String::StringData)
+String::String(size_t bytes, char character) : mLength(0)
 {
-    d->mString = std::string(bytes, character);
-    d->mLength = CalculateLength(d->mString);
+    std::string str(bytes, character);
+    size_t length = CalculateLength(str);
+
+    Assign(std::move(str), length);
+}
+
+String::String(std::string&& str, size_t length) : mLength(0)
+{
+    Assign(std::move(str), length);
+}
+
+String& String::operator=(const String& other)
+{
+    mLength = other.mLength;
+    mInline = other.mInline;
+    d = other.d;
+
+    return *this;
+}
+
+String& String::operator=(String&& other) noexcept
+{
+    if(this != &other)
+    {
+        mLength = other.mLength;
+        mInline = std::move(other.mInline);
+        d = std::move(other.d);
+
+        other.mLength = 0;
+        other.mInline.clear();
+    }
+
+    return *this;
+}
+
+void String::Assign(std::string&& str, size_t length)
+{
+    mLength = length;
+
+    if(INLINE_MAX_SIZE >= str.size())
+    {
+        mInline = std::move(str);
+        d.reset();
+    }
+    else
+    {
+        d = std::make_shared<StringData>(std::move(str));
+        mInline.clear();
+    }
+}
+
+const std::string& String::Raw() const
+{
+    return d ? d->mString : mInline;
 }
 
 String String::Left(size_t length) const
@@ -132,29 +264,13 @@ String String::Left(size_t length) const
     {
         return String();
     }
-    else if(length >= d->mLength)
+    else if(length >= mLength)
     {
         return String(*this);
     }
     else
     {
-        std::string::const_iterator it;
-
-        size_t len = length + 1;
-
-        for(it = d->mString.cbegin(); 0 < len &&
-            it != d->mString.cend(); ++it)
-        {
-            if((*it & 0xC0) != 0x80)
-            {
-                len--;
-            }
-        }
-
-        StringData *pData = new StringData(std::string(
-            d->mString.cbegin(), --it), length);
-
-        return String(pData);
+        return String(Raw().substr(0, ByteOffset(length)), length);
     }
 }
 
@@ -164,18 +280,23 @@ String String::Right(size_t length) const
     {
         return String();
     }
-    else if(length >= d->mLength)
+    else if(length >= mLength)
     {
         return String(*this);
     }
+    else if(mLength == Raw().size())
+    {
+        // Pure ASCII.
+        return String(Raw().substr(Raw().size() - length), length);
+    }
     else
     {
         std::string::const_reverse_iterator it;
 
         size_t len = length;
 
-        for(it = d->mString.crbegin(); 0 < len &&
-            it != d->mString.crend(); ++it)
+        for(it = Raw().crbegin(); 0 < len &&
+            it != Raw().crend(); ++it)
         {
             if((*it & 0xC0) != 0x80)
             {
@@ -183,10 +304,7 @@ String String::Right(size_t length) const
             }
         }
 
-        StringData *pData = new StringData(std::string(it.base(),
-            d->mString.cend()), length);
-
-        return String(pData);
+        return String(std::string(it.base(), Raw().cend()), length);
     }
 }
 
@@ -240,7 +358,7 @@ void String::Truncate(size_t position)
 
 String String::Mid(size_t position, size_t count) const
 {
-    if(position >= d->mLength)
+    if(position >= mLength)
     {
         return String();
     }
@@ -249,116 +367,198 @@ String String::Mid(size_t position, size_t count) const
         size_t length;
 
         // Sanity check the count does not go past the end of the string.
-        if((count + position) >= d->mLength)
+        if((count + position) >= mLength)
         {
             count = 0;
 
-            length = d->mLength - position;
+            length = mLength - position;
         }
         else
         {
             length = count;
         }
 
-        std::string::const_iterator begin;
+        const char *pData = Raw().c_str();
+        const char *pEnd = pData + Raw().size();
+        const char *pBegin = pData + ByteOffset(position);
+        const char *pFinish = pEnd;
 
-        position++;
-
-        for(begin = d->mString.cbegin(); 0 < position &&
-            begin != d->mString.cend(); ++begin)
+        if(0 != count)
         {
-            if((*begin & 0xC0) != 0x80)
+            if(mLength == Raw().size())
             {
-                position--;
+                pFinish = pBegin + count;
             }
-        }
-
-        std::string::const_iterator end;
-
-        if(0 != count)
-        {
-            for(end = begin; 0 < count && end != d->mString.cend(); ++end)
+            else
             {
-                if((*end & 0xC0) != 0x80)
-                {
-                    count--;
-                }
+                pFinish = SkipCodePoints(pBegin, pEnd, count);
             }
-
-            --end;
-        }
-        else
-        {
-            end = d->mString.cend();
         }
 
-        StringData *pData = new StringData(std::string(--begin, end), length);
-
-        return String(pData);
+        return String(std::string(pBegin, pFinish), length);
     }
 }
 
 String::CodePoint String::At(size_t position) const
 {
-    if(position >= d->mLength)
+    if(position >= mLength)
     {
         return 0;
     }
-    else
+
+    const char *pData = Raw().c_str();
+
+    return *CodePointIterator(pData + ByteOffset(position),
+        pData + Raw().size());
+}
+
+String::CodePointIterator String::begin() const
+{
+    const char *pData = Raw().c_str();
+
+    return CodePointIterator(pData, pData + Raw().size());
+}
+
+String::CodePointIterator String::end() const
+{
+    const char *pEnd = Raw().c_str() + Raw().size();
+
+    return CodePointIterator(pEnd, pEnd);
+}
+
+size_t String::ByteOffset(size_t position) const
+{
+    size_t size = Raw().size();
+
+    if(position >= mLength)
+    {
+        return size;
+    }
+    else if(mLength == size)
     {
-        std::string::const_iterator begin;
+        // Pure ASCII.
+        return position;
+    }
 
-        position++;
+    const char *pData = Raw().c_str();
+    const char *pStart = pData;
 
-        for(begin = d->mString.cbegin(); 0 < position &&
-            begin != d->mString.cend(); ++begin)
+    if(INDEX_MIN_LENGTH <= mLength)
+    {
+        std::shared_ptr<const std::vector<size_t>> index =
+            std::atomic_load(&d->mIndex);
+
+        // Two threads may build the index at the same time; they build the
+        // same thing so either one may win.
+        if(!index)
         {
-            if((*begin & 0xC0) != 0x80)
+            std::shared_ptr<std::vector<size_t>> offsets(
+                new std::vector<size_t>);
+            offsets->reserve(mLength / INDEX_STRIDE + 1);
+
+            const char *pEnd = pData + size;
+
+            for(const char *p = pData; p < pEnd; p = SkipCodePoints(p, pEnd,
+                INDEX_STRIDE))
             {
-                position--;
+                offsets->push_back((size_t)(p - pData));
             }
+
+            index = offsets;
+
+            std::atomic_store(&d->mIndex, index);
         }
 
-        CodePoint cp = 0;
+        pStart = pData + (*index)[position / INDEX_STRIDE];
+        position %= INDEX_STRIDE;
+    }
+
+    return (size_t)(SkipCodePoints(pStart, pData + size, position) - pData);
+}
 
-        char bytes[4];
+String::CodePointIterator::CodePointIterator(const char *pPosition,
+    const char *pEnd) : mPosition(pPosition), mEnd(pEnd)
+{
+}
 
-        bytes[0] = *(--begin);
+String::CodePoint String::CodePointIterator::operator*() const
+{
+    CodePoint cp = 0;
 
-        if(0 == (bytes[0] & 0x80))
+    if(mPosition < mEnd)
+    {
+        size_t size = SequenceSize(*mPosition);
+
+        // Don't read past the end of a truncated sequence.
+        if((size_t)(mEnd - mPosition) < size)
         {
-            cp = bytes[0] & 0x7F;
+            size = (size_t)(mEnd - mPosition);
         }
-        else if(0xC0 == (bytes[0] & 0xE0))
-        {
-            bytes[1] = *(++begin);
 
-            cp = (CodePoint)(((bytes[0] & 0x1F) << 6) |
-                (bytes[1] & 0x3F));
-        }
-        else if(0xE0 == (bytes[0] & 0xF0))
-        {
-            bytes[1] = *(++begin);
-            bytes[2] = *(++begin);
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(mPosition);
 
-            cp = (CodePoint)(((bytes[0] & 0x1F) << 12) |
-                ((bytes[1] & 0x3F) << 6) |
-                (bytes[2] & 0x3F));
-        }
-        else
+        switch(size)
         {
-            bytes[1] = *(++begin);
-            bytes[2] = *(++begin);
-            bytes[3] = *(++begin);
-
-            cp = (CodePoint)(((bytes[0] & 0x0F) << 18) |
-                ((bytes[1] & 0x3F) << 12) |
-                ((bytes[2] & 0x3F) << 6) |
-                (bytes[3] & 0x3F));
+            case 1:
+                cp = bytes[0] & 0x7F;
+                break;
+            case 2:
+                cp = (CodePoint)(((bytes[0] & 0x1F) << 6) |
+                    (bytes[1] & 0x3F));
+                break;
+            case 3:
+                cp = (CodePoint)(((bytes[0] & 0x0F) << 12) |
+                    ((bytes[1] & 0x3F) << 6) |
+                    (bytes[2] & 0x3F));
+                break;
+            default:
+                cp = (CodePoint)(((bytes[0] & 0x07) << 18) |
+                    ((bytes[1] & 0x3F) << 12) |
+                    ((bytes[2] & 0x3F) << 6) |
+                    (bytes[3] & 0x3F));
+                break;
         }
-
-        return cp;
     }
+
+    return cp;
+}
+
+String::CodePointIterator& String::CodePointIterator::operator++()
+{
+    mPosition = SkipCodePoints(mPosition, mEnd, 1);
+
+    return *this;
+}
+
+String::CodePointIterator String::CodePointIterator::operator++(int)
+{
+    CodePointIterator copy(*this);
+
+    mPosition = SkipCodePoints(mPosition, mEnd, 1);
+
+    return copy;
+}
+
+bool String::CodePointIterator::operator==(
+    const CodePointIterator& other) const
+{
+    return mPosition == other.mPosition;
+}
+
+bool String::CodePointIterator::operator!=(
+    const CodePointIterator& other) const
+{
+    return mPosition != other.mPosition;
+}
+
+bool String::CodePointIterator::AtEnd() const
+{
+    return mPosition >= mEnd;
+}
+
+const char* String::CodePointIterator::Position() const
+{
+    return mPosition;
 }
 
 std::list<String> String::Split(const String& delimiter) const
@@ -366,8 +566,8 @@ std::list<String> String::Split(const String& delimiter) const
     // Used with fixes and integration.
     // Source: http://stackoverflow.com/questions/14265581/
 
-    const std::string& str = d->mString;
-    const std::string& delim = delimiter.d->mString;
+    const std::string& str = Raw();
+    const std::string& delim = delimiter.Raw();
 
     std::list<String> list;
 
@@ -388,50 +588,64 @@ std::list<String> String::Split(const String& delimiter) const
 
 bool String::operator==(const char *szString) const
 {
-    return std::string(szString) == d->mString;
+    return std::string(szString) == Raw();
 }
 
 bool String::operator==(const std::string& other) const
 {
-    return other == d->mString;
+    return other == Raw();
 }
 
 bool String::operator==(const String& other) const
 {
-    return (d == other.d) || (d->mString == other.d->mString);
+    return (d && d == other.d) || (Raw() == other.Raw());
 }
 
 bool String::operator!=(const char *szString) const
 {
-    return std::string(szString) != d->mString;
+    return std::string(szString) != Raw();
 }
 
 bool String::operator!=(const std::string& other) const
 {
-    return other != d->mString;
+    return other != Raw();
 }
 
 bool String::operator!=(const String& other) const
 {
-    return (d != other.d) && (d->mString != other.d->mString);
+    return !(*this == other);
 }
 
 String& String::Append(const String& other)
 {
-    Detatch();
-
-    d->mLength += other.d->mLength;
-    d->mString += other.d->mString;
+    if(d && d.unique())
+    {
+        // Nobody else sees the data so change it in place.
+        mLength += other.mLength;
+        d->mString += other.Raw();
+        d->mIndex.reset();
+    }
+    else
+    {
+        Assign(Raw() + other.Raw(), mLength + other.mLength);
+    }
 
     return *this;
 }
 
 String& String::Prepend(const String& other)
 {
-    Detatch();
-
-    d->mLength += other.d->mLength;
-    d->mString = other.d->mString + d->mString;
+    if(d && d.unique())
+    {
+        // Nobody else sees the data so change it in place.
+        mLength += other.mLength;
+        d->mString.insert(0, other.Raw());
+        d->mIndex.reset();
+    }
+    else
+    {
+        Assign(other.Raw() + Raw(), mLength + other.mLength);
+    }
 
     return *this;
 }
@@ -443,86 +657,66 @@ String& String::operator+=(const String& other)
 
 std::string String::ToUtf8() const
 {
-    return d->mString;
-}
-
-String::String(StringData *pData) : d(pData)
-{
-}
-
-void String::Detatch()
-{
-    if(!d.unique())
-    {
-        d = std::shared_ptr<StringData>(new StringData(*d));
-    }
+    return Raw();
 }
 
 size_t String::CalculateLength(const std::string& str) const
 {
-    size_t length = 0;
-
-    for(auto it = str.cbegin(); it != str.cend(); ++it)
-    {
-        if((*it & 0xC0) != 0x80)
-        {
-            length++;
-        }
-    }
-
-    return length;
+    return Utf8::CountCodePoints(str.c_str(), str.size());
 }
 
 size_t String::Length() const
 {
-    return d->mLength;
+    return mLength;
 }
 
 size_t String::Size() const
 {
-    return d->mString.size();
+    return Raw().size();
 }
 
 bool String::IsEmpty() const
 {
-    return 0 == d->mLength;
+    return 0 == mLength;
 }
 
 void String::Clear()
 {
-    d = std::shared_ptr<StringData>(new StringData);
+    mLength = 0;
+    mInline.clear();
+    d.reset();
 }
 
 bool String::Contains(const String& other) const
 {
-    return std::string::npos != d->mString.find(other.d->mString);
+    return std::string::npos != Raw().find(other.Raw());
 }
 
 String String::LeftTrimmed() const
 {
-    std::string s = d->mString;
+    std::string s = Raw();
 
     // Source: http://stackoverflow.com/questions/216823/
     s.erase(s.begin(), std::find_if(s.begin(), s.end(),
         std::not1(std::ptr_fun<int, int>(std::isspace))));
 
-    return String(s);
+    return String(std::move(s));
 }
 
 String String::RightTrimmed() const
 {
-    std::string s = d->mString;
+    std::string s = Raw();
 
     // Source: http://stackoverflow.com/questions/216823/
     s.erase(std::find_if(s.rbegin(), s.rend(),
         std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
 
-    return String(s);
+    return String(std::move(s));
 }
 
 String String::Trimmed() const
 {
-    std::string s = d->mString;
+    std::string s = Raw();
 
     // Source: http://stackoverflow.com/questions/216823/
 
@@ -534,14 +728,14 @@ String String::Trimmed() const
     s.erase(std::find_if(s.rbegin(), s.rend(),
         std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
 
-    return String(s);
+    return String(std::move(s));
 }
 
 String String::Replace(const String& _search, const String& _replace) const
 {
-    std::string search = _search.d->mString;
-    std::string replace = _replace.d->mString;
-    std::string subject = d->mString;
+    const std::string& search = _search.Raw();
+    const std::string& replace = _replace.Raw();
+    std::string subject = Raw();
 
     if(!search.empty())
     {
@@ -555,39 +749,112 @@ String String::Replace(const String& _search, const String& _replace) const
         }
     }
 
-    return String(subject);
+    return String(std::move(subject));
 }
 
 String String::Arg(const String& a) const
 {
-    int matchCount = 0;
+    return Format(&a, 1);
+}
 
-    auto callback = [&](const std::smatch& match)
+String String::Arg(const std::vector<String>& args) const
+{
+    if(args.empty())
     {
-        int n = std::atoi(match.str(1).c_str());
+        return *this;
+    }
 
-        if(1 == n)
+    return Format(&args[0], args.size());
+}
+
+/**
+ * @internal
+ * Check if a character is a word character for the end of an argument. The
+ * argument must end on a word boundary so "%1a" is not an argument.
+ * @param c Character after the digits of the argument.
+ * @returns true if the character would continue the word.
+ */
+static bool IsWordCharacter(char c)
+{
+    return ('a' <= c && 'z' >= c) || ('A' <= c && 'Z' >= c) ||
+        ('0' <= c && '9' >= c) || '_' == c;
+}
+
+String String::Format(const String *pArgs, size_t count) const
+{
+    const std::string& format = Raw();
+    std::vector<bool> found(count, false);
+    std::string s;
+
+    size_t argumentsSize = 0;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        argumentsSize += pArgs[i].Raw().size();
+    }
+
+    s.reserve(format.size() + argumentsSize);
+
+    size_t last = 0;
+    size_t pos = 0;
+
+    // An argument is a % followed by one or two digits (and a word
+    // boundary); anything else is copied as is.
+    while(std::string::npos != (pos = format.find('%', pos)))
+    {
+        size_t digits = 0;
+        int n = 0;
+
+        while(2 > digits && format.size() > (pos + 1 + digits) &&
+            '0' <= format[pos + 1 + digits] && '9' >= format[pos + 1 + digits])
         {
-            matchCount++;
+            n = n * 10 + (format[pos + 1 + digits] - '0');
+            digits++;
+        }
 
-            return a.d->mString;
+        size_t end = pos + 1 + digits;
+
+        if(0 == digits || (format.size() > end &&
+            IsWordCharacter(format[end])))
+        {
+            pos++;
+            continue;
+        }
+
+        s.append(format, last, pos - last);
+
+        if(1 <= n && (size_t)n <= count)
+        {
+            found[(size_t)(n - 1)] = true;
+
+            s.append(pArgs[n - 1].Raw());
         }
         else
         {
-            return "%" + std::to_string(n - 1);
+            // Same as shifting down once per argument (%0 only once since
+            // the result is no longer an argument).
+            s.push_back('%');
+            s.append(std::to_string(1 > n ? n - 1 : n - (int)count));
         }
-    };
 
-    std::regex re("\\%([0-9]{1,2})\\b");
-    std::string s = std::regex_replace(d->mString.cbegin(),
-        d->mString.cend(), re, callback);
+        last = pos = end;
+    }
 
-    if(0 == matchCount && mBadArgumentReporting)
+    s.append(format, last, std::string::npos);
+
+    if(mBadArgumentReporting)
     {
-        std::cerr << "Argument not found in string: " << s << std::endl;
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(!found[i])
+            {
+                std::cerr << "Argument not found in string: " << s <<
+                    std::endl;
+            }
+        }
     }
 
-    return String(s);
+    return String(std::move(s));
 }
 
 String String::Arg(int16_t a, int fieldWidth, int base, char fillChar)
@@ -658,27 +925,27 @@ String String::Arg(uint64_t a, int fieldWidth, int base, char fillChar)
 
 String String::ToUpper() const
 {
-    std::string s = d->mString;
+    std::string s = Raw();
 
     // Source: http://stackoverflow.com/questions/313970/
     std::transform(s.begin(), s.end(), s.begin(), ::toupper);
 
-    return String(new StringData(s, d->mLength));
+    return String(std::move(s), mLength);
 }
 
 String String::ToLower() const
 {
-    std::string s = d->mString;
+    std::string s = Raw();
 
     // Source: http://stackoverflow.com/questions/313970/
     std::transform(s.begin(), s.end(), s.begin(), ::tolower);
 
-    return String(new StringData(s, d->mLength));
+    return String(std::move(s), mLength);
 }
 
 std::vector<char> String::Data(bool nullTerminate) const
 {
-    std::vector<char> v(d->mString.cbegin(), d->mString.cend());
+    std::vector<char> v(Raw().cbegin(), Raw().cend());
 
     if(nullTerminate)
     {
@@ -690,7 +957,7 @@ std::vector<char> String::Data(bool nullTerminate) const
 
 const char* String::C() const
 {
-    return d->mString.c_str();
+    return Raw().c_str();
 }
 
 bool String::IsReportingBadArguments()
@@ -747,37 +1014,7 @@ const String libcomp::operator+(const String& a, const String& b)
 
 String String::FromCodePoint(CodePoint cp)
 {
-    unsigned char bytes[4];
-
-    // For the UTF-8 encoding format, see: https://en.wikipedia.org/wiki/UTF-8
-    if(0x80 > cp)
-    {
-        bytes[0] = cp & 0x7F;
+    char bytes[4];
 
-        return String(reinterpret_cast<char*>(bytes), 1);
-    }
-    else if(0x800 > cp)
-    {
-        bytes[0] = 0xC0 | ((cp >> 6) & 0x1F);
-        bytes[1] = 0x80 | (cp & 0x3F);
-
-        return String(reinterpret_cast<char*>(bytes), 2);
-    }
-    else if(0x10000 > cp)
-    {
-        bytes[0] = 0xE0 | ((cp >> 12) & 0x0F);
-        bytes[1] = 0x80 | ((cp >> 6) & 0x3F);
-        bytes[2] = 0x80 | (cp & 0x3F);
-
-        return String(reinterpret_cast<char*>(bytes), 3);
-    }
-    else
-    {
-        bytes[0] = 0xF0 | ((cp >> 18) & 0x07);
-        bytes[1] = 0x80 | ((cp >> 12) & 0x3F);
-        bytes[2] = 0x80 | ((cp >> 6) & 0x3F);
-        bytes[3] = 0x80 | (cp & 0x3F);
-
-        return String(reinterpret_cast<char*>(bytes), 4);
-    }
+    return String(bytes, Utf8::Encode(cp, bytes));
 }
@@ -52,23 +52,96 @@ public:
      */
     typedef uint32_t CodePoint;
 
+    /**
+     * Forward iterator over the code points of a string. It reads the UTF-8
+     * data of the string directly so it is only valid while the string it
+     * came from is alive and not changed.
+     */
+    class CodePointIterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef CodePoint value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const CodePoint* pointer;
+        typedef CodePoint reference;
+
+        /**
+         * Construct an iterator over UTF-8 data.
+         * @param pPosition First byte of the code point to start at.
+         * @param pEnd End of the data.
+         */
+        CodePointIterator(const char *pPosition, const char *pEnd);
+
+        /**
+         * Decode the current code point.
+         * @returns Current code point (0 at the end).
+         */
+        CodePoint operator*() const;
+
+        /**
+         * Move to the next code point.
+         * @returns Reference to this iterator.
+         */
+        CodePointIterator& operator++();
+
+        /**
+         * Move to the next code point.
+         * @returns Copy of the iterator before it moved.
+         */
+        CodePointIterator operator++(int);
+
+        bool operator==(const CodePointIterator& other) const;
+        bool operator!=(const CodePointIterator& other) const;
+
+        /**
+         * Check if the iterator is past the last code point.
+         * @returns true if there are no more code points.
+         */
+        bool AtEnd() const;
+
+        /**
+         * Get the pointer to the UTF-8 bytes of the current code point.
+         * @returns Pointer into the string data.
+         */
+        const char* Position() const;
+
+    private:
+        const char *mPosition;
+        const char *mEnd;
+    };
+
     /**
      * Construct an empty string.
      */
     String();
 
     /**
-     * Perform a shallow copy of another string.
+     * Perform a shallow copy of another string. Short strings are copied
+     * and long strings share their data until one of them is changed.
      * @param other The string to copy.
      */
     String(const String& other);
 
+    /**
+     * Take the data of another string. The other string is left empty.
+     * @param other The string to move.
+     */
+    String(String&& other) noexcept;
+
     /**
      * Construct a string from a UTF-8 encoded STL string object.
      * @param str UTF-8 encoded STL string object.
      */
     String(const std::string& str);
 
+    /**
+     * Construct a string from a UTF-8 encoded STL string object and take
+     * its data.
+     * @param str UTF-8 encoded STL string object.
+     */
+    String(std::string&& str);
+
     /**
      * Construct a string from a C-style UTF-8 encoded string.
      * @param szString C-style UTF-8 encoded string.
@@ -160,6 +233,19 @@ public:
      */
     CodePoint At(size_t position) const;
 
+    /**
+     * Get an iterator to the first code point. Walking the string with an
+     * iterator is linear where a loop over @ref At is quadratic.
+     * @returns Iterator to the first code point.
+     */
+    CodePointIterator begin() const;
+
+    /**
+     * Get an iterator past the last code point.
+     * @returns Iterator past the last code point.
+     */
+    CodePointIterator end() const;
+
     /**
      * Split a string by a delimiter.
      * @param delimiter Sub-string to split the string by.
@@ -256,6 +342,33 @@ public:
      */
     String Arg(const String& a) const;
 
+    /**
+     * Replace several arguments at once. This is the same as chaining a
+     * call to the single argument @ref Arg for each of them (%1 is the
+     * first argument, %2 the second and so on, the rest are shifted down)
+     * except that the string is only scanned once and argument text is
+     * never scanned for arguments itself.
+     * @param a Argument to place into %1.
+     * @param b Argument to place into %2.
+     * @param rest Arguments to place into %3 and up.
+     * @returns String with the arguments added.
+     */
+    template<typename... T>
+    String Arg(const String& a, const String& b, const T&... rest) const
+    {
+        const String args[] = { a, b, String(rest)... };
+
+        return Format(args, sizeof(args) / sizeof(args[0]));
+    }
+
+    /**
+     * Replace several arguments at once when the number of arguments is
+     * only known at run time. This works like the variadic @ref Arg.
+     * @param args Arguments to place into %1 and up.
+     * @returns String with the arguments added.
+     */
+    String Arg(const std::vector<String>& args) const;
+
     /**
      * Convert the string into lowercase.
      * @returns Copy of the string in lowercase.
@@ -334,6 +447,20 @@ public:
     String Arg(uint64_t a, int fieldWidth = 0, int base = 10,
         char fillChar = ' ');
 
+    /**
+     * Perform a shallow copy of another string.
+     * @param other The string to copy.
+     * @returns Reference to this string.
+     */
+    String& operator=(const String& other);
+
+    /**
+     * Take the data of another string. The other string is left empty.
+     * @param other The string to move.
+     * @returns Reference to this string.
+     */
+    String& operator=(String&& other) noexcept;
+
     /**
      * Compare the string to a C-style UTF-8 encoded string.
      * @param szString C-style UTF-8 encoded string to compare to.
@@ -518,16 +645,26 @@ private:
     /**
      * @internal
      * Construct a string with the given data.
-     * @param pData Internal string data structure.
+     * @param str UTF-8 encoded data to take.
+     * @param length Number of UTF-8 characters in the data.
      */
-    String(StringData *pData);
+    String(std::string&& str, size_t length);
 
     /**
      * @internal
-     * Perform a deep copy of the string data. This will take ownership
-     * of the data if no other string references it.
+     * Replace the data of the string. Short data is kept inline and long
+     * data is moved into a new shared data object.
+     * @param str UTF-8 encoded data to take.
+     * @param length Number of UTF-8 characters in the data.
      */
-    void Detatch();
+    void Assign(std::string&& str, size_t length);
+
+    /**
+     * @internal
+     * Get the UTF-8 encoded data of the string.
+     * @returns Inline or shared data of the string.
+     */
+    const std::string& Raw() const;
 
     /**
      * @internal
@@ -539,7 +676,39 @@ private:
 
     /**
      * @internal
-     * Shared pointer to the string data.
+     * Find the first byte of a code point. Pure ASCII strings are indexed
+     * directly and long strings use a sparse index of code point offsets
+     * that is built the first time it is needed.
+     * @param position Number of characters into the string.
+     * @returns Byte offset of the character (the size if it is past the
+     *   end).
+     */
+    size_t ByteOffset(size_t position) const;
+
+    /**
+     * @internal
+     * Replace the arguments %1 to %<em>count</em> in a single pass.
+     * @param pArgs Text of the arguments.
+     * @param count Number of arguments.
+     * @returns String with the arguments added.
+     */
+    String Format(const String *pArgs, size_t count) const;
+
+    /**
+     * @internal
+     * Number of UTF-8 characters in the string.
+     */
+    size_t mLength;
+
+    /**
+     * @internal
+     * Data of a short string. This is only used when @ref d is not set.
+     */
+    std::string mInline;
+
+    /**
+     * @internal
+     * Shared pointer to the data of a long string.
      */
     std::shared_ptr<StringData> d;
 
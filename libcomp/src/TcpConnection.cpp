@@ -26,23 +26,269 @@
 
 #include "TcpConnection.h"
 
+#include "AllocationTracker.h"
+#include "ConnectionRegistry.h"
 #include "Constants.h"
+#include "IoUring.h"
 #include "Log.h"
+#include "Metrics.h"
+#include "ObjectPool.h"
+#include "PacketCapture.h"
+#include "Tracer.h"
 
 using namespace libcomp;
 
+/**
+ * @internal
+ * Metrics shared by every connection.
+ */
+class TcpConnectionMetrics
+{
+public:
+    TcpConnectionMetrics() : connections(Metrics::GetSingletonPtr()->Gauge(
+        "comp_tcp_connections", "Open TCP connections.")),
+        bytesIn(Metrics::GetSingletonPtr()->Counter(
+        "comp_tcp_received_bytes_total", "Bytes received from sockets.")),
+        bytesOut(Metrics::GetSingletonPtr()->Counter(
+        "comp_tcp_sent_bytes_total", "Bytes written to sockets.")),
+        sendQueue(Metrics::GetSingletonPtr()->Gauge(
+        "comp_tcp_send_queue_bytes", "Bytes waiting to be sent.")),
+        handshake(Metrics::GetSingletonPtr()->Histogram(
+        "comp_tcp_handshake_seconds", "Time to finish the handshake."))
+    {
+    }
+
+    MetricGauge& connections;
+    MetricCounter& bytesIn;
+    MetricCounter& bytesOut;
+    MetricGauge& sendQueue;
+    MetricHistogram& handshake;
+};
+
+/**
+ * @internal
+ * Get the connection metrics.
+ * @returns Metrics shared by every connection.
+ */
+static TcpConnectionMetrics& GetMetrics()
+{
+    static TcpConnectionMetrics metrics;
+
+    return metrics;
+}
+
+/**
+ * @internal
+ * Receive buffer of the default size so one pool can serve every
+ * connection that receives on demand.
+ */
+class PooledReceiveBuffer : public RingBuffer
+{
+public:
+    PooledReceiveBuffer() : RingBuffer(RECEIVE_BUFFER_SIZE)
+    {
+    }
+};
+
+/**
+ * @internal
+ * Get the pool of receive buffers for connections that receive on demand.
+ * @returns Receive buffer pool.
+ */
+static ObjectPool<PooledReceiveBuffer>& GetReceiveBufferPool()
+{
+    // This is never freed on purpose; buffers may still be released by
+    // other threads while static objects are being destroyed.
+    static ObjectPool<PooledReceiveBuffer> *pPool =
+        new ObjectPool<PooledReceiveBuffer>(RECEIVE_BUFFER_POOL_MAX_FREE);
+
+    return *pPool;
+}
+
+/**
+ * @internal
+ * Context and big numbers used to calculate the shared data. There is one
+ * set per thread so they are not allocated for every handshake.
+ */
+class DiffieHellmanScratch
+{
+public:
+    DiffieHellmanScratch() : context(BN_CTX_new()), otherPublic(BN_new()),
+        limit(BN_new()), shared(BN_new()), prime(BN_new()),
+        montgomery(BN_MONT_CTX_new()), montgomeryValid(false)
+    {
+    }
+
+    ~DiffieHellmanScratch()
+    {
+        BN_MONT_CTX_free(montgomery);
+        BN_free(prime);
+        BN_clear_free(shared);
+        BN_free(limit);
+        BN_clear_free(otherPublic);
+        BN_CTX_free(context);
+    }
+
+    bool IsValid() const
+    {
+        return nullptr != context && nullptr != otherPublic &&
+            nullptr != limit && nullptr != shared && nullptr != prime &&
+            nullptr != montgomery;
+    }
+
+    /**
+     * Get the Montgomery form of a prime. It is only calculated again when
+     * the prime changes (each server has one).
+     * @param pPrime Prime to get the Montgomery form of.
+     * @returns Montgomery form or nullptr on failure.
+     */
+    BN_MONT_CTX* GetMontgomery(const BIGNUM *pPrime)
+    {
+        if(!montgomeryValid || 0 != BN_cmp(prime, pPrime))
+        {
+            montgomeryValid = nullptr != BN_copy(prime, pPrime) &&
+                1 == BN_MONT_CTX_set(montgomery, pPrime, context);
+        }
+
+        return montgomeryValid ? montgomery : nullptr;
+    }
+
+    BN_CTX *context;
+    BIGNUM *otherPublic;
+    BIGNUM *limit;
+    BIGNUM *shared;
+    BIGNUM *prime;
+    BN_MONT_CTX *montgomery;
+    bool montgomeryValid;
+};
+
+/**
+ * @internal
+ * Value of each character as a hex digit (-1 if it is not one).
+ */
+class HexTable
+{
+public:
+    HexTable()
+    {
+        memset(values, -1, sizeof(values));
+
+        for(int8_t i = 0; i < 10; ++i)
+        {
+            values['0' + i] = i;
+        }
+
+        for(int8_t i = 0; i < 6; ++i)
+        {
+            values['A' + i] = (int8_t)(10 + i);
+            values['a' + i] = (int8_t)(10 + i);
+        }
+    }
+
+    int8_t values[256];
+};
+
+/**
+ * @internal
+ * Write a key as upper case hex (like BN_bn2hex).
+ * @param key Key to write.
+ * @param szHex Buffer of @ref DH_KEY_HEX_SIZE characters to write to.
+ */
+static void EncodeKey(const TcpConnection::DiffieHellmanKey_t& key,
+    char *szHex)
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    for(size_t i = 0; i < key.size(); ++i)
+    {
+        *szHex++ = digits[key[i] >> 4];
+        *szHex++ = digits[key[i] & 0x0F];
+    }
+}
+
+/**
+ * @internal
+ * Read a key from hex (upper or lower case).
+ * @param szHex Buffer of @ref DH_KEY_HEX_SIZE characters to read.
+ * @param key Set to the key.
+ * @returns true if every character was a hex digit.
+ */
+static bool DecodeKey(const char *szHex,
+    TcpConnection::DiffieHellmanKey_t& key)
+{
+    static const HexTable table;
+
+    int8_t invalid = 0;
+
+    for(size_t i = 0; i < key.size(); ++i)
+    {
+        int8_t high = table.values[(uint8_t)*szHex++];
+        int8_t low = table.values[(uint8_t)*szHex++];
+
+        // A bad digit is -1 so it sets the sign bit.
+        invalid |= (int8_t)(high | low);
+
+        key[i] = (uint8_t)(((uint8_t)high << 4) | ((uint8_t)low & 0x0F));
+    }
+
+    return 0 <= invalid;
+}
+
+/**
+ * @internal
+ * Write a big number as big endian bytes padded with zeros on the left
+ * (what BN_bn2binpad does in OpenSSL 1.1 and later).
+ * @param pNumber Number to write.
+ * @param key Set to the number.
+ * @returns true if the number fits.
+ */
+static bool NumberToKey(const BIGNUM *pNumber,
+    TcpConnection::DiffieHellmanKey_t& key)
+{
+    int size = BN_num_bytes(pNumber);
+
+    if(0 > size || (size_t)size > key.size())
+    {
+        return false;
+    }
+
+    size_t padding = key.size() - (size_t)size;
+
+    memset(key.data(), 0, padding);
+
+    return size == BN_bn2bin(pNumber, key.data() + padding);
+}
+
 TcpConnection::TcpConnection(asio::io_service& io_service) :
     mSocket(io_service), mDiffieHellman(nullptr), mStatus(
     TcpConnection::STATUS_NOT_CONNECTED), mRole(TcpConnection::ROLE_CLIENT),
-    mRemoteAddress("0.0.0.0")
+    mOutgoingBytes(0), mWritable(true),
+    mOutgoingLowWatermark(OUTGOING_LOW_WATERMARK),
+    mOutgoingHighWatermark(OUTGOING_HIGH_WATERMARK), mClosing(false),
+    mSendBatchPackets(MAX_SEND_BATCH_PACKETS),
+    mSendBatchSize(MAX_SEND_BATCH_SIZE), mRemoteAddress("0.0.0.0"),
+    mConnectionID(INVALID_CONNECTION_ID), mLastActivity(0),
+    mKeepAliveSent(false), mSocketOptions(SocketOptions::GetDefaults()),
+    mRingReceive(0), mReceiveOnDemand(false)
 {
+    GetMetrics().connections.Add(1);
 }
 
 TcpConnection::TcpConnection(asio::ip::tcp::socket& socket,
     DH *pDiffieHellman) : mSocket(std::move(socket)),
     mDiffieHellman(pDiffieHellman), mStatus(TcpConnection::STATUS_CONNECTED),
-    mRole(TcpConnection::ROLE_SERVER), mRemoteAddress("0.0.0.0")
+    mRole(TcpConnection::ROLE_SERVER),
+    mOutgoingBytes(0), mWritable(true),
+    mOutgoingLowWatermark(OUTGOING_LOW_WATERMARK),
+    mOutgoingHighWatermark(OUTGOING_HIGH_WATERMARK), mClosing(false),
+    mSendBatchPackets(MAX_SEND_BATCH_PACKETS),
+    mSendBatchSize(MAX_SEND_BATCH_SIZE), mRemoteAddress("0.0.0.0"),
+    mConnectionID(INVALID_CONNECTION_ID), mLastActivity(0),
+    mKeepAliveSent(false), mSocketOptions(SocketOptions::GetDefaults()),
+    mRingReceive(0), mReceiveOnDemand(false)
 {
+    GetMetrics().connections.Add(1);
+
     // Cache the remote address.
     try
     {
@@ -56,6 +302,9 @@ TcpConnection::TcpConnection(asio::ip::tcp::socket& socket,
 
 TcpConnection::~TcpConnection()
 {
+    GetMetrics().connections.Add(-1);
+    GetMetrics().sendQueue.Add(-(int64_t)mOutgoingBytes.load());
+
     if(nullptr != mDiffieHellman)
     {
         DH_free(mDiffieHellman);
@@ -86,108 +335,746 @@ bool TcpConnection::Connect(const String& host, int port)
     return result;
 }
 
-void TcpConnection::SendPacket(Packet& packet)
+void TcpConnection::SetSocketOptions(const SocketOptions_t& options)
+{
+    mSocketOptions = options;
+}
+
+bool TcpConnection::SendPacket(Packet& packet, SendPriority_t priority)
+{
+    ReadOnlyPacket copy(packet);
+
+    return SendPacket(copy, priority);
+}
+
+bool TcpConnection::SendPacket(ReadOnlyPacket& packet,
+    SendPriority_t priority)
+{
+    AllocationTracker::Scope tag(AllocationTracker::TAG_SEND);
+
+    bool result = true;
+    bool firstPacket = false;
+    bool full = false;
+
+    {
+        std::lock_guard<std::mutex> guard(mOutgoingMutex);
+
+        if(!mWritable || (mOutgoingBytes + packet.Size()) >
+            mOutgoingHighWatermark)
+        {
+            mWritable = false;
+            full = true;
+        }
+        else
+        {
+            QueuePacket(packet, firstPacket);
+        }
+    }
+
+    // The policy is asked outside of the lock so it may send.
+    if(full)
+    {
+        switch(OutgoingOverflow(packet, priority))
+        {
+            case OVERFLOW_QUEUE:
+            {
+                std::lock_guard<std::mutex> guard(mOutgoingMutex);
+
+                QueuePacket(packet, firstPacket);
+                break;
+            }
+            case OVERFLOW_DROP:
+            {
+                result = false;
+                break;
+            }
+            case OVERFLOW_DISCONNECT:
+            {
+                result = false;
+
+                // This may be any thread so close on the io thread.
+                std::shared_ptr<TcpConnection> self = mSelf.lock();
+
+                if(nullptr != self)
+                {
+                    GetIoService().post([self]()
+                    {
+                        if(STATUS_NOT_CONNECTED != self->mStatus)
+                        {
+                            self->SocketError("Outgoing queue is full.");
+                        }
+                    });
+                }
+                break;
+            }
+        }
+    }
+
+    if(firstPacket)
+    {
+        SendNextPacket();
+    }
+
+    return result;
+}
+
+void TcpConnection::QueuePacket(ReadOnlyPacket& packet, bool& firstPacket)
+{
+    firstPacket = mOutgoingPackets.empty();
+    mOutgoingBytes += packet.Size();
+    GetMetrics().sendQueue.Add((int64_t)packet.Size());
+    mOutgoingPackets.push_back(std::move(packet));
+}
+
+void TcpConnection::SetOutgoingLimits(size_t lowWatermark,
+    size_t highWatermark)
+{
+    std::lock_guard<std::mutex> guard(mOutgoingMutex);
+
+    mOutgoingLowWatermark = lowWatermark < highWatermark ? lowWatermark :
+        highWatermark;
+    mOutgoingHighWatermark = highWatermark;
+}
+
+bool TcpConnection::IsWritable() const
+{
+    return mWritable;
+}
+
+size_t TcpConnection::GetOutgoingBytes() const
+{
+    return mOutgoingBytes;
+}
+
+TcpConnection::OverflowAction_t TcpConnection::OutgoingOverflow(
+    const ReadOnlyPacket& packet, SendPriority_t priority)
+{
+    OverflowAction_t action = OVERFLOW_QUEUE;
+
+    if(PRIORITY_LOW == priority)
+    {
+        action = OVERFLOW_DROP;
+    }
+    else if((mOutgoingBytes + packet.Size()) > mOutgoingHighWatermark)
+    {
+        action = OVERFLOW_DISCONNECT;
+    }
+
+    return action;
+}
+
+void TcpConnection::FlushCommands()
+{
+}
+
+void TcpConnection::OutgoingDrained()
+{
+}
+
+void TcpConnection::ConnectionClosing(const String& reason)
+{
+    (void)reason;
+}
+
+void TcpConnection::Close(const String& reason)
+{
+    std::shared_ptr<TcpConnection> self = mSelf.lock();
+
+    if(nullptr == self)
+    {
+        return;
+    }
+
+    GetIoService().post([self, reason]()
+    {
+        if(STATUS_NOT_CONNECTED == self->mStatus || self->mClosing)
+        {
+            return;
+        }
+
+        LOG_DEBUG_FORMAT("Closing connection from %1: %2\n",
+            self->GetRemoteAddress(), reason);
+
+        self->ConnectionClosing(reason);
+
+        bool idle;
+
+        {
+            std::lock_guard<std::mutex> guard(self->mOutgoingMutex);
+
+            // The write that empties the queue finishes the close.
+            self->mClosing = true;
+            idle = self->mOutgoingPackets.empty();
+        }
+
+        if(idle)
+        {
+            self->FinishClose();
+        }
+    });
+}
+
+void TcpConnection::FinishClose()
+{
+    asio::error_code ignored;
+
+    // Let the peer read what was written before it sees the connection end.
+    mSocket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+
+    SocketError();
+}
+
+bool TcpConnection::RequestPacket(uint32_t size)
+{
+    bool result = false;
+
+#ifdef COMP_HACK_DEBUG
+    if(0 < mReceivedPacket.Size())
+    {
+        LOG_DEBUG(String("TcpConnection::RequestPacket() called when there is "
+            "still %1 bytes in the buffer.\n").Arg(mReceivedPacket.Size()));
+    }
+#endif // COMP_HACK_DEBUG
+
+    char *pDestination = PrepareRead(size);
+
+    if(nullptr != pDestination)
+    {
+        // Request packet data from the socket.
+        mSocket.async_receive(asio::buffer(pDestination, size), 0,
+            [this](asio::error_code errorCode, std::size_t length)
+            {
+                if(FinishRead(errorCode, length))
+                {
+                    // It's up to this callback to remove the data from the
+                    // packet either by calling std::move() or packet.Clear().
+                    PacketReceived(mReceivedPacket);
+
+#ifdef COMP_HACK_DEBUG
+                    if(0 < mReceivedPacket.Size())
+                    {
+                        LOG_DEBUG(String("TcpConnection::PacketReceived() "
+                            "was called and it left %1 bytes in the buffer.\n"
+                            ).Arg(mReceivedPacket.Size()));
+                    }
+#endif // COMP_HACK_DEBUG
+                }
+            });
+
+        // Success.
+        result = true;
+    }
+
+    return result;
+}
+
+char* TcpConnection::PrepareRead(uint32_t size)
+{
+    if(0 == size || MAX_PACKET_SIZE < (mReceivedPacket.Size() + size))
+    {
+        return nullptr;
+    }
+
+    // Make sure the buffer is there and big enough.
+    mReceivedPacket.Reserve(mReceivedPacket.Size() + size);
+
+    // Get direct access to the buffer.
+    char *pDestination = mReceivedPacket.Data();
+
+    if(nullptr != pDestination)
+    {
+        // Calculate where to write the data.
+        pDestination += mReceivedPacket.Size();
+    }
+
+    return pDestination;
+}
+
+bool TcpConnection::FinishRead(const asio::error_code& errorCode,
+    std::size_t length)
+{
+    AllocationTracker::Scope tag(AllocationTracker::TAG_RECV);
+    TRACE_SCOPE("recv");
+
+    if(errorCode)
+    {
+        SocketError();
+
+        return false;
+    }
+
+    GetMetrics().bytesIn.Increment(length);
+
+    // Adjust the size of the packet.
+    (void)mReceivedPacket.Direct(mReceivedPacket.Size() + (uint32_t)length);
+    mReceivedPacket.Rewind();
+
+    MarkActivity();
+
+    return true;
+}
+
+bool TcpConnection::SetStreamingReceive(int32_t capacity)
+{
+    bool result = false;
+
+    try
+    {
+        mReceiveBuffer.reset(new RingBuffer(capacity));
+
+        result = true;
+    }
+    catch(RingBuffer::Exception& e)
+    {
+        LOG_ERROR(String("Failed to create the receive buffer: %1\n").Arg(
+            e.Message()));
+
+        mReceiveBuffer.reset();
+    }
+
+    return result;
+}
+
+bool TcpConnection::IsStreamingReceive() const
+{
+    return nullptr != mReceiveBuffer || mReceiveOnDemand;
+}
+
+void TcpConnection::SetReceiveOnDemand(bool enabled)
+{
+    mReceiveOnDemand = enabled;
+
+    // A pooled buffer is taken for each burst of data instead.
+    if(enabled)
+    {
+        mReceiveBuffer.reset();
+    }
+}
+
+bool TcpConnection::IsReceiveOnDemand() const
+{
+    return mReceiveOnDemand;
+}
+
+ObjectPoolStats_t TcpConnection::GetReceiveBufferPoolStats()
+{
+    return GetReceiveBufferPool().GetStats();
+}
+
+bool TcpConnection::RequestStream()
+{
+    if(nullptr != mIoUring && IsStreamingReceive())
+    {
+        return StartRingReceive();
+    }
+
+    // With nothing left to parse the buffer goes back to the pool until
+    // the socket is readable again.
+    if(mReceiveOnDemand && (nullptr == mReceiveBuffer ||
+        0 == mReceiveBuffer->Available()))
+    {
+        return WaitForStream();
+    }
+
+    bool result = false;
+
+    int32_t size = nullptr != mReceiveBuffer ? mReceiveBuffer->Free() : 0;
+    void *pDestination = nullptr != mReceiveBuffer ?
+        mReceiveBuffer->BeginWrite(size) : nullptr;
+
+    if(nullptr != pDestination && 0 < size)
+    {
+        // Take whatever the socket has up to the space in the buffer.
+        mSocket.async_read_some(asio::buffer(pDestination, (size_t)size),
+            [this](asio::error_code errorCode, std::size_t length)
+            {
+                StreamRead(errorCode, length);
+            });
+
+        // Success.
+        result = true;
+    }
+
+    return result;
+}
+
+bool TcpConnection::WaitForStream()
+{
+    mReceiveBuffer.reset();
+
+    // The handshake packet buffer is not used again either.
+    if(0 == mReceivedPacket.Size())
+    {
+        mReceivedPacket = Packet();
+    }
+
+    // Reads after the wait must not block the io thread.
+    asio::error_code errorCode;
+
+    if(!mSocket.non_blocking() && mSocket.non_blocking(true, errorCode))
+    {
+        return false;
+    }
+
+    // A null buffer read only waits for the socket to be readable.
+    mSocket.async_read_some(asio::null_buffers(),
+        [this](asio::error_code waitError, std::size_t)
+        {
+            if(waitError)
+            {
+                SocketError();
+            }
+            else
+            {
+                StreamReady();
+            }
+        });
+
+    return true;
+}
+
+void TcpConnection::StreamReady()
+{
+    if(!AcquireReceiveBuffer())
+    {
+        SocketError("Failed to get a receive buffer.");
+
+        return;
+    }
+
+    int32_t size = mReceiveBuffer->Free();
+    void *pDestination = mReceiveBuffer->BeginWrite(size);
+
+    asio::error_code errorCode;
+    std::size_t length = mSocket.read_some(asio::buffer(pDestination,
+        (size_t)size), errorCode);
+
+    if(asio::error::would_block == errorCode ||
+        asio::error::try_again == errorCode)
+    {
+        // Nothing to read after all so go back to waiting.
+        if(!WaitForStream())
+        {
+            SocketError("Failed to request more data.");
+        }
+
+        return;
+    }
+
+    StreamRead(errorCode, length);
+}
+
+void TcpConnection::StreamRead(const asio::error_code& errorCode,
+    std::size_t length)
+{
+    AllocationTracker::Scope tag(AllocationTracker::TAG_RECV);
+    TRACE_SCOPE("recv");
+
+    if(errorCode)
+    {
+        SocketError();
+
+        return;
+    }
+
+    GetMetrics().bytesIn.Increment(length);
+
+    int32_t written = (int32_t)length;
+    (void)mReceiveBuffer->EndWrite(written);
+
+    MarkActivity();
+
+    StreamReceived(*mReceiveBuffer);
+
+    // Keep reading while the connection is still up.
+    if(STATUS_NOT_CONNECTED != mStatus && !RequestStream())
+    {
+        SocketError("Receive buffer is full.");
+    }
+}
+
+bool TcpConnection::AcquireReceiveBuffer()
+{
+    if(nullptr != mReceiveBuffer)
+    {
+        return true;
+    }
+
+    try
+    {
+        mReceiveBuffer = GetReceiveBufferPool().Allocate();
+    }
+    catch(RingBuffer::Exception& e)
+    {
+        LOG_ERROR(String("Failed to create the receive buffer: %1\n").Arg(
+            e.Message()));
+    }
+
+    return nullptr != mReceiveBuffer;
+}
+
+bool TcpConnection::StartRingReceive()
+{
+    std::shared_ptr<TcpConnection> self = mSelf.lock();
+
+    if(nullptr == self)
+    {
+        return false;
+    }
+
+    // The ring may only be used by the io thread.
+    GetIoService().dispatch([self]()
+    {
+        // The receive keeps going once started.
+        if(0 != self->mRingReceive || STATUS_NOT_CONNECTED == self->mStatus)
+        {
+            return;
+        }
+
+        std::weak_ptr<TcpConnection> weakSelf(self);
+
+        self->mRingReceive = self->mIoUring->Receive(
+            self->mSocket.native_handle(), [weakSelf](int32_t result,
+                const uint8_t *pData)
+            {
+                std::shared_ptr<TcpConnection> connection = weakSelf.lock();
+
+                if(nullptr != connection)
+                {
+                    connection->RingReceived(result, pData);
+                }
+            });
+
+        if(0 == self->mRingReceive)
+        {
+            self->SocketError("Failed to start the receive.");
+        }
+    });
+
+    return true;
+}
+
+void TcpConnection::RingReceived(int32_t result, const uint8_t *pData)
+{
+    AllocationTracker::Scope tag(AllocationTracker::TAG_RECV);
+    TRACE_SCOPE("recv");
+
+    if(0 >= result)
+    {
+        // The peer closed the connection or the receive failed.
+        mRingReceive = 0;
+
+        SocketError();
+
+        return;
+    }
+
+    if(!AcquireReceiveBuffer())
+    {
+        SocketError("Failed to get a receive buffer.");
+
+        return;
+    }
+
+    // The kernel buffer is handed back once this returns so the data has
+    // to be copied into the receive buffer now.
+    if(mReceiveBuffer->Free() < result)
+    {
+        SocketError("Receive buffer is full.");
+
+        return;
+    }
+
+    (void)mReceiveBuffer->Write(pData, result);
+
+    GetMetrics().bytesIn.Increment((uint64_t)result);
+
+    MarkActivity();
+
+    StreamReceived(*mReceiveBuffer);
+
+    // The receive keeps going without a buffer until more data arrives.
+    if(mReceiveOnDemand && nullptr != mReceiveBuffer &&
+        0 == mReceiveBuffer->Available())
+    {
+        mReceiveBuffer.reset();
+    }
+}
+
+TcpConnection::Role_t TcpConnection::GetRole() const
+{
+    return mRole;
+}
+
+TcpConnection::ConnectionStatus_t TcpConnection::GetStatus() const
+{
+    return mStatus;
+}
+
+String TcpConnection::GetRemoteAddress() const
+{
+    return mRemoteAddress;
+}
+
+void TcpConnection::SetSelf(const std::weak_ptr<libcomp::TcpConnection>& self)
+{
+    mSelf = self;
+}
+
+void TcpConnection::SetAddressLease(const std::shared_ptr<void>& lease)
+{
+    mAddressLease = lease;
+}
+
+void TcpConnection::SetIoUring(const std::shared_ptr<IoUring>& ring)
+{
+    mIoUring = ring;
+}
+
+void TcpConnection::SetRegistry(const std::weak_ptr<
+    ConnectionRegistry>& registry, uint64_t id)
+{
+    mRegistry = registry;
+    mConnectionID = id;
+
+    PacketCapture *pCapture = PacketCapture::GetSingletonPtr();
+
+    if(pCapture->IsCapturing())
+    {
+        pCapture->Record(PacketCapture::TYPE_OPEN, id, 0, mRemoteAddress.C(),
+            (uint32_t)mRemoteAddress.Size());
+    }
+}
+
+uint64_t TcpConnection::GetConnectionID() const
+{
+    return mConnectionID;
+}
+
+void TcpConnection::SetTimerWheel(const std::shared_ptr<TimerWheel>& wheel)
+{
+    mTimerWheel = wheel;
+
+    RunOnWheel([this]()
+    {
+        mLastActivity = mTimerWheel->Now();
+        mKeepAliveSent = false;
+
+        ArmIdleTimer(TIMEOUT_KEEPALIVE * 1000);
+    });
+}
+
+void TcpConnection::StartHandshakeTimeout(uint32_t seconds)
 {
-    ReadOnlyPacket copy(packet);
+    mHandshakeStart = std::chrono::steady_clock::now();
 
-    SendPacket(copy);
+    RunOnWheel([this, seconds]()
+    {
+        mTimerWheel->Arm(mHandshakeTimer, (uint64_t)seconds * 1000, [this]()
+        {
+            SocketError("Handshake timed out.");
+        });
+    });
 }
-void TcpConnection::SendPacket(ReadOnlyPacket& packet)
-{
-    bool firstPacket;
 
+void TcpConnection::StopHandshakeTimeout()
+{
+    if(std::chrono::steady_clock::time_point() != mHandshakeStart)
     {
-        std::lock_guard<std::mutex> guard(mOutgoingMutex);
-
-        firstPacket = mOutgoingPackets.empty();
-        mOutgoingPackets.push_back(std::move(packet));
+        GetMetrics().handshake.ObserveSince(mHandshakeStart);
+        mHandshakeStart = std::chrono::steady_clock::time_point();
     }
 
-    if(firstPacket)
+    RunOnWheel([this]()
     {
-        SendNextPacket();
-    }
+        mHandshakeTimer.Cancel();
+    });
 }
 
-bool TcpConnection::RequestPacket(uint32_t size)
+void TcpConnection::KeepAlive()
 {
-    bool result = false;
+}
 
-    // Make sure the buffer is there.
-    mReceivedPacket.Allocate();
+bool TcpConnection::RunOnWheel(const std::function<void()>& work)
+{
+    std::shared_ptr<TcpConnection> self = mSelf.lock();
 
-#ifdef COMP_HACK_DEBUG
-    if(0 < mReceivedPacket.Size())
+    if(nullptr == mTimerWheel || nullptr == self)
     {
-        LOG_DEBUG(String("TcpConnection::RequestPacket() called when there is "
-            "still %1 bytes in the buffer.\n").Arg(mReceivedPacket.Size()));
+        return false;
     }
-#endif // COMP_HACK_DEBUG
-
-    // Get direct access to the buffer.
-    char *pDestination = mReceivedPacket.Data();
 
-    if(0 != size && MAX_PACKET_SIZE >= (mReceivedPacket.Size() + size) &&
-        nullptr != pDestination)
+    // The wheel may only be touched by the thread that drives it. This runs
+    // right away when called from that thread.
+    GetIoService().dispatch([self, work]()
     {
-        // Calculate where to write the data.
-        pDestination += mReceivedPacket.Size();
-
-        // Request packet data from the socket.
-        mSocket.async_receive(asio::buffer(pDestination, size), 0,
-            [this](asio::error_code errorCode, std::size_t length)
-            {
-                if(errorCode)
-                {
-                    SocketError();
-                }
-                else
-                {
-                    // Adjust the size of the packet.
-                    (void)mReceivedPacket.Direct(mReceivedPacket.Size() +
-                        length);
-                    mReceivedPacket.Rewind();
-
-                    // It's up to this callback to remove the data from the
-                    // packet either by calling std::move() or packet.Clear().
-                    PacketReceived(mReceivedPacket);
-
-#ifdef COMP_HACK_DEBUG
-                    if(0 < mReceivedPacket.Size())
-                    {
-                        LOG_DEBUG(String("TcpConnection::PacketReceived() "
-                            "was called and it left %1 bytes in the buffer.\n"
-                            ).Arg(mReceivedPacket.Size()));
-                    }
-#endif // COMP_HACK_DEBUG
-                }
-            });
-
-        // Success.
-        result = true;
-    }
+        if(STATUS_NOT_CONNECTED != self->mStatus)
+        {
+            work();
+        }
+    });
 
-    return result;
+    return true;
 }
 
-TcpConnection::Role_t TcpConnection::GetRole() const
+bool TcpConnection::ScheduleTimer(TimerWheel::Timer& timer, uint64_t delay,
+    const std::function<void()>& callback)
 {
-    return mRole;
+    TimerWheel::Timer *pTimer = &timer;
+
+    return RunOnWheel([this, pTimer, delay, callback]()
+    {
+        if(!pTimer->IsArmed())
+        {
+            mTimerWheel->Arm(*pTimer, delay, callback);
+        }
+    });
 }
 
-TcpConnection::ConnectionStatus_t TcpConnection::GetStatus() const
+void TcpConnection::ArmIdleTimer(uint64_t delay)
 {
-    return mStatus;
+    mTimerWheel->Arm(mIdleTimer, delay, [this]()
+    {
+        IdleTimerExpired();
+    });
 }
 
-String TcpConnection::GetRemoteAddress() const
+void TcpConnection::IdleTimerExpired()
 {
-    return mRemoteAddress;
+    // The activity time is only updated (not the timer) on every receive so
+    // the timer just checks how long it has really been idle.
+    uint64_t idle = mTimerWheel->Now() - mLastActivity;
+    uint64_t keepAlive = TIMEOUT_KEEPALIVE * 1000;
+    uint64_t timeout = TIMEOUT_SOCKET * 1000;
+
+    if(idle >= timeout)
+    {
+        SocketError("Connection timed out.");
+    }
+    else if(idle >= keepAlive)
+    {
+        if(!mKeepAliveSent)
+        {
+            mKeepAliveSent = true;
+
+            KeepAlive();
+        }
+
+        ArmIdleTimer(timeout - idle);
+    }
+    else
+    {
+        ArmIdleTimer(keepAlive - idle);
+    }
 }
 
-void TcpConnection::SetSelf(const std::weak_ptr<libcomp::TcpConnection>& self)
+void TcpConnection::MarkActivity()
 {
-    mSelf = self;
+    if(nullptr != mTimerWheel)
+    {
+        mLastActivity = mTimerWheel->Now();
+        mKeepAliveSent = false;
+    }
 }
 
 void TcpConnection::Connect(const asio::ip::tcp::endpoint& endpoint)
@@ -208,6 +1095,12 @@ void TcpConnection::Connect(const asio::ip::tcp::endpoint& endpoint)
         {
             mStatus = STATUS_CONNECTED;
 
+            if(!SocketOptions::Apply(mSocket, mSocketOptions))
+            {
+                LOG_WARNING("Failed to set the socket options of the "
+                    "connection.\n");
+            }
+
             // Cache the remote address.
             try
             {
@@ -226,67 +1119,221 @@ void TcpConnection::Connect(const asio::ip::tcp::endpoint& endpoint)
 
 void TcpConnection::SendNextPacket()
 {
-    std::lock_guard<std::mutex> guard(mOutgoingMutex);
+    AllocationTracker::Scope tag(AllocationTracker::TAG_SEND);
+    TRACE_SCOPE("send");
+
+    std::vector<asio::const_buffer> buffers;
+    size_t batchSize = 0;
 
-    if(!mOutgoingPackets.empty())
     {
-        ReadOnlyPacket& packet = mOutgoingPackets.front();
+        std::lock_guard<std::mutex> guard(mOutgoingMutex);
 
-        mSocket.async_send(asio::buffer(packet.ConstData(), packet.Size()), 0,
-            [this](asio::error_code errorCode, std::size_t length)
+        // Gather as many queued packets as the limits allow into a single
+        // write. The first packet is always sent even if it is over the byte
+        // limit. The packets stay in the queue until the write completes so
+        // SendPacket() will not start another write in the meantime.
+        for(auto& packet : mOutgoingPackets)
+        {
+            if(!buffers.empty() && (buffers.size() >= mSendBatchPackets ||
+                (batchSize + packet.Size()) > mSendBatchSize))
             {
-                bool sendAnother = false;
-                bool packetOk = false;
+                break;
+            }
+
+            buffers.push_back(asio::buffer(packet.ConstData(),
+                packet.Size()));
+            batchSize += packet.Size();
+        }
+    }
 
-                ReadOnlyPacket packet;
+    if(!buffers.empty())
+    {
+        SendBuffers(buffers, buffers.size(), batchSize);
+    }
+}
 
-                if(errorCode)
-                {
-                    SocketError();
-                }
-                else
-                {
-                    std::lock_guard<std::mutex> guard(mOutgoingMutex);
+void TcpConnection::SendBuffers(const std::vector<asio::const_buffer>& buffers,
+    size_t packetCount, size_t batchSize)
+{
+    std::shared_ptr<TcpConnection> self = mSelf.lock();
 
-                    if(mOutgoingPackets.empty() || length !=
-                        mOutgoingPackets.front().Size())
-                    {
-                        SocketError();
-                    }
-                    else
-                    {
-                        packet = mOutgoingPackets.front();
+    if(nullptr == mIoUring || nullptr == self)
+    {
+        asio::async_write(mSocket, buffers,
+            [this, packetCount, batchSize](asio::error_code errorCode,
+                std::size_t length)
+            {
+                FinishSend(errorCode, length, packetCount, batchSize);
+            });
+
+        return;
+    }
 
-                        mOutgoingPackets.pop_front();
+    // The ring may only be used by the io thread (this may be any thread).
+    // Sends started while the io thread is busy go out with one submit.
+    GetIoService().dispatch([self, buffers, packetCount, batchSize]()
+    {
+        // The handle of a closed socket may already belong to another one.
+        if(!self->mSocket.is_open())
+        {
+            return;
+        }
 
-                        sendAnother = !mOutgoingPackets.empty();
-                        packetOk = true;
-                    }
-                }
+        // The handler keeps the connection (and the queued packets) alive
+        // until the kernel is done with the data.
+        bool started = self->mIoUring->Send(self->mSocket.native_handle(),
+            buffers, [self, packetCount, batchSize](int32_t result)
+            {
+                asio::error_code errorCode;
 
-                if(packetOk)
+                if(0 > result)
                 {
-                    PacketSent(packet);
-
-                    if(sendAnother)
-                    {
-                        SendNextPacket();
-                    }
+                    errorCode = asio::error_code(-result,
+                        asio::error::get_system_category());
                 }
+
+                self->FinishSend(errorCode, 0 > result ? 0 : (size_t)result,
+                    packetCount, batchSize);
             });
+
+        if(!started)
+        {
+            self->FinishSend(asio::error::no_buffer_space, 0, packetCount,
+                batchSize);
+        }
+    });
+}
+
+void TcpConnection::FinishSend(const asio::error_code& errorCode,
+    std::size_t length, size_t packetCount, size_t batchSize)
+{
+    AllocationTracker::Scope tag(AllocationTracker::TAG_SEND);
+
+    bool sendAnother = false;
+    bool drained = false;
+    bool closed = false;
+
+    std::list<ReadOnlyPacket> sentPackets;
+
+    if(errorCode)
+    {
+        SocketError();
+    }
+    else
+    {
+        std::lock_guard<std::mutex> sentGuard(mOutgoingMutex);
+
+        if(mOutgoingPackets.size() < packetCount || length != batchSize)
+        {
+            SocketError();
+        }
+        else
+        {
+            auto last = mOutgoingPackets.begin();
+            std::advance(last, packetCount);
+
+            sentPackets.splice(sentPackets.begin(), mOutgoingPackets,
+                mOutgoingPackets.begin(), last);
+
+            sendAnother = !mOutgoingPackets.empty();
+            closed = !sendAnother && mClosing;
+
+            mOutgoingBytes -= batchSize;
+            GetMetrics().sendQueue.Add(-(int64_t)batchSize);
+            GetMetrics().bytesOut.Increment(batchSize);
+
+            if(!mWritable && mOutgoingBytes <= mOutgoingLowWatermark)
+            {
+                mWritable = true;
+                drained = true;
+            }
+        }
+    }
+
+    // Notify once per packet (outside of the lock).
+    for(auto& packet : sentPackets)
+    {
+        PacketSent(packet);
+    }
+
+    if(drained)
+    {
+        OutgoingDrained();
+    }
+
+    if(sendAnother)
+    {
+        SendNextPacket();
+    }
+    else if(closed)
+    {
+        FinishClose();
     }
 }
 
+void TcpConnection::SetSendBatchLimits(size_t maxPackets, size_t maxBytes)
+{
+    std::lock_guard<std::mutex> guard(mOutgoingMutex);
+
+    mSendBatchPackets = 0 < maxPackets ? maxPackets : 1;
+    mSendBatchSize = maxBytes;
+}
+
+bool TcpConnection::ProtocolViolation(ProtocolError::Code_t code,
+    const ReadOnlyPacket *pPacket, uint32_t offset)
+{
+    bool detailed = ProtocolError::Report(code, GetRemoteAddress(), pPacket,
+        offset);
+
+    SocketError();
+
+    return detailed;
+}
+
 void TcpConnection::SocketError(const String& errorMessage)
 {
     if(!errorMessage.IsEmpty())
     {
-        LOG_ERROR(String("Socket error for client from %1:  %2\n").Arg(
-            GetRemoteAddress()).Arg(errorMessage));
+        LOG_ERROR_FORMAT("Socket error for client from %1:  %2\n",
+            GetRemoteAddress(), errorMessage);
+    }
+
+    // Closing the socket does not stop a receive on the ring (it holds its
+    // own reference to the socket).
+    if(0 != mRingReceive)
+    {
+        mIoUring->Cancel(mRingReceive);
+        mRingReceive = 0;
     }
 
     mSocket.close();
     mStatus = STATUS_NOT_CONNECTED;
+
+    // The remote address may open another connection now.
+    mAddressLease.reset();
+
+    // Errors are reported on the thread that owns the wheel.
+    mIdleTimer.Cancel();
+    mHandshakeTimer.Cancel();
+
+    std::shared_ptr<ConnectionRegistry> registry = mRegistry.lock();
+
+    if(nullptr != registry && INVALID_CONNECTION_ID != mConnectionID)
+    {
+        uint64_t id = mConnectionID;
+        mConnectionID = INVALID_CONNECTION_ID;
+
+        PacketCapture::GetSingletonPtr()->Record(PacketCapture::TYPE_CLOSE,
+            id, 0, nullptr, 0);
+
+        // The registry may hold the last reference to this connection so
+        // only remove it after the handler that called this is done (and
+        // after the handlers the close aborted).
+        GetIoService().post([registry, id]()
+        {
+            (void)registry->Remove(id);
+        });
+    }
 }
 
 void TcpConnection::ConnectionFailed()
@@ -307,6 +1354,18 @@ void TcpConnection::PacketReceived(Packet& packet)
     packet.Clear();
 }
 
+void TcpConnection::StreamReceived(RingBuffer& buffer)
+{
+    // Discard the data.
+    int32_t size = buffer.Available();
+    (void)buffer.EndRead(size);
+}
+
+asio::io_service& TcpConnection::GetIoService()
+{
+    return mSocket.get_io_service();
+}
+
 void TcpConnection::SetEncryptionKey(const std::vector<char>& data)
 {
     SetEncryptionKey(&data[0], data.size());
@@ -348,20 +1407,15 @@ String TcpConnection::GetDiffieHellmanPrime(const DH *pDiffieHellman)
 String TcpConnection::GenerateDiffieHellmanPublic(DH *pDiffieHellman)
 {
     String publicKey;
+    DiffieHellmanKey_t key;
 
-    if(nullptr != pDiffieHellman && nullptr != pDiffieHellman->p &&
-        nullptr != pDiffieHellman->g && 1 == DH_generate_key(pDiffieHellman) &&
-        nullptr != pDiffieHellman->pub_key)
+    if(GenerateDiffieHellmanPublic(pDiffieHellman, key))
     {
-        char *pHexResult = BN_bn2hex(pDiffieHellman->pub_key);
+        char szHex[DH_KEY_HEX_SIZE];
 
-        if(nullptr != pHexResult)
-        {
-            publicKey = String(pHexResult).RightJustified(
-                DH_KEY_HEX_SIZE, '0');
+        EncodeKey(key, szHex);
 
-            OPENSSL_free(pHexResult);
-        }
+        publicKey = String(szHex, DH_KEY_HEX_SIZE);
     }
 
     return publicKey;
@@ -370,53 +1424,190 @@ String TcpConnection::GenerateDiffieHellmanPublic(DH *pDiffieHellman)
 std::vector<char> TcpConnection::GenerateDiffieHellmanSharedData(
     DH *pDiffieHellman, const String& otherPublic)
 {
+    DiffieHellmanKey_t key;
+
+    if(DH_KEY_HEX_SIZE != otherPublic.Length() ||
+        !DecodeKey(otherPublic.C(), key))
+    {
+        return std::vector<char>();
+    }
+
+    return GenerateDiffieHellmanSharedData(pDiffieHellman, key);
+}
+
+bool TcpConnection::GetDiffieHellmanPrime(const DH *pDiffieHellman,
+    DiffieHellmanKey_t& prime)
+{
+    return nullptr != pDiffieHellman && nullptr != pDiffieHellman->p &&
+        DH_KEY_BYTE_SIZE == BN_num_bytes(pDiffieHellman->p) &&
+        NumberToKey(pDiffieHellman->p, prime);
+}
+
+bool TcpConnection::GenerateDiffieHellmanPublic(DH *pDiffieHellman,
+    DiffieHellmanKey_t& publicKey)
+{
+    TRACE_SCOPE("dh");
+
+    // A key pair taken from the key cache has already been generated.
+    return nullptr != pDiffieHellman && nullptr != pDiffieHellman->p &&
+        nullptr != pDiffieHellman->g && (nullptr != pDiffieHellman->pub_key ||
+        1 == DH_generate_key(pDiffieHellman)) &&
+        nullptr != pDiffieHellman->pub_key &&
+        NumberToKey(pDiffieHellman->pub_key, publicKey);
+}
+
+std::vector<char> TcpConnection::GenerateDiffieHellmanSharedData(
+    DH *pDiffieHellman, const DiffieHellmanKey_t& otherPublic)
+{
+    TRACE_SCOPE("dh");
+
     std::vector<char> data;
 
-    unsigned char sharedData[DH_SHARED_DATA_SIZE];
+    if(nullptr == pDiffieHellman || nullptr == pDiffieHellman->p ||
+        nullptr == pDiffieHellman->g || nullptr == pDiffieHellman->pub_key ||
+        nullptr == pDiffieHellman->priv_key ||
+        DH_SHARED_DATA_SIZE != DH_size(pDiffieHellman))
+    {
+        return data;
+    }
+
+    static thread_local DiffieHellmanScratch scratch;
 
-    if(nullptr != pDiffieHellman && nullptr != pDiffieHellman->p &&
-        nullptr != pDiffieHellman->g &&  nullptr != pDiffieHellman->pub_key &&
-        DH_SHARED_DATA_SIZE == DH_size(pDiffieHellman) &&
-        DH_KEY_HEX_SIZE == otherPublic.Length())
+    if(!scratch.IsValid())
     {
-        BIGNUM *pOtherPublic = nullptr;
+        return data;
+    }
 
-        if(0 < BN_hex2bn(&pOtherPublic, otherPublic.C()) &&
-            nullptr != pOtherPublic && BF_NET_KEY_BYTE_SIZE <=
-            DH_compute_key(sharedData, pOtherPublic, pDiffieHellman))
-        {
-            data.insert(data.begin(),
-                reinterpret_cast<const char*>(sharedData),
-                reinterpret_cast<const char*>(sharedData) +
-                DH_SHARED_DATA_SIZE);
-        }
+    BN_MONT_CTX *pMontgomery = scratch.GetMontgomery(pDiffieHellman->p);
+
+    // This is what DH_compute_key does with its own context: the other
+    // public must be in (1, p - 1) and the private key is kept secret by
+    // the constant time exponent.
+    if(nullptr != pMontgomery && nullptr != BN_bin2bn(otherPublic.data(),
+        (int)otherPublic.size(), scratch.otherPublic) &&
+        nullptr != BN_copy(scratch.limit, pDiffieHellman->p) &&
+        1 == BN_sub_word(scratch.limit, 1) &&
+        0 < BN_cmp(scratch.otherPublic, BN_value_one()) &&
+        0 > BN_cmp(scratch.otherPublic, scratch.limit) &&
+        1 == BN_mod_exp_mont_consttime(scratch.shared, scratch.otherPublic,
+        pDiffieHellman->priv_key, pDiffieHellman->p, scratch.context,
+        pMontgomery) && BF_NET_KEY_BYTE_SIZE <= BN_num_bytes(scratch.shared))
+    {
+        // Like DH_compute_key the data is not padded; the encryption key is
+        // the start of it.
+        data.assign(DH_SHARED_DATA_SIZE, 0);
 
-        if(nullptr != pOtherPublic)
-        {
-            BN_clear_free(pOtherPublic);
-            pOtherPublic = nullptr;
-        }
+        BN_bn2bin(scratch.shared, reinterpret_cast<unsigned char*>(&data[0]));
     }
 
+    BN_clear(scratch.otherPublic);
+    BN_clear(scratch.shared);
+
     return data;
 }
 
+void TcpConnection::WriteDiffieHellmanKey(Packet& packet,
+    const DiffieHellmanKey_t& key)
+{
+    char szHex[DH_KEY_HEX_SIZE];
+
+    EncodeKey(key, szHex);
+
+    packet.WriteU32Big(DH_KEY_HEX_SIZE);
+    packet.WriteArray(szHex, DH_KEY_HEX_SIZE);
+}
+
+bool TcpConnection::ReadDiffieHellmanKey(ReadOnlyPacket& packet,
+    DiffieHellmanKey_t& key)
+{
+    if((sizeof(uint32_t) + DH_KEY_HEX_SIZE) > packet.Left() ||
+        DH_KEY_HEX_SIZE != packet.PeekU32Big())
+    {
+        return false;
+    }
+
+    char szHex[DH_KEY_HEX_SIZE];
+
+    packet.Skip(sizeof(uint32_t));
+    packet.ReadArray(szHex, DH_KEY_HEX_SIZE);
+
+    return DecodeKey(szHex, key);
+}
+
 void TcpConnection::BroadcastPacket(const std::list<std::shared_ptr<
-    TcpConnection>>& connections, Packet& packet)
+    TcpConnection>>& connections, Packet& packet, SendPriority_t priority)
 {
     ReadOnlyPacket copy(packet);
 
-    BroadcastPacket(connections, copy);
+    BroadcastPacket(connections, copy, priority);
 }
 
 void TcpConnection::BroadcastPacket(const std::list<std::shared_ptr<
-    TcpConnection>>& connections, ReadOnlyPacket& packet)
+    TcpConnection>>& connections, ReadOnlyPacket& packet,
+    SendPriority_t priority)
+{
+    // Every recipient shares this buffer so it is only encoded once.
+    std::shared_ptr<ReadOnlyPacket> payload(new ReadOnlyPacket(packet));
+
+    PostToOwners(connections, [payload, priority](const std::vector<
+        std::shared_ptr<TcpConnection>>& recipients)
+    {
+        for(auto& recipient : recipients)
+        {
+            // Shallow copy; SendPacket() takes this one.
+            ReadOnlyPacket copy(*payload);
+
+            (void)recipient->SendPacket(copy, priority);
+        }
+    });
+}
+
+void TcpConnection::PostToOwners(const std::list<std::shared_ptr<
+    TcpConnection>>& connections, const std::function<void(
+    const std::vector<std::shared_ptr<TcpConnection>>&)>& job)
 {
+    typedef std::vector<std::shared_ptr<TcpConnection>> Recipients_t;
+
+    // There are only as many groups as there are worker threads so a
+    // linear search is fine.
+    std::vector<std::pair<asio::io_service*,
+        std::shared_ptr<Recipients_t>>> groups;
+
     for(auto connection : connections)
     {
-        if(connection)
+        if(!connection)
+        {
+            continue;
+        }
+
+        asio::io_service *pService = &connection->GetIoService();
+        std::shared_ptr<Recipients_t> recipients;
+
+        for(auto& group : groups)
+        {
+            if(pService == group.first)
+            {
+                recipients = group.second;
+                break;
+            }
+        }
+
+        if(!recipients)
         {
-            connection->SendPacket(packet);
+            recipients.reset(new Recipients_t);
+            groups.push_back(std::make_pair(pService, recipients));
         }
+
+        recipients->push_back(connection);
+    }
+
+    for(auto& group : groups)
+    {
+        std::shared_ptr<Recipients_t> recipients = group.second;
+
+        group.first->post([job, recipients]()
+        {
+            job(*recipients);
+        });
     }
 }
@@ -28,8 +28,14 @@
 #define LIBCOMP_SRC_TCPCONNECTION_H
 
 // libcomp Includes
+#include "Constants.h"
+#include "ObjectPool.h"
 #include "Packet.h"
+#include "ProtocolError.h"
+#include "RingBuffer.h"
+#include "SocketOptions.h"
 #include "String.h"
+#include "TimerWheel.h"
 
 // Boost ASIO Includes
 #include "PushIgnore.h"
@@ -41,14 +47,27 @@
 #include <openssl/blowfish.h>
 
 // Standard C++11 Includes
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace libcomp
 {
 
+class ConnectionRegistry;
+class IoUring;
+
 class TcpConnection
 {
 public:
+    /// Groups the members of each group by their io_service.
+    friend class GroupRegistry;
+
     typedef enum
     {
         ROLE_SERVER = 0,
@@ -64,6 +83,33 @@ public:
         STATUS_ENCRYPTED,
     } ConnectionStatus_t;
 
+    /**
+     * How important an outgoing packet is once the send queue is full.
+     */
+    typedef enum
+    {
+        /// Must be delivered (or the connection closed).
+        PRIORITY_NORMAL = 0,
+        /// May be dropped while the connection is not writable.
+        PRIORITY_LOW,
+    } SendPriority_t;
+
+    /**
+     * What to do with a packet sent while the connection is not writable.
+     */
+    typedef enum
+    {
+        /// Queue the packet anyway.
+        OVERFLOW_QUEUE = 0,
+        /// Drop the packet.
+        OVERFLOW_DROP,
+        /// Drop the packet and close the connection.
+        OVERFLOW_DISCONNECT,
+    } OverflowAction_t;
+
+    /// Diffie-Hellman public key or prime as big endian bytes.
+    typedef std::array<uint8_t, DH_KEY_BYTE_SIZE> DiffieHellmanKey_t;
+
     TcpConnection(asio::io_service& io_service);
     TcpConnection(asio::ip::tcp::socket& socket, DH *pDiffieHellman);
     virtual ~TcpConnection();
@@ -73,13 +119,205 @@ public:
     static std::vector<char> GenerateDiffieHellmanSharedData(
         DH *pDiffieHellman, const String& otherPublic);
 
+    /**
+     * Get the prime of a Diffie-Hellman key without going through hex.
+     * @param pDiffieHellman Key to get the prime of.
+     * @param prime Set to the prime.
+     * @returns true if the prime is the expected size.
+     */
+    static bool GetDiffieHellmanPrime(const DH *pDiffieHellman,
+        DiffieHellmanKey_t& prime);
+
+    /**
+     * Generate the public key (unless it already was) without going
+     * through hex.
+     * @param pDiffieHellman Key to generate the public key of.
+     * @param publicKey Set to the public key.
+     * @returns true if the public key was generated.
+     */
+    static bool GenerateDiffieHellmanPublic(DH *pDiffieHellman,
+        DiffieHellmanKey_t& publicKey);
+
+    /**
+     * Calculate the shared data from the public key of the other side. The
+     * context and big numbers used are kept per thread so a burst of
+     * handshakes does not allocate them for each one.
+     * @param pDiffieHellman Key with the private key of this side.
+     * @param otherPublic Public key of the other side.
+     * @returns Shared data or an empty vector on failure.
+     */
+    static std::vector<char> GenerateDiffieHellmanSharedData(
+        DH *pDiffieHellman, const DiffieHellmanKey_t& otherPublic);
+
+    /**
+     * Write a key as the 32-bit big endian size and hex string the
+     * handshake uses.
+     * @param packet Packet to write the key to.
+     * @param key Key to write.
+     */
+    static void WriteDiffieHellmanKey(Packet& packet,
+        const DiffieHellmanKey_t& key);
+
+    /**
+     * Read a key written by @ref WriteDiffieHellmanKey. Nothing is read
+     * unless the size is @ref DH_KEY_HEX_SIZE and the whole string is there.
+     * @param packet Packet to read the key from.
+     * @param key Set to the key.
+     * @returns true if the key was read and is valid hex.
+     */
+    static bool ReadDiffieHellmanKey(ReadOnlyPacket& packet,
+        DiffieHellmanKey_t& key);
+
     bool Connect(const String& host, int port = 0);
 
-    void SendPacket(Packet& packet);
-    void SendPacket(ReadOnlyPacket& packet);
+    /**
+     * Set the options applied to the socket once it connects. Accepted
+     * connections get the options of their server instead.
+     * @param options Socket options to use.
+     */
+    void SetSocketOptions(const SocketOptions_t& options);
+
+    /**
+     * Queue a packet to be sent. See the ReadOnlyPacket overload.
+     * @param packet Packet to send. The packet keeps its data.
+     * @param priority What may happen to the packet if the queue is full.
+     * @returns true if the packet was queued.
+     */
+    bool SendPacket(Packet& packet, SendPriority_t priority = PRIORITY_NORMAL);
+
+    /**
+     * Queue a packet to be sent. Once the queued bytes would go over the
+     * high watermark the connection is no longer writable and every packet
+     * is passed to @ref OutgoingOverflow until the queue drains to the low
+     * watermark.
+     * @param packet Packet to send. It is moved into the queue.
+     * @param priority What may happen to the packet if the queue is full.
+     * @returns true if the packet was queued; false if it was dropped.
+     */
+    bool SendPacket(ReadOnlyPacket& packet,
+        SendPriority_t priority = PRIORITY_NORMAL);
+
+    /**
+     * Set the send queue watermarks.
+     * @param lowWatermark Queued bytes at which a full connection is
+     *   writable again.
+     * @param highWatermark Queued bytes at which the connection stops being
+     *   writable.
+     */
+    void SetOutgoingLimits(size_t lowWatermark, size_t highWatermark);
+
+    /**
+     * Check if the send queue has room. Check this before building an
+     * expensive payload for a connection that may be a slow reader.
+     * @returns true if packets are queued without going to the overflow
+     *   policy.
+     */
+    bool IsWritable() const;
+
+    /**
+     * Get the number of bytes waiting to be sent.
+     * @returns Number of queued outgoing bytes.
+     */
+    size_t GetOutgoingBytes() const;
+
+    /**
+     * Send the commands a subclass has been holding back to coalesce them
+     * (see LobbyConnection::QueueCommand). A TickLoop calls this at the end
+     * of each tick. The default does nothing.
+     */
+    virtual void FlushCommands();
 
     bool RequestPacket(uint32_t size);
 
+    /**
+     * Read exactly @em size more bytes into the receive packet and pass
+     * them to @em handler instead of @ref PacketReceived. Unlike
+     * @ref RequestPacket the handler only runs once every byte is there so
+     * a protocol step does not have to request the rest itself. The handler
+     * is copied into the read operation (not into a std::function) so a
+     * stackless asio::coroutine can pass itself and resume after the read:
+     * @code
+     * reenter(this)
+     * {
+     *     yield pConnection->AsyncRead(8, *this);
+     *
+     *     // The 8 bytes are in the packet now.
+     * }
+     * @endcode
+     * @param size Number of bytes to read.
+     * @param handler Called as handler(bool success, Packet& packet) on the
+     *   thread of the connection. On failure the socket is closed already.
+     * @returns true if the read was started.
+     */
+    template<typename Handler>
+    bool AsyncRead(uint32_t size, Handler handler)
+    {
+        char *pDestination = PrepareRead(size);
+
+        if(nullptr == pDestination)
+        {
+            return false;
+        }
+
+        asio::async_read(mSocket, asio::buffer(pDestination, size),
+            [this, handler](asio::error_code errorCode,
+                std::size_t length) mutable
+            {
+                bool success = FinishRead(errorCode, length);
+
+                handler(success, mReceivedPacket);
+            });
+
+        return true;
+    }
+
+    /**
+     * Set how many queued packets may be combined into a single write.
+     * @param maxPackets Maximum number of packets per write (at least 1).
+     * @param maxBytes Maximum number of bytes per write. A single packet
+     * larger than this is still sent on its own.
+     */
+    void SetSendBatchLimits(size_t maxPackets, size_t maxBytes);
+
+    /**
+     * Receive into a per-connection ring buffer instead of reading exact
+     * packet sizes. Once @ref RequestStream is called every read takes as
+     * much as the socket has (up to the free space in the buffer) and
+     * @ref StreamReceived is called to consume it.
+     * @param capacity Minimum size of the ring buffer.
+     * @returns true if the ring buffer was created.
+     */
+    bool SetStreamingReceive(int32_t capacity = RECEIVE_BUFFER_SIZE);
+
+    /**
+     * Check if the connection receives into a ring buffer.
+     * @returns true if @ref SetStreamingReceive was successful.
+     */
+    bool IsStreamingReceive() const;
+
+    /**
+     * Only hold a streaming receive buffer while there is data to parse.
+     * An idle connection waits for the socket to be readable without a
+     * buffer and takes one (of @ref RECEIVE_BUFFER_SIZE) from a pool shared
+     * by every connection once data is there. The buffer goes back to the
+     * pool when every frame in it has been parsed. This replaces any
+     * buffer from @ref SetStreamingReceive.
+     * @param enabled If buffers are taken on demand.
+     */
+    void SetReceiveOnDemand(bool enabled);
+
+    /**
+     * Check if the connection takes a receive buffer on demand.
+     * @returns true if @ref SetReceiveOnDemand was enabled.
+     */
+    bool IsReceiveOnDemand() const;
+
+    /**
+     * Get the counters for the pool of on demand receive buffers.
+     * @returns Receive buffer pool counters.
+     */
+    static ObjectPoolStats_t GetReceiveBufferPoolStats();
+
     Role_t GetRole() const;
     ConnectionStatus_t GetStatus() const;
 
@@ -87,28 +325,241 @@ public:
 
     void SetSelf(const std::weak_ptr<libcomp::TcpConnection>& self);
 
+    /**
+     * Remember the registry this connection was added to. The connection
+     * removes itself once the socket is closed.
+     * @param registry Registry holding the connection.
+     * @param id ID of the connection in the registry.
+     */
+    void SetRegistry(const std::weak_ptr<ConnectionRegistry>& registry,
+        uint64_t id);
+
+    /**
+     * Get the ID of the connection in its registry.
+     * @returns ID of the connection or INVALID_CONNECTION_ID.
+     */
+    uint64_t GetConnectionID() const;
+
+    /**
+     * Use a timer wheel for the idle (and handshake) timeouts. The wheel
+     * must be driven by the thread that runs this connection. Without a
+     * wheel the connection never times out.
+     * @param wheel Timer wheel of the io thread of this connection.
+     */
+    void SetTimerWheel(const std::shared_ptr<TimerWheel>& wheel);
+
+    /**
+     * Hold a lease (see @ref AcceptLimiter::Acquire) until the socket is
+     * closed so the connection counts against its remote address.
+     * @param lease Lease of the connection.
+     */
+    void SetAddressLease(const std::shared_ptr<void>& lease);
+
+    /**
+     * Send and (with @ref SetStreamingReceive) receive through an io_uring
+     * instead of the asio reactor. The ring must be run by the io_service
+     * of this connection. Reads of an exact size (@ref RequestPacket and
+     * @ref AsyncRead) still use asio. Needs @ref SetSelf.
+     * @param ring Ring of the io thread of this connection.
+     */
+    void SetIoUring(const std::shared_ptr<IoUring>& ring);
+
+    /**
+     * Close the connection once everything queued to send has been written
+     * instead of dropping it like an error does. This may be called from
+     * any thread; the close happens on the io thread of the connection.
+     * Needs @ref SetSelf.
+     * @param reason Why the connection is closed (for the log).
+     */
+    void Close(const String& reason);
+
     virtual void ConnectionSuccess();
 
+    /**
+     * Send the same packet to many connections. See the ReadOnlyPacket
+     * overload for details.
+     * @param connections Connections to send the packet to.
+     * @param packet Packet to send. The packet keeps its data.
+     */
     static void BroadcastPacket(const std::list<std::shared_ptr<
-        TcpConnection>>& connections, Packet& packet);
+        TcpConnection>>& connections, Packet& packet,
+        SendPriority_t priority = PRIORITY_NORMAL);
+
+    /**
+     * Send the same packet to many connections. Every recipient shares the
+     * one packet buffer (it must not be changed afterwards). The recipients
+     * are grouped by the io_service they run on and each group is posted to
+     * its io_service. The packets are then queued by the thread that owns the
+     * connections, so the calling thread never touches their send queues.
+     * This means the packets are queued after this returns.
+     * @param connections Connections to send the packet to.
+     * @param packet Packet to send. The packet keeps its data.
+     * @param priority What may happen to the packet for a recipient that
+     *   is not writable.
+     */
     static void BroadcastPacket(const std::list<std::shared_ptr<
-        TcpConnection>>& connections, ReadOnlyPacket& packet);
+        TcpConnection>>& connections, ReadOnlyPacket& packet,
+        SendPriority_t priority = PRIORITY_NORMAL);
 
 protected:
     virtual void Connect(const asio::ip::tcp::endpoint& endpoint);
 
+    /**
+     * Make room for @em size more bytes in the receive packet.
+     * @param size Number of bytes that will be read.
+     * @returns Where to write the bytes or null if they do not fit.
+     */
+    char* PrepareRead(uint32_t size);
+
+    /**
+     * Add the bytes of a finished read to the receive packet (or close the
+     * socket if the read failed).
+     * @param errorCode Result of the read.
+     * @param length Number of bytes that were read.
+     * @returns true if the read worked.
+     */
+    bool FinishRead(const asio::error_code& errorCode, std::size_t length);
+
     virtual void SocketError(const String& errorMessage = String());
 
+    /**
+     * Report malformed data from the remote end (see @ref ProtocolError)
+     * and close the connection. Unlike @ref SocketError with a message this
+     * is rate limited so it is safe to call for every bad packet.
+     * @param code Kind of violation.
+     * @param pPacket Packet the violation was found in (may be null).
+     * @param offset Offset into the packet the violation was found at.
+     * @returns true if the report was picked for the detailed diagnostics.
+     */
+    bool ProtocolViolation(ProtocolError::Code_t code,
+        const ReadOnlyPacket *pPacket = nullptr, uint32_t offset = 0);
+
     virtual void ConnectionFailed();
 
     virtual void PacketSent(ReadOnlyPacket& packet);
     virtual void PacketReceived(Packet& packet);
 
+    /**
+     * Called once nothing has been received for @ref TIMEOUT_KEEPALIVE
+     * seconds. A subclass may send something the other side has to answer
+     * so a live peer is not closed after @ref TIMEOUT_SOCKET seconds.
+     */
+    virtual void KeepAlive();
+
+    /**
+     * Decide what to do with a packet sent while the connection is not
+     * writable. This may be called from any thread that sends. By default
+     * low priority packets are dropped and the connection is closed if a
+     * normal packet would go over the high watermark.
+     * @param packet Packet that is being sent.
+     * @param priority Priority the packet was sent with.
+     * @returns What to do with the packet.
+     */
+    virtual OverflowAction_t OutgoingOverflow(const ReadOnlyPacket& packet,
+        SendPriority_t priority);
+
+    /**
+     * Called (on the io thread) once a connection that was not writable
+     * has drained to the low watermark. A subclass that held back traffic
+     * can send it now.
+     */
+    virtual void OutgoingDrained();
+
+    /**
+     * Called (on the io thread) when @ref Close starts. A subclass may send
+     * the traffic it is holding back (or a goodbye) here; it is written
+     * before the socket is closed.
+     * @param reason Why the connection is closed.
+     */
+    virtual void ConnectionClosing(const String& reason);
+
+    /**
+     * Close the connection if @ref StopHandshakeTimeout is not called
+     * within the given time. Needs a timer wheel.
+     * @param seconds Time the handshake may take.
+     */
+    void StartHandshakeTimeout(uint32_t seconds = TIMEOUT_HANDSHAKE);
+
+    /**
+     * Stop the handshake timeout (the handshake is done).
+     */
+    void StopHandshakeTimeout();
+
+    /**
+     * Run work on the io thread that drives the timer wheel of the
+     * connection (right away if called from that thread). The work is
+     * dropped if the connection is closed by then.
+     * @param work Work that may use the timer wheel.
+     * @returns false if the connection has no timer wheel (the work is not
+     *   run).
+     */
+    bool RunOnWheel(const std::function<void()>& work);
+
+    /**
+     * Arm a timer on the wheel of the connection unless it is already
+     * armed (it then keeps its deadline). This may be called from any
+     * thread. The timer must be cancelled by @ref SocketError.
+     * @param timer Timer to arm.
+     * @param delay Milliseconds until the timer fires.
+     * @param callback Function to call on the io thread when it fires.
+     * @returns false if the connection has no timer wheel.
+     */
+    bool ScheduleTimer(TimerWheel::Timer& timer, uint64_t delay,
+        const std::function<void()>& callback);
+
+    /**
+     * Start reading into the streaming receive buffer. Reading continues
+     * after each @ref StreamReceived call until the socket is closed.
+     * @returns true if the read was started.
+     */
+    bool RequestStream();
+
+    /**
+     * Called after data was read into the streaming receive buffer. The
+     * callback should consume every complete message it can. Anything left
+     * stays in the buffer for the next call.
+     * @param buffer Ring buffer holding the received data.
+     */
+    virtual void StreamReceived(RingBuffer& buffer);
+
+    /**
+     * Get the io_service the connection runs on. Use this to post work back
+     * to the thread that owns the connection.
+     * @returns io_service of the socket.
+     */
+    asio::io_service& GetIoService();
+
+    /**
+     * Group connections by the io_service they run on and post @em job to
+     * each io_service with its group. This lets the owning thread of each
+     * connection do the work without any cross-thread locking.
+     * @param connections Connections to group (null entries are skipped).
+     * @param job Work to run on each io_service for its connections.
+     */
+    static void PostToOwners(const std::list<std::shared_ptr<
+        TcpConnection>>& connections, const std::function<void(
+        const std::vector<std::shared_ptr<TcpConnection>>&)>& job);
+
     void SetEncryptionKey(const std::vector<char>& data);
     void SetEncryptionKey(const void *pData, size_t dataSize);
 
 private:
     void SendNextPacket();
+    void SendBuffers(const std::vector<asio::const_buffer>& buffers,
+        size_t packetCount, size_t batchSize);
+    void FinishSend(const asio::error_code& errorCode, std::size_t length,
+        size_t packetCount, size_t batchSize);
+    bool WaitForStream();
+    void StreamReady();
+    void StreamRead(const asio::error_code& errorCode, std::size_t length);
+    bool AcquireReceiveBuffer();
+    bool StartRingReceive();
+    void RingReceived(int32_t result, const uint8_t *pData);
+    void QueuePacket(ReadOnlyPacket& packet, bool& firstPacket);
+    void ArmIdleTimer(uint64_t delay);
+    void IdleTimerExpired();
+    void MarkActivity();
+    void FinishClose();
 
     asio::ip::tcp::socket mSocket;
 
@@ -125,10 +576,40 @@ private:
 
     Packet mReceivedPacket;
 
+    std::shared_ptr<RingBuffer> mReceiveBuffer;
+
     std::mutex mOutgoingMutex;
     std::list<ReadOnlyPacket> mOutgoingPackets;
+    std::atomic<size_t> mOutgoingBytes;
+    std::atomic<bool> mWritable;
+    size_t mOutgoingLowWatermark;
+    size_t mOutgoingHighWatermark;
+    bool mClosing;
+
+    size_t mSendBatchPackets;
+    size_t mSendBatchSize;
 
     String mRemoteAddress;
+
+    std::weak_ptr<ConnectionRegistry> mRegistry;
+    uint64_t mConnectionID;
+    std::shared_ptr<void> mAddressLease;
+
+    // The wheel must outlive the timers armed on it.
+    std::shared_ptr<TimerWheel> mTimerWheel;
+    TimerWheel::Timer mIdleTimer;
+    TimerWheel::Timer mHandshakeTimer;
+    std::chrono::steady_clock::time_point mHandshakeStart;
+    uint64_t mLastActivity;
+    bool mKeepAliveSent;
+
+    SocketOptions_t mSocketOptions;
+
+    // Only used by the io thread.
+    std::shared_ptr<IoUring> mIoUring;
+    uint64_t mRingReceive;
+
+    bool mReceiveOnDemand;
 };
 
 } // namespace libcomp
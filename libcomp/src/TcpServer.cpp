@@ -26,19 +26,52 @@
 
 #include "TcpServer.h"
 
+#include "AcceptLimiter.h"
+#include "ConnectionRegistry.h"
 #include "Constants.h"
+#include "DiffieHellmanCache.h"
+#include "IoUring.h"
 #include "Log.h"
+#include "Metrics.h"
 #include "TcpConnection.h"
+#include "ThreadAffinity.h"
+#include "Tracer.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+#include <chrono>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <unistd.h>
+#endif // !WIN32
 
 using namespace libcomp;
 
-TcpServer::TcpServer(String listenAddress, int port) : mAcceptor(mService),
+TcpServer::TcpServer(String listenAddress, int port, size_t workerCount) :
+    mActiveAcceptors(0), mSocketOptions(SocketOptions::GetDefaults()),
+    mWorkerCount(workerCount), mNextWorker(0),
+    mConnections(new ConnectionRegistry), mAcceptLimiter(new AcceptLimiter),
+    mDraining(false),
+    mHasListenHandle(false), mListenHandle(),
     mDiffieHellman(nullptr), mListenAddress(listenAddress), mPort(port)
 {
+    if(0 == mWorkerCount)
+    {
+        mWorkerCount = std::thread::hardware_concurrency();
+    }
+
+    if(0 == mWorkerCount)
+    {
+        mWorkerCount = 1;
+    }
 }
 
 TcpServer::~TcpServer()
 {
+    StopWorkers();
+
+    mKeyCache.reset();
+
     if(nullptr != mDiffieHellman)
     {
         DH_free(mDiffieHellman);
@@ -49,6 +82,13 @@ int TcpServer::Start()
 {
     asio::ip::tcp::endpoint endpoint;
 
+    // Generating the prime can take a long time so do it (and start filling
+    // the key cache) before any client can connect.
+    if(!PrepareDiffieHellman())
+    {
+        return -1;
+    }
+
     if(mListenAddress.IsEmpty() || "any" == mListenAddress.ToLower())
     {
         endpoint = asio::ip::tcp::endpoint(asio::ip::tcp::v4(), mPort);
@@ -59,18 +99,34 @@ int TcpServer::Start()
             mListenAddress.ToUtf8()), mPort);
     }
 
-    mAcceptor.open(endpoint.protocol());
-    mAcceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
-    mAcceptor.bind(endpoint);
-    mAcceptor.listen();
+    // Connections run on the workers. The workers must be running first so
+    // each of them can get an acceptor.
+    StartWorkers();
 
-    asio::ip::tcp::socket socket(mService);
+    if(!Listen(endpoint))
+    {
+        StopWorkers();
 
-    mAcceptor.async_accept(socket,
-        [this, &socket](asio::error_code errorCode)
-        {
-            AcceptHandler(errorCode, socket);
-        });
+        return -1;
+    }
+
+    mActiveAcceptors = mAcceptors.size();
+
+    if(mReadyHandler)
+    {
+        mReadyHandler();
+    }
+
+    // When the workers accept this thread only waits for them to stop.
+    if(1 < mAcceptors.size())
+    {
+        mServiceWork.reset(new asio::io_service::work(mService));
+    }
+
+    for(size_t i = 0; i < mAcceptors.size(); ++i)
+    {
+        AsyncAccept(i);
+    }
 
     mServiceThread = std::thread([this]()
     {
@@ -79,71 +135,753 @@ int TcpServer::Start()
 
     mServiceThread.join();
 
+    // Every acceptor is closed now so no new connection can be missed.
+    if(mDraining)
+    {
+        DrainConnections();
+    }
+
+    StopWorkers();
+
     return 0;
 }
 
+void TcpServer::Stop(const String& reason, uint32_t timeout)
+{
+    {
+        std::lock_guard<std::mutex> guard(mDrainLock);
+
+        if(mDraining)
+        {
+            return;
+        }
+
+        mDrainReason = reason;
+        mDrainDeadline = std::chrono::steady_clock::now() +
+            std::chrono::seconds(timeout);
+        mDraining = true;
+    }
+
+    LOG_INFO(String("Stopping the server on port %1: %2\n").Arg(
+        mPort).Arg(reason));
+
+    // The acceptors are only touched by the thread that runs them. If
+    // Start() has not got that far yet this runs once it has.
+    mService.post([this]()
+    {
+        CloseAcceptors();
+    });
+}
+
+void TcpServer::SetListenHandle(
+    asio::ip::tcp::acceptor::native_handle_type handle)
+{
+    mListenHandle = handle;
+    mHasListenHandle = true;
+}
+
+bool TcpServer::GetListenHandle(
+    asio::ip::tcp::acceptor::native_handle_type& handle) const
+{
+    if(mAcceptors.empty())
+    {
+        return false;
+    }
+
+    handle = mAcceptors.front()->native_handle();
+
+    return true;
+}
+
+void TcpServer::CloseAcceptors()
+{
+    for(size_t i = 0; i < mAcceptors.size(); ++i)
+    {
+        std::shared_ptr<asio::ip::tcp::acceptor> acceptor = mAcceptors[i];
+
+        // The pending accept fails and AcceptHandler() lets Start() return
+        // once the last acceptor is done.
+        auto closeAcceptor = [this, acceptor, i]()
+        {
+            asio::error_code ignored;
+            acceptor->close(ignored);
+
+            // The ring holds its own reference to the socket so closing it
+            // does not stop an accept there.
+            if(i < mRingAccepts.size() && 0 != mRingAccepts[i])
+            {
+                mWorkerRings[i]->Cancel(mRingAccepts[i]);
+                mRingAccepts[i] = 0;
+
+                asio::ip::tcp::socket socket(*mWorkerServices[i]);
+                AcceptHandler(asio::error::operation_aborted, socket, i, i);
+            }
+        };
+
+        if(1 < mAcceptors.size())
+        {
+            mWorkerServices[i]->post(closeAcceptor);
+        }
+        else
+        {
+            closeAcceptor();
+        }
+    }
+}
+
+void TcpServer::DrainConnections()
+{
+    String reason;
+    std::chrono::steady_clock::time_point deadline;
+
+    {
+        std::lock_guard<std::mutex> guard(mDrainLock);
+
+        reason = mDrainReason;
+        deadline = mDrainDeadline;
+    }
+
+    auto connections = mConnections->Snapshot();
+
+    for(auto connection : *connections)
+    {
+        connection->Close(reason);
+    }
+
+    // Each connection removes itself once its queue is written.
+    while(0 < mConnections->Count() &&
+        std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(
+            DRAIN_POLL_INTERVAL));
+    }
+
+    if(0 < mConnections->Count())
+    {
+        LOG_WARNING(String("Dropping %1 connection(s) that did not close "
+            "in time.\n").Arg(mConnections->Count()));
+    }
+}
+
+size_t TcpServer::GetWorkerCount() const
+{
+    return mWorkerCount;
+}
+
+bool TcpServer::SetDiffieHellman(const String& prime)
+{
+    bool result = false;
+
+    DH *pDiffieHellman = LoadDiffieHellman(prime);
+
+    if(nullptr != pDiffieHellman)
+    {
+        if(nullptr != mDiffieHellman)
+        {
+            DH_free(mDiffieHellman);
+        }
+
+        mDiffieHellman = pDiffieHellman;
+        mKeyCache.reset();
+
+        result = true;
+    }
+
+    return result;
+}
+
+void TcpServer::SetReadyHandler(const std::function<void()>& handler)
+{
+    mReadyHandler = handler;
+}
+
+bool TcpServer::PrepareDiffieHellman()
+{
+    if(!UsesDiffieHellman())
+    {
+        return true;
+    }
+
+    if(nullptr == mDiffieHellman)
+    {
+        // Generate it since we don't have one yet.
+        mDiffieHellman = GenerateDiffieHellman();
+
+        if(nullptr == mDiffieHellman)
+        {
+            LOG_CRITICAL("Failed to generate Diffie-Hellman prime!\n");
+        }
+        else
+        {
+            LOG_WARNING(String("Please add the following to your "
+                "configuration XML: <prime>%1</prime>\n").Arg(
+                    TcpConnection::GetDiffieHellmanPrime(mDiffieHellman)
+                )
+            );
+        }
+    }
+
+    if(nullptr != mDiffieHellman && !mKeyCache)
+    {
+        mKeyCache.reset(new DiffieHellmanCache(mDiffieHellman,
+            DH_KEY_CACHE_SIZE));
+    }
+
+    return nullptr != mDiffieHellman;
+}
+
+asio::io_service& TcpServer::GetNextWorkerService()
+{
+    // Before the workers start (or if they failed to) fall back to the
+    // accept service so a connection always has somewhere to run.
+    if(mWorkerServices.empty())
+    {
+        return mService;
+    }
+
+    asio::io_service& service = *mWorkerServices[mNextWorker];
+
+    mNextWorker = (mNextWorker + 1) % mWorkerServices.size();
+
+    return service;
+}
+
+bool TcpServer::Listen(const asio::ip::tcp::endpoint& endpoint)
+{
+    asio::error_code errorCode;
+    bool reusePort = mSocketOptions.reusePort && 1 < mWorkerServices.size();
+
+    if(mHasListenHandle)
+    {
+        std::shared_ptr<asio::ip::tcp::acceptor> acceptor(
+            new asio::ip::tcp::acceptor(mService));
+
+        acceptor->assign(endpoint.protocol(), mListenHandle, errorCode);
+
+        if(errorCode)
+        {
+            LOG_CRITICAL(String("Failed to use the inherited listen socket: "
+                "%1\n").Arg(errorCode.message()));
+
+            return false;
+        }
+
+        mAcceptors.push_back(acceptor);
+
+        LOG_DEBUG(String("Listening on port %1 with an inherited "
+            "socket.\n").Arg(mPort));
+
+        return true;
+    }
+
+    if(reusePort)
+    {
+        for(auto service : mWorkerServices)
+        {
+            std::shared_ptr<asio::ip::tcp::acceptor> acceptor(
+                new asio::ip::tcp::acceptor(*service));
+
+            if(!SocketOptions::Listen(*acceptor, endpoint, mSocketOptions,
+                true, errorCode))
+            {
+                LOG_WARNING(String("Failed to listen with one acceptor per "
+                    "worker (%1). Using a single acceptor instead.\n").Arg(
+                    errorCode.message()));
+
+                mAcceptors.clear();
+                reusePort = false;
+                break;
+            }
+
+            mAcceptors.push_back(acceptor);
+        }
+    }
+
+    if(!reusePort)
+    {
+        std::shared_ptr<asio::ip::tcp::acceptor> acceptor(
+            new asio::ip::tcp::acceptor(mService));
+
+        if(!SocketOptions::Listen(*acceptor, endpoint, mSocketOptions,
+            false, errorCode))
+        {
+            LOG_CRITICAL(String("Failed to listen on port %1: %2\n").Arg(
+                mPort).Arg(errorCode.message()));
+
+            return false;
+        }
+
+        mAcceptors.push_back(acceptor);
+    }
+
+    LOG_DEBUG(String("Listening on port %1 with %2 acceptor(s).\n").Arg(
+        mPort).Arg(mAcceptors.size()));
+
+    return true;
+}
+
+void TcpServer::AsyncAccept(size_t acceptor)
+{
+    asio::io_service *pService;
+    size_t worker;
+
+    if(1 < mAcceptors.size())
+    {
+        // Each acceptor runs on (and only accepts for) its own worker so the
+        // accept, the handshake and the rest of the connection stay on the
+        // same thread.
+        worker = acceptor;
+        pService = mWorkerServices[worker].get();
+
+        if(RingAccept(acceptor))
+        {
+            return;
+        }
+    }
+    else
+    {
+        worker = mNextWorker;
+        pService = &GetNextWorkerService();
+    }
+
+    // Accept directly into a socket owned by the worker that will run the
+    // connection. The socket is moved into the connection by
+    // CreateConnection() so it only has to live until the handler returns.
+    std::shared_ptr<asio::ip::tcp::socket> socket(
+        new asio::ip::tcp::socket(*pService));
+
+    mAcceptors[acceptor]->async_accept(*socket,
+        [this, socket, acceptor, worker](asio::error_code errorCode)
+        {
+            AcceptHandler(errorCode, *socket, acceptor, worker);
+        });
+}
+
+bool TcpServer::RingAccept(size_t acceptor)
+{
+    std::shared_ptr<IoUring> ring = acceptor < mWorkerRings.size() ?
+        mWorkerRings[acceptor] : nullptr;
+
+    if(nullptr == ring)
+    {
+        return false;
+    }
+
+    // The ring may only be used by its worker. The first accept is started
+    // from the thread that runs Start().
+    mWorkerServices[acceptor]->dispatch([this, acceptor, ring]()
+    {
+        // A multishot accept keeps going after each connection.
+        if(0 != mRingAccepts[acceptor])
+        {
+            return;
+        }
+
+        if(mAcceptors[acceptor]->is_open())
+        {
+            mRingAccepts[acceptor] = ring->Accept(
+                mAcceptors[acceptor]->native_handle(),
+                [this, acceptor](int32_t result)
+                {
+                    RingAccepted(acceptor, result);
+                });
+        }
+
+        if(0 == mRingAccepts[acceptor])
+        {
+            // Let the reactor report the error (or accept instead).
+            std::shared_ptr<asio::ip::tcp::socket> socket(
+                new asio::ip::tcp::socket(*mWorkerServices[acceptor]));
+
+            mAcceptors[acceptor]->async_accept(*socket,
+                [this, socket, acceptor](asio::error_code errorCode)
+                {
+                    AcceptHandler(errorCode, *socket, acceptor, acceptor);
+                });
+        }
+    });
+
+    return true;
+}
+
+void TcpServer::RingAccepted(size_t acceptor, int32_t result)
+{
+    asio::ip::tcp::socket socket(*mWorkerServices[acceptor]);
+    asio::error_code errorCode;
+
+    if(0 > result)
+    {
+        // The accept has stopped.
+        mRingAccepts[acceptor] = 0;
+
+        errorCode = asio::error_code(-result,
+            asio::error::get_system_category());
+    }
+    else
+    {
+        asio::error_code ignored;
+
+        socket.assign(mAcceptors[acceptor]->local_endpoint(
+            ignored).protocol(), result, errorCode);
+
+        if(errorCode)
+        {
+#if !defined(_WIN32) && !defined(_WIN64)
+            ::close(result);
+#endif // !WIN32
+
+            LOG_ERROR(String("Failed to use an accepted socket: %1\n").Arg(
+                errorCode.message()));
+
+            return;
+        }
+    }
+
+    AcceptHandler(errorCode, socket, acceptor, acceptor);
+}
+
+void TcpServer::StartWorkers()
+{
+    if(!mWorkerServices.empty())
+    {
+        return;
+    }
+
+    bool useRing = mSocketOptions.ioUring && IoUring::IsSupported();
+
+    if(mSocketOptions.ioUring && !useRing)
+    {
+        LOG_WARNING("The kernel does not support io_uring. Using the asio "
+            "reactor instead.\n");
+    }
+
+    for(size_t i = 0; i < mWorkerCount; ++i)
+    {
+        std::shared_ptr<asio::io_service> service(new asio::io_service);
+
+        // Keep the worker running while it has no connections.
+        mWorkerWork.emplace_back(*service);
+        mWorkerServices.push_back(service);
+
+        // The wheel is only ever touched by the worker thread.
+        std::shared_ptr<TimerWheel> wheel(new TimerWheel(TIMER_WHEEL_TICK,
+            WheelTime()));
+        std::shared_ptr<asio::steady_timer> ticker(
+            new asio::steady_timer(*service));
+
+        mWorkerWheels.push_back(wheel);
+        mWorkerTickers.push_back(ticker);
+
+        TickWheel(ticker, wheel);
+
+        // The ring is watched by the io_service so it has to be open before
+        // the worker runs.
+        std::shared_ptr<IoUring> ring;
+
+        if(useRing)
+        {
+            ring.reset(new IoUring(*service));
+
+            if(!ring->Open())
+            {
+                LOG_WARNING(String("Failed to open the io_uring of worker "
+                    "%1.\n").Arg(i));
+
+                ring.reset();
+            }
+        }
+
+        mWorkerRings.push_back(ring);
+        mRingAccepts.push_back(0);
+
+        mWorkerThreads.emplace_back([service, i]()
+        {
+            ThreadAffinity::Apply(ThreadAffinity::ROLE_IO, i);
+
+            service->run();
+        });
+    }
+
+    LOG_DEBUG(String("Started %1 connection worker thread(s).\n").Arg(
+        mWorkerCount));
+}
+
+void TcpServer::StopWorkers()
+{
+    mWorkerWork.clear();
+
+    for(auto service : mWorkerServices)
+    {
+        service->stop();
+    }
+
+    for(auto& thread : mWorkerThreads)
+    {
+        thread.join();
+    }
+
+    mWorkerThreads.clear();
+
+    // Sends still on a ring hold their connection so the rings go first.
+    for(auto ring : mWorkerRings)
+    {
+        if(nullptr != ring)
+        {
+            ring->Close();
+        }
+    }
+
+    // The connections and acceptors hold sockets owned by the worker
+    // services so they must go before the services do.
+    mConnections->Clear();
+    mAcceptors.clear();
+    mWorkerTickers.clear();
+    mWorkerWheels.clear();
+    mWorkerRings.clear();
+    mRingAccepts.clear();
+    mWorkerServices.clear();
+}
+
+uint64_t TcpServer::WheelTime()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TcpServer::TickWheel(const std::shared_ptr<asio::steady_timer>& ticker,
+    const std::shared_ptr<TimerWheel>& wheel)
+{
+    ticker->expires_from_now(std::chrono::milliseconds(TIMER_WHEEL_TICK));
+
+    // Only hold a weak reference so stopping the workers frees the wheel.
+    std::weak_ptr<asio::steady_timer> weakTicker(ticker);
+    std::weak_ptr<TimerWheel> weakWheel(wheel);
+
+    ticker->async_wait([weakTicker, weakWheel](asio::error_code errorCode)
+    {
+        std::shared_ptr<asio::steady_timer> t = weakTicker.lock();
+        std::shared_ptr<TimerWheel> w = weakWheel.lock();
+
+        if(!errorCode && nullptr != t && nullptr != w)
+        {
+            w->Advance(WheelTime());
+
+            TickWheel(t, w);
+        }
+    });
+}
+
 std::shared_ptr<TcpConnection> TcpServer::CreateConnection(
     asio::ip::tcp::socket& socket)
 {
     return std::shared_ptr<TcpConnection>(new TcpConnection(socket,
-        CopyDiffieHellman(mDiffieHellman)));
+        TakeDiffieHellman()));
+}
+
+/**
+ * @internal
+ * Get the address the accept limits apply to. An IPv6 host usually has a
+ * whole /64 to pick addresses from so only that prefix is used.
+ * @param address Remote address of a connection.
+ * @returns Address to use with the AcceptLimiter.
+ */
+static AcceptLimiter::Address_t GetLimiterAddress(
+    const asio::ip::address& address)
+{
+    AcceptLimiter::Address_t key;
+
+    if(address.is_v4())
+    {
+        auto bytes = asio::ip::address_v6::v4_mapped(
+            address.to_v4()).to_bytes();
+
+        std::copy(bytes.begin(), bytes.end(), key.begin());
+    }
+    else
+    {
+        asio::ip::address_v6 v6 = address.to_v6();
+        auto bytes = v6.to_bytes();
+
+        std::copy(bytes.begin(), bytes.end(), key.begin());
+
+        if(!v6.is_v4_mapped())
+        {
+            std::fill(key.begin() + 8, key.end(), 0);
+        }
+    }
+
+    return key;
 }
 
 void TcpServer::AcceptHandler(asio::error_code errorCode,
-    asio::ip::tcp::socket& socket)
+    asio::ip::tcp::socket& socket, size_t acceptor, size_t worker)
 {
-    if(errorCode)
+    TRACE_SCOPE("accept");
+
+    // Once the server is stopping a socket that was still accepted is
+    // closed when this returns and the acceptor is not used again.
+    if(errorCode || mDraining)
     {
-        LOG_ERROR(String("async_accept error: %1\n").Arg(errorCode.message()));
+        // A stopping server closed the acceptor itself.
+        if(!mDraining)
+        {
+            LOG_ERROR(String("async_accept error: %1\n").Arg(
+                errorCode.message()));
+        }
+
+        // Let Start() return once no acceptor is left.
+        if(0 == --mActiveAcceptors)
+        {
+            mService.post([this]()
+            {
+                mServiceWork.reset();
+            });
+        }
     }
     else
     {
-        /// @todo Consider moving this.
-        if(nullptr == mDiffieHellman)
+        // Start() makes sure there is a prime before accepting.
+        if(!UsesDiffieHellman() || nullptr != mDiffieHellman)
         {
-            // Generate it since we don't have one yet.
-            mDiffieHellman = GenerateDiffieHellman();
+            asio::error_code endpointError;
+            asio::ip::address address = socket.remote_endpoint(
+                endpointError).address();
+            std::shared_ptr<void> lease;
+
+            // Check the remote address before anything expensive is done
+            // for the connection.
+            AcceptLimiter::Result_t limit = endpointError ?
+                AcceptLimiter::RESULT_ACCEPTED : mAcceptLimiter->Acquire(
+                GetLimiterAddress(address), lease);
+
+            if(AcceptLimiter::RESULT_ACCEPTED != limit)
+            {
+                static MetricCounter& rateLimited = Metrics::
+                    GetSingletonPtr()->Counter("comp_tcp_limited_total",
+                    "Connections closed by the per-address limits.",
+                    "reason=\"rate\"");
+                static MetricCounter& tooMany = Metrics::
+                    GetSingletonPtr()->Counter("comp_tcp_limited_total",
+                    "Connections closed by the per-address limits.",
+                    "reason=\"concurrent\"");
+
+                (AcceptLimiter::RESULT_RATE_LIMITED == limit ?
+                    rateLimited : tooMany).Increment();
+
+                // No logging here; that is what an abusive host would
+                // like to make us do for every attempt.
+                asio::error_code closeError;
+                socket.close(closeError);
+
+                AsyncAccept(acceptor);
+
+                return;
+            }
+
+            LOG_DEBUG_FORMAT("New connection from %1\n",
+                address.to_string());
 
-            if(nullptr == mDiffieHellman)
+            if(!SocketOptions::Apply(socket, mSocketOptions))
             {
-                LOG_CRITICAL("Failed to generate Diffie-Hellman prime!\n");
+                LOG_WARNING("Failed to set the socket options of a new "
+                    "connection.\n");
             }
-            else
+
+            std::shared_ptr<TcpConnection> connection = CreateConnection(
+                socket);
+            uint64_t id = nullptr != connection ? mConnections->Add(
+                connection) : INVALID_CONNECTION_ID;
+
+            static MetricCounter& accepted = Metrics::GetSingletonPtr()->
+                Counter("comp_tcp_accepts_total", "Accepted connections.");
+            static MetricCounter& refused = Metrics::GetSingletonPtr()->
+                Counter("comp_tcp_refused_total", "Connections refused "
+                "because the server was full.");
+
+            if(INVALID_CONNECTION_ID == id)
             {
-                LOG_WARNING(String("Please add the following to your "
-                    "configuration XML: <prime>%1</prime>\n").Arg(
-                        TcpConnection::GetDiffieHellmanPrime(mDiffieHellman)
-                    )
-                );
+                refused.Increment();
+
+                // Nothing has been started on the connection yet so this
+                // closes the socket.
+                LOG_WARNING_FORMAT("Refused connection from %1: there are "
+                    "already %2 connections.\n", connection ?
+                    connection->GetRemoteAddress() : String(),
+                    mConnections->GetMaxConnections());
             }
-        }
+            else
+            {
+                accepted.Increment();
 
-        // Make sure it's correct now.
-        if(nullptr != mDiffieHellman)
-        {
-            LOG_DEBUG(String("New connection from %1\n").Arg(
-                socket.remote_endpoint().address().to_string()));
+                // Register the connection before it can fail so it is
+                // always removed again.
+                connection->SetRegistry(mConnections, id);
+                connection->SetSelf(connection);
+                connection->SetAddressLease(lease);
 
-            mConnections.push_back(CreateConnection(socket));
+                if(worker < mWorkerWheels.size())
+                {
+                    connection->SetTimerWheel(mWorkerWheels[worker]);
+                }
 
-            // This is actually using a different socket because the
-            // CreateConnection() call will use std::move on the socket which
-            // will reset this socket (which is a reference to the local
-            // variable in the Start() function).
-            mAcceptor.async_accept(socket,
-                [this, &socket](asio::error_code errorCode)
+                if(worker < mWorkerRings.size() &&
+                    nullptr != mWorkerRings[worker])
                 {
-                    AcceptHandler(errorCode, socket);
-                });
+                    connection->SetIoUring(mWorkerRings[worker]);
+                }
+
+                connection->ConnectionSuccess();
+            }
+
+            // Accept the next connection (on the next worker if there is only
+            // one acceptor).
+            AsyncAccept(acceptor);
         }
     }
 }
 
+void TcpServer::SetSocketOptions(const SocketOptions_t& options)
+{
+    mSocketOptions = options;
+}
+
+const SocketOptions_t& TcpServer::GetSocketOptions() const
+{
+    return mSocketOptions;
+}
+
+void TcpServer::SetAcceptLimits(double ratePerSecond, uint32_t burst,
+    uint32_t maxPerAddress)
+{
+    mAcceptLimiter.reset(new AcceptLimiter(ratePerSecond, burst,
+        maxPerAddress));
+}
+
+bool TcpServer::UsesDiffieHellman() const
+{
+    return true;
+}
+
 const DH* TcpServer::GetDiffieHellman() const
 {
     return mDiffieHellman;
 }
 
+std::shared_ptr<ConnectionRegistry> TcpServer::GetConnections() const
+{
+    return mConnections;
+}
+
+DH* TcpServer::TakeDiffieHellman()
+{
+    if(mKeyCache)
+    {
+        return mKeyCache->Take();
+    }
+
+    return CopyDiffieHellman(mDiffieHellman);
+}
+
 DH* TcpServer::GenerateDiffieHellman()
 {
     int codes;
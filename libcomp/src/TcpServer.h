@@ -28,7 +28,10 @@
 #define LIBCOMP_SRC_TCPSERVER_H
 
 // libcomp Includes
+#include "Constants.h"
+#include "SocketOptions.h"
 #include "String.h"
+#include "TimerWheel.h"
 
 // Boost ASIO Includes
 #include "PushIgnore.h"
@@ -36,8 +39,14 @@
 #include "PopIgnore.h"
 
 // Standard C++ Includes
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 // OpenSSL Includes
 #include <openssl/dh.h>
@@ -45,16 +54,118 @@
 namespace libcomp
 {
 
+class AcceptLimiter;
+class ConnectionRegistry;
+class DiffieHellmanCache;
+class IoUring;
 class TcpConnection;
 
 class TcpServer
 {
 public:
-    TcpServer(String listenAddress, int port);
+    /**
+     * Create a new server.
+     * @param listenAddress Address to listen on ("any" for all interfaces).
+     * @param port Port to listen on.
+     * @param workerCount Number of worker threads (each with their own
+     * io_service) to run the connections on. Zero will use one worker per
+     * hardware thread.
+     */
+    TcpServer(String listenAddress, int port, size_t workerCount = 0);
     virtual ~TcpServer();
 
     virtual int Start();
 
+    /**
+     * Stop the server gracefully: stop accepting, ask every connection to
+     * @ref TcpConnection::Close once its queued data is written and make
+     * @ref Start return after they are all gone (or after @em timeout). This
+     * may be called from any thread (for example on a signal).
+     * @param reason Why the connections are closed (for the log).
+     * @param timeout Seconds to wait before the remaining connections are
+     *   dropped.
+     */
+    void Stop(const String& reason = "Server is shutting down.",
+        uint32_t timeout = TIMEOUT_DRAIN);
+
+    /**
+     * Listen on a socket that is already bound and listening instead of
+     * opening a new one. This lets a replacement process take over the
+     * listen socket of the process it replaces (see @ref GetListenHandle)
+     * so no connection attempt is refused during a restart. There is only
+     * one acceptor for such a socket. This must be called before
+     * @ref Start.
+     * @param handle Native handle of the inherited listen socket.
+     */
+    void SetListenHandle(asio::ip::tcp::acceptor::native_handle_type handle);
+
+    /**
+     * Get the native handle of the listen socket so it can be passed to a
+     * replacement process (which calls @ref SetListenHandle) before this one
+     * is stopped. With one acceptor per worker each of them has its own
+     * socket; the replacement should then listen with SO_REUSEPORT instead.
+     * @param handle Set to the handle of the first acceptor.
+     * @returns true if the server is listening.
+     */
+    bool GetListenHandle(
+        asio::ip::tcp::acceptor::native_handle_type& handle) const;
+
+    /**
+     * Get the number of worker threads connections are spread across.
+     * @returns Number of worker threads.
+     */
+    size_t GetWorkerCount() const;
+
+    /**
+     * Set the Diffie-Hellman prime to use instead of generating one when the
+     * server starts. This must be called before @ref Start.
+     * @param prime Prime as a hex string.
+     * @returns true if the prime was valid; false otherwise.
+     */
+    bool SetDiffieHellman(const String& prime);
+
+    /**
+     * Load or generate the Diffie-Hellman prime and start filling the key
+     * cache now instead of in @ref Start. This lets it run at the same time
+     * as the other startup work. It must be called before @ref Start.
+     * @returns true if the server has a prime.
+     */
+    bool PrepareDiffieHellman();
+
+    /**
+     * Set a function to call once the server is listening (right before
+     * the first connection may be accepted). It runs on the thread that
+     * called @ref Start. This must be called before @ref Start.
+     * @param handler Function to call.
+     */
+    void SetReadyHandler(const std::function<void()>& handler);
+
+    /**
+     * Set the options for the listen socket(s) and every accepted socket.
+     * This must be called before @ref Start.
+     * @param options Socket options to use.
+     */
+    void SetSocketOptions(const SocketOptions_t& options);
+
+    /**
+     * Get the socket options of the server.
+     * @returns Socket options of the server.
+     */
+    const SocketOptions_t& GetSocketOptions() const;
+
+    /**
+     * Set how many connections each remote address may open. Attempts over
+     * a limit are closed before a connection (or its handshake) is set up.
+     * This must be called before @ref Start.
+     * @param ratePerSecond New connections each address may open per second
+     *   (0 for no rate limit).
+     * @param burst New connections an address may open at once.
+     * @param maxPerAddress Connections each address may have open at the
+     *   same time (0 for no limit).
+     */
+    void SetAcceptLimits(double ratePerSecond, uint32_t burst,
+        uint32_t maxPerAddress);
+
     static DH* GenerateDiffieHellman();
     static DH* LoadDiffieHellman(const String& prime);
     static DH* LoadDiffieHellman(const std::vector<char>& data);
@@ -66,18 +177,104 @@ protected:
     virtual std::shared_ptr<TcpConnection> CreateConnection(
         asio::ip::tcp::socket& socket);
 
+    /**
+     * Check if the connections of this server run the Diffie-Hellman key
+     * exchange. Without it no prime is generated or loaded on start.
+     * @returns true if the server needs a prime.
+     */
+    virtual bool UsesDiffieHellman() const;
+
     const DH* GetDiffieHellman() const;
 
+    /**
+     * Get the Diffie-Hellman object for a new connection. This will be a
+     * pre-generated key pair from the key cache if one is ready; otherwise
+     * it is a copy of the prime and base only.
+     * @returns Diffie-Hellman object the connection will own.
+     */
+    DH* TakeDiffieHellman();
+
+    /**
+     * Get the registry of live connections (for example to broadcast to
+     * a snapshot of them).
+     * @returns Registry of the connections of this server.
+     */
+    std::shared_ptr<ConnectionRegistry> GetConnections() const;
+
+    /**
+     * Handle a new connection from one of the acceptors.
+     * @param errorCode Result of the accept.
+     * @param socket Accepted socket (owned by the worker it should run on).
+     * @param acceptor Index of the acceptor that accepted the socket.
+     * @param worker Index of the worker the socket belongs to.
+     */
     void AcceptHandler(asio::error_code errorCode,
-        asio::ip::tcp::socket& socket);
+        asio::ip::tcp::socket& socket, size_t acceptor, size_t worker);
+
+    /**
+     * Get the io_service of the next worker in round-robin order. Each
+     * worker io_service is run by exactly one thread so every handler of a
+     * connection bound to it runs in order without needing a strand.
+     * @returns Worker io_service a new connection should be bound to.
+     */
+    asio::io_service& GetNextWorkerService();
+
 private:
+    bool Listen(const asio::ip::tcp::endpoint& endpoint);
+    void AsyncAccept(size_t acceptor);
+    bool RingAccept(size_t acceptor);
+    void RingAccepted(size_t acceptor, int32_t result);
+    void StartWorkers();
+    void StopWorkers();
+    void CloseAcceptors();
+    void DrainConnections();
+
+    static uint64_t WheelTime();
+    static void TickWheel(const std::shared_ptr<asio::steady_timer>& ticker,
+        const std::shared_ptr<TimerWheel>& wheel);
+
     asio::io_service mService;
-    asio::ip::tcp::acceptor mAcceptor;
+
+    // Either one acceptor on mService or (with SO_REUSEPORT) one acceptor
+    // on each worker that only accepts connections for that worker.
+    std::vector<std::shared_ptr<asio::ip::tcp::acceptor>> mAcceptors;
+    std::unique_ptr<asio::io_service::work> mServiceWork;
+    std::atomic<size_t> mActiveAcceptors;
+    SocketOptions_t mSocketOptions;
 
     std::thread mServiceThread;
-    std::list<std::shared_ptr<TcpConnection>> mConnections;
+
+    size_t mWorkerCount;
+    size_t mNextWorker;
+    std::vector<std::shared_ptr<asio::io_service>> mWorkerServices;
+    std::list<asio::io_service::work> mWorkerWork;
+    std::list<std::thread> mWorkerThreads;
+
+    // One timer wheel (and the timer that drives it) per worker.
+    std::vector<std::shared_ptr<TimerWheel>> mWorkerWheels;
+    std::vector<std::shared_ptr<asio::steady_timer>> mWorkerTickers;
+
+    // One io_uring per worker (null if it is not used) and the ID of the
+    // multishot accept of the acceptor on that worker (each only touched
+    // by the worker thread).
+    std::vector<std::shared_ptr<IoUring>> mWorkerRings;
+    std::vector<uint64_t> mRingAccepts;
+
+    std::shared_ptr<ConnectionRegistry> mConnections;
+    std::unique_ptr<AcceptLimiter> mAcceptLimiter;
+
+    std::atomic<bool> mDraining;
+    std::mutex mDrainLock;
+    String mDrainReason;
+    std::chrono::steady_clock::time_point mDrainDeadline;
+
+    std::function<void()> mReadyHandler;
+
+    bool mHasListenHandle;
+    asio::ip::tcp::acceptor::native_handle_type mListenHandle;
 
     DH *mDiffieHellman;
+    std::unique_ptr<DiffieHellmanCache> mKeyCache;
 
     String mListenAddress;
     int mPort;
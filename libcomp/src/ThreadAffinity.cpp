@@ -0,0 +1,348 @@
+/**
+ * @file libcomp/src/ThreadAffinity.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief CPU affinity and NUMA placement of the server threads.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ThreadAffinity.h"
+
+// libcomp Includes
+#include "Constants.h"
+#include "Log.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#endif // __linux__
+
+using namespace libcomp;
+
+namespace
+{
+
+/**
+ * @internal
+ * CPUs set for each role.
+ */
+class RoleCpus
+{
+public:
+    std::mutex lock;
+    ThreadAffinity::CpuList_t cpus[ThreadAffinity::ROLE_COUNT];
+};
+
+RoleCpus& GetRoleCpus()
+{
+    static RoleCpus roles;
+
+    return roles;
+}
+
+/**
+ * @internal
+ * Node of the calling thread if it was limited to the CPUs of one node.
+ * @returns Reference to the node (or -1 if the thread may change nodes).
+ */
+int32_t& PinnedNode()
+{
+    static thread_local int32_t node = -1;
+
+    return node;
+}
+
+#if defined(__linux__)
+/**
+ * @internal
+ * Read the node of each CPU from sysfs.
+ * @returns Node of each CPU indexed by the CPU number.
+ */
+std::vector<uint32_t> ReadNodeTable()
+{
+    static const std::string path = "/sys/devices/system/node/";
+
+    std::vector<uint32_t> table;
+    DIR *pDir = opendir(path.c_str());
+
+    if(nullptr == pDir)
+    {
+        return table;
+    }
+
+    struct dirent *pEntry;
+
+    while(nullptr != (pEntry = readdir(pDir)))
+    {
+        unsigned int node;
+        char extra;
+
+        if(1 != sscanf(pEntry->d_name, "node%u%c", &node, &extra))
+        {
+            continue;
+        }
+
+        std::ifstream file(path + pEntry->d_name + "/cpulist");
+        std::string line;
+        ThreadAffinity::CpuList_t cpus;
+
+        if(!std::getline(file, line) ||
+            !ThreadAffinity::ParseCpuList(line, cpus))
+        {
+            continue;
+        }
+
+        for(auto cpu : cpus)
+        {
+            if(cpu >= table.size())
+            {
+                table.resize(cpu + 1, 0);
+            }
+
+            table[cpu] = node;
+        }
+    }
+
+    closedir(pDir);
+
+    return table;
+}
+#endif // __linux__
+
+} // namespace
+
+bool ThreadAffinity::ParseCpuList(const String& spec, CpuList_t& cpus)
+{
+    cpus.clear();
+
+    String trimmed = spec.Trimmed();
+
+    if(trimmed.IsEmpty())
+    {
+        return true;
+    }
+
+    for(const String& part : trimmed.Split(","))
+    {
+        std::list<String> range = part.Split("-");
+        int64_t first = 0, last = 0;
+        bool ok = false;
+
+        if(1 == range.size())
+        {
+            first = last = range.front().Trimmed().ToInteger<int64_t>(&ok);
+        }
+        else if(2 == range.size())
+        {
+            bool lastOK = false;
+
+            first = range.front().Trimmed().ToInteger<int64_t>(&ok);
+            last = range.back().Trimmed().ToInteger<int64_t>(&lastOK);
+            ok = ok && lastOK;
+        }
+
+        if(!ok || 0 > first || first > last || MAX_CPU_COUNT <= last)
+        {
+            cpus.clear();
+
+            return false;
+        }
+
+        for(int64_t cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back((uint32_t)cpu);
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+    return true;
+}
+
+void ThreadAffinity::SetCpus(Role_t role, const CpuList_t& cpus)
+{
+    if(ROLE_COUNT > role)
+    {
+        RoleCpus& roles = GetRoleCpus();
+        std::lock_guard<std::mutex> guard(roles.lock);
+
+        roles.cpus[role] = cpus;
+    }
+}
+
+ThreadAffinity::CpuList_t ThreadAffinity::GetCpus(Role_t role)
+{
+    if(ROLE_COUNT > role)
+    {
+        RoleCpus& roles = GetRoleCpus();
+        std::lock_guard<std::mutex> guard(roles.lock);
+
+        return roles.cpus[role];
+    }
+
+    return CpuList_t();
+}
+
+bool ThreadAffinity::Apply(Role_t role, size_t index)
+{
+    CpuList_t cpus = GetCpus(role);
+
+    if(cpus.empty())
+    {
+        return true;
+    }
+
+    // Connections stay on their network thread so it may as well stay on
+    // one CPU (and keep its caches warm).
+    if(ROLE_IO == role)
+    {
+        cpus = CpuList_t(1, cpus[index % cpus.size()]);
+    }
+
+    if(!SetCurrentThread(cpus))
+    {
+        LOG_WARNING(String("Failed to set the CPU affinity of a thread "
+            "(role %1).\n").Arg(role));
+
+        return false;
+    }
+
+    return true;
+}
+
+bool ThreadAffinity::GetCurrentThread(CpuList_t& cpus)
+{
+    cpus.clear();
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if(0 != pthread_getaffinity_np(pthread_self(), sizeof(set), &set))
+    {
+        return false;
+    }
+
+    for(uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if(CPU_ISSET(cpu, &set))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return true;
+#else // !__linux__
+    return false;
+#endif // __linux__
+}
+
+bool ThreadAffinity::SetCurrentThread(const CpuList_t& cpus)
+{
+    if(cpus.empty())
+    {
+        return false;
+    }
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for(auto cpu : cpus)
+    {
+        if(CPU_SETSIZE <= cpu)
+        {
+            return false;
+        }
+
+        CPU_SET(cpu, &set);
+    }
+
+    if(0 != pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+    {
+        return false;
+    }
+
+    // Remember the node so allocations don't have to look it up.
+    uint32_t node = GetNode(cpus.front());
+
+    for(auto cpu : cpus)
+    {
+        if(GetNode(cpu) != node)
+        {
+            PinnedNode() = -1;
+
+            return true;
+        }
+    }
+
+    PinnedNode() = (int32_t)node;
+
+    return true;
+#else // !__linux__
+    return false;
+#endif // __linux__
+}
+
+uint32_t ThreadAffinity::GetNode(uint32_t cpu)
+{
+#if defined(__linux__)
+    static const std::vector<uint32_t> table = ReadNodeTable();
+
+    if(cpu < table.size())
+    {
+        return table[cpu];
+    }
+#else // !__linux__
+    (void)cpu;
+#endif // __linux__
+
+    return 0;
+}
+
+uint32_t ThreadAffinity::GetCurrentNode()
+{
+    int32_t node = PinnedNode();
+
+    if(0 <= node)
+    {
+        return (uint32_t)node;
+    }
+
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+
+    if(0 <= cpu)
+    {
+        return GetNode((uint32_t)cpu);
+    }
+#endif // __linux__
+
+    return 0;
+}
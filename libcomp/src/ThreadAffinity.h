@@ -0,0 +1,140 @@
+/**
+ * @file libcomp/src/ThreadAffinity.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief CPU affinity and NUMA placement of the server threads.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_THREADAFFINITY_H
+#define LIBCOMP_SRC_THREADAFFINITY_H
+
+// libcomp Includes
+#include "String.h"
+
+// Standard C++11 Includes
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+namespace ThreadAffinity
+{
+
+/// List of CPU numbers.
+typedef std::vector<uint32_t> CpuList_t;
+
+/**
+ * Kind of server thread. Each kind may be placed on its own set of CPUs.
+ */
+typedef enum : uint8_t
+{
+    /// Network threads. Each one is pinned to a single CPU of the set
+    /// (round robin) since its connections never move to another thread.
+    ROLE_IO = 0,
+
+    /// Threads of the worker pools and message schedulers.
+    ROLE_WORKER,
+
+    /// Threads started by the database driver to run query callbacks.
+    ROLE_DATABASE,
+
+    /// Asynchronous log writer thread.
+    ROLE_LOG,
+
+    /// Number of roles.
+    ROLE_COUNT,
+} Role_t;
+
+/**
+ * Parse a list of CPUs in the same format as the Linux cpulist files and
+ * taskset (for example "0-3,8,10-11").
+ * @param spec List of CPUs and ranges of CPUs separated by commas.
+ * @param cpus Set to the CPUs in the list (sorted with no duplicates).
+ * @returns true if the list was valid; false otherwise.
+ */
+bool ParseCpuList(const String& spec, CpuList_t& cpus);
+
+/**
+ * Set the CPUs the threads of a role should run on. This must be set before
+ * the threads of that role are started. An empty list (the default) leaves
+ * the threads wherever the operating system puts them.
+ * @param role Kind of thread.
+ * @param cpus CPUs the threads may run on.
+ */
+void SetCpus(Role_t role, const CpuList_t& cpus);
+
+/**
+ * Get the CPUs the threads of a role should run on.
+ * @param role Kind of thread.
+ * @returns CPUs the threads may run on (empty if they are not placed).
+ */
+CpuList_t GetCpus(Role_t role);
+
+/**
+ * Place the calling thread on the CPUs set for its role. Call this first
+ * thing in a new thread so the memory it touches is allocated on the NUMA
+ * node it will run on.
+ * @param role Kind of thread.
+ * @param index Index of the thread in its pool (picks the CPU of a
+ *   @ref ROLE_IO thread).
+ * @returns true if the thread was placed or no CPUs are set for the role;
+ *   false if the affinity could not be changed.
+ */
+bool Apply(Role_t role, size_t index = 0);
+
+/**
+ * Get the CPUs the calling thread may run on.
+ * @param cpus Set to the CPUs the thread may run on.
+ * @returns true if the affinity was read; false if it is not supported.
+ */
+bool GetCurrentThread(CpuList_t& cpus);
+
+/**
+ * Limit the calling thread to a set of CPUs. Threads it starts afterwards
+ * inherit the same set.
+ * @param cpus CPUs the thread may run on.
+ * @returns true if the affinity was changed; false otherwise.
+ */
+bool SetCurrentThread(const CpuList_t& cpus);
+
+/**
+ * Get the NUMA node a CPU belongs to.
+ * @param cpu CPU number.
+ * @returns Node of the CPU (0 if the system has no NUMA information).
+ */
+uint32_t GetNode(uint32_t cpu);
+
+/**
+ * Get the NUMA node the calling thread runs on. This is cheap enough to
+ * call on every allocation. A thread placed by @ref Apply on CPUs of a
+ * single node always reports that node.
+ * @returns Node of the calling thread.
+ */
+uint32_t GetCurrentNode();
+
+} // namespace ThreadAffinity
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_THREADAFFINITY_H
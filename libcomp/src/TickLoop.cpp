@@ -0,0 +1,389 @@
+/**
+ * @file libcomp/src/TickLoop.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Fixed rate loop that handles queued messages in batches.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TickLoop.h"
+
+// libcomp Includes
+#include "CommandProfiler.h"
+#include "Exception.h"
+#include "Log.h"
+#include "MessagePacket.h"
+#include "MessagePacketFrame.h"
+#include "Metrics.h"
+#include "TcpConnection.h"
+#include "ThreadAffinity.h"
+#include "Tracer.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+
+using namespace libcomp;
+
+/**
+ * @internal
+ * Metrics shared by every tick loop.
+ */
+class TickLoopMetrics
+{
+public:
+    TickLoopMetrics() : duration(Metrics::GetSingletonPtr()->Histogram(
+        "comp_tick_seconds", "Time spent running a tick.")),
+        overruns(Metrics::GetSingletonPtr()->Counter(
+        "comp_tick_overruns_total", "Ticks that took longer than the tick "
+        "interval.")), messages(Metrics::GetSingletonPtr()->Counter(
+        "comp_tick_messages_total", "Messages handled by the tick loop."))
+    {
+    }
+
+    MetricHistogram& duration;
+    MetricCounter& overruns;
+    MetricCounter& messages;
+};
+
+/**
+ * @internal
+ * Get the tick loop metrics.
+ * @returns Metrics shared by every tick loop.
+ */
+static TickLoopMetrics& GetMetrics()
+{
+    static TickLoopMetrics metrics;
+
+    return metrics;
+}
+
+TickLoop::TickLoop(const std::shared_ptr<MessageQueue<
+    Message::Message*>>& queue, const Handler_t& handler, uint32_t interval) :
+    mQueue(queue), mHandler(handler), mInterval(interval), mRunning(false),
+    mTicks(0), mOverruns(0), mMessageCount(0), mLastMicroseconds(0),
+    mMaxMicroseconds(0)
+{
+}
+
+TickLoop::~TickLoop()
+{
+    Stop();
+}
+
+bool TickLoop::Start()
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(mThread.joinable())
+    {
+        return false;
+    }
+
+    mRunning = true;
+    mThread = std::thread([this]()
+    {
+        Run();
+    });
+
+    return true;
+}
+
+void TickLoop::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        mRunning = false;
+    }
+
+    mCondition.notify_all();
+
+    if(mThread.joinable())
+    {
+        mThread.join();
+    }
+}
+
+size_t TickLoop::Tick()
+{
+    TRACE_SCOPE("tick");
+
+    auto start = std::chrono::steady_clock::now();
+
+    (void)mQueue->TryDequeueAll(mMessages);
+
+    mEntries.clear();
+
+    for(size_t i = 0; i < mMessages.size(); ++i)
+    {
+        // A null message is the stop signal of a queue; there is nothing
+        // to handle.
+        if(nullptr != mMessages[i])
+        {
+            Entry_t entry;
+            entry.index = i;
+
+            Describe(mMessages[i], entry);
+
+            mEntries.push_back(entry);
+        }
+    }
+
+    Order();
+
+    for(size_t i : mOrder)
+    {
+        const Entry_t& entry = mEntries[i];
+        Message::Message *pMessage = mMessages[entry.index];
+
+        try
+        {
+            if(nullptr != dynamic_cast<Message::Packet*>(pMessage))
+            {
+                CommandProfiler::HandlerScope profile(entry.commandCode);
+                TRACE_SCOPE("handler");
+
+                mHandler(*pMessage);
+            }
+            else
+            {
+                TRACE_SCOPE("handler");
+
+                mHandler(*pMessage);
+            }
+        }
+        catch(libcomp::Exception& e)
+        {
+            e.Log();
+        }
+        catch(...)
+        {
+            LOG_ERROR("Unhandled exception in a message handler.\n");
+        }
+    }
+
+    // Send what the tick queued for each connection as one frame. The
+    // entries are sorted by connection so each one is flushed once.
+    TcpConnection *pLastConnection = nullptr;
+
+    for(auto& entry : mEntries)
+    {
+        if(nullptr != entry.pConnection &&
+            entry.pConnection != pLastConnection)
+        {
+            pLastConnection = entry.pConnection;
+            pLastConnection->FlushCommands();
+        }
+    }
+
+    for(auto& connection : mFlush)
+    {
+        connection->FlushCommands();
+    }
+
+    mFlush.clear();
+
+    // The messages keep their connections alive until the flush is done.
+    for(auto pMessage : mMessages)
+    {
+        delete pMessage;
+    }
+
+    mMessages.clear();
+
+    size_t handled = mEntries.size();
+    uint64_t microseconds = (uint64_t)std::chrono::duration_cast<
+        std::chrono::microseconds>(std::chrono::steady_clock::now() -
+        start).count();
+
+    mTicks++;
+    mMessageCount += handled;
+    mLastMicroseconds = microseconds;
+
+    if(microseconds > mMaxMicroseconds)
+    {
+        mMaxMicroseconds = microseconds;
+    }
+
+    GetMetrics().duration.Observe(microseconds);
+    GetMetrics().messages.Increment(handled);
+
+    if(microseconds > (uint64_t)std::chrono::duration_cast<
+        std::chrono::microseconds>(mInterval).count())
+    {
+        mOverruns++;
+        GetMetrics().overruns.Increment();
+    }
+
+    return handled;
+}
+
+void TickLoop::FlushAtTickEnd(const std::shared_ptr<
+    TcpConnection>& connection)
+{
+    if(connection)
+    {
+        mFlush.push_back(connection);
+    }
+}
+
+TickStats_t TickLoop::GetStats() const
+{
+    TickStats_t stats;
+    stats.ticks = mTicks;
+    stats.overruns = mOverruns;
+    stats.messages = mMessageCount;
+    stats.lastMicroseconds = mLastMicroseconds;
+    stats.maxMicroseconds = mMaxMicroseconds;
+
+    return stats;
+}
+
+void TickLoop::Run()
+{
+    (void)ThreadAffinity::Apply(ThreadAffinity::ROLE_WORKER);
+
+    auto next = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> uniqueLock(mLock);
+
+    while(mRunning)
+    {
+        uniqueLock.unlock();
+        Tick();
+        uniqueLock.lock();
+
+        // Start right away if the tick ran past the next one.
+        next += mInterval;
+
+        auto now = std::chrono::steady_clock::now();
+
+        if(next < now)
+        {
+            next = now;
+        }
+
+        mCondition.wait_until(uniqueLock, next, [this]()
+        {
+            return !mRunning;
+        });
+    }
+
+    uniqueLock.unlock();
+
+    // Handle whatever was queued before the loop was stopped.
+    Tick();
+}
+
+void TickLoop::Order()
+{
+    // Sorting by connection then queue position keeps the messages of each
+    // connection in the order they were received.
+    std::sort(mEntries.begin(), mEntries.end(), [](const Entry_t& a,
+        const Entry_t& b)
+    {
+        if(a.pConnection != b.pConnection)
+        {
+            return a.pConnection < b.pConnection;
+        }
+
+        return a.index < b.index;
+    });
+
+    mRuns.clear();
+    mHeads.clear();
+    mOrder.clear();
+
+    for(size_t i = 0; i < mEntries.size();)
+    {
+        size_t end = i + 1;
+
+        while(end < mEntries.size() &&
+            mEntries[end].pConnection == mEntries[i].pConnection)
+        {
+            end++;
+        }
+
+        mHeads.push_back(std::make_pair(mEntries[i].commandCode,
+            mRuns.size()));
+        mRuns.push_back(std::make_pair(i, end));
+
+        i = end;
+    }
+
+    // Merge the connections by the command code at the front of each one
+    // (lowest first) so the same handler runs back to back.
+    auto greater = std::greater<std::pair<uint16_t, size_t>>();
+
+    std::make_heap(mHeads.begin(), mHeads.end(), greater);
+
+    while(!mHeads.empty())
+    {
+        std::pop_heap(mHeads.begin(), mHeads.end(), greater);
+
+        uint16_t commandCode = mHeads.back().first;
+        std::pair<size_t, size_t>& run = mRuns[mHeads.back().second];
+
+        while(run.first < run.second &&
+            mEntries[run.first].commandCode == commandCode)
+        {
+            mOrder.push_back(run.first++);
+        }
+
+        if(run.first < run.second)
+        {
+            mHeads.back().first = mEntries[run.first].commandCode;
+            std::push_heap(mHeads.begin(), mHeads.end(), greater);
+        }
+        else
+        {
+            mHeads.pop_back();
+        }
+    }
+}
+
+void TickLoop::Describe(const Message::Message *pMessage, Entry_t& entry)
+{
+    entry.pConnection = nullptr;
+    entry.commandCode = 0;
+
+    auto pPacket = dynamic_cast<const Message::Packet*>(pMessage);
+
+    if(nullptr != pPacket)
+    {
+        entry.pConnection = pPacket->GetConnectionHandle().Get();
+        entry.commandCode = pPacket->GetCommandCode();
+
+        return;
+    }
+
+    auto pFrame = dynamic_cast<const Message::PacketFrame*>(pMessage);
+
+    if(nullptr != pFrame)
+    {
+        entry.pConnection = pFrame->GetConnectionHandle().Get();
+
+        if(0 < pFrame->GetCommandCount())
+        {
+            entry.commandCode = pFrame->GetCommandCode(0);
+        }
+    }
+}
@@ -0,0 +1,233 @@
+/**
+ * @file libcomp/src/TickLoop.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Fixed rate loop that handles queued messages in batches.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_TICKLOOP_H
+#define LIBCOMP_SRC_TICKLOOP_H
+
+// libcomp Includes
+#include "Message.h"
+#include "MessageQueue.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+class TcpConnection;
+
+/**
+ * Counters for the ticks run by a @ref TickLoop.
+ */
+typedef struct
+{
+    /// Number of ticks run.
+    uint64_t ticks;
+
+    /// Number of ticks that took longer than the tick interval.
+    uint64_t overruns;
+
+    /// Number of messages handled.
+    uint64_t messages;
+
+    /// Time the last tick took (microseconds).
+    uint64_t lastMicroseconds;
+
+    /// Longest time a tick took (microseconds).
+    uint64_t maxMicroseconds;
+} TickStats_t;
+
+/**
+ * Game loop that runs at a fixed rate on its own thread. Each tick takes
+ * every message waiting in the queue (into a vector kept between ticks),
+ * orders them so the same command handler runs back to back and then
+ * flushes the commands queued on each connection (see
+ * TcpConnection::FlushCommands) so everything a tick produced for a client
+ * goes out in one frame.
+ *
+ * Messages of one connection are always handled in the order they were
+ * received. Within that rule the connections are merged by command code:
+ * the lowest command code at the front of any connection runs next, for
+ * every connection with that command at its front.
+ *
+ * A tick that takes longer than the interval is counted as an overrun and
+ * the next tick starts right away (missed ticks are not made up).
+ */
+class TickLoop
+{
+public:
+    /// Function that handles a message. The loop deletes the message at
+    /// the end of the tick.
+    typedef std::function<void(Message::Message&)> Handler_t;
+
+    /// Length of a tick unless another is given (in milliseconds).
+    static const uint32_t DEFAULT_INTERVAL = 50;
+
+    /**
+     * Create the loop. It does not run until @ref Start is called.
+     * @param queue Queue to take messages from. Nothing else should
+     *   dequeue from it.
+     * @param handler Function to run for each message.
+     * @param interval Length of a tick (in milliseconds).
+     */
+    TickLoop(const std::shared_ptr<MessageQueue<Message::Message*>>& queue,
+        const Handler_t& handler, uint32_t interval = DEFAULT_INTERVAL);
+
+    /**
+     * Stop the loop (see @ref Stop).
+     */
+    ~TickLoop();
+
+    /**
+     * Start the loop thread.
+     * @returns true if the thread was started; false if it is running.
+     */
+    bool Start();
+
+    /**
+     * Stop the loop thread. One last tick handles the messages that were
+     * still queued.
+     */
+    void Stop();
+
+    /**
+     * Run one tick on the calling thread. This is what the loop thread
+     * runs; it may be called directly if the loop was not started.
+     * @returns Number of messages handled.
+     */
+    size_t Tick();
+
+    /**
+     * Flush the queued commands of a connection at the end of this tick.
+     * The connections that sent a message are flushed anyway; use this for
+     * the other connections a handler queued commands on. Only call this
+     * from a handler.
+     * @param connection Connection to flush.
+     */
+    void FlushAtTickEnd(const std::shared_ptr<TcpConnection>& connection);
+
+    /**
+     * Get the tick counters.
+     * @returns Counters of the loop.
+     */
+    TickStats_t GetStats() const;
+
+private:
+    /**
+     * @internal
+     * Message taken in a tick with the fields it is ordered by.
+     */
+    typedef struct
+    {
+        /// Connection the message came from (null for other messages).
+        TcpConnection *pConnection;
+
+        /// Position of the message in the queue.
+        size_t index;
+
+        /// Command code of the message (the first command of a frame).
+        uint16_t commandCode;
+    } Entry_t;
+
+    /**
+     * @internal
+     * Run ticks until the loop is stopped.
+     */
+    void Run();
+
+    /**
+     * @internal
+     * Fill @ref mOrder with the order to handle @ref mEntries in.
+     */
+    void Order();
+
+    /**
+     * @internal
+     * Get the connection and command code of a message.
+     * @param pMessage Message to look at.
+     * @param entry Entry to fill in.
+     */
+    static void Describe(const Message::Message *pMessage, Entry_t& entry);
+
+    /// Queue the messages are taken from.
+    std::shared_ptr<MessageQueue<Message::Message*>> mQueue;
+
+    /// Function that handles each message.
+    Handler_t mHandler;
+
+    /// Length of a tick.
+    std::chrono::milliseconds mInterval;
+
+    /// Messages taken this tick (kept so the memory is reused).
+    std::vector<Message::Message*> mMessages;
+
+    /// Messages of this tick sorted by connection.
+    std::vector<Entry_t> mEntries;
+
+    /// Next and end index in @ref mEntries of each connection.
+    std::vector<std::pair<size_t, size_t>> mRuns;
+
+    /// Heap of the command code at the front of each connection.
+    std::vector<std::pair<uint16_t, size_t>> mHeads;
+
+    /// Order to handle the entries in.
+    std::vector<size_t> mOrder;
+
+    /// Other connections to flush at the end of the tick.
+    std::vector<std::shared_ptr<TcpConnection>> mFlush;
+
+    /// Loop thread.
+    std::thread mThread;
+
+    /// Set while the loop thread should keep running.
+    bool mRunning;
+
+    /// Lock for @ref mRunning.
+    std::mutex mLock;
+
+    /// Wakes the loop thread when it is stopped.
+    std::condition_variable mCondition;
+
+    std::atomic<uint64_t> mTicks;
+    std::atomic<uint64_t> mOverruns;
+    std::atomic<uint64_t> mMessageCount;
+    std::atomic<uint64_t> mLastMicroseconds;
+    std::atomic<uint64_t> mMaxMicroseconds;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_TICKLOOP_H
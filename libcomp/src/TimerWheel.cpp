@@ -0,0 +1,221 @@
+/**
+ * @file libcomp/src/TimerWheel.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Hierarchical timing wheel for connection timeouts.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TimerWheel.h"
+
+using namespace libcomp;
+
+TimerWheel::Timer::Timer() : mPrev(this), mNext(this), mExpires(0)
+{
+}
+
+TimerWheel::Timer::~Timer()
+{
+    Unlink();
+}
+
+bool TimerWheel::Timer::IsArmed() const
+{
+    return this != mNext;
+}
+
+void TimerWheel::Timer::Cancel()
+{
+    Unlink();
+    mCallback = std::function<void()>();
+}
+
+void TimerWheel::Timer::Unlink()
+{
+    mPrev->mNext = mNext;
+    mNext->mPrev = mPrev;
+    mPrev = this;
+    mNext = this;
+}
+
+TimerWheel::TimerWheel(uint32_t tickLength, uint64_t now) :
+    mTickLength(0 < tickLength ? tickLength : 1), mStartTime(now),
+    mCurrentTick(0), mNow(now)
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    // Leave every timer unarmed so they don't point into this wheel.
+    for(int level = 0; level < LEVEL_COUNT; ++level)
+    {
+        for(int slot = 0; slot < SLOT_COUNT; ++slot)
+        {
+            Timer& list = mSlots[level][slot];
+
+            while(list.IsArmed())
+            {
+                list.mNext->Cancel();
+            }
+        }
+    }
+}
+
+void TimerWheel::Arm(Timer& timer, uint64_t delay,
+    const std::function<void()>& callback)
+{
+    timer.Unlink();
+
+    // Round up so the timer never fires early (and never on this tick).
+    uint64_t ticks = (delay + mTickLength - 1) / mTickLength;
+
+    timer.mExpires = mCurrentTick + (0 < ticks ? ticks : 1);
+    timer.mCallback = callback;
+
+    Insert(timer);
+}
+
+void TimerWheel::Advance(uint64_t now)
+{
+    if(now <= mNow)
+    {
+        return;
+    }
+
+    mNow = now;
+
+    uint64_t targetTick = (now - mStartTime) / mTickLength;
+
+    while(mCurrentTick < targetTick)
+    {
+        mCurrentTick++;
+
+        // Move timers from the outer wheels in when an inner one wraps.
+        for(int level = 1; level < LEVEL_COUNT; ++level)
+        {
+            if(0 != (mCurrentTick & ((1ULL << (level * SLOT_BITS)) - 1)))
+            {
+                break;
+            }
+
+            Cascade(level);
+        }
+
+        // Detach the slot so callbacks can arm timers into it again.
+        Timer expired;
+        Splice(mSlots[0][mCurrentTick & (SLOT_COUNT - 1)], expired);
+
+        while(expired.IsArmed())
+        {
+            Timer& timer = *expired.mNext;
+            timer.Unlink();
+
+            if(timer.mExpires > mCurrentTick)
+            {
+                // Clamped to the outer wheel; not done yet.
+                Insert(timer);
+            }
+            else
+            {
+                // The callback may re-arm the timer so move it out first.
+                std::function<void()> callback = std::move(timer.mCallback);
+                timer.mCallback = std::function<void()>();
+
+                if(callback)
+                {
+                    callback();
+                }
+            }
+        }
+    }
+}
+
+uint64_t TimerWheel::Now() const
+{
+    return mNow;
+}
+
+uint32_t TimerWheel::GetTickLength() const
+{
+    return mTickLength;
+}
+
+void TimerWheel::Insert(Timer& timer)
+{
+    uint64_t delta = timer.mExpires - mCurrentTick;
+    uint64_t expires = timer.mExpires;
+    int level = 0;
+
+    while(level < (LEVEL_COUNT - 1) &&
+        delta >= (1ULL << ((level + 1) * SLOT_BITS)))
+    {
+        level++;
+    }
+
+    // Anything past the outermost wheel waits in its last slot and is
+    // inserted again when it gets there.
+    uint64_t range = 1ULL << (LEVEL_COUNT * SLOT_BITS);
+
+    if(delta >= range)
+    {
+        expires = mCurrentTick + range - 1;
+    }
+
+    Append(mSlots[level][(expires >> (level * SLOT_BITS)) &
+        (SLOT_COUNT - 1)], timer);
+}
+
+void TimerWheel::Cascade(int level)
+{
+    Timer pending;
+    Splice(mSlots[level][(mCurrentTick >> (level * SLOT_BITS)) &
+        (SLOT_COUNT - 1)], pending);
+
+    while(pending.IsArmed())
+    {
+        Timer& timer = *pending.mNext;
+        timer.Unlink();
+
+        Insert(timer);
+    }
+}
+
+void TimerWheel::Append(Timer& list, Timer& timer)
+{
+    timer.mPrev = list.mPrev;
+    timer.mNext = &list;
+    list.mPrev->mNext = &timer;
+    list.mPrev = &timer;
+}
+
+void TimerWheel::Splice(Timer& from, Timer& to)
+{
+    if(from.IsArmed())
+    {
+        to.mNext = from.mNext;
+        to.mPrev = from.mPrev;
+        to.mNext->mPrev = &to;
+        to.mPrev->mNext = &to;
+
+        from.mNext = &from;
+        from.mPrev = &from;
+    }
+}
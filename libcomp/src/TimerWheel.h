@@ -0,0 +1,156 @@
+/**
+ * @file libcomp/src/TimerWheel.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Hierarchical timing wheel for connection timeouts.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_TIMERWHEEL_H
+#define LIBCOMP_SRC_TIMERWHEEL_H
+
+// libcomp Includes
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <functional>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Hierarchical timing wheel. Timers are kept in slots of a few wheels of
+ * increasing tick size (like the hands of a clock) so arming and cancelling
+ * a timer is O(1) no matter how many timers there are. Timers on the outer
+ * wheels move inwards as the time gets closer. The wheel is not thread
+ * safe: each io thread owns its own wheel and drives it with @ref Advance
+ * and only that thread may arm or cancel its timers.
+ */
+class TimerWheel
+{
+public:
+    /**
+     * Timer that can be armed on a wheel. The timer is owned by the user
+     * (for example as a member of a connection) and cancels itself when it
+     * is destroyed.
+     */
+    class Timer
+    {
+    public:
+        Timer();
+        ~Timer();
+
+        /**
+         * Check if the timer is waiting to expire.
+         * @returns true if the timer is armed.
+         */
+        bool IsArmed() const;
+
+        /**
+         * Stop the timer (if it is armed) without calling the callback.
+         */
+        void Cancel();
+
+    private:
+        friend class TimerWheel;
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        void Unlink();
+
+        Timer *mPrev;
+        Timer *mNext;
+        uint64_t mExpires;
+        std::function<void()> mCallback;
+    };
+
+    /**
+     * Create a wheel.
+     * @param tickLength Milliseconds per tick of the innermost wheel.
+     * @param now Current time (in milliseconds).
+     */
+    explicit TimerWheel(uint32_t tickLength = TIMER_WHEEL_TICK,
+        uint64_t now = 0);
+    ~TimerWheel();
+
+    /**
+     * Arm (or re-arm) a timer. The timer fires on the first tick at least
+     * @em delay milliseconds from now.
+     * @param timer Timer to arm.
+     * @param delay Milliseconds until the timer fires.
+     * @param callback Function to call when the timer fires. It may arm or
+     *   cancel any timer (including this one).
+     */
+    void Arm(Timer& timer, uint64_t delay,
+        const std::function<void()>& callback);
+
+    /**
+     * Move the wheel forward and fire every timer that expired.
+     * @param now Current time (in milliseconds).
+     */
+    void Advance(uint64_t now);
+
+    /**
+     * Get the time the wheel was last advanced to.
+     * @returns Time (in milliseconds).
+     */
+    uint64_t Now() const;
+
+    /**
+     * Get the length of a tick.
+     * @returns Milliseconds per tick.
+     */
+    uint32_t GetTickLength() const;
+
+private:
+    /// Number of bits of the tick count each wheel covers.
+    static const int SLOT_BITS = 6;
+
+    /// Number of slots in each wheel.
+    static const int SLOT_COUNT = 1 << SLOT_BITS;
+
+    /// Number of wheels.
+    static const int LEVEL_COUNT = 4;
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    void Insert(Timer& timer);
+    void Cascade(int level);
+
+    static void Append(Timer& list, Timer& timer);
+    static void Splice(Timer& from, Timer& to);
+
+    uint32_t mTickLength;
+    uint64_t mStartTime;
+    uint64_t mCurrentTick;
+    uint64_t mNow;
+
+    /// Sentinel of the (circular) list of timers in each slot.
+    Timer mSlots[LEVEL_COUNT][SLOT_COUNT];
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_TIMERWHEEL_H
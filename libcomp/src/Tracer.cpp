@@ -0,0 +1,236 @@
+/**
+ * @file libcomp/src/Tracer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Records timed spans per thread and exports them as a Chrome trace.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Tracer.h"
+
+// libcomp Includes
+#include "Constants.h"
+
+// Standard C++11 Includes
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+using namespace libcomp;
+
+/// Bit set in the time of an event that ends a span.
+static const uint64_t END_FLAG = 1ULL << 63;
+
+Tracer::Scope::Scope(const char *szName) : mName(nullptr)
+{
+    Tracer *pTracer = Tracer::GetSingletonPtr();
+
+    if(pTracer->IsEnabled())
+    {
+        mName = szName;
+
+        pTracer->Begin(szName);
+    }
+}
+
+Tracer::Scope::~Scope()
+{
+    // The end is recorded even if tracing was turned off in the meantime
+    // so the span is not left open.
+    if(nullptr != mName)
+    {
+        Tracer::GetSingletonPtr()->End(mName);
+    }
+}
+
+Tracer::ThreadBuffer::ThreadBuffer(uint32_t threadID) : id(threadID),
+    head(0), start(0), events(TRACE_BUFFER_EVENTS)
+{
+}
+
+Tracer::Tracer() : mStart(std::chrono::steady_clock::now()), mEnabled(false)
+{
+}
+
+Tracer* Tracer::GetSingletonPtr()
+{
+    // This is never freed on purpose; spans may still end on other threads
+    // while static objects are being destroyed.
+    static Tracer *pTracer = new Tracer;
+
+    return pTracer;
+}
+
+void Tracer::SetEnabled(bool enabled)
+{
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Tracer::IsEnabled() const
+{
+    return mEnabled.load(std::memory_order_relaxed);
+}
+
+void Tracer::Begin(const char *szName)
+{
+    Record(szName, false);
+}
+
+void Tracer::End(const char *szName)
+{
+    Record(szName, true);
+}
+
+void Tracer::Clear()
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    for(auto pBuffer : mBuffers)
+    {
+        pBuffer->start.store(pBuffer->head.load(std::memory_order_acquire),
+            std::memory_order_relaxed);
+    }
+}
+
+String Tracer::ExportChromeJson() const
+{
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    char szEvent[256];
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    for(auto pBuffer : mBuffers)
+    {
+        uint64_t head = pBuffer->head.load(std::memory_order_acquire);
+        uint64_t begin = std::max(pBuffer->start.load(
+            std::memory_order_relaxed), TRACE_BUFFER_EVENTS < head ?
+            head - TRACE_BUFFER_EVENTS : 0);
+
+        std::vector<std::pair<const char*, uint64_t>> events;
+        events.reserve((size_t)(head - begin));
+
+        for(uint64_t i = begin; i < head; ++i)
+        {
+            const Event& event = pBuffer->events[(size_t)(
+                i % TRACE_BUFFER_EVENTS)];
+
+            events.push_back(std::make_pair(event.name.load(
+                std::memory_order_relaxed), event.time.load(
+                std::memory_order_relaxed)));
+        }
+
+        // Drop anything the thread may have overwritten while it was read
+        // (including the slot it may be writing right now).
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        uint64_t newHead = pBuffer->head.load(std::memory_order_relaxed);
+        uint64_t skip = 0;
+
+        if(newHead >= begin + TRACE_BUFFER_EVENTS)
+        {
+            skip = std::min((uint64_t)events.size(),
+                newHead - begin - TRACE_BUFFER_EVENTS + 1);
+        }
+
+        int depth = 0;
+
+        for(size_t i = (size_t)skip; i < events.size(); ++i)
+        {
+            bool end = 0 != (events[i].second & END_FLAG);
+            uint64_t time = events[i].second & ~END_FLAG;
+
+            // The start of the span was overwritten.
+            if(end && 0 == depth)
+            {
+                continue;
+            }
+
+            depth += end ? -1 : 1;
+
+            // Times are in microseconds.
+            snprintf(szEvent, sizeof(szEvent), "%s{\"name\":\"%s\","
+                "\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03u,\"pid\":1,"
+                "\"tid\":%u}", first ? "" : ",", events[i].first,
+                end ? 'E' : 'B', time / 1000, (unsigned int)(time % 1000),
+                pBuffer->id);
+
+            json += szEvent;
+            first = false;
+        }
+    }
+
+    json += "],\"displayTimeUnit\":\"ms\"}\n";
+
+    return json;
+}
+
+bool Tracer::WriteChromeJson(const String& path) const
+{
+    String json = ExportChromeJson();
+
+    std::ofstream out(path.C(), std::ofstream::out | std::ofstream::binary |
+        std::ofstream::trunc);
+    out.write(json.C(), (std::streamsize)json.Size());
+
+    return out.good();
+}
+
+void Tracer::Record(const char *szName, bool end)
+{
+    ThreadBuffer *pBuffer = GetThreadBuffer();
+
+    uint64_t time = (uint64_t)std::chrono::duration_cast<
+        std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+        mStart).count();
+
+    if(end)
+    {
+        time |= END_FLAG;
+    }
+
+    // Only this thread writes the ring so a relaxed load of the head is
+    // enough; the release store publishes the event to an export.
+    uint64_t head = pBuffer->head.load(std::memory_order_relaxed);
+    Event& event = pBuffer->events[(size_t)(head % TRACE_BUFFER_EVENTS)];
+
+    event.name.store(szName, std::memory_order_relaxed);
+    event.time.store(time, std::memory_order_relaxed);
+
+    pBuffer->head.store(head + 1, std::memory_order_release);
+}
+
+Tracer::ThreadBuffer* Tracer::GetThreadBuffer()
+{
+    static thread_local ThreadBuffer *pBuffer = nullptr;
+
+    if(nullptr == pBuffer)
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        pBuffer = new ThreadBuffer((uint32_t)mBuffers.size() + 1);
+        mBuffers.push_back(pBuffer);
+    }
+
+    return pBuffer;
+}
@@ -0,0 +1,222 @@
+/**
+ * @file libcomp/src/Tracer.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Records timed spans per thread and exports them as a Chrome trace.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_TRACER_H
+#define LIBCOMP_SRC_TRACER_H
+
+// libcomp Includes
+#include "String.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Records the begin and end of named spans into a ring of events for each
+ * thread and exports them in the Chrome trace event format (which
+ * chrome://tracing and the Perfetto UI both open). A thread only touches
+ * its own ring so recording takes no lock. Nothing is recorded until the
+ * tracer is enabled.
+ *
+ * The spans in the library are added with @ref TRACE_SCOPE, which is
+ * compiled out unless the build is configured with TRACING (which defines
+ * COMP_TRACING).
+ */
+class Tracer
+{
+public:
+    /**
+     * Records a span from its creation to the end of the scope.
+     */
+    class Scope
+    {
+    public:
+        /**
+         * Begin the span.
+         * @param szName Name of the span. This must be a string literal
+         *   (only the pointer is kept).
+         */
+        explicit Scope(const char *szName);
+
+        /**
+         * End the span (if it was begun).
+         */
+        ~Scope();
+
+        Scope(const Scope& other) = delete;
+        Scope& operator=(const Scope& other) = delete;
+
+    private:
+        /// Name of the span or null if tracing was off when it began.
+        const char *mName;
+    };
+
+    /**
+     * Get the tracer.
+     * @returns Pointer to the tracer.
+     */
+    static Tracer* GetSingletonPtr();
+
+    /**
+     * Turn tracing on or off. Recorded events are kept.
+     * @param enabled If spans should be recorded.
+     */
+    void SetEnabled(bool enabled);
+
+    /**
+     * Check if tracing is on.
+     * @returns true if spans are being recorded.
+     */
+    bool IsEnabled() const;
+
+    /**
+     * Record the start of a span on the calling thread.
+     * @param szName Name of the span (a string literal).
+     */
+    void Begin(const char *szName);
+
+    /**
+     * Record the end of a span on the calling thread.
+     * @param szName Name of the span (a string literal).
+     */
+    void End(const char *szName);
+
+    /**
+     * Drop every event recorded so far.
+     */
+    void Clear();
+
+    /**
+     * Write the events of every thread in the Chrome trace event (JSON)
+     * format. This may be called while other threads are recording; events
+     * they overwrite during the export are left out.
+     * @returns JSON text of the trace.
+     */
+    String ExportChromeJson() const;
+
+    /**
+     * Write the events of every thread to a file in the Chrome trace event
+     * format.
+     * @param path Path of the file to write.
+     * @returns true if the file was written.
+     */
+    bool WriteChromeJson(const String& path) const;
+
+private:
+    Tracer();
+
+    /**
+     * @internal
+     * One recorded event. The fields are atomic only so an export may read
+     * them while the thread is still recording.
+     */
+    class Event
+    {
+    public:
+        /// Name of the span.
+        std::atomic<const char*> name;
+
+        /// Nanoseconds since the tracer was created. The top bit is set for
+        /// the end of a span.
+        std::atomic<uint64_t> time;
+    };
+
+    /**
+     * @internal
+     * Ring of events recorded by one thread.
+     */
+    class ThreadBuffer
+    {
+    public:
+        ThreadBuffer(uint32_t threadID);
+
+        /// Number of the thread in the trace.
+        uint32_t id;
+
+        /// Number of events ever recorded.
+        std::atomic<uint64_t> head;
+
+        /// Number of events recorded before the last @ref Clear.
+        std::atomic<uint64_t> start;
+
+        /// Ring of events (TRACE_BUFFER_EVENTS long).
+        std::vector<Event> events;
+    };
+
+    /**
+     * @internal
+     * Record an event on the calling thread.
+     * @param szName Name of the span.
+     * @param end true for the end of a span.
+     */
+    void Record(const char *szName, bool end);
+
+    /**
+     * @internal
+     * Get the ring of the calling thread (creating it the first time).
+     * @returns Ring of the calling thread.
+     */
+    ThreadBuffer* GetThreadBuffer();
+
+    /// Time the events are measured from.
+    std::chrono::steady_clock::time_point mStart;
+
+    /// Set if spans are being recorded.
+    std::atomic<bool> mEnabled;
+
+    /// Ring of every thread that has recorded an event. These are never
+    /// freed so an export always has the events of threads that exited.
+    std::vector<ThreadBuffer*> mBuffers;
+
+    /// Lock for the list of rings.
+    mutable std::mutex mLock;
+};
+
+} // namespace libcomp
+
+#if defined(COMP_TRACING)
+#define TRACE_SCOPE_NAME_INNER(line) traceScope ## line
+#define TRACE_SCOPE_NAME(line) TRACE_SCOPE_NAME_INNER(line)
+
+/**
+ * Record a span named @em name from here to the end of the scope. This is
+ * compiled out unless COMP_TRACING is defined.
+ * @param name Name of the span (a string literal).
+ */
+#define TRACE_SCOPE(name) \
+    libcomp::Tracer::Scope TRACE_SCOPE_NAME(__LINE__)(name)
+#else // !COMP_TRACING
+#define TRACE_SCOPE(name) do { } while(0)
+#endif // COMP_TRACING
+
+#endif // LIBCOMP_SRC_TRACER_H
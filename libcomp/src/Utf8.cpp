@@ -0,0 +1,210 @@
+/**
+ * @file libcomp/src/Utf8.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Vectorized UTF-8 and ASCII helpers.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Utf8.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LIBCOMP_UTF8_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define LIBCOMP_UTF8_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+using namespace libcomp;
+
+#ifdef LIBCOMP_UTF8_SSE2
+/**
+ * @internal
+ * Get the index of the lowest set bit.
+ * @param mask Non-zero mask.
+ * @returns Index of the lowest set bit.
+ */
+static size_t LowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+
+    return (size_t)index;
+#else // _MSC_VER
+    return (size_t)__builtin_ctz(mask);
+#endif // _MSC_VER
+}
+#endif // LIBCOMP_UTF8_SSE2
+
+size_t Utf8::CountCodePoints(const char *pData, size_t size)
+{
+    size_t continuations = 0;
+    size_t i = 0;
+
+#if defined(LIBCOMP_UTF8_SSE2)
+    // As signed bytes the continuation bytes (0x80 - 0xBF) are the only ones
+    // below -64. Each compare gives -1 per continuation byte which is
+    // subtracted from per byte counters; those are summed before they can
+    // overflow (every 255 blocks).
+    const __m128i limit = _mm_set1_epi8(-64);
+    const __m128i zero = _mm_setzero_si128();
+
+    while((i + 16) <= size)
+    {
+        size_t blocks = (size - i) / 16;
+        blocks = 255 < blocks ? 255 : blocks;
+
+        __m128i counts = zero;
+
+        for(size_t b = 0; b < blocks; ++b, i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                pData + i));
+
+            counts = _mm_sub_epi8(counts, _mm_cmplt_epi8(v, limit));
+        }
+
+        __m128i sums = _mm_sad_epu8(counts, zero);
+
+        continuations += (size_t)_mm_cvtsi128_si32(sums) +
+            (size_t)_mm_extract_epi16(sums, 4);
+    }
+#elif defined(LIBCOMP_UTF8_NEON)
+    const int8x16_t limit = vdupq_n_s8(-64);
+
+    while((i + 16) <= size)
+    {
+        size_t blocks = (size - i) / 16;
+        blocks = 255 < blocks ? 255 : blocks;
+
+        uint8x16_t counts = vdupq_n_u8(0);
+
+        for(size_t b = 0; b < blocks; ++b, i += 16)
+        {
+            int8x16_t v = vld1q_s8(reinterpret_cast<const int8_t*>(
+                pData + i));
+
+            counts = vsubq_u8(counts, vcltq_s8(v, limit));
+        }
+
+        continuations += (size_t)vaddlvq_u8(counts);
+    }
+#endif
+
+    for(; i < size; ++i)
+    {
+        if(0x80 == (pData[i] & 0xC0))
+        {
+            continuations++;
+        }
+    }
+
+    return size - continuations;
+}
+
+size_t Utf8::AsciiRun(const uint8_t *pData, size_t size)
+{
+    size_t i = 0;
+
+#if defined(LIBCOMP_UTF8_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+
+    for(; (i + 16) <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+            pData + i));
+
+        // The sign bit marks a non-ASCII byte.
+        uint32_t mask = (uint32_t)(_mm_movemask_epi8(v) |
+            _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+
+        if(0 != mask)
+        {
+            return i + LowestBit(mask);
+        }
+    }
+#elif defined(LIBCOMP_UTF8_NEON)
+    const uint8x16_t high = vdupq_n_u8(0x80);
+
+    for(; (i + 16) <= size; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(pData + i);
+        uint8x16_t stop = vorrq_u8(vcgeq_u8(v, high), vceqq_u8(v,
+            vdupq_n_u8(0)));
+
+        // Let the byte loop find where in the block it stops.
+        if(0 != vmaxvq_u8(stop))
+        {
+            break;
+        }
+    }
+#endif
+
+    while(i < size && 0 != pData[i] && 0 == (pData[i] & 0x80))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+size_t Utf8::Encode(uint32_t cp, char *pDestination)
+{
+    unsigned char *bytes = reinterpret_cast<unsigned char*>(pDestination);
+
+    // For the UTF-8 encoding format, see: https://en.wikipedia.org/wiki/UTF-8
+    if(0x80 > cp)
+    {
+        bytes[0] = (unsigned char)(cp & 0x7F);
+
+        return 1;
+    }
+    else if(0x800 > cp)
+    {
+        bytes[0] = (unsigned char)(0xC0 | ((cp >> 6) & 0x1F));
+        bytes[1] = (unsigned char)(0x80 | (cp & 0x3F));
+
+        return 2;
+    }
+    else if(0x10000 > cp)
+    {
+        bytes[0] = (unsigned char)(0xE0 | ((cp >> 12) & 0x0F));
+        bytes[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[2] = (unsigned char)(0x80 | (cp & 0x3F));
+
+        return 3;
+    }
+    else
+    {
+        bytes[0] = (unsigned char)(0xF0 | ((cp >> 18) & 0x07));
+        bytes[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+        bytes[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[3] = (unsigned char)(0x80 | (cp & 0x3F));
+
+        return 4;
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * @file libcomp/src/Utf8.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Vectorized UTF-8 and ASCII helpers.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_UTF8_H
+#define LIBCOMP_SRC_UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Helpers for the hot loops of String and Convert. Most player names and
+ * chat are pure ASCII so the scans work on 16 bytes at a time (SSE2 or
+ * NEON when the compiler targets them) and fall back to a byte loop.
+ */
+namespace Utf8
+{
+
+/**
+ * Count the code points in UTF-8 data (every byte that is not a
+ * continuation byte).
+ * @param pData UTF-8 data.
+ * @param size Number of bytes of data.
+ * @returns Number of code points.
+ */
+size_t CountCodePoints(const char *pData, size_t size);
+
+/**
+ * Count the leading bytes that are ASCII (and not a null terminator).
+ * @param pData Data to scan.
+ * @param size Number of bytes that may be read.
+ * @returns Number of leading ASCII bytes.
+ */
+size_t AsciiRun(const uint8_t *pData, size_t size);
+
+/**
+ * Encode a code point as UTF-8.
+ * @param cp Code point to encode.
+ * @param pDestination Buffer of at least 4 bytes.
+ * @returns Number of bytes written.
+ */
+size_t Encode(uint32_t cp, char *pDestination);
+
+} // namespace Utf8
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_UTF8_H
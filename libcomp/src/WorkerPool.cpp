@@ -0,0 +1,189 @@
+/**
+ * @file libcomp/src/WorkerPool.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Pool of threads that run queued work.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WorkerPool.h"
+
+// libcomp Includes
+#include "Exception.h"
+#include "Log.h"
+#include "ThreadAffinity.h"
+
+using namespace libcomp;
+
+WorkerPool::WorkerPool(size_t threadCount, size_t maxQueued) :
+    mMaxQueued(maxQueued), mRunning(true)
+{
+    mStats.completed = 0;
+    mStats.rejected = 0;
+    mStats.queued = 0;
+    mStats.totalLatency = 0;
+    mStats.maxLatency = 0;
+
+    if(0 == threadCount)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    if(0 == threadCount)
+    {
+        threadCount = 1;
+    }
+
+    for(size_t i = 0; i < threadCount; ++i)
+    {
+        mThreads.emplace_back([this, i]()
+        {
+            ThreadAffinity::Apply(ThreadAffinity::ROLE_WORKER, i);
+
+            Run();
+        });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    Stop();
+}
+
+void WorkerPool::Stop()
+{
+    // Drop the jobs outside of the lock; they may own objects that submit
+    // more work when they are destroyed.
+    std::deque<QueuedJob_t> dropped;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        mRunning = false;
+        mQueue.swap(dropped);
+        mStats.queued = 0;
+    }
+
+    mCondition.notify_all();
+
+    for(auto& thread : mThreads)
+    {
+        if(thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+bool WorkerPool::Submit(const Job_t& job)
+{
+    bool result = false;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        if(mRunning && mQueue.size() < mMaxQueued)
+        {
+            QueuedJob_t queued;
+            queued.job = job;
+            queued.submitted = std::chrono::steady_clock::now();
+
+            mQueue.push_back(queued);
+            mStats.queued = mQueue.size();
+
+            result = true;
+        }
+        else
+        {
+            mStats.rejected++;
+        }
+    }
+
+    if(result)
+    {
+        mCondition.notify_one();
+    }
+
+    return result;
+}
+
+size_t WorkerPool::GetThreadCount() const
+{
+    return mThreads.size();
+}
+
+WorkerPoolStats_t WorkerPool::GetStats() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mStats;
+}
+
+void WorkerPool::Run()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while(mRunning)
+    {
+        mCondition.wait(lock, [this]()
+        {
+            return !mRunning || !mQueue.empty();
+        });
+
+        if(!mRunning)
+        {
+            break;
+        }
+
+        QueuedJob_t queued = mQueue.front();
+        mQueue.pop_front();
+        mStats.queued = mQueue.size();
+
+        lock.unlock();
+
+        try
+        {
+            queued.job();
+        }
+        catch(libcomp::Exception& e)
+        {
+            e.Log();
+        }
+        catch(...)
+        {
+            LOG_ERROR("Unhandled exception in a worker pool job.\n");
+        }
+
+        uint64_t latency = (uint64_t)std::chrono::duration_cast<
+            std::chrono::microseconds>(std::chrono::steady_clock::now() -
+            queued.submitted).count();
+
+        lock.lock();
+
+        mStats.completed++;
+        mStats.totalLatency += latency;
+
+        if(latency > mStats.maxLatency)
+        {
+            mStats.maxLatency = latency;
+        }
+    }
+}
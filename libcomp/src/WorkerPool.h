@@ -0,0 +1,143 @@
+/**
+ * @file libcomp/src/WorkerPool.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Pool of threads that run queued work.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_WORKERPOOL_H
+#define LIBCOMP_SRC_WORKERPOOL_H
+
+// Standard C++11 Includes
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Counters for the work run by a @ref WorkerPool. The latency of a job is
+ * measured from when it was submitted until it finished running.
+ */
+typedef struct
+{
+    /// Number of jobs that finished.
+    uint64_t completed;
+
+    /// Number of jobs rejected because the queue was full.
+    uint64_t rejected;
+
+    /// Number of jobs waiting in the queue.
+    uint64_t queued;
+
+    /// Sum of the latency of every finished job (in microseconds).
+    uint64_t totalLatency;
+
+    /// Highest latency of a finished job (in microseconds).
+    uint64_t maxLatency;
+} WorkerPoolStats_t;
+
+/**
+ * Fixed number of threads that run jobs from a bounded queue. This is used
+ * to move expensive work (like the Diffie-Hellman key exchange) off of the
+ * network threads. A job that has to report back to a connection should
+ * post the result to the io_service of that connection.
+ */
+class WorkerPool
+{
+public:
+    /// Job to run on a worker thread.
+    typedef std::function<void()> Job_t;
+
+    /**
+     * Create and start the worker threads.
+     * @param threadCount Number of threads (zero will use one per hardware
+     * thread).
+     * @param maxQueued Maximum number of jobs that may wait in the queue.
+     */
+    WorkerPool(size_t threadCount, size_t maxQueued);
+
+    /**
+     * Stop the worker threads (see @ref Stop).
+     */
+    ~WorkerPool();
+
+    /**
+     * Stop the worker threads. Jobs that have not started are dropped and
+     * this waits for the running jobs to finish. No new jobs are accepted
+     * afterwards.
+     */
+    void Stop();
+
+    /**
+     * Queue a job to be run by one of the worker threads.
+     * @param job Job to run.
+     * @returns true if the job was queued; false if the queue is full.
+     */
+    bool Submit(const Job_t& job);
+
+    /**
+     * Get the number of worker threads.
+     * @returns Number of worker threads.
+     */
+    size_t GetThreadCount() const;
+
+    /**
+     * Get the current counters.
+     * @returns Worker pool counters.
+     */
+    WorkerPoolStats_t GetStats() const;
+
+private:
+    /**
+     * @internal
+     * Job and the time it was submitted.
+     */
+    typedef struct
+    {
+        Job_t job;
+        std::chrono::steady_clock::time_point submitted;
+    } QueuedJob_t;
+
+    void Run();
+
+    size_t mMaxQueued;
+    bool mRunning;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCondition;
+    std::deque<QueuedJob_t> mQueue;
+    std::list<std::thread> mThreads;
+
+    WorkerPoolStats_t mStats;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_WORKERPOOL_H
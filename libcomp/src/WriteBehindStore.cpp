@@ -0,0 +1,418 @@
+/**
+ * @file libcomp/src/WriteBehindStore.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief In memory store of entity fields written to the database later.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WriteBehindStore.h"
+
+// libcomp Includes
+#include "DatabaseBatch.h"
+#include "Log.h"
+#include "ThreadAffinity.h"
+
+using namespace libcomp;
+
+WriteBehindStore::WriteBehindStore(const std::shared_ptr<DatabasePool>& pool,
+    const String& table, const String& keyColumn,
+    const std::vector<String>& columns, std::chrono::milliseconds interval) :
+    mPool(pool), mKeyColumn(keyColumn), mColumns(columns),
+    mInterval(interval), mRunning(false), mUpdates(0), mCollapsed(0),
+    mWritten(0), mFlushes(0), mFailures(0)
+{
+    // Each field always uses the same statement so it stays prepared.
+    for(auto& column : mColumns)
+    {
+        mStatements.push_back(String("UPDATE %1 SET %2 = ? WHERE %3 = ?;"
+            ).Arg(table).Arg(column).Arg(keyColumn));
+    }
+}
+
+WriteBehindStore::~WriteBehindStore()
+{
+    Stop();
+}
+
+void WriteBehindStore::Start()
+{
+    std::lock_guard<std::mutex> guard(mRunLock);
+
+    if(!mRunning)
+    {
+        mRunning = true;
+
+        mFlusher = std::thread([this]()
+        {
+            ThreadAffinity::Apply(ThreadAffinity::ROLE_DATABASE);
+
+            Run();
+        });
+    }
+}
+
+void WriteBehindStore::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(mRunLock);
+
+        mRunning = false;
+    }
+
+    mRunCondition.notify_all();
+
+    if(mFlusher.joinable())
+    {
+        mFlusher.join();
+    }
+
+    if(!Flush())
+    {
+        LOG_ERROR(String("Failed to write %1 entities while stopping.\n").Arg(
+            GetDirtyCount()));
+    }
+}
+
+bool WriteBehindStore::Load(const String& key,
+    const std::vector<String>& values)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(mEntities.end() != mEntities.find(key.ToUtf8()))
+    {
+        return false;
+    }
+
+    Entity& entity = GetEntity(key);
+
+    for(size_t i = 0; i < values.size() && i < mColumns.size(); ++i)
+    {
+        entity.values[i] = values[i];
+    }
+
+    return true;
+}
+
+bool WriteBehindStore::Set(const String& key, size_t field,
+    const String& value)
+{
+    if(field >= mColumns.size())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    Entity& entity = GetEntity(key);
+    entity.values[field] = value;
+
+    uint64_t& word = entity.dirty[field / 64];
+    uint64_t bit = (uint64_t)1 << (field % 64);
+
+    mUpdates++;
+
+    if(0 != (word & bit))
+    {
+        // Already waiting; the newest value is the one written.
+        mCollapsed++;
+    }
+    else
+    {
+        word |= bit;
+    }
+
+    if(!entity.queued)
+    {
+        entity.queued = true;
+
+        mDirtyKeys.push_back(key.ToUtf8());
+    }
+
+    return true;
+}
+
+bool WriteBehindStore::Get(const String& key, size_t field,
+    String& value) const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mEntities.find(key.ToUtf8());
+
+    if(mEntities.end() == it || field >= mColumns.size())
+    {
+        return false;
+    }
+
+    value = it->second.values[field];
+
+    return true;
+}
+
+size_t WriteBehindStore::GetField(const String& column) const
+{
+    size_t field = 0;
+
+    while(field < mColumns.size() && column != mColumns[field])
+    {
+        field++;
+    }
+
+    return field;
+}
+
+bool WriteBehindStore::Release(const String& key)
+{
+    std::lock_guard<std::mutex> writeGuard(mWriteLock);
+
+    std::vector<Write_t> writes;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        auto it = mEntities.find(key.ToUtf8());
+
+        if(mEntities.end() == it)
+        {
+            return false;
+        }
+
+        TakeDirty(key, it->second, writes);
+    }
+
+    bool result = Write(writes);
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    auto it = mEntities.find(key.ToUtf8());
+
+    // Keep it if it could not be written or was changed again.
+    if(result && mEntities.end() != it && !it->second.queued)
+    {
+        mEntities.erase(it);
+    }
+
+    return result;
+}
+
+bool WriteBehindStore::Flush()
+{
+    // Batches are written one at a time so an older value of a field can
+    // never be written after a newer one.
+    std::lock_guard<std::mutex> writeGuard(mWriteLock);
+
+    std::vector<Write_t> writes;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        std::vector<std::string> keys;
+        keys.swap(mDirtyKeys);
+
+        for(auto& key : keys)
+        {
+            auto it = mEntities.find(key);
+
+            // Released entities may still be listed.
+            if(mEntities.end() != it)
+            {
+                TakeDirty(key, it->second, writes);
+            }
+        }
+    }
+
+    return Write(writes);
+}
+
+size_t WriteBehindStore::GetDirtyCount() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    size_t count = 0;
+
+    for(auto& key : mDirtyKeys)
+    {
+        auto it = mEntities.find(key);
+
+        if(mEntities.end() != it && it->second.queued)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+size_t WriteBehindStore::Count() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mEntities.size();
+}
+
+WriteBehindStats_t WriteBehindStore::GetStats() const
+{
+    WriteBehindStats_t stats;
+    stats.updates = mUpdates;
+    stats.collapsed = mCollapsed;
+    stats.written = mWritten;
+    stats.flushes = mFlushes;
+    stats.failures = mFailures;
+
+    return stats;
+}
+
+WriteBehindStore::Entity& WriteBehindStore::GetEntity(const String& key)
+{
+    std::string id = key.ToUtf8();
+
+    auto it = mEntities.find(id);
+
+    if(mEntities.end() != it)
+    {
+        return it->second;
+    }
+
+    Entity& entity = mEntities[id];
+    entity.values.resize(mColumns.size());
+    entity.dirty.resize((mColumns.size() + 63) / 64, 0);
+    entity.queued = false;
+
+    return entity;
+}
+
+void WriteBehindStore::TakeDirty(const String& key, Entity& entity,
+    std::vector<Write_t>& writes)
+{
+    for(size_t i = 0; i < entity.dirty.size(); ++i)
+    {
+        uint64_t word = entity.dirty[i];
+
+        while(0 != word)
+        {
+            size_t bit = 0;
+
+            while(0 == (word & ((uint64_t)1 << bit)))
+            {
+                bit++;
+            }
+
+            word &= ~((uint64_t)1 << bit);
+
+            Write_t write;
+            write.key = key;
+            write.field = i * 64 + bit;
+            write.value = entity.values[write.field];
+
+            writes.push_back(write);
+        }
+
+        entity.dirty[i] = 0;
+    }
+
+    entity.queued = false;
+}
+
+bool WriteBehindStore::Write(const std::vector<Write_t>& writes)
+{
+    if(writes.empty())
+    {
+        return true;
+    }
+
+    std::shared_ptr<Database> db = nullptr != mPool ? mPool->Acquire() :
+        nullptr;
+
+    bool result = nullptr != db;
+
+    if(result)
+    {
+        DatabaseBatch batch = db->CreateBatch();
+
+        for(auto& write : writes)
+        {
+            DatabaseQuery query = db->Prepare(mStatements[write.field]);
+
+            if(!query.IsValid() || !query.Bind(0, write.value) ||
+                !query.Bind(1, write.key) || !batch.Add(query))
+            {
+                result = false;
+                break;
+            }
+        }
+
+        result = result && batch.Execute();
+    }
+
+    mFlushes++;
+
+    if(result)
+    {
+        mWritten += writes.size();
+
+        return true;
+    }
+
+    mFailures++;
+
+    LOG_ERROR(String("Failed to write %1 fields to the database.\n").Arg(
+        writes.size()));
+
+    // The values in memory are at least as new as the ones that failed so
+    // the fields are only marked dirty again.
+    std::lock_guard<std::mutex> guard(mLock);
+
+    for(auto& write : writes)
+    {
+        Entity& entity = GetEntity(write.key);
+        entity.dirty[write.field / 64] |= (uint64_t)1 << (write.field % 64);
+
+        if(!entity.queued)
+        {
+            entity.queued = true;
+
+            mDirtyKeys.push_back(write.key.ToUtf8());
+        }
+    }
+
+    return false;
+}
+
+void WriteBehindStore::Run()
+{
+    std::unique_lock<std::mutex> uniqueLock(mRunLock);
+
+    while(mRunning)
+    {
+        mRunCondition.wait_for(uniqueLock, mInterval);
+
+        if(!mRunning)
+        {
+            break;
+        }
+
+        uniqueLock.unlock();
+
+        (void)Flush();
+
+        uniqueLock.lock();
+    }
+}
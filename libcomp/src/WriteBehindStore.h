@@ -0,0 +1,243 @@
+/**
+ * @file libcomp/src/WriteBehindStore.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief In memory store of entity fields written to the database later.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_SRC_WRITEBEHINDSTORE_H
+#define LIBCOMP_SRC_WRITEBEHINDSTORE_H
+
+// libcomp Includes
+#include "Constants.h"
+#include "DatabasePool.h"
+#include "String.h"
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace libcomp
+{
+
+/**
+ * Counters describing how much work a @ref WriteBehindStore saved.
+ */
+typedef struct
+{
+    /// Number of field changes.
+    uint64_t updates;
+
+    /// Number of changes to a field that was already waiting to be written
+    /// (these cost no extra database write).
+    uint64_t collapsed;
+
+    /// Number of field writes sent to the database.
+    uint64_t written;
+
+    /// Number of batches sent to the database.
+    uint64_t flushes;
+
+    /// Number of batches that failed (their fields are written again).
+    uint64_t failures;
+} WriteBehindStats_t;
+
+/**
+ * Store of entities (such as characters) whose fields change often: the
+ * position, expertise, valuables and quest masks. Changes are kept in
+ * memory and each field has a dirty bit. A background thread writes the
+ * dirty fields every interval as one batch of "UPDATE table SET column =
+ * ? WHERE key = ?" statements, so any number of changes to a field between
+ * two flushes is one write. The rate of database writes is bounded by the
+ * number of fields, not by how active the players are. An entity is
+ * written right away when it is released (on logout). A failed batch marks
+ * its fields dirty again so nothing is lost. Every method may be called
+ * from any thread.
+ */
+class WriteBehindStore
+{
+public:
+    /**
+     * Create a store. Call @ref Start to start the background flush.
+     * @param pool Database connections to write with.
+     * @param table Table holding the entities.
+     * @param keyColumn Column with the ID of each entity.
+     * @param columns Column of each field. A field is named by its index
+     *   in this list.
+     * @param interval Time between background flushes.
+     */
+    WriteBehindStore(const std::shared_ptr<DatabasePool>& pool,
+        const String& table, const String& keyColumn,
+        const std::vector<String>& columns,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(
+        WRITE_BEHIND_INTERVAL));
+
+    /**
+     * Stop the background flush and write every dirty field.
+     */
+    ~WriteBehindStore();
+
+    /**
+     * Start writing the dirty fields in the background.
+     */
+    void Start();
+
+    /**
+     * Stop the background flush and write every dirty field.
+     */
+    void Stop();
+
+    /**
+     * Add an entity with the values read from the database. The values are
+     * not dirty. An entity that is already in the store is not changed.
+     * @param key ID of the entity.
+     * @param values Value of each field (missing fields are empty).
+     * @returns true if the entity was added.
+     */
+    bool Load(const String& key, const std::vector<String>& values);
+
+    /**
+     * Change a field. The entity is added if it is not in the store.
+     * @param key ID of the entity.
+     * @param field Index of the field.
+     * @param value New value of the field.
+     * @returns true if the field exists.
+     */
+    bool Set(const String& key, size_t field, const String& value);
+
+    /**
+     * Get the value of a field.
+     * @param key ID of the entity.
+     * @param field Index of the field.
+     * @param value Set to the value of the field.
+     * @returns true if the entity is in the store and the field exists.
+     */
+    bool Get(const String& key, size_t field, String& value) const;
+
+    /**
+     * Get the index of a field.
+     * @param column Column of the field.
+     * @returns Index of the field or the number of fields if there is no
+     *   such column.
+     */
+    size_t GetField(const String& column) const;
+
+    /**
+     * Write the dirty fields of an entity now and remove it from the store
+     * (when the player logs out).
+     * @param key ID of the entity.
+     * @returns true if the entity was in the store and its fields were
+     *   written. If the write fails the entity is kept and written by the
+     *   next flush.
+     */
+    bool Release(const String& key);
+
+    /**
+     * Write every dirty field now.
+     * @returns true if the fields were written (or none were dirty).
+     */
+    bool Flush();
+
+    /**
+     * Get the number of entities with at least one dirty field.
+     * @returns Number of dirty entities.
+     */
+    size_t GetDirtyCount() const;
+
+    /**
+     * Get the number of entities in the store.
+     * @returns Number of entities.
+     */
+    size_t Count() const;
+
+    /**
+     * Get the current counters.
+     * @returns Store counters.
+     */
+    WriteBehindStats_t GetStats() const;
+
+private:
+    /**
+     * @internal
+     * Fields of one entity.
+     */
+    class Entity
+    {
+    public:
+        std::vector<String> values;
+        std::vector<uint64_t> dirty;
+        bool queued;
+    };
+
+    /**
+     * @internal
+     * One field to write.
+     */
+    typedef struct
+    {
+        String key;
+        size_t field;
+        String value;
+    } Write_t;
+
+    Entity& GetEntity(const String& key);
+    void TakeDirty(const String& key, Entity& entity,
+        std::vector<Write_t>& writes);
+    bool Write(const std::vector<Write_t>& writes);
+    void Run();
+
+    std::shared_ptr<DatabasePool> mPool;
+    String mKeyColumn;
+    std::vector<String> mColumns;
+    std::vector<String> mStatements;
+    std::chrono::milliseconds mInterval;
+
+    mutable std::mutex mLock;
+    std::unordered_map<std::string, Entity> mEntities;
+    std::vector<std::string> mDirtyKeys;
+
+    /// Only one batch is written at a time so writes stay in order.
+    std::mutex mWriteLock;
+
+    std::mutex mRunLock;
+    std::condition_variable mRunCondition;
+    bool mRunning;
+    std::thread mFlusher;
+
+    std::atomic<uint64_t> mUpdates;
+    std::atomic<uint64_t> mCollapsed;
+    std::atomic<uint64_t> mWritten;
+    std::atomic<uint64_t> mFlushes;
+    std::atomic<uint64_t> mFailures;
+};
+
+} // namespace libcomp
+
+#endif // LIBCOMP_SRC_WRITEBEHINDSTORE_H
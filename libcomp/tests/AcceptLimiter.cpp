@@ -0,0 +1,148 @@
+/**
+ * @file libcomp/tests/AcceptLimiter.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the AcceptLimiter class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <AcceptLimiter.h>
+
+using namespace libcomp;
+
+static AcceptLimiter::Address_t MakeAddress(uint8_t last)
+{
+    AcceptLimiter::Address_t address = { { 0 } };
+    address[10] = 0xFF;
+    address[11] = 0xFF;
+    address[12] = 10;
+    address[15] = last;
+
+    return address;
+}
+
+TEST(AcceptLimiter, Rate)
+{
+    // 2 per second with a burst of 4 and no concurrent limit.
+    AcceptLimiter limiter(2, 4, 0, 64);
+    AcceptLimiter::Address_t a = MakeAddress(1);
+    AcceptLimiter::Address_t b = MakeAddress(2);
+    std::shared_ptr<void> lease;
+
+    for(int i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(limiter.Acquire(a, lease, 1000),
+            AcceptLimiter::RESULT_ACCEPTED);
+    }
+
+    EXPECT_EQ(limiter.Acquire(a, lease, 1000),
+        AcceptLimiter::RESULT_RATE_LIMITED);
+
+    // Another address has its own bucket.
+    EXPECT_EQ(limiter.Acquire(b, lease, 1000),
+        AcceptLimiter::RESULT_ACCEPTED);
+
+    // Half a second buys one more connection.
+    EXPECT_EQ(limiter.Acquire(a, lease, 1500),
+        AcceptLimiter::RESULT_ACCEPTED);
+    EXPECT_EQ(limiter.Acquire(a, lease, 1500),
+        AcceptLimiter::RESULT_RATE_LIMITED);
+
+    // The bucket never holds more than the burst.
+    for(int i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(limiter.Acquire(a, lease, 100000),
+            AcceptLimiter::RESULT_ACCEPTED);
+    }
+
+    EXPECT_EQ(limiter.Acquire(a, lease, 100000),
+        AcceptLimiter::RESULT_RATE_LIMITED);
+}
+
+TEST(AcceptLimiter, Concurrent)
+{
+    AcceptLimiter limiter(0, 1, 2, 64);
+    AcceptLimiter::Address_t a = MakeAddress(1);
+
+    std::shared_ptr<void> first, second, third;
+
+    EXPECT_EQ(limiter.Acquire(a, first, 0), AcceptLimiter::RESULT_ACCEPTED);
+    EXPECT_EQ(limiter.Acquire(a, second, 0), AcceptLimiter::RESULT_ACCEPTED);
+    EXPECT_EQ(limiter.GetConnectionCount(a), 2u);
+    EXPECT_EQ(limiter.Acquire(a, third, 0),
+        AcceptLimiter::RESULT_TOO_MANY_CONNECTIONS);
+
+    // Dropping the last reference to a lease frees the connection.
+    std::shared_ptr<void> copy = first;
+    first.reset();
+    EXPECT_EQ(limiter.GetConnectionCount(a), 2u);
+    copy.reset();
+    EXPECT_EQ(limiter.GetConnectionCount(a), 1u);
+
+    EXPECT_EQ(limiter.Acquire(a, third, 0), AcceptLimiter::RESULT_ACCEPTED);
+    EXPECT_EQ(limiter.GetConnectionCount(a), 2u);
+}
+
+TEST(AcceptLimiter, FullTable)
+{
+    // One slot per shard is rounded up to the probe window.
+    AcceptLimiter limiter(1, 1, 1, 1);
+    std::vector<std::shared_ptr<void>> leases;
+
+    // Far more busy addresses than slots; the ones that don't fit are let
+    // in without a lease.
+    for(int i = 0; i < 250; ++i)
+    {
+        std::shared_ptr<void> lease;
+
+        EXPECT_EQ(limiter.Acquire(MakeAddress((uint8_t)i), lease, 0),
+            AcceptLimiter::RESULT_ACCEPTED);
+
+        leases.push_back(lease);
+    }
+
+    // Once every lease is gone and the buckets refill the slots are reused.
+    leases.clear();
+
+    std::shared_ptr<void> lease;
+
+    EXPECT_EQ(limiter.Acquire(MakeAddress(1), lease, 10000),
+        AcceptLimiter::RESULT_ACCEPTED);
+    EXPECT_EQ(limiter.GetConnectionCount(MakeAddress(1)), 1u);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,55 @@
+/**
+ * @file libcomp/tests/AllocationCheck.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test helpers that check a code path does not allocate.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_TESTS_ALLOCATIONCHECK_H
+#define LIBCOMP_TESTS_ALLOCATIONCHECK_H
+
+#include <AllocationTracker.h>
+
+/**
+ * Expect a statement to make no heap allocations on the calling thread.
+ * The statement always runs; the check is only made when the build counts
+ * allocations (see libcomp::AllocationTracker::IsEnabled).
+ * @param statement Code to run.
+ */
+#define EXPECT_NO_ALLOCATIONS(statement) \
+    do \
+    { \
+        libcomp::AllocationTracker::AllocationCounts_t allocationsBefore = \
+            libcomp::AllocationTracker::GetThreadTotal(); \
+        statement; \
+        libcomp::AllocationTracker::AllocationCounts_t allocationsAfter = \
+            libcomp::AllocationTracker::GetThreadTotal(); \
+        if(libcomp::AllocationTracker::IsEnabled()) \
+        { \
+            EXPECT_EQ(0u, allocationsAfter.allocations - \
+                allocationsBefore.allocations) << #statement \
+                " allocated " << (allocationsAfter.bytes - \
+                allocationsBefore.bytes) << " bytes"; \
+        } \
+    } while(0)
+
+#endif // LIBCOMP_TESTS_ALLOCATIONCHECK_H
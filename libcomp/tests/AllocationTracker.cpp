@@ -0,0 +1,145 @@
+/**
+ * @file libcomp/tests/AllocationTracker.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the AllocationTracker class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include "AllocationCheck.h"
+
+#include <AllocationTracker.h>
+
+// Standard C++11 Includes
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+TEST(AllocationTracker, Scopes)
+{
+    AllocationTracker::AllocationCounts_t recvBefore =
+        AllocationTracker::GetThreadCounts(AllocationTracker::TAG_RECV);
+    AllocationTracker::AllocationCounts_t sendBefore =
+        AllocationTracker::GetThreadCounts(AllocationTracker::TAG_SEND);
+
+    {
+        AllocationTracker::Scope recv(AllocationTracker::TAG_RECV);
+
+        std::unique_ptr<int> value(new int(1));
+
+        {
+            AllocationTracker::Scope send(AllocationTracker::TAG_SEND);
+
+            std::unique_ptr<char[]> buffer(new char[100]);
+        }
+
+        // Back to the outer tag.
+        std::unique_ptr<int> other(new int(2));
+    }
+
+    AllocationTracker::AllocationCounts_t recv =
+        AllocationTracker::GetThreadCounts(AllocationTracker::TAG_RECV);
+    AllocationTracker::AllocationCounts_t send =
+        AllocationTracker::GetThreadCounts(AllocationTracker::TAG_SEND);
+
+    if(!AllocationTracker::IsEnabled())
+    {
+        EXPECT_EQ(0u, recv.allocations);
+        EXPECT_EQ(0u, send.allocations);
+
+        return;
+    }
+
+    EXPECT_EQ(2u, recv.allocations - recvBefore.allocations);
+    EXPECT_EQ(2 * sizeof(int), recv.bytes - recvBefore.bytes);
+    EXPECT_EQ(2u, recv.frees - recvBefore.frees);
+    EXPECT_EQ(1u, send.allocations - sendBefore.allocations);
+    EXPECT_EQ(100u, send.bytes - sendBefore.bytes);
+    EXPECT_EQ(1u, send.frees - sendBefore.frees);
+}
+
+TEST(AllocationTracker, Threads)
+{
+    AllocationTracker::AllocationCounts_t before =
+        AllocationTracker::GetCounts(AllocationTracker::TAG_PARSE);
+
+    // The counts of a thread are kept after it exits.
+    std::thread thread([]()
+    {
+        AllocationTracker::Scope parse(AllocationTracker::TAG_PARSE);
+
+        for(int i = 0; i < 10; ++i)
+        {
+            delete new int(i);
+        }
+    });
+
+    thread.join();
+
+    AllocationTracker::AllocationCounts_t after =
+        AllocationTracker::GetCounts(AllocationTracker::TAG_PARSE);
+
+    if(AllocationTracker::IsEnabled())
+    {
+        EXPECT_EQ(10u, after.allocations - before.allocations);
+        EXPECT_EQ(10u, after.frees - before.frees);
+    }
+    else
+    {
+        EXPECT_EQ(0u, after.allocations);
+    }
+}
+
+TEST(AllocationTracker, NoAllocations)
+{
+    std::vector<int> values;
+    values.reserve(16);
+
+    EXPECT_NO_ALLOCATIONS(
+        for(int i = 0; i < 16; ++i)
+        {
+            values.push_back(i);
+        }
+    );
+
+    EXPECT_STREQ("recv", AllocationTracker::GetTagName(
+        AllocationTracker::TAG_RECV));
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
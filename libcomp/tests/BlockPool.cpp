@@ -0,0 +1,192 @@
+/**
+ * @file libcomp/tests/BlockPool.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the BlockPool class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <BlockPool.h>
+#include <MessagePacket.h>
+#include <Packet.h>
+
+// Standard C++11 Includes
+#include <cstddef>
+#include <set>
+
+using namespace libcomp;
+
+TEST(BlockPool, SlabGrowth)
+{
+    BlockPool pool(24, 4);
+
+    std::set<void*> blocks;
+
+    // The first slab holds 4 blocks; the fifth block needs another slab.
+    for(int i = 0; i < 5; ++i)
+    {
+        void *pBlock = pool.Allocate();
+        ASSERT_NE(pBlock, nullptr);
+
+        blocks.insert(pBlock);
+    }
+
+    EXPECT_EQ(blocks.size(), 5u);
+
+    ObjectPoolStats_t stats = pool.GetStats();
+    EXPECT_EQ(stats.misses, 2);
+    EXPECT_EQ(stats.hits, 3);
+    EXPECT_EQ(stats.outstanding, 5);
+    EXPECT_EQ(stats.highWater, 5);
+    EXPECT_EQ(stats.free, 3);
+
+    for(auto pBlock : blocks)
+    {
+        pool.Free(pBlock);
+    }
+
+    stats = pool.GetStats();
+    EXPECT_EQ(stats.outstanding, 0);
+    EXPECT_EQ(stats.highWater, 5);
+    EXPECT_EQ(stats.free, 8);
+}
+
+TEST(BlockPool, ReuseFreed)
+{
+    BlockPool pool(64, 8);
+
+    void *pFirst = pool.Allocate();
+    void *pSecond = pool.Allocate();
+    ASSERT_NE(pFirst, nullptr);
+    ASSERT_NE(pSecond, nullptr);
+
+    // The last block freed is the next one handed out.
+    pool.Free(pFirst);
+    EXPECT_EQ(pool.Allocate(), pFirst);
+
+    // Freeing nothing does not change the counters.
+    pool.Free(nullptr);
+
+    ObjectPoolStats_t stats = pool.GetStats();
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.outstanding, 2);
+    EXPECT_EQ(stats.highWater, 2);
+    EXPECT_EQ(stats.free, 6);
+
+    pool.Free(pFirst);
+    pool.Free(pSecond);
+}
+
+TEST(BlockPool, Alignment)
+{
+    const size_t alignment = alignof(std::max_align_t);
+
+    // Odd sizes are rounded up so every block in the slab stays aligned.
+    BlockPool pool(3, 16);
+    EXPECT_EQ(pool.GetBlockSize() % alignment, 0u);
+    EXPECT_GE(pool.GetBlockSize(), sizeof(void*));
+
+    BlockPool bigPool(alignment + 1, 16);
+    EXPECT_EQ(bigPool.GetBlockSize(), 2 * alignment);
+
+    for(int i = 0; i < 32; ++i)
+    {
+        void *pBlock = pool.Allocate();
+        ASSERT_NE(pBlock, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(pBlock) % alignment, 0u);
+    }
+}
+
+namespace
+{
+
+/**
+ * Message bigger than Message::Packet so its operator new gets a size that
+ * does not match the pool.
+ */
+class BigPacket : public Message::Packet
+{
+public:
+    BigPacket(ReadOnlyPacket& packet) : libcomp::Message::Packet(
+        std::shared_ptr<TcpConnection>(), 0, packet)
+    {
+        memset(mExtra, 0xAA, sizeof(mExtra));
+    }
+
+    char mExtra[256];
+};
+
+} // namespace
+
+TEST(BlockPool, MessagePacketSizeMismatch)
+{
+    ObjectPoolStats_t before = Message::Packet::GetPoolStats();
+
+    Packet data;
+    ReadOnlyPacket copy(data);
+
+    // A Message::Packet comes from the pool.
+    Message::Message *pMessage = new Message::Packet(
+        std::shared_ptr<TcpConnection>(), 0, copy);
+
+    ObjectPoolStats_t stats = Message::Packet::GetPoolStats();
+    EXPECT_EQ(stats.outstanding, before.outstanding + 1);
+
+    delete pMessage;
+
+    stats = Message::Packet::GetPoolStats();
+    EXPECT_EQ(stats.outstanding, before.outstanding);
+
+    // A subclass falls back to the heap in both new and delete.
+    uint64_t allocations = stats.hits + stats.misses;
+
+    pMessage = new BigPacket(copy);
+
+    stats = Message::Packet::GetPoolStats();
+    EXPECT_EQ(stats.outstanding, before.outstanding);
+    EXPECT_EQ(stats.hits + stats.misses, allocations);
+
+    delete pMessage;
+
+    stats = Message::Packet::GetPoolStats();
+    EXPECT_EQ(stats.outstanding, before.outstanding);
+    EXPECT_EQ(stats.hits + stats.misses, allocations);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,219 @@
+/**
+ * @file libcomp/tests/Blowfish.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test and benchmark the bulk Blowfish routines.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Blowfish.h>
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace libcomp;
+
+static const Blowfish::Engine_t ENGINES[] = {
+    Blowfish::ENGINE_SCALAR,
+    Blowfish::ENGINE_INTERLEAVED,
+    Blowfish::ENGINE_AVX2,
+};
+
+static void SetupKey(BF_KEY& key)
+{
+    static const unsigned char keyData[] = "TestBlowfishKey!";
+
+    BF_set_key(&key, 16, keyData);
+}
+
+static std::vector<unsigned char> RandomData(size_t blockCount)
+{
+    std::mt19937 rng(1234);
+    std::vector<unsigned char> data(blockCount * 8);
+
+    for(auto& byte : data)
+    {
+        byte = (unsigned char)(rng() & 0xFF);
+    }
+
+    return data;
+}
+
+TEST(Blowfish, MatchesBlockLoop)
+{
+    BF_KEY key;
+    SetupKey(key);
+
+    Blowfish::Engine_t original = Blowfish::GetEngine();
+
+    for(auto engine : ENGINES)
+    {
+        if(!Blowfish::SetEngine(engine))
+        {
+            continue;
+        }
+
+        // Sizes around the lane counts hit every tail path.
+        for(size_t blockCount = 0; blockCount < 40; ++blockCount)
+        {
+            std::vector<unsigned char> plain = RandomData(blockCount);
+            std::vector<unsigned char> expected = plain;
+
+            for(size_t i = 0; i < blockCount; ++i)
+            {
+                BF_LONG block[2];
+
+                memcpy(block, &expected[i * 8], sizeof(block));
+                BF_encrypt(block, &key);
+                memcpy(&expected[i * 8], block, sizeof(block));
+            }
+
+            // Use an unaligned buffer on purpose.
+            std::vector<unsigned char> buffer(plain.size() + 1);
+            unsigned char *pData = &buffer[1];
+
+            if(!plain.empty())
+            {
+                memcpy(pData, &plain[0], plain.size());
+            }
+
+            Blowfish::EncryptBlocks(key, pData, blockCount);
+
+            EXPECT_EQ(0, memcmp(pData, expected.data(), expected.size()))
+                << "engine " << engine << " blocks " << blockCount;
+
+            Blowfish::DecryptBlocks(key, pData, blockCount);
+
+            EXPECT_EQ(0, memcmp(pData, plain.data(), plain.size()))
+                << "engine " << engine << " blocks " << blockCount;
+        }
+    }
+
+    EXPECT_TRUE(Blowfish::SetEngine(original));
+}
+
+TEST(Blowfish, OutOfPlace)
+{
+    BF_KEY key;
+    SetupKey(key);
+
+    const size_t blockCount = 27;
+
+    std::vector<unsigned char> plain = RandomData(blockCount);
+    std::vector<unsigned char> expected = plain;
+    std::vector<unsigned char> encrypted(plain.size());
+    std::vector<unsigned char> decrypted(plain.size());
+
+    Blowfish::EncryptBlocks(key, &expected[0], blockCount);
+    Blowfish::EncryptBlocks(key, &plain[0], &encrypted[0], blockCount);
+
+    EXPECT_EQ(expected, encrypted);
+
+    Blowfish::DecryptBlocks(key, &encrypted[0], &decrypted[0], blockCount);
+
+    EXPECT_EQ(plain, decrypted);
+}
+
+TEST(Blowfish, DetectsSupportedEngine)
+{
+    EXPECT_TRUE(Blowfish::IsEngineSupported(Blowfish::ENGINE_SCALAR));
+    EXPECT_TRUE(Blowfish::IsEngineSupported(Blowfish::ENGINE_INTERLEAVED));
+    EXPECT_TRUE(Blowfish::IsEngineSupported(Blowfish::GetEngine()));
+    EXPECT_NE(Blowfish::ENGINE_SCALAR, Blowfish::GetEngine());
+}
+
+TEST(Blowfish, Benchmark)
+{
+    // One maximum size packet worth of blocks.
+    const size_t blockCount = 16384 / 8;
+    const int iterations = 500;
+
+    BF_KEY key;
+    SetupKey(key);
+
+    std::vector<unsigned char> data = RandomData(blockCount);
+
+    // The loop Decrypt::Encrypt used to run.
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for(int i = 0; i < iterations; ++i)
+    {
+        unsigned char *pData = &data[0];
+
+        for(size_t j = 0; j < blockCount; ++j, pData += 8)
+        {
+            BF_encrypt(reinterpret_cast<BF_LONG*>(pData), &key);
+        }
+    }
+
+    double baseline = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    double megabytes = (double)(blockCount * 8 * iterations) /
+        (1024.0 * 1024.0);
+
+    std::cout << "BF_encrypt loop: " << (megabytes / baseline)
+        << " MiB/s" << std::endl;
+
+    Blowfish::Engine_t original = Blowfish::GetEngine();
+
+    for(auto engine : ENGINES)
+    {
+        if(!Blowfish::SetEngine(engine))
+        {
+            continue;
+        }
+
+        start = std::chrono::high_resolution_clock::now();
+
+        for(int i = 0; i < iterations; ++i)
+        {
+            Blowfish::EncryptBlocks(key, &data[0], blockCount);
+        }
+
+        double elapsed = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << "Engine " << engine << ": " << (megabytes / elapsed)
+            << " MiB/s (" << (baseline / elapsed) << "x)" << std::endl;
+    }
+
+    EXPECT_TRUE(Blowfish::SetEngine(original));
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
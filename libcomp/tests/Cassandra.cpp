@@ -32,7 +32,9 @@
 #include <DatabaseCassandra.h>
 
 // Standard C++ Includes
+#include <atomic>
 #include <iostream>
+#include <list>
 
 using namespace libcomp;
 
@@ -394,6 +396,141 @@ TEST(Cassandra, ObjectBatch)
     EXPECT_FALSE(db.IsOpen());
 }
 
+TEST(Cassandra, ExecuteAsync)
+{
+    DatabaseCassandra db;
+
+    EXPECT_FALSE(db.IsOpen());
+    EXPECT_TRUE(db.Open("127.0.0.1"));
+    EXPECT_TRUE(db.IsOpen());
+
+    EXPECT_TRUE(db.Execute("DROP KEYSPACE IF EXISTS comp_hack;"));
+    EXPECT_TRUE(db.Execute("CREATE KEYSPACE comp_hack WITH REPLICATION = {"
+        " 'class' : 'NetworkTopologyStrategy', 'datacenter1' : 1 };"));
+    EXPECT_TRUE(db.Execute("USE comp_hack;"));
+    EXPECT_TRUE(db.Execute("CREATE TABLE objects ( uid uuid PRIMARY KEY, "
+        "member_vars map<ascii, blob> );"));
+
+    std::unordered_map<std::string, std::vector<char>> values;
+    values["test_int"] = std::vector<char>(4, 'x');
+
+    // Keep many inserts in flight at once.
+    std::list<DatabaseQuery> queries;
+    std::list<std::future<bool>> futures;
+
+    for(int i = 0; i < 32; ++i)
+    {
+        queries.push_back(db.Prepare("INSERT INTO objects ( uid, "
+            "member_vars ) VALUES ( uuid(), ? );"));
+
+        DatabaseQuery& q = queries.back();
+        EXPECT_TRUE(q.IsValid());
+        EXPECT_TRUE(q.Bind(0, values));
+
+        futures.push_back(q.ExecuteAsync());
+    }
+
+    for(auto& future : futures)
+    {
+        EXPECT_TRUE(future.get());
+    }
+
+    // Read the rows back from the callback.
+    std::atomic<int> rowCount(0);
+
+    DatabaseQuery q = db.Prepare("SELECT uid, member_vars FROM objects;");
+    EXPECT_TRUE(q.IsValid());
+
+    std::promise<bool> finished;
+
+    EXPECT_TRUE(q.ExecuteAsync([&](bool result)
+    {
+        while(result && q.Next())
+        {
+            rowCount++;
+        }
+
+        finished.set_value(result);
+    }));
+
+    EXPECT_TRUE(finished.get_future().get());
+    EXPECT_EQ(rowCount, 32);
+
+    // A bad query reports the failure to the callback.
+    DatabaseQuery bad = db.Prepare("SELECT * FROM missing_table;");
+    EXPECT_FALSE(bad.ExecuteAsync().get());
+
+    EXPECT_TRUE(db.Execute("DROP TABLE objects;"));
+
+    EXPECT_TRUE(db.Close());
+    EXPECT_FALSE(db.IsOpen());
+}
+
+TEST(Cassandra, Batch)
+{
+    DatabaseCassandra db;
+
+    EXPECT_TRUE(db.Open("127.0.0.1"));
+    EXPECT_TRUE(db.IsOpen());
+
+    EXPECT_TRUE(db.Execute("DROP KEYSPACE IF EXISTS comp_hack;"));
+    EXPECT_TRUE(db.Execute("CREATE KEYSPACE comp_hack WITH REPLICATION = {"
+        " 'class' : 'NetworkTopologyStrategy', 'datacenter1' : 1 };"));
+    EXPECT_TRUE(db.Execute("USE comp_hack;"));
+    EXPECT_TRUE(db.Execute("CREATE TABLE items ( id ascii PRIMARY KEY );"));
+
+    DatabaseBatch batch = db.CreateBatch(false, 4);
+    DatabaseQuery q = db.Prepare("INSERT INTO items ( id ) VALUES ( ? );");
+    EXPECT_TRUE(q.IsValid());
+
+    for(int i = 0; i < 10; ++i)
+    {
+        EXPECT_TRUE(q.Bind(0, String("item%1").Arg(i)));
+        EXPECT_TRUE(batch.Add(q));
+    }
+
+    EXPECT_EQ(batch.Count(), 2u);
+    EXPECT_TRUE(batch.Execute());
+    EXPECT_EQ(batch.Count(), 0u);
+
+    q = db.Prepare("SELECT id FROM items;");
+    EXPECT_TRUE(q.Execute());
+
+    int rowCount = 0;
+
+    while(q.Next())
+    {
+        rowCount++;
+    }
+
+    EXPECT_EQ(rowCount, 10);
+
+    // Page through the rows three at a time.
+    q = db.Prepare("SELECT id FROM items;");
+
+    rowCount = 0;
+
+    EXPECT_TRUE(q.ForEachRow([&q, &rowCount]()
+    {
+        const char *szID;
+        size_t size;
+
+        EXPECT_TRUE(q.GetText("id", szID, size));
+        EXPECT_EQ(std::string(szID, 4), "item");
+
+        rowCount++;
+
+        return true;
+    }, 3));
+
+    EXPECT_EQ(rowCount, 10);
+
+    EXPECT_TRUE(db.Execute("DROP TABLE items;"));
+
+    EXPECT_TRUE(db.Close());
+    EXPECT_FALSE(db.IsOpen());
+}
+
 int main(int argc, char *argv[])
 {
     try
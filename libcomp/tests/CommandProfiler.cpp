@@ -0,0 +1,113 @@
+/**
+ * @file libcomp/tests/CommandProfiler.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the per-command profiler.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <CommandProfiler.h>
+
+using namespace libcomp;
+
+TEST(CommandProfiler, Disabled)
+{
+    CommandProfiler *pProfiler = CommandProfiler::GetSingletonPtr();
+
+    EXPECT_FALSE(pProfiler->IsEnabled());
+
+    pProfiler->RecordReceived(0x0003, 100, 10);
+
+    {
+        CommandProfiler::HandlerScope scope(0x0003);
+    }
+
+    CommandProfile_t profile = pProfiler->GetProfile(0x0003);
+
+    EXPECT_EQ(profile.count, 0);
+    EXPECT_EQ(profile.handled, 0);
+}
+
+TEST(CommandProfiler, Totals)
+{
+    CommandProfiler *pProfiler = CommandProfiler::GetSingletonPtr();
+    pProfiler->SetEnabled(true);
+    pProfiler->Reset();
+
+    pProfiler->RecordReceived(0x0003, 100, 10);
+    pProfiler->RecordReceived(0x0003, 50, 30);
+    pProfiler->RecordReceived(0xFFFF, 8, 1);
+    pProfiler->RecordHandled(0x0003, 40);
+    pProfiler->RecordHandled(0x0003, 90);
+    pProfiler->RecordHandled(0xFFFF, 500);
+
+    {
+        CommandProfiler::HandlerScope scope(0x1234);
+    }
+
+    CommandProfile_t profile = pProfiler->GetProfile(0x0003);
+
+    EXPECT_EQ(profile.count, 2);
+    EXPECT_EQ(profile.bytes, 150);
+    EXPECT_EQ(profile.queueMicroseconds, 40);
+    EXPECT_EQ(profile.handled, 2);
+    EXPECT_EQ(profile.handlerMicroseconds, 130);
+    EXPECT_EQ(profile.handlerMaxMicroseconds, 90);
+    EXPECT_EQ(pProfiler->GetProfile(0x1234).handled, 1);
+
+    // The slowest command is listed first.
+    String dump = pProfiler->Dump(1);
+
+    EXPECT_TRUE(dump.Contains("0xffff"));
+    EXPECT_FALSE(dump.Contains("0x0003"));
+
+    dump = pProfiler->Dump();
+
+    EXPECT_TRUE(dump.Contains("0x0003          2          150       75"
+        "         20          2          130       65       90\n"));
+
+    pProfiler->SetEnabled(false);
+    pProfiler->RecordHandled(0x0003, 40);
+
+    EXPECT_EQ(pProfiler->GetProfile(0x0003).handled, 2);
+
+    pProfiler->Reset();
+
+    EXPECT_EQ(pProfiler->GetProfile(0x0003).count, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
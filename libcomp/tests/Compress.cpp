@@ -0,0 +1,162 @@
+/**
+ * @file libcomp/tests/Compress.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the zlib compression contexts.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Compress.h>
+
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+static std::vector<char> MakePayload(size_t size, uint32_t seed)
+{
+    std::vector<char> payload(size);
+
+    // Mostly repeating text with a little noise so it compresses a bit.
+    for(size_t i = 0; i < size; ++i)
+    {
+        seed = seed * 1103515245u + 12345u;
+        payload[i] = (0 == (seed >> 28)) ? (char)(seed >> 16) :
+            "comp_hack "[i % 10];
+    }
+
+    return payload;
+}
+
+TEST(Compress, OneCall)
+{
+    std::vector<char> payload = MakePayload(1000, 1);
+    std::vector<char> compressed(2000);
+    std::vector<char> decompressed(1000);
+
+    // Run more than once to use the same thread context again.
+    for(int i = 0; i < 3; ++i)
+    {
+        int32_t size = Compress::Compress(&payload[0], &compressed[0],
+            (int32_t)payload.size(), (int32_t)compressed.size(), i * 4);
+
+        ASSERT_LT(0, size);
+        ASSERT_EQ(1000, Compress::Decompress(&compressed[0],
+            &decompressed[0], size, (int32_t)decompressed.size()));
+        EXPECT_EQ(payload, decompressed);
+    }
+
+    EXPECT_EQ(-1, Compress::Compress(&payload[0], &compressed[0],
+        (int32_t)payload.size(), (int32_t)compressed.size(), 10));
+    EXPECT_EQ(-3, Compress::Compress(&payload[0], &compressed[0],
+        (int32_t)payload.size(), 4));
+
+    // A failed call must not break the next one.
+    EXPECT_LT(0, Compress::Compress(&payload[0], &compressed[0],
+        (int32_t)payload.size(), (int32_t)compressed.size()));
+    EXPECT_EQ(-3, Compress::Decompress(&payload[0], &decompressed[0],
+        (int32_t)payload.size(), (int32_t)decompressed.size()));
+}
+
+TEST(Compress, Streaming)
+{
+    std::vector<char> payload = MakePayload(200000, 2);
+
+    Compress::Compressor compressor(6);
+    Compress::Decompressor decompressor;
+
+    for(int i = 0; i < 2; ++i)
+    {
+        std::vector<char> compressed;
+
+        // Feed the payload in uneven chunks.
+        for(size_t offset = 0; offset < payload.size(); offset += 7777)
+        {
+            size_t chunk = payload.size() - offset;
+            chunk = 7777 < chunk ? 7777 : chunk;
+
+            ASSERT_LE(0, compressor.Write(&payload[offset], (int32_t)chunk,
+                compressed, false));
+        }
+
+        ASSERT_LE(0, compressor.Write(nullptr, 0, compressed, true));
+
+        std::vector<char> decompressed;
+        bool finished = false;
+
+        for(size_t offset = 0; offset < compressed.size(); offset += 1000)
+        {
+            size_t chunk = compressed.size() - offset;
+            chunk = 1000 < chunk ? 1000 : chunk;
+
+            ASSERT_FALSE(finished);
+            ASSERT_LE(0, decompressor.Write(&compressed[offset],
+                (int32_t)chunk, decompressed, finished));
+        }
+
+        EXPECT_TRUE(finished);
+        EXPECT_EQ(payload, decompressed);
+
+        // The size limit stops a payload that is too big.
+        decompressed.clear();
+
+        EXPECT_EQ(-3, decompressor.Write(&compressed[0],
+            (int32_t)compressed.size(), decompressed, finished, 1000));
+        EXPECT_TRUE(decompressed.empty());
+    }
+}
+
+TEST(Compress, ThreadContexts)
+{
+    Compress::Compressor *pMain = Compress::ThreadCompressor();
+    Compress::Compressor *pOther = nullptr;
+
+    EXPECT_EQ(pMain, Compress::ThreadCompressor(-1));
+    EXPECT_NE(pMain, Compress::ThreadCompressor(9));
+    EXPECT_EQ(nullptr, Compress::ThreadCompressor(10));
+
+    std::thread t([&pOther]()
+    {
+        pOther = Compress::ThreadCompressor();
+    });
+
+    t.join();
+
+    EXPECT_NE(pMain, pOther);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,178 @@
+/**
+ * @file libcomp/tests/ConnectionHandle.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the ConnectionHandle class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <ConnectionHandle.h>
+#include <ConnectionRegistry.h>
+#include <MessagePacket.h>
+#include <MessagePacketFrame.h>
+#include <TcpConnection.h>
+
+// Standard C++11 Includes
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+TEST(ConnectionHandle, Empty)
+{
+    ConnectionHandle handle;
+
+    EXPECT_FALSE(handle);
+    EXPECT_EQ(handle.Get(), nullptr);
+    EXPECT_EQ(handle.Lock(), nullptr);
+    EXPECT_EQ(handle.GetID(), INVALID_CONNECTION_ID);
+    EXPECT_EQ(handle.GetReferenceCount(), 0);
+    EXPECT_FALSE(handle.Borrow());
+
+    ConnectionHandle nullHandle(std::shared_ptr<TcpConnection>(nullptr));
+    EXPECT_FALSE(nullHandle);
+}
+
+TEST(ConnectionHandle, SharesOneReference)
+{
+    asio::io_service service;
+    auto registry = std::make_shared<ConnectionRegistry>(4);
+
+    std::shared_ptr<TcpConnection> connection(new TcpConnection(service));
+    uint64_t id = registry->Add(connection);
+    connection->SetRegistry(registry, id);
+
+    long useCount = connection.use_count();
+
+    {
+        ConnectionHandle handle(connection);
+
+        EXPECT_TRUE(handle);
+        EXPECT_EQ(handle.Get(), connection.get());
+        EXPECT_EQ(handle.GetID(), id);
+        EXPECT_EQ(registry->Get(handle.GetID()), connection);
+
+        // Every copy shares the one connection reference.
+        EXPECT_EQ(connection.use_count(), useCount + 1);
+
+        ConnectionHandle borrowed = handle.Borrow();
+        ConnectionHandle copy(handle);
+        ConnectionHandle moved(std::move(copy));
+
+        EXPECT_FALSE(copy);
+        EXPECT_EQ(handle.GetReferenceCount(), 3);
+        EXPECT_EQ(connection.use_count(), useCount + 1);
+
+        copy = borrowed;
+        EXPECT_EQ(handle.GetReferenceCount(), 4);
+
+        moved = ConnectionHandle();
+        EXPECT_EQ(handle.GetReferenceCount(), 3);
+        EXPECT_EQ(moved.Get(), nullptr);
+    }
+
+    EXPECT_EQ(connection.use_count(), useCount);
+
+    // The ID is stale once the slot is reused.
+    registry->Remove(id);
+    registry->Add(connection);
+
+    EXPECT_EQ(registry->Get(id), nullptr);
+}
+
+TEST(ConnectionHandle, Messages)
+{
+    asio::io_service service;
+
+    std::shared_ptr<TcpConnection> connection(new TcpConnection(service));
+
+    long useCount = connection.use_count();
+    ObjectPoolStats_t before = ConnectionHandle::GetPoolStats();
+
+    std::vector<Message::Packet*> messages;
+
+    {
+        ConnectionHandle handle(connection);
+
+        for(int i = 0; i < 8; ++i)
+        {
+            ReadOnlyPacket command;
+
+            messages.push_back(new Message::Packet(handle.Borrow(),
+                (uint16_t)i, command));
+        }
+
+        EXPECT_EQ(handle.GetReferenceCount(), 9);
+    }
+
+    EXPECT_EQ(connection.use_count(), useCount + 1);
+    EXPECT_EQ(messages.front()->GetConnection(), connection);
+    EXPECT_EQ(messages.back()->GetConnectionHandle().Get(), connection.get());
+
+    // The workers release the messages on other threads.
+    std::vector<std::thread> threads;
+
+    for(auto pMessage : messages)
+    {
+        threads.emplace_back([pMessage]()
+        {
+            delete pMessage;
+        });
+    }
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(connection.use_count(), useCount);
+
+    // Only one block was taken for the whole frame and it was returned.
+    ObjectPoolStats_t after = ConnectionHandle::GetPoolStats();
+    EXPECT_EQ((after.hits + after.misses) - (before.hits + before.misses),
+        1);
+    EXPECT_EQ(after.outstanding, before.outstanding);
+
+    ReadOnlyPacket frame;
+    std::unique_ptr<Message::PacketFrame> pFrame(new Message::PacketFrame(
+        ConnectionHandle(connection), frame));
+
+    EXPECT_EQ(pFrame->GetConnection(), connection);
+    EXPECT_EQ(connection.use_count(), useCount + 1);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
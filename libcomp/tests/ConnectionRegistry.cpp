@@ -0,0 +1,152 @@
+/**
+ * @file libcomp/tests/ConnectionRegistry.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the ConnectionRegistry class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <ConnectionRegistry.h>
+#include <TcpConnection.h>
+
+using namespace libcomp;
+
+TEST(ConnectionRegistry, AddRemove)
+{
+    asio::io_service service;
+    ConnectionRegistry registry(4);
+
+    std::shared_ptr<TcpConnection> a(new TcpConnection(service));
+    std::shared_ptr<TcpConnection> b(new TcpConnection(service));
+
+    uint64_t idA = registry.Add(a);
+    uint64_t idB = registry.Add(b);
+
+    EXPECT_NE(idA, INVALID_CONNECTION_ID);
+    EXPECT_NE(idB, INVALID_CONNECTION_ID);
+    EXPECT_NE(idA, idB);
+    EXPECT_EQ(registry.Count(), 2);
+    EXPECT_EQ(registry.Get(idA), a);
+    EXPECT_EQ(registry.Get(idB), b);
+
+    EXPECT_TRUE(registry.Remove(idA));
+    EXPECT_FALSE(registry.Remove(idA));
+    EXPECT_EQ(registry.Get(idA), nullptr);
+    EXPECT_EQ(registry.Count(), 1);
+
+    // The slot is reused with a new generation so the old ID stays dead.
+    uint64_t idC = registry.Add(a);
+
+    EXPECT_NE(idC, idA);
+    EXPECT_EQ(idC & 0xFFFFFFFF, idA & 0xFFFFFFFF);
+    EXPECT_EQ(registry.Get(idA), nullptr);
+    EXPECT_EQ(registry.Get(idC), a);
+    EXPECT_FALSE(registry.Remove(idA));
+    EXPECT_EQ(registry.Count(), 2);
+}
+
+TEST(ConnectionRegistry, EnforcesLimit)
+{
+    asio::io_service service;
+    ConnectionRegistry registry(2);
+
+    std::shared_ptr<TcpConnection> connection(new TcpConnection(service));
+
+    uint64_t id = registry.Add(connection);
+
+    EXPECT_NE(registry.Add(connection), INVALID_CONNECTION_ID);
+    EXPECT_EQ(registry.Add(connection), INVALID_CONNECTION_ID);
+    EXPECT_EQ(registry.Add(nullptr), INVALID_CONNECTION_ID);
+
+    EXPECT_TRUE(registry.Remove(id));
+    EXPECT_NE(registry.Add(connection), INVALID_CONNECTION_ID);
+    EXPECT_EQ(registry.Count(), 2);
+}
+
+TEST(ConnectionRegistry, Snapshot)
+{
+    asio::io_service service;
+    ConnectionRegistry registry;
+
+    std::shared_ptr<TcpConnection> a(new TcpConnection(service));
+    std::shared_ptr<TcpConnection> b(new TcpConnection(service));
+
+    EXPECT_TRUE(registry.Snapshot()->empty());
+
+    uint64_t idA = registry.Add(a);
+    (void)registry.Add(b);
+
+    auto snapshot = registry.Snapshot();
+
+    EXPECT_EQ(snapshot->size(), 2);
+
+    // Nothing changed so the same list is handed out.
+    EXPECT_EQ(registry.Snapshot(), snapshot);
+
+    EXPECT_TRUE(registry.Remove(idA));
+
+    // The old snapshot is not changed.
+    EXPECT_EQ(snapshot->size(), 2);
+    EXPECT_EQ(registry.Snapshot()->size(), 1);
+    EXPECT_EQ(registry.Snapshot()->front(), b);
+
+    registry.Clear();
+
+    EXPECT_EQ(registry.Count(), 0);
+    EXPECT_TRUE(registry.Snapshot()->empty());
+}
+
+TEST(ConnectionRegistry, RemoveReleasesConnection)
+{
+    asio::io_service service;
+    ConnectionRegistry registry;
+
+    std::shared_ptr<TcpConnection> connection(new TcpConnection(service));
+    std::weak_ptr<TcpConnection> weak(connection);
+
+    uint64_t id = registry.Add(connection);
+
+    EXPECT_EQ(registry.Snapshot()->size(), 1);
+
+    connection.reset();
+
+    // The cached snapshot must not keep the connection alive.
+    EXPECT_TRUE(registry.Remove(id));
+    EXPECT_TRUE(weak.expired());
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,123 @@
+/**
+ * @file libcomp/tests/ConnectionTest.h
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test helpers for connections over the loopback interface.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCOMP_TESTS_CONNECTIONTEST_H
+#define LIBCOMP_TESTS_CONNECTIONTEST_H
+
+#include <Message.h>
+#include <MessageQueue.h>
+#include <TcpConnection.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <memory>
+
+/// Queue the connections send their messages to.
+typedef libcomp::MessageQueue<libcomp::Message::Message*> TestQueue_t;
+
+/**
+ * Run the io_service until a condition is true (or a few seconds passed).
+ * @param service io_service to run.
+ * @param condition Condition to wait for.
+ * @returns true if the condition became true.
+ */
+template<typename Condition>
+static bool RunUntil(asio::io_service& service, Condition condition)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+    while(!condition() && std::chrono::steady_clock::now() < end)
+    {
+        service.poll();
+        service.reset();
+    }
+
+    return condition();
+}
+
+/**
+ * Both ends of a connection over the loopback interface. The client is
+ * created (but not connected) with the pair and the server end is created
+ * once a connection was accepted (see @ref AcceptClient).
+ */
+template<class T>
+class ConnectionPair
+{
+public:
+    ConnectionPair(asio::io_service& service) : client(new T(service)),
+        clientQueue(new TestQueue_t), serverQueue(new TestQueue_t)
+    {
+        client->SetSelf(client);
+        client->SetMessageQueue(clientQueue);
+    }
+
+    ~ConnectionPair()
+    {
+        libcomp::Message::Message *pMessage;
+
+        while(clientQueue->TryDequeue(pMessage))
+        {
+            delete pMessage;
+        }
+
+        while(serverQueue->TryDequeue(pMessage))
+        {
+            delete pMessage;
+        }
+    }
+
+    std::shared_ptr<T> client;
+    std::shared_ptr<T> server;
+    std::shared_ptr<TestQueue_t> clientQueue;
+    std::shared_ptr<TestQueue_t> serverQueue;
+};
+
+/**
+ * Connect a client to a new listening socket and accept the connection.
+ * @param service io_service for both ends.
+ * @param client Connection to connect.
+ * @param accepted Socket to accept the connection on.
+ * @returns true if the connection was accepted.
+ */
+static inline bool AcceptClient(asio::io_service& service,
+    libcomp::TcpConnection& client, asio::ip::tcp::socket& accepted)
+{
+    asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(
+        asio::ip::address_v4::loopback(), 0));
+
+    bool acceptDone = false;
+
+    acceptor.async_accept(accepted, [&acceptDone](asio::error_code)
+    {
+        acceptDone = true;
+    });
+
+    return client.Connect("127.0.0.1", acceptor.local_endpoint().port()) &&
+        RunUntil(service, [&acceptDone]() { return acceptDone; }) &&
+        accepted.is_open();
+}
+
+#endif // LIBCOMP_TESTS_CONNECTIONTEST_H
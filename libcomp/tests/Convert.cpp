@@ -111,6 +111,62 @@ TEST(String, CP932)
         ((sizeof(encodedString) - 1 + 4 - 1) / 4) * 4);
 }
 
+TEST(String, CP932HalfWidth)
+{
+    // Half-width katakana are single bytes with the high bit set and must
+    // not swallow the byte after them.
+    String decodedString = "ｺﾝﾌﾟ日本ｱ";
+
+    unsigned char encodedString[] = {
+        0xba, 0xdd, 0xcc, 0xdf, 0x93, 0xfa, 0x96, 0x7b, 0xb1, 0x00
+    };
+
+    std::vector<char> encodedData(reinterpret_cast<char*>(encodedString),
+        reinterpret_cast<char*>(encodedString) + sizeof(encodedString));
+
+    std::vector<char> testData = Convert::ToEncoding(Convert::ENCODING_CP932,
+        decodedString);
+
+    ASSERT_EQ(testData.size(), encodedData.size());
+
+    EXPECT_EQ(memcmp(encodedString, &testData[0],
+        sizeof(encodedString)), 0);
+    EXPECT_EQ(Convert::FromEncoding(Convert::ENCODING_CP932, &encodedData[0]),
+        decodedString);
+
+    // Code points past U+FFFF have no mapping.
+    testData = Convert::ToEncoding(Convert::ENCODING_CP932,
+        String("\xF0\x9F\x98\x80"), false);
+
+    ASSERT_EQ(testData.size(), 1u);
+    EXPECT_EQ(testData[0], '?');
+}
+
+TEST(Convert, EncodeInto)
+{
+    String decodedString = u8"日本語 abc";
+
+    std::vector<char> expected = Convert::ToEncoding(Convert::ENCODING_CP932,
+        decodedString);
+
+    char buffer[32];
+    memset(buffer, 0x7F, sizeof(buffer));
+
+    EXPECT_EQ(Convert::EncodeInto(Convert::ENCODING_CP932, decodedString,
+        buffer, sizeof(buffer)), expected.size());
+    EXPECT_EQ(memcmp(buffer, &expected[0], expected.size()), 0);
+    EXPECT_EQ(buffer[expected.size()], 0x7F);
+
+    // A buffer that is too small reports the size that is needed.
+    EXPECT_EQ(Convert::EncodeInto(Convert::ENCODING_CP932, decodedString,
+        buffer, 3, false), expected.size() - 1);
+    EXPECT_EQ(Convert::EncodeInto(Convert::ENCODING_CP1252, "abc",
+        buffer, 3), 4);
+    EXPECT_EQ(Convert::EncodeInto(Convert::ENCODING_UTF8, decodedString,
+        buffer, sizeof(buffer), false), decodedString.Size());
+    EXPECT_EQ(String(buffer, decodedString.Size()), decodedString);
+}
+
 int main(int argc, char *argv[])
 {
     try
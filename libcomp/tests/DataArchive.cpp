@@ -0,0 +1,146 @@
+/**
+ * @file libcomp/tests/DataArchive.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the DataArchive class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Constants.h>
+#include <DataArchive.h>
+
+// Standard C++11 Includes
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+using namespace libcomp;
+
+TEST(DataArchive, WriteAndRead)
+{
+    std::map<std::string, std::string> files;
+    files["Data/ItemData.sbin"] = "items";
+    files["Data\\DevilData.sbin"] = std::string(5000, 'd');
+    files["empty.bin"] = "";
+
+    std::vector<std::string> names;
+
+    for(auto& file : files)
+    {
+        names.push_back(file.first);
+    }
+
+    std::string path = "DataArchive.test.carc";
+
+    ASSERT_TRUE(DataArchive::Write(path, names, [&files](
+        const std::string& name, std::vector<char>& data)
+    {
+        auto it = files.find(name);
+
+        if(files.end() == it)
+        {
+            return false;
+        }
+
+        data.assign(it->second.begin(), it->second.end());
+
+        return true;
+    }));
+
+    DataArchive archive;
+    ASSERT_TRUE(archive.Open(path));
+    EXPECT_TRUE(archive.IsOpen());
+    EXPECT_EQ(3u, archive.Count());
+    EXPECT_EQ(3u, archive.GetNames().size());
+
+    const char *pData = nullptr;
+    size_t size = 0;
+
+    // Names are matched without regard to case or slash direction.
+    ASSERT_TRUE(archive.Get("data/itemdata.sbin", pData, size));
+    EXPECT_EQ(std::string("items"), std::string(pData, size));
+    EXPECT_EQ(0u, (uintptr_t)pData % DATA_ARCHIVE_ALIGNMENT);
+
+    ASSERT_TRUE(archive.Get("/DATA/DevilData.sbin", pData, size));
+    EXPECT_EQ(files["Data\\DevilData.sbin"], std::string(pData, size));
+    EXPECT_EQ(0u, (uintptr_t)pData % DATA_ARCHIVE_ALIGNMENT);
+
+    ASSERT_TRUE(archive.Get("empty.bin", pData, size));
+    EXPECT_EQ(0u, size);
+
+    EXPECT_FALSE(archive.Contains("Data/Missing.sbin"));
+
+    archive.Close();
+    EXPECT_FALSE(archive.IsOpen());
+    EXPECT_FALSE(archive.Contains("empty.bin"));
+
+    remove(path.c_str());
+}
+
+TEST(DataArchive, Invalid)
+{
+    std::string path = "DataArchive.invalid.carc";
+
+    auto loader = [](const std::string& name, std::vector<char>& data)
+    {
+        data.assign(name.begin(), name.end());
+
+        return true;
+    };
+
+    // Two names for the same file are refused.
+    std::vector<std::string> names;
+    names.push_back("a/b.bin");
+    names.push_back("A\\B.bin");
+
+    EXPECT_FALSE(DataArchive::Write(path, names, loader));
+
+    // So is a file that is not an archive.
+    {
+        std::ofstream out(path.c_str(), std::ofstream::binary);
+        out << "not an archive at all";
+    }
+
+    DataArchive archive;
+    EXPECT_FALSE(archive.Open(path));
+    EXPECT_FALSE(archive.IsOpen());
+    EXPECT_FALSE(archive.Open("DataArchive.missing.carc"));
+
+    remove(path.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -28,8 +28,12 @@
 #include <gtest/gtest.h>
 #include <PopIgnore.h>
 
+#include <DatabasePool.h>
 #include <DatabaseSQLite3.h>
 
+// Standard C++11 Includes
+#include <thread>
+
 using namespace libcomp;
 
 TEST(SQLite3, OpenCloseDatabase)
@@ -41,6 +45,314 @@ TEST(SQLite3, OpenCloseDatabase)
     ASSERT_TRUE(db.Close());
 }
 
+TEST(SQLite3, PreparedStatementCache)
+{
+    DatabaseSQLite3 db;
+
+    ASSERT_TRUE(db.Open(":memory:"));
+    ASSERT_TRUE(db.Execute("CREATE TABLE accounts ( username TEXT );"));
+    EXPECT_FALSE(db.Execute("SELECT"));
+    EXPECT_FALSE(db.GetLastError().IsEmpty());
+
+    StatementCacheStats_t before = db.GetStatementCacheStats();
+
+    for(int i = 0; i < 3; ++i)
+    {
+        DatabaseQuery q = db.Prepare("INSERT INTO accounts ( username ) "
+            "VALUES ( ? );");
+        EXPECT_TRUE(q.IsValid());
+        EXPECT_TRUE(q.Bind(0, String("user%1").Arg(i)));
+        EXPECT_TRUE(q.Execute());
+    }
+
+    StatementCacheStats_t after = db.GetStatementCacheStats();
+
+    // Only the first insert had to prepare the statement.
+    EXPECT_EQ(after.misses - before.misses, 1u);
+    EXPECT_EQ(after.hits - before.hits, 2u);
+
+    DatabaseQuery q = db.Prepare("SELECT username FROM accounts WHERE "
+        "username != :name;");
+    EXPECT_TRUE(q.Bind("name", "user1"));
+    EXPECT_TRUE(q.Execute());
+
+    int rowCount = 0;
+
+    while(q.Next())
+    {
+        rowCount++;
+    }
+
+    EXPECT_EQ(rowCount, 2);
+
+    // Executing again after binding starts over.
+    EXPECT_TRUE(q.Bind("name", "user9"));
+    EXPECT_TRUE(q.Execute());
+
+    rowCount = 0;
+
+    while(q.Next())
+    {
+        rowCount++;
+    }
+
+    EXPECT_EQ(rowCount, 3);
+
+    q = DatabaseQuery(nullptr, String());
+
+    ASSERT_TRUE(db.Close());
+}
+
+static int CountRows(Database& db, const String& query)
+{
+    int rowCount = 0;
+
+    DatabaseQuery q = db.Prepare(query);
+
+    if(q.Execute())
+    {
+        while(q.Next())
+        {
+            rowCount++;
+        }
+    }
+
+    return rowCount;
+}
+
+TEST(SQLite3, Batch)
+{
+    DatabaseSQLite3 db;
+
+    ASSERT_TRUE(db.Open(":memory:"));
+    ASSERT_TRUE(db.Execute("CREATE TABLE items ( id TEXT PRIMARY KEY );"));
+
+    {
+        DatabaseBatch batch = db.CreateBatch(false, 4);
+        DatabaseQuery q = db.Prepare("INSERT INTO items ( id ) VALUES ( ? );");
+
+        for(int i = 0; i < 10; ++i)
+        {
+            EXPECT_TRUE(q.Bind(0, String("item%1").Arg(i)));
+            EXPECT_TRUE(batch.Add(q));
+        }
+
+        // Two batches of four were sent automatically.
+        EXPECT_EQ(batch.Count(), 2u);
+    }
+
+    // The last two were discarded with the batch.
+    EXPECT_EQ(CountRows(db, "SELECT id FROM items;"), 8);
+
+    {
+        DatabaseBatch batch = db.CreateBatch(false, 0);
+        DatabaseQuery q = db.Prepare("INSERT INTO items ( id ) VALUES ( ? );");
+
+        EXPECT_TRUE(q.Bind(0, "item8"));
+        EXPECT_TRUE(batch.Add(q));
+
+        // Duplicate key so the whole batch is dropped.
+        EXPECT_TRUE(q.Bind(0, "item0"));
+        EXPECT_FALSE(batch.Add(q));
+
+        EXPECT_TRUE(q.Bind(0, "item9"));
+        EXPECT_TRUE(batch.Add(q));
+
+        EXPECT_FALSE(batch.Execute());
+        EXPECT_EQ(batch.Count(), 0u);
+    }
+
+    EXPECT_EQ(CountRows(db, "SELECT id FROM items;"), 8);
+
+    {
+        DatabaseBatch batch = db.CreateBatch();
+        DatabaseQuery q = db.Prepare("INSERT INTO items ( id ) VALUES ( ? );");
+
+        EXPECT_TRUE(q.Bind(0, "item8"));
+        EXPECT_TRUE(batch.Add(q));
+        EXPECT_TRUE(q.Bind(0, "item9"));
+        EXPECT_TRUE(batch.Add(q));
+        EXPECT_TRUE(batch.Execute());
+    }
+
+    EXPECT_EQ(CountRows(db, "SELECT id FROM items;"), 10);
+
+    ASSERT_TRUE(db.Close());
+}
+
+TEST(SQLite3, TypedColumns)
+{
+    DatabaseSQLite3 db;
+
+    ASSERT_TRUE(db.Open(":memory:"));
+    ASSERT_TRUE(db.Execute("CREATE TABLE characters ( id INTEGER, "
+        "xp INTEGER, data BLOB, name TEXT );"));
+    ASSERT_TRUE(db.Execute("INSERT INTO characters VALUES ( 42, "
+        "1234567890123, x'00ff7f', 'hikaru' );"));
+    ASSERT_TRUE(db.Execute("INSERT INTO characters VALUES ( 43, NULL, "
+        "NULL, 'ren' );"));
+
+    DatabaseQuery q = db.Prepare("SELECT id, xp, data, name FROM characters "
+        "ORDER BY id;");
+    ASSERT_TRUE(q.Execute());
+    ASSERT_TRUE(q.Next());
+
+    int32_t id = 0;
+    int64_t xp = 0;
+    const char *pData = nullptr;
+    const char *szName = nullptr;
+    size_t size = 0;
+
+    EXPECT_TRUE(q.GetInt(0, id));
+    EXPECT_EQ(id, 42);
+    EXPECT_TRUE(q.GetBigInt("xp", xp));
+    EXPECT_EQ(xp, 1234567890123LL);
+
+    // Too big for 32 bits.
+    EXPECT_FALSE(q.GetInt("xp", id));
+
+    ASSERT_TRUE(q.GetBlob(2, pData, size));
+    ASSERT_EQ(size, 3u);
+    EXPECT_EQ(pData[0], 0x00);
+    EXPECT_EQ((uint8_t)pData[1], 0xFF);
+    EXPECT_EQ(pData[2], 0x7F);
+
+    ASSERT_TRUE(q.GetText("name", szName, size));
+    EXPECT_EQ(std::string(szName, size), "hikaru");
+
+    // Wrong type and missing columns.
+    EXPECT_FALSE(q.GetText(0, szName, size));
+    EXPECT_FALSE(q.GetInt(4, id));
+    EXPECT_FALSE(q.GetInt("missing", id));
+
+    ASSERT_TRUE(q.Next());
+    EXPECT_FALSE(q.GetBigInt(1, xp));
+    EXPECT_FALSE(q.GetBlob("data", pData, size));
+    EXPECT_FALSE(q.Next());
+    EXPECT_FALSE(q.GetInt(0, id));
+
+    std::string names;
+
+    EXPECT_TRUE(q.ForEachRow([&q, &names]()
+    {
+        const char *szText;
+        size_t textSize;
+
+        if(q.GetText(3, szText, textSize))
+        {
+            names.append(szText, textSize).append(";");
+        }
+
+        return true;
+    }));
+
+    EXPECT_EQ(names, "hikaru;ren;");
+
+    // The visitor can stop early.
+    int visited = 0;
+
+    EXPECT_TRUE(q.ForEachRow([&visited]()
+    {
+        visited++;
+
+        return false;
+    }));
+
+    EXPECT_EQ(visited, 1);
+
+    q = DatabaseQuery(nullptr, String());
+
+    ASSERT_TRUE(db.Close());
+}
+
+TEST(StatementCache, Eviction)
+{
+    StatementCache<int> cache(2);
+
+    cache.Insert("a", std::make_shared<int>(1));
+    cache.Insert("b", std::make_shared<int>(2));
+
+    // Use "a" so "b" is the least recently used.
+    ASSERT_TRUE(nullptr != cache.Find("a"));
+    EXPECT_EQ(*cache.Find("a"), 1);
+
+    cache.Insert("c", std::make_shared<int>(3));
+
+    EXPECT_TRUE(nullptr == cache.Find("b"));
+    EXPECT_TRUE(nullptr != cache.Find("c"));
+
+    // Taking a statement removes it until it is inserted again.
+    std::shared_ptr<int> taken = cache.Find("a", true);
+    ASSERT_TRUE(nullptr != taken);
+    EXPECT_TRUE(nullptr == cache.Find("a"));
+
+    cache.Insert("a", taken);
+    EXPECT_TRUE(nullptr != cache.Find("a"));
+
+    StatementCacheStats_t stats = cache.GetStats();
+    EXPECT_EQ(stats.hits, 5u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_EQ(stats.size, 2u);
+}
+
+TEST(DatabasePool, CheckOut)
+{
+    DatabasePool pool([]()
+    {
+        std::shared_ptr<Database> db = std::make_shared<DatabaseSQLite3>();
+
+        return db->Open(":memory:") ? db : std::shared_ptr<Database>();
+    }, 2);
+
+    EXPECT_EQ(pool.GetOpenCount(), 0u);
+
+    std::shared_ptr<Database> a = pool.Acquire();
+    std::shared_ptr<Database> b = pool.Acquire();
+    ASSERT_TRUE(nullptr != a);
+    ASSERT_TRUE(nullptr != b);
+    EXPECT_NE(a.get(), b.get());
+    EXPECT_EQ(pool.GetOpenCount(), 2u);
+    EXPECT_EQ(pool.GetIdleCount(), 0u);
+
+    Database *pFirst = a.get();
+
+    // The pool is full so this waits until a connection is returned.
+    std::shared_ptr<Database> c;
+
+    std::thread waiter([&pool, &c]()
+    {
+        c = pool.Acquire();
+    });
+
+    a.reset();
+    waiter.join();
+
+    EXPECT_EQ(c.get(), pFirst);
+    EXPECT_EQ(pool.GetOpenCount(), 2u);
+
+    c.reset();
+    EXPECT_EQ(pool.GetIdleCount(), 1u);
+
+    // Each thread keeps its own connection.
+    std::shared_ptr<Database> mine = pool.GetThreadDatabase();
+    EXPECT_EQ(mine.get(), pool.GetThreadDatabase().get());
+
+    b.reset();
+
+    Database *pOther = nullptr;
+
+    std::thread other([&pool, &pOther]()
+    {
+        pOther = pool.GetThreadDatabase().get();
+    });
+
+    other.join();
+
+    EXPECT_NE(pOther, mine.get());
+    EXPECT_EQ(pool.GetIdleCount(), 1u);
+}
+
 int main(int argc, char *argv[])
 {
     try
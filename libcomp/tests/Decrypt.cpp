@@ -32,6 +32,7 @@
 #include <Decrypt.h>
 #include <Exception.h>
 
+#include <algorithm>
 #include <regex>
 
 using namespace libcomp;
@@ -79,6 +80,32 @@ TEST(GenerateRandom, NegativeOrZeroReturnsDefault)
         "GenerateRandom should return an empty string for an invalid size.";
 }
 
+TEST(GenerateSessionToken, OutputIsLowerHex)
+{
+    String token = Decrypt::GenerateSessionToken(300);
+
+    EXPECT_EQ(token.Length(), 300);
+    EXPECT_TRUE(std::regex_match(token.ToUtf8(), std::regex("^[a-f0-9]*$")))
+        << "GenerateSessionToken should return lower-case hex.";
+    EXPECT_TRUE(Decrypt::GenerateSessionToken(3).IsEmpty());
+}
+
+TEST(GenerateSessionToken, OutputChanges)
+{
+    // Enough tokens to refill the random pool more than once.
+    String last = Decrypt::GenerateSessionToken(300);
+
+    for(int i = 0; i < 64; ++i)
+    {
+        String token = Decrypt::GenerateSessionToken(300);
+
+        ASSERT_EQ(token.Length(), 300);
+        ASSERT_NE(token, last);
+
+        last = token;
+    }
+}
+
 TEST(GenerateSessionKey, ValueIsNotNegative)
 {
     for(int i = 0; i < 1000; ++i)
@@ -224,6 +251,59 @@ TEST(EncryptDecrypt, File)
     }
 }
 
+TEST(Decrypt, FileChunks)
+{
+    std::vector<char> data(100003);
+
+    for(size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = (char)(i * 7 + i / 251);
+    }
+
+    ASSERT_TRUE(Decrypt::EncryptFile("/tmp/test.bin", data));
+
+    std::vector<char> expected = Decrypt::LoadFile("/tmp/test.bin");
+
+    // Chunk sizes that are not a multiple of the block size are rounded.
+    for(size_t chunkSize : { 8, 27, 4096, 1 << 20 })
+    {
+        size_t offset = 0;
+
+        ASSERT_TRUE(Decrypt::EncryptFile("/tmp/test.bin",
+            [&data, &offset](char *pData, size_t size)
+        {
+            size = std::min(size, data.size() - offset);
+            memcpy(pData, &data[offset], size);
+            offset += size;
+
+            return size;
+        }, (uint32_t)data.size(), chunkSize));
+
+        EXPECT_EQ(expected, Decrypt::LoadFile("/tmp/test.bin"));
+
+        std::vector<char> decrypted;
+        size_t largest = 0;
+
+        ASSERT_TRUE(Decrypt::DecryptFile("/tmp/test.bin",
+            [&decrypted, &largest](const char *pData, size_t size)
+        {
+            decrypted.insert(decrypted.end(), pData, pData + size);
+            largest = std::max(largest, size);
+
+            return true;
+        }, chunkSize));
+
+        EXPECT_EQ(data, decrypted);
+        EXPECT_GE(std::max<size_t>(chunkSize, 8), largest);
+    }
+
+    // The sink may stop early.
+    EXPECT_FALSE(Decrypt::DecryptFile("/tmp/test.bin",
+        [](const char*, size_t) { return false; }));
+    EXPECT_FALSE(Decrypt::DecryptFile("/tmp/does-not-exist.bin",
+        [](const char*, size_t) { return true; }));
+}
+
 int main(int argc, char *argv[])
 {
     try
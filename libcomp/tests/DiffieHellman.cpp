@@ -104,6 +104,80 @@ TEST(DiffieHellman, KeyExchange)
     DH_free(pServer);
 }
 
+TEST(DiffieHellman, BinaryKeyExchange)
+{
+    DH *pServer = TcpServer::GenerateDiffieHellman();
+    ASSERT_NE(pServer, nullptr);
+
+    TcpConnection::DiffieHellmanKey_t prime;
+    ASSERT_TRUE(TcpConnection::GetDiffieHellmanPrime(pServer, prime));
+
+    TcpConnection::DiffieHellmanKey_t serverPublic;
+    ASSERT_TRUE(TcpConnection::GenerateDiffieHellmanPublic(pServer,
+        serverPublic));
+
+    // The keys go over the wire as the same hex strings.
+    Packet packet;
+    TcpConnection::WriteDiffieHellmanKey(packet, prime);
+    TcpConnection::WriteDiffieHellmanKey(packet, serverPublic);
+    ASSERT_EQ(packet.Size(), 2 * (sizeof(uint32_t) + DH_KEY_HEX_SIZE));
+
+    packet.Rewind();
+    ASSERT_EQ(packet.ReadString32Big(Convert::ENCODING_UTF8),
+        TcpConnection::GetDiffieHellmanPrime(pServer));
+    ASSERT_EQ(packet.ReadString32Big(Convert::ENCODING_UTF8),
+        TcpConnection::GenerateDiffieHellmanPublic(pServer));
+
+    TcpConnection::DiffieHellmanKey_t readPrime;
+    TcpConnection::DiffieHellmanKey_t readPublic;
+
+    packet.Rewind();
+    ASSERT_TRUE(TcpConnection::ReadDiffieHellmanKey(packet, readPrime));
+    ASSERT_TRUE(TcpConnection::ReadDiffieHellmanKey(packet, readPublic));
+    ASSERT_EQ(packet.Left(), 0u);
+    ASSERT_EQ(readPrime, prime);
+    ASSERT_EQ(readPublic, serverPublic);
+
+    DH *pClient = TcpServer::LoadDiffieHellman(readPrime.data(),
+        readPrime.size());
+    ASSERT_NE(pClient, nullptr);
+
+    TcpConnection::DiffieHellmanKey_t clientPublic;
+    ASSERT_TRUE(TcpConnection::GenerateDiffieHellmanPublic(pClient,
+        clientPublic));
+
+    std::vector<char> clientData =
+        TcpConnection::GenerateDiffieHellmanSharedData(pClient, readPublic);
+    ASSERT_EQ(clientData.size(), DH_SHARED_DATA_SIZE);
+
+    std::vector<char> serverData =
+        TcpConnection::GenerateDiffieHellmanSharedData(pServer, clientPublic);
+    ASSERT_EQ(serverData, clientData);
+
+    // The hex version gets the same data.
+    ASSERT_EQ(TcpConnection::GenerateDiffieHellmanSharedData(pServer,
+        TcpConnection::GenerateDiffieHellmanPublic(pClient)), serverData);
+
+    // A public key of 1 is refused.
+    TcpConnection::DiffieHellmanKey_t badPublic;
+    badPublic.fill(0);
+    badPublic[badPublic.size() - 1] = 1;
+
+    ASSERT_TRUE(TcpConnection::GenerateDiffieHellmanSharedData(pServer,
+        badPublic).empty());
+
+    // So is a key that is not hex.
+    Packet badPacket;
+    badPacket.WriteU32Big(DH_KEY_HEX_SIZE);
+    badPacket.WriteBlank(DH_KEY_HEX_SIZE);
+    badPacket.Rewind();
+
+    ASSERT_FALSE(TcpConnection::ReadDiffieHellmanKey(badPacket, badPublic));
+
+    DH_free(pClient);
+    DH_free(pServer);
+}
+
 int main(int argc, char *argv[])
 {
     try
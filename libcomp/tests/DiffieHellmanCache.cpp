@@ -0,0 +1,142 @@
+/**
+ * @file libcomp/tests/DiffieHellmanCache.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the DiffieHellmanCache class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <DiffieHellmanCache.h>
+#include <TcpConnection.h>
+#include <TcpServer.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <thread>
+
+using namespace libcomp;
+
+/**
+ * Wait for the cache to have a number of key pairs ready.
+ * @param cache Cache to wait for.
+ * @param count Number of key pairs to wait for.
+ * @returns true if the key pairs were ready within 10 seconds.
+ */
+static bool WaitForKeys(const DiffieHellmanCache& cache, size_t count)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    while(count > cache.Available())
+    {
+        if(std::chrono::steady_clock::now() > end)
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+TEST(DiffieHellmanCache, TakeAndRefill)
+{
+    DH *pDiffieHellman = TcpServer::GenerateDiffieHellman();
+    ASSERT_NE(pDiffieHellman, nullptr);
+
+    DiffieHellmanCache cache(pDiffieHellman, 4);
+    ASSERT_TRUE(WaitForKeys(cache, 4));
+
+    // Key pairs from the cache are already generated.
+    DH *pFirst = cache.Take();
+    DH *pSecond = cache.Take();
+    ASSERT_NE(pFirst, nullptr);
+    ASSERT_NE(pSecond, nullptr);
+    ASSERT_NE(pFirst->pub_key, nullptr);
+    ASSERT_NE(pSecond->pub_key, nullptr);
+    ASSERT_NE(BN_cmp(pFirst->pub_key, pSecond->pub_key), 0);
+    ASSERT_EQ(cache.GetMisses(), 0u);
+
+    // The handshake uses the pre-generated public key as it is.
+    TcpConnection::DiffieHellmanKey_t publicKey;
+    ASSERT_TRUE(TcpConnection::GenerateDiffieHellmanPublic(pFirst,
+        publicKey));
+
+    BIGNUM *pPublic = BN_bin2bn(publicKey.data(), (int)publicKey.size(),
+        nullptr);
+    ASSERT_NE(pPublic, nullptr);
+    ASSERT_EQ(BN_cmp(pPublic, pFirst->pub_key), 0);
+    BN_free(pPublic);
+
+    // The keys that were taken are replaced.
+    ASSERT_TRUE(WaitForKeys(cache, 4));
+
+    DH_free(pFirst);
+    DH_free(pSecond);
+    DH_free(pDiffieHellman);
+}
+
+TEST(DiffieHellmanCache, Miss)
+{
+    DH *pDiffieHellman = TcpServer::GenerateDiffieHellman();
+    ASSERT_NE(pDiffieHellman, nullptr);
+
+    // A cache with no room is always empty.
+    DiffieHellmanCache cache(pDiffieHellman, 0);
+
+    DH *pKey = cache.Take();
+    ASSERT_NE(pKey, nullptr);
+    ASSERT_EQ(cache.GetMisses(), 1u);
+    ASSERT_EQ(cache.Available(), 0u);
+
+    // The copy has the prime but the key pair is made by the handshake.
+    ASSERT_EQ(TcpConnection::GetDiffieHellmanPrime(pKey),
+        TcpConnection::GetDiffieHellmanPrime(pDiffieHellman));
+    ASSERT_EQ(pKey->pub_key, nullptr);
+    ASSERT_EQ(TcpConnection::GenerateDiffieHellmanPublic(pKey).Length(),
+        DH_KEY_HEX_SIZE);
+    ASSERT_NE(pKey->pub_key, nullptr);
+
+    DH_free(cache.Take());
+    ASSERT_EQ(cache.GetMisses(), 2u);
+
+    DH_free(pKey);
+    DH_free(pDiffieHellman);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
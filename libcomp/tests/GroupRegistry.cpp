@@ -0,0 +1,131 @@
+/**
+ * @file libcomp/tests/GroupRegistry.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the GroupRegistry class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <GroupRegistry.h>
+
+using namespace libcomp;
+
+TEST(GroupRegistry, JoinLeave)
+{
+    asio::io_service service;
+    GroupRegistry registry;
+
+    std::shared_ptr<TcpConnection> a(new TcpConnection(service));
+    std::shared_ptr<TcpConnection> b(new TcpConnection(service));
+
+    EXPECT_TRUE(registry.Join(CHAT_VISIBILITY_PARTY, 1, a));
+    EXPECT_FALSE(registry.Join(CHAT_VISIBILITY_PARTY, 1, a));
+    EXPECT_TRUE(registry.Join(CHAT_VISIBILITY_PARTY, 1, b));
+    EXPECT_TRUE(registry.Join(CHAT_VISIBILITY_KLAN, 1, a));
+    EXPECT_FALSE(registry.Join(CHAT_VISIBILITY_KLAN, 1, nullptr));
+
+    EXPECT_EQ(registry.Count(), 2);
+
+    GroupRegistry::Members_t party = registry.GetMembers(
+        CHAT_VISIBILITY_PARTY, 1);
+    ASSERT_NE(party, nullptr);
+    EXPECT_EQ(party->connections.size(), 2);
+    ASSERT_EQ(party->owners.size(), 1);
+    EXPECT_EQ(party->owners[0].pService, &service);
+    EXPECT_EQ(party->owners[0].count, 2);
+
+    // Changes make a new array; the old one is left alone.
+    EXPECT_TRUE(registry.Leave(CHAT_VISIBILITY_PARTY, 1, a.get()));
+    EXPECT_FALSE(registry.Leave(CHAT_VISIBILITY_PARTY, 1, a.get()));
+
+    GroupRegistry::Members_t changed = registry.GetMembers(
+        CHAT_VISIBILITY_PARTY, 1);
+    ASSERT_NE(changed, nullptr);
+    EXPECT_EQ(changed->connections.size(), 1);
+    EXPECT_EQ(changed->connections[0], b);
+    EXPECT_GT(changed->version, party->version);
+    EXPECT_EQ(party->connections.size(), 2);
+
+    // Closing leaves every group and empty groups are dropped.
+    EXPECT_EQ(registry.LeaveAll(a.get()), 1);
+    EXPECT_EQ(registry.GetMembers(CHAT_VISIBILITY_KLAN, 1), nullptr);
+    EXPECT_EQ(registry.LeaveAll(b.get()), 1);
+    EXPECT_EQ(registry.LeaveAll(b.get()), 0);
+    EXPECT_EQ(registry.Count(), 0);
+}
+
+TEST(GroupRegistry, Broadcast)
+{
+    asio::io_service first;
+    asio::io_service second;
+    GroupRegistry registry;
+
+    std::shared_ptr<TcpConnection> a(new TcpConnection(first));
+    std::shared_ptr<TcpConnection> b(new TcpConnection(second));
+    std::shared_ptr<TcpConnection> c(new TcpConnection(first));
+
+    EXPECT_TRUE(registry.Join(CHAT_VISIBILITY_TEAM, 9, a));
+    EXPECT_TRUE(registry.Join(CHAT_VISIBILITY_TEAM, 9, b));
+    EXPECT_TRUE(registry.Join(CHAT_VISIBILITY_TEAM, 9, c));
+
+    // The members are grouped by io_service.
+    GroupRegistry::Members_t members = registry.GetMembers(
+        CHAT_VISIBILITY_TEAM, 9);
+    ASSERT_EQ(members->owners.size(), 2);
+    EXPECT_EQ(members->connections[0], a);
+    EXPECT_EQ(members->connections[1], c);
+    EXPECT_EQ(members->connections[2], b);
+
+    Packet p;
+    p.WriteU32Little(0x12345678);
+
+    ReadOnlyPacket packet(std::move(p));
+
+    EXPECT_EQ(registry.Broadcast(CHAT_VISIBILITY_TEAM, 9, packet, a.get()),
+        2);
+    EXPECT_EQ(registry.Broadcast(CHAT_VISIBILITY_TEAM, 10, packet), 0);
+
+    // One job for each io_service queues the packet for its members.
+    EXPECT_EQ(first.poll_one(), 1);
+    EXPECT_EQ(second.poll_one(), 1);
+
+    EXPECT_EQ(a->GetOutgoingBytes(), 0);
+    EXPECT_EQ(b->GetOutgoingBytes(), packet.Size());
+    EXPECT_EQ(c->GetOutgoingBytes(), packet.Size());
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
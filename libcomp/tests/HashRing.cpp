@@ -0,0 +1,215 @@
+/**
+ * @file libcomp/tests/HashRing.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the consistent hash ring.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <HashRing.h>
+
+// Standard C++11 Includes
+#include <map>
+
+using namespace libcomp;
+
+static const size_t KEY_COUNT = 10000;
+
+static String MakeKey(size_t i)
+{
+    return String("account%1").Arg(i);
+}
+
+TEST(HashRing, Empty)
+{
+    HashRing ring;
+
+    EXPECT_EQ(ring.GetNodeCount(), 0);
+    EXPECT_TRUE(ring.GetNode("test").IsEmpty());
+    EXPECT_TRUE(ring.GetNodes("test", 3).empty());
+    EXPECT_FALSE(ring.IsOwner("test", ""));
+    EXPECT_FALSE(ring.RemoveNode("a"));
+}
+
+TEST(HashRing, Deterministic)
+{
+    HashRing a, b;
+
+    a.AddNode("a:1");
+    a.AddNode("b:2");
+    a.AddNode("c:3");
+
+    // The order nodes are added in must not change the ring.
+    b.AddNode("c:3");
+    b.AddNode("a:1");
+    b.AddNode("b:2");
+    b.AddNode("a:1");
+
+    EXPECT_EQ(b.GetNodeCount(), 3);
+
+    for(size_t i = 0; i < KEY_COUNT; ++i)
+    {
+        String key = MakeKey(i);
+
+        EXPECT_EQ(a.GetNode(key), b.GetNode(key));
+        EXPECT_TRUE(a.IsOwner(key, a.GetNode(key)));
+    }
+}
+
+TEST(HashRing, AddMovesOnlyNewKeys)
+{
+    HashRing ring;
+    ring.AddNode("a");
+    ring.AddNode("b");
+    ring.AddNode("c");
+
+    std::vector<String> before;
+
+    for(size_t i = 0; i < KEY_COUNT; ++i)
+    {
+        before.push_back(ring.GetNode(MakeKey(i)));
+    }
+
+    ring.AddNode("d");
+
+    size_t moved = 0;
+
+    for(size_t i = 0; i < KEY_COUNT; ++i)
+    {
+        String owner = ring.GetNode(MakeKey(i));
+
+        if(owner != before[i])
+        {
+            // Keys may only move to the new node.
+            EXPECT_EQ(owner, "d");
+            moved++;
+        }
+    }
+
+    // Roughly a quarter of the keys should move.
+    EXPECT_GT(moved, KEY_COUNT / 8);
+    EXPECT_LT(moved, KEY_COUNT * 3 / 8);
+}
+
+TEST(HashRing, RemoveMovesOnlyOwnKeys)
+{
+    HashRing ring;
+    ring.AddNode("a");
+    ring.AddNode("b");
+    ring.AddNode("c");
+    ring.AddNode("d");
+
+    std::vector<String> before;
+
+    for(size_t i = 0; i < KEY_COUNT; ++i)
+    {
+        before.push_back(ring.GetNode(MakeKey(i)));
+    }
+
+    EXPECT_TRUE(ring.RemoveNode("b"));
+    EXPECT_FALSE(ring.HasNode("b"));
+    EXPECT_EQ(ring.GetNodeCount(), 3);
+
+    for(size_t i = 0; i < KEY_COUNT; ++i)
+    {
+        String owner = ring.GetNode(MakeKey(i));
+
+        if("b" == before[i])
+        {
+            EXPECT_NE(owner, "b");
+        }
+        else
+        {
+            EXPECT_EQ(owner, before[i]);
+        }
+    }
+}
+
+TEST(HashRing, Balance)
+{
+    HashRing ring;
+    ring.AddNode("10.0.0.1:14666");
+    ring.AddNode("10.0.0.2:14666");
+    ring.AddNode("10.0.0.3:14666");
+    ring.AddNode("10.0.0.4:14666");
+
+    std::map<std::string, size_t> counts;
+
+    for(size_t i = 0; i < KEY_COUNT; ++i)
+    {
+        counts[ring.GetNode(MakeKey(i)).ToUtf8()]++;
+    }
+
+    EXPECT_EQ(counts.size(), 4);
+
+    for(auto it : counts)
+    {
+        EXPECT_GT(it.second, KEY_COUNT / 8);
+        EXPECT_LT(it.second, KEY_COUNT * 3 / 8);
+    }
+}
+
+TEST(HashRing, Fallback)
+{
+    HashRing ring;
+    ring.AddNode("a");
+    ring.AddNode("b");
+    ring.AddNode("c");
+
+    for(size_t i = 0; i < 100; ++i)
+    {
+        String key = MakeKey(i);
+        std::vector<String> nodes = ring.GetNodes(key, 5);
+
+        ASSERT_EQ(nodes.size(), 3);
+        EXPECT_EQ(nodes[0], ring.GetNode(key));
+        EXPECT_NE(nodes[0], nodes[1]);
+        EXPECT_NE(nodes[0], nodes[2]);
+        EXPECT_NE(nodes[1], nodes[2]);
+
+        // The second choice is where the key goes if the owner leaves.
+        HashRing smaller;
+        smaller.AddNode("a");
+        smaller.AddNode("b");
+        smaller.AddNode("c");
+        smaller.RemoveNode(nodes[0]);
+
+        EXPECT_EQ(smaller.GetNode(key), nodes[1]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,179 @@
+/**
+ * @file libcomp/tests/InterestGrid.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the InterestGrid class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <InterestGrid.h>
+
+// Standard C++11 Includes
+#include <cmath>
+#include <random>
+#include <set>
+
+using namespace libcomp;
+
+TEST(InterestGrid, Range)
+{
+    asio::io_service service;
+    InterestGrid grid(100.0f);
+
+    std::shared_ptr<TcpConnection> a(new TcpConnection(service));
+    std::shared_ptr<TcpConnection> b(new TcpConnection(service));
+    std::shared_ptr<TcpConnection> c(new TcpConnection(service));
+
+    EXPECT_TRUE(grid.Update(a, 1, 0.0f, 0.0f));
+    EXPECT_TRUE(grid.Update(b, 1, 150.0f, 0.0f));
+    EXPECT_TRUE(grid.Update(c, 2, 0.0f, 0.0f));
+    EXPECT_FALSE(grid.Update(nullptr, 1, 0.0f, 0.0f));
+
+    EXPECT_EQ(grid.Count(), 3);
+    EXPECT_EQ(grid.Count(1), 2);
+    EXPECT_EQ(grid.Count(2), 1);
+
+    InterestGrid::ConnectionList_t recipients;
+
+    // Only a is close enough and c is in another zone.
+    EXPECT_EQ(grid.GetInRange(1, -10.0f, 0.0f, 100.0f, recipients), 1);
+    ASSERT_EQ(recipients.size(), 1);
+    EXPECT_EQ(recipients.front(), a);
+
+    // The sender is left out.
+    recipients.clear();
+    EXPECT_EQ(grid.GetInRange(1, 0.0f, 0.0f, 200.0f, recipients,
+        a.get()), 1);
+    EXPECT_EQ(recipients.front(), b);
+
+    // Moving across cells and zones.
+    EXPECT_TRUE(grid.Update(b, 1, -50.0f, -50.0f));
+    EXPECT_TRUE(grid.Update(c, 1, 1000.0f, 1000.0f));
+
+    uint32_t zoneID;
+    float x, y;
+
+    EXPECT_TRUE(grid.GetPosition(c.get(), zoneID, x, y));
+    EXPECT_EQ(zoneID, 1);
+    EXPECT_EQ(x, 1000.0f);
+    EXPECT_EQ(grid.Count(2), 0);
+
+    recipients.clear();
+    EXPECT_EQ(grid.GetInRange(1, 0.0f, 0.0f, 100.0f, recipients), 2);
+
+    recipients.clear();
+    EXPECT_EQ(grid.GetInZone(1, recipients, b.get()), 2);
+
+    // A huge range still finds everyone.
+    recipients.clear();
+    EXPECT_EQ(grid.GetInRange(1, 0.0f, 0.0f, 1.0e30f, recipients), 3);
+
+    EXPECT_TRUE(grid.Remove(b.get()));
+    EXPECT_FALSE(grid.Remove(b.get()));
+    EXPECT_FALSE(grid.GetPosition(b.get(), zoneID, x, y));
+    EXPECT_EQ(grid.Count(1), 2);
+
+    recipients.clear();
+    EXPECT_EQ(grid.GetInRange(1, 0.0f, 0.0f, 100.0f, recipients), 1);
+}
+
+TEST(InterestGrid, MatchesScan)
+{
+    asio::io_service service;
+    InterestGrid grid(64.0f);
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+
+    std::vector<std::shared_ptr<TcpConnection>> connections;
+    std::vector<std::pair<float, float>> positions;
+
+    for(int i = 0; i < 500; ++i)
+    {
+        connections.emplace_back(new TcpConnection(service));
+        positions.push_back(std::make_pair(position(random),
+            position(random)));
+    }
+
+    // Place everyone and then move them all a few times.
+    for(int round = 0; round < 3; ++round)
+    {
+        for(size_t i = 0; i < connections.size(); ++i)
+        {
+            positions[i] = std::make_pair(position(random),
+                position(random));
+
+            ASSERT_TRUE(grid.Update(connections[i], 7, positions[i].first,
+                positions[i].second));
+        }
+    }
+
+    for(int query = 0; query < 50; ++query)
+    {
+        float x = position(random);
+        float y = position(random);
+        float range = (float)(query * 10);
+
+        std::set<TcpConnection*> expected;
+
+        for(size_t i = 0; i < connections.size(); ++i)
+        {
+            float dx = positions[i].first - x;
+            float dy = positions[i].second - y;
+
+            if(range * range >= dx * dx + dy * dy)
+            {
+                expected.insert(connections[i].get());
+            }
+        }
+
+        InterestGrid::ConnectionList_t recipients;
+        grid.GetInRange(7, x, y, range, recipients);
+
+        std::set<TcpConnection*> found;
+
+        for(auto& connection : recipients)
+        {
+            found.insert(connection.get());
+        }
+
+        EXPECT_EQ(found, expected);
+        EXPECT_EQ(found.size(), recipients.size());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,363 @@
+/**
+ * @file libcomp/tests/InternalConnection.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the handshake and framing of the InternalConnection class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include "ConnectionTest.h"
+
+#include <Constants.h>
+#include <InternalConnection.h>
+#include <MessagePacketFrame.h>
+#include <ProtocolError.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <vector>
+
+using namespace libcomp;
+
+/**
+ * Connect the client of a pair and create the server end (but don't start
+ * it so messages may be queued on it first).
+ * @param service io_service for both ends.
+ * @param pair Pair to connect.
+ * @param serverKey Pre-shared key of the server end.
+ * @returns true if the server end was created.
+ */
+static bool AcceptPair(asio::io_service& service,
+    ConnectionPair<InternalConnection>& pair, const String& serverKey)
+{
+    asio::ip::tcp::socket accepted(service);
+
+    if(!AcceptClient(service, *pair.client, accepted))
+    {
+        return false;
+    }
+
+    pair.server.reset(new InternalConnection(accepted));
+    pair.server->SetSelf(pair.server);
+    pair.server->SetPreSharedKey(serverKey);
+    pair.server->SetMessageQueue(pair.serverQueue);
+
+    return true;
+}
+
+/**
+ * Connect both ends of a pair with the same key and run the handshake.
+ * @param service io_service for both ends.
+ * @param pair Pair to connect.
+ * @returns true if both ends are ready.
+ */
+static bool ConnectPair(asio::io_service& service,
+    ConnectionPair<InternalConnection>& pair)
+{
+    pair.client->SetPreSharedKey("secret");
+
+    if(!AcceptPair(service, pair, "secret"))
+    {
+        return false;
+    }
+
+    pair.server->ConnectionSuccess();
+
+    return RunUntil(service, [&pair]()
+    {
+        return pair.client->IsReady() && pair.server->IsReady();
+    });
+}
+
+/**
+ * Wait for the next frame sent to a queue.
+ * @param service io_service to run while waiting.
+ * @param queue Queue to take the frame from.
+ * @returns The frame or nullptr if none arrived.
+ */
+static std::unique_ptr<Message::PacketFrame> WaitForFrame(
+    asio::io_service& service, TestQueue_t& queue)
+{
+    Message::Message *pMessage = nullptr;
+
+    if(RunUntil(service, [&queue]() { return 0 < queue.Size(); }))
+    {
+        (void)queue.TryDequeue(pMessage);
+    }
+
+    std::unique_ptr<Message::Message> message(pMessage);
+    std::unique_ptr<Message::PacketFrame> frame(
+        dynamic_cast<Message::PacketFrame*>(pMessage));
+
+    if(frame)
+    {
+        (void)message.release();
+    }
+
+    return frame;
+}
+
+/**
+ * Send raw bytes that are not a valid frame from the client of a pair.
+ * @param data Bytes to send after the handshake.
+ */
+static void CheckBadFrame(const std::vector<uint8_t>& data)
+{
+    asio::io_service service;
+    ConnectionPair<InternalConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    uint64_t violations = ProtocolError::GetCount(
+        ProtocolError::CODE_BAD_INTERNAL_FRAME);
+
+    Packet packet;
+    packet.WriteArray(&data[0], (uint32_t)data.size());
+
+    ASSERT_TRUE(pair.client->SendPacket(packet));
+    ASSERT_TRUE(RunUntil(service, [&pair]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED ==
+            pair.server->GetStatus();
+    }));
+
+    EXPECT_EQ(violations + 1, ProtocolError::GetCount(
+        ProtocolError::CODE_BAD_INTERNAL_FRAME));
+    EXPECT_EQ(0u, pair.serverQueue->Size());
+}
+
+TEST(InternalConnection, Handshake)
+{
+    asio::io_service service;
+    ConnectionPair<InternalConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    EXPECT_EQ(TcpConnection::STATUS_CONNECTED, pair.client->GetStatus());
+    EXPECT_EQ(TcpConnection::STATUS_CONNECTED, pair.server->GetStatus());
+}
+
+TEST(InternalConnection, WrongKeyRejectedByClient)
+{
+    asio::io_service service;
+    ConnectionPair<InternalConnection> pair(service);
+
+    pair.client->SetPreSharedKey("secret");
+
+    ASSERT_TRUE(AcceptPair(service, pair, "guess"));
+
+    pair.server->ConnectionSuccess();
+
+    // The server proves itself first so the client finds out.
+    ASSERT_TRUE(RunUntil(service, [&pair]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED ==
+            pair.client->GetStatus() && TcpConnection::STATUS_NOT_CONNECTED ==
+            pair.server->GetStatus();
+    }));
+
+    EXPECT_FALSE(pair.client->IsReady());
+    EXPECT_FALSE(pair.server->IsReady());
+}
+
+TEST(InternalConnection, WrongKeyRejectedByServer)
+{
+    asio::io_service service;
+    asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(
+        asio::ip::address_v4::loopback(), 0));
+    asio::ip::tcp::socket client(service);
+
+    client.connect(acceptor.local_endpoint());
+
+    asio::ip::tcp::socket accepted(service);
+    acceptor.accept(accepted);
+
+    std::shared_ptr<InternalConnection> server(
+        new InternalConnection(accepted));
+    server->SetSelf(server);
+    server->SetPreSharedKey("secret");
+    server->ConnectionSuccess();
+
+    // A client that does not know the key can only guess the proof.
+    const uint32_t magicSize = (uint32_t)(sizeof(INTERNAL_MAGIC) - 1);
+
+    std::vector<char> hello(INTERNAL_MAGIC, INTERNAL_MAGIC + magicSize);
+    hello.resize(magicSize + INTERNAL_NONCE_SIZE, 0x11);
+
+    asio::write(client, asio::buffer(hello));
+
+    std::vector<char> serverHello(magicSize + INTERNAL_NONCE_SIZE +
+        INTERNAL_PROOF_SIZE);
+    bool helloRead = false;
+
+    asio::async_read(client, asio::buffer(serverHello), [&helloRead](
+        asio::error_code errorCode, size_t)
+    {
+        helloRead = !errorCode;
+    });
+
+    ASSERT_TRUE(RunUntil(service, [&helloRead]() { return helloRead; }));
+    EXPECT_EQ(0, memcmp(&serverHello[0], INTERNAL_MAGIC, magicSize));
+
+    std::vector<char> proof(INTERNAL_PROOF_SIZE, 0x22);
+    asio::write(client, asio::buffer(proof));
+
+    ASSERT_TRUE(RunUntil(service, [&server]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED == server->GetStatus();
+    }));
+    EXPECT_FALSE(server->IsReady());
+}
+
+TEST(InternalConnection, QueuedMessagesShareFrame)
+{
+    asio::io_service service;
+    ConnectionPair<InternalConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    const char first[] = "first";
+    const char third[] = "third message";
+
+    ASSERT_TRUE(pair.client->QueueMessage(0x10, first, sizeof(first)));
+    ASSERT_TRUE(pair.client->QueueMessage(0x11, nullptr, 0));
+    ASSERT_TRUE(pair.client->QueueMessage(0x12, third, sizeof(third)));
+
+    pair.client->FlushMessages();
+
+    std::unique_ptr<Message::PacketFrame> frame = WaitForFrame(service,
+        *pair.serverQueue);
+    ASSERT_NE(nullptr, frame.get());
+    ASSERT_EQ(3u, frame->GetCommandCount());
+    EXPECT_EQ(pair.server, frame->GetConnection());
+
+    const char *data[3] = { first, nullptr, third };
+    uint32_t sizes[3] = { sizeof(first), 0, sizeof(third) };
+
+    for(size_t i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(0x10 + i, frame->GetCommandCode(i));
+
+        ReadOnlyPacket message;
+        frame->GetCommand(i, message);
+
+        ASSERT_EQ(sizes[i], message.Size());
+
+        if(0 < sizes[i])
+        {
+            EXPECT_EQ(0, memcmp(data[i], message.ConstData(), sizes[i]));
+        }
+    }
+}
+
+TEST(InternalConnection, QueuedBeforeReady)
+{
+    asio::io_service service;
+    ConnectionPair<InternalConnection> pair(service);
+
+    const char data[] = "early";
+
+    // Both ends queue messages before the handshake has even started.
+    ASSERT_TRUE(pair.client->QueueMessage(0x20, data, sizeof(data)));
+    ASSERT_TRUE(pair.client->QueueMessage(0x21, data, sizeof(data)));
+
+    pair.client->FlushMessages();
+
+    pair.client->SetPreSharedKey("secret");
+
+    ASSERT_TRUE(AcceptPair(service, pair, "secret"));
+    ASSERT_TRUE(pair.server->QueueMessage(0x30, data, sizeof(data)));
+
+    pair.server->ConnectionSuccess();
+
+    std::unique_ptr<Message::PacketFrame> fromClient = WaitForFrame(service,
+        *pair.serverQueue);
+    std::unique_ptr<Message::PacketFrame> fromServer = WaitForFrame(service,
+        *pair.clientQueue);
+
+    ASSERT_NE(nullptr, fromClient.get());
+    ASSERT_NE(nullptr, fromServer.get());
+
+    EXPECT_TRUE(pair.client->IsReady());
+    EXPECT_TRUE(pair.server->IsReady());
+
+    ASSERT_EQ(2u, fromClient->GetCommandCount());
+    EXPECT_EQ(0x20, fromClient->GetCommandCode(0));
+    EXPECT_EQ(0x21, fromClient->GetCommandCode(1));
+
+    ASSERT_EQ(1u, fromServer->GetCommandCount());
+    EXPECT_EQ(0x30, fromServer->GetCommandCode(0));
+}
+
+TEST(InternalConnection, BadFrames)
+{
+    {
+        SCOPED_TRACE("Frame size is zero");
+
+        CheckBadFrame({ 0, 0, 0, 0 });
+    }
+
+    {
+        SCOPED_TRACE("Frame size is too big");
+
+        uint32_t frameSize = MAX_PACKET_SIZE;
+
+        CheckBadFrame({ (uint8_t)frameSize, (uint8_t)(frameSize >> 8),
+            (uint8_t)(frameSize >> 16), (uint8_t)(frameSize >> 24) });
+    }
+
+    {
+        SCOPED_TRACE("Frame size wraps around");
+
+        CheckBadFrame({ 0xFF, 0xFF, 0xFF, 0xFF });
+    }
+
+    {
+        SCOPED_TRACE("Message header runs past the frame");
+
+        CheckBadFrame({ 2, 0, 0, 0, 0x10, 0 });
+    }
+
+    {
+        SCOPED_TRACE("Message data runs past the frame");
+
+        CheckBadFrame({ 8, 0, 0, 0, 0x10, 0, 16, 0, 1, 2, 3, 4 });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
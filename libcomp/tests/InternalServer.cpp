@@ -0,0 +1,191 @@
+/**
+ * @file libcomp/tests/InternalServer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the InternalServer class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include "ConnectionTest.h"
+
+#include <InternalConnection.h>
+#include <InternalServer.h>
+#include <MessagePacketFrame.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace libcomp;
+
+/**
+ * Start a server on its own thread.
+ * @param server Server to start.
+ * @param serverThread Set to the thread running the server.
+ * @returns Port the server listens on (or zero if it did not start).
+ */
+static uint16_t StartServer(InternalServer& server, std::thread& serverThread)
+{
+    std::mutex lock;
+    std::condition_variable condition;
+    uint16_t port = 0;
+    bool ready = false;
+
+    server.SetReadyHandler([&]()
+    {
+        asio::ip::tcp::acceptor::native_handle_type handle;
+        sockaddr_in address;
+        socklen_t addressSize = sizeof(address);
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        if(server.GetListenHandle(handle) && 0 == getsockname(handle,
+            reinterpret_cast<sockaddr*>(&address), &addressSize))
+        {
+            port = ntohs(address.sin_port);
+        }
+
+        ready = true;
+        condition.notify_all();
+    });
+
+    serverThread = std::thread([&server]()
+    {
+        server.Start();
+    });
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    condition.wait_for(guard, std::chrono::seconds(5), [&ready]()
+    {
+        return ready;
+    });
+
+    return port;
+}
+
+/**
+ * Connect a link to the server.
+ * @param service io_service to run the link on.
+ * @param port Port of the server.
+ * @param key Pre-shared key of the link.
+ * @returns Link to the server.
+ */
+static std::shared_ptr<InternalConnection> ConnectLink(
+    asio::io_service& service, uint16_t port, const String& key)
+{
+    std::shared_ptr<InternalConnection> link(new InternalConnection(
+        service));
+    link->SetSelf(link);
+    link->SetPreSharedKey(key);
+
+    if(!link->Connect("127.0.0.1", port))
+    {
+        link.reset();
+    }
+
+    return link;
+}
+
+TEST(InternalServer, ReceiveMessages)
+{
+    std::shared_ptr<TestQueue_t> queue(new TestQueue_t);
+
+    InternalServer server("127.0.0.1", 0, "secret", queue);
+
+    std::thread serverThread;
+    uint16_t port = StartServer(server, serverThread);
+    ASSERT_NE(0, port);
+
+    asio::io_service service;
+
+    // A link with the wrong key is closed and never ready.
+    std::shared_ptr<InternalConnection> stranger = ConnectLink(service,
+        port, "guess");
+    ASSERT_NE(nullptr, stranger);
+    ASSERT_TRUE(RunUntil(service, [&stranger]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED == stranger->GetStatus();
+    }));
+    EXPECT_FALSE(stranger->IsReady());
+
+    // The server passes the key on to the connections it accepts.
+    std::shared_ptr<InternalConnection> link = ConnectLink(service, port,
+        "secret");
+    ASSERT_NE(nullptr, link);
+    ASSERT_TRUE(RunUntil(service, [&link]() { return link->IsReady(); }));
+
+    const char data[] = "session";
+
+    ASSERT_TRUE(link->QueueMessage(
+        InternalConnection::MESSAGE_SESSION_ROUTE, data, sizeof(data)));
+    ASSERT_TRUE(link->SendMessage(
+        InternalConnection::MESSAGE_SESSION_STATE, data, sizeof(data)));
+
+    // Every message the nodes send arrives on the queue.
+    ASSERT_TRUE(RunUntil(service, [&queue]() { return 0 < queue->Size(); }));
+
+    Message::Message *pMessage = nullptr;
+    ASSERT_TRUE(queue->TryDequeue(pMessage));
+
+    std::unique_ptr<Message::Message> message(pMessage);
+
+    Message::PacketFrame *pFrame = dynamic_cast<Message::PacketFrame*>(
+        pMessage);
+    ASSERT_NE(nullptr, pFrame);
+    ASSERT_EQ(2u, pFrame->GetCommandCount());
+    EXPECT_EQ(InternalConnection::MESSAGE_SESSION_ROUTE,
+        pFrame->GetCommandCode(0));
+    EXPECT_EQ(InternalConnection::MESSAGE_SESSION_STATE,
+        pFrame->GetCommandCode(1));
+
+    link->Close("Test is done.");
+    RunUntil(service, [&link]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED == link->GetStatus();
+    });
+
+    message.reset();
+
+    server.Stop("Test is done.", 1);
+    serverThread.join();
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
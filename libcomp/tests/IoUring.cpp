@@ -0,0 +1,230 @@
+/**
+ * @file libcomp/tests/IoUring.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the IoUring class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include "ConnectionTest.h"
+
+#include <IoUring.h>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // __linux__
+
+using namespace libcomp;
+
+#if defined(__linux__)
+TEST(IoUring, SendReceive)
+{
+    if(!IoUring::IsSupported())
+    {
+        return;
+    }
+
+    asio::io_service service;
+    IoUring ring(service);
+
+    ASSERT_TRUE(ring.Open(8, 4));
+
+    int sockets[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    std::vector<uint8_t> received;
+    int32_t lastResult = 1;
+
+    EXPECT_NE(0u, ring.Receive(sockets[0], [&](int32_t result,
+        const uint8_t *pData)
+    {
+        lastResult = result;
+
+        if(0 < result)
+        {
+            received.insert(received.end(), pData, pData + result);
+        }
+    }));
+
+    // Much more than the 4 receive buffers can hold at once so they are
+    // handed back to the kernel (and the socket buffer fills up).
+    std::vector<uint8_t> first(300000), second(5), third(70000);
+
+    for(size_t i = 0; i < first.size(); ++i)
+    {
+        first[i] = (uint8_t)i;
+    }
+
+    for(size_t i = 0; i < third.size(); ++i)
+    {
+        third[i] = (uint8_t)(i * 7);
+    }
+
+    std::vector<asio::const_buffer> buffers;
+    buffers.push_back(asio::buffer(first));
+    buffers.push_back(asio::buffer(second));
+    buffers.push_back(asio::buffer(third));
+
+    int32_t sent = 0;
+
+    EXPECT_TRUE(ring.Send(sockets[1], buffers, [&sent](int32_t result)
+    {
+        sent = result;
+    }));
+
+    size_t total = first.size() + second.size() + third.size();
+
+    EXPECT_TRUE(RunUntil(service, [&]()
+    {
+        return 0 != sent && received.size() >= total;
+    }));
+
+    EXPECT_EQ((int32_t)total, sent);
+    ASSERT_EQ(total, received.size());
+    EXPECT_TRUE(std::equal(first.begin(), first.end(), received.begin()));
+    EXPECT_TRUE(std::equal(third.begin(), third.end(), received.begin() +
+        (int64_t)(first.size() + second.size())));
+
+    // The receive ends once the peer is gone.
+    close(sockets[1]);
+
+    EXPECT_TRUE(RunUntil(service, [&]()
+    {
+        return 0 == lastResult;
+    }));
+
+    close(sockets[0]);
+}
+
+TEST(IoUring, Cancel)
+{
+    if(!IoUring::IsSupported())
+    {
+        return;
+    }
+
+    asio::io_service service;
+    IoUring ring(service);
+
+    ASSERT_TRUE(ring.Open(8, 4));
+
+    int sockets[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    std::shared_ptr<int> calls(new int(0));
+    std::weak_ptr<int> weakCalls(calls);
+
+    uint64_t id = ring.Receive(sockets[0], [calls](int32_t result,
+        const uint8_t *pData)
+    {
+        (void)result;
+        (void)pData;
+
+        (*calls)++;
+    });
+
+    ASSERT_NE(0u, id);
+
+    // The handler is released right away.
+    ring.Cancel(id);
+    calls.reset();
+    EXPECT_TRUE(weakCalls.expired());
+
+    // Nothing is delivered after the cancel.
+    uint8_t data[4] = { 1, 2, 3, 4 };
+    EXPECT_EQ(4, write(sockets[1], data, sizeof(data)));
+
+    bool ran = false;
+
+    EXPECT_TRUE(ring.Send(sockets[1], { asio::buffer(data) },
+        [&ran](int32_t result)
+    {
+        EXPECT_EQ(4, result);
+        ran = true;
+    }));
+
+    EXPECT_TRUE(RunUntil(service, [&ran]() { return ran; }));
+
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST(IoUring, Accept)
+{
+    if(!IoUring::IsSupported())
+    {
+        return;
+    }
+
+    asio::io_service service;
+    IoUring ring(service);
+
+    ASSERT_TRUE(ring.Open(8, 4));
+
+    asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(
+        asio::ip::address_v4::loopback(), 0));
+
+    std::vector<int> accepted;
+
+    EXPECT_NE(0u, ring.Accept(acceptor.native_handle(),
+        [&accepted](int32_t result)
+    {
+        accepted.push_back(result);
+    }));
+
+    // One accept keeps accepting.
+    asio::ip::tcp::socket a(service), b(service);
+    a.connect(acceptor.local_endpoint());
+    b.connect(acceptor.local_endpoint());
+
+    EXPECT_TRUE(RunUntil(service, [&accepted]()
+    {
+        return 2 <= accepted.size();
+    }));
+
+    ASSERT_EQ(2u, accepted.size());
+
+    for(auto handle : accepted)
+    {
+        EXPECT_LE(0, handle);
+        close(handle);
+    }
+}
+#endif // __linux__
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
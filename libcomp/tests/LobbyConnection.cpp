@@ -0,0 +1,1021 @@
+/**
+ * @file libcomp/tests/LobbyConnection.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the framing and encryption of the LobbyConnection class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include "ConnectionTest.h"
+
+#include <Compress.h>
+#include <Decrypt.h>
+#include <Endian.h>
+#include <LobbyConnection.h>
+#include <MessagePacket.h>
+#include <MessagePacketFrame.h>
+#include <ProtocolError.h>
+#include <TcpServer.h>
+#include <TimerWheel.h>
+#include <WorkerPool.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <list>
+#include <vector>
+
+using namespace libcomp;
+
+/**
+ * Get the server key pair shared by every test (generating the prime is
+ * slow).
+ * @returns Diffie-Hellman parameters of the server.
+ */
+static DH* GetServerDiffieHellman()
+{
+    static DH *pDiffieHellman = TcpServer::GenerateDiffieHellman();
+
+    return pDiffieHellman;
+}
+
+/**
+ * Connection that keeps a copy of every frame it sends.
+ */
+class TestConnection : public LobbyConnection
+{
+public:
+    TestConnection(asio::io_service& service) : LobbyConnection(service)
+    {
+    }
+
+    TestConnection(asio::ip::tcp::socket& socket, DH *pDiffieHellman) :
+        LobbyConnection(socket, pDiffieHellman)
+    {
+    }
+
+    virtual void PacketSent(ReadOnlyPacket& packet)
+    {
+        mSent.push_back(std::vector<char>(packet.ConstData(),
+            packet.ConstData() + packet.Size()));
+    }
+
+    const BF_KEY& GetEncryptionKey() const
+    {
+        return mEncryptionKey;
+    }
+
+    std::vector<std::vector<char>> mSent;
+};
+
+/**
+ * Connect a client to a server connection and run the key exchange.
+ * @param service io_service for both ends.
+ * @param pair Pair to connect.
+ * @param cryptoPool Pool both ends run the key exchange on (if any).
+ * @returns true if both ends are encrypted.
+ */
+static bool ConnectPair(asio::io_service& service,
+    ConnectionPair<TestConnection>& pair,
+    const std::shared_ptr<WorkerPool>& cryptoPool = nullptr)
+{
+    asio::ip::tcp::socket accepted(service);
+
+    pair.client->SetCryptoPool(cryptoPool);
+
+    if(!AcceptClient(service, *pair.client, accepted))
+    {
+        return false;
+    }
+
+    pair.server.reset(new TestConnection(accepted,
+        TcpServer::CopyDiffieHellman(GetServerDiffieHellman())));
+    pair.server->SetSelf(pair.server);
+    pair.server->SetMessageQueue(pair.serverQueue);
+    pair.server->SetCryptoPool(cryptoPool);
+    pair.server->ConnectionSuccess();
+
+    bool encrypted = RunUntil(service, [&pair]()
+    {
+        return TcpConnection::STATUS_ENCRYPTED ==
+            pair.client->GetStatus() && TcpConnection::STATUS_ENCRYPTED ==
+            pair.server->GetStatus();
+    });
+
+    // Only keep the frames sent after the handshake.
+    pair.client->mSent.clear();
+    pair.server->mSent.clear();
+
+    return encrypted;
+}
+
+/**
+ * Build an encrypted frame the way it was done before
+ * LobbyConnection::SendEncrypted (write a Packet and encrypt it after).
+ * @param key Key to encrypt the frame with.
+ * @param pCommands Commands to put in the frame.
+ * @param commandCount Number of commands.
+ * @returns Encrypted frame.
+ */
+static std::vector<char> BuildFrame(const BF_KEY& key,
+    const LobbyConnection::OutgoingCommand_t *pCommands,
+    size_t commandCount)
+{
+    Packet packet;
+    packet.WriteBlank(2 * sizeof(uint32_t));
+
+    for(size_t i = 0; i < commandCount; ++i)
+    {
+        uint16_t commandSize = (uint16_t)(pCommands[i].dataSize +
+            2 * sizeof(uint16_t));
+
+        packet.WriteU16Big(commandSize);
+        packet.WriteU16Little(commandSize);
+        packet.WriteU16Little(pCommands[i].commandCode);
+
+        if(0 < pCommands[i].dataSize)
+        {
+            packet.WriteArray(pCommands[i].pData, pCommands[i].dataSize);
+        }
+    }
+
+    Decrypt::EncryptPacket(key, packet);
+
+    return std::vector<char>(packet.ConstData(), packet.ConstData() +
+        packet.Size());
+}
+
+/**
+ * Decrypt a frame.
+ * @param key Key to decrypt the frame with.
+ * @param frame Encrypted frame.
+ * @returns Plaintext frame.
+ */
+static std::vector<char> DecryptFrame(const BF_KEY& key,
+    const std::vector<char>& frame)
+{
+    Packet packet(frame);
+
+    Decrypt::DecryptPacket(key, packet);
+
+    return std::vector<char>(packet.ConstData(), packet.ConstData() +
+        packet.Size());
+}
+
+/**
+ * Wait for the next message sent to a queue.
+ * @param service io_service to run while waiting.
+ * @param queue Queue to take the message from.
+ * @returns The message or nullptr if none arrived.
+ */
+static Message::Message* WaitForMessage(asio::io_service& service,
+    TestQueue_t& queue)
+{
+    Message::Message *pMessage = nullptr;
+
+    if(RunUntil(service, [&queue]() { return 0 < queue.Size(); }))
+    {
+        (void)queue.TryDequeue(pMessage);
+    }
+
+    return pMessage;
+}
+
+/**
+ * Wait for frames sent to a connection with frame dispatch enabled.
+ * @param service io_service to run while waiting.
+ * @param queue Queue the frames are sent to.
+ * @param frameCount Number of frames to wait for.
+ * @returns Command codes of each frame that arrived.
+ */
+static std::vector<std::vector<uint16_t>> WaitForFrames(
+    asio::io_service& service, TestQueue_t& queue, size_t frameCount)
+{
+    std::vector<std::vector<uint16_t>> frames;
+
+    while(frames.size() < frameCount)
+    {
+        std::unique_ptr<Message::Message> message(WaitForMessage(service,
+            queue));
+
+        Message::PacketFrame *pFrame = dynamic_cast<Message::PacketFrame*>(
+            message.get());
+
+        if(nullptr == pFrame)
+        {
+            break;
+        }
+
+        std::vector<uint16_t> codes;
+
+        for(auto& command : pFrame->GetCommands())
+        {
+            codes.push_back(command.commandCode);
+        }
+
+        frames.push_back(codes);
+    }
+
+    return frames;
+}
+
+/**
+ * Send a frame with the compressed flag set. The payload is padded and
+ * encrypted but otherwise sent as it is.
+ * @param connection Connection to send the frame on.
+ * @param payload Compressed payload (inflated size and zlib stream).
+ * @param realSize Real size to put in the frame header.
+ * @returns true if the frame was queued.
+ */
+static bool SendCompressedFrame(TestConnection& connection,
+    const std::vector<char>& payload, uint32_t realSize)
+{
+    uint32_t paddedSize = (uint32_t)((payload.size() + BLOWFISH_BLOCK_SIZE -
+        1) / BLOWFISH_BLOCK_SIZE) * BLOWFISH_BLOCK_SIZE;
+
+    std::vector<char> data(payload);
+    data.resize(paddedSize, 0);
+
+    Decrypt::Encrypt(connection.GetEncryptionKey(), &data[0], paddedSize);
+
+    Packet packet;
+    packet.WriteU32Big(paddedSize);
+    packet.WriteU32Big(realSize | FRAME_COMPRESSED_FLAG);
+    packet.WriteArray(data);
+
+    return connection.SendPacket(packet);
+}
+
+/**
+ * Build the payload of a compressed frame with one command in it.
+ * @param commandCode Code of the command.
+ * @param dataSize Size of the command data (all zeros).
+ * @returns Inflated size followed by the zlib stream of the command.
+ */
+static std::vector<char> CompressCommand(uint16_t commandCode,
+    uint16_t dataSize)
+{
+    Packet command;
+    command.WriteU16Big((uint16_t)(dataSize + 2 * sizeof(uint16_t)));
+    command.WriteU16Little((uint16_t)(dataSize + 2 * sizeof(uint16_t)));
+    command.WriteU16Little(commandCode);
+    command.WriteBlank(dataSize);
+
+    std::vector<char> payload(sizeof(uint32_t) + command.Size());
+
+    int32_t written = Compress::ThreadCompressor()->Compress(
+        command.ConstData(), &payload[sizeof(uint32_t)],
+        (int32_t)command.Size(), (int32_t)command.Size());
+
+    if(0 >= written)
+    {
+        return std::vector<char>();
+    }
+
+    uint32_t inflatedSize = htobe32(command.Size());
+    memcpy(&payload[0], &inflatedSize, sizeof(inflatedSize));
+
+    payload.resize(sizeof(uint32_t) + (size_t)written);
+
+    return payload;
+}
+
+/**
+ * Send a compressed frame that the server must reject.
+ * @param payload Compressed payload.
+ * @param realSize Real size to put in the frame header.
+ * @param compression true if the server accepts compressed frames.
+ */
+static void CheckCompressedFrameRejected(const std::vector<char>& payload,
+    uint32_t realSize, bool compression = true)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetCompression(compression);
+
+    uint64_t violations = ProtocolError::GetCount(
+        ProtocolError::CODE_BAD_COMPRESSED_FRAME);
+    uint64_t inflated = LobbyConnection::GetCompressionStats(
+        ).framesInflated;
+
+    ASSERT_TRUE(SendCompressedFrame(*pair.client, payload, realSize));
+    ASSERT_TRUE(RunUntil(service, [&pair]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED ==
+            pair.server->GetStatus();
+    }));
+
+    EXPECT_EQ(violations + 1, ProtocolError::GetCount(
+        ProtocolError::CODE_BAD_COMPRESSED_FRAME));
+    EXPECT_EQ(inflated, LobbyConnection::GetCompressionStats(
+        ).framesInflated);
+    EXPECT_EQ(0u, pair.serverQueue->Size());
+}
+
+/**
+ * Send a command each way over an encrypted connection.
+ * @param service io_service for both ends.
+ * @param pair Both ends of the connection.
+ */
+static void CheckCommandsPass(asio::io_service& service,
+    ConnectionPair<TestConnection>& pair)
+{
+    const char data[] = "encrypted";
+
+    ASSERT_TRUE(pair.client->SendEncrypted(0x1234, data, sizeof(data)));
+    ASSERT_TRUE(pair.server->SendEncrypted(0x4321, data, sizeof(data)));
+
+    std::unique_ptr<Message::Message> fromClient(WaitForMessage(service,
+        *pair.serverQueue));
+    std::unique_ptr<Message::Message> fromServer(WaitForMessage(service,
+        *pair.clientQueue));
+
+    Message::Packet *pFromClient = dynamic_cast<Message::Packet*>(
+        fromClient.get());
+    Message::Packet *pFromServer = dynamic_cast<Message::Packet*>(
+        fromServer.get());
+
+    ASSERT_NE(nullptr, pFromClient);
+    ASSERT_NE(nullptr, pFromServer);
+
+    EXPECT_EQ(0x1234, pFromClient->GetCommandCode());
+    EXPECT_EQ(0x4321, pFromServer->GetCommandCode());
+
+    ASSERT_EQ(sizeof(data), pFromClient->GetPacket().Size());
+    ASSERT_EQ(sizeof(data), pFromServer->GetPacket().Size());
+
+    EXPECT_EQ(0, memcmp(data, pFromClient->GetPacket().ConstData(),
+        sizeof(data)));
+    EXPECT_EQ(0, memcmp(data, pFromServer->GetPacket().ConstData(),
+        sizeof(data)));
+}
+
+TEST(LobbyConnection, Handshake)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    // The key exchange runs inline (the client coroutine resumes itself).
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    CheckCommandsPass(service, pair);
+}
+
+TEST(LobbyConnection, HandshakeCryptoPool)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    // Stopped before the io_service the results are posted to is gone.
+    std::shared_ptr<WorkerPool> cryptoPool(new WorkerPool(2, 16));
+
+    ASSERT_TRUE(ConnectPair(service, pair, cryptoPool));
+
+    // The client generates its keys in one step and the server its public
+    // and the shared data in two.
+    EXPECT_EQ(3u, cryptoPool->GetStats().completed);
+    EXPECT_EQ(0u, cryptoPool->GetStats().rejected);
+
+    CheckCommandsPass(service, pair);
+
+    cryptoPool->Stop();
+}
+
+TEST(LobbyConnection, SendEncryptedMatchesPacket)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    std::vector<char> data(1000);
+
+    for(size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = (char)(i * 7 + 1);
+    }
+
+    // Sizes of the command data of each frame. Each command adds a 6 byte
+    // header so the first frames fill whole blocks and the rest do not.
+    std::vector<std::vector<uint16_t>> frames = {
+        { 2 }, { 10 }, { 2, 2 }, { 26, 0, 12 },
+        { 0 }, { 5 }, { 1, 3, 7 }, { 26, 0, 18 }, { 1000 },
+    };
+
+    uint16_t commandCode = 0x100;
+
+    for(auto& sizes : frames)
+    {
+        std::vector<LobbyConnection::OutgoingCommand_t> commands;
+        size_t offset = 0;
+
+        for(auto size : sizes)
+        {
+            LobbyConnection::OutgoingCommand_t command;
+            command.commandCode = commandCode++;
+            command.pData = &data[offset];
+            command.dataSize = size;
+
+            commands.push_back(command);
+
+            offset = (offset + size) % 64;
+        }
+
+        pair.client->mSent.clear();
+
+        ASSERT_TRUE(pair.client->SendEncrypted(&commands[0],
+            commands.size()));
+        ASSERT_TRUE(RunUntil(service, [&pair]()
+        {
+            return !pair.client->mSent.empty();
+        }));
+        ASSERT_EQ(1u, pair.client->mSent.size());
+
+        const BF_KEY& key = pair.client->GetEncryptionKey();
+
+        std::vector<char> sent = pair.client->mSent.front();
+        std::vector<char> expected = BuildFrame(key, &commands[0],
+            commands.size());
+
+        // Same sizes, same padding and the same encrypted bytes.
+        EXPECT_EQ(expected, sent);
+        EXPECT_EQ(DecryptFrame(key, expected), DecryptFrame(key, sent));
+        EXPECT_EQ(0u, (sent.size() - 2 * sizeof(uint32_t)) %
+            BLOWFISH_BLOCK_SIZE);
+    }
+}
+
+TEST(LobbyConnection, FrameDispatch)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetFrameDispatch(true);
+
+    uint8_t first[5] = { 1, 2, 3, 4, 5 };
+    uint8_t third[12] = { 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17 };
+
+    LobbyConnection::OutgoingCommand_t commands[3] = {
+        { 0x1001, first, sizeof(first) },
+        { 0x1002, nullptr, 0 },
+        { 0x1003, third, sizeof(third) },
+    };
+
+    ASSERT_TRUE(pair.client->SendEncrypted(commands, 3));
+
+    std::unique_ptr<Message::Message> message(WaitForMessage(service,
+        *pair.serverQueue));
+    ASSERT_NE(nullptr, message.get());
+
+    // Every command of the frame is in the one message.
+    Message::PacketFrame *pFrame = dynamic_cast<Message::PacketFrame*>(
+        message.get());
+    ASSERT_NE(nullptr, pFrame);
+    EXPECT_EQ(pair.server, pFrame->GetConnection());
+    ASSERT_EQ(3u, pFrame->GetCommandCount());
+
+    // The data of each command follows the sizes and its 6 byte header.
+    const std::vector<Message::PacketFrame::Command_t>& locations =
+        pFrame->GetCommands();
+    uint32_t offset = 2 * sizeof(uint32_t);
+
+    for(size_t i = 0; i < 3; ++i)
+    {
+        offset += 3 * sizeof(uint16_t);
+
+        EXPECT_EQ(commands[i].commandCode, pFrame->GetCommandCode(i));
+        EXPECT_EQ(commands[i].commandCode, locations[i].commandCode);
+        EXPECT_EQ(offset, locations[i].offset);
+        EXPECT_EQ(commands[i].dataSize, locations[i].length);
+
+        offset += commands[i].dataSize;
+    }
+
+    // A second frame is read into the same receive packet.
+    uint8_t other[17];
+    memset(other, 0xEE, sizeof(other));
+
+    LobbyConnection::OutgoingCommand_t overwrite = { 0x2000, other,
+        sizeof(other) };
+
+    ASSERT_TRUE(pair.client->SendEncrypted(&overwrite, 1));
+
+    std::unique_ptr<Message::Message> next(WaitForMessage(service,
+        *pair.serverQueue));
+    ASSERT_NE(nullptr, next.get());
+
+    // The views into the first frame still hold its commands.
+    for(size_t i = 0; i < 3; ++i)
+    {
+        ReadOnlyPacket command;
+        pFrame->GetCommand(i, command);
+
+        ASSERT_EQ(commands[i].dataSize, command.Size());
+
+        if(0 < command.Size())
+        {
+            EXPECT_EQ(0, memcmp(commands[i].pData, command.ConstData(),
+                command.Size()));
+        }
+    }
+}
+
+TEST(LobbyConnection, QueueCommandOrder)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetFrameDispatch(true);
+    pair.client->SetCommandFlush(MAX_PACKET_SIZE, 0);
+
+    uint8_t data[10] = { 0 };
+
+    // Queued commands go out before a frame sent after them.
+    ASSERT_TRUE(pair.client->QueueCommand(1, data, sizeof(data)));
+    ASSERT_TRUE(pair.client->QueueCommand(2, nullptr, 0));
+    ASSERT_TRUE(pair.client->SendEncrypted(3, data, sizeof(data)));
+    ASSERT_TRUE(pair.client->QueueCommand(4, data, sizeof(data)));
+
+    pair.client->FlushCommands();
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 1, 2 }, { 3 },
+        { 4 } }), WaitForFrames(service, *pair.serverQueue, 3));
+}
+
+TEST(LobbyConnection, QueueCommandTimer)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    std::shared_ptr<TimerWheel> wheel(new TimerWheel(1, 0));
+
+    pair.server->SetFrameDispatch(true);
+    pair.client->SetTimerWheel(wheel);
+    pair.client->SetCommandFlush(MAX_PACKET_SIZE, 2);
+
+    uint8_t data[10] = { 0 };
+
+    ASSERT_TRUE(pair.client->QueueCommand(1, data, sizeof(data)));
+    ASSERT_TRUE(pair.client->QueueCommand(2, data, sizeof(data)));
+
+    // Arm the timer on the io thread.
+    service.poll();
+    service.reset();
+
+    wheel->Advance(1);
+    service.poll();
+    service.reset();
+
+    EXPECT_EQ(0u, pair.client->GetOutgoingBytes());
+    EXPECT_TRUE(pair.client->mSent.empty());
+
+    // Nothing flushes the commands but the timer.
+    wheel->Advance(2);
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 1, 2 } }),
+        WaitForFrames(service, *pair.serverQueue, 1));
+}
+
+TEST(LobbyConnection, QueueCommandNoWheel)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetFrameDispatch(true);
+    pair.client->SetCommandFlush(MAX_PACKET_SIZE, 2);
+
+    uint8_t data[10] = { 0 };
+
+    ASSERT_TRUE(pair.client->QueueCommand(1, data, sizeof(data)));
+    ASSERT_TRUE(pair.client->QueueCommand(2, data, sizeof(data)));
+    EXPECT_EQ(0u, pair.client->GetOutgoingBytes());
+
+    // Without a wheel the commands go out once the io_service runs.
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 1, 2 } }),
+        WaitForFrames(service, *pair.serverQueue, 1));
+}
+
+TEST(LobbyConnection, QueueCommandFlushSize)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetFrameDispatch(true);
+    pair.client->SetCommandFlush(32, 0);
+
+    uint8_t data[10] = { 0 };
+
+    // Each command is 16 bytes with its header.
+    ASSERT_TRUE(pair.client->QueueCommand(1, data, sizeof(data)));
+    EXPECT_EQ(0u, pair.client->GetOutgoingBytes());
+
+    ASSERT_TRUE(pair.client->QueueCommand(2, data, sizeof(data)));
+    EXPECT_EQ(2 * sizeof(uint32_t) + 32, pair.client->GetOutgoingBytes());
+
+    ASSERT_TRUE(pair.client->QueueCommand(3, data, sizeof(data)));
+    EXPECT_EQ(2 * sizeof(uint32_t) + 32, pair.client->GetOutgoingBytes());
+
+    pair.client->FlushCommands();
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 1, 2 }, { 3 } }),
+        WaitForFrames(service, *pair.serverQueue, 2));
+}
+
+TEST(LobbyConnection, QueueCommandOverflow)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetFrameDispatch(true);
+    pair.client->SetCommandFlush(MAX_PACKET_SIZE, 0);
+
+    std::vector<uint8_t> data(4000);
+
+    // Only four of these fit in a frame so the fifth seals the first four.
+    for(uint16_t i = 1; i <= 5; ++i)
+    {
+        ASSERT_TRUE(pair.client->QueueCommand(i, &data[0],
+            (uint16_t)data.size()));
+    }
+
+    pair.client->FlushCommands();
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 1, 2, 3, 4 },
+        { 5 } }), WaitForFrames(service, *pair.serverQueue, 2));
+
+    ASSERT_EQ(2u, pair.client->mSent.size());
+    EXPECT_GE((size_t)MAX_PACKET_SIZE, pair.client->mSent[0].size());
+
+    // A command that can never fit in a frame is refused.
+    data.resize(MAX_PACKET_SIZE);
+
+    EXPECT_FALSE(pair.client->QueueCommand(6, &data[0],
+        (uint16_t)data.size()));
+}
+
+TEST(LobbyConnection, QueueCommandNotWritable)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetFrameDispatch(true);
+    pair.client->SetCommandFlush(8, 0);
+    pair.client->SetOutgoingLimits(16, 48);
+
+    uint8_t data[18] = { 0 };
+
+    // A 32 byte frame waits for the service to run.
+    ASSERT_TRUE(pair.client->SendEncrypted(1, data, sizeof(data)));
+    ASSERT_EQ(32u, pair.client->GetOutgoingBytes());
+
+    // Dropping a low priority packet marks the connection as full.
+    Packet filler;
+    filler.WriteBlank(32);
+
+    ASSERT_FALSE(pair.client->SendPacket(filler,
+        TcpConnection::PRIORITY_LOW));
+    ASSERT_FALSE(pair.client->IsWritable());
+
+    // Over the flush size but held back until the queue drains.
+    ASSERT_TRUE(pair.client->QueueCommand(2, data, 10));
+    ASSERT_TRUE(pair.client->QueueCommand(3, data, 10));
+
+    pair.client->FlushCommands();
+    EXPECT_EQ(32u, pair.client->GetOutgoingBytes());
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 1 }, { 2, 3 } }),
+        WaitForFrames(service, *pair.serverQueue, 2));
+}
+
+TEST(LobbyConnection, QueueCommandClose)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.server->SetFrameDispatch(true);
+    pair.client->SetCommandFlush(MAX_PACKET_SIZE, 0);
+
+    uint8_t data[10] = { 0 };
+
+    ASSERT_TRUE(pair.client->QueueCommand(1, data, sizeof(data)));
+    ASSERT_TRUE(pair.client->QueueCommand(2, data, sizeof(data)));
+
+    // The held back commands are sent before the socket is closed.
+    pair.client->Close("Test is done.");
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 1, 2 } }),
+        WaitForFrames(service, *pair.serverQueue, 1));
+}
+
+TEST(LobbyConnection, BroadcastEncrypted)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> first(service);
+    ConnectionPair<TestConnection> second(service);
+
+    ASSERT_TRUE(ConnectPair(service, first));
+    ASSERT_TRUE(ConnectPair(service, second));
+
+    first.client->SetFrameDispatch(true);
+    second.client->SetFrameDispatch(true);
+    first.server->SetCommandFlush(MAX_PACKET_SIZE, 0);
+
+    uint8_t data[18];
+
+    for(size_t i = 0; i < sizeof(data); ++i)
+    {
+        data[i] = (uint8_t)(i + 1);
+    }
+
+    // 27 bytes of commands so the frame needs padding.
+    LobbyConnection::OutgoingCommand_t commands[2] = {
+        { 0x10, data, 13 },
+        { 0x11, data, 2 },
+    };
+
+    std::list<std::shared_ptr<TcpConnection>> recipients = {
+        first.server, second.server,
+    };
+
+    // Commands queued before the broadcast are sent first.
+    ASSERT_TRUE(first.server->QueueCommand(0x09, data, 4));
+
+    LobbyConnection::BroadcastStats_t before =
+        LobbyConnection::GetBroadcastStats();
+
+    ASSERT_TRUE(LobbyConnection::BroadcastEncrypted(recipients, commands,
+        2));
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 0x09 },
+        { 0x10, 0x11 } }), WaitForFrames(service, *first.clientQueue, 2));
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 0x10, 0x11 } }),
+        WaitForFrames(service, *second.clientQueue, 1));
+
+    ASSERT_TRUE(RunUntil(service, [&first, &second]()
+    {
+        return 2u == first.server->mSent.size() &&
+            1u == second.server->mSent.size();
+    }));
+
+    // Each recipient has the frame (sizes and padding included) encrypted
+    // with its own key.
+    const BF_KEY& firstKey = first.server->GetEncryptionKey();
+    const BF_KEY& secondKey = second.server->GetEncryptionKey();
+
+    std::vector<char> firstFrame = first.server->mSent[1];
+    std::vector<char> secondFrame = second.server->mSent[0];
+
+    EXPECT_EQ(BuildFrame(firstKey, commands, 2), firstFrame);
+    EXPECT_EQ(BuildFrame(secondKey, commands, 2), secondFrame);
+    EXPECT_NE(firstFrame, secondFrame);
+    EXPECT_EQ(DecryptFrame(firstKey, firstFrame),
+        DecryptFrame(secondKey, secondFrame));
+
+    LobbyConnection::BroadcastStats_t after =
+        LobbyConnection::GetBroadcastStats();
+
+    EXPECT_EQ(before.framesEncrypted + 2, after.framesEncrypted);
+    EXPECT_EQ(before.bytesEncrypted + 2 * 32, after.bytesEncrypted);
+
+    // The broadcast only runs once the service does. By then the second
+    // recipient is full so it is skipped for a low priority frame.
+    ASSERT_TRUE(LobbyConnection::BroadcastEncrypted(recipients, commands,
+        2, TcpConnection::PRIORITY_LOW));
+
+    second.server->SetOutgoingLimits(16, 48);
+
+    ASSERT_TRUE(second.server->SendEncrypted(0x20, data, 18));
+
+    Packet filler;
+    filler.WriteBlank(32);
+
+    ASSERT_FALSE(second.server->SendPacket(filler,
+        TcpConnection::PRIORITY_LOW));
+    ASSERT_FALSE(second.server->IsWritable());
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 0x10, 0x11 } }),
+        WaitForFrames(service, *first.clientQueue, 1));
+
+    // Nothing arrives between the frame sent before and the one after.
+    ASSERT_TRUE(RunUntil(service, [&second]()
+    {
+        return second.server->IsWritable();
+    }));
+    ASSERT_TRUE(second.server->SendEncrypted(0x21, data, 18));
+
+    EXPECT_EQ(std::vector<std::vector<uint16_t>>({ { 0x20 }, { 0x21 } }),
+        WaitForFrames(service, *second.clientQueue, 2));
+    EXPECT_EQ(after.framesEncrypted + 1,
+        LobbyConnection::GetBroadcastStats().framesEncrypted);
+}
+
+TEST(LobbyConnection, CompressedFrames)
+{
+    asio::io_service service;
+    ConnectionPair<TestConnection> pair(service);
+
+    ASSERT_TRUE(ConnectPair(service, pair));
+
+    pair.client->SetCompression(true, 64);
+    pair.server->SetCompression(true, 64);
+
+    std::vector<char> text(2000);
+    std::vector<char> noise(200);
+
+    for(size_t i = 0; i < text.size(); ++i)
+    {
+        text[i] = (char)('a' + i % 16);
+    }
+
+    uint32_t seed = 12345;
+
+    for(auto& c : noise)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = (char)(seed >> 16);
+    }
+
+    LobbyConnection::CompressionStats_t before =
+        LobbyConnection::GetCompressionStats();
+
+    // Compressed, too random to get smaller and under the threshold.
+    ASSERT_TRUE(pair.client->SendEncrypted(0x30, &text[0],
+        (uint16_t)text.size()));
+    ASSERT_TRUE(pair.client->SendEncrypted(0x31, &noise[0],
+        (uint16_t)noise.size()));
+    ASSERT_TRUE(pair.client->SendEncrypted(0x32, &noise[0], 16));
+
+    std::vector<char> *expected[3] = { &text, &noise, &noise };
+    uint32_t sizes[3] = { (uint32_t)text.size(), (uint32_t)noise.size(),
+        16 };
+
+    for(uint16_t i = 0; i < 3; ++i)
+    {
+        std::unique_ptr<Message::Message> message(WaitForMessage(service,
+            *pair.serverQueue));
+
+        Message::Packet *pPacket = dynamic_cast<Message::Packet*>(
+            message.get());
+        ASSERT_NE(nullptr, pPacket);
+
+        EXPECT_EQ(0x30 + i, pPacket->GetCommandCode());
+        ASSERT_EQ(sizes[i], pPacket->GetPacket().Size());
+        EXPECT_EQ(0, memcmp(&(*expected[i])[0],
+            pPacket->GetPacket().ConstData(), sizes[i]));
+    }
+
+    ASSERT_TRUE(RunUntil(service, [&pair]()
+    {
+        return 3u == pair.client->mSent.size();
+    }));
+
+    // Only the first frame has the flag (and is smaller).
+    std::vector<uint32_t> realSizes;
+
+    for(auto& frame : pair.client->mSent)
+    {
+        uint32_t realSize;
+        memcpy(&realSize, &frame[sizeof(uint32_t)], sizeof(realSize));
+
+        realSizes.push_back(be32toh(realSize));
+    }
+
+    EXPECT_NE(0u, realSizes[0] & FRAME_COMPRESSED_FLAG);
+    EXPECT_GT(text.size(), realSizes[0] & ~FRAME_COMPRESSED_FLAG);
+    EXPECT_EQ(noise.size() + 3 * sizeof(uint16_t), realSizes[1]);
+    EXPECT_EQ(16 + 3 * sizeof(uint16_t), realSizes[2]);
+
+    LobbyConnection::CompressionStats_t after =
+        LobbyConnection::GetCompressionStats();
+
+    EXPECT_EQ(before.framesCompressed + 1, after.framesCompressed);
+    EXPECT_EQ(before.framesIncompressible + 1, after.framesIncompressible);
+    EXPECT_EQ(before.framesInflated + 1, after.framesInflated);
+    EXPECT_EQ(before.bytesIn + text.size() + 3 * sizeof(uint16_t),
+        after.bytesIn);
+    EXPECT_EQ(before.bytesOut + (realSizes[0] & ~FRAME_COMPRESSED_FLAG),
+        after.bytesOut);
+}
+
+TEST(LobbyConnection, CompressedFrameRejected)
+{
+    std::vector<char> valid = CompressCommand(0x40, 500);
+    ASSERT_FALSE(valid.empty());
+
+    // The frames are built right: a good one is inflated.
+    {
+        asio::io_service service;
+        ConnectionPair<TestConnection> pair(service);
+
+        ASSERT_TRUE(ConnectPair(service, pair));
+
+        pair.server->SetCompression(true);
+
+        ASSERT_TRUE(SendCompressedFrame(*pair.client, valid,
+            (uint32_t)valid.size()));
+
+        std::unique_ptr<Message::Message> message(WaitForMessage(service,
+            *pair.serverQueue));
+
+        Message::Packet *pPacket = dynamic_cast<Message::Packet*>(
+            message.get());
+        ASSERT_NE(nullptr, pPacket);
+        EXPECT_EQ(0x40, pPacket->GetCommandCode());
+        EXPECT_EQ(500u, pPacket->GetPacket().Size());
+    }
+
+    {
+        SCOPED_TRACE("Inflated size is zero");
+
+        std::vector<char> payload(valid);
+        memset(&payload[0], 0, sizeof(uint32_t));
+
+        CheckCompressedFrameRejected(payload, (uint32_t)payload.size());
+    }
+
+    {
+        SCOPED_TRACE("Inflated size is too big");
+
+        std::vector<char> payload(valid);
+        uint32_t inflatedSize = htobe32(MAX_PACKET_SIZE);
+        memcpy(&payload[0], &inflatedSize, sizeof(inflatedSize));
+
+        CheckCompressedFrameRejected(payload, (uint32_t)payload.size());
+    }
+
+    {
+        SCOPED_TRACE("Real size is too small");
+
+        CheckCompressedFrameRejected(valid, sizeof(uint32_t));
+    }
+
+    {
+        SCOPED_TRACE("Truncated zlib stream");
+
+        std::vector<char> payload(valid.begin(), valid.begin() +
+            sizeof(uint32_t) + (valid.size() - sizeof(uint32_t)) / 2);
+
+        CheckCompressedFrameRejected(payload, (uint32_t)payload.size());
+    }
+
+    {
+        SCOPED_TRACE("Compression is off");
+
+        CheckCompressedFrameRejected(valid, (uint32_t)valid.size(), false);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
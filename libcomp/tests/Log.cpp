@@ -0,0 +1,325 @@
+/**
+ * @file libcomp/tests/Log.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the Log class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+TEST(Log, AsyncKeepsOrder)
+{
+    Log *pLog = Log::GetSingletonPtr();
+
+    std::vector<String> messages;
+    std::thread::id hookThread;
+
+    pLog->ClearHooks();
+    pLog->AddLogHook([&](Log::Level_t level, const String& msg)
+    {
+        (void)level;
+
+        hookThread = std::this_thread::get_id();
+        messages.push_back(msg);
+    });
+
+    pLog->StartAsync();
+    ASSERT_TRUE(pLog->IsAsync());
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        LOG_WARNING(String("%1\n").Arg(i));
+    }
+
+    // Stopping writes everything that was queued.
+    pLog->StopAsync();
+    ASSERT_FALSE(pLog->IsAsync());
+
+    ASSERT_EQ(1000u, messages.size());
+    EXPECT_NE(std::this_thread::get_id(), hookThread);
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(String("WARNING: %1\n").Arg(i), messages[(size_t)i]);
+    }
+
+    // Back to logging on the calling thread.
+    LOG_INFO("sync\n");
+
+    ASSERT_EQ(1001u, messages.size());
+    EXPECT_EQ(std::this_thread::get_id(), hookThread);
+
+    pLog->ClearHooks();
+}
+
+TEST(Log, AsyncManyThreads)
+{
+    Log *pLog = Log::GetSingletonPtr();
+
+    std::vector<int> counts(4, 0);
+
+    pLog->ClearHooks();
+    pLog->AddLogHook([&](Log::Level_t level, const String& msg)
+    {
+        (void)level;
+
+        // "ERROR: <thread> <value>"
+        std::list<String> parts = msg.Split(" ");
+
+        if(3 == parts.size())
+        {
+            parts.pop_front();
+
+            size_t thread = (size_t)atoi(parts.front().C());
+            int value = atoi(parts.back().C());
+
+            // Each thread's messages stay in order.
+            EXPECT_EQ(counts[thread], value);
+            counts[thread]++;
+        }
+    });
+
+    pLog->StartAsync(64);
+
+    std::vector<std::thread> threads;
+
+    for(int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([t]()
+        {
+            for(int i = 0; i < 500; ++i)
+            {
+                LOG_ERROR(String("%1 %2").Arg(t).Arg(i));
+            }
+        });
+    }
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    pLog->StopAsync();
+
+    // Errors are never dropped.
+    for(int t = 0; t < 4; ++t)
+    {
+        EXPECT_EQ(500, counts[(size_t)t]);
+    }
+
+    pLog->ClearHooks();
+}
+
+TEST(Log, AsyncStopWhileLogging)
+{
+    Log *pLog = Log::GetSingletonPtr();
+
+    std::atomic<int> count(0);
+    std::atomic<int> started(0);
+
+    pLog->ClearHooks();
+    pLog->AddLogHook([&](Log::Level_t level, const String& msg)
+    {
+        (void)level;
+        (void)msg;
+
+        count++;
+    });
+
+    pLog->StartAsync(64);
+
+    std::vector<std::thread> threads;
+
+    for(int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&started]()
+        {
+            started++;
+
+            for(int i = 0; i < 2000; ++i)
+            {
+                LOG_ERROR("stop\n");
+            }
+        });
+    }
+
+    while(4 > started)
+    {
+        std::this_thread::yield();
+    }
+
+    // Messages logged while stopping are written by the writer or by the
+    // thread that logged them but never lost.
+    pLog->StopAsync();
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(4 * 2000, count);
+
+    pLog->ClearHooks();
+}
+
+static int gFormatCount = 0;
+
+static String CountedMessage()
+{
+    gFormatCount++;
+
+    return "counted\n";
+}
+
+TEST(Log, DisabledLevelSkipsArguments)
+{
+    Log *pLog = Log::GetSingletonPtr();
+
+    gFormatCount = 0;
+
+    pLog->SetLogLevelEnabled(Log::LOG_LEVEL_INFO, false);
+    LOG_INFO(CountedMessage());
+    EXPECT_EQ(0, gFormatCount);
+
+    pLog->SetLogLevelEnabled(Log::LOG_LEVEL_INFO, true);
+    LOG_INFO(CountedMessage());
+    EXPECT_EQ(1, gFormatCount);
+}
+
+TEST(Log, FormatRenderedByWriter)
+{
+    Log *pLog = Log::GetSingletonPtr();
+
+    std::vector<String> messages;
+    std::thread::id hookThread;
+
+    pLog->ClearHooks();
+    pLog->AddLogHook([&](Log::Level_t level, const String& msg)
+    {
+        (void)level;
+
+        hookThread = std::this_thread::get_id();
+        messages.push_back(msg);
+    });
+
+    // Without the writer thread the message is rendered right away.
+    LOG_WARNING_FORMAT("%1 of %2 (%3)\n", 1, 2u, "sync");
+
+    ASSERT_EQ(1u, messages.size());
+    EXPECT_EQ(String("WARNING: 1 of 2 (sync)\n"), messages[0]);
+    EXPECT_EQ(std::this_thread::get_id(), hookThread);
+
+    pLog->StartAsync();
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        LOG_ERROR_FORMAT("%1 %2 %3\n", i, -i, String("async"));
+    }
+
+    pLog->StopAsync();
+
+    ASSERT_EQ(1001u, messages.size());
+    EXPECT_NE(std::this_thread::get_id(), hookThread);
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(String("ERROR: %1 %2 async\n").Arg(i).Arg(-i),
+            messages[(size_t)i + 1]);
+    }
+
+    pLog->ClearHooks();
+}
+
+TEST(Log, BinaryLog)
+{
+    Log *pLog = Log::GetSingletonPtr();
+
+    std::string path = testing::TempDir() + "comp_binary_log.bin";
+
+    pLog->ClearHooks();
+    pLog->SetBinaryLogPath(path);
+    ASSERT_EQ(String(path), pLog->GetBinaryLogPath());
+
+    pLog->StartAsync();
+    LOG_INFO_FORMAT("%1 + %2 = %3\n", 1, 1.5, 2.5);
+    LOG_WARNING("plain\n");
+    LOG_INFO_FORMAT("%1 + %2 = %3\n", 2, 2.5, 4.5);
+    pLog->StopAsync();
+
+    pLog->SetBinaryLogPath(String());
+
+    std::vector<String> messages;
+    std::vector<uint8_t> levels;
+
+    std::ifstream in(path, std::ifstream::binary);
+
+    EXPECT_TRUE(LogRecord::ReadFile(in, [&](const LogRecordHeader_t& header,
+        const String& msg)
+    {
+        EXPECT_NE(0u, header.timestamp);
+        EXPECT_EQ(LogRecord::CurrentThread(), header.thread);
+
+        levels.push_back(header.level);
+        messages.push_back(msg);
+    }));
+
+    in.close();
+    std::remove(path.c_str());
+
+    // The plain message may be written before or after the others.
+    ASSERT_EQ(3u, messages.size());
+    EXPECT_EQ(1, std::count(levels.begin(), levels.end(),
+        (uint8_t)Log::LOG_LEVEL_WARNING));
+    EXPECT_NE(messages.end(), std::find(messages.begin(), messages.end(),
+        String("plain\n")));
+    EXPECT_NE(messages.end(), std::find(messages.begin(), messages.end(),
+        String("1 + 1.5 = 2.5\n")));
+    EXPECT_NE(messages.end(), std::find(messages.begin(), messages.end(),
+        String("2 + 2.5 = 4.5\n")));
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
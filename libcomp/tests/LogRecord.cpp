@@ -0,0 +1,160 @@
+/**
+ * @file libcomp/tests/LogRecord.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the LogRecord class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <LogRecord.h>
+
+// Standard C++11 Includes
+#include <sstream>
+
+using namespace libcomp;
+
+TEST(LogRecord, EncodeDecode)
+{
+    LogRecord record(7, 2, 1234, 5678);
+
+    record.Add((int8_t)-5);
+    record.Add((uint16_t)65535);
+    record.Add(-1234567890123ll);
+    record.Add(0.25f);
+    record.Add("text");
+    record.Add(String("日本語"));
+    record.Add(std::string());
+
+    EXPECT_EQ(2, record.GetLevel());
+
+    LogRecordHeader_t header;
+    std::vector<String> args;
+
+    ASSERT_TRUE(LogRecord::Decode(record.Data(), record.Size(), header,
+        args));
+    EXPECT_EQ(7u, header.formatId);
+    EXPECT_EQ(2, header.level);
+    EXPECT_EQ(1234u, header.timestamp);
+    EXPECT_EQ(5678u, header.thread);
+
+    ASSERT_EQ(7u, args.size());
+    EXPECT_EQ(String("-5"), args[0]);
+    EXPECT_EQ(String("65535"), args[1]);
+    EXPECT_EQ(String("-1234567890123"), args[2]);
+    EXPECT_EQ(String("0.25"), args[3]);
+    EXPECT_EQ(String("text"), args[4]);
+    EXPECT_EQ(String("日本語"), args[5]);
+    EXPECT_EQ(String(), args[6]);
+
+    // A record cut short is rejected.
+    EXPECT_FALSE(LogRecord::Decode(record.Data(), record.Size() - 1, header,
+        args));
+
+    // Argument text is never scanned for arguments itself.
+    EXPECT_EQ(String("a=%2 b=1"), LogRecord::Render("a=%1 b=%2",
+        { "%2", "1" }));
+}
+
+TEST(LogRecord, LongString)
+{
+    LogRecord record(1, 0);
+
+    record.Add(std::string(LOG_RECORD_SIZE * 2, 'x'));
+    record.Add(1);
+
+    EXPECT_EQ((uint32_t)LOG_RECORD_SIZE, record.Size());
+
+    LogRecordHeader_t header;
+    std::vector<String> args;
+
+    // The string is cut short and the number no longer fits.
+    ASSERT_TRUE(LogRecord::Decode(record.Data(), record.Size(), header,
+        args));
+    ASSERT_EQ(1u, args.size());
+    EXPECT_GT(args[0].Size(), (size_t)(LOG_RECORD_SIZE / 2));
+    EXPECT_LT(args[0].Size(), (size_t)LOG_RECORD_SIZE);
+}
+
+TEST(LogRecord, File)
+{
+    std::stringstream file;
+
+    LogRecord::WriteFileHeader(file);
+    LogRecord::WriteFormat(file, 3, "%1 is %2");
+
+    LogRecord first(3, 1);
+    first.Add("answer");
+    first.Add(42);
+
+    LogRecord::WriteRecord(file, first.Data(), first.Size());
+
+    LogRecord plain(LogRecord::PLAIN_FORMAT, 4);
+    plain.Add("plain");
+
+    LogRecord::WriteRecord(file, plain.Data(), plain.Size());
+
+    std::vector<String> messages;
+
+    EXPECT_TRUE(LogRecord::ReadFile(file, [&](
+        const LogRecordHeader_t& header, const String& msg)
+    {
+        (void)header;
+
+        messages.push_back(msg);
+    }));
+
+    ASSERT_EQ(2u, messages.size());
+    EXPECT_EQ(String("answer is 42"), messages[0]);
+    EXPECT_EQ(String("plain"), messages[1]);
+
+    // A record with no format written before it is an error.
+    std::stringstream bad;
+
+    LogRecord::WriteFileHeader(bad);
+    LogRecord::WriteRecord(bad, first.Data(), first.Size());
+
+    EXPECT_FALSE(LogRecord::ReadFile(bad, [](const LogRecordHeader_t&,
+        const String&) { }));
+
+    // Not a binary log at all.
+    std::stringstream text("CRITICAL: hello\n");
+
+    EXPECT_FALSE(LogRecord::ReadFile(text, [](const LogRecordHeader_t&,
+        const String&) { }));
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,157 @@
+/**
+ * @file libcomp/tests/MessageQueue.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the MessageQueue class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <MessageQueue.h>
+
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+TEST(MessageQueue, TryDequeueEmpty)
+{
+    MessageQueue<int> queue(4);
+
+    int value = 0;
+
+    EXPECT_FALSE(queue.TryDequeue(value));
+
+    queue.Enqueue(7);
+
+    EXPECT_TRUE(queue.TryDequeue(value));
+    EXPECT_EQ(value, 7);
+    EXPECT_FALSE(queue.TryDequeue(value));
+}
+
+TEST(MessageQueue, Bounded)
+{
+    MessageQueue<int> queue(4);
+
+    EXPECT_EQ(queue.Capacity(), 4);
+
+    for(int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(queue.TryEnqueue(i));
+    }
+
+    int value = 4;
+
+    EXPECT_FALSE(queue.TryEnqueue(value));
+    EXPECT_EQ(queue.Dequeue(), 0);
+    EXPECT_TRUE(queue.TryEnqueue(value));
+
+    std::list<int> items;
+    queue.DequeueAll(items);
+
+    EXPECT_EQ(items, std::list<int>({ 1, 2, 3, 4 }));
+}
+
+TEST(MessageQueue, BatchEnqueue)
+{
+    MessageQueue<int> queue(4);
+
+    std::list<int> batch({ 1, 2, 3 });
+    queue.Enqueue(batch);
+
+    EXPECT_TRUE(batch.empty());
+
+    std::list<int> items;
+    queue.DequeueAll(items);
+
+    EXPECT_EQ(items, std::list<int>({ 1, 2, 3 }));
+}
+
+TEST(MessageQueue, MultipleProducers)
+{
+    const int producerCount = 4;
+    const int itemCount = 10000;
+
+    MessageQueue<int> queue(64);
+    std::vector<std::thread> producers;
+
+    for(int p = 0; p < producerCount; ++p)
+    {
+        producers.push_back(std::thread([&queue, p, itemCount]()
+        {
+            for(int i = 0; i < itemCount; ++i)
+            {
+                if(0 == (i % 10))
+                {
+                    std::list<int> batch({ p * itemCount + i });
+                    queue.Enqueue(batch);
+                }
+                else
+                {
+                    queue.Enqueue(p * itemCount + i);
+                }
+            }
+        }));
+    }
+
+    std::vector<int> last(producerCount, -1);
+    int received = 0;
+
+    while(received < producerCount * itemCount)
+    {
+        std::list<int> items;
+        queue.DequeueAll(items);
+
+        for(int value : items)
+        {
+            int p = value / itemCount;
+
+            // Items from one producer must arrive in order.
+            EXPECT_GT(value % itemCount, last[(size_t)p]);
+            last[(size_t)p] = value % itemCount;
+            received++;
+        }
+    }
+
+    for(auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    EXPECT_EQ(received, producerCount * itemCount);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
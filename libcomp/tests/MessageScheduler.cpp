@@ -0,0 +1,178 @@
+/**
+ * @file libcomp/tests/MessageScheduler.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the work-stealing message scheduler.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <MessageScheduler.h>
+
+#include <atomic>
+#include <chrono>
+
+using namespace libcomp;
+
+/// Number of strands used by the ordering test.
+static const int KEY_COUNT = 16;
+
+/// Number of messages sent on each strand.
+static const int MESSAGE_COUNT = 2000;
+
+class TestMessage : public Message::Message
+{
+public:
+    TestMessage(int messageKey, int messageSequence) : key(messageKey),
+        sequence(messageSequence)
+    {
+    }
+
+    int key;
+    int sequence;
+};
+
+TEST(MessageScheduler, StrandsStayOrdered)
+{
+    std::atomic<int> inFlight[KEY_COUNT];
+    int nextSequence[KEY_COUNT];
+    std::atomic<int> errors(0);
+
+    for(int i = 0; i < KEY_COUNT; ++i)
+    {
+        inFlight[i] = 0;
+        nextSequence[i] = 0;
+    }
+
+    {
+        MessageScheduler scheduler([&](Message::Message& message)
+        {
+            TestMessage& test = static_cast<TestMessage&>(message);
+
+            // Only one message of a strand may run at a time...
+            if(0 != inFlight[test.key]++)
+            {
+                errors++;
+            }
+
+            // ...and they must run in the order they were submitted.
+            if(nextSequence[test.key] != test.sequence)
+            {
+                errors++;
+            }
+
+            nextSequence[test.key] = test.sequence + 1;
+            inFlight[test.key]--;
+        }, 4);
+
+        EXPECT_EQ(scheduler.GetThreadCount(), 4);
+
+        for(int i = 0; i < MESSAGE_COUNT; ++i)
+        {
+            for(int key = 0; key < KEY_COUNT; ++key)
+            {
+                ASSERT_TRUE(scheduler.Submit((uint64_t)(key + 1),
+                    new TestMessage(key, i)));
+            }
+        }
+
+        // Stopping runs everything that was accepted.
+        scheduler.Stop();
+
+        MessageSchedulerStats_t stats = scheduler.GetStats();
+
+        EXPECT_EQ(stats.submitted, KEY_COUNT * MESSAGE_COUNT);
+        EXPECT_EQ(stats.completed, KEY_COUNT * MESSAGE_COUNT);
+        EXPECT_EQ(stats.queued, 0);
+
+        EXPECT_FALSE(scheduler.Submit(1, new TestMessage(0, 0)));
+        EXPECT_EQ(scheduler.GetStats().rejected, 1);
+    }
+
+    EXPECT_EQ(errors, 0);
+
+    for(int i = 0; i < KEY_COUNT; ++i)
+    {
+        EXPECT_EQ(nextSequence[i], MESSAGE_COUNT);
+    }
+}
+
+TEST(MessageScheduler, UnorderedMessages)
+{
+    std::atomic<int> count(0);
+
+    MessageScheduler scheduler([&count](Message::Message&)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        count++;
+    }, 4);
+
+    // Messages with no ordering each get their own strand.
+    for(int i = 0; i < 64; ++i)
+    {
+        ASSERT_TRUE(scheduler.Submit(0, new TestMessage(0, i)));
+    }
+
+    scheduler.Stop();
+
+    EXPECT_EQ(count, 64);
+    EXPECT_EQ(scheduler.GetStats().completed, 64);
+}
+
+TEST(MessageScheduler, ConsumeQueue)
+{
+    auto queue = std::make_shared<MessageQueue<Message::Message*>>();
+    std::atomic<int> count(0);
+
+    MessageScheduler scheduler([&count](Message::Message&)
+    {
+        count++;
+    }, 2);
+
+    ASSERT_TRUE(scheduler.Consume(queue));
+    EXPECT_FALSE(scheduler.Consume(queue));
+
+    for(int i = 0; i < 100; ++i)
+    {
+        queue->Enqueue(new TestMessage(0, i));
+    }
+
+    scheduler.Stop();
+
+    EXPECT_EQ(count, 100);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
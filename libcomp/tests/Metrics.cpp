@@ -0,0 +1,131 @@
+/**
+ * @file libcomp/tests/Metrics.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the runtime metrics registry.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Metrics.h>
+
+// Standard C++11 Includes
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+TEST(Metrics, CounterAcrossThreads)
+{
+    MetricCounter& counter = Metrics::GetSingletonPtr()->Counter(
+        "test_counter_total", "Test counter.");
+
+    EXPECT_EQ(&counter, &Metrics::GetSingletonPtr()->Counter(
+        "test_counter_total", "Test counter."));
+
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < 8; ++i)
+    {
+        threads.push_back(std::thread([&counter]()
+        {
+            for(int j = 0; j < 10000; ++j)
+            {
+                counter.Increment();
+            }
+        }));
+    }
+
+    for(auto& t : threads)
+    {
+        t.join();
+    }
+
+    EXPECT_EQ(counter.Value(), 80000);
+}
+
+TEST(Metrics, Gauge)
+{
+    MetricGauge& gauge = Metrics::GetSingletonPtr()->Gauge(
+        "test_gauge", "Test gauge.");
+
+    gauge.Set(10);
+    gauge.Add(5);
+    gauge.Add(-20);
+
+    EXPECT_EQ(gauge.Value(), -5);
+}
+
+TEST(Metrics, Export)
+{
+    MetricHistogram& histogram = Metrics::GetSingletonPtr()->Histogram(
+        "test_latency_seconds", "Test histogram.", "code=\"0x0003\"",
+        { 1000, 10000 });
+
+    histogram.Observe(500);
+    histogram.Observe(5000);
+    histogram.Observe(2000000);
+
+    MetricHistogram::Snapshot_t snapshot = histogram.GetSnapshot();
+
+    ASSERT_EQ(snapshot.buckets.size(), 3);
+    EXPECT_EQ(snapshot.buckets[0], 1);
+    EXPECT_EQ(snapshot.buckets[1], 1);
+    EXPECT_EQ(snapshot.buckets[2], 1);
+    EXPECT_EQ(snapshot.count, 3);
+    EXPECT_EQ(snapshot.sum, 2005500);
+
+    Metrics::GetSingletonPtr()->Counter("test_export_total",
+        "Test export.").Increment(7);
+
+    String text = Metrics::GetSingletonPtr()->Export();
+
+    EXPECT_TRUE(text.Contains("# TYPE test_export_total counter\n"
+        "test_export_total 7\n"));
+    EXPECT_TRUE(text.Contains("# TYPE test_latency_seconds histogram\n"));
+    EXPECT_TRUE(text.Contains("test_latency_seconds_bucket{code=\"0x0003\","
+        "le=\"0.001000\"} 1\n"));
+    EXPECT_TRUE(text.Contains("test_latency_seconds_bucket{code=\"0x0003\","
+        "le=\"0.010000\"} 2\n"));
+    EXPECT_TRUE(text.Contains("test_latency_seconds_bucket{code=\"0x0003\","
+        "le=\"+Inf\"} 3\n"));
+    EXPECT_TRUE(text.Contains("test_latency_seconds_sum{code=\"0x0003\"} "
+        "2.005500\n"));
+    EXPECT_TRUE(text.Contains("test_latency_seconds_count{code=\"0x0003\"} "
+        "3\n"));
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * @file libcomp/tests/MpscRingBuffer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the MpscRingBuffer class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <MpscRingBuffer.h>
+
+// Standard C++11 Includes
+#include <cstring>
+#include <thread>
+
+using namespace libcomp;
+
+TEST(MpscRingBuffer, Commit)
+{
+    MpscRingBuffer buffer(4096);
+    std::vector<char> record;
+
+    EXPECT_FALSE(buffer.ReadRecord(record));
+
+    char *pFirst = reinterpret_cast<char*>(buffer.BeginRecord(5));
+    char *pSecond = reinterpret_cast<char*>(buffer.BeginRecord(3));
+
+    ASSERT_NE(nullptr, pFirst);
+    ASSERT_NE(nullptr, pSecond);
+
+    memcpy(pFirst, "first", 5);
+    memcpy(pSecond, "two", 3);
+
+    // The second record can't be read before the first is committed.
+    buffer.EndRecord(pSecond);
+    EXPECT_FALSE(buffer.ReadRecord(record));
+
+    buffer.EndRecord(pFirst);
+
+    RingRecord_t records[4];
+    int32_t size = 0;
+
+    ASSERT_EQ(2, buffer.BeginReadV(records, 4, size));
+    EXPECT_EQ(5, records[0].size);
+    EXPECT_EQ(0, memcmp("first", records[0].pData, 5));
+    EXPECT_EQ(3, records[1].size);
+    EXPECT_EQ(0, memcmp("two", records[1].pData, 3));
+    EXPECT_EQ(buffer.Used(), size);
+
+    buffer.EndRead(size);
+    EXPECT_EQ(0, buffer.Used());
+}
+
+TEST(MpscRingBuffer, Full)
+{
+    MpscRingBuffer buffer(4096);
+    std::vector<char> data((size_t)buffer.Capacity() / 2);
+    std::vector<char> record;
+
+    EXPECT_FALSE(buffer.WriteRecord(&data[0], buffer.Capacity()));
+    EXPECT_TRUE(buffer.WriteRecord(&data[0], (int32_t)data.size()));
+    EXPECT_FALSE(buffer.WriteRecord(&data[0], (int32_t)data.size()));
+
+    ASSERT_TRUE(buffer.ReadRecord(record));
+    EXPECT_EQ(data.size(), record.size());
+
+    // The space is reused once it has been read (wrapping around the end).
+    for(int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(buffer.WriteRecord(&data[0], (int32_t)data.size()));
+        ASSERT_TRUE(buffer.ReadRecord(record));
+    }
+}
+
+TEST(MpscRingBuffer, Producers)
+{
+    MpscRingBuffer buffer(4096);
+
+    static const uint32_t PRODUCERS = 4;
+    static const uint32_t COUNT = 20000;
+
+    std::vector<std::thread> producers;
+
+    for(uint32_t p = 0; p < PRODUCERS; ++p)
+    {
+        producers.emplace_back([&buffer, p]()
+        {
+            for(uint32_t i = 0; i < COUNT;)
+            {
+                uint32_t value[2] = { p, i };
+
+                if(buffer.WriteRecord(value, sizeof(value)))
+                {
+                    i++;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Records of each producer arrive in the order it wrote them.
+    std::vector<uint32_t> expected(PRODUCERS, 0);
+    uint32_t total = 0;
+
+    RingRecord_t records[16];
+
+    while(total < PRODUCERS * COUNT)
+    {
+        int32_t size = 0;
+        int32_t count = buffer.BeginReadV(records, 16, size);
+
+        for(int32_t i = 0; i < count; ++i)
+        {
+            uint32_t value[2];
+
+            ASSERT_EQ((int32_t)sizeof(value), records[i].size);
+            memcpy(value, records[i].pData, sizeof(value));
+            ASSERT_GT(PRODUCERS, value[0]);
+            ASSERT_EQ(expected[value[0]]++, value[1]);
+        }
+
+        total += (uint32_t)count;
+        buffer.EndRead(size);
+    }
+
+    for(auto& producer : producers)
+    {
+        producer.join();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
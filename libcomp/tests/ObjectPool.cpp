@@ -0,0 +1,103 @@
+/**
+ * @file libcomp/tests/ObjectPool.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the ObjectPool class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <ObjectPool.h>
+
+using namespace libcomp;
+
+TEST(ObjectPool, ReuseReleased)
+{
+    ObjectPool<int> pool(2);
+
+    std::shared_ptr<int> a = pool.Allocate();
+    int *pA = a.get();
+    a.reset();
+
+    std::shared_ptr<int> b = pool.Allocate();
+
+    EXPECT_EQ(b.get(), pA);
+
+    ObjectPoolStats_t stats = pool.GetStats();
+
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.outstanding, 1);
+    EXPECT_EQ(stats.highWater, 1);
+    EXPECT_EQ(stats.free, 0);
+}
+
+TEST(ObjectPool, HighWaterAndMaxFree)
+{
+    ObjectPool<int> pool(1);
+
+    {
+        std::shared_ptr<int> a = pool.Allocate();
+        std::shared_ptr<int> b = pool.Allocate();
+        std::shared_ptr<int> c = pool.Allocate();
+    }
+
+    ObjectPoolStats_t stats = pool.GetStats();
+
+    EXPECT_EQ(stats.misses, 3);
+    EXPECT_EQ(stats.outstanding, 0);
+    EXPECT_EQ(stats.highWater, 3);
+    EXPECT_EQ(stats.free, 1);
+
+    pool.Reserve(4);
+
+    EXPECT_EQ(pool.GetStats().free, 4);
+}
+
+TEST(ObjectPool, OutlivesPool)
+{
+    std::shared_ptr<int> a;
+
+    {
+        ObjectPool<int> pool(1);
+        a = pool.Allocate();
+    }
+
+    *a = 5;
+    a.reset();
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -28,6 +28,7 @@
 #include <gtest/gtest.h>
 #include <PopIgnore.h>
 
+#include <Exception.h>
 #include <Packet.h>
 
 using namespace libcomp;
@@ -74,6 +75,159 @@ TEST(Packet, MoveAssignment)
     EXPECT_EQ(String(&a.ReadArray(1)[0], 1), "z");
 }
 
+TEST(Packet, SizeClassGrowth)
+{
+    Packet p;
+    p.WriteU32Little(0x12345678);
+
+    EXPECT_EQ(p.Capacity(), PACKET_SMALL_SIZE);
+
+    p.WriteBlank(PACKET_SMALL_SIZE);
+
+    EXPECT_EQ(p.Capacity(), PACKET_MEDIUM_SIZE);
+
+    p.WriteBlank(PACKET_MEDIUM_SIZE);
+
+    EXPECT_EQ(p.Capacity(), MAX_PACKET_SIZE);
+    EXPECT_EQ(p.Size(), 4 + PACKET_SMALL_SIZE + PACKET_MEDIUM_SIZE);
+
+    // The data written before the packet grew must be kept.
+    p.Rewind();
+
+    EXPECT_EQ(p.ReadU32Little(), 0x12345678);
+
+    EXPECT_THROW(p.Reserve(MAX_PACKET_SIZE + 1), libcomp::Exception);
+}
+
+TEST(Packet, SizeClassShallowCopy)
+{
+    Packet p;
+    p.WriteArray("abcdef", 6);
+
+    ReadOnlyPacket copy(p);
+    ReadOnlyPacket part(copy, 2, 3);
+
+    EXPECT_EQ(part.Size(), 3);
+    EXPECT_EQ(part.ConstData(), copy.ConstData() + 2);
+    EXPECT_EQ(String(&part.ReadArray(3)[0], 3), "cde");
+}
+
+TEST(Packet, WriteStringEncoded)
+{
+    String name = u8"日本語 name";
+
+    Packet p;
+    p.WriteString16Little(Convert::ENCODING_CP932, name, true);
+    p.WriteString32Big(Convert::ENCODING_UTF8, name, false);
+    p.WriteString16(Convert::ENCODING_CP1252, "", false);
+    p.WriteString(Convert::ENCODING_CP1252, "abc", true);
+
+    EXPECT_EQ(p.Size(), 2u + 12u + 4u + 14u + 2u + 4u);
+
+    p.Rewind();
+
+    EXPECT_EQ(p.PeekU16Little(), 12);
+    EXPECT_EQ(p.ReadString16Little(Convert::ENCODING_CP932), name);
+    EXPECT_EQ(p.PeekU32Big(), 14u);
+    EXPECT_EQ(p.ReadString32Big(Convert::ENCODING_UTF8), name);
+    EXPECT_EQ(p.ReadU16(), 0);
+    EXPECT_EQ(p.ReadString(Convert::ENCODING_CP1252), "abc");
+}
+
+TEST(Packet, ScalarArrays)
+{
+    // Odd counts make sure the leftovers after the SIMD blocks are swapped.
+    uint16_t a16[19];
+    uint32_t a32[11];
+    uint64_t a64[5];
+
+    for(uint32_t i = 0; i < 19; ++i)
+    {
+        a16[i] = (uint16_t)(0x0102 * (i + 1));
+    }
+
+    for(uint32_t i = 0; i < 11; ++i)
+    {
+        a32[i] = 0x01020304u * (i + 1);
+    }
+
+    for(uint32_t i = 0; i < 5; ++i)
+    {
+        a64[i] = 0x0102030405060708ULL * (i + 1);
+    }
+
+    Packet p;
+    p.WriteU16ArrayBig(a16, 19);
+    p.WriteU16ArrayLittle(a16, 19);
+    p.WriteU32ArrayBig(a32, 11);
+    p.WriteU32ArrayLittle(a32, 11);
+    p.WriteU64ArrayBig(a64, 5);
+    p.WriteU64ArrayLittle(a64, 5);
+    p.WriteU32ArrayBig(a32, 0);
+
+    EXPECT_EQ(p.Size(), 2 * (19 * 2 + 11 * 4 + 5 * 8));
+
+    // The bulk writes match the single value reads.
+    p.Rewind();
+
+    for(uint32_t i = 0; i < 19; ++i)
+    {
+        EXPECT_EQ(p.ReadU16Big(), a16[i]);
+    }
+
+    for(uint32_t i = 0; i < 19; ++i)
+    {
+        EXPECT_EQ(p.ReadU16Little(), a16[i]);
+    }
+
+    for(uint32_t i = 0; i < 11; ++i)
+    {
+        EXPECT_EQ(p.ReadU32Big(), a32[i]);
+    }
+
+    for(uint32_t i = 0; i < 11; ++i)
+    {
+        EXPECT_EQ(p.ReadU32Little(), a32[i]);
+    }
+
+    for(uint32_t i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(p.ReadU64Big(), a64[i]);
+    }
+
+    for(uint32_t i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(p.ReadU64Little(), a64[i]);
+    }
+
+    // The bulk reads match the bulk writes.
+    uint16_t b16[19];
+    uint32_t b32[11];
+    uint64_t b64[5];
+
+    p.Rewind();
+    p.ReadU16ArrayBig(b16, 19);
+    EXPECT_EQ(0, memcmp(a16, b16, sizeof(a16)));
+    p.ReadU16ArrayLittle(b16, 19);
+    EXPECT_EQ(0, memcmp(a16, b16, sizeof(a16)));
+    p.ReadU32ArrayBig(b32, 11);
+    EXPECT_EQ(0, memcmp(a32, b32, sizeof(a32)));
+    p.ReadU32ArrayLittle(b32, 11);
+    EXPECT_EQ(0, memcmp(a32, b32, sizeof(a32)));
+    p.ReadU64ArrayBig(b64, 5);
+    EXPECT_EQ(0, memcmp(a64, b64, sizeof(a64)));
+    p.ReadU64ArrayLittle(b64, 5);
+    EXPECT_EQ(0, memcmp(a64, b64, sizeof(a64)));
+    EXPECT_EQ(p.Left(), 0);
+
+    // Reading past the end throws before anything is read.
+    p.Seek(p.Size() - 6);
+    EXPECT_THROW(p.ReadU32ArrayBig(b32, 2), libcomp::Exception);
+    EXPECT_EQ(p.Left(), 6);
+    EXPECT_THROW(p.ReadU16ArrayBig(b16, 0x80000001u), libcomp::Exception);
+    EXPECT_THROW(p.WriteU64ArrayBig(a64, 0x20000001u), libcomp::Exception);
+}
+
 int main(int argc, char *argv[])
 {
     try
@@ -0,0 +1,114 @@
+/**
+ * @file libcomp/tests/PacketCapture.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the packet capture writer and reader.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <PacketCapture.h>
+#include <PacketCaptureReader.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace libcomp;
+
+TEST(PacketCapture, RoundTrip)
+{
+    const char szPath[] = "/tmp/test.cap";
+
+    PacketCapture *pCapture = PacketCapture::GetSingletonPtr();
+
+    // Nothing is written until the capture starts.
+    pCapture->Record(PacketCapture::TYPE_OPEN, 1, 0, nullptr, 0);
+
+    ASSERT_TRUE(pCapture->Start(szPath));
+    EXPECT_TRUE(pCapture->IsCapturing());
+
+    const char szAddress[] = "127.0.0.1";
+    const char data[] = { 0x01, 0x02, 0x03 };
+
+    pCapture->Record(PacketCapture::TYPE_OPEN, 7, 0, szAddress,
+        (uint32_t)strlen(szAddress));
+    pCapture->Record(PacketCapture::TYPE_COMMAND, 7, 0x1234, data,
+        sizeof(data));
+    pCapture->Record(PacketCapture::TYPE_CLOSE, 7, 0, nullptr, 0);
+    pCapture->Stop();
+
+    EXPECT_FALSE(pCapture->IsCapturing());
+    EXPECT_EQ(pCapture->GetDroppedRecords(), 0);
+
+    PacketCaptureReader reader;
+    PacketCaptureRecord_t record;
+
+    ASSERT_TRUE(reader.Open(szPath));
+    EXPECT_NE(reader.GetStartTime(), 0);
+
+    ASSERT_TRUE(reader.Next(record));
+    EXPECT_EQ(record.type, PacketCapture::TYPE_OPEN);
+    EXPECT_EQ(record.connectionID, 7);
+    EXPECT_EQ(std::string(record.data.begin(), record.data.end()),
+        szAddress);
+
+    uint64_t openTime = record.timestamp;
+
+    ASSERT_TRUE(reader.Next(record));
+    EXPECT_EQ(record.type, PacketCapture::TYPE_COMMAND);
+    EXPECT_EQ(record.commandCode, 0x1234);
+    ASSERT_EQ(record.data.size(), sizeof(data));
+    EXPECT_EQ(0, memcmp(&record.data[0], data, sizeof(data)));
+    EXPECT_GE(record.timestamp, openTime);
+
+    ASSERT_TRUE(reader.Next(record));
+    EXPECT_EQ(record.type, PacketCapture::TYPE_CLOSE);
+    EXPECT_TRUE(record.data.empty());
+
+    EXPECT_FALSE(reader.Next(record));
+
+    reader.Close();
+    remove(szPath);
+}
+
+TEST(PacketCapture, NotACapture)
+{
+    PacketCaptureReader reader;
+
+    EXPECT_FALSE(reader.Open("/nonexistent/capture"));
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
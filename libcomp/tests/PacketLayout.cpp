@@ -0,0 +1,130 @@
+/**
+ * @file libcomp/tests/PacketLayout.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the fixed-size packet layouts.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <PacketLayout.h>
+
+using namespace libcomp;
+
+typedef PacketLayout<BigField<uint32_t>, LittleField<uint16_t>,
+    BigField<int16_t>, LittleField<uint8_t>, LittleField<float>,
+    BigField<int64_t>> TestLayout_t;
+
+TEST(PacketLayout, Size)
+{
+    EXPECT_EQ(TestLayout_t::SIZE, 4 + 2 + 2 + 1 + 4 + 8);
+}
+
+TEST(PacketLayout, MatchesAccessors)
+{
+    Packet p;
+    TestLayout_t::Write(p, 0x12345678, 0xABCD, -2, 7, 1.5f, -3);
+
+    EXPECT_EQ(p.Size(), TestLayout_t::SIZE);
+
+    p.Rewind();
+
+    EXPECT_EQ(p.ReadU32Big(), 0x12345678);
+    EXPECT_EQ(p.ReadU16Little(), 0xABCD);
+    EXPECT_EQ(p.ReadS16Big(), -2);
+    EXPECT_EQ(p.ReadU8(), 7);
+    EXPECT_EQ(p.ReadFloat(), 1.5f);
+    EXPECT_EQ(p.ReadS64Big(), -3);
+
+    Packet q;
+    q.WriteU32Big(0xDEADBEEF);
+    q.WriteU16Little(0x1234);
+    q.WriteS16Big(-300);
+    q.WriteU8(0xFF);
+    q.WriteFloat(-0.25f);
+    q.WriteS64Big(-1234567890123LL);
+    q.Rewind();
+
+    uint32_t a;
+    uint16_t b;
+    int16_t c;
+    uint8_t d;
+    float e;
+    int64_t f;
+
+    EXPECT_TRUE(TestLayout_t::Read(q, a, b, c, d, e, f));
+    EXPECT_EQ(a, 0xDEADBEEF);
+    EXPECT_EQ(b, 0x1234);
+    EXPECT_EQ(c, -300);
+    EXPECT_EQ(d, 0xFF);
+    EXPECT_EQ(e, -0.25f);
+    EXPECT_EQ(f, -1234567890123LL);
+    EXPECT_EQ(q.Left(), 0);
+}
+
+TEST(PacketLayout, BoundsChecked)
+{
+    typedef PacketLayout<LittleField<uint16_t>,
+        LittleField<uint16_t>> Header_t;
+
+    Packet p;
+    p.WriteU16Little(4);
+    p.WriteU8(1);
+    p.Rewind();
+
+    uint16_t size = 0;
+    uint16_t code = 0;
+
+    // Not enough data leaves the packet and the values alone.
+    EXPECT_FALSE(Header_t::Read(p, size, code));
+    EXPECT_EQ(p.Tell(), 0);
+    EXPECT_EQ(size, 0);
+    EXPECT_EQ(code, 0);
+
+    p.End();
+    p.WriteU8(2);
+    p.Rewind();
+
+    EXPECT_TRUE(Header_t::Peek(p, size, code));
+    EXPECT_EQ(p.Tell(), 0);
+    EXPECT_EQ(size, 4);
+    EXPECT_EQ(code, 0x0201);
+
+    EXPECT_TRUE(Header_t::Read(p, size, code));
+    EXPECT_EQ(p.Tell(), 4);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
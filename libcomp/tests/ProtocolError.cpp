@@ -0,0 +1,93 @@
+/**
+ * @file libcomp/tests/ProtocolError.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the rate-limited protocol error reports.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Packet.h>
+#include <ProtocolError.h>
+
+using namespace libcomp;
+
+TEST(ProtocolError, RateLimited)
+{
+    Packet p;
+    p.WriteBlank(1000);
+
+    // The first report gets the detailed diagnostics. An offset past the
+    // end must not break the dump.
+    EXPECT_TRUE(ProtocolError::Report(ProtocolError::CODE_EXTRA_DATA,
+        "127.0.0.1", &p, 5000));
+
+    int detailed = 0;
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        if(ProtocolError::Report(ProtocolError::CODE_SHORT_COMMAND_DATA,
+            "127.0.0.1", &p, (uint32_t)i))
+        {
+            detailed++;
+        }
+    }
+
+    EXPECT_EQ(ProtocolError::GetCount(ProtocolError::CODE_EXTRA_DATA), 1u);
+    EXPECT_EQ(ProtocolError::GetCount(
+        ProtocolError::CODE_SHORT_COMMAND_DATA), 1000u);
+
+    // Only a handful are logged (a few more if the loop crossed into the
+    // next second) and the rest are only counted.
+    EXPECT_LE(detailed, 2);
+    EXPECT_GE(ProtocolError::GetSuppressedCount(),
+        1001u - 2 * PROTOCOL_ERROR_LOG_RATE);
+}
+
+TEST(ProtocolError, Descriptions)
+{
+    for(int i = 0; i < ProtocolError::CODE_COUNT; ++i)
+    {
+        EXPECT_STRNE(ProtocolError::GetDescription(
+            (ProtocolError::Code_t)i), "unknown");
+    }
+
+    EXPECT_STREQ(ProtocolError::GetDescription(ProtocolError::CODE_COUNT),
+        "unknown");
+    EXPECT_EQ(ProtocolError::GetCount(ProtocolError::CODE_COUNT), 0u);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
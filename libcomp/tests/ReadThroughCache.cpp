@@ -0,0 +1,244 @@
+/**
+ * @file libcomp/tests/ReadThroughCache.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the ReadThroughCache class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <ReadThroughCache.h>
+
+// Standard C++11 Includes
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+TEST(ReadThroughCache, LoadsOnce)
+{
+    std::unordered_map<std::string, int> database;
+    database["alice"] = 1;
+
+    int loads = 0;
+
+    ReadThroughCache<int> cache([&](const std::string& key, int& value)
+    {
+        loads++;
+
+        auto it = database.find(key);
+
+        if(database.end() == it)
+        {
+            return false;
+        }
+
+        value = it->second;
+
+        return true;
+    }, nullptr, 16, std::chrono::seconds(60));
+
+    int value = 0;
+
+    EXPECT_TRUE(cache.Get("alice", value));
+    EXPECT_EQ(value, 1);
+    EXPECT_TRUE(cache.Get("alice", value));
+    EXPECT_EQ(loads, 1);
+
+    // Missing records are not cached.
+    EXPECT_FALSE(cache.Get("bob", value));
+    EXPECT_FALSE(cache.Get("bob", value));
+    EXPECT_EQ(loads, 3);
+
+    ReadThroughCacheStats_t stats = cache.GetStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 3u);
+
+    // An invalidated record is read again.
+    database["alice"] = 2;
+    cache.Invalidate("alice");
+
+    EXPECT_TRUE(cache.Get("alice", value));
+    EXPECT_EQ(value, 2);
+    EXPECT_EQ(loads, 4);
+}
+
+TEST(ReadThroughCache, WriteThrough)
+{
+    std::unordered_map<std::string, int> database;
+    bool failWrites = false;
+    int loads = 0;
+
+    ReadThroughCache<int> cache([&](const std::string& key, int& value)
+    {
+        loads++;
+        value = database[key];
+
+        return true;
+    }, [&](const std::string& key, const int& value)
+    {
+        if(!failWrites)
+        {
+            database[key] = value;
+        }
+
+        return !failWrites;
+    }, 16, std::chrono::seconds(60));
+
+    int value = 0;
+
+    EXPECT_TRUE(cache.Put("sid", 7));
+    EXPECT_EQ(database["sid"], 7);
+    EXPECT_TRUE(cache.Get("sid", value));
+    EXPECT_EQ(value, 7);
+    EXPECT_EQ(loads, 0);
+
+    // A failed write drops the cached copy.
+    failWrites = true;
+    EXPECT_FALSE(cache.Put("sid", 8));
+    EXPECT_TRUE(cache.Get("sid", value));
+    EXPECT_EQ(value, 7);
+    EXPECT_EQ(loads, 1);
+}
+
+TEST(ReadThroughCache, ExpiresAndEvicts)
+{
+    int loads = 0;
+
+    ReadThroughCache<int> cache([&loads](const std::string& key, int& value)
+    {
+        loads++;
+        value = (int)key.size();
+
+        return true;
+    }, nullptr, 2, std::chrono::milliseconds(20), 1);
+
+    int value = 0;
+
+    EXPECT_TRUE(cache.Get("a", value));
+    EXPECT_TRUE(cache.Get("bb", value));
+    EXPECT_TRUE(cache.Get("ccc", value));
+    EXPECT_EQ(cache.GetStats().evictions, 1u);
+
+    // "a" was the least recently used.
+    EXPECT_TRUE(cache.Get("a", value));
+    EXPECT_EQ(loads, 4);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+
+    EXPECT_TRUE(cache.Get("a", value));
+    EXPECT_EQ(value, 1);
+    EXPECT_EQ(loads, 5);
+    EXPECT_EQ(cache.GetStats().expired, 1u);
+}
+
+TEST(ReadThroughCache, OwnerFilter)
+{
+    int loads = 0;
+
+    ReadThroughCache<int> cache([&loads](const std::string& key, int& value)
+    {
+        loads++;
+        value = (int)key.size();
+
+        return true;
+    }, nullptr, 16, std::chrono::seconds(60));
+
+    // Only keys starting with "a" belong to this process.
+    cache.SetOwnerFilter([](const std::string& key)
+    {
+        return 0 == key.compare(0, 1, "a");
+    });
+
+    int value = 0;
+
+    EXPECT_TRUE(cache.Get("a1", value));
+    EXPECT_TRUE(cache.Get("a1", value));
+    EXPECT_EQ(loads, 1);
+
+    EXPECT_TRUE(cache.Get("b1", value));
+    EXPECT_TRUE(cache.Get("b1", value));
+    EXPECT_EQ(value, 2);
+    EXPECT_EQ(loads, 3);
+
+    // Writes to records owned elsewhere still reach the database.
+    EXPECT_TRUE(cache.Put("b2", 7));
+    EXPECT_TRUE(cache.Get("b2", value));
+    EXPECT_EQ(value, 2);
+    EXPECT_EQ(loads, 4);
+}
+
+TEST(ReadThroughCache, Threads)
+{
+    std::atomic<int> loads(0);
+
+    ReadThroughCache<std::string> cache([&loads](const std::string& key,
+        std::string& value)
+    {
+        loads++;
+        value = key + "!";
+
+        return true;
+    }, nullptr, 1024, std::chrono::seconds(60));
+
+    std::vector<std::thread> threads;
+
+    for(int t = 0; t < 4; ++t)
+    {
+        threads.push_back(std::thread([&cache]()
+        {
+            for(int i = 0; i < 1000; ++i)
+            {
+                std::string key = std::to_string(i % 100);
+                std::string value;
+
+                EXPECT_TRUE(cache.Get(key, value));
+                EXPECT_EQ(value, key + "!");
+            }
+        }));
+    }
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Every key is loaded at least once and only again if threads raced.
+    EXPECT_GE(loads, 100);
+    EXPECT_LE(loads, 400);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,151 @@
+/**
+ * @file libcomp/tests/RingBuffer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the RingBuffer class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <RingBuffer.h>
+
+// Standard C++11 Includes
+#include <cstring>
+#include <thread>
+
+using namespace libcomp;
+
+TEST(RingBuffer, ReadWrite)
+{
+    RingBuffer buffer(4096);
+
+    EXPECT_EQ(buffer.Capacity() - 1, buffer.Free());
+    EXPECT_EQ(0, buffer.Available());
+
+    char data[3000];
+    char out[3000];
+
+    memset(data, 'x', sizeof(data));
+
+    // The second write wraps around the end of the buffer.
+    for(int i = 0; i < 2; ++i)
+    {
+        ASSERT_EQ((int32_t)sizeof(data), buffer.Write(data, sizeof(data)));
+        EXPECT_EQ((int32_t)sizeof(data), buffer.Available());
+        ASSERT_EQ((int32_t)sizeof(out), buffer.Read(out, sizeof(out)));
+        EXPECT_EQ(0, memcmp(data, out, sizeof(data)));
+    }
+
+    EXPECT_EQ(0, buffer.Available());
+}
+
+TEST(RingBuffer, Records)
+{
+    RingBuffer buffer(4096);
+    std::vector<char> record;
+
+    EXPECT_FALSE(buffer.ReadRecord(record));
+
+    EXPECT_TRUE(buffer.WriteRecord("hello", 5));
+    EXPECT_TRUE(buffer.WriteRecord("", 0));
+    EXPECT_TRUE(buffer.WriteRecord("world!", 6));
+
+    // A record that does not fit is not written at all.
+    std::vector<char> big((size_t)buffer.Capacity());
+    EXPECT_FALSE(buffer.WriteRecord(&big[0], (int32_t)big.size()));
+
+    ASSERT_TRUE(buffer.ReadRecord(record));
+    EXPECT_EQ("hello", std::string(record.begin(), record.end()));
+
+    // Gather the rest with one call.
+    RingRecord_t records[4];
+    int32_t size = 0;
+
+    ASSERT_EQ(2, buffer.BeginReadV(records, 4, size));
+    EXPECT_EQ(0, records[0].size);
+    EXPECT_EQ(6, records[1].size);
+    EXPECT_EQ(0, memcmp("world!", records[1].pData, 6));
+    EXPECT_EQ(buffer.Available(), size);
+
+    EXPECT_EQ(0, buffer.EndRead(size));
+    EXPECT_FALSE(buffer.ReadRecord(record));
+}
+
+TEST(RingBuffer, Threads)
+{
+    RingBuffer buffer(4096);
+
+    static const uint32_t COUNT = 100000;
+
+    std::thread producer([&buffer]()
+    {
+        for(uint32_t i = 0; i < COUNT;)
+        {
+            if(buffer.WriteRecord(&i, sizeof(i)))
+            {
+                i++;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    RingRecord_t records[16];
+    uint32_t expected = 0;
+
+    while(expected < COUNT)
+    {
+        int32_t size = 0;
+        int32_t count = buffer.BeginReadV(records, 16, size);
+
+        for(int32_t i = 0; i < count; ++i)
+        {
+            uint32_t value;
+
+            ASSERT_EQ((int32_t)sizeof(value), records[i].size);
+            memcpy(&value, records[i].pData, sizeof(value));
+            ASSERT_EQ(expected++, value);
+        }
+
+        buffer.EndRead(size);
+    }
+
+    producer.join();
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
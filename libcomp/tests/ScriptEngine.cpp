@@ -29,7 +29,12 @@
 #include <PopIgnore.h>
 
 #include <Log.h>
+#include <Packet.h>
 #include <ScriptEngine.h>
+#include <ScriptEnginePool.h>
+
+// Standard C++11 Includes
+#include <thread>
 
 using namespace libcomp;
 
@@ -131,6 +136,175 @@ TEST(ScriptEngine, ReadOnlyPacket)
     Log::GetSingletonPtr()->ClearHooks();
 }
 
+TEST(ScriptEngine, EvalCached)
+{
+    String scriptMessages;
+
+    Log::GetSingletonPtr()->AddLogHook(
+        [&scriptMessages](Log::Level_t level, const String& msg)
+        {
+            (void)level;
+
+            scriptMessages += msg;
+        });
+
+    ScriptEngine engine;
+
+    // The cached script must run every time it is evaluated.
+    EXPECT_TRUE(engine.Eval("print(\"A\");", "test.nut"));
+    EXPECT_TRUE(engine.Eval("print(\"A\");", "test.nut"));
+    EXPECT_EQ(scriptMessages, "SQUIRREL: A\nSQUIRREL: A\n");
+    scriptMessages.Clear();
+
+    // A changed script is compiled again.
+    EXPECT_TRUE(engine.Eval("print(\"B\");", "test.nut"));
+    EXPECT_EQ(scriptMessages, "SQUIRREL: B\n");
+    scriptMessages.Clear();
+
+    Log::GetSingletonPtr()->ClearHooks();
+}
+
+TEST(ScriptEngine, Bytecode)
+{
+    String scriptMessages;
+
+    Log::GetSingletonPtr()->AddLogHook(
+        [&scriptMessages](Log::Level_t level, const String& msg)
+        {
+            (void)level;
+
+            scriptMessages += msg;
+        });
+
+    std::vector<char> bytecode;
+
+    // Compiling does not run the script.
+    {
+        ScriptEngine compiler;
+
+        EXPECT_TRUE(compiler.Compile("p <- Packet();\n"
+            "p.WriteBlank(5);\n"
+            "print(p.Size());\n", "packet.nut", bytecode));
+        EXPECT_FALSE(bytecode.empty());
+        EXPECT_TRUE(scriptMessages.IsEmpty());
+    }
+
+    ScriptEngine engine;
+
+    EXPECT_TRUE(engine.EvalBytecode(bytecode, "packet.nut"));
+    EXPECT_EQ(scriptMessages, "SQUIRREL: 5\n");
+    scriptMessages.Clear();
+
+    // Garbage is rejected.
+    std::vector<char> garbage(16, 'x');
+    EXPECT_FALSE(engine.EvalBytecode(garbage, "garbage.nut"));
+
+    Log::GetSingletonPtr()->ClearHooks();
+}
+
+TEST(ScriptEngine, Struct)
+{
+    String scriptMessages;
+
+    Log::GetSingletonPtr()->AddLogHook(
+        [&scriptMessages](Log::Level_t level, const String& msg)
+        {
+            (void)level;
+
+            scriptMessages += msg;
+        });
+
+    ScriptEngine engine;
+
+    EXPECT_TRUE(engine.Eval(
+        "function Parse(p) {\n"
+        "    local v = p.ReadStruct(\"<BhI2x>H\");\n"
+        "    print(v.len() + \" \" + v[0] + \" \" + v[1] + \" \" +\n"
+        "        v[2] + \" \" + v[3] + \" \" + p.Left());\n"
+        "}\n"
+        "function Build(p) {\n"
+        "    p.WriteStruct(\"<BhI2x>H\", [7, -2, 100000, 0x1234]);\n"
+        "}\n", "struct.nut"));
+
+    Packet packet;
+
+    // The script writes into the packet passed to it (not a copy).
+    EXPECT_TRUE(engine.Call("Build", packet));
+    ASSERT_EQ(packet.Size(), 11U);
+    EXPECT_EQ(packet.Data()[9], 0x12);
+
+    packet.Rewind();
+    packet.WriteU8(0xFF);
+    packet.Rewind();
+
+    ReadOnlyPacket copy(packet);
+    copy.Rewind();
+
+    EXPECT_TRUE(engine.Call("Parse", copy));
+    EXPECT_EQ(scriptMessages, "SQUIRREL: 4 255 -2 100000 4660 0\n");
+    EXPECT_EQ(copy.Left(), 0U);
+    scriptMessages.Clear();
+
+    // A short packet is not read at all.
+    copy.Seek(1);
+    EXPECT_FALSE(engine.Call("Parse", copy));
+    EXPECT_EQ(copy.Tell(), 1U);
+
+    Log::GetSingletonPtr()->ClearHooks();
+}
+
+/**
+ * Stand-in for a worker service that runs each job on its own thread.
+ */
+class ThreadService
+{
+public:
+    void post(const std::function<void()>& job)
+    {
+        std::thread(job).join();
+    }
+};
+
+TEST(ScriptEngine, Pool)
+{
+    String scriptMessages;
+
+    Log::GetSingletonPtr()->AddLogHook(
+        [&scriptMessages](Log::Level_t level, const String& msg)
+        {
+            (void)level;
+
+            scriptMessages += msg;
+        });
+
+    ScriptEnginePool pool;
+    ThreadService service;
+
+    EXPECT_TRUE(pool.AddModule("function Hello() { print(\"Hello\"); }",
+        "hello.nut"));
+    EXPECT_FALSE(pool.AddModule("function (", "broken.nut"));
+    scriptMessages.Clear();
+
+    // Each thread gets its own engine with the module loaded.
+    pool.Call(service, "Hello");
+    pool.Call(service, "Hello");
+    EXPECT_EQ(scriptMessages, "SQUIRREL: Hello\nSQUIRREL: Hello\n");
+    EXPECT_EQ(pool.GetEngineCount(), 2U);
+    scriptMessages.Clear();
+
+    // The same thread keeps its engine and picks up new modules.
+    EXPECT_TRUE(pool.AddModule("function Bye() { print(\"Bye\"); }",
+        "bye.nut"));
+    EXPECT_TRUE(pool.GetThreadEngine().Call("Hello"));
+    EXPECT_TRUE(&pool.GetThreadEngine() == &pool.GetThreadEngine());
+    EXPECT_TRUE(pool.GetThreadEngine().Call("Bye"));
+    EXPECT_FALSE(pool.GetThreadEngine().Call("Missing"));
+    EXPECT_EQ(pool.GetEngineCount(), 3U);
+    EXPECT_EQ(scriptMessages.Left(30), "SQUIRREL: Hello\nSQUIRREL: Bye\n");
+
+    Log::GetSingletonPtr()->ClearHooks();
+}
+
 int main(int argc, char *argv[])
 {
     try
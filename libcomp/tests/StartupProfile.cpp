@@ -0,0 +1,121 @@
+/**
+ * @file libcomp/tests/StartupProfile.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the StartupProfile class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <StartupProfile.h>
+
+// Standard C++11 Includes
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+
+using namespace libcomp;
+
+TEST(StartupProfile, Parallel)
+{
+    StartupProfile profile("Test");
+
+    std::mutex lock;
+    std::condition_variable condition;
+    int started = 0;
+
+    // Each step waits for the other so they only finish if they run at
+    // the same time.
+    auto step = [&]()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+
+        started++;
+        condition.notify_all();
+
+        return condition.wait_for(guard, std::chrono::seconds(5),
+            [&started]() { return 2 <= started; });
+    };
+
+    profile.AddStep("first", step);
+    profile.AddStep("second", step);
+
+    EXPECT_TRUE(profile.Run());
+
+    auto steps = profile.GetSteps();
+    ASSERT_EQ(2u, steps.size());
+    EXPECT_EQ(String("first"), steps[0].name);
+    EXPECT_EQ(String("second"), steps[1].name);
+    EXPECT_TRUE(steps[0].success);
+    EXPECT_TRUE(steps[1].success);
+
+    EXPECT_FALSE(profile.IsReady());
+    profile.Ready();
+    EXPECT_TRUE(profile.IsReady());
+}
+
+TEST(StartupProfile, Failure)
+{
+    StartupProfile profile("Test");
+    std::atomic<int> ran(0);
+
+    profile.AddStep("ok", [&ran]() { ran++; return true; });
+    profile.AddStep("fails", [&ran]() { ran++; return false; });
+    profile.AddStep("throws", [&ran]() -> bool
+    {
+        ran++;
+
+        throw std::runtime_error("step failed");
+    });
+
+    // Every step still runs.
+    EXPECT_FALSE(profile.Run());
+    EXPECT_EQ(3, ran);
+
+    auto steps = profile.GetSteps();
+    ASSERT_EQ(3u, steps.size());
+    EXPECT_TRUE(steps[0].success);
+    EXPECT_FALSE(steps[1].success);
+    EXPECT_FALSE(steps[2].success);
+
+    // A later run only has the steps added since.
+    profile.AddStep("again", []() { return true; });
+    EXPECT_TRUE(profile.Run());
+    EXPECT_EQ(4u, profile.GetSteps().size());
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -30,8 +30,37 @@
 
 #include <String.h>
 
+#include <regex_ext>
+
+#include <chrono>
+#include <iostream>
+
 using namespace libcomp;
 
+/**
+ * The regex based String::Arg this used to be (to compare against).
+ */
+static std::string RegexArg(const std::string& format, const std::string& a)
+{
+    auto callback = [&](const std::smatch& match)
+    {
+        int n = std::atoi(match.str(1).c_str());
+
+        if(1 == n)
+        {
+            return a;
+        }
+        else
+        {
+            return "%" + std::to_string(n - 1);
+        }
+    };
+
+    std::regex re("\\%([0-9]{1,2})\\b");
+
+    return std::regex_replace(format.cbegin(), format.cend(), re, callback);
+}
+
 TEST(String, Length)
 {
     EXPECT_EQ(9, String("今日は月曜日です。").Length());
@@ -269,6 +298,100 @@ TEST(String, ArgInt)
     EXPECT_EQ("0x00ff", String("0x%1").Arg(255, 4, 16, '0'));
 }
 
+TEST(String, ArgMultiple)
+{
+    EXPECT_EQ("Arguments: a1, b2, c3", String("Arguments: %2, %1, %3").Arg(
+        "b2", "a1", "c3"));
+    EXPECT_EQ("a b a %1", String("%1 %2 %1 %3").Arg("a", "b"));
+
+    // Unlike chained calls the argument text is not scanned again.
+    EXPECT_EQ("%2 b", String("%1 %2").Arg("%2", "b"));
+
+    bool reporting = String::IsReportingBadArguments();
+    String::SetBadArgumentReporting(false);
+    EXPECT_EQ("Argument 1 is missing: b",
+        String("Argument 1 is missing: %2").Arg("a", "b"));
+    String::SetBadArgumentReporting(reporting);
+}
+
+TEST(String, ArgMatchesRegex)
+{
+    const char *formats[] = {
+        "", "%", "%%", "%1", "%%1", "%1%", "%1%2", "%2%1", "%0", "%00",
+        "%01", "%05", "%10", "%99", "%100", "%1a", "%1_", "%1.", "a%1b",
+        "%2 %1 %3", "%1\n", "%12%", "x%9y %9 %09 %9%",
+    };
+
+    bool reporting = String::IsReportingBadArguments();
+    String::SetBadArgumentReporting(false);
+
+    for(auto format : formats)
+    {
+        std::string expected = RegexArg(RegexArg(format, "a"), "bc");
+
+        EXPECT_EQ(expected, String(format).Arg("a").Arg("bc").ToUtf8())
+            << "Format: " << format;
+    }
+
+    String::SetBadArgumentReporting(reporting);
+}
+
+TEST(String, ArgBenchmark)
+{
+    const int iterations = 2000;
+    const std::string format = "Socket error for client from %1:  %2 (%3 "
+        "bytes queued, %4 ms)\n";
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::string expected;
+
+    for(int i = 0; i < iterations; ++i)
+    {
+        expected = RegexArg(RegexArg(RegexArg(RegexArg(format, "127.0.0.1"),
+            "Connection timed out."), "16384"), "17000");
+    }
+
+    double regex = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+
+    String chained;
+
+    for(int i = 0; i < iterations; ++i)
+    {
+        chained = String(format).Arg("127.0.0.1").Arg(
+            "Connection timed out.").Arg(16384).Arg(17000);
+    }
+
+    double single = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+
+    String multiple;
+
+    for(int i = 0; i < iterations; ++i)
+    {
+        multiple = String(format).Arg("127.0.0.1", "Connection timed out.",
+            "16384", "17000");
+    }
+
+    double onePass = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    EXPECT_EQ(expected, chained.ToUtf8());
+    EXPECT_EQ(expected, multiple.ToUtf8());
+
+    std::cout << "regex Arg x4: " << (regex * 1e9 / iterations) << " ns"
+        << std::endl;
+    std::cout << "Arg x4: " << (single * 1e9 / iterations) << " ns"
+        << std::endl;
+    std::cout << "Arg(a, b, c, d): " << (onePass * 1e9 / iterations)
+        << " ns" << std::endl;
+}
+
 TEST(String, ToUpperLower)
 {
     EXPECT_EQ("ABCDEF", String("aBcDeF").ToUpper());
@@ -413,6 +536,111 @@ TEST(String, ToInteger)
     EXPECT_TRUE(ok);
 }
 
+TEST(String, CodePointIterator)
+{
+    String s("aé今日は😀z");
+
+    std::vector<String::CodePoint> expected = {
+        0x61, 0xE9, 0x4ECA, 0x65E5, 0x306F, 0x1F600, 0x7A,
+    };
+    std::vector<String::CodePoint> cps;
+
+    for(String::CodePoint cp : s)
+    {
+        cps.push_back(cp);
+    }
+
+    EXPECT_EQ(expected, cps);
+
+    for(size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_EQ(expected[i], s.At(i));
+    }
+
+    EXPECT_EQ(0u, s.At(expected.size()));
+    String empty;
+    EXPECT_TRUE(empty.begin() == empty.end());
+}
+
+TEST(String, LongStringIndex)
+{
+    // Long enough to use the code point index.
+    String s;
+    std::vector<String::CodePoint> expected;
+
+    for(int i = 0; i < 100; ++i)
+    {
+        s += String("a今😀");
+        expected.push_back(0x61);
+        expected.push_back(0x4ECA);
+        expected.push_back(0x1F600);
+    }
+
+    ASSERT_EQ(expected.size(), s.Length());
+
+    for(size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_EQ(expected[i], s.At(i));
+    }
+
+    EXPECT_EQ("今😀a今", s.Mid(4, 4));
+    EXPECT_EQ("😀a", s.Mid(s.Length() - 4, 2));
+    EXPECT_EQ("a今😀a", s.Left(4));
+    EXPECT_EQ("😀a今😀", s.Right(4));
+    EXPECT_EQ(s.Mid(150), s.Right(150));
+
+    // Changing the string must not use the old index.
+    String copy(s);
+    copy.Prepend("é");
+
+    EXPECT_EQ(0xE9u, copy.At(0));
+    EXPECT_EQ(0x61u, copy.At(1));
+    EXPECT_EQ(0x61u, s.At(0));
+    EXPECT_EQ(0x1F600u, copy.At(300));
+}
+
+TEST(String, MoveAndShare)
+{
+    String shortString = "short";
+    String longString = u8"This string is too long to be stored inline ✓";
+
+    String movedShort(std::move(shortString));
+    String movedLong(std::move(longString));
+
+    EXPECT_TRUE(shortString.IsEmpty());
+    EXPECT_TRUE(longString.IsEmpty());
+    EXPECT_EQ(0, shortString.Size());
+    EXPECT_EQ(movedShort, "short");
+    EXPECT_EQ(movedLong.Length(), 45);
+
+    shortString = std::move(movedShort);
+    EXPECT_EQ(shortString, "short");
+    EXPECT_TRUE(movedShort.IsEmpty());
+
+    // Long strings share their data until one of them changes.
+    String copy = movedLong;
+    EXPECT_EQ(copy.C(), movedLong.C());
+
+    copy += "!";
+    EXPECT_NE(copy.C(), movedLong.C());
+    EXPECT_EQ(copy.Length(), 46);
+    EXPECT_EQ(movedLong.Length(), 45);
+    EXPECT_EQ(copy.Left(45), movedLong);
+
+    // Growing a short string past the inline size and back.
+    String grow = "abc";
+    grow.Append(String(20, 'x')).Prepend("<");
+    EXPECT_EQ(grow, String("<abc") + String(20, 'x'));
+    EXPECT_EQ(grow.Length(), 24);
+
+    grow.Truncate(2);
+    EXPECT_EQ(grow, "<a");
+
+    String self = "abcdefghij";
+    self.Append(self);
+    EXPECT_EQ(self, "abcdefghijabcdefghij");
+}
+
 int main(int argc, char *argv[])
 {
     try
@@ -0,0 +1,476 @@
+/**
+ * @file libcomp/tests/TcpConnection.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the receiving of the TcpConnection class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include "ConnectionTest.h"
+
+#include <TcpConnection.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+/**
+ * Connection that keeps the last @em mKeep bytes of what it receives in the
+ * buffer (like a partial frame) and consumes the rest.
+ */
+class StreamConnection : public TcpConnection
+{
+public:
+    StreamConnection(asio::ip::tcp::socket& socket) :
+        TcpConnection(socket, nullptr), mKeep(0), mReceived(0)
+    {
+    }
+
+    virtual void StreamReceived(RingBuffer& buffer)
+    {
+        int32_t available = buffer.Available();
+        int32_t consume = available > mKeep ? available - mKeep : 0;
+
+        mReceived += consume;
+
+        (void)buffer.EndRead(consume);
+    }
+
+    bool Start()
+    {
+        return RequestStream();
+    }
+
+    int32_t mKeep;
+    int32_t mReceived;
+};
+
+/**
+ * Connection that records what happens to the packets it sends. Each
+ * packet starts with a 32-bit sequence number.
+ */
+class SendConnection : public TcpConnection
+{
+public:
+    SendConnection(asio::ip::tcp::socket& socket) :
+        TcpConnection(socket, nullptr), mDrained(0), mClosingCalls(0)
+    {
+    }
+
+    virtual void PacketSent(ReadOnlyPacket& packet)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, packet.ConstData(), sizeof(sequence));
+
+        mSent.push_back(sequence);
+    }
+
+    virtual void OutgoingDrained()
+    {
+        mDrained++;
+    }
+
+    virtual void ConnectionClosing(const String& reason)
+    {
+        (void)reason;
+
+        mClosingCalls++;
+
+        // Sent before the socket is closed.
+        Packet packet;
+        packet.WriteU32Little(0xFFFFFFFF);
+
+        SendPacket(packet);
+    }
+
+    std::vector<uint32_t> mSent;
+    int mDrained;
+    int mClosingCalls;
+};
+
+/**
+ * Queue a packet that starts with a sequence number.
+ * @param connection Connection to send the packet on.
+ * @param sequence Sequence number of the packet.
+ * @param size Size of the packet (at least 4 bytes).
+ * @param priority Priority to send the packet with.
+ * @returns true if the packet was queued.
+ */
+static bool SendSequence(TcpConnection& connection, uint32_t sequence,
+    uint32_t size, TcpConnection::SendPriority_t priority =
+    TcpConnection::PRIORITY_NORMAL)
+{
+    Packet packet;
+    packet.WriteU32Little(sequence);
+    packet.WriteBlank(size - (uint32_t)sizeof(sequence));
+
+    return connection.SendPacket(packet, priority);
+}
+
+/**
+ * Connect a socket to a new connection over the loopback interface.
+ * @param service io_service for both ends.
+ * @param client Socket to connect.
+ * @returns Connection on the accepted end.
+ */
+static std::shared_ptr<SendConnection> AcceptConnection(
+    asio::io_service& service, asio::ip::tcp::socket& client)
+{
+    asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(
+        asio::ip::address_v4::loopback(), 0));
+
+    client.connect(acceptor.local_endpoint());
+
+    asio::ip::tcp::socket accepted(service);
+    acceptor.accept(accepted);
+
+    std::shared_ptr<SendConnection> connection(
+        new SendConnection(accepted));
+    connection->SetSelf(connection);
+
+    return connection;
+}
+
+/**
+ * Read the sequence numbers of packets of one size from a socket.
+ * @param client Socket to read from.
+ * @param count Number of packets to read.
+ * @param size Size of each packet.
+ * @returns Sequence numbers that were read.
+ */
+static std::vector<uint32_t> ReadSequences(asio::ip::tcp::socket& client,
+    size_t count, uint32_t size)
+{
+    std::vector<uint32_t> sequences;
+    std::vector<char> data(size);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        asio::read(client, asio::buffer(&data[0], size));
+
+        uint32_t sequence;
+        memcpy(&sequence, &data[0], sizeof(sequence));
+
+        sequences.push_back(sequence);
+    }
+
+    return sequences;
+}
+
+TEST(TcpConnection, ReceiveOnDemand)
+{
+    asio::io_service service;
+    asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(
+        asio::ip::address_v4::loopback(), 0));
+
+    asio::ip::tcp::socket client(service);
+    client.connect(acceptor.local_endpoint());
+
+    asio::ip::tcp::socket accepted(service);
+    acceptor.accept(accepted);
+
+    std::shared_ptr<StreamConnection> connection(
+        new StreamConnection(accepted));
+    connection->SetReceiveOnDemand(true);
+
+    EXPECT_TRUE(connection->IsReceiveOnDemand());
+    EXPECT_TRUE(connection->IsStreamingReceive());
+
+    uint64_t outstanding = TcpConnection::GetReceiveBufferPoolStats(
+        ).outstanding;
+
+    // Waiting for data does not hold a buffer.
+    ASSERT_TRUE(connection->Start());
+    service.poll();
+    service.reset();
+
+    EXPECT_EQ(TcpConnection::GetReceiveBufferPoolStats().outstanding,
+        outstanding);
+
+    // Everything is parsed so the buffer goes back.
+    char data[64] = { 0 };
+    asio::write(client, asio::buffer(data, 16));
+
+    EXPECT_TRUE(RunUntil(service, [&connection]()
+    {
+        return 16 == connection->mReceived;
+    }));
+    EXPECT_EQ(TcpConnection::GetReceiveBufferPoolStats().outstanding,
+        outstanding);
+
+    // A partial frame keeps the buffer until the rest is there.
+    connection->mKeep = 8;
+    asio::write(client, asio::buffer(data, 40));
+
+    EXPECT_TRUE(RunUntil(service, [&connection]()
+    {
+        return 48 == connection->mReceived;
+    }));
+    EXPECT_EQ(TcpConnection::GetReceiveBufferPoolStats().outstanding,
+        outstanding + 1);
+
+    connection->mKeep = 0;
+    asio::write(client, asio::buffer(data, 8));
+
+    EXPECT_TRUE(RunUntil(service, [&connection]()
+    {
+        return 64 == connection->mReceived;
+    }));
+    EXPECT_EQ(TcpConnection::GetReceiveBufferPoolStats().outstanding,
+        outstanding);
+}
+
+TEST(TcpConnection, SendBatches)
+{
+    asio::io_service service;
+    asio::ip::tcp::socket client(service);
+
+    std::shared_ptr<SendConnection> connection = AcceptConnection(service,
+        client);
+
+    // More packets than fit in one write.
+    connection->SetSendBatchLimits(3, 1024);
+
+    std::vector<uint32_t> expected;
+
+    for(uint32_t i = 0; i < 10; ++i)
+    {
+        ASSERT_TRUE(SendSequence(*connection, i, 8));
+
+        expected.push_back(i);
+    }
+
+    // One notification per packet in the order they were queued.
+    ASSERT_TRUE(RunUntil(service, [&connection]()
+    {
+        return 10 == connection->mSent.size();
+    }));
+    EXPECT_EQ(expected, connection->mSent);
+    EXPECT_EQ(0u, connection->GetOutgoingBytes());
+    EXPECT_EQ(expected, ReadSequences(client, 10, 8));
+
+    // The byte limit also ends a write but a bigger packet is still sent.
+    connection->SetSendBatchLimits(100, 16);
+    connection->mSent.clear();
+
+    ASSERT_TRUE(SendSequence(*connection, 10, 64));
+
+    for(uint32_t i = 11; i < 16; ++i)
+    {
+        ASSERT_TRUE(SendSequence(*connection, i, 8));
+    }
+
+    ASSERT_TRUE(RunUntil(service, [&connection]()
+    {
+        return 6 == connection->mSent.size();
+    }));
+    EXPECT_EQ(std::vector<uint32_t>({ 10, 11, 12, 13, 14, 15 }),
+        connection->mSent);
+    EXPECT_EQ(std::vector<uint32_t>({ 10 }), ReadSequences(client, 1, 64));
+    EXPECT_EQ(std::vector<uint32_t>({ 11, 12, 13, 14, 15 }),
+        ReadSequences(client, 5, 8));
+}
+
+TEST(TcpConnection, Watermarks)
+{
+    asio::io_service service;
+    asio::ip::tcp::socket client(service);
+
+    std::shared_ptr<SendConnection> connection = AcceptConnection(service,
+        client);
+    connection->SetOutgoingLimits(16, 32);
+
+    // Nothing is sent until the service runs so the queue fills up.
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+        ASSERT_TRUE(SendSequence(*connection, i, 8));
+    }
+
+    EXPECT_TRUE(connection->IsWritable());
+    EXPECT_EQ(32u, connection->GetOutgoingBytes());
+
+    // A low priority packet over the high watermark is dropped.
+    EXPECT_FALSE(SendSequence(*connection, 4, 8,
+        TcpConnection::PRIORITY_LOW));
+    EXPECT_FALSE(connection->IsWritable());
+    EXPECT_EQ(32u, connection->GetOutgoingBytes());
+
+    // The first write only had the first packet. Above the low watermark
+    // the connection stays full even though the packet would fit.
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+    while(32u == connection->GetOutgoingBytes() &&
+        std::chrono::steady_clock::now() < end)
+    {
+        service.poll_one();
+        service.reset();
+    }
+
+    ASSERT_EQ(24u, connection->GetOutgoingBytes());
+    EXPECT_FALSE(connection->IsWritable());
+    EXPECT_FALSE(SendSequence(*connection, 5, 8,
+        TcpConnection::PRIORITY_LOW));
+    EXPECT_EQ(0, connection->mDrained);
+
+    // Writable again (once) below the low watermark.
+    ASSERT_TRUE(RunUntil(service, [&connection]()
+    {
+        return 0 == connection->GetOutgoingBytes();
+    }));
+    EXPECT_TRUE(connection->IsWritable());
+    EXPECT_EQ(1, connection->mDrained);
+    EXPECT_EQ(std::vector<uint32_t>({ 0, 1, 2, 3 }), connection->mSent);
+
+    EXPECT_TRUE(SendSequence(*connection, 6, 8,
+        TcpConnection::PRIORITY_LOW));
+    ASSERT_TRUE(RunUntil(service, [&connection]()
+    {
+        return 5 == connection->mSent.size();
+    }));
+    EXPECT_EQ(1, connection->mDrained);
+    EXPECT_EQ(std::vector<uint32_t>({ 0, 1, 2, 3, 6 }),
+        ReadSequences(client, 5, 8));
+    EXPECT_EQ(TcpConnection::STATUS_CONNECTED, connection->GetStatus());
+}
+
+TEST(TcpConnection, OverflowDisconnect)
+{
+    asio::io_service service;
+    asio::ip::tcp::socket client(service);
+
+    std::shared_ptr<SendConnection> connection = AcceptConnection(service,
+        client);
+    connection->SetOutgoingLimits(16, 32);
+
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+        ASSERT_TRUE(SendSequence(*connection, i, 8));
+    }
+
+    // A normal packet over the high watermark closes the connection.
+    EXPECT_FALSE(SendSequence(*connection, 4, 8));
+    EXPECT_FALSE(connection->IsWritable());
+
+    EXPECT_TRUE(RunUntil(service, [&connection]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED ==
+            connection->GetStatus();
+    }));
+}
+
+TEST(TcpConnection, CloseAfterQueue)
+{
+    asio::io_service service;
+    asio::ip::tcp::socket client(service);
+
+    std::shared_ptr<SendConnection> connection = AcceptConnection(service,
+        client);
+
+    // More than the socket buffers hold so the close has to wait.
+    const uint32_t count = 64;
+    const uint32_t size = 4096;
+
+    connection->SetOutgoingLimits(count * size, 2 * count * size);
+
+    std::vector<uint32_t> expected;
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        ASSERT_TRUE(SendSequence(*connection, i, size));
+
+        expected.push_back(i);
+    }
+
+    expected.push_back(0xFFFFFFFF);
+
+    connection->Close("Test is done.");
+
+    std::vector<char> received;
+
+    std::thread reader([&client, &received]()
+    {
+        char data[4096];
+        asio::error_code errorCode;
+
+        for(;;)
+        {
+            size_t length = client.read_some(asio::buffer(data), errorCode);
+
+            if(errorCode)
+            {
+                break;
+            }
+
+            received.insert(received.end(), data, data + length);
+        }
+    });
+
+    EXPECT_TRUE(RunUntil(service, [&connection]()
+    {
+        return TcpConnection::STATUS_NOT_CONNECTED ==
+            connection->GetStatus();
+    }));
+
+    reader.join();
+
+    // Everything queued (and what was sent while closing) came first.
+    EXPECT_EQ(1, connection->mClosingCalls);
+    ASSERT_EQ((size_t)(count * size + 4), received.size());
+
+    std::vector<uint32_t> sequences;
+
+    for(size_t offset = 0; offset < received.size(); offset += size)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, &received[offset], sizeof(sequence));
+
+        sequences.push_back(sequence);
+    }
+
+    EXPECT_EQ(expected, sequences);
+    EXPECT_EQ(expected, connection->mSent);
+
+    // Closing again does nothing.
+    connection->Close("Again.");
+    service.poll();
+    EXPECT_EQ(1, connection->mClosingCalls);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
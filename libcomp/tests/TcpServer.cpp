@@ -0,0 +1,214 @@
+/**
+ * @file libcomp/tests/TcpServer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the TcpServer class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <TcpConnection.h>
+#include <TcpServer.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace libcomp;
+
+/**
+ * Connection that lets the test post to the worker it runs on.
+ */
+class WorkerConnection : public TcpConnection
+{
+public:
+    WorkerConnection(asio::ip::tcp::socket& socket) :
+        TcpConnection(socket, nullptr)
+    {
+    }
+
+    asio::io_service& GetWorkerService()
+    {
+        return GetIoService();
+    }
+};
+
+/**
+ * Server without a key exchange that counts the connections each worker
+ * thread runs.
+ */
+class WorkerServer : public TcpServer
+{
+public:
+    WorkerServer(size_t workerCount) : TcpServer("127.0.0.1", 0,
+        workerCount), mConnections(0)
+    {
+    }
+
+    /**
+     * Wait for a number of connections to reach their worker.
+     * @param count Number of connections to wait for.
+     * @returns Connections run by each worker thread.
+     */
+    std::map<std::thread::id, int> WaitForConnections(int count)
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+
+        mCondition.wait_for(lock, std::chrono::seconds(5), [this, count]()
+        {
+            return count <= mConnections;
+        });
+
+        return mThreads;
+    }
+
+protected:
+    virtual bool UsesDiffieHellman() const
+    {
+        return false;
+    }
+
+    virtual std::shared_ptr<TcpConnection> CreateConnection(
+        asio::ip::tcp::socket& socket)
+    {
+        std::shared_ptr<WorkerConnection> connection(
+            new WorkerConnection(socket));
+
+        connection->GetWorkerService().post([this]()
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+
+            mThreads[std::this_thread::get_id()]++;
+            mConnections++;
+
+            mCondition.notify_all();
+        });
+
+        return connection;
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::map<std::thread::id, int> mThreads;
+    int mConnections;
+};
+
+TEST(TcpServer, SpreadAcrossWorkers)
+{
+    const int workerCount = 4;
+    const int connectionCount = 4 * workerCount;
+
+    WorkerServer server(workerCount);
+    EXPECT_EQ((size_t)workerCount, server.GetWorkerCount());
+
+    // A single acceptor hands the connections out in turn.
+    SocketOptions_t options = server.GetSocketOptions();
+    options.reusePort = false;
+
+    server.SetSocketOptions(options);
+    server.SetAcceptLimits(0, 0, 0);
+
+    std::mutex lock;
+    std::condition_variable condition;
+    uint16_t port = 0;
+
+    server.SetReadyHandler([&]()
+    {
+        asio::ip::tcp::acceptor::native_handle_type handle;
+        sockaddr_in address;
+        socklen_t addressSize = sizeof(address);
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        if(server.GetListenHandle(handle) && 0 == getsockname(handle,
+            reinterpret_cast<sockaddr*>(&address), &addressSize))
+        {
+            port = ntohs(address.sin_port);
+        }
+
+        condition.notify_all();
+    });
+
+    std::thread serverThread([&server]()
+    {
+        server.Start();
+    });
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+
+        condition.wait_for(guard, std::chrono::seconds(5), [&port]()
+        {
+            return 0 != port;
+        });
+    }
+
+    ASSERT_NE(0, port);
+
+    asio::io_service service;
+    std::list<asio::ip::tcp::socket> clients;
+
+    for(int i = 0; i < connectionCount; ++i)
+    {
+        clients.emplace_back(service);
+        clients.back().connect(asio::ip::tcp::endpoint(
+            asio::ip::address_v4::loopback(), port));
+    }
+
+    // Each worker has its own thread and gets the same share.
+    std::map<std::thread::id, int> threads = server.WaitForConnections(
+        connectionCount);
+    EXPECT_EQ((size_t)workerCount, threads.size());
+
+    for(auto thread : threads)
+    {
+        EXPECT_EQ(connectionCount / workerCount, thread.second);
+    }
+
+    EXPECT_EQ(0u, threads.count(std::this_thread::get_id()));
+    EXPECT_EQ(0u, threads.count(serverThread.get_id()));
+
+    server.Stop("Test is done.", 1);
+    serverThread.join();
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
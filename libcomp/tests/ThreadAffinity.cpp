@@ -0,0 +1,118 @@
+/**
+ * @file libcomp/tests/ThreadAffinity.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the ThreadAffinity class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <ThreadAffinity.h>
+
+// Standard C++11 Includes
+#include <thread>
+
+using namespace libcomp;
+
+TEST(ThreadAffinity, ParseCpuList)
+{
+    ThreadAffinity::CpuList_t cpus;
+
+    EXPECT_TRUE(ThreadAffinity::ParseCpuList("", cpus));
+    EXPECT_TRUE(cpus.empty());
+
+    EXPECT_TRUE(ThreadAffinity::ParseCpuList("3", cpus));
+    EXPECT_EQ(cpus, ThreadAffinity::CpuList_t({ 3 }));
+
+    EXPECT_TRUE(ThreadAffinity::ParseCpuList(" 8, 0-2 ,10-11,1\n", cpus));
+    EXPECT_EQ(cpus, ThreadAffinity::CpuList_t({ 0, 1, 2, 8, 10, 11 }));
+
+    EXPECT_FALSE(ThreadAffinity::ParseCpuList("2-1", cpus));
+    EXPECT_TRUE(cpus.empty());
+    EXPECT_FALSE(ThreadAffinity::ParseCpuList("1,,2", cpus));
+    EXPECT_FALSE(ThreadAffinity::ParseCpuList("1-2-3", cpus));
+    EXPECT_FALSE(ThreadAffinity::ParseCpuList("a", cpus));
+    EXPECT_FALSE(ThreadAffinity::ParseCpuList("-1", cpus));
+    EXPECT_FALSE(ThreadAffinity::ParseCpuList("0-100000", cpus));
+}
+
+TEST(ThreadAffinity, Apply)
+{
+    // No CPUs leaves the thread alone.
+    EXPECT_TRUE(ThreadAffinity::GetCpus(ThreadAffinity::ROLE_IO).empty());
+    EXPECT_TRUE(ThreadAffinity::Apply(ThreadAffinity::ROLE_IO, 5));
+
+    ThreadAffinity::CpuList_t allowed;
+
+    if(!ThreadAffinity::GetCurrentThread(allowed) || allowed.empty())
+    {
+        return;
+    }
+
+    ThreadAffinity::SetCpus(ThreadAffinity::ROLE_IO, allowed);
+    ThreadAffinity::SetCpus(ThreadAffinity::ROLE_WORKER, allowed);
+
+    // Each network thread gets one CPU of the set.
+    std::thread([&allowed]()
+    {
+        ThreadAffinity::CpuList_t cpus;
+
+        EXPECT_TRUE(ThreadAffinity::Apply(ThreadAffinity::ROLE_IO,
+            allowed.size() + 1));
+        EXPECT_TRUE(ThreadAffinity::GetCurrentThread(cpus));
+        EXPECT_EQ(cpus, ThreadAffinity::CpuList_t(
+            1, allowed[1 % allowed.size()]));
+        EXPECT_EQ(ThreadAffinity::GetCurrentNode(),
+            ThreadAffinity::GetNode(cpus.front()));
+    }).join();
+
+    // Other threads get the whole set.
+    std::thread([&allowed]()
+    {
+        ThreadAffinity::CpuList_t cpus;
+
+        EXPECT_TRUE(ThreadAffinity::Apply(ThreadAffinity::ROLE_WORKER, 1));
+        EXPECT_TRUE(ThreadAffinity::GetCurrentThread(cpus));
+        EXPECT_EQ(cpus, allowed);
+    }).join();
+
+    ThreadAffinity::SetCpus(ThreadAffinity::ROLE_IO,
+        ThreadAffinity::CpuList_t());
+    ThreadAffinity::SetCpus(ThreadAffinity::ROLE_WORKER,
+        ThreadAffinity::CpuList_t());
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,167 @@
+/**
+ * @file libcomp/tests/TickLoop.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the TickLoop class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <MessagePacket.h>
+#include <TcpConnection.h>
+#include <TickLoop.h>
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+using namespace libcomp;
+
+/**
+ * Queue a command from a connection.
+ * @param queue Queue to add the command to.
+ * @param connection Connection the command is from.
+ * @param commandCode Command code.
+ * @param sequence Number the command carries so its order can be checked.
+ */
+static void QueueCommand(MessageQueue<Message::Message*>& queue,
+    const std::shared_ptr<TcpConnection>& connection, uint16_t commandCode,
+    uint32_t sequence)
+{
+    Packet packet;
+    packet.WriteU32Little(sequence);
+    packet.Rewind();
+
+    ReadOnlyPacket data(packet);
+
+    queue.Enqueue(new Message::Packet(connection, commandCode, data));
+}
+
+TEST(TickLoop, GroupsCommands)
+{
+    asio::io_service service;
+    std::shared_ptr<TcpConnection> first(new TcpConnection(service));
+    std::shared_ptr<TcpConnection> second(new TcpConnection(service));
+    std::shared_ptr<TcpConnection> third(new TcpConnection(service));
+
+    auto queue = std::make_shared<MessageQueue<Message::Message*>>();
+
+    std::vector<uint16_t> handled;
+    std::map<TcpConnection*, uint32_t> nextSequence;
+    int errors = 0;
+
+    TickLoop loop(queue, [&](Message::Message& message)
+    {
+        Message::Packet& packet = static_cast<Message::Packet&>(message);
+        TcpConnection *pConnection = packet.GetConnectionHandle().Get();
+
+        // Each connection keeps its order.
+        if(nextSequence[pConnection]++ != packet.GetPacket().ReadU32Little())
+        {
+            errors++;
+        }
+
+        handled.push_back(packet.GetCommandCode());
+    });
+
+    // Every connection sends command 1 then command 2.
+    for(auto connection : { first, second, third })
+    {
+        QueueCommand(*queue, connection, 1, 0);
+        QueueCommand(*queue, connection, 2, 1);
+    }
+
+    EXPECT_EQ(6u, loop.Tick());
+    EXPECT_EQ(0, errors);
+    EXPECT_EQ(std::vector<uint16_t>({ 1, 1, 1, 2, 2, 2 }), handled);
+
+    // A command 1 behind a command 2 has to wait for it.
+    handled.clear();
+    QueueCommand(*queue, first, 2, 2);
+    QueueCommand(*queue, first, 1, 3);
+    QueueCommand(*queue, second, 1, 2);
+
+    EXPECT_EQ(3u, loop.Tick());
+    EXPECT_EQ(0, errors);
+    EXPECT_EQ(std::vector<uint16_t>({ 1, 2, 1 }), handled);
+
+    // Nothing is waiting for the next tick.
+    EXPECT_EQ(0u, loop.Tick());
+
+    TickStats_t stats = loop.GetStats();
+    EXPECT_EQ(3u, stats.ticks);
+    EXPECT_EQ(9u, stats.messages);
+}
+
+TEST(TickLoop, Thread)
+{
+    auto queue = std::make_shared<MessageQueue<Message::Message*>>();
+    std::atomic<int> handled(0);
+
+    TickLoop loop(queue, [&handled](Message::Message&)
+    {
+        handled++;
+    }, 5);
+
+    EXPECT_TRUE(loop.Start());
+    EXPECT_FALSE(loop.Start());
+
+    for(int i = 0; i < 10; ++i)
+    {
+        queue->Enqueue(new Message::Message);
+    }
+
+    // The null stop signal of a queue is skipped.
+    queue->Enqueue(nullptr);
+
+    for(int i = 0; i < 200 && 10 > handled; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    queue->Enqueue(new Message::Message);
+
+    // Stopping handles what is left.
+    loop.Stop();
+
+    EXPECT_EQ(11, handled);
+    EXPECT_LE(2u, loop.GetStats().ticks);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,150 @@
+/**
+ * @file libcomp/tests/TimerWheel.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the TimerWheel class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <TimerWheel.h>
+
+#include <vector>
+
+using namespace libcomp;
+
+TEST(TimerWheel, FiresAfterDelay)
+{
+    TimerWheel wheel(10, 1000);
+    TimerWheel::Timer timer;
+
+    int fired = 0;
+
+    wheel.Arm(timer, 25, [&fired]() { fired++; });
+
+    EXPECT_TRUE(timer.IsArmed());
+
+    wheel.Advance(1020);
+    EXPECT_EQ(fired, 0);
+
+    wheel.Advance(1030);
+    EXPECT_EQ(fired, 1);
+    EXPECT_FALSE(timer.IsArmed());
+
+    wheel.Advance(5000);
+    EXPECT_EQ(fired, 1);
+}
+
+TEST(TimerWheel, Cancel)
+{
+    TimerWheel wheel(10);
+
+    int fired = 0;
+
+    {
+        TimerWheel::Timer destroyed;
+        wheel.Arm(destroyed, 50, [&fired]() { fired++; });
+    }
+
+    TimerWheel::Timer timer;
+    wheel.Arm(timer, 50, [&fired]() { fired++; });
+    timer.Cancel();
+
+    EXPECT_FALSE(timer.IsArmed());
+
+    wheel.Advance(1000);
+    EXPECT_EQ(fired, 0);
+}
+
+TEST(TimerWheel, OuterWheels)
+{
+    TimerWheel wheel(1);
+
+    // One delay per wheel (and one past the last one).
+    std::vector<uint64_t> delays = { 5, 63, 64, 100, 4095, 4096, 5000,
+        300000, 20000000 };
+    std::vector<uint64_t> firedAt(delays.size(), 0);
+    std::vector<TimerWheel::Timer> timers(delays.size());
+
+    for(size_t i = 0; i < delays.size(); ++i)
+    {
+        wheel.Arm(timers[i], delays[i], [&wheel, &firedAt, i]()
+        {
+            firedAt[i] = wheel.Now();
+        });
+    }
+
+    // Step in uneven jumps like a real tick would.
+    for(uint64_t now = 0; now <= 20000100; now += 7)
+    {
+        wheel.Advance(now);
+    }
+
+    for(size_t i = 0; i < delays.size(); ++i)
+    {
+        EXPECT_GE(firedAt[i], delays[i]) << "delay " << delays[i];
+        EXPECT_LT(firedAt[i], delays[i] + 7) << "delay " << delays[i];
+    }
+}
+
+TEST(TimerWheel, RearmFromCallback)
+{
+    TimerWheel wheel(10);
+    TimerWheel::Timer timer;
+
+    int fired = 0;
+
+    std::function<void()> callback;
+    callback = [&]()
+    {
+        if(3 > ++fired)
+        {
+            wheel.Arm(timer, 100, callback);
+        }
+    };
+
+    wheel.Arm(timer, 100, callback);
+
+    for(uint64_t now = 0; now <= 1000; now += 10)
+    {
+        wheel.Advance(now);
+    }
+
+    EXPECT_EQ(fired, 3);
+    EXPECT_FALSE(timer.IsArmed());
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,141 @@
+/**
+ * @file libcomp/tests/Tracer.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the Tracer class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Constants.h>
+#include <Tracer.h>
+
+// Standard C++11 Includes
+#include <string>
+#include <thread>
+
+using namespace libcomp;
+
+/**
+ * Count how many times some text is found in a string.
+ * @param text String to search.
+ * @param find Text to count.
+ * @returns Number of times @em find is in @em text.
+ */
+static size_t Count(const std::string& text, const std::string& find)
+{
+    size_t count = 0;
+
+    for(size_t i = text.find(find); std::string::npos != i;
+        i = text.find(find, i + 1))
+    {
+        count++;
+    }
+
+    return count;
+}
+
+TEST(Tracer, Spans)
+{
+    Tracer *pTracer = Tracer::GetSingletonPtr();
+    pTracer->Clear();
+
+    // Nothing is recorded while tracing is off.
+    {
+        Tracer::Scope scope("off");
+    }
+
+    pTracer->SetEnabled(true);
+
+    {
+        Tracer::Scope outer("outer");
+        Tracer::Scope inner("inner");
+    }
+
+    std::thread thread([]()
+    {
+        Tracer::Scope scope("other");
+    });
+
+    thread.join();
+
+    pTracer->SetEnabled(false);
+
+    std::string json = pTracer->ExportChromeJson().ToUtf8();
+
+    EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+    EXPECT_EQ(0u, Count(json, "\"off\""));
+    EXPECT_EQ(2u, Count(json, "\"outer\""));
+    EXPECT_EQ(2u, Count(json, "\"inner\""));
+    EXPECT_EQ(2u, Count(json, "\"other\""));
+    EXPECT_EQ(3u, Count(json, "\"ph\":\"B\""));
+    EXPECT_EQ(3u, Count(json, "\"ph\":\"E\""));
+
+    // Spans are nested in the order they began.
+    EXPECT_LT(json.find("\"outer\""), json.find("\"inner\""));
+
+    pTracer->Clear();
+    EXPECT_EQ(0u, Count(pTracer->ExportChromeJson().ToUtf8(), "\"ph\""));
+}
+
+TEST(Tracer, Overwrite)
+{
+    Tracer *pTracer = Tracer::GetSingletonPtr();
+    pTracer->Clear();
+    pTracer->SetEnabled(true);
+
+    // The begin of the outer span is overwritten so its end is dropped.
+    pTracer->Begin("lost");
+
+    for(int i = 0; i < TRACE_BUFFER_EVENTS; ++i)
+    {
+        pTracer->Begin("span");
+        pTracer->End("span");
+    }
+
+    pTracer->End("lost");
+    pTracer->SetEnabled(false);
+
+    std::string json = pTracer->ExportChromeJson().ToUtf8();
+
+    EXPECT_EQ(0u, Count(json, "\"lost\""));
+    EXPECT_EQ(Count(json, "\"ph\":\"B\""), Count(json, "\"ph\":\"E\""));
+    EXPECT_GE((size_t)TRACE_BUFFER_EVENTS, Count(json, "\"ph\""));
+
+    pTracer->Clear();
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
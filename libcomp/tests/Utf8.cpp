@@ -0,0 +1,161 @@
+/**
+ * @file libcomp/tests/Utf8.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the UTF-8 and ASCII helpers.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <Convert.h>
+#include <Utf8.h>
+
+#include <vector>
+
+using namespace libcomp;
+
+static size_t ScalarCount(const char *pData, size_t size)
+{
+    size_t count = 0;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        if(0x80 != (pData[i] & 0xC0))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static size_t ScalarRun(const uint8_t *pData, size_t size)
+{
+    size_t i = 0;
+
+    while(i < size && 0 != pData[i] && 0x80 > pData[i])
+    {
+        i++;
+    }
+
+    return i;
+}
+
+TEST(Utf8, CountCodePoints)
+{
+    std::vector<char> data;
+
+    // Long enough to flush the vector counters more than once.
+    for(size_t i = 0; i < 16 * 600; ++i)
+    {
+        data.push_back((char)((i * 131u + 7u) & 0xFF));
+    }
+
+    for(size_t offset = 0; offset < 16; ++offset)
+    {
+        for(size_t size : { 0, 1, 15, 16, 17, 33, 255, 4096, 4080 + 1000 })
+        {
+            ASSERT_EQ(ScalarCount(&data[offset], size),
+                Utf8::CountCodePoints(&data[offset], size));
+        }
+    }
+
+    EXPECT_EQ(4, Utf8::CountCodePoints(u8"aéあ\U0001F600", 10));
+}
+
+TEST(Utf8, AsciiRun)
+{
+    std::vector<uint8_t> data(100, 'x');
+
+    for(size_t stop = 0; stop < 64; ++stop)
+    {
+        for(int value : { 0x00, 0x80, 0xFF })
+        {
+            std::vector<uint8_t> copy = data;
+            copy[stop] = (uint8_t)value;
+
+            for(size_t size : { stop, stop + 1, (size_t)64, (size_t)100 })
+            {
+                ASSERT_EQ(ScalarRun(&copy[0], size),
+                    Utf8::AsciiRun(&copy[0], size));
+            }
+        }
+    }
+
+    EXPECT_EQ(100, Utf8::AsciiRun(&data[0], data.size()));
+}
+
+TEST(Utf8, Encode)
+{
+    for(uint32_t cp : { 0x24u, 0x7Fu, 0xA2u, 0x7FFu, 0x20ACu, 0xFFFFu,
+        0x10348u })
+    {
+        char bytes[4];
+        size_t size = Utf8::Encode(cp, bytes);
+
+        EXPECT_EQ(String(bytes, size).At(0), cp);
+        EXPECT_EQ(1, Utf8::CountCodePoints(bytes, size));
+    }
+}
+
+TEST(Utf8, ConvertMixed)
+{
+    // Long ASCII runs with CP-1252 bytes in between.
+    std::string cp1252;
+
+    for(int i = 0; i < 20; ++i)
+    {
+        cp1252 += "The quick brown fox ";
+        cp1252 += (char)0x80;
+    }
+
+    String utf8 = Convert::FromEncoding(Convert::ENCODING_CP1252,
+        cp1252.c_str());
+
+    EXPECT_EQ(cp1252.size(), utf8.Length());
+    EXPECT_EQ(0x20AC, utf8.At(20));
+
+    std::vector<char> back = Convert::ToEncoding(Convert::ENCODING_CP1252,
+        utf8, false);
+
+    EXPECT_EQ(cp1252, std::string(back.begin(), back.end()));
+
+    // Size limited conversion stops in the middle of an ASCII run.
+    EXPECT_EQ(String("The qu"), Convert::FromEncoding(
+        Convert::ENCODING_CP1252, cp1252.c_str(), 6));
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
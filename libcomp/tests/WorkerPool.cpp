@@ -0,0 +1,104 @@
+/**
+ * @file libcomp/tests/WorkerPool.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the WorkerPool class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <WorkerPool.h>
+
+#include <atomic>
+
+using namespace libcomp;
+
+TEST(WorkerPool, RunsJobs)
+{
+    std::atomic<int> count(0);
+
+    {
+        WorkerPool pool(2, 100);
+
+        EXPECT_EQ(pool.GetThreadCount(), 2);
+
+        for(int i = 0; i < 50; ++i)
+        {
+            ASSERT_TRUE(pool.Submit([&count]()
+            {
+                count++;
+            }));
+        }
+
+        while(50 > pool.GetStats().completed)
+        {
+            std::this_thread::yield();
+        }
+
+        EXPECT_EQ(pool.GetStats().rejected, 0);
+    }
+
+    EXPECT_EQ(count, 50);
+}
+
+TEST(WorkerPool, BoundedQueue)
+{
+    WorkerPool pool(1, 1);
+
+    std::atomic<bool> release(false);
+
+    // Block the only worker.
+    ASSERT_TRUE(pool.Submit([&release]()
+    {
+        while(!release)
+        {
+            std::this_thread::yield();
+        }
+    }));
+
+    while(0 < pool.GetStats().queued)
+    {
+        std::this_thread::yield();
+    }
+
+    EXPECT_TRUE(pool.Submit([](){ }));
+    EXPECT_FALSE(pool.Submit([](){ }));
+    EXPECT_EQ(pool.GetStats().rejected, 1);
+
+    release = true;
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
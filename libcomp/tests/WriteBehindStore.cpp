@@ -0,0 +1,204 @@
+/**
+ * @file libcomp/tests/WriteBehindStore.cpp
+ * @ingroup libcomp
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the WriteBehindStore class.
+ *
+ * This file is part of the COMP_hack Library (libcomp).
+ *
+ * Copyright (C) 2014-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <DatabaseSQLite3.h>
+#include <WriteBehindStore.h>
+
+using namespace libcomp;
+
+/**
+ * Make a pool with a single in memory database holding a characters table.
+ * @param pDatabase Set to the database so it may be checked.
+ * @returns Pool that always hands out the one database.
+ */
+static std::shared_ptr<DatabasePool> MakePool(
+    std::shared_ptr<Database>& database)
+{
+    database.reset(new DatabaseSQLite3);
+
+    if(!database->Open(":memory:") || !database->Execute("CREATE TABLE "
+        "characters ( id TEXT, x TEXT, y TEXT, quests TEXT );") ||
+        !database->Execute("INSERT INTO characters ( id ) VALUES "
+        "( 'alice' ), ( 'bob' );"))
+    {
+        database.reset();
+    }
+
+    std::shared_ptr<Database> db = database;
+
+    return std::make_shared<DatabasePool>([db]()
+    {
+        return db;
+    }, 1);
+}
+
+/**
+ * Read one column of a character from the database.
+ * @param db Database to read.
+ * @param id ID of the character.
+ * @param column Column to read.
+ * @returns Value of the column.
+ */
+static String ReadColumn(const std::shared_ptr<Database>& db,
+    const String& id, const String& column)
+{
+    DatabaseQuery q = db->Prepare(String("SELECT %1 FROM characters WHERE "
+        "id = ?;").Arg(column));
+
+    const char *szText = nullptr;
+    size_t size = 0;
+
+    if(q.Bind(0, id) && q.Execute() && q.Next() && q.GetText(0, szText,
+        size) && nullptr != szText)
+    {
+        return String(szText, size);
+    }
+
+    return String();
+}
+
+TEST(WriteBehindStore, CollapsesWrites)
+{
+    std::shared_ptr<Database> db;
+    auto pool = MakePool(db);
+    ASSERT_NE(db, nullptr);
+
+    WriteBehindStore store(pool, "characters", "id", { "x", "y", "quests" });
+
+    EXPECT_EQ(store.GetField("y"), 1);
+    EXPECT_EQ(store.GetField("z"), 3);
+
+    EXPECT_TRUE(store.Load("bob", { "5", "6", "" }));
+    EXPECT_FALSE(store.Load("bob", { "7" }));
+    EXPECT_EQ(store.GetDirtyCount(), 0);
+
+    // Many moves are one write.
+    for(int i = 0; i < 100; ++i)
+    {
+        EXPECT_TRUE(store.Set("alice", 0, String("%1").Arg(i)));
+        EXPECT_TRUE(store.Set("alice", 1, String("%1").Arg(-i)));
+    }
+
+    EXPECT_FALSE(store.Set("alice", 3, "bad"));
+    EXPECT_EQ(store.GetDirtyCount(), 1);
+    EXPECT_EQ(ReadColumn(db, "alice", "x"), String());
+
+    String value;
+    EXPECT_TRUE(store.Get("alice", 0, value));
+    EXPECT_EQ(value, String("99"));
+    EXPECT_TRUE(store.Get("bob", 1, value));
+    EXPECT_EQ(value, String("6"));
+
+    EXPECT_TRUE(store.Flush());
+    EXPECT_EQ(store.GetDirtyCount(), 0);
+    EXPECT_EQ(ReadColumn(db, "alice", "x"), String("99"));
+    EXPECT_EQ(ReadColumn(db, "alice", "y"), String("-99"));
+
+    WriteBehindStats_t stats = store.GetStats();
+    EXPECT_EQ(stats.updates, 200);
+    EXPECT_EQ(stats.collapsed, 198);
+    EXPECT_EQ(stats.written, 2);
+    EXPECT_EQ(stats.flushes, 1);
+    EXPECT_EQ(stats.failures, 0);
+
+    // Nothing dirty is nothing written.
+    EXPECT_TRUE(store.Flush());
+    EXPECT_EQ(store.GetStats().written, 2);
+
+    // Logging out writes right away and forgets the entity.
+    EXPECT_TRUE(store.Set("bob", 2, "ff00"));
+    EXPECT_TRUE(store.Release("bob"));
+    EXPECT_FALSE(store.Release("bob"));
+    EXPECT_EQ(ReadColumn(db, "bob", "quests"), String("ff00"));
+    EXPECT_FALSE(store.Get("bob", 2, value));
+    EXPECT_EQ(store.Count(), 1);
+}
+
+TEST(WriteBehindStore, Background)
+{
+    std::shared_ptr<Database> db;
+    auto pool = MakePool(db);
+    ASSERT_NE(db, nullptr);
+
+    {
+        WriteBehindStore store(pool, "characters", "id", { "x" },
+            std::chrono::milliseconds(10));
+        store.Start();
+
+        EXPECT_TRUE(store.Set("alice", 0, "1"));
+
+        auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        while(0 == store.GetStats().written &&
+            std::chrono::steady_clock::now() < end)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        EXPECT_EQ(store.GetStats().written, 1);
+
+        // Stopping writes what is left.
+        EXPECT_TRUE(store.Set("bob", 0, "2"));
+    }
+
+    EXPECT_EQ(ReadColumn(db, "alice", "x"), String("1"));
+    EXPECT_EQ(ReadColumn(db, "bob", "x"), String("2"));
+}
+
+TEST(WriteBehindStore, FailedWriteIsKept)
+{
+    std::shared_ptr<Database> db;
+    auto pool = MakePool(db);
+    ASSERT_NE(db, nullptr);
+
+    // There is no such column so the write fails.
+    WriteBehindStore store(pool, "characters", "id", { "missing" });
+
+    EXPECT_TRUE(store.Set("alice", 0, "1"));
+    EXPECT_FALSE(store.Flush());
+    EXPECT_EQ(store.GetDirtyCount(), 1);
+    EXPECT_EQ(store.GetStats().failures, 1);
+    EXPECT_FALSE(store.Release("alice"));
+    EXPECT_EQ(store.Count(), 1);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
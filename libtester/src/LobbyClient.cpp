@@ -4,7 +4,7 @@
  *
  * @author COMP Omega <compomega@tutanota.com>
  *
- * @brief Class to create a lobby test connection.
+ * @brief Load generator that drives many lobby test connections.
  *
  * This file is part of the COMP_hack Tester Library (libtester).
  *
@@ -26,8 +26,436 @@
 
 #include "LobbyClient.h"
 
+// libcomp Includes
+#include <CommandProfiler.h>
+#include <Log.h>
+#include <MessagePacket.h>
+
+// Standard C++11 Includes
+#include <algorithm>
+#include <deque>
+
 using namespace libtester;
 
-LobbyClient::LobbyClient()
+/// Milliseconds between two rounds of requests on a worker.
+static const int TICK_INTERVAL = 10;
+
+/// Longest time the sessions are given to finish the handshake.
+static const std::chrono::seconds HANDSHAKE_WAIT(30);
+
+/**
+ * @internal
+ * Client role connection that reports back to the load generator.
+ */
+class LobbyClient::Session : public libcomp::LobbyConnection
+{
+public:
+    Session(LobbyClient& client, asio::io_service& service) :
+        libcomp::LobbyConnection(service), mClient(client),
+        mEncrypted(false), mFinished(false)
+    {
+    }
+
+    bool Start(const libcomp::String& host, int port)
+    {
+        mStart = std::chrono::steady_clock::now();
+
+        return Connect(host, port);
+    }
+
+    bool IsEncrypted() const
+    {
+        return mEncrypted && !mFinished;
+    }
+
+    void Send(const ScriptedCommand_t& command)
+    {
+        if(command.expectReply)
+        {
+            std::lock_guard<std::mutex> guard(mRequestLock);
+            mRequests.push_back(std::chrono::steady_clock::now());
+        }
+
+        SendEncrypted(command.commandCode, command.data.empty() ?
+            nullptr : &command.data[0], (uint16_t)command.data.size());
+    }
+
+    bool PopRequest(std::chrono::steady_clock::time_point& sent)
+    {
+        std::lock_guard<std::mutex> guard(mRequestLock);
+
+        if(mRequests.empty())
+        {
+            return false;
+        }
+
+        sent = mRequests.front();
+        mRequests.pop_front();
+
+        return true;
+    }
+
+    void Close()
+    {
+        if(!mFinished)
+        {
+            mFinished = true;
+            SocketError();
+        }
+    }
+
+protected:
+    virtual void ConnectionEncrypted()
+    {
+        libcomp::LobbyConnection::ConnectionEncrypted();
+
+        mEncrypted = true;
+
+        std::lock_guard<std::mutex> guard(mClient.mLock);
+        mClient.mReport.sessionsEncrypted++;
+        mClient.AddSample(mClient.mHandshakeSamples, mStart);
+    }
+
+    virtual void ConnectionFailed()
+    {
+        libcomp::LobbyConnection::ConnectionFailed();
+
+        Failed();
+    }
+
+    virtual void SocketError(const libcomp::String& errorMessage =
+        libcomp::String())
+    {
+        libcomp::LobbyConnection::SocketError(errorMessage);
+
+        Failed();
+    }
+
+private:
+    void Failed()
+    {
+        // Sessions closed at the end of the run do not count.
+        if(!mFinished)
+        {
+            mFinished = true;
+
+            std::lock_guard<std::mutex> guard(mClient.mLock);
+            mClient.mReport.sessionsFailed++;
+        }
+    }
+
+    LobbyClient& mClient;
+
+    std::chrono::steady_clock::time_point mStart;
+    std::atomic<bool> mEncrypted;
+    std::atomic<bool> mFinished;
+
+    /// Send time of each request still waiting for a reply.
+    std::deque<std::chrono::steady_clock::time_point> mRequests;
+    std::mutex mRequestLock;
+};
+
+LobbyClient::LobbyClient(const libcomp::String& host, int port,
+    size_t ioThreads) : mHost(host), mPort(port), mTickCredit(0),
+    mReplies(std::make_shared<libcomp::MessageQueue<
+    libcomp::Message::Message*>>()), mRunning(false)
+{
+    for(size_t i = 0; i < (0 < ioThreads ? ioThreads : 1); ++i)
+    {
+        mWorkers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+}
+
+LobbyClient::~LobbyClient()
+{
+}
+
+void LobbyClient::SetScript(const std::vector<ScriptedCommand_t>& script)
+{
+    mScript = script;
+}
+
+LobbyClient::Report_t LobbyClient::Run(size_t sessions, double requestRate,
+    std::chrono::milliseconds duration)
+{
+    mReport = Report_t();
+    mHandshakeSamples.clear();
+    mRequestSamples.clear();
+    mTickCredit = requestRate * TICK_INTERVAL / 1000.0 /
+        (double)mWorkers.size();
+    mRunning = true;
+
+    for(auto& worker : mWorkers)
+    {
+        Worker *pWorker = worker.get();
+
+        pWorker->service.reset();
+        pWorker->work.reset(new asio::io_service::work(pWorker->service));
+        pWorker->timer.reset(new asio::steady_timer(pWorker->service));
+        pWorker->sessions.clear();
+        pWorker->credit = 0;
+        pWorker->nextSession = 0;
+        pWorker->nextCommand = 0;
+        pWorker->thread = std::thread([pWorker]()
+        {
+            pWorker->service.run();
+        });
+    }
+
+    std::thread replyThread([this]()
+    {
+        ReadReplies();
+    });
+
+    // Open every session at once (spread over the workers).
+    for(size_t i = 0; i < sessions; ++i)
+    {
+        Worker& worker = *mWorkers[i % mWorkers.size()];
+
+        std::shared_ptr<Session> session = std::make_shared<Session>(*this,
+            worker.service);
+        session->SetSelf(session);
+        session->SetMessageQueue(mReplies);
+
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+            mReport.sessionsStarted++;
+        }
+
+        if(!session->Start(mHost, mPort))
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+            mReport.sessionsFailed++;
+
+            continue;
+        }
+
+        worker.service.post([&worker, session]()
+        {
+            worker.sessions.push_back(session);
+        });
+    }
+
+    // Give the handshakes time to finish before the timed part starts.
+    auto handshakeStart = std::chrono::steady_clock::now();
+
+    while(HANDSHAKE_WAIT > (std::chrono::steady_clock::now() -
+        handshakeStart))
+    {
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+
+            if(mReport.sessionsStarted <= (mReport.sessionsEncrypted +
+                mReport.sessionsFailed))
+            {
+                break;
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(
+            TICK_INTERVAL));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    if(!mScript.empty())
+    {
+        for(auto& worker : mWorkers)
+        {
+            Worker *pWorker = worker.get();
+
+            pWorker->service.post([this, pWorker]()
+            {
+                Tick(*pWorker);
+            });
+        }
+    }
+
+    std::this_thread::sleep_for(duration);
+
+    mRunning = false;
+
+    // Let the last replies arrive before the sessions are closed.
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        10 * TICK_INTERVAL));
+
+    mReport.elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    for(auto& worker : mWorkers)
+    {
+        Worker *pWorker = worker.get();
+
+        pWorker->service.post([pWorker]()
+        {
+            pWorker->timer->cancel();
+
+            for(auto session : pWorker->sessions)
+            {
+                session->Close();
+            }
+
+            pWorker->sessions.clear();
+        });
+
+        pWorker->work.reset();
+    }
+
+    for(auto& worker : mWorkers)
+    {
+        worker->thread.join();
+    }
+
+    // Stop the reply thread once everything has been read.
+    mReplies->Enqueue(nullptr);
+    replyThread.join();
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    mReport.handshake = Summarize(mHandshakeSamples);
+    mReport.request = Summarize(mRequestSamples);
+
+    return mReport;
+}
+
+libcomp::String LobbyClient::FormatReport(const Report_t& report)
 {
+    double elapsed = 0 < report.elapsed ? report.elapsed : 1;
+
+    return libcomp::String("Sessions: %1 started, %2 encrypted, %3 failed\n"
+        "Requests: %4 sent, %5 replies in %6 ms (%7 requests/s)\n"
+        "Handshake (us): p50 %8 p90 %9 p99 %10 max %11\n"
+        "Request (us): p50 %12 p90 %13 p99 %14 max %15\n").Arg(
+        report.sessionsStarted).Arg(report.sessionsEncrypted).Arg(
+        report.sessionsFailed).Arg(report.requestsSent).Arg(
+        report.repliesReceived).Arg((uint64_t)(report.elapsed * 1000)).Arg(
+        (uint64_t)((double)report.requestsSent / elapsed)).Arg(
+        report.handshake.p50).Arg(report.handshake.p90).Arg(
+        report.handshake.p99).Arg(report.handshake.max).Arg(
+        report.request.p50).Arg(report.request.p90).Arg(
+        report.request.p99).Arg(report.request.max);
+}
+
+void LobbyClient::Tick(Worker& worker)
+{
+    if(!mRunning)
+    {
+        return;
+    }
+
+    // Do not let a stalled worker build up a huge burst of requests.
+    worker.credit = std::min(worker.credit + mTickCredit,
+        10 * mTickCredit + 1);
+
+    uint64_t sent = 0;
+
+    while(1 <= worker.credit && !worker.sessions.empty())
+    {
+        std::shared_ptr<Session> session;
+
+        // Find the next session that is ready for requests.
+        for(size_t i = 0; i < worker.sessions.size() && !session; ++i)
+        {
+            auto& candidate = worker.sessions[worker.nextSession];
+            worker.nextSession = (worker.nextSession + 1) %
+                worker.sessions.size();
+
+            if(candidate->IsEncrypted())
+            {
+                session = candidate;
+            }
+        }
+
+        if(!session)
+        {
+            break;
+        }
+
+        session->Send(mScript[worker.nextCommand]);
+        worker.nextCommand = (worker.nextCommand + 1) % mScript.size();
+        worker.credit -= 1;
+        sent++;
+    }
+
+    if(0 < sent)
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mReport.requestsSent += sent;
+    }
+
+    worker.timer->expires_from_now(std::chrono::milliseconds(
+        TICK_INTERVAL));
+    worker.timer->async_wait([this, &worker](asio::error_code error)
+    {
+        if(!error)
+        {
+            Tick(worker);
+        }
+    });
+}
+
+void LobbyClient::ReadReplies()
+{
+    while(true)
+    {
+        libcomp::Message::Handle message(mReplies->Dequeue());
+
+        if(!message)
+        {
+            break;
+        }
+
+        libcomp::Message::Packet *pPacket = dynamic_cast<
+            libcomp::Message::Packet*>(message.get());
+
+        if(nullptr == pPacket)
+        {
+            continue;
+        }
+
+        libcomp::CommandProfiler::HandlerScope profile(
+            pPacket->GetCommandCode());
+
+        std::shared_ptr<Session> session = std::dynamic_pointer_cast<
+            Session>(pPacket->GetConnection());
+        std::chrono::steady_clock::time_point sent;
+
+        std::lock_guard<std::mutex> guard(mLock);
+        mReport.repliesReceived++;
+
+        if(session && session->PopRequest(sent))
+        {
+            AddSample(mRequestSamples, sent);
+        }
+    }
+}
+
+void LobbyClient::AddSample(std::vector<uint64_t>& samples,
+    std::chrono::steady_clock::time_point start)
+{
+    samples.push_back((uint64_t)std::chrono::duration_cast<
+        std::chrono::microseconds>(std::chrono::steady_clock::now() -
+        start).count());
+}
+
+LobbyClient::Latency_t LobbyClient::Summarize(std::vector<uint64_t>& samples)
+{
+    Latency_t latency = Latency_t();
+    latency.count = samples.size();
+
+    if(samples.empty())
+    {
+        return latency;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    size_t last = samples.size() - 1;
+
+    latency.p50 = samples[last * 50 / 100];
+    latency.p90 = samples[last * 90 / 100];
+    latency.p99 = samples[last * 99 / 100];
+    latency.max = samples[last];
+
+    return latency;
 }
@@ -4,7 +4,7 @@
  *
  * @author COMP Omega <compomega@tutanota.com>
  *
- * @brief Class to create a lobby test connection.
+ * @brief Load generator that drives many lobby test connections.
  *
  * This file is part of the COMP_hack Tester Library (libtester).
  *
@@ -27,13 +27,180 @@
 #ifndef LIBTESTER_SRC_LOBBYCLIENT_H
 #define LIBTESTER_SRC_LOBBYCLIENT_H
 
+// libcomp Includes
+#include <LobbyConnection.h>
+#include <MessageQueue.h>
+#include <String.h>
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace libtester
 {
 
+/**
+ * Load generator for the lobby server. Many client role LobbyConnection
+ * sessions are opened over several io threads. Each completes the
+ * Diffie-Hellman and Blowfish handshake and then the sessions share a
+ * scripted mix of commands sent at a target rate. Handshake and request
+ * latency (request to reply) are reported as percentiles along with the
+ * throughput of the run.
+ */
 class LobbyClient
 {
 public:
-    LobbyClient();
+    /**
+     * Command sent by the sessions. The script is replayed in order over
+     * and over (each request goes to the next session in turn).
+     */
+    typedef struct
+    {
+        /// Code of the command.
+        uint16_t commandCode;
+
+        /// Command data (without the command header).
+        std::vector<char> data;
+
+        /// Indicates the server answers this command with one reply.
+        bool expectReply;
+    } ScriptedCommand_t;
+
+    /**
+     * Latency distribution (in microseconds).
+     */
+    typedef struct
+    {
+        uint64_t count;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t max;
+    } Latency_t;
+
+    /**
+     * Results of a run.
+     */
+    typedef struct
+    {
+        /// Number of sessions that were started.
+        uint64_t sessionsStarted;
+
+        /// Number of sessions that finished the handshake.
+        uint64_t sessionsEncrypted;
+
+        /// Number of sessions that failed or were closed by the server.
+        uint64_t sessionsFailed;
+
+        /// Number of commands sent.
+        uint64_t requestsSent;
+
+        /// Number of commands received.
+        uint64_t repliesReceived;
+
+        /// Seconds the run took.
+        double elapsed;
+
+        /// Time from connecting to the connection being encrypted.
+        Latency_t handshake;
+
+        /// Time from sending a command to its reply.
+        Latency_t request;
+    } Report_t;
+
+    /**
+     * Create a new load generator.
+     * @param host Host of the lobby server.
+     * @param port Port of the lobby server.
+     * @param ioThreads Number of threads running the sessions.
+     */
+    LobbyClient(const libcomp::String& host, int port,
+        size_t ioThreads = 4);
+    ~LobbyClient();
+
+    /**
+     * Set the commands sent by the sessions. Without a script the sessions
+     * only do the handshake.
+     * @param script Commands to send in order.
+     */
+    void SetScript(const std::vector<ScriptedCommand_t>& script);
+
+    /**
+     * Open the sessions, send the script for a while and close them again.
+     * This blocks until the run is over.
+     * @param sessions Number of concurrent sessions.
+     * @param requestRate Commands sent each second (over all sessions).
+     * @param duration How long to send commands for once the sessions have
+     *   had time to connect.
+     * @returns Results of the run.
+     */
+    Report_t Run(size_t sessions, double requestRate,
+        std::chrono::milliseconds duration);
+
+    /**
+     * Format a report for the log.
+     * @param report Report to format.
+     * @returns Multi-line summary of the report.
+     */
+    static libcomp::String FormatReport(const Report_t& report);
+
+private:
+    class Session;
+
+    /**
+     * @internal
+     * io thread and the sessions it runs.
+     */
+    class Worker
+    {
+    public:
+        asio::io_service service;
+        std::unique_ptr<asio::io_service::work> work;
+        std::unique_ptr<asio::steady_timer> timer;
+        std::vector<std::shared_ptr<Session>> sessions;
+        std::thread thread;
+
+        /// Requests this worker may send (grows with time).
+        double credit;
+
+        /// Next session and command to send.
+        size_t nextSession;
+        size_t nextCommand;
+    };
+
+    void Tick(Worker& worker);
+    void ReadReplies();
+
+    void AddSample(std::vector<uint64_t>& samples,
+        std::chrono::steady_clock::time_point start);
+
+    static Latency_t Summarize(std::vector<uint64_t>& samples);
+
+    libcomp::String mHost;
+    int mPort;
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::vector<ScriptedCommand_t> mScript;
+
+    /// Requests each worker gets per tick of its timer.
+    double mTickCredit;
+
+    /// Replies from every session (read by @ref ReadReplies).
+    std::shared_ptr<libcomp::MessageQueue<
+        libcomp::Message::Message*>> mReplies;
+
+    /// Lock for the counters and samples.
+    std::mutex mLock;
+
+    std::atomic<bool> mRunning;
+    Report_t mReport;
+    std::vector<uint64_t> mHandshakeSamples;
+    std::vector<uint64_t> mRequestSamples;
 };
 
 } // namespace libtester
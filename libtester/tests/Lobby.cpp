@@ -28,6 +28,7 @@
 #include <gtest/gtest.h>
 #include <PopIgnore.h>
 
+#include <LobbyClient.h>
 #include <LobbyConnection.h>
 #include <Log.h>
 
@@ -59,6 +60,26 @@ TEST(Lobby, Connection)
     serviceThread.join();
 }
 
+TEST(Lobby, Load)
+{
+    libtester::LobbyClient client("127.0.0.1", 10666, 4);
+
+    libtester::LobbyClient::ScriptedCommand_t command;
+    command.commandCode = 0x0003;
+    command.data.assign(4, 0);
+    command.expectReply = false;
+
+    client.SetScript({ command });
+
+    libtester::LobbyClient::Report_t report = client.Run(64, 500,
+        std::chrono::seconds(10));
+
+    LOG_INFO(libtester::LobbyClient::FormatReport(report));
+
+    EXPECT_EQ(report.sessionsStarted, 64U);
+    EXPECT_EQ(report.sessionsEncrypted, 64U);
+}
+
 int main(int argc, char *argv[])
 {
     try
@@ -29,29 +29,45 @@
 // lobby Includes
 #include "LobbyConnection.h"
 
+// libcomp Includes
+#include <Constants.h>
+
 using namespace lobby;
 
 LobbyServer::LobbyServer(libcomp::String listenAddress, int port) :
-    libcomp::TcpServer(listenAddress, port)
+    libcomp::TcpServer(listenAddress, port), mCryptoPool(
+    new libcomp::WorkerPool(0, MAX_PENDING_HANDSHAKES))
 {
+    // The client starts the handshake so there is no need to wake up for a
+    // connection until it has sent something.
+    libcomp::SocketOptions_t options = GetSocketOptions();
+    options.deferAccept = TIMEOUT_DEFER_ACCEPT;
+
+    SetSocketOptions(options);
 }
 
 LobbyServer::~LobbyServer()
 {
+    // Connections keep the pool alive so stop it before they are destroyed.
+    mCryptoPool->Stop();
 }
 
 std::shared_ptr<libcomp::TcpConnection> LobbyServer::CreateConnection(
     asio::ip::tcp::socket& socket)
 {
-    auto connection = std::shared_ptr<libcomp::TcpConnection>(
-        new libcomp::LobbyConnection(socket, CopyDiffieHellman(
-            GetDiffieHellman())
-        )
+    auto lobbyConnection = std::shared_ptr<libcomp::LobbyConnection>(
+        new libcomp::LobbyConnection(socket, TakeDiffieHellman())
     );
 
-    // Make sure this is called after connecting.
-    connection->SetSelf(connection);
-    connection->ConnectionSuccess();
+    lobbyConnection->SetCryptoPool(mCryptoPool);
+
+    std::shared_ptr<libcomp::TcpConnection> connection = lobbyConnection;
+
+    // Parse as many frames as the socket has per read. Most connections are
+    // idle so the ring buffer is only taken from a pool while data is
+    // waiting to be parsed.
+    connection->SetReceiveOnDemand(true);
 
+    // TcpServer starts the connection once it has been registered.
     return connection;
 }
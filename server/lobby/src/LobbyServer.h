@@ -29,6 +29,7 @@
 
 // libcomp Includes
 #include <TcpServer.h>
+#include <WorkerPool.h>
 
 namespace lobby
 {
@@ -42,6 +43,10 @@ public:
 protected:
     virtual std::shared_ptr<libcomp::TcpConnection> CreateConnection(
         asio::ip::tcp::socket& socket);
+
+private:
+    /// Runs the Diffie-Hellman key exchange off of the network threads.
+    std::shared_ptr<libcomp::WorkerPool> mCryptoPool;
 };
 
 } // namespace lobby
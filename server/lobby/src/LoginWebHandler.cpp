@@ -28,14 +28,21 @@
 
 // lobby Includes
 #include "ResourceLogin.h"
+#include "WorldRouter.h"
 
 // libcomp Includes
+#include <Compress.h>
+#include <Constants.h>
 #include <Decrypt.h>
 #include <Log.h>
 
+// Standard C++11 Includes
+#include <cstring>
+
 using namespace lobby;
 
-LoginHandler::LoginHandler()
+LoginHandler::LoginHandler(const std::shared_ptr<WorldRouter>& worldRouter) :
+    mWorldRouter(worldRouter)
 {
     mVfs.AddArchiveLoader(new ttvfs::VFSZipArchiveLoader);
 
@@ -46,6 +53,17 @@ LoginHandler::LoginHandler()
     {
         LOG_CRITICAL("Failed to add login resource archive.\n");
     }
+
+    // Decompress and parse the pages up front so the first logins do not
+    // pay for it. Anything else is cached the first time it is requested.
+    static const char* const PRELOAD[] = {
+        "index.html", "authenticated.html", "quit.html",
+    };
+
+    for(auto szPath : PRELOAD)
+    {
+        (void)GetAsset(szPath);
+    }
 }
 
 LoginHandler::~LoginHandler()
@@ -93,19 +111,28 @@ void LoginHandler::ParsePost(CivetServer *pServer,
         return;
     }
 
-    size_t postContentLength = pRequestInfo->content_length;
-
-    // Sanity check the post content length.
-    if(0 == postContentLength)
+    // Sanity check the post content length. Anything bigger than the login
+    // form is not read (civetweb discards the unread body).
+    if(0 >= pRequestInfo->content_length ||
+        LOGIN_WEB_MAX_POST < pRequestInfo->content_length)
     {
         return;
     }
 
-    // Allocate.
-    char *szPostData = new char[postContentLength + 1];
+    // Each civetweb thread reuses its own buffer for the POST body.
+    static thread_local std::vector<char> postBuffer(LOGIN_WEB_MAX_POST + 1);
+
+    char *szPostData = &postBuffer[0];
 
     // Read the post data.
-    postContentLength = mg_read(pConnection, szPostData, postContentLength);
+    int postContentLength = mg_read(pConnection, szPostData,
+        (size_t)pRequestInfo->content_length);
+
+    if(0 > postContentLength)
+    {
+        return;
+    }
+
     szPostData[postContentLength] = 0;
 
     // Last read post value.
@@ -160,12 +187,40 @@ void LoginHandler::ParsePost(CivetServer *pServer,
 
         // The session IDs need to be generated.
         /// @todo Save these into the database.
-        postVars.sid1 = libcomp::Decrypt::GenerateRandom(300).ToLower();
-        postVars.sid2 = libcomp::Decrypt::GenerateRandom(300).ToLower();
+        postVars.sid1 = libcomp::Decrypt::GenerateSessionToken(300);
+        postVars.sid2 = libcomp::Decrypt::GenerateSessionToken(300);
+
+        // Let the world node the client will end up on expect it.
+        if(nullptr != mWorldRouter && 0 < mWorldRouter->GetNodeCount() &&
+            !mWorldRouter->RouteSession(postVars.id, postVars.sid1))
+        {
+            LOG_WARNING(libcomp::String("No world node is ready for the "
+                "session of %1.\n").Arg(postVars.id));
+        }
     }
+}
+
+const char* LoginHandler::ConnectionHeader(
+    struct mg_connection *pConnection)
+{
+    const mg_request_info *pRequestInfo = mg_get_request_info(pConnection);
+    const char *szConnection = mg_get_header(pConnection, "Connection");
+
+    // HTTP/1.1 keeps the connection open unless the client asks to close
+    // it; older clients must ask for keep-alive.
+    bool keepAlive = nullptr != pRequestInfo &&
+        nullptr != pRequestInfo->http_version &&
+        0 == strcmp(pRequestInfo->http_version, "1.1");
 
-    // Free.
-    delete[] szPostData;
+    if(nullptr != szConnection)
+    {
+        libcomp::String connection = libcomp::String(szConnection).ToLower();
+
+        keepAlive = "keep-alive" == connection ||
+            (keepAlive && "close" != connection);
+    }
+
+    return keepAlive ? "keep-alive" : "close";
 }
 
 bool LoginHandler::HandlePage(CivetServer *pServer,
@@ -207,68 +262,253 @@ bool LoginHandler::HandlePage(CivetServer *pServer,
     LOG_DEBUG(libcomp::String("URI: %1\n").Arg(uri));
 
     // Attempt to load the URI.
-    std::vector<char> pageData = LoadVfsFile(uri);
+    std::shared_ptr<const Asset> asset = GetAsset(uri);
 
     // Make sure the page was loaded or return a 404.
-    if(pageData.empty())
+    if(!asset)
     {
         return false;
     }
 
-    if(".png" == uri.Right(strlen(".png")))
+    if(asset->isTemplate)
     {
-        mg_printf(pConnection, "HTTP/1.1 200 OK\r\n"
-            "Content-Type: image/png; charset=UTF-8\r\n"
-            "Content-Length: %u\r\n"
-            "Connection: close\r\n"
-            "\r\n", (unsigned int)pageData.size());
-        mg_write(pConnection, &pageData[0], pageData.size());
+        SendPage(pConnection, *asset, postVars);
     }
     else
     {
-        libcomp::String page(&pageData[0], pageData.size());
-
-        // Replace our variables
-        page = page.Replace("{COMP_HACK_MSG}",
-            postVars.msg);
-        page = page.Replace("{COMP_HACK_SUBMIT}",
-            postVars.submit);
-        page = page.Replace("{COMP_HACK_ID}",
-            postVars.id);
-        page = page.Replace("{COMP_HACK_ID_READONLY}",
-            postVars.idReadOnly);
-        page = page.Replace("{COMP_HACK_PASS}",
-            postVars.pass);
-        page = page.Replace("{COMP_HACK_PASS_READONLY}",
-            postVars.passReadOnly);
-        page = page.Replace("{COMP_HACK_IDSAVE}",
-            postVars.idsave);
-        page = page.Replace("{COMP_HACK_IDSAVE_READONLY}",
-            postVars.idsaveReadOnly);
-        page = page.Replace("{COMP_HACK_BIRTHDAY}",
-            postVars.birthday);
-        page = page.Replace("{COMP_HACK_CV_INPUT}",
-            postVars.cv);
-        page = page.Replace("{COMP_HACK_CV}",
-            postVars.cvDisp);
-        page = page.Replace("{COMP_HACK_SID1}",
-            postVars.sid1);
-        page = page.Replace("{COMP_HACK_SID2}",
-            postVars.sid2);
-
-        mg_printf(pConnection, "HTTP/1.1 200 OK\r\n"
-            "Content-Type: text/html; charset=UTF-8\r\n"
-            "Content-Length: %u\r\n"
-            "Connection: close\r\n"
-            "\r\n", (unsigned int)page.Size());
-        mg_write(pConnection, page.C(), page.Size());
+        SendStatic(pConnection, *asset);
     }
 
     return true;
 }
 
+std::shared_ptr<const LoginHandler::Asset> LoginHandler::GetAsset(
+    const libcomp::String& path)
+{
+    {
+        std::lock_guard<std::mutex> guard(mAssetLock);
+
+        auto it = mAssets.find(path.ToUtf8());
+
+        if(mAssets.end() != it)
+        {
+            return it->second;
+        }
+    }
+
+    // Load outside of the lock so a slow file does not hold up the cached
+    // ones. Missing files are not cached or any URI would grow the cache.
+    std::shared_ptr<const Asset> asset = LoadAsset(path);
+
+    if(!asset)
+    {
+        return asset;
+    }
+
+    std::lock_guard<std::mutex> guard(mAssetLock);
+
+    // Keep the copy of another thread that loaded the same file first.
+    return mAssets.insert(std::make_pair(path.ToUtf8(), asset)).first->second;
+}
+
+std::shared_ptr<LoginHandler::Asset> LoginHandler::LoadAsset(
+    const libcomp::String& path)
+{
+    static const struct
+    {
+        const char *szName;
+        libcomp::String ReplacementVariables::*pVariable;
+    } PLACEHOLDERS[] = {
+        { "{COMP_HACK_MSG}", &ReplacementVariables::msg },
+        { "{COMP_HACK_SUBMIT}", &ReplacementVariables::submit },
+        { "{COMP_HACK_ID}", &ReplacementVariables::id },
+        { "{COMP_HACK_ID_READONLY}", &ReplacementVariables::idReadOnly },
+        { "{COMP_HACK_PASS}", &ReplacementVariables::pass },
+        { "{COMP_HACK_PASS_READONLY}", &ReplacementVariables::passReadOnly },
+        { "{COMP_HACK_IDSAVE}", &ReplacementVariables::idsave },
+        { "{COMP_HACK_IDSAVE_READONLY}",
+            &ReplacementVariables::idsaveReadOnly },
+        { "{COMP_HACK_BIRTHDAY}", &ReplacementVariables::birthday },
+        { "{COMP_HACK_CV_INPUT}", &ReplacementVariables::cv },
+        { "{COMP_HACK_CV}", &ReplacementVariables::cvDisp },
+        { "{COMP_HACK_SID1}", &ReplacementVariables::sid1 },
+        { "{COMP_HACK_SID2}", &ReplacementVariables::sid2 },
+    };
+
+    std::vector<char> data = LoadVfsFile(path);
+
+    if(data.empty())
+    {
+        return std::shared_ptr<Asset>();
+    }
+
+    std::shared_ptr<Asset> asset = std::make_shared<Asset>();
+    asset->data.swap(data);
+    asset->isTemplate = ".png" != path.Right(strlen(".png"));
+
+    if(!asset->isTemplate)
+    {
+        asset->contentType = "image/png";
+
+        // Entity tag from a hash (FNV-1a) of the file.
+        uint32_t hash = 2166136261U;
+
+        for(char c : asset->data)
+        {
+            hash = (hash ^ (uint8_t)c) * 16777619U;
+        }
+
+        asset->etag = libcomp::String("\"%1\"").Arg(hash, 8, 16, '0');
+        asset->deflatedEtag = libcomp::String("\"%1-z\"").Arg(
+            hash, 8, 16, '0');
+
+        // Only keep a compressed copy if it is worth sending.
+        libcomp::Compress::Compressor compressor(9);
+
+        if(0 < compressor.Write(&asset->data[0], (int32_t)asset->data.size(),
+            asset->deflated, true) && asset->deflated.size() >=
+            asset->data.size() - asset->data.size() / 8)
+        {
+            asset->deflated.clear();
+        }
+
+        return asset;
+    }
+
+    asset->contentType = "text/html; charset=UTF-8";
+
+    // Split the page into literal text and placeholders.
+    const std::vector<char>& page = asset->data;
+    size_t literalStart = 0;
+
+    for(size_t i = 0; i < page.size(); ++i)
+    {
+        if('{' != page[i])
+        {
+            continue;
+        }
+
+        for(auto& placeholder : PLACEHOLDERS)
+        {
+            size_t nameLength = strlen(placeholder.szName);
+
+            if(nameLength > (page.size() - i) ||
+                0 != memcmp(&page[i], placeholder.szName, nameLength))
+            {
+                continue;
+            }
+
+            Segment literal;
+            literal.offset = literalStart;
+            literal.length = i - literalStart;
+            literal.pVariable = nullptr;
+
+            Segment variable;
+            variable.offset = i;
+            variable.length = 0;
+            variable.pVariable = placeholder.pVariable;
+
+            asset->segments.push_back(literal);
+            asset->segments.push_back(variable);
+
+            literalStart = i + nameLength;
+            i = literalStart - 1;
+
+            break;
+        }
+    }
+
+    Segment literal;
+    literal.offset = literalStart;
+    literal.length = page.size() - literalStart;
+    literal.pVariable = nullptr;
+
+    asset->segments.push_back(literal);
+
+    return asset;
+}
+
+void LoginHandler::SendStatic(struct mg_connection *pConnection,
+    const Asset& asset)
+{
+    const char *szEncoding = mg_get_header(pConnection, "Accept-Encoding");
+    bool deflate = !asset.deflated.empty() && nullptr != szEncoding &&
+        nullptr != strstr(szEncoding, "deflate");
+    const std::vector<char>& body = deflate ? asset.deflated : asset.data;
+
+    // Each encoding is a different representation so it needs its own tag.
+    const libcomp::String& etag = deflate ? asset.deflatedEtag : asset.etag;
+
+    const char *szMatch = mg_get_header(pConnection, "If-None-Match");
+
+    if(nullptr != szMatch && etag == szMatch)
+    {
+        mg_printf(pConnection, "HTTP/1.1 304 Not Modified\r\n"
+            "ETag: %s\r\n"
+            "Vary: Accept-Encoding\r\n"
+            "Cache-Control: public, max-age=86400\r\n"
+            "Connection: %s\r\n"
+            "\r\n", etag.C(), ConnectionHeader(pConnection));
+
+        return;
+    }
+
+    mg_printf(pConnection, "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %u\r\n"
+        "%s"
+        "ETag: %s\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "Cache-Control: public, max-age=86400\r\n"
+        "Connection: %s\r\n"
+        "\r\n", asset.contentType.C(), (unsigned int)body.size(),
+        deflate ? "Content-Encoding: deflate\r\n" : "", etag.C(),
+        ConnectionHeader(pConnection));
+    mg_write(pConnection, &body[0], body.size());
+}
+
+void LoginHandler::SendPage(struct mg_connection *pConnection,
+    const Asset& asset, const ReplacementVariables& postVars)
+{
+    // Rendered pages are reused by the next request on this thread.
+    static thread_local std::vector<char> page;
+
+    page.clear();
+
+    for(const Segment& segment : asset.segments)
+    {
+        if(nullptr == segment.pVariable)
+        {
+            page.insert(page.end(), asset.data.begin() +
+                (std::ptrdiff_t)segment.offset, asset.data.begin() +
+                (std::ptrdiff_t)(segment.offset + segment.length));
+        }
+        else
+        {
+            const libcomp::String& value = postVars.*segment.pVariable;
+
+            page.insert(page.end(), value.C(), value.C() + value.Size());
+        }
+    }
+
+    mg_printf(pConnection, "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %u\r\n"
+        "Cache-Control: no-store\r\n"
+        "Connection: %s\r\n"
+        "\r\n", asset.contentType.C(), (unsigned int)page.size(),
+        ConnectionHeader(pConnection));
+
+    if(!page.empty())
+    {
+        mg_write(pConnection, &page[0], page.size());
+    }
+}
+
 std::vector<char> LoginHandler::LoadVfsFile(const libcomp::String& path)
 {
+    std::lock_guard<std::mutex> guard(mVfsLock);
+
     std::vector<char> data;
 
     ttvfs::File *vf = mVfs.GetFile(path.C());
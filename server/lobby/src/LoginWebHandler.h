@@ -34,6 +34,9 @@
 #include <String.h>
 
 // Standard C++11 Includes
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 // VFS Includes
@@ -45,10 +48,18 @@
 namespace lobby
 {
 
+class WorldRouter;
+
 class LoginHandler : public CivetHandler
 {
 public:
-    LoginHandler();
+    /**
+     * Create the handler.
+     * @param worldRouter Router to hand authenticated sessions to (if the
+     *   lobby has world nodes).
+     */
+    explicit LoginHandler(const std::shared_ptr<WorldRouter>& worldRouter =
+        std::shared_ptr<WorldRouter>());
     virtual ~LoginHandler();
 
     virtual bool handleGet(CivetServer *pServer,
@@ -80,15 +91,86 @@ private:
         bool quit;
     };
 
+    /**
+     * Part of a page template. A segment is either a run of literal text
+     * or a placeholder replaced by one of the replacement variables.
+     */
+    class Segment
+    {
+    public:
+        /// Offset of the literal text in the page data.
+        size_t offset;
+
+        /// Length of the literal text.
+        size_t length;
+
+        /// Variable that replaces this segment (or null for literal text).
+        libcomp::String ReplacementVariables::*pVariable;
+    };
+
+    /**
+     * Page or image loaded from the VFS. Pages are split into segments
+     * once so a response can be rendered in a single pass. Assets are never
+     * changed after they are cached so they may be shared between threads.
+     */
+    class Asset
+    {
+    public:
+        /// Decompressed file data.
+        std::vector<char> data;
+
+        /// Data compressed with deflate (empty if it does not help).
+        std::vector<char> deflated;
+
+        /// Template segments (empty for static files).
+        std::vector<Segment> segments;
+
+        /// Entity tag for static files.
+        libcomp::String etag;
+
+        /// Entity tag for the deflated copy of static files.
+        libcomp::String deflatedEtag;
+
+        /// Content type sent with the file.
+        libcomp::String contentType;
+
+        /// Indicates the file is a page template.
+        bool isTemplate;
+    };
+
     void ParsePost(CivetServer *pServer, struct mg_connection *pConnection,
         ReplacementVariables& postVars);
 
+    static const char* ConnectionHeader(struct mg_connection *pConnection);
+
     bool HandlePage(CivetServer *pServer, struct mg_connection *pConnection,
         ReplacementVariables& postVars);
 
     std::vector<char> LoadVfsFile(const libcomp::String& path);
 
+    std::shared_ptr<const Asset> GetAsset(const libcomp::String& path);
+
+    std::shared_ptr<Asset> LoadAsset(const libcomp::String& path);
+
+    void SendStatic(struct mg_connection *pConnection,
+        const Asset& asset);
+
+    void SendPage(struct mg_connection *pConnection, const Asset& asset,
+        const ReplacementVariables& postVars);
+
     ttvfs::Root mVfs;
+
+    /// Lock for reading files from the VFS.
+    std::mutex mVfsLock;
+
+    /// Assets loaded so far.
+    std::unordered_map<std::string, std::shared_ptr<const Asset>> mAssets;
+
+    /// Lock for the asset cache.
+    std::mutex mAssetLock;
+
+    /// World nodes the sessions are routed to.
+    std::shared_ptr<WorldRouter> mWorldRouter;
 };
 
 } // namespace lobby
@@ -0,0 +1,57 @@
+/**
+ * @file server/lobby/src/MetricsWebHandler.cpp
+ * @ingroup lobby
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Civet handler that exports the runtime metrics.
+ *
+ * This file is part of the Lobby Server (lobby).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MetricsWebHandler.h"
+
+// libcomp Includes
+#include <AllocationTracker.h>
+#include <Metrics.h>
+
+using namespace lobby;
+
+MetricsHandler::~MetricsHandler()
+{
+}
+
+bool MetricsHandler::handleGet(CivetServer *pServer,
+    struct mg_connection *pConnection)
+{
+    (void)pServer;
+
+    libcomp::AllocationTracker::Publish();
+
+    libcomp::String body = libcomp::Metrics::GetSingletonPtr()->Export();
+
+    mg_printf(pConnection, "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %u\r\n"
+        "Cache-Control: no-store\r\n"
+        "Connection: close\r\n"
+        "\r\n", (unsigned int)body.Size());
+    mg_write(pConnection, body.C(), body.Size());
+
+    return true;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file server/lobby/src/ProfileWebHandler.cpp
+ * @ingroup lobby
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Civet handler that shows the command profile.
+ *
+ * This file is part of the Lobby Server (lobby).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProfileWebHandler.h"
+
+// libcomp Includes
+#include <CommandProfiler.h>
+
+using namespace lobby;
+
+ProfileHandler::~ProfileHandler()
+{
+}
+
+bool ProfileHandler::handleGet(CivetServer *pServer,
+    struct mg_connection *pConnection)
+{
+    (void)pServer;
+
+    libcomp::CommandProfiler *pProfiler =
+        libcomp::CommandProfiler::GetSingletonPtr();
+    std::string value;
+
+    if(CivetServer::getParam(pConnection, "enable", value))
+    {
+        pProfiler->SetEnabled("0" != value);
+    }
+
+    if(CivetServer::getParam(pConnection, "reset", value) && "0" != value)
+    {
+        pProfiler->Reset();
+    }
+
+    libcomp::String body = libcomp::String("Profiling is %1.\n\n%2").Arg(
+        pProfiler->IsEnabled() ? "on" : "off").Arg(pProfiler->Dump());
+
+    mg_printf(pConnection, "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: %u\r\n"
+        "Cache-Control: no-store\r\n"
+        "Connection: close\r\n"
+        "\r\n", (unsigned int)body.Size());
+    mg_write(pConnection, body.C(), body.Size());
+
+    return true;
+}
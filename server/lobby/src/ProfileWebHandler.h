@@ -0,0 +1,52 @@
+/**
+ * @file server/lobby/src/ProfileWebHandler.h
+ * @ingroup lobby
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Civet handler that shows the command profile.
+ *
+ * This file is part of the Lobby Server (lobby).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVER_LOBBY_SRC_PROFILEWEBHANDLER_H
+#define SERVER_LOBBY_SRC_PROFILEWEBHANDLER_H
+
+// Civet Includes
+#include <CivetServer.h>
+
+namespace lobby
+{
+
+/**
+ * Shows the per-command profile as a plain text table. A GET with
+ * @c ?enable=1 or @c ?enable=0 turns profiling on or off and
+ * @c ?reset=1 zeroes the totals first.
+ */
+class ProfileHandler : public CivetHandler
+{
+public:
+    virtual ~ProfileHandler();
+
+    virtual bool handleGet(CivetServer *pServer,
+        struct mg_connection *pConnection);
+};
+
+} // namespace lobby
+
+#endif // SERVER_LOBBY_SRC_PROFILEWEBHANDLER_H
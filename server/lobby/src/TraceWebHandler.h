@@ -0,0 +1,53 @@
+/**
+ * @file server/lobby/src/TraceWebHandler.h
+ * @ingroup lobby
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Civet handler that exports the span trace.
+ *
+ * This file is part of the Lobby Server (lobby).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVER_LOBBY_SRC_TRACEWEBHANDLER_H
+#define SERVER_LOBBY_SRC_TRACEWEBHANDLER_H
+
+// Civet Includes
+#include <CivetServer.h>
+
+namespace lobby
+{
+
+/**
+ * Exports the recorded spans as a Chrome trace (open the file in
+ * chrome://tracing or the Perfetto UI). A GET with @c ?enable=1 or
+ * @c ?enable=0 turns tracing on or off and @c ?clear=1 drops the recorded
+ * spans after they are exported.
+ */
+class TraceHandler : public CivetHandler
+{
+public:
+    virtual ~TraceHandler();
+
+    virtual bool handleGet(CivetServer *pServer,
+        struct mg_connection *pConnection);
+};
+
+} // namespace lobby
+
+#endif // SERVER_LOBBY_SRC_TRACEWEBHANDLER_H
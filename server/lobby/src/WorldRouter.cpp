@@ -0,0 +1,345 @@
+/**
+ * @file server/lobby/src/WorldRouter.cpp
+ * @ingroup lobby
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Links from the lobby to the world nodes.
+ *
+ * This file is part of the Lobby Server (lobby).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WorldRouter.h"
+
+// libcomp Includes
+#include <Constants.h>
+#include <Log.h>
+#include <Packet.h>
+
+using namespace lobby;
+
+WorldRouter::WorldRouter(const libcomp::String& preSharedKey) :
+    mPreSharedKey(preSharedKey), mCheckTimer(mService), mRunning(false)
+{
+}
+
+WorldRouter::~WorldRouter()
+{
+    Stop();
+}
+
+void WorldRouter::AddNode(const libcomp::String& host, int port)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    Node node;
+    node.name = libcomp::String("%1:%2").Arg(host).Arg(port);
+    node.host = host;
+    node.port = port;
+
+    if(mRing.HasNode(node.name))
+    {
+        return;
+    }
+
+    mNodes.push_back(node);
+    mRing.AddNode(node.name);
+}
+
+bool WorldRouter::AddNodes(const libcomp::String& nodes)
+{
+    bool result = true;
+
+    for(auto entry : nodes.Split(","))
+    {
+        std::list<libcomp::String> parts = entry.Trimmed().Split(":");
+
+        bool ok = false;
+        int64_t port = 0;
+
+        if(2 == parts.size())
+        {
+            port = parts.back().ToInteger<int64_t>(&ok);
+        }
+
+        if(!ok || 0 >= port || 65535 < port || parts.front().IsEmpty())
+        {
+            LOG_ERROR(libcomp::String("Invalid world node: %1\n").Arg(
+                entry));
+
+            result = false;
+        }
+        else
+        {
+            AddNode(parts.front(), (int)port);
+        }
+    }
+
+    return result;
+}
+
+size_t WorldRouter::GetNodeCount() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    return mNodes.size();
+}
+
+void WorldRouter::Start()
+{
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        if(mRunning || mThread.joinable())
+        {
+            return;
+        }
+
+        mRunning = true;
+    }
+
+    mService.post([this]()
+    {
+        CheckNodes();
+    });
+
+    mThread = std::thread([this]()
+    {
+        mService.run();
+    });
+}
+
+void WorldRouter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        if(!mRunning)
+        {
+            return;
+        }
+
+        mRunning = false;
+    }
+
+    mService.post([this]()
+    {
+        mCheckTimer.cancel();
+
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+
+            for(auto& node : mNodes)
+            {
+                if(nullptr != node.connection)
+                {
+                    node.connection->Close("Lobby is stopping.");
+                }
+            }
+        }
+
+        // Don't wait for a node that stopped reading.
+        WaitForClose(std::chrono::steady_clock::now() +
+            std::chrono::seconds(TIMEOUT_DRAIN));
+    });
+
+    mThread.join();
+}
+
+void WorldRouter::WaitForClose(
+    const std::chrono::steady_clock::time_point& deadline)
+{
+    bool open = false;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        for(auto& node : mNodes)
+        {
+            open = open || (nullptr != node.connection &&
+                libcomp::TcpConnection::STATUS_NOT_CONNECTED !=
+                node.connection->GetStatus());
+        }
+    }
+
+    if(!open || std::chrono::steady_clock::now() >= deadline)
+    {
+        mService.stop();
+
+        return;
+    }
+
+    mCheckTimer.expires_from_now(std::chrono::milliseconds(
+        DRAIN_POLL_INTERVAL));
+    mCheckTimer.async_wait([this, deadline](asio::error_code errorCode)
+    {
+        if(!errorCode)
+        {
+            WaitForClose(deadline);
+        }
+    });
+}
+
+void WorldRouter::CheckNodes()
+{
+    std::lock_guard<std::mutex> guard(mLock);
+
+    if(!mRunning)
+    {
+        return;
+    }
+
+    for(auto& node : mNodes)
+    {
+        // The link is lost once it closed (or its connect failed). Nothing
+        // of the old connection is still pending by now since it runs on
+        // this thread and the last check was a while ago.
+        if(nullptr != node.connection && libcomp::TcpConnection::
+            STATUS_NOT_CONNECTED != node.connection->GetStatus())
+        {
+            continue;
+        }
+
+        std::shared_ptr<libcomp::InternalConnection> connection(
+            new libcomp::InternalConnection(mService));
+
+        connection->SetPreSharedKey(mPreSharedKey);
+        connection->SetSelf(connection);
+
+        try
+        {
+            if(!connection->Connect(node.host, node.port))
+            {
+                connection.reset();
+            }
+        }
+        catch(std::exception& e)
+        {
+            LOG_WARNING(libcomp::String("Failed to resolve world node "
+                "%1: %2\n").Arg(node.host).Arg(e.what()));
+
+            connection.reset();
+        }
+
+        node.connection = connection;
+    }
+
+    ScheduleCheck();
+}
+
+void WorldRouter::ScheduleCheck()
+{
+    mCheckTimer.expires_from_now(std::chrono::seconds(
+        INTERNAL_RECONNECT_DELAY));
+    mCheckTimer.async_wait([this](asio::error_code errorCode)
+    {
+        if(!errorCode)
+        {
+            CheckNodes();
+        }
+    });
+}
+
+bool WorldRouter::IsReady(const Node& node)
+{
+    return nullptr != node.connection && node.connection->IsReady() &&
+        libcomp::TcpConnection::STATUS_NOT_CONNECTED !=
+        node.connection->GetStatus();
+}
+
+std::vector<std::shared_ptr<libcomp::InternalConnection>>
+    WorldRouter::GetReadyConnections() const
+{
+    std::vector<std::shared_ptr<libcomp::InternalConnection>> ready;
+
+    std::lock_guard<std::mutex> guard(mLock);
+
+    for(auto& node : mNodes)
+    {
+        if(IsReady(node))
+        {
+            ready.push_back(node.connection);
+        }
+    }
+
+    return ready;
+}
+
+bool WorldRouter::RouteSession(const libcomp::String& account,
+    const libcomp::String& sessionID)
+{
+    std::shared_ptr<libcomp::InternalConnection> connection;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+
+        // Walk the ring from the owner so a node that is down only moves
+        // its own accounts (to the node after it) and no others.
+        for(auto name : mRing.GetNodes(account, mRing.GetNodeCount()))
+        {
+            for(auto& node : mNodes)
+            {
+                if(node.name == name && IsReady(node))
+                {
+                    connection = node.connection;
+                    break;
+                }
+            }
+
+            if(nullptr != connection)
+            {
+                break;
+            }
+        }
+    }
+
+    if(nullptr == connection)
+    {
+        return false;
+    }
+
+    libcomp::Packet message;
+    message.WriteString16Little(libcomp::Convert::ENCODING_UTF8, account);
+    message.WriteString16Little(libcomp::Convert::ENCODING_UTF8, sessionID);
+
+    return connection->QueueMessage(
+        libcomp::InternalConnection::MESSAGE_SESSION_ROUTE,
+        message.ConstData(), (uint16_t)message.Size());
+}
+
+size_t WorldRouter::ShareSession(const libcomp::String& sessionID,
+    const std::vector<char>& state)
+{
+    libcomp::Packet message;
+    message.WriteString16Little(libcomp::Convert::ENCODING_UTF8, sessionID);
+    message.WriteArray(state);
+
+    size_t count = 0;
+
+    for(auto connection : GetReadyConnections())
+    {
+        if(connection->QueueMessage(
+            libcomp::InternalConnection::MESSAGE_SESSION_STATE,
+            message.ConstData(), (uint16_t)message.Size()))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file server/lobby/src/WorldRouter.h
+ * @ingroup lobby
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Links from the lobby to the world nodes.
+ *
+ * This file is part of the Lobby Server (lobby).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVER_LOBBY_SRC_WORLDROUTER_H
+#define SERVER_LOBBY_SRC_WORLDROUTER_H
+
+// libcomp Includes
+#include <HashRing.h>
+#include <InternalConnection.h>
+#include <String.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lobby
+{
+
+/**
+ * Internal links from this lobby to the world nodes behind it. Each node
+ * gets one @ref libcomp::InternalConnection that is dialled again whenever
+ * it is lost. Authenticated sessions are spread over the nodes with a
+ * @ref libcomp::HashRing keyed by account so capacity grows by adding
+ * nodes and the loss of a node only moves its own accounts. The links run
+ * on their own
+ * thread; every method may be called from any thread.
+ */
+class WorldRouter
+{
+public:
+    /**
+     * Create a router without any nodes.
+     * @param preSharedKey Key the world nodes expect.
+     */
+    explicit WorldRouter(const libcomp::String& preSharedKey);
+    ~WorldRouter();
+
+    /**
+     * Add a world node. This must be called before @ref Start.
+     * @param host Host name or address of the node.
+     * @param port Internal port of the node.
+     */
+    void AddNode(const libcomp::String& host, int port);
+
+    /**
+     * Add the nodes of a comma separated list of host:port pairs.
+     * @param nodes List of nodes (for example "world1:10667,world2:10667").
+     * @returns true if every entry was valid.
+     */
+    bool AddNodes(const libcomp::String& nodes);
+
+    /**
+     * Get the number of nodes that were added.
+     * @returns Number of world nodes.
+     */
+    size_t GetNodeCount() const;
+
+    /**
+     * Connect to the nodes and keep reconnecting the ones that are lost.
+     */
+    void Start();
+
+    /**
+     * Close the links (after sending what is queued) and stop the thread.
+     */
+    void Stop();
+
+    /**
+     * Hand an authenticated session to a world node. An account is sent to
+     * the node that owns it on the ring or, if that node is not ready, the
+     * next ready node after it. Every lobby with the same node list picks
+     * the same node.
+     * @param account Account name of the session.
+     * @param sessionID Session ID the client will log in with.
+     * @returns true if a node is ready and the session was queued for it.
+     */
+    bool RouteSession(const libcomp::String& account,
+        const libcomp::String& sessionID);
+
+    /**
+     * Send the state of a session to every node that is ready.
+     * @param sessionID Session the state belongs to.
+     * @param state Opaque state of the session.
+     * @returns Number of nodes the state was queued for.
+     */
+    size_t ShareSession(const libcomp::String& sessionID,
+        const std::vector<char>& state);
+
+private:
+    /**
+     * @internal
+     * One world node and its current link.
+     */
+    class Node
+    {
+    public:
+        libcomp::String name;
+        libcomp::String host;
+        int port;
+        std::shared_ptr<libcomp::InternalConnection> connection;
+    };
+
+    void CheckNodes();
+    void ScheduleCheck();
+    void WaitForClose(const std::chrono::steady_clock::time_point& deadline);
+
+    static bool IsReady(const Node& node);
+
+    std::vector<std::shared_ptr<libcomp::InternalConnection>>
+        GetReadyConnections() const;
+
+    libcomp::String mPreSharedKey;
+
+    asio::io_service mService;
+    asio::steady_timer mCheckTimer;
+    std::thread mThread;
+
+    mutable std::mutex mLock;
+    std::vector<Node> mNodes;
+    libcomp::HashRing mRing;
+    bool mRunning;
+};
+
+} // namespace lobby
+
+#endif // SERVER_LOBBY_SRC_WORLDROUTER_H
@@ -27,31 +27,337 @@
 // lobby Includes
 #include "LoginWebHandler.h"
 #include "LobbyServer.h"
+#include "MetricsWebHandler.h"
+#include "ProfileWebHandler.h"
+#include "TraceWebHandler.h"
+#include "WorldRouter.h"
 
 // libcomp Includes
+#include <CommandProfiler.h>
+#include <Constants.h>
 #include <Log.h>
+#include <PacketCapture.h>
+#include <StartupProfile.h>
+#include <ThreadAffinity.h>
+#include <Tracer.h>
 
 // Civet Includes
 #include <CivetServer.h>
 
+// Standard C++11 Includes
+#include <csignal>
+#include <cstdlib>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#endif // !WIN32
+
+/**
+ * Get a web server setting from the environment.
+ * @param szName Name of the environment variable.
+ * @param defaultValue Value to use if the variable is not set.
+ * @returns Value of the setting as a string for civetweb.
+ */
+static std::string WebSetting(const char *szName, int defaultValue)
+{
+    const char *szValue = getenv(szName);
+
+    if(nullptr != szValue && 0 < atoi(szValue))
+    {
+        return szValue;
+    }
+
+    return std::to_string(defaultValue);
+}
+
+/**
+ * Set the CPUs each kind of server thread runs on from the environment
+ * (COMP_IO_CPUS, COMP_WORKER_CPUS, COMP_DATABASE_CPUS and COMP_LOG_CPUS).
+ * Each one is a list like "0-3,8". This must be done before any of the
+ * threads are started.
+ */
+static void PlaceThreads()
+{
+    static const char *szNames[libcomp::ThreadAffinity::ROLE_COUNT] = {
+        "COMP_IO_CPUS",
+        "COMP_WORKER_CPUS",
+        "COMP_DATABASE_CPUS",
+        "COMP_LOG_CPUS",
+    };
+
+    for(uint8_t i = 0; i < libcomp::ThreadAffinity::ROLE_COUNT; ++i)
+    {
+        const char *szValue = getenv(szNames[i]);
+        libcomp::ThreadAffinity::CpuList_t cpus;
+
+        if(nullptr == szValue)
+        {
+            continue;
+        }
+
+        if(!libcomp::ThreadAffinity::ParseCpuList(szValue, cpus))
+        {
+            LOG_WARNING(libcomp::String("Ignoring invalid CPU list in "
+                "%1.\n").Arg(szNames[i]));
+
+            continue;
+        }
+
+        libcomp::ThreadAffinity::SetCpus(
+            (libcomp::ThreadAffinity::Role_t)i, cpus);
+    }
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/**
+ * Start a new copy of the server that takes over the listen socket so no
+ * connection attempt is refused while this copy stops.
+ * @param server Server whose listen socket the copy inherits.
+ * @param argv Arguments this process was started with.
+ * @returns true if the copy was started.
+ */
+static bool SpawnReplacement(const lobby::LobbyServer& server,
+    const char *argv[])
+{
+    asio::ip::tcp::acceptor::native_handle_type handle;
+
+    if(!server.GetListenHandle(handle))
+    {
+        return false;
+    }
+
+    // Let the listen socket survive the exec.
+    int flags = fcntl(handle, F_GETFD);
+
+    if(0 > flags || 0 != fcntl(handle, F_SETFD, flags & ~FD_CLOEXEC))
+    {
+        return false;
+    }
+
+    // Only async-signal-safe calls are allowed in the child so the
+    // environment is set up before the fork.
+    if(0 != setenv("COMP_LISTEN_FD", std::to_string(handle).c_str(), 1))
+    {
+        return false;
+    }
+
+    pid_t pid = fork();
+
+    if(0 == pid)
+    {
+        execvp(argv[0], const_cast<char* const*>(argv));
+        _exit(EXIT_FAILURE);
+    }
+
+    return 0 < pid;
+}
+#endif // !WIN32
+
 int main(int argc, const char *argv[])
 {
-    (void)argc;
-    (void)argv;
+    // Time every step until the server is ready.
+    libcomp::StartupProfile profile("Lobby server");
 
     libcomp::Log::GetSingletonPtr()->AddStandardOutputHook();
 
+    PlaceThreads();
+
+    // Keep every message in binary form to be decoded with comp_logdecode.
+    const char *szBinaryLog = getenv("COMP_BINARY_LOG");
+
+    if(nullptr != szBinaryLog)
+    {
+        libcomp::Log::GetSingletonPtr()->SetBinaryLogPath(szBinaryLog);
+    }
+
+    // Keep the terminal (and log file) writes off the network threads.
+    libcomp::Log::GetSingletonPtr()->StartAsync();
+
+    // Profiling may also be turned on later from the /profile page.
+    if(nullptr != getenv("COMP_COMMAND_PROFILE"))
+    {
+        libcomp::CommandProfiler::GetSingletonPtr()->SetEnabled(true);
+    }
+
+    // Record spans from the start and write them out as a Chrome trace on
+    // exit (the build must have TRACING on). The /trace page also works.
+    const char *szTrace = getenv("COMP_TRACE");
+
+    if(nullptr != szTrace)
+    {
+        libcomp::Tracer::GetSingletonPtr()->SetEnabled(true);
+    }
+
+    // Record the decrypted traffic so it may be replayed with comp_replay.
+    const char *szCapture = getenv("COMP_CAPTURE");
+
+    if(nullptr != szCapture && !libcomp::PacketCapture::GetSingletonPtr()->
+        Start(szCapture))
+    {
+        LOG_WARNING("Traffic will not be captured.\n");
+    }
+
     std::vector<std::string> options;
     options.push_back("listening_ports");
     options.push_back("10999");
-
-    CivetServer webServer(options);
-    webServer.addHandler("/", new lobby::LoginHandler);
+    options.push_back("num_threads");
+    options.push_back(WebSetting("COMP_LOGIN_WEB_THREADS",
+        LOGIN_WEB_THREADS));
+    options.push_back("connection_queue");
+    options.push_back(WebSetting("COMP_LOGIN_WEB_QUEUE",
+        LOGIN_WEB_QUEUE_DEPTH));
+    options.push_back("enable_keep_alive");
+    options.push_back("yes");
+    options.push_back("keep_alive_timeout_ms");
+    options.push_back(std::to_string(LOGIN_WEB_KEEP_ALIVE_MS));
 
     LOG_INFO("COMP_hack Lobby Server v0.0.1 build 1\n");
     LOG_INFO("Copyright (C) 2010-2016 COMP_hack Team\n\n");
 
     lobby::LobbyServer server("any", 10666);
 
-    return server.Start();
+    // An optional saved prime avoids generating one on every start.
+    if(1 < argc && !server.SetDiffieHellman(argv[1]))
+    {
+        LOG_CRITICAL("Invalid Diffie-Hellman prime.\n");
+        libcomp::PacketCapture::GetSingletonPtr()->Stop();
+        libcomp::Log::GetSingletonPtr()->StopAsync();
+
+        return -1;
+    }
+
+    // Sessions are handed to the world nodes over internal links.
+    const char *szInternalKey = getenv("COMP_INTERNAL_KEY");
+    const char *szWorldNodes = getenv("COMP_WORLD_NODES");
+
+    std::shared_ptr<lobby::WorldRouter> worldRouter(new lobby::WorldRouter(
+        nullptr != szInternalKey ? szInternalKey : ""));
+
+    // None of these depend on each other so they run at the same time.
+    lobby::LoginHandler *pLoginHandler = nullptr;
+
+    profile.AddStep("Login pages", [&pLoginHandler, worldRouter]()
+    {
+        pLoginHandler = new lobby::LoginHandler(worldRouter);
+
+        return true;
+    });
+
+    profile.AddStep("Diffie-Hellman", [&server]()
+    {
+        return server.PrepareDiffieHellman();
+    });
+
+    profile.AddStep("World nodes", [worldRouter, szWorldNodes]()
+    {
+        if(nullptr != szWorldNodes && !worldRouter->AddNodes(szWorldNodes))
+        {
+            LOG_WARNING("Some of the world nodes were ignored.\n");
+        }
+
+        worldRouter->Start();
+
+        return true;
+    });
+
+    if(!profile.Run())
+    {
+        worldRouter->Stop();
+        libcomp::PacketCapture::GetSingletonPtr()->Stop();
+        libcomp::Log::GetSingletonPtr()->StopAsync();
+
+        return -1;
+    }
+
+    // Clients are only let in once everything above is done.
+    CivetServer webServer(options);
+    webServer.addHandler("/", pLoginHandler);
+    webServer.addHandler("/metrics", new lobby::MetricsHandler);
+    webServer.addHandler("/profile", new lobby::ProfileHandler);
+    webServer.addHandler("/trace", new lobby::TraceHandler);
+
+    server.SetReadyHandler([&profile]()
+    {
+        profile.Ready();
+    });
+
+    // Run the client sockets through io_uring (Linux only).
+    if(nullptr != getenv("COMP_IO_URING"))
+    {
+        libcomp::SocketOptions_t socketOptions = server.GetSocketOptions();
+        socketOptions.ioUring = true;
+
+        server.SetSocketOptions(socketOptions);
+    }
+
+    // The process this one replaces may have passed its listen socket.
+    const char *szListenHandle = getenv("COMP_LISTEN_FD");
+
+    if(nullptr != szListenHandle)
+    {
+        server.SetListenHandle((asio::ip::tcp::acceptor::native_handle_type)
+            atoi(szListenHandle));
+    }
+
+    // SIGINT and SIGTERM drain the connections before exiting. SIGUSR2
+    // starts a replacement on the same listen socket first.
+    asio::io_service signalService;
+    asio::signal_set signals(signalService, SIGINT, SIGTERM);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    signals.add(SIGUSR2);
+#endif // !WIN32
+
+    signals.async_wait([&server, argv](const asio::error_code& errorCode,
+        int signalNumber)
+    {
+        if(errorCode)
+        {
+            return;
+        }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+        if(SIGUSR2 == signalNumber)
+        {
+            if(!SpawnReplacement(server, argv))
+            {
+                LOG_ERROR("Failed to start the replacement server.\n");
+            }
+
+            server.Stop("Server is restarting.");
+
+            return;
+        }
+#else // WIN32
+        (void)signalNumber;
+#endif // !WIN32
+
+        server.Stop();
+    });
+
+    std::thread signalThread([&signalService]()
+    {
+        signalService.run();
+    });
+
+    int result = server.Start();
+
+    signalService.stop();
+    signalThread.join();
+
+    worldRouter->Stop();
+
+    if(nullptr != szTrace && !libcomp::Tracer::GetSingletonPtr()->
+        WriteChromeJson(szTrace))
+    {
+        LOG_ERROR(libcomp::String("Failed to write the trace to %1.\n").Arg(
+            szTrace));
+    }
+
+    libcomp::PacketCapture::GetSingletonPtr()->Stop();
+    libcomp::Log::GetSingletonPtr()->StopAsync();
+
+    return result;
 }
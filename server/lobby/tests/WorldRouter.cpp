@@ -0,0 +1,321 @@
+/**
+ * @file server/lobby/tests/WorldRouter.cpp
+ * @ingroup lobby
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the routing of sessions to the world nodes.
+ *
+ * This file is part of the Lobby Server (lobby).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include "WorldRouter.h"
+
+// libcomp Includes
+#include <InternalServer.h>
+#include <MessagePacketFrame.h>
+
+// Standard C++11 Includes
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace lobby;
+
+/// Queue the world node sends the messages to.
+typedef libcomp::MessageQueue<libcomp::Message::Message*> TestQueue_t;
+
+/**
+ * World node for the router to connect to.
+ */
+class WorldNode
+{
+public:
+    WorldNode(const libcomp::String& preSharedKey) :
+        mQueue(new TestQueue_t), mServer("127.0.0.1", 0, preSharedKey,
+        mQueue), mPort(0)
+    {
+    }
+
+    ~WorldNode()
+    {
+        mServer.Stop("Test is done.", 1);
+
+        if(mThread.joinable())
+        {
+            mThread.join();
+        }
+
+        libcomp::Message::Message *pMessage;
+
+        while(mQueue->TryDequeue(pMessage))
+        {
+            delete pMessage;
+        }
+    }
+
+    /**
+     * Start the node on its own thread.
+     * @returns Port the node listens on (or zero if it did not start).
+     */
+    uint16_t Start()
+    {
+        std::mutex lock;
+        std::condition_variable condition;
+        bool ready = false;
+
+        mServer.SetReadyHandler([&]()
+        {
+            asio::ip::tcp::acceptor::native_handle_type handle;
+            sockaddr_in address;
+            socklen_t addressSize = sizeof(address);
+
+            std::lock_guard<std::mutex> guard(lock);
+
+            if(mServer.GetListenHandle(handle) && 0 == getsockname(handle,
+                reinterpret_cast<sockaddr*>(&address), &addressSize))
+            {
+                mPort = ntohs(address.sin_port);
+            }
+
+            ready = true;
+            condition.notify_all();
+        });
+
+        mThread = std::thread([this]()
+        {
+            mServer.Start();
+        });
+
+        std::unique_lock<std::mutex> guard(lock);
+
+        condition.wait_for(guard, std::chrono::seconds(5), [&ready]()
+        {
+            return ready;
+        });
+
+        return mPort;
+    }
+
+    /**
+     * Wait for the next message the node receives.
+     * @param messageCode Set to the code of the message.
+     * @param data Set to the data of the message.
+     * @returns true if a message arrived.
+     */
+    bool WaitForMessage(uint16_t& messageCode, libcomp::ReadOnlyPacket& data)
+    {
+        auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        while(mPending.empty() && std::chrono::steady_clock::now() < end)
+        {
+            libcomp::Message::Message *pMessage;
+
+            if(mQueue->TryDequeue(pMessage))
+            {
+                std::shared_ptr<libcomp::Message::Message> message(pMessage);
+
+                auto frame = std::dynamic_pointer_cast<
+                    libcomp::Message::PacketFrame>(message);
+
+                for(size_t i = 0; nullptr != frame &&
+                    i < frame->GetCommandCount(); ++i)
+                {
+                    mPending.push_back(std::make_pair(frame, i));
+                }
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        if(mPending.empty())
+        {
+            return false;
+        }
+
+        auto next = mPending.front();
+        mPending.pop_front();
+
+        messageCode = next.first->GetCommandCode(next.second);
+        next.first->GetCommand(next.second, data);
+
+        return true;
+    }
+
+private:
+    std::shared_ptr<TestQueue_t> mQueue;
+    libcomp::InternalServer mServer;
+    std::thread mThread;
+    uint16_t mPort;
+
+    std::list<std::pair<std::shared_ptr<libcomp::Message::PacketFrame>,
+        size_t>> mPending;
+};
+
+/**
+ * Get a port nothing listens on.
+ * @returns Closed port on the loopback interface.
+ */
+static uint16_t GetClosedPort()
+{
+    asio::io_service service;
+    asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(
+        asio::ip::address_v4::loopback(), 0));
+
+    return acceptor.local_endpoint().port();
+}
+
+/**
+ * Route a session as soon as a node is ready.
+ * @param router Router to route the session with.
+ * @param account Account name of the session.
+ * @param sessionID Session ID of the session.
+ * @param timeout How long to wait for a node.
+ * @returns true if the session was routed.
+ */
+static bool WaitToRoute(WorldRouter& router, const libcomp::String& account,
+    const libcomp::String& sessionID, const std::chrono::milliseconds&
+    timeout = std::chrono::milliseconds(5000))
+{
+    auto end = std::chrono::steady_clock::now() + timeout;
+
+    while(!router.RouteSession(account, sessionID))
+    {
+        if(std::chrono::steady_clock::now() >= end)
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+TEST(WorldRouter, AddNodes)
+{
+    WorldRouter router("secret");
+
+    EXPECT_TRUE(router.AddNodes("world1:10667, world2:10667"));
+    EXPECT_EQ(2u, router.GetNodeCount());
+
+    // Nodes are only added once.
+    EXPECT_TRUE(router.AddNodes("world1:10667"));
+    EXPECT_EQ(2u, router.GetNodeCount());
+
+    EXPECT_FALSE(router.AddNodes("world3,world4:0,:10667,world5:70000"));
+    EXPECT_EQ(2u, router.GetNodeCount());
+}
+
+TEST(WorldRouter, RouteAndShare)
+{
+    WorldNode node("secret");
+    uint16_t port = node.Start();
+    ASSERT_NE(0, port);
+
+    WorldRouter router("secret");
+    router.AddNode("127.0.0.1", port);
+    router.AddNode("127.0.0.1", GetClosedPort());
+
+    // Nothing is ready before the links are started.
+    EXPECT_FALSE(router.RouteSession("account", "session"));
+    EXPECT_EQ(0u, router.ShareSession("session", std::vector<char>()));
+
+    router.Start();
+
+    // Every account goes to the node that is up.
+    ASSERT_TRUE(WaitToRoute(router, "first", "session1"));
+    ASSERT_TRUE(router.RouteSession("second", "session2"));
+
+    std::vector<char> state = { 1, 2, 3, 4 };
+    EXPECT_EQ(1u, router.ShareSession("session1", state));
+
+    uint16_t messageCode = 0;
+    libcomp::ReadOnlyPacket data;
+
+    for(auto session : { std::make_pair("first", "session1"),
+        std::make_pair("second", "session2") })
+    {
+        ASSERT_TRUE(node.WaitForMessage(messageCode, data));
+        EXPECT_EQ(libcomp::InternalConnection::MESSAGE_SESSION_ROUTE,
+            messageCode);
+        EXPECT_EQ(session.first, data.ReadString16Little(
+            libcomp::Convert::ENCODING_UTF8));
+        EXPECT_EQ(session.second, data.ReadString16Little(
+            libcomp::Convert::ENCODING_UTF8));
+    }
+
+    ASSERT_TRUE(node.WaitForMessage(messageCode, data));
+    EXPECT_EQ(libcomp::InternalConnection::MESSAGE_SESSION_STATE,
+        messageCode);
+    EXPECT_EQ("session1", data.ReadString16Little(
+        libcomp::Convert::ENCODING_UTF8));
+    EXPECT_EQ(state, data.ReadArray(data.Left()));
+
+    // Stopping sends what is still queued.
+    ASSERT_TRUE(router.RouteSession("third", "session3"));
+
+    router.Stop();
+
+    ASSERT_TRUE(node.WaitForMessage(messageCode, data));
+    EXPECT_EQ(libcomp::InternalConnection::MESSAGE_SESSION_ROUTE,
+        messageCode);
+    EXPECT_EQ("third", data.ReadString16Little(
+        libcomp::Convert::ENCODING_UTF8));
+}
+
+TEST(WorldRouter, WrongKey)
+{
+    WorldNode node("secret");
+    uint16_t port = node.Start();
+    ASSERT_NE(0, port);
+
+    WorldRouter router("guess");
+    router.AddNode("127.0.0.1", port);
+    router.Start();
+
+    // The node never becomes ready.
+    EXPECT_FALSE(WaitToRoute(router, "account", "session",
+        std::chrono::milliseconds(500)));
+
+    router.Stop();
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
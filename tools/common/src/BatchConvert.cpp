@@ -0,0 +1,431 @@
+/**
+ * @file tools/common/src/BatchConvert.cpp
+ * @ingroup tools
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Batch file conversion shared by the tools.
+ *
+ * This file is part of the COMP_hack Tools.
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BatchConvert.h"
+
+// libcomp Includes
+#include <WorkerPool.h>
+
+// Standard C++11 Includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#include <windows.h>
+#else // !WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif // !WIN32
+
+/**
+ * @internal
+ * Input and output path of a file to convert.
+ */
+typedef std::pair<std::string, std::string> FileJob_t;
+
+/**
+ * @internal
+ * Check if a path is a directory.
+ * @param path Path to check.
+ * @returns true if the path is a directory.
+ */
+static bool IsDirectory(const std::string& path)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    DWORD attributes = GetFileAttributesA(path.c_str());
+
+    return INVALID_FILE_ATTRIBUTES != attributes &&
+        0 != (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else // !WIN32
+    struct stat info;
+
+    return 0 == stat(path.c_str(), &info) && S_ISDIR(info.st_mode);
+#endif // !WIN32
+}
+
+/**
+ * @internal
+ * Find every file under a directory.
+ * @param root Directory to search.
+ * @param relative Path under @em root to search (empty for @em root).
+ * @param files List to add the paths (relative to @em root) to.
+ * @returns true if every directory could be read.
+ */
+static bool ListFiles(const std::string& root, const std::string& relative,
+    std::list<std::string>& files)
+{
+    bool result = true;
+
+    std::string path = relative.empty() ? root : (root + "/" + relative);
+    std::list<std::string> names;
+
+#if defined(_WIN32) || defined(_WIN64)
+    WIN32_FIND_DATAA entry;
+    HANDLE hFind = FindFirstFileA((path + "\\*").c_str(), &entry);
+
+    if(INVALID_HANDLE_VALUE == hFind)
+    {
+        return false;
+    }
+
+    do
+    {
+        names.push_back(entry.cFileName);
+    } while(FindNextFileA(hFind, &entry));
+
+    FindClose(hFind);
+#else // !WIN32
+    DIR *pDir = opendir(path.c_str());
+
+    if(nullptr == pDir)
+    {
+        return false;
+    }
+
+    struct dirent *pEntry;
+
+    while(nullptr != (pEntry = readdir(pDir)))
+    {
+        names.push_back(pEntry->d_name);
+    }
+
+    closedir(pDir);
+#endif // !WIN32
+
+    for(auto name : names)
+    {
+        if("." == name || ".." == name)
+        {
+            continue;
+        }
+
+        std::string child = relative.empty() ? name : (relative + "/" + name);
+
+        if(IsDirectory(root + "/" + child))
+        {
+            result = ListFiles(root, child, files) && result;
+        }
+        else
+        {
+            files.push_back(child);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @internal
+ * Create every missing directory leading up to a file.
+ * @param path Path to the file.
+ * @returns true if the directory of the file exists.
+ */
+static bool MakeParentDirectories(const std::string& path)
+{
+    size_t pos = 0;
+
+    while(std::string::npos != (pos = path.find_first_of("/\\", pos + 1)))
+    {
+        std::string parent = path.substr(0, pos);
+
+#if defined(_WIN32) || defined(_WIN64)
+        if(0 != _mkdir(parent.c_str()) && !IsDirectory(parent))
+#else // !WIN32
+        if(0 != mkdir(parent.c_str(), 0755) && EEXIST != errno)
+#endif // !WIN32
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @internal
+ * Get the path a file in a list is written to under the output directory.
+ * @param path Path to a file as given in the list.
+ * @returns The path itself if it is relative and stays inside the output
+ *   directory; otherwise, everything after the last directory separator.
+ */
+static std::string OutputName(const std::string& path)
+{
+    bool relative = !path.empty() && '/' != path[0] && '\\' != path[0] &&
+        std::string::npos == path.find(':');
+
+    // Drop any "./" in front and give up on anything that leaves the
+    // directory.
+    std::string name = path;
+
+    while(0 == name.compare(0, 2, "./") || 0 == name.compare(0, 2, ".\\"))
+    {
+        name = name.substr(2);
+    }
+
+    size_t start = 0;
+
+    while(relative && start <= name.size())
+    {
+        size_t end = name.find_first_of("/\\", start);
+
+        if(std::string::npos == end)
+        {
+            end = name.size();
+        }
+
+        if(".." == name.substr(start, end - start))
+        {
+            relative = false;
+        }
+
+        start = end + 1;
+    }
+
+    if(relative)
+    {
+        return name;
+    }
+
+    size_t pos = path.find_last_of("/\\");
+
+    return std::string::npos == pos ? path : path.substr(pos + 1);
+}
+
+/**
+ * @internal
+ * Print how the tool is used.
+ * @param szProgram Name of the program.
+ * @returns Exit code for the tool.
+ */
+static int Usage(const char *szProgram)
+{
+    std::cerr << "USAGE: " << szProgram << " IN OUT" << std::endl;
+    std::cerr << "       " << szProgram << " [-j THREADS] IN_DIR OUT_DIR"
+        << std::endl;
+    std::cerr << "       " << szProgram << " [-j THREADS] -l LIST OUT_DIR"
+        << std::endl;
+
+    return EXIT_FAILURE;
+}
+
+bool BatchConvert::ListFiles(const std::string& root,
+    std::list<std::string>& files)
+{
+    return ::ListFiles(root, std::string(), files);
+}
+
+int BatchConvert::Run(int argc, char *argv[], const Convert_t& convert)
+{
+    std::vector<std::string> args;
+    size_t threadCount = 0;
+    bool fileList = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        if("-j" == arg && (i + 1) < argc)
+        {
+            threadCount = (size_t)strtoul(argv[++i], nullptr, 10);
+        }
+        else if("-l" == arg)
+        {
+            fileList = true;
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    if(2 != args.size())
+    {
+        return Usage(argv[0]);
+    }
+
+    std::list<FileJob_t> jobs;
+
+    if(fileList)
+    {
+        std::ifstream list(args[0]);
+        std::string line;
+
+        if(!list.good())
+        {
+            std::cerr << "Failed to open file list: " << args[0] << std::endl;
+
+            return EXIT_FAILURE;
+        }
+
+        while(std::getline(list, line))
+        {
+            // Allow lists written on Windows.
+            if(!line.empty() && '\r' == line.back())
+            {
+                line.pop_back();
+            }
+
+            if(!line.empty())
+            {
+                jobs.push_back(FileJob_t(line, args[1] + "/" +
+                    OutputName(line)));
+            }
+        }
+
+        // Two files written to the same place would overwrite each other.
+        std::map<std::string, std::string> outputs;
+
+        for(auto job : jobs)
+        {
+            auto it = outputs.insert(std::make_pair(job.second, job.first));
+
+            if(!it.second)
+            {
+                std::cerr << "Both " << it.first->second << " and "
+                    << job.first << " would be written to " << job.second
+                    << std::endl;
+
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    else if(IsDirectory(args[0]))
+    {
+        std::list<std::string> files;
+
+        if(!::ListFiles(args[0], std::string(), files))
+        {
+            std::cerr << "Failed to read directory: " << args[0] << std::endl;
+
+            return EXIT_FAILURE;
+        }
+
+        for(auto file : files)
+        {
+            jobs.push_back(FileJob_t(args[0] + "/" + file,
+                args[1] + "/" + file));
+        }
+    }
+    else
+    {
+        uint64_t bytes = 0;
+
+        return convert(args[0], args[1], bytes) ? EXIT_SUCCESS :
+            EXIT_FAILURE;
+    }
+
+    if(jobs.empty())
+    {
+        std::cerr << "No files to convert." << std::endl;
+
+        return EXIT_FAILURE;
+    }
+
+    std::mutex lock;
+    std::condition_variable finished;
+    size_t remaining = jobs.size();
+
+    std::atomic<uint64_t> totalBytes(0);
+    std::atomic<size_t> failures(0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    {
+        libcomp::WorkerPool pool(threadCount, jobs.size());
+
+        threadCount = pool.GetThreadCount();
+
+        for(auto job : jobs)
+        {
+            bool submitted = pool.Submit([&, job]()
+            {
+                uint64_t bytes = 0;
+
+                bool converted = MakeParentDirectories(job.second) &&
+                    convert(job.first, job.second, bytes);
+
+                std::lock_guard<std::mutex> guard(lock);
+
+                if(converted)
+                {
+                    totalBytes += bytes;
+                }
+                else
+                {
+                    failures++;
+
+                    std::cerr << "Failed to convert: " << job.first
+                        << std::endl;
+                }
+
+                remaining--;
+                finished.notify_one();
+            });
+
+            if(!submitted)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+
+                failures++;
+                remaining--;
+
+                std::cerr << "Failed to queue: " << job.first << std::endl;
+            }
+        }
+
+        std::unique_lock<std::mutex> uniqueLock(lock);
+
+        finished.wait(uniqueLock, [&remaining]()
+        {
+            return 0 == remaining;
+        });
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    double megabytes = (double)totalBytes / (1024.0 * 1024.0);
+
+    std::cout << "Converted " << (jobs.size() - failures) << " of "
+        << jobs.size() << " files (" << std::fixed << std::setprecision(2)
+        << megabytes << " MiB) in " << seconds << " s ("
+        << (0.0 < seconds ? megabytes / seconds : 0.0) << " MiB/s) using "
+        << threadCount << " threads" << std::endl;
+
+    return 0 == failures ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file tools/common/src/BatchConvert.h
+ * @ingroup tools
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Batch file conversion shared by the tools.
+ *
+ * This file is part of the COMP_hack Tools.
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOOLS_COMMON_SRC_BATCHCONVERT_H
+#define TOOLS_COMMON_SRC_BATCHCONVERT_H
+
+#include <stdint.h>
+
+// Standard C++11 Includes
+#include <functional>
+#include <list>
+#include <string>
+
+namespace BatchConvert
+{
+
+/**
+ * Convert one file.
+ * @param in Path to the file to read.
+ * @param out Path to the file to write.
+ * @param bytes Set to the number of bytes that were converted.
+ * @returns true if the file was converted.
+ */
+typedef std::function<bool(const std::string& in, const std::string& out,
+    uint64_t& bytes)> Convert_t;
+
+/**
+ * Run a tool that converts files. The command line may be one of:
+ * - IN OUT (convert one file)
+ * - [-j THREADS] IN_DIR OUT_DIR (convert every file under a directory into
+ *   the same layout under the output directory)
+ * - [-j THREADS] -l LIST OUT_DIR (convert every file named in a list, one
+ *   path per line, into the output directory; relative paths keep their
+ *   layout under it and other paths are written by file name)
+ *
+ * Batches are spread over a pool of threads (one per hardware thread by
+ * default) and the throughput is printed when they finish.
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ * @param convert Function that converts one file.
+ * @returns Exit code for the tool.
+ */
+int Run(int argc, char *argv[], const Convert_t& convert);
+
+/**
+ * Find every file under a directory.
+ * @param root Directory to search.
+ * @param files List to add the paths (relative to @em root, separated by
+ *   forward slashes) to.
+ * @returns true if every directory could be read.
+ */
+bool ListFiles(const std::string& root, std::list<std::string>& files);
+
+} // namespace BatchConvert
+
+#endif // TOOLS_COMMON_SRC_BATCHCONVERT_H
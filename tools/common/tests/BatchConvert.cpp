@@ -0,0 +1,210 @@
+/**
+ * @file tools/common/tests/BatchConvert.cpp
+ * @ingroup tools
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Test the batch file conversion shared by the tools.
+ *
+ * This file is part of the COMP_hack Tools.
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PushIgnore.h>
+#include <gtest/gtest.h>
+#include <PopIgnore.h>
+
+#include <BatchConvert.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void WriteFile(const std::string& path, const std::string& data)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << data;
+}
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    return std::string(std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+}
+
+static void RemoveTree(const std::string& path)
+{
+    DIR *pDir = opendir(path.c_str());
+
+    if(nullptr == pDir)
+    {
+        (void)remove(path.c_str());
+
+        return;
+    }
+
+    struct dirent *pEntry;
+    std::list<std::string> names;
+
+    while(nullptr != (pEntry = readdir(pDir)))
+    {
+        std::string name = pEntry->d_name;
+
+        if("." != name && ".." != name)
+        {
+            names.push_back(name);
+        }
+    }
+
+    closedir(pDir);
+
+    for(auto name : names)
+    {
+        RemoveTree(path + "/" + name);
+    }
+
+    (void)rmdir(path.c_str());
+}
+
+/**
+ * Run the tool on a command line with a conversion that copies the file.
+ */
+static int RunCopy(std::vector<std::string> args)
+{
+    std::vector<char*> argv;
+    std::string program = "batch";
+
+    argv.push_back(&program[0]);
+
+    for(auto& arg : args)
+    {
+        argv.push_back(&arg[0]);
+    }
+
+    return BatchConvert::Run((int)argv.size(), &argv[0], [](
+        const std::string& in, const std::string& out, uint64_t& bytes)
+    {
+        std::string data = ReadFile(in);
+
+        if(data.empty())
+        {
+            return false;
+        }
+
+        WriteFile(out, data);
+        bytes = data.size();
+
+        return true;
+    });
+}
+
+TEST(BatchConvert, Directory)
+{
+    const std::string root = "/tmp/batchconvert_dir";
+
+    RemoveTree(root);
+    ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/in").c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/in/a").c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/in/b").c_str(), 0755));
+
+    WriteFile(root + "/in/top.bin", "top");
+    WriteFile(root + "/in/a/same.bin", "first");
+    WriteFile(root + "/in/b/same.bin", "second");
+
+    EXPECT_EQ(EXIT_SUCCESS, RunCopy({ "-j", "2", root + "/in",
+        root + "/out" }));
+
+    // The layout of the input directory is kept.
+    EXPECT_EQ("top", ReadFile(root + "/out/top.bin"));
+    EXPECT_EQ("first", ReadFile(root + "/out/a/same.bin"));
+    EXPECT_EQ("second", ReadFile(root + "/out/b/same.bin"));
+
+    // A file that fails to convert fails the run.
+    WriteFile(root + "/in/empty.bin", "");
+
+    EXPECT_EQ(EXIT_FAILURE, RunCopy({ root + "/in", root + "/out" }));
+
+    RemoveTree(root);
+}
+
+TEST(BatchConvert, List)
+{
+    const std::string root = "/tmp/batchconvert_list";
+
+    RemoveTree(root);
+    ASSERT_EQ(0, mkdir(root.c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/a").c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/b").c_str(), 0755));
+
+    WriteFile(root + "/a/same.bin", "first");
+    WriteFile(root + "/b/same.bin", "second");
+
+    char szCwd[4096];
+    ASSERT_NE(nullptr, getcwd(szCwd, sizeof(szCwd)));
+    ASSERT_EQ(0, chdir(root.c_str()));
+
+    // Relative paths keep their layout under the output directory.
+    WriteFile("relative.txt", "a/same.bin\r\n./b/same.bin\n\n");
+
+    EXPECT_EQ(EXIT_SUCCESS, RunCopy({ "-l", "relative.txt", "out" }));
+    EXPECT_EQ("first", ReadFile("out/a/same.bin"));
+    EXPECT_EQ("second", ReadFile("out/b/same.bin"));
+
+    // Other paths are written by file name so they may not collide.
+    WriteFile("absolute.txt", root + "/a/same.bin\n" +
+        root + "/b/same.bin\n");
+
+    EXPECT_EQ(EXIT_FAILURE, RunCopy({ "-l", "absolute.txt", "out2" }));
+    EXPECT_EQ("", ReadFile("out2/same.bin"));
+
+    WriteFile("absolute.txt", root + "/a/same.bin\n");
+
+    EXPECT_EQ(EXIT_SUCCESS, RunCopy({ "-l", "absolute.txt", "out2" }));
+    EXPECT_EQ("first", ReadFile("out2/same.bin"));
+
+    // A missing list fails.
+    EXPECT_EQ(EXIT_FAILURE, RunCopy({ "-l", "missing.txt", "out3" }));
+
+    ASSERT_EQ(0, chdir(szCwd));
+
+    RemoveTree(root);
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        ::testing::InitGoogleTest(&argc, argv);
+
+        return RUN_ALL_TESTS();
+    }
+    catch(...)
+    {
+        return EXIT_FAILURE;
+    }
+}
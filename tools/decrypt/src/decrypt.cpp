@@ -26,29 +26,39 @@
 
 #include <Decrypt.h>
 
+#include <BatchConvert.h>
+
 #include <fstream>
-#include <iostream>
 #include <cstdlib>
 
-int main(int argc, char *argv[])
+/**
+ * Decrypt a single file.
+ * @param inPath Path to the file to decrypt.
+ * @param outPath Path to write the decrypted file to.
+ * @param bytes Set to the size of the decrypted file.
+ * @returns true if the file was decrypted.
+ */
+static bool DecryptOne(const std::string& inPath, const std::string& outPath,
+    uint64_t& bytes)
 {
-    if(3 != argc)
-    {
-        std::cerr << "USAGE: " << argv[0] << " IN OUT" << std::endl;
-
-        return EXIT_FAILURE;
-    }
-
-    std::vector<char> data = libcomp::Decrypt::DecryptFile(argv[1]);
+    std::ofstream out;
+    out.open(outPath, std::ofstream::out | std::ofstream::binary);
 
-    if(data.empty())
+    // Write each chunk as it is decrypted so big files are never held in
+    // memory.
+    bool decrypted = libcomp::Decrypt::DecryptFile(inPath,
+        [&out, &bytes](const char *pData, size_t size)
     {
-        return EXIT_FAILURE;
-    }
+        out.write(pData, (std::streamsize)size);
+        bytes += size;
 
-    std::ofstream out;
-    out.open(argv[2], std::ofstream::out | std::ofstream::binary);
-    out.write(&data[0], data.size());
+        return out.good();
+    });
+
+    return decrypted && out.good();
+}
 
-    return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+int main(int argc, char *argv[])
+{
+    return BatchConvert::Run(argc, argv, DecryptOne);
 }
@@ -26,18 +26,47 @@
 
 #include <Decrypt.h>
 
-#include <iostream>
+#include <BatchConvert.h>
+
+#include <fstream>
 #include <cstdlib>
 
-int main(int argc, char *argv[])
+/**
+ * Encrypt a single file.
+ * @param inPath Path to the file to encrypt.
+ * @param outPath Path to write the encrypted file to.
+ * @param bytes Set to the size of the file that was encrypted.
+ * @returns true if the file was encrypted.
+ */
+static bool EncryptOne(const std::string& inPath, const std::string& outPath,
+    uint64_t& bytes)
 {
-    if(3 != argc)
-    {
-        std::cerr << "USAGE: " << argv[0] << " IN OUT" << std::endl;
+    std::ifstream in;
+    in.open(inPath, std::ifstream::in | std::ifstream::binary |
+        std::ifstream::ate);
+
+    std::streampos fileSize = in.tellg();
+    in.seekg(0);
 
-        return EXIT_FAILURE;
+    if(!in.good() || 0 >= fileSize || UINT32_MAX < (uint64_t)fileSize)
+    {
+        return false;
     }
 
-    return libcomp::Decrypt::EncryptFile(argv[2], libcomp::Decrypt::LoadFile(
-        argv[1])) ? EXIT_SUCCESS : EXIT_FAILURE;
+    bytes = (uint64_t)fileSize;
+
+    // Read each chunk as it is encrypted so big files are never held in
+    // memory.
+    return libcomp::Decrypt::EncryptFile(outPath,
+        [&in](char *pData, size_t size)
+    {
+        in.read(pData, (std::streamsize)size);
+
+        return (size_t)in.gcount();
+    }, (uint32_t)fileSize);
+}
+
+int main(int argc, char *argv[])
+{
+    return BatchConvert::Run(argc, argv, EncryptOne);
 }
@@ -0,0 +1,95 @@
+/**
+ * @file tools/logdecode/src/logdecode.cpp
+ * @ingroup tools
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Render a binary log file as text.
+ *
+ * This tool reads a log written with libcomp::Log::SetBinaryLogPath and
+ * prints each message with the time and the thread that logged it.
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <LogRecord.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+
+int main(int argc, char *argv[])
+{
+    static const char *szLevels[] = {
+        "DEBUG", "INFO", "WARNING", "ERROR", "CRITICAL",
+    };
+
+    if(2 != argc)
+    {
+        fprintf(stderr, "USAGE: %s LOG\n", argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[1], std::ifstream::binary);
+
+    if(!in.good())
+    {
+        fprintf(stderr, "Failed to open log: %s\n", argv[1]);
+
+        return EXIT_FAILURE;
+    }
+
+    bool ok = libcomp::LogRecord::ReadFile(in, [](
+        const libcomp::LogRecordHeader_t& header, const libcomp::String& msg)
+    {
+        time_t seconds = (time_t)(header.timestamp / 1000000);
+        struct tm local;
+        char szTime[32];
+
+#if defined(_WIN32) || defined(_WIN64)
+        localtime_s(&local, &seconds);
+#else // !WIN32
+        localtime_r(&seconds, &local);
+#endif // WIN32
+
+        strftime(szTime, sizeof(szTime), "%Y-%m-%d %H:%M:%S", &local);
+
+        // Messages usually end with a new line already.
+        libcomp::String text = msg;
+
+        if(!text.IsEmpty() && text.Right(1) != "\n")
+        {
+            text += "\n";
+        }
+
+        printf("%s.%06u [%016" PRIx64 "] %s: %s", szTime,
+            (unsigned)(header.timestamp % 1000000), header.thread,
+            header.level < (sizeof(szLevels) / sizeof(szLevels[0])) ?
+            szLevels[header.level] : "?", text.C());
+    });
+
+    if(!ok)
+    {
+        fprintf(stderr, "The log is damaged or is not a binary log.\n");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file tools/pack/src/pack.cpp
+ * @ingroup tools
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Pack a directory of game data files into one archive.
+ *
+ * This tool writes every file under a directory into an indexed archive
+ * that the servers map with libcomp::DataArchive. With -e the files are
+ * decrypted as they are packed so the servers never decrypt them again.
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <DataArchive.h>
+#include <Decrypt.h>
+
+#include <BatchConvert.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+/**
+ * Print how to use the tool.
+ * @param szProgram Name of the program.
+ * @returns Exit code for the tool.
+ */
+static int Usage(const char *szProgram)
+{
+    std::cerr << "USAGE: " << szProgram << " [-e] IN_DIR ARCHIVE"
+        << std::endl;
+    std::cerr << "  -e  Decrypt the files as they are packed." << std::endl;
+
+    return EXIT_FAILURE;
+}
+
+/**
+ * Read a file as it is.
+ * @param path Path to the file to read.
+ * @param data Set to the contents of the file.
+ * @returns true if the file was read.
+ */
+static bool ReadFile(const std::string& path, std::vector<char>& data)
+{
+    std::ifstream in(path.c_str(), std::ifstream::in |
+        std::ifstream::binary | std::ifstream::ate);
+
+    if(!in.good())
+    {
+        return false;
+    }
+
+    data.resize((size_t)in.tellg());
+    in.seekg(0);
+
+    if(!data.empty())
+    {
+        in.read(&data[0], (std::streamsize)data.size());
+    }
+
+    return in.good();
+}
+
+int main(int argc, char *argv[])
+{
+    bool decrypt = false;
+    int arg = 1;
+
+    if(arg < argc && 0 == strcmp(argv[arg], "-e"))
+    {
+        decrypt = true;
+        arg++;
+    }
+
+    if(2 != argc - arg)
+    {
+        return Usage(argv[0]);
+    }
+
+    std::string root = argv[arg];
+    std::string archivePath = argv[arg + 1];
+    std::list<std::string> files;
+
+    if(!BatchConvert::ListFiles(root, files))
+    {
+        std::cerr << "Failed to read directory: " << root << std::endl;
+
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> names(files.begin(), files.end());
+    uint64_t bytes = 0;
+
+    bool packed = libcomp::DataArchive::Write(archivePath, names,
+        [&root, &bytes, decrypt](const std::string& name,
+            std::vector<char>& data)
+    {
+        std::string path = root + "/" + name;
+
+        if(decrypt)
+        {
+            bool decrypted = libcomp::Decrypt::DecryptFile(path,
+                [&data](const char *pData, size_t size)
+            {
+                data.insert(data.end(), pData, pData + size);
+
+                return true;
+            });
+
+            if(!decrypted)
+            {
+                std::cerr << "Failed to decrypt file: " << path << std::endl;
+
+                return false;
+            }
+        }
+        else if(!ReadFile(path, data))
+        {
+            std::cerr << "Failed to read file: " << path << std::endl;
+
+            return false;
+        }
+
+        bytes += data.size();
+
+        return true;
+    });
+
+    if(!packed)
+    {
+        std::cerr << "Failed to write archive: " << archivePath << std::endl;
+
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Packed " << names.size() << " files (" << bytes
+        << " bytes) into " << archivePath << std::endl;
+
+    return EXIT_SUCCESS;
+}
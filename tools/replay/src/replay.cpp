@@ -0,0 +1,335 @@
+/**
+ * @file tools/replay/src/replay.cpp
+ * @ingroup tools
+ *
+ * @author COMP Omega <compomega@tutanota.com>
+ *
+ * @brief Replay a packet capture against a server.
+ *
+ * This tool opens one connection for each connection in a capture made
+ * with libcomp::PacketCapture and sends the recorded commands on the
+ * recorded schedule (optionally sped up).
+ *
+ * Copyright (C) 2012-2016 COMP_hack Team <compomega@tutanota.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <LobbyConnection.h>
+#include <Message.h>
+#include <MessageQueue.h>
+#include <PacketCaptureReader.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * Client connection that holds back the recorded commands until the
+ * handshake is done. Every method is called on the io thread.
+ */
+class ReplaySession : public libcomp::LobbyConnection
+{
+public:
+    explicit ReplaySession(asio::io_service& service) :
+        libcomp::LobbyConnection(service), mEncrypted(false),
+        mClosed(false)
+    {
+    }
+
+    void Send(uint16_t commandCode, const std::vector<char>& data)
+    {
+        if(mClosed)
+        {
+            gSkipped++;
+        }
+        else if(mEncrypted)
+        {
+            Write(commandCode, data);
+        }
+        else
+        {
+            mPending.push_back(std::make_pair(commandCode, data));
+        }
+    }
+
+    void Close()
+    {
+        if(!mClosed)
+        {
+            mClosed = true;
+            gSkipped += mPending.size();
+            mPending.clear();
+
+            SocketError();
+        }
+    }
+
+    /// Commands sent to the server.
+    static std::atomic<uint64_t> gSent;
+
+    /// Commands not sent because the session failed.
+    static std::atomic<uint64_t> gSkipped;
+
+    /// Sessions that failed before the capture closed them.
+    static std::atomic<uint64_t> gFailed;
+
+protected:
+    virtual void ConnectionEncrypted()
+    {
+        libcomp::LobbyConnection::ConnectionEncrypted();
+
+        mEncrypted = true;
+
+        for(auto& command : mPending)
+        {
+            Write(command.first, command.second);
+        }
+
+        mPending.clear();
+    }
+
+    virtual void ConnectionFailed()
+    {
+        libcomp::LobbyConnection::ConnectionFailed();
+
+        Failed();
+    }
+
+    virtual void SocketError(const libcomp::String& errorMessage =
+        libcomp::String())
+    {
+        libcomp::LobbyConnection::SocketError(errorMessage);
+
+        Failed();
+    }
+
+private:
+    void Write(uint16_t commandCode, const std::vector<char>& data)
+    {
+        if(SendEncrypted(commandCode, data.empty() ? nullptr : &data[0],
+            (uint16_t)data.size()))
+        {
+            gSent++;
+        }
+        else
+        {
+            gSkipped++;
+        }
+    }
+
+    void Failed()
+    {
+        if(!mClosed)
+        {
+            mClosed = true;
+            gFailed++;
+            gSkipped += mPending.size();
+            mPending.clear();
+        }
+    }
+
+    bool mEncrypted;
+    bool mClosed;
+
+    /// Commands recorded before the handshake finished.
+    std::deque<std::pair<uint16_t, std::vector<char>>> mPending;
+};
+
+std::atomic<uint64_t> ReplaySession::gSent(0);
+std::atomic<uint64_t> ReplaySession::gSkipped(0);
+std::atomic<uint64_t> ReplaySession::gFailed(0);
+
+int main(int argc, char *argv[])
+{
+    if(4 > argc || 5 < argc)
+    {
+        fprintf(stderr, "USAGE: %s CAPTURE HOST PORT [SPEED]\n", argv[0]);
+        fprintf(stderr, "SPEED is how many times faster than the capture "
+            "to replay (default 1).\n");
+
+        return EXIT_FAILURE;
+    }
+
+    libcomp::String host(argv[2]);
+    int port = atoi(argv[3]);
+    double speed = 5 == argc ? atof(argv[4]) : 1.0;
+
+    if(0 >= port || 0 >= speed)
+    {
+        fprintf(stderr, "Invalid port or speed.\n");
+
+        return EXIT_FAILURE;
+    }
+
+    libcomp::PacketCaptureReader reader;
+
+    if(!reader.Open(argv[1]))
+    {
+        fprintf(stderr, "Failed to open capture: %s\n", argv[1]);
+
+        return EXIT_FAILURE;
+    }
+
+    // Load the whole capture so reading the file never delays a command.
+    std::vector<libcomp::PacketCaptureRecord_t> records;
+    libcomp::PacketCaptureRecord_t record;
+
+    while(reader.Next(record))
+    {
+        records.push_back(std::move(record));
+    }
+
+    reader.Close();
+
+    printf("Replaying %u records at %gx\n", (unsigned int)records.size(),
+        speed);
+
+    asio::io_service service;
+    std::unique_ptr<asio::io_service::work> work(
+        new asio::io_service::work(service));
+    std::thread serviceThread([&service]()
+    {
+        service.run();
+    });
+
+    // Throw away the replies (but count them).
+    auto replies = std::make_shared<libcomp::MessageQueue<
+        libcomp::Message::Message*>>();
+    uint64_t replyCount = 0;
+
+    std::thread replyThread([&replies, &replyCount]()
+    {
+        while(true)
+        {
+            libcomp::Message::Handle message(replies->Dequeue());
+
+            if(!message)
+            {
+                break;
+            }
+
+            replyCount++;
+        }
+    });
+
+    std::unordered_map<uint64_t, std::shared_ptr<ReplaySession>> sessions;
+    uint64_t sessionCount = 0;
+    uint64_t maxLag = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(auto& next : records)
+    {
+        auto due = start + std::chrono::microseconds((uint64_t)(
+            (double)next.timestamp / speed));
+        auto now = std::chrono::steady_clock::now();
+
+        if(due > now)
+        {
+            std::this_thread::sleep_until(due);
+        }
+        else
+        {
+            maxLag = std::max(maxLag, (uint64_t)std::chrono::duration_cast<
+                std::chrono::microseconds>(now - due).count());
+        }
+
+        auto it = sessions.find(next.connectionID);
+        std::shared_ptr<ReplaySession> session = sessions.end() != it ?
+            it->second : nullptr;
+
+        if(libcomp::PacketCapture::TYPE_CLOSE == next.type)
+        {
+            if(session)
+            {
+                service.post([session]()
+                {
+                    session->Close();
+                });
+
+                sessions.erase(it);
+            }
+
+            continue;
+        }
+
+        // The capture may have started after a connection was opened.
+        if(!session)
+        {
+            session = std::make_shared<ReplaySession>(service);
+            session->SetSelf(session);
+            session->SetMessageQueue(replies);
+            sessionCount++;
+
+            if(!session->Connect(host, port))
+            {
+                ReplaySession::gFailed++;
+            }
+
+            sessions[next.connectionID] = session;
+        }
+
+        if(libcomp::PacketCapture::TYPE_COMMAND == next.type)
+        {
+            uint16_t commandCode = next.commandCode;
+            std::vector<char> data = std::move(next.data);
+
+            service.post([session, commandCode, data]()
+            {
+                session->Send(commandCode, data);
+            });
+        }
+    }
+
+    // Let the last replies arrive before closing what is still open.
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    for(auto& pair : sessions)
+    {
+        std::shared_ptr<ReplaySession> session = pair.second;
+
+        service.post([session]()
+        {
+            session->Close();
+        });
+    }
+
+    sessions.clear();
+    work.reset();
+    serviceThread.join();
+
+    replies->Enqueue(nullptr);
+    replyThread.join();
+
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    printf("Sessions: %llu opened, %llu failed\n",
+        (unsigned long long)sessionCount,
+        (unsigned long long)ReplaySession::gFailed);
+    printf("Commands: %llu sent, %llu skipped, %llu replies in %.3f s\n",
+        (unsigned long long)ReplaySession::gSent,
+        (unsigned long long)ReplaySession::gSkipped,
+        (unsigned long long)replyCount, elapsed);
+    printf("Largest delay behind the schedule: %llu us\n",
+        (unsigned long long)maxLag);
+
+    return 0 == ReplaySession::gFailed ? EXIT_SUCCESS : EXIT_FAILURE;
+}